@@ -151,6 +151,7 @@ static uint64_t timestamp_highest = TS_CLOCK_MAX;
 static uint64_t seek = 0;
 static uint64_t sequence = 0;
 static uint64_t mux_max_delay = UINT64_MAX;
+static bool abr = false;
 static struct upipe *src = NULL;
 static struct upipe *hls = NULL;
 static struct upipe *variant = NULL;
@@ -764,6 +765,19 @@ static int catch_variant(struct uprobe *uprobe,
     struct uprobe_variant *probe_variant =
         uprobe_variant_from_uprobe(uprobe);
 
+    if (event >= UPROBE_LOCAL &&
+        ubase_get_signature(args) == UPIPE_HLS_MASTER_SIGNATURE) {
+        switch (event) {
+        case UPROBE_HLS_MASTER_SWITCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+            struct uref *uref = va_arg(args, struct uref *);
+            /* the variant is replaced at the end of the current item */
+            return uref_flow_get_id(uref, &variant_id);
+        }
+        }
+        return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+
     switch (event) {
     case UPROBE_SPLIT_UPDATE: {
         struct uref *uref_video = NULL;
@@ -914,6 +928,12 @@ static int catch_variant(struct uprobe *uprobe,
         if (!video_output.pipe && !audio_output.pipe)
             cmd_quit();
 
+        /* the playlists time the downloads for the adaptive selection */
+        if (abr && video_output.pipe)
+            upipe_attach_uclock(video_output.pipe);
+        if (abr && audio_output.pipe && audio_output.pipe != video_output.pipe)
+            upipe_attach_uclock(audio_output.pipe);
+
         return UBASE_ERR_NONE;
     }
     }
@@ -968,6 +988,9 @@ static int catch_hls(struct uprobe *uprobe,
             uref_dump(uref, uprobe);
         }
 
+        if (abr && !ubase_check(upipe_hls_master_set_abr(upipe, true)))
+            uprobe_warn(uprobe, NULL, "adaptive selection unavailable");
+
         ret = select_variant(uprobe);
         if (!ubase_check(ret))
             cmd_quit();
@@ -1223,6 +1246,7 @@ enum opt {
     OPT_DUMP,
     OPT_HELP,
     OPT_MUX_MAX_DELAY,
+    OPT_ABR,
 };
 
 static struct option options[] = {
@@ -1249,6 +1273,7 @@ static struct option options[] = {
     { "dump", required_argument, NULL, OPT_DUMP },
     { "help", no_argument, NULL, OPT_HELP },
     { "mux-max-delay", required_argument, NULL, OPT_MUX_MAX_DELAY },
+    { "abr", no_argument, NULL, OPT_ABR },
     { 0, 0, 0, 0 },
 };
 
@@ -1372,6 +1397,9 @@ int main(int argc, char **argv)
         case OPT_MUX_MAX_DELAY:
             mux_max_delay = strtoull(optarg, NULL, 10);
             break;
+        case OPT_ABR:
+            abr = true;
+            break;
 
         case OPT_HELP:
             usage(argv[0], NULL);
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/** @file
+ * @short prints the counters exported by a live upipe process
+ *
+ * The stats segment of the process (see uprobe_ustats) is mapped read-only,
+ * so the monitored process is never slowed down.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ustats.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <ctype.h>
+
+static void usage(const char *argv0) {
+    fprintf(stdout, "Usage: %s [-a] [-i <interval>] [-n <count>] <pid|segment>\n", argv0);
+    fprintf(stdout, "   -a: aggregate the records of all pipes by metric\n");
+    fprintf(stdout, "   -i: print the counters every <interval> seconds, with their rates\n");
+    fprintf(stdout, "   -n: stop after <count> iterations\n");
+    exit(EXIT_FAILURE);
+}
+
+/** current and previous samples */
+static struct ustats_sample *samples, *previous;
+/** validity of the samples */
+static bool *valid, *previous_valid;
+
+/** returns the metric of a record, that is the part after the last dot */
+static const char *metric(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return dot != NULL ? dot + 1 : name;
+}
+
+/** prints a sample */
+static void print_sample(const struct ustats_sample *sample,
+                         const struct ustats_sample *old, double interval)
+{
+    switch (sample->type) {
+        case USTATS_COUNTER:
+            printf("%-48s %-8s %"PRIu64, sample->name, "counter",
+                   sample->value);
+            if (old != NULL && interval > 0 && sample->value >= old->value)
+                printf(" (%.1f/s)", (sample->value - old->value) / interval);
+            break;
+        case USTATS_GAUGE:
+            printf("%-48s %-8s %"PRIu64, sample->name, "gauge",
+                   sample->value);
+            break;
+        case USTATS_RATIO:
+            printf("%-48s %-8s %"PRIu64"/%"PRIu64" (%.2f%%)", sample->name,
+                   "ratio", sample->value, sample->total,
+                   sample->total ? 100. * sample->value / sample->total : 0.);
+            break;
+        default:
+            return;
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool aggregate = false;
+    unsigned int interval = 0;
+    unsigned int count = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ai:n:")) != -1) {
+        switch (opt) {
+            case 'a':
+                aggregate = true;
+                break;
+            case 'i':
+                interval = strtoul(optarg, NULL, 0);
+                count = 0;
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    const char *target = argv[optind];
+    char name[64];
+    if (isdigit(target[0]))
+        snprintf(name, sizeof(name), "/upipe-%s", target);
+    else
+        snprintf(name, sizeof(name), "%s", target);
+
+    struct ustats *ustats = ustats_attach(name);
+    if (ustats == NULL) {
+        fprintf(stderr, "unable to attach to stats segment %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned int nb_records = ustats_nb_records(ustats);
+    samples = calloc(nb_records, sizeof(struct ustats_sample));
+    previous = calloc(nb_records, sizeof(struct ustats_sample));
+    valid = calloc(nb_records, sizeof(bool));
+    previous_valid = calloc(nb_records, sizeof(bool));
+    if (samples == NULL || previous == NULL || valid == NULL ||
+        previous_valid == NULL) {
+        fprintf(stderr, "allocation error\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned int iteration = 0; !count || iteration < count;
+         iteration++) {
+        if (iteration)
+            sleep(interval);
+
+        for (unsigned int i = 0; i < nb_records; i++)
+            valid[i] = ubase_check(ustats_read(ustats, i, &samples[i]));
+
+        if (aggregate) {
+            /* sum the records of the same metric and type, and the previous
+             * samples of the same records */
+            bool done[nb_records];
+            memset(done, 0, sizeof(done));
+            for (unsigned int i = 0; i < nb_records; i++) {
+                if (!valid[i] || done[i])
+                    continue;
+                struct ustats_sample sum = samples[i];
+                struct ustats_sample old_sum = sum;
+                snprintf(sum.name, sizeof(sum.name), "%s",
+                         metric(samples[i].name));
+                old_sum.value = old_sum.total = 0;
+                bool has_old = interval > 0;
+                for (unsigned int j = i; j < nb_records; j++) {
+                    if (!valid[j] || done[j] || samples[j].type != sum.type ||
+                        strcmp(metric(samples[j].name), sum.name))
+                        continue;
+                    done[j] = true;
+                    if (j != i) {
+                        sum.value += samples[j].value;
+                        sum.total += samples[j].total;
+                    }
+                    if (previous_valid[j] &&
+                        !strcmp(previous[j].name, samples[j].name)) {
+                        old_sum.value += previous[j].value;
+                        old_sum.total += previous[j].total;
+                    } else
+                        has_old = false;
+                }
+                print_sample(&sum, has_old ? &old_sum : NULL, interval);
+            }
+        } else {
+            for (unsigned int i = 0; i < nb_records; i++) {
+                if (!valid[i])
+                    continue;
+                bool has_old = previous_valid[i] &&
+                    !strcmp(previous[i].name, samples[i].name);
+                print_sample(&samples[i], has_old ? &previous[i] : NULL,
+                             interval);
+            }
+        }
+        if (interval)
+            printf("\n");
+        fflush(stdout);
+
+        struct ustats_sample *tmp = previous;
+        previous = samples;
+        samples = tmp;
+        bool *tmp_valid = previous_valid;
+        previous_valid = valid;
+        valid = tmp_valid;
+    }
+
+    free(samples);
+    free(previous);
+    free(valid);
+    free(previous_valid);
+    ustats_close(ustats);
+    return 0;
+}
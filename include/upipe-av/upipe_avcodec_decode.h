@@ -37,14 +37,187 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define UPIPE_AVCDEC_SIGNATURE UBASE_FOURCC('a', 'v', 'c', 'd')
 
+/** @This defines the threading models of the decoder. */
+enum upipe_avcdec_thread_type {
+    /** let libavcodec choose */
+    UPIPE_AVCDEC_THREAD_AUTO = 0,
+    /** frame threading (higher throughput, one frame of latency per thread) */
+    UPIPE_AVCDEC_THREAD_FRAME,
+    /** slice threading (no additional latency) */
+    UPIPE_AVCDEC_THREAD_SLICE
+};
+
+/** @This is the number of buckets of the decode latency histogram. Bucket 0
+ * counts latencies below 1 ms, bucket i counts latencies between
+ * 2^(i-1) and 2^i ms, and the last bucket counts everything above. */
+#define UPIPE_AVCDEC_LATENCY_BUCKETS 12
+
+/** @This describes the measured decode latency, that is the time between
+ * the input of a packet and the output of the corresponding frame. */
+struct upipe_avcdec_latency {
+    /** number of measured frames */
+    uint64_t count;
+    /** minimum latency in @ref #UCLOCK_FREQ units */
+    uint64_t min;
+    /** maximum latency in @ref #UCLOCK_FREQ units */
+    uint64_t max;
+    /** sum of all latencies in @ref #UCLOCK_FREQ units */
+    uint64_t sum;
+    /** histogram */
+    uint64_t buckets[UPIPE_AVCDEC_LATENCY_BUCKETS];
+};
+
+/** @This extends upipe_command with specific commands for avcdec. */
+enum upipe_avcdec_command {
+    UPIPE_AVCDEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the threading model (int, unsigned int) */
+    UPIPE_AVCDEC_SET_THREADING,
+    /** gets the threading model (int *, unsigned int *) */
+    UPIPE_AVCDEC_GET_THREADING,
+    /** enables or disables low latency mode (int) */
+    UPIPE_AVCDEC_SET_LOW_LATENCY,
+    /** gets the measured decode latency (struct upipe_avcdec_latency *) */
+    UPIPE_AVCDEC_GET_LATENCY
+};
+
+/** @This converts @ref upipe_avcdec_command to a string.
+ *
+ * @param command command to convert
+ * @return a string or NULL if invalid
+ */
+static inline const char *upipe_avcdec_command_str(int command)
+{
+    switch ((enum upipe_avcdec_command)command) {
+        UBASE_CASE_TO_STR(UPIPE_AVCDEC_SET_THREADING);
+        UBASE_CASE_TO_STR(UPIPE_AVCDEC_GET_THREADING);
+        UBASE_CASE_TO_STR(UPIPE_AVCDEC_SET_LOW_LATENCY);
+        UBASE_CASE_TO_STR(UPIPE_AVCDEC_GET_LATENCY);
+        case UPIPE_AVCDEC_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This sets the threading model of the decoder. It only takes effect
+ * before the codec is opened, that is before the first packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type threading model
+ * @param thread_count number of threads, or 0 for automatic
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_threading(struct upipe *upipe,
+        enum upipe_avcdec_thread_type thread_type, unsigned int thread_count)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_THREADING,
+                         UPIPE_AVCDEC_SIGNATURE, (int)thread_type,
+                         thread_count);
+}
+
+/** @This gets the threading model of the decoder. Once the codec is opened,
+ * the thread count is the number of threads actually granted.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with the threading model
+ * @param thread_count_p filled in with the number of threads
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_threading(struct upipe *upipe,
+        enum upipe_avcdec_thread_type *thread_type_p,
+        unsigned int *thread_count_p)
+{
+    int thread_type;
+    int err = upipe_control(upipe, UPIPE_AVCDEC_GET_THREADING,
+                            UPIPE_AVCDEC_SIGNATURE, &thread_type,
+                            thread_count_p);
+    if (ubase_check(err) && thread_type_p != NULL)
+        *thread_type_p = (enum upipe_avcdec_thread_type)thread_type;
+    return err;
+}
+
+/** @This enables or disables low latency mode. In low latency mode, slice
+ * threading is forced, and the latency reported in the flow definition is
+ * derived from the measured decode latency instead of being estimated. It
+ * requires a uclock. It only takes effect before the codec is opened.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled true to enable low latency mode
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_low_latency(struct upipe *upipe,
+                                               bool enabled)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_LOW_LATENCY,
+                         UPIPE_AVCDEC_SIGNATURE, enabled ? 1 : 0);
+}
+
+/** @This gets the measured decode latency. Latency is only measured in
+ * low latency mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param latency filled in with the measured latency
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_latency(struct upipe *upipe,
+                                           struct upipe_avcdec_latency *latency)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_GET_LATENCY,
+                         UPIPE_AVCDEC_SIGNATURE, latency);
+}
+
 /** @This returns the management structure for all avcodec decode pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_avcdec_mgr_alloc(void);
 
+/** @This extends upipe_mgr_command with specific commands for avcdec. */
+enum upipe_avcdec_mgr_command {
+    UPIPE_AVCDEC_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
+
+    /** sets the process-wide decoder thread budget (unsigned int) */
+    UPIPE_AVCDEC_MGR_SET_THREAD_BUDGET,
+    /** gets the process-wide decoder thread budget
+     * (unsigned int *, unsigned int *) */
+    UPIPE_AVCDEC_MGR_GET_THREAD_BUDGET
+};
+
+/** @This sets the maximum number of decoding threads shared by all avcdec
+ * pipes of the process. Each decoder is granted at least one thread, and
+ * at most the remaining budget, when its codec is opened. 0 disables the
+ * budget (default).
+ *
+ * @param mgr pointer to manager
+ * @param budget maximum number of threads
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_set_thread_budget(struct upipe_mgr *mgr,
+                                                     unsigned int budget)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_SET_THREAD_BUDGET,
+                             UPIPE_AVCDEC_SIGNATURE, budget);
+}
+
+/** @This gets the process-wide decoder thread budget.
+ *
+ * @param mgr pointer to manager
+ * @param budget_p filled in with the maximum number of threads
+ * @param used_p filled in with the number of threads currently granted
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_get_thread_budget(struct upipe_mgr *mgr,
+                                                     unsigned int *budget_p,
+                                                     unsigned int *used_p)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_GET_THREAD_BUDGET,
+                             UPIPE_AVCDEC_SIGNATURE, budget_p, used_p);
+}
+
 #ifdef __cplusplus
 }
 #endif
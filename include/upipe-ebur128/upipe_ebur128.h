@@ -44,6 +44,98 @@ UREF_ATTR_FLOAT(ebur128, global, "ebur128.global", global integrated loudness)
 
 #define UPIPE_EBUR128_SIGNATURE UBASE_FOURCC('r', '1', '2', '8')
 
+/** @This extends @ref upipe_command with specific commands for
+ * ebur128 pipes.
+ */
+enum upipe_ebur128_command {
+    UPIPE_EBUR128_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** set the momentary loudness reporting interval (uint64_t) */
+    UPIPE_EBUR128_SET_MOMENTARY_INTERVAL,
+    /** get the momentary loudness reporting interval (uint64_t *) */
+    UPIPE_EBUR128_GET_MOMENTARY_INTERVAL,
+    /** set the integrated loudness and range reporting interval (uint64_t) */
+    UPIPE_EBUR128_SET_INTEGRATED_INTERVAL,
+    /** get the integrated loudness and range reporting interval
+     * (uint64_t *) */
+    UPIPE_EBUR128_GET_INTEGRATED_INTERVAL
+};
+
+/** @This converts @ref upipe_ebur128_command to a string.
+ *
+ * @param command command to convert
+ * @return a string or NULL if invalid
+ */
+static inline const char *upipe_ebur128_command_str(int command)
+{
+    switch ((enum upipe_ebur128_command)command) {
+        UBASE_CASE_TO_STR(UPIPE_EBUR128_SET_MOMENTARY_INTERVAL);
+        UBASE_CASE_TO_STR(UPIPE_EBUR128_GET_MOMENTARY_INTERVAL);
+        UBASE_CASE_TO_STR(UPIPE_EBUR128_SET_INTEGRATED_INTERVAL);
+        UBASE_CASE_TO_STR(UPIPE_EBUR128_GET_INTEGRATED_INTERVAL);
+        case UPIPE_EBUR128_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This sets the interval between two momentary loudness reports. The
+ * attribute is only set on the first buffer after the interval elapsed.
+ * 0 means the attribute is set on every buffer (default).
+ *
+ * @param upipe description structure of the pipe
+ * @param interval interval in @ref #UCLOCK_FREQ units
+ * @return an error code
+ */
+static inline int upipe_ebur128_set_momentary_interval(struct upipe *upipe,
+                                                       uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_SET_MOMENTARY_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval);
+}
+
+/** @This gets the interval between two momentary loudness reports.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval in @ref #UCLOCK_FREQ units
+ * @return an error code
+ */
+static inline int upipe_ebur128_get_momentary_interval(struct upipe *upipe,
+                                                       uint64_t *interval_p)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_GET_MOMENTARY_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval_p);
+}
+
+/** @This sets the interval between two integrated loudness and loudness
+ * range reports. Those values are computed from the loudness histogram, so
+ * a larger interval directly saves CPU. 0 means the attributes are set on
+ * every buffer (default).
+ *
+ * @param upipe description structure of the pipe
+ * @param interval interval in @ref #UCLOCK_FREQ units
+ * @return an error code
+ */
+static inline int upipe_ebur128_set_integrated_interval(struct upipe *upipe,
+                                                        uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_SET_INTEGRATED_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval);
+}
+
+/** @This gets the interval between two integrated loudness and loudness
+ * range reports.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval in @ref #UCLOCK_FREQ units
+ * @return an error code
+ */
+static inline int upipe_ebur128_get_integrated_interval(struct upipe *upipe,
+                                                        uint64_t *interval_p)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_GET_INTEGRATED_INTERVAL,
+                         UPIPE_EBUR128_SIGNATURE, interval_p);
+}
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
@@ -33,6 +33,158 @@ extern "C" {
 #define UPIPE_HLS_MASTER_SIGNATURE      UBASE_FOURCC('h','l','s','M')
 #define UPIPE_HLS_MASTER_SUB_SIGNATURE  UBASE_FOURCC('h','l','s','m')
 
+/** @This is the state of the adaptive variant selection. */
+struct upipe_hls_master_abr_stats {
+    /** number of throughput samples */
+    uint64_t samples;
+    /** exponentially weighted moving average of the throughput in bps */
+    uint64_t ewma;
+    /** harmonic mean of the last throughput samples in bps */
+    uint64_t harmonic;
+    /** throughput estimate used for the selection in bps */
+    uint64_t estimate;
+    /** buffered duration in 27MHz ticks, UINT64_MAX if unknown */
+    uint64_t buffer;
+    /** number of variant switches */
+    uint64_t switches;
+};
+
+/** @This extends @ref upipe_command with specific hls master commands. */
+enum upipe_hls_master_command {
+    UPIPE_HLS_MASTER_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** enable or disable the adaptive variant selection (int) */
+    UPIPE_HLS_MASTER_SET_ABR,
+    /** set the buffer pipe to watch (struct upipe *) */
+    UPIPE_HLS_MASTER_SET_BUFFER,
+    /** add a throughput sample (uint64_t, uint64_t) */
+    UPIPE_HLS_MASTER_ADD_SAMPLE,
+    /** select a variant (uint64_t, struct uref **) */
+    UPIPE_HLS_MASTER_SELECT,
+    /** get the adaptive selection state
+     * (struct upipe_hls_master_abr_stats *) */
+    UPIPE_HLS_MASTER_GET_ABR_STATS,
+};
+
+/** @This converts hls master specific command to a string.
+ *
+ * @param cmd @ref upipe_command to convert
+ * @return a string or NULL if not a valid @ref upipe_hls_master_command
+ */
+static inline const char *upipe_hls_master_command_str(int cmd)
+{
+    switch ((enum upipe_hls_master_command)cmd) {
+    UBASE_CASE_TO_STR(UPIPE_HLS_MASTER_SET_ABR);
+    UBASE_CASE_TO_STR(UPIPE_HLS_MASTER_SET_BUFFER);
+    UBASE_CASE_TO_STR(UPIPE_HLS_MASTER_ADD_SAMPLE);
+    UBASE_CASE_TO_STR(UPIPE_HLS_MASTER_SELECT);
+    UBASE_CASE_TO_STR(UPIPE_HLS_MASTER_GET_ABR_STATS);
+    case UPIPE_HLS_MASTER_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This enables or disables the adaptive variant selection. When enabled,
+ * the variant sub pipes throw @ref UPROBE_HLS_MASTER_SWITCH at item
+ * boundaries when another variant fits the estimated throughput better.
+ * The downloads are only timed if a uclock is attached to the renditions
+ * of the variant, see @ref upipe_attach_uclock.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled true to enable
+ * @return an error code
+ */
+static inline int upipe_hls_master_set_abr(struct upipe *upipe, bool enabled)
+{
+    return upipe_control(upipe, UPIPE_HLS_MASTER_SET_ABR,
+                         UPIPE_HLS_MASTER_SIGNATURE, enabled ? 1 : 0);
+}
+
+/** @This sets the hls buffer pipe whose occupancy is used to hold
+ * switches.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer hls buffer pipe or NULL
+ * @return an error code
+ */
+static inline int upipe_hls_master_set_buffer(struct upipe *upipe,
+                                              struct upipe *buffer)
+{
+    return upipe_control(upipe, UPIPE_HLS_MASTER_SET_BUFFER,
+                         UPIPE_HLS_MASTER_SIGNATURE, buffer);
+}
+
+/** @This adds a throughput sample. Samples are added automatically from
+ * the playlists of the variant sub pipes.
+ *
+ * @param upipe description structure of the pipe
+ * @param bytes number of downloaded bytes
+ * @param duration download duration in 27MHz ticks
+ * @return an error code
+ */
+static inline int upipe_hls_master_add_sample(struct upipe *upipe,
+                                              uint64_t bytes,
+                                              uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_HLS_MASTER_ADD_SAMPLE,
+                         UPIPE_HLS_MASTER_SIGNATURE, bytes, duration);
+}
+
+/** @This selects the variant to play according to the current estimate.
+ *
+ * @param upipe description structure of the pipe
+ * @param current flow id of the playing variant or UINT64_MAX
+ * @param variant_p filled with the selected variant
+ * @return an error code
+ */
+static inline int upipe_hls_master_select(struct upipe *upipe,
+                                          uint64_t current,
+                                          struct uref **variant_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_MASTER_SELECT,
+                         UPIPE_HLS_MASTER_SIGNATURE, current, variant_p);
+}
+
+/** @This gets the adaptive selection state.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled with the current state
+ * @return an error code
+ */
+static inline int upipe_hls_master_get_abr_stats(
+        struct upipe *upipe, struct upipe_hls_master_abr_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_HLS_MASTER_GET_ABR_STATS,
+                         UPIPE_HLS_MASTER_SIGNATURE, stats);
+}
+
+/** @This extends @ref uprobe_event with specific hls master events. */
+enum uprobe_hls_master_event {
+    UPROBE_HLS_MASTER_SENTINEL = UPROBE_LOCAL,
+
+    /** a variant is being selected, the probe may change the selected
+     * flow id (const struct upipe_hls_master_abr_stats *, uint64_t,
+     * uint64_t *) */
+    UPROBE_HLS_MASTER_ABR_SELECT,
+    /** the playing variant should be replaced (struct uref *) */
+    UPROBE_HLS_MASTER_SWITCH,
+};
+
+/** @This converts hls master specific event to a string.
+ *
+ * @param event @ref uprobe_event to convert
+ * @return a string or NULL if not a valid @ref uprobe_hls_master_event
+ */
+static inline const char *uprobe_hls_master_event_str(int event)
+{
+    switch ((enum uprobe_hls_master_event)event) {
+    UBASE_CASE_TO_STR(UPROBE_HLS_MASTER_ABR_SELECT);
+    UBASE_CASE_TO_STR(UPROBE_HLS_MASTER_SWITCH);
+    case UPROBE_HLS_MASTER_SENTINEL: break;
+    }
+    return NULL;
+}
+
 /** @This allocates a hls master pipe manager.
  *
  * @return the pipe manager.
@@ -36,6 +36,23 @@ extern "C" {
 
 #define UPIPE_HLS_PLAYLIST_SIGNATURE UBASE_FOURCC('m','3','u','p')
 
+/** @This stores the download statistics of a playlist. Download times are
+ * only measured once a uclock is attached with @ref upipe_attach_uclock. */
+struct upipe_hls_playlist_stats {
+    /** number of downloaded items */
+    uint64_t items;
+    /** number of downloaded bytes */
+    uint64_t bytes;
+    /** cumulated download time in 27MHz ticks */
+    uint64_t duration;
+    /** throughput of the last downloaded item in bits per second */
+    uint64_t throughput;
+    /** number of items played from the prefetch buffer */
+    uint64_t prefetched;
+    /** number of times a prefetched download was paused by the budget */
+    uint64_t paused;
+};
+
 /** @This extends @ref upipe_command with specific m3u playlist command. */
 enum upipe_hls_playlist_command {
     UPIPE_HLS_PLAYLIST_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -50,6 +67,11 @@ enum upipe_hls_playlist_command {
     UPIPE_HLS_PLAYLIST_NEXT,
     /** seek to this offset (uint64_t) */
     UPIPE_HLS_PLAYLIST_SEEK,
+    /** set the number of items to prefetch and the maximum number of
+     * prefetched bytes (unsigned int, uint64_t) */
+    UPIPE_HLS_PLAYLIST_SET_PREFETCH,
+    /** get the download statistics (struct upipe_hls_playlist_stats *) */
+    UPIPE_HLS_PLAYLIST_GET_STATS,
 };
 
 /** @This converts m3u playlist specific command to a string.
@@ -66,6 +88,8 @@ static inline const char *upipe_hls_playlist_command_str(int cmd)
     UBASE_CASE_TO_STR(UPIPE_HLS_PLAYLIST_PLAY);
     UBASE_CASE_TO_STR(UPIPE_HLS_PLAYLIST_NEXT);
     UBASE_CASE_TO_STR(UPIPE_HLS_PLAYLIST_SEEK);
+    UBASE_CASE_TO_STR(UPIPE_HLS_PLAYLIST_SET_PREFETCH);
+    UBASE_CASE_TO_STR(UPIPE_HLS_PLAYLIST_GET_STATS);
     case UPIPE_HLS_PLAYLIST_SENTINEL: break;
     }
     return NULL;
@@ -135,6 +159,37 @@ static inline int upipe_hls_playlist_seek(struct upipe *upipe, uint64_t at,
                          UPIPE_HLS_PLAYLIST_SIGNATURE, at, offset_p);
 }
 
+/** @This sets the number of items downloaded in advance while the current
+ * item is playing. Once the prefetched data reaches the given budget, the
+ * prefetched downloads are paused and no new download is started until an
+ * item is played. Only items sharing the current key are prefetched.
+ *
+ * @param upipe description structure of the pipe
+ * @param count number of items to prefetch, 0 to disable prefetching
+ * @param max_size maximum number of prefetched bytes
+ * @return an error code
+ */
+static inline int upipe_hls_playlist_set_prefetch(struct upipe *upipe,
+                                                  unsigned int count,
+                                                  uint64_t max_size)
+{
+    return upipe_control(upipe, UPIPE_HLS_PLAYLIST_SET_PREFETCH,
+                         UPIPE_HLS_PLAYLIST_SIGNATURE, count, max_size);
+}
+
+/** @This gets the download statistics of the playlist.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled with the statistics
+ * @return an error code
+ */
+static inline int upipe_hls_playlist_get_stats(
+        struct upipe *upipe, struct upipe_hls_playlist_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_HLS_PLAYLIST_GET_STATS,
+                         UPIPE_HLS_PLAYLIST_SIGNATURE, stats);
+}
+
 /** @This extends @ref uprobe_event with specific m3u playlist events. */
 enum uprobe_hls_playlist_event {
     UPROBE_HLS_PLAYLIST_SENTINEL = UPROBE_LOCAL,
@@ -145,6 +200,9 @@ enum uprobe_hls_playlist_event {
     UPROBE_HLS_PLAYLIST_RELOADED,
     /** the item has finished */
     UPROBE_HLS_PLAYLIST_ITEM_END,
+    /** an item was downloaded, only thrown when a uclock is attached
+     * (uint64_t bytes, uint64_t duration) */
+    UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED,
 };
 
 /** @This converts hls playlist specific event to a string.
@@ -158,6 +216,7 @@ static inline const char *uprobe_hls_playlist_event_str(int event)
     UBASE_CASE_TO_STR(UPROBE_HLS_PLAYLIST_NEED_RELOAD);
     UBASE_CASE_TO_STR(UPROBE_HLS_PLAYLIST_RELOADED);
     UBASE_CASE_TO_STR(UPROBE_HLS_PLAYLIST_ITEM_END);
+    UBASE_CASE_TO_STR(UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED);
     case UPROBE_HLS_PLAYLIST_SENTINEL: break;
     }
     return NULL;
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module writing HLS and low-latency HLS segments and playlists
+ *
+ * Each input sub pipe is a rendition. It accepts a block flow, either a
+ * transport stream (typically the output of a ts mux pipe) or CMAF
+ * fragments, and cuts segments on random access points. If a part
+ * duration is set, the segments are also described as low-latency HLS
+ * partial segments, using byte ranges of the segment file.
+ *
+ * Segments and playlists are written by a writer thread owned by the pipe,
+ * so that file system latencies do not stall the pipe thread, and the
+ * playlists are renamed in place once completely written.
+ */
+
+#ifndef _UPIPE_HLS_UPIPE_HLS_SEGMENTER_H_
+/** @hidden */
+# define _UPIPE_HLS_UPIPE_HLS_SEGMENTER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_HLS_SEGMENTER_SIGNATURE       UBASE_FOURCC('h','l','s','S')
+#define UPIPE_HLS_SEGMENTER_SUB_SIGNATURE   UBASE_FOURCC('h','l','s','s')
+
+/** default target duration of the segments */
+#define UPIPE_HLS_SEGMENTER_DEF_DURATION    (UINT64_C(27000000) * 6)
+/** default number of segments listed in the media playlists */
+#define UPIPE_HLS_SEGMENTER_DEF_WINDOW      5
+
+/** @This extends @ref upipe_command with specific hls segmenter commands. */
+enum upipe_hls_segmenter_command {
+    UPIPE_HLS_SEGMENTER_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** set the output directory and the master playlist name
+     * (const char *, const char *) */
+    UPIPE_HLS_SEGMENTER_SET_PATH,
+    /** get the output directory and the master playlist name
+     * (const char **, const char **) */
+    UPIPE_HLS_SEGMENTER_GET_PATH,
+    /** set the segment and part target durations (uint64_t, uint64_t) */
+    UPIPE_HLS_SEGMENTER_SET_DURATION,
+    /** get the segment and part target durations (uint64_t *, uint64_t *) */
+    UPIPE_HLS_SEGMENTER_GET_DURATION,
+    /** set the number of segments in the media playlists (unsigned int) */
+    UPIPE_HLS_SEGMENTER_SET_WINDOW,
+    /** wait until the queued files are written (void) */
+    UPIPE_HLS_SEGMENTER_SYNC,
+};
+
+/** @This converts hls segmenter specific command to a string.
+ *
+ * @param cmd @ref upipe_command to convert
+ * @return a string or NULL if not a valid @ref upipe_hls_segmenter_command
+ */
+static inline const char *upipe_hls_segmenter_command_str(int cmd)
+{
+    switch ((enum upipe_hls_segmenter_command)cmd) {
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SET_PATH);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_GET_PATH);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SET_DURATION);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_GET_DURATION);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SET_WINDOW);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SYNC);
+    case UPIPE_HLS_SEGMENTER_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This sets the output directory and the master playlist name.
+ *
+ * @param upipe description structure of the pipe
+ * @param dir output directory
+ * @param master master playlist file name or NULL
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_set_path(struct upipe *upipe,
+                                               const char *dir,
+                                               const char *master)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SET_PATH,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE, dir, master);
+}
+
+/** @This gets the output directory and the master playlist name.
+ *
+ * @param upipe description structure of the pipe
+ * @param dir_p filled with the output directory
+ * @param master_p filled with the master playlist file name
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_get_path(struct upipe *upipe,
+                                               const char **dir_p,
+                                               const char **master_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_GET_PATH,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE, dir_p, master_p);
+}
+
+/** @This sets the segment and part target durations. A part duration of 0
+ * disables the low-latency partial segments.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration segment target duration in 27MHz ticks
+ * @param part_duration part target duration in 27MHz ticks, or 0
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_set_duration(struct upipe *upipe,
+                                                   uint64_t duration,
+                                                   uint64_t part_duration)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SET_DURATION,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE,
+                         duration, part_duration);
+}
+
+/** @This gets the segment and part target durations.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration_p filled with the segment target duration
+ * @param part_duration_p filled with the part target duration
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_get_duration(struct upipe *upipe,
+                                                   uint64_t *duration_p,
+                                                   uint64_t *part_duration_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_GET_DURATION,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE,
+                         duration_p, part_duration_p);
+}
+
+/** @This sets the number of segments listed in the media playlists. Older
+ * segments are deleted once they have been out of the playlist for the
+ * same number of segments. 0 keeps all segments.
+ *
+ * @param upipe description structure of the pipe
+ * @param window number of segments
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_set_window(struct upipe *upipe,
+                                                 unsigned int window)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SET_WINDOW,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE, window);
+}
+
+/** @This waits until the segments and playlists queued so far are
+ * written. It blocks the calling thread.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_sync(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SYNC,
+                         UPIPE_HLS_SEGMENTER_SIGNATURE);
+}
+
+/** @This extends @ref upipe_command with specific hls segmenter sub pipe
+ * commands. */
+enum upipe_hls_segmenter_sub_command {
+    UPIPE_HLS_SEGMENTER_SUB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** set the rendition name used for the file names (const char *) */
+    UPIPE_HLS_SEGMENTER_SUB_SET_NAME,
+    /** get the rendition name (const char **) */
+    UPIPE_HLS_SEGMENTER_SUB_GET_NAME,
+};
+
+/** @This converts hls segmenter sub pipe specific command to a string.
+ *
+ * @param cmd @ref upipe_command to convert
+ * @return a string or NULL if not a valid
+ * @ref upipe_hls_segmenter_sub_command
+ */
+static inline const char *upipe_hls_segmenter_sub_command_str(int cmd)
+{
+    switch ((enum upipe_hls_segmenter_sub_command)cmd) {
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SUB_SET_NAME);
+    UBASE_CASE_TO_STR(UPIPE_HLS_SEGMENTER_SUB_GET_NAME);
+    case UPIPE_HLS_SEGMENTER_SUB_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This sets the rendition name. The media playlist is written to
+ * name.m3u8 and the segments to name_sequence.ts (or .m4s). It must be
+ * set before the first segment is written.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param name rendition name
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_sub_set_name(struct upipe *upipe,
+                                                   const char *name)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SUB_SET_NAME,
+                         UPIPE_HLS_SEGMENTER_SUB_SIGNATURE, name);
+}
+
+/** @This gets the rendition name.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param name_p filled with the rendition name
+ * @return an error code
+ */
+static inline int upipe_hls_segmenter_sub_get_name(struct upipe *upipe,
+                                                   const char **name_p)
+{
+    return upipe_control(upipe, UPIPE_HLS_SEGMENTER_SUB_GET_NAME,
+                         UPIPE_HLS_SEGMENTER_SUB_SIGNATURE, name_p);
+}
+
+/** @This extends @ref uprobe_event with specific hls segmenter sub pipe
+ * events. */
+enum uprobe_hls_segmenter_sub_event {
+    UPROBE_HLS_SEGMENTER_SUB_SENTINEL = UPROBE_LOCAL,
+
+    /** a segment was completed (uint64_t sequence, uint64_t duration,
+     * uint64_t size) */
+    UPROBE_HLS_SEGMENTER_SUB_SEGMENT,
+};
+
+/** @This converts hls segmenter sub pipe specific event to a string.
+ *
+ * @param event @ref uprobe_event to convert
+ * @return a string or NULL if not a valid
+ * @ref uprobe_hls_segmenter_sub_event
+ */
+static inline const char *uprobe_hls_segmenter_sub_event_str(int event)
+{
+    switch ((enum uprobe_hls_segmenter_sub_event)event) {
+    UBASE_CASE_TO_STR(UPROBE_HLS_SEGMENTER_SUB_SEGMENT);
+    case UPROBE_HLS_SEGMENTER_SUB_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This allocates a hls segmenter pipe manager.
+ *
+ * @return the pipe manager
+ */
+struct upipe_mgr *upipe_hls_segmenter_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -23,6 +23,15 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/** @file
+ * @short Upipe grid pipe, connecting any input to any output
+ *
+ * Inputs and outputs of a grid may be used from different threads (for
+ * instance inside workers), the frames being shared between them without
+ * locks. An input and an output must not be released while another
+ * thread selects them with @ref upipe_grid_out_set_input.
+ */
+
 #ifndef _UPIPE_MODULES_UPIPE_GRID_H_
 #define _UPIPE_MODULES_UPIPE_GRID_H_
 
@@ -156,6 +156,12 @@ enum upipe_http_src_mgr_command {
     UPIPE_HTTP_SRC_MGR_SET_COOKIE,
     /** iterate over cookies */
     UPIPE_HTTP_SRC_MGR_ITERATE_COOKIE,
+
+    /** set the maximum number of idle connections kept (unsigned int) */
+    UPIPE_HTTP_SRC_MGR_SET_KEEPALIVE,
+    /** set the size and lifetime of the name resolution cache
+     * (unsigned int, uint64_t) */
+    UPIPE_HTTP_SRC_MGR_SET_DNS_CACHE,
 };
 
 /** @This sets the proxy url to use by default for the new allocated pipes.
@@ -214,6 +220,39 @@ static inline int upipe_http_src_mgr_iterate_cookie(struct upipe_mgr *mgr,
                              UPIPE_HTTP_SRC_SIGNATURE, domain, path, uchain_p);
 }
 
+/** @This sets the maximum number of idle connections the manager keeps
+ * open for reuse by the next requests to the same host. Connections are only
+ * kept when the server allows it, and 0 disables connection reuse.
+ *
+ * @param mgr pointer to upipe manager
+ * @param max_idle maximum number of idle connections
+ * @return an error code
+ */
+static inline int upipe_http_src_mgr_set_keepalive(struct upipe_mgr *mgr,
+                                                   unsigned int max_idle)
+{
+    return upipe_mgr_control(mgr, UPIPE_HTTP_SRC_MGR_SET_KEEPALIVE,
+                             UPIPE_HTTP_SRC_SIGNATURE, max_idle);
+}
+
+/** @This sets the maximum number of name resolutions the manager caches,
+ * and how long they are kept. The oldest resolutions are removed when the
+ * cache is full, and 0 disables the cache. Names are resolved on another
+ * thread, so that the event loop is not blocked.
+ *
+ * @param mgr pointer to upipe manager
+ * @param max_hosts maximum number of cached name resolutions
+ * @param ttl lifetime of a cached name resolution, in units of UCLOCK_FREQ
+ * @return an error code
+ */
+static inline int upipe_http_src_mgr_set_dns_cache(struct upipe_mgr *mgr,
+                                                   unsigned int max_hosts,
+                                                   uint64_t ttl)
+{
+    return upipe_mgr_control(mgr, UPIPE_HTTP_SRC_MGR_SET_DNS_CACHE,
+                             UPIPE_HTTP_SRC_SIGNATURE, max_hosts, ttl);
+}
+
 /** @This returns the management structure for all http sources.
  *
  * @return pointer to manager
@@ -37,6 +37,8 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdint.h>
+
 #define UPIPE_UDPSRC_SIGNATURE UBASE_FOURCC('u','s','r','c')
 
 /** @This extends upipe_command with specific commands. */
@@ -47,6 +49,26 @@ enum upipe_udpsrc_command {
     UPIPE_UDPSRC_GET_FD,
     /** set socket fd (int) */
     UPIPE_UDPSRC_SET_FD,
+    /** get busy-poll idle period (uint64_t *) */
+    UPIPE_UDPSRC_GET_BUSY_POLL,
+    /** set busy-poll idle period (uint64_t) */
+    UPIPE_UDPSRC_SET_BUSY_POLL,
+    /** get polling statistics (struct upipe_udpsrc_poll_stats *) */
+    UPIPE_UDPSRC_GET_POLL_STATS,
+};
+
+/** @This stores the polling statistics of a udp source. */
+struct upipe_udpsrc_poll_stats {
+    /** number of wake-ups on socket readiness */
+    uint64_t wakeups;
+    /** number of reads in busy-poll mode */
+    uint64_t polls;
+    /** number of reads in busy-poll mode which returned no datagram */
+    uint64_t empty_polls;
+    /** number of datagrams received */
+    uint64_t packets;
+    /** number of switches to busy-poll mode */
+    uint64_t busy;
 };
 
 /** @This extends uprobe_throw with specific events. */
@@ -81,6 +103,53 @@ static inline int upipe_udpsrc_set_fd(struct upipe *upipe, int fd)
                          fd);
 }
 
+/** @This returns the busy-poll idle period.
+ *
+ * @param upipe description structure of the pipe
+ * @param idle_p filled in with the idle period in 27 MHz ticks, or 0 if
+ * busy-poll is disabled
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_busy_poll(struct upipe *upipe,
+                                             uint64_t *idle_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_BUSY_POLL,
+                         UPIPE_UDPSRC_SIGNATURE, idle_p);
+}
+
+/** @This enables the busy-poll mode. When a datagram is received, the
+ * source stops waiting for the readiness of the socket and reads it without
+ * blocking from an idler pump, until no datagram was received for the given
+ * idle period. The pipe then falls back to waiting for the readiness of the
+ * socket. This dedicates a core to the source while packets are flowing,
+ * which lowers the latency and the cost of the wake-ups at high packet
+ * rates. Where available, SO_BUSY_POLL is also set on the socket while
+ * busy-poll is enabled, and reset when it is disabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param idle idle period in 27 MHz ticks, or 0 to disable busy-poll
+ * @return an error code
+ */
+static inline int upipe_udpsrc_set_busy_poll(struct upipe *upipe,
+                                             uint64_t idle)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_SET_BUSY_POLL,
+                         UPIPE_UDPSRC_SIGNATURE, idle);
+}
+
+/** @This returns the polling statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled in with the statistics
+ * @return an error code
+ */
+static inline int upipe_udpsrc_get_poll_stats(
+        struct upipe *upipe, struct upipe_udpsrc_poll_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_UDPSRC_GET_POLL_STATS,
+                         UPIPE_UDPSRC_SIGNATURE, stats);
+}
+
 /** @This returns the management structure for all udp socket sources.
  *
  * @return pointer to manager
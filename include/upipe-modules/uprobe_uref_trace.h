@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe sampling urefs for tracing and collecting their trace stamps
+ *
+ * The probe catches the events thrown by @ref upipe_probe_uref pipes. It
+ * starts tracing one uref out of a given number of untraced urefs (see
+ * @ref uref_trace_start), and collects the stamps of traced urefs into
+ * histograms of the residence time per hop, then stops tracing them.
+ *
+ * Typically a upipe_probe_uref pipe using a sampling probe is placed after a
+ * source, and another one using a collecting probe (with a sampling rate of
+ * 0) is placed before a sink. Since the statistics are updated without
+ * locking, a probe must only be used by the pipes of a single thread.
+ *
+ * The stamps are attributes of the urefs (see @ref uref_trace_start): they
+ * are lost by the pipes allocating new urefs without importing the
+ * attributes of their input, such as muxes, and the urefs coming out of
+ * such pipes are not collected.
+ *
+ * The collecting probe also checks the time between the first and the last
+ * stamp of the urefs against the latency declared by the flow definition of
+ * the upipe_probe_uref pipe. The declared latency is accumulated from the
+ * source, so a uref exceeding it reveals a pipe adding more latency than it
+ * declares.
+ */
+
+#ifndef _UPIPE_MODULES_UPROBE_UREF_TRACE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPROBE_UREF_TRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/upump_trace.h>
+
+#include <stdint.h>
+
+/** @This stores the statistics of a hop, that is the residence time of the
+ * urefs in a pipe, from their entry into it to their entry into the next
+ * pipe. */
+struct uprobe_uref_trace_hop {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** position of the hop on the path of the urefs */
+    unsigned int index;
+    /** signature of the manager of the pipe */
+    uint32_t signature;
+    /** signature of the manager of the next pipe */
+    uint32_t next_signature;
+    /** residence times */
+    struct upump_trace_hist hist;
+};
+
+UBASE_FROM_TO(uprobe_uref_trace_hop, uchain, uchain, uchain)
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_uref_trace {
+    /** trace one untraced uref out of sample, or 0 to only collect */
+    unsigned int sample;
+    /** number of untraced urefs since the last sampled one */
+    unsigned int counter;
+
+    /** list of per-hop statistics, by position */
+    struct uchain hops;
+    /** time spent between the first and the last stamp of the urefs */
+    struct upump_trace_hist total;
+    /** latency declared by the flow definition of the collecting pipe, or
+     * UINT64_MAX */
+    uint64_t latency;
+    /** number of urefs whose time between the first and the last stamp
+     * exceeded the declared latency */
+    uint64_t exceeded;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_uref_trace, uprobe)
+
+/** @This initializes an already allocated uprobe_uref_trace structure.
+ *
+ * @param uprobe_uref_trace pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param sample trace one untraced uref out of sample, or 0 to only collect
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_uref_trace_init(
+        struct uprobe_uref_trace *uprobe_uref_trace,
+        struct uprobe *next, unsigned int sample);
+
+/** @This cleans a uprobe_uref_trace structure.
+ *
+ * @param uprobe_uref_trace structure to clean
+ */
+void uprobe_uref_trace_clean(struct uprobe_uref_trace *uprobe_uref_trace);
+
+/** @This allocates a new uprobe_uref_trace structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param sample trace one untraced uref out of sample, or 0 to only collect
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_uref_trace_alloc(struct uprobe *next,
+                                       unsigned int sample);
+
+/** @This resets the statistics of the probe.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_uref_trace_reset(struct uprobe *uprobe);
+
+/** @This prints the statistics of the probe, one line per hop, at the
+ * notice level, and a warning if urefs exceeded the declared latency.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_uref_trace_print(struct uprobe *uprobe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
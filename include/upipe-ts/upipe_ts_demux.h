@@ -104,6 +104,9 @@ static inline int upipe_ts_demux_set_private_key(struct upipe *upipe,
  */
 struct upipe_mgr *upipe_ts_demux_mgr_alloc(void);
 
+/** maximum number of framer workers of a ts_demux manager */
+#define UPIPE_TS_DEMUX_MAX_WORKERS 64
+
 /** @This extends upipe_mgr_command with specific commands for ts_demux. */
 enum upipe_ts_demux_mgr_command {
     UPIPE_TS_DEMUX_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
@@ -137,7 +140,13 @@ enum upipe_ts_demux_mgr_command {
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(ts_scte35d, TS_SCTE35D)
 
     UPIPE_TS_DEMUX_MGR_GET_SET_MGR(autof, AUTOF)
+    UPIPE_TS_DEMUX_MGR_GET_SET_MGR(ts_fastd, TS_FASTD)
 #undef UPIPE_TS_DEMUX_MGR_GET_SET_MGR
+
+    /** adds a framer worker (struct upipe_mgr *, struct uprobe *) */
+    UPIPE_TS_DEMUX_MGR_ADD_WORKER,
+    /** removes all framer workers (void) */
+    UPIPE_TS_DEMUX_MGR_CLEAR_WORKERS,
 };
 
 /** @hidden */
@@ -191,8 +200,47 @@ UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(ts_pesd, TS_PESD)
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(ts_scte35d, TS_SCTE35D)
 
 UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(autof, AUTOF)
+UPIPE_TS_DEMUX_MGR_GET_SET_MGR2(ts_fastd, TS_FASTD)
 #undef UPIPE_TS_DEMUX_MGR_GET_SET_MGR2
 
+/** @This adds a framer worker to the ts_demux manager. Programs are given
+ * to the workers in a round-robin fashion, and the framers of all the
+ * elementary streams of a program then run in the thread of its worker,
+ * wrapped in a wlin pipe. Synchronization, splitting, PSI tables and TS/PES
+ * decapsulation stay in the thread of the demux, so that clock references
+ * and timestamps are still processed in order. Outputs and events are
+ * unchanged for the application. This may only be called before any pipe
+ * has been allocated.
+ *
+ * @param mgr pointer to manager
+ * @param wlin_mgr wlin manager transferring pipes to the worker thread
+ * (see @ref upipe_wlin_mgr_alloc)
+ * @param uprobe_remote probe hierarchy used by the framers in the worker
+ * thread (belongs to the callee)
+ * @return an error code
+ */
+static inline int upipe_ts_demux_mgr_add_worker(struct upipe_mgr *mgr,
+                                                struct upipe_mgr *wlin_mgr,
+                                                struct uprobe *uprobe_remote)
+{
+    return upipe_mgr_control(mgr, UPIPE_TS_DEMUX_MGR_ADD_WORKER,
+                             UPIPE_TS_DEMUX_SIGNATURE, wlin_mgr,
+                             uprobe_remote);
+}
+
+/** @This removes all framer workers from the ts_demux manager, so that
+ * framers run in the thread of the demux again. This may only be called
+ * before any pipe has been allocated.
+ *
+ * @param mgr pointer to manager
+ * @return an error code
+ */
+static inline int upipe_ts_demux_mgr_clear_workers(struct upipe_mgr *mgr)
+{
+    return upipe_mgr_control(mgr, UPIPE_TS_DEMUX_MGR_CLEAR_WORKERS,
+                             UPIPE_TS_DEMUX_SIGNATURE);
+}
+
 #ifdef __cplusplus
 }
 #endif
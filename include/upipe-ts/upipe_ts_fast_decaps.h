@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module decapsulating (removing) TS and PES headers of TS
+ * packets in a single pass
+ *
+ * This pipe is equivalent to a ts_decaps pipe followed by a ts_pesd pipe,
+ * and throws the same events. It accepts "block.mpegts.mpegtspes." flow
+ * definitions and outputs "block." PES chunks. The packets lost counter is
+ * retrieved with @ref upipe_ts_decaps_get_packets_lost.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_FAST_DECAPS_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_FAST_DECAPS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_decaps.h>
+
+#define UPIPE_TS_FASTD_SIGNATURE UBASE_FOURCC('t','s','f','d')
+
+/** @This returns the management structure for all ts_fastd pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_fastd_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
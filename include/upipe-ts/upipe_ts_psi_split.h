@@ -34,6 +34,56 @@ extern "C" {
 #define UPIPE_TS_PSI_SPLIT_SIGNATURE UBASE_FOURCC('t','s','p','Y')
 #define UPIPE_TS_PSI_SPLIT_OUTPUT_SIGNATURE UBASE_FOURCC('t','s','p','Z')
 
+/** @This extends upipe_command with specific commands for ts_psi_split output
+ * subpipes. */
+enum upipe_ts_psi_split_sub_command {
+    UPIPE_TS_PSI_SPLIT_SUB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** enables or disables the section fingerprint cache (int) */
+    UPIPE_TS_PSI_SPLIT_SUB_SET_CACHE,
+    /** returns the fingerprint cache counters (uint64_t *, uint64_t *) */
+    UPIPE_TS_PSI_SPLIT_SUB_GET_CACHE_STATS,
+};
+
+/** @This enables or disables the section fingerprint cache on an output
+ * subpipe. When enabled, sections with a syntax indicator whose table id,
+ * table id extension, section number, version number and CRC are identical
+ * to the last section seen for the same (table id, table id extension,
+ * section number) are dropped instead of being output. This must only be
+ * used for decoders which do nothing with repeated tables (it is not
+ * suitable for PAT and PMT, whose repetitions are random access points).
+ * Toggling the cache empties it.
+ *
+ * @param upipe description structure of the pipe
+ * @param enable true to enable the cache
+ * @return an error code
+ */
+static inline int upipe_ts_psi_split_sub_set_cache(struct upipe *upipe,
+                                                   bool enable)
+{
+    return upipe_control(upipe, UPIPE_TS_PSI_SPLIT_SUB_SET_CACHE,
+                         UPIPE_TS_PSI_SPLIT_OUTPUT_SIGNATURE,
+                         enable ? 1 : 0);
+}
+
+/** @This returns the number of sections dropped by the fingerprint cache
+ * (hits), and the number of sections that went through it (misses), since
+ * the cache was enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param hits_p filled in with the number of hits (may be NULL)
+ * @param misses_p filled in with the number of misses (may be NULL)
+ * @return an error code
+ */
+static inline int upipe_ts_psi_split_sub_get_cache_stats(struct upipe *upipe,
+                                                         uint64_t *hits_p,
+                                                         uint64_t *misses_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PSI_SPLIT_SUB_GET_CACHE_STATS,
+                         UPIPE_TS_PSI_SPLIT_OUTPUT_SIGNATURE,
+                         hits_p, misses_p);
+}
+
 /** @This returns the management structure for all ts_psi_split pipes.
  *
  * @return pointer to manager
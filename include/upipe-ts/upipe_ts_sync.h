@@ -49,7 +49,15 @@ enum upipe_ts_sync_command {
     /** returns the configured number of packets to synchronize with (int *) */
     UPIPE_TS_SYNC_GET_SYNC,
     /** sets the configured number of packets to synchronize with (int) */
-    UPIPE_TS_SYNC_SET_SYNC
+    UPIPE_TS_SYNC_SET_SYNC,
+    /** enables or disables the PID filter (int) */
+    UPIPE_TS_SYNC_SET_PID_FILTER,
+    /** lets the packets of a PID through the filter (unsigned int) */
+    UPIPE_TS_SYNC_ADD_PID,
+    /** drops the packets of a PID when filtering (unsigned int) */
+    UPIPE_TS_SYNC_DEL_PID,
+    /** returns the number of packets dropped by the filter (uint64_t *) */
+    UPIPE_TS_SYNC_GET_FILTERED
 };
 
 /** @This returns the management structure for all ts_sync pipes.
@@ -84,6 +92,59 @@ static inline int upipe_ts_sync_set_sync(struct upipe *upipe, int sync)
                          sync);
 }
 
+/** @This enables or disables the PID filter. When enabled, packets whose
+ * PID was not added with @ref upipe_ts_sync_add_pid are dropped before
+ * a uref is allocated for them. The filter is disabled by default, and
+ * initially no PID is added.
+ *
+ * @param upipe description structure of the pipe
+ * @param enable true to enable the filter
+ * @return an error code
+ */
+static inline int upipe_ts_sync_set_pid_filter(struct upipe *upipe,
+                                               bool enable)
+{
+    return upipe_control(upipe, UPIPE_TS_SYNC_SET_PID_FILTER,
+                         UPIPE_TS_SYNC_SIGNATURE, enable ? 1 : 0);
+}
+
+/** @This lets the packets of the given PID through the PID filter.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID to add
+ * @return an error code
+ */
+static inline int upipe_ts_sync_add_pid(struct upipe *upipe, uint16_t pid)
+{
+    return upipe_control(upipe, UPIPE_TS_SYNC_ADD_PID,
+                         UPIPE_TS_SYNC_SIGNATURE, (unsigned int)pid);
+}
+
+/** @This drops the packets of the given PID when the PID filter is enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID to remove
+ * @return an error code
+ */
+static inline int upipe_ts_sync_del_pid(struct upipe *upipe, uint16_t pid)
+{
+    return upipe_control(upipe, UPIPE_TS_SYNC_DEL_PID,
+                         UPIPE_TS_SYNC_SIGNATURE, (unsigned int)pid);
+}
+
+/** @This returns the number of packets dropped by the PID filter.
+ *
+ * @param upipe description structure of the pipe
+ * @param filtered_p filled in with the number of packets
+ * @return an error code
+ */
+static inline int upipe_ts_sync_get_filtered(struct upipe *upipe,
+                                             uint64_t *filtered_p)
+{
+    return upipe_control(upipe, UPIPE_TS_SYNC_GET_FILTERED,
+                         UPIPE_TS_SYNC_SIGNATURE, filtered_p);
+}
+
 #ifdef __cplusplus
 }
 #endif
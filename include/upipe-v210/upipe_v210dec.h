@@ -37,6 +37,29 @@ extern "C" {
 
 #define UPIPE_V210DEC_SIGNATURE UBASE_FOURCC('v','2','1','d')
 
+/** @This extends upipe_command with specific commands for v210dec. */
+enum upipe_v210dec_command {
+    UPIPE_V210DEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the number of threads unpacking the rows (unsigned int) */
+    UPIPE_V210DEC_SET_THREADS,
+};
+
+/** @This sets the number of threads unpacking the rows of each picture. The
+ * pipe thread takes one band of rows, so threads - 1 worker threads are
+ * created; 0 or 1 converts on the pipe thread only (default).
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_v210dec_set_threads(struct upipe *upipe,
+                                            unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_V210DEC_SET_THREADS,
+                         UPIPE_V210DEC_SIGNATURE, threads);
+}
+
 /** @This returns the management structure for v210 pipes.
  *
  * @return pointer to manager
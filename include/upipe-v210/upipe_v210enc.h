@@ -37,6 +37,29 @@ extern "C" {
 
 #define UPIPE_V210ENC_SIGNATURE UBASE_FOURCC('v','2','1','e')
 
+/** @This extends upipe_command with specific commands for v210enc. */
+enum upipe_v210enc_command {
+    UPIPE_V210ENC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the number of threads packing the rows (unsigned int) */
+    UPIPE_V210ENC_SET_THREADS,
+};
+
+/** @This sets the number of threads packing the rows of each picture. The
+ * pipe thread takes one band of rows, so threads - 1 worker threads are
+ * created; 0 or 1 converts on the pipe thread only (default).
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_v210enc_set_threads(struct upipe *upipe,
+                                            unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_V210ENC_SET_THREADS,
+                         UPIPE_V210ENC_SIGNATURE, threads);
+}
+
 /** @This returns the management structure for v210 pipes.
  *
  * @return pointer to manager
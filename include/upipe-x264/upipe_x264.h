@@ -63,7 +63,15 @@ enum upipe_x264_command {
     UPIPE_X264_SET_SC_LATENCY,
 
     /** set slice type enforcement mode (int) */
-    UPIPE_X264_SET_SLICE_TYPE_ENFORCE
+    UPIPE_X264_SET_SLICE_TYPE_ENFORCE,
+
+    /** switches to sliced threads mode with the given number of threads
+     * (unsigned int) */
+    UPIPE_X264_SET_SLICED_THREADS,
+
+    /** switches to chunked GOP-parallel mode with the given number of
+     * encoder instances and GOPs per chunk (unsigned int, unsigned int) */
+    UPIPE_X264_SET_CHUNKED
 };
 
 /** @This reconfigures encoder with updated parameters.
@@ -151,6 +159,44 @@ static inline int upipe_x264_set_slice_type_enforce(struct upipe *upipe,
                          UPIPE_X264_SIGNATURE, enforce ? 1 : 0);
 }
 
+/** @This switches x264 into sliced threads mode, for low-latency
+ * applications. Each picture is split into as many slices as threads, the
+ * lookahead and B-frames are disabled, and unless set otherwise the VBV is
+ * sized to a single frame at the configured bitrate. It must be called
+ * before the encoder is opened.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of slice threads, or 0 to disable
+ * @return an error code
+ */
+static inline int upipe_x264_set_sliced_threads(struct upipe *upipe,
+                                                unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_X264_SET_SLICED_THREADS,
+                         UPIPE_X264_SIGNATURE, threads);
+}
+
+/** @This switches x264 into chunked GOP-parallel mode, for file
+ * transcodes. The input is split into chunks of closed GOPs, which are
+ * dispatched in turn to several encoder instances, each running on its own
+ * thread; the output is restitched in the input order by the pipe. Up to a
+ * chunk of input pictures is queued per instance, and the pipe thread waits
+ * when an instance is behind. It must be called before the encoder is
+ * opened, and is exclusive with sliced threads mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param instances number of encoder instances, or 0 to disable
+ * @param gops number of GOPs (of keyint_max frames) per chunk
+ * @return an error code
+ */
+static inline int upipe_x264_set_chunked(struct upipe *upipe,
+                                         unsigned int instances,
+                                         unsigned int gops)
+{
+    return upipe_control(upipe, UPIPE_X264_SET_CHUNKED, UPIPE_X264_SIGNATURE,
+                         instances, gops);
+}
+
 /** @This returns the management structure for x264 pipes.
  *
  * @return pointer to manager
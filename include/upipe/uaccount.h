@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short accounting of the allocations of a pipe
+ *
+ * A uaccount structure is made current on a thread with
+ * @ref uaccount_enter, typically by @ref upipe_input and
+ * @ref upipe_control for pipes with profiling counters (see
+ * @ref uprobe_prof), and by the dispatch of the pumps allocated while it was
+ * current. Allocations of urefs, ubufs and udicts are then counted in it, and
+ * umem buffers are charged to it until they are freed, possibly from another
+ * thread. Each umem keeps a reference to its account, so that the account
+ * outlives the pipe if its buffers are still in use.
+ *
+ * The counters are updated with relaxed atomic operations, so they may be
+ * read from any thread, but are not consistent with one another.
+ */
+
+#ifndef _UPIPE_UACCOUNT_H_
+/** @hidden */
+#define _UPIPE_UACCOUNT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @This stores the allocation counters of a pipe. */
+struct uaccount {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** bytes of umem buffers currently allocated */
+    uint64_t live;
+    /** cumulative bytes of umem buffers allocated */
+    uint64_t bytes;
+    /** number of umem buffers allocated */
+    uint64_t umems;
+    /** number of urefs allocated */
+    uint64_t urefs;
+    /** number of ubufs allocated */
+    uint64_t ubufs;
+    /** number of udicts allocated */
+    uint64_t udicts;
+};
+
+UBASE_FROM_TO(uaccount, urefcount, urefcount, urefcount)
+
+/** @internal @This qualifies the account current on the thread. The
+ * initial-exec model turns the inline accesses compiled in the shared
+ * libraries into loads relative to the thread pointer, instead of calls to
+ * __tls_get_addr. */
+#define UACCOUNT_TLS __thread __attribute__ ((tls_model("initial-exec")))
+
+/** @hidden */
+extern UACCOUNT_TLS struct uaccount *uaccount_current;
+
+/** @This allocates a uaccount structure.
+ *
+ * @return pointer to uaccount, or NULL in case of allocation error
+ */
+struct uaccount *uaccount_alloc(void);
+
+/** @This increments the reference count of a uaccount.
+ *
+ * @param account pointer to uaccount, or NULL
+ * @return same pointer to uaccount
+ */
+static inline struct uaccount *uaccount_use(struct uaccount *account)
+{
+    if (account == NULL)
+        return NULL;
+    urefcount_use(&account->urefcount);
+    return account;
+}
+
+/** @This decrements the reference count of a uaccount or frees it.
+ *
+ * @param account pointer to uaccount, or NULL
+ */
+static inline void uaccount_release(struct uaccount *account)
+{
+    if (account != NULL)
+        urefcount_release(&account->urefcount);
+}
+
+/** @This makes an account current on the calling thread.
+ *
+ * @param account pointer to uaccount, or NULL
+ * @return previously current account, to give to @ref uaccount_leave
+ */
+static inline struct uaccount *uaccount_enter(struct uaccount *account)
+{
+    struct uaccount *prev = uaccount_current;
+    uaccount_current = account;
+    return prev;
+}
+
+/** @This restores the account which was current before @ref uaccount_enter.
+ *
+ * @param prev account returned by @ref uaccount_enter
+ */
+static inline void uaccount_leave(struct uaccount *prev)
+{
+    uaccount_current = prev;
+}
+
+/** @This returns the account current on the calling thread.
+ *
+ * @return pointer to uaccount, or NULL
+ */
+static inline struct uaccount *uaccount_get_current(void)
+{
+    return uaccount_current;
+}
+
+/** @This reads a counter of a uaccount.
+ *
+ * @param counter pointer to the counter
+ * @return value of the counter
+ */
+static inline uint64_t uaccount_load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/** @internal @This adds a value to a counter of a uaccount.
+ *
+ * @param counter pointer to the counter
+ * @param value value to add
+ */
+static inline void uaccount_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/** @This resets the cumulative counters of a uaccount. The bytes currently
+ * allocated are kept.
+ *
+ * @param account pointer to uaccount
+ */
+static inline void uaccount_reset(struct uaccount *account)
+{
+    __atomic_store_n(&account->bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&account->umems, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&account->urefs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&account->ubufs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&account->udicts, 0, __ATOMIC_RELAXED);
+}
+
+/** @This counts the allocation of a uref in the current account. */
+static inline void uaccount_uref(void)
+{
+    struct uaccount *account = uaccount_current;
+    if (unlikely(account != NULL))
+        uaccount_add(&account->urefs, 1);
+}
+
+/** @This counts the allocation of a ubuf in the current account. */
+static inline void uaccount_ubuf(void)
+{
+    struct uaccount *account = uaccount_current;
+    if (unlikely(account != NULL))
+        uaccount_add(&account->ubufs, 1);
+}
+
+/** @This counts the allocation of a udict in the current account. */
+static inline void uaccount_udict(void)
+{
+    struct uaccount *account = uaccount_current;
+    if (unlikely(account != NULL))
+        uaccount_add(&account->udicts, 1);
+}
+
+/** @This charges the allocation of a umem buffer to the current account.
+ *
+ * @param size size of the buffer
+ * @return account to give to @ref uaccount_umem_free, or NULL
+ */
+static inline struct uaccount *uaccount_umem_alloc(size_t size)
+{
+    struct uaccount *account = uaccount_current;
+    if (likely(account == NULL))
+        return NULL;
+    uaccount_add(&account->live, size);
+    uaccount_add(&account->bytes, size);
+    uaccount_add(&account->umems, 1);
+    return uaccount_use(account);
+}
+
+/** @This charges the resizing of a umem buffer to its account.
+ *
+ * @param account account returned by @ref uaccount_umem_alloc, or NULL
+ * @param size previous size of the buffer
+ * @param new_size new size of the buffer
+ */
+static inline void uaccount_umem_realloc(struct uaccount *account,
+                                         size_t size, size_t new_size)
+{
+    if (likely(account == NULL))
+        return;
+    uaccount_add(&account->live, (uint64_t)new_size - size);
+    if (new_size > size)
+        uaccount_add(&account->bytes, new_size - size);
+}
+
+/** @This credits the release of a umem buffer to its account.
+ *
+ * @param account account returned by @ref uaccount_umem_alloc, or NULL
+ * @param size size of the buffer
+ */
+static inline void uaccount_umem_free(struct uaccount *account, size_t size)
+{
+    if (likely(account == NULL))
+        return;
+    uaccount_add(&account->live, -(uint64_t)size);
+    uaccount_release(account);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
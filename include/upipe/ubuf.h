@@ -37,6 +37,8 @@ extern "C" {
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uaccount.h>
+#include <upipe/utrace.h>
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -183,6 +185,9 @@ static inline struct ubuf *ubuf_alloc(struct ubuf_mgr *mgr,
     va_start(args, signature);
     ubuf = mgr->ubuf_alloc(mgr, signature, args);
     va_end(args);
+    if (likely(ubuf != NULL))
+        uaccount_ubuf();
+    UTRACE3(ubuf_alloc, mgr, signature, ubuf);
     return ubuf;
 }
 
@@ -230,7 +235,8 @@ static inline struct ubuf *ubuf_dup(struct ubuf *ubuf)
 {
     struct ubuf *dup_ubuf;
     if (unlikely(!ubase_check(ubuf_control(ubuf, UBUF_DUP, &dup_ubuf))))
-        return NULL;
+        dup_ubuf = NULL;
+    UTRACE2(ubuf_dup, ubuf, dup_ubuf);
     return dup_ubuf;
 }
 
@@ -242,6 +248,7 @@ static inline void ubuf_free(struct ubuf *ubuf)
 {
     if (ubuf == NULL)
         return;
+    UTRACE1(ubuf_free, ubuf);
     ubuf->mgr->ubuf_free(ubuf);
 }
 
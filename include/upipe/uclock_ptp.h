@@ -37,6 +37,24 @@ extern "C" {
 #include <upipe/uclock.h>
 #include <upipe/uprobe.h>
 
+#include <stdint.h>
+#include <stdbool.h>
+
+/** period of the refresh of the mapping from the system clock
+ * (CLOCK_MONOTONIC_RAW) to a PHC, in ns */
+#define UCLOCK_PTP_REFRESH UINT64_C(1000000000)
+
+/** @This cross-timestamps the PHC of a NIC and CLOCK_MONOTONIC_RAW.
+ *
+ * @param opaque opaque given at allocation
+ * @param nic index of the NIC
+ * @param sys_p filled in with the time of CLOCK_MONOTONIC_RAW in ns
+ * @param phc_p filled in with the time of the PHC in ns
+ * @return false in case of error
+ */
+typedef bool (*uclock_ptp_phc_read)(void *opaque, int nic,
+                                    uint64_t *sys_p, uint64_t *phc_p);
+
 /** @This allocates a new uclock structure.
  *
  * @param uprobe probe catching log events for error reporting
@@ -45,6 +63,29 @@ extern "C" {
  */
 struct uclock *uclock_ptp_alloc(struct uprobe *uprobe, const char *interface[2]);
 
+/** @This allocates a new uclock structure reading the PHCs with a callback
+ * instead of the devices, for instance to test it with fake PHCs. The links
+ * are up, and their state is changed with @ref uclock_ptp_set_link.
+ *
+ * @param uprobe probe catching log events for error reporting
+ * @param nb_nics number of NICs (1 or 2)
+ * @param phc_read callback cross-timestamping the PHCs
+ * @param opaque opaque passed to phc_read
+ * @return pointer to uclock, or NULL in case of error
+ */
+struct uclock *uclock_ptp_alloc_phc(struct uprobe *uprobe,
+                                    unsigned int nb_nics,
+                                    uclock_ptp_phc_read phc_read,
+                                    void *opaque);
+
+/** @This forces the state of a link, until the next netlink event about it.
+ *
+ * @param uclock pointer to a uclock allocated by uclock_ptp
+ * @param nic index of the NIC
+ * @param up true if the link is up
+ */
+void uclock_ptp_set_link(struct uclock *uclock, unsigned int nic, bool up);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,6 +36,7 @@ extern "C" {
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uaccount.h>
 
 #include <stdio.h>
 #include <stdint.h>
@@ -231,7 +232,10 @@ struct udict_mgr {
  */
 static inline struct udict *udict_alloc(struct udict_mgr *mgr, size_t size)
 {
-    return mgr->udict_alloc(mgr, size);
+    struct udict *udict = mgr->udict_alloc(mgr, size);
+    if (likely(udict != NULL))
+        uaccount_udict();
+    return udict;
 }
 
 /** @internal @This sends a control command to the udict.
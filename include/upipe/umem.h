@@ -36,6 +36,7 @@ extern "C" {
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uaccount.h>
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -56,6 +57,8 @@ struct umem {
     size_t size;
     /** real size of the buffer space */
     size_t real_size;
+    /** account the buffer space is charged to, or NULL */
+    struct uaccount *account;
 };
 
 /** @This returns a pointer to the buffer space pointed to by a umem.
@@ -109,7 +112,10 @@ static inline bool umem_alloc(struct umem_mgr *mgr, struct umem *umem,
                               size_t size)
 {
     assert(umem != NULL);
-    return mgr->umem_alloc(mgr, umem, size);
+    if (unlikely(!mgr->umem_alloc(mgr, umem, size)))
+        return false;
+    umem->account = uaccount_umem_alloc(size);
+    return true;
 }
 
 /** @This resizes a umem.
@@ -123,7 +129,14 @@ static inline bool umem_alloc(struct umem_mgr *mgr, struct umem *umem,
 static inline bool umem_realloc(struct umem *umem, size_t new_size)
 {
     assert(umem != NULL);
-    return umem->mgr->umem_realloc(umem, new_size);
+    struct uaccount *account = umem->account;
+    size_t size = umem->size;
+    if (unlikely(!umem->mgr->umem_realloc(umem, new_size)))
+        return false;
+    /* the manager may have overwritten the structure */
+    umem->account = account;
+    uaccount_umem_realloc(account, size, new_size);
+    return true;
 }
 
 /** @This frees a umem.
@@ -136,6 +149,8 @@ static inline bool umem_realloc(struct umem *umem, size_t new_size)
 static inline void umem_free(struct umem *umem)
 {
     assert(umem != NULL);
+    uaccount_umem_free(umem->account, umem->size);
+    umem->account = NULL;
     umem->mgr->umem_free(umem);
 }
 
@@ -39,6 +39,20 @@ extern "C" {
 
 #include <upipe/umem.h>
 
+/** @This describes the usage of a pool of a umem pool manager. */
+struct umem_pool_stats {
+    /** size (in octets) of the buffers of the pool */
+    size_t size;
+    /** maximum number of buffers kept in the pool */
+    unsigned int depth;
+    /** number of buffers currently kept in the pool */
+    unsigned int kept;
+    /** number of allocations served from the pool */
+    uint32_t hits;
+    /** number of allocations that had to call malloc() */
+    uint32_t misses;
+};
+
 /** @This allocates a new instance of the umem pool manager allocating buffers
  * from application memory, using pools in power of 2's.
  *
@@ -62,6 +76,28 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...);
  */
 struct umem_mgr *umem_pool_mgr_alloc_simple(uint16_t base_pools_depth);
 
+/** @This enables the usage counters of a umem pool manager. They are
+ * shared between threads and updated on each allocation, so they are
+ * disabled by default. It must be called before the manager is used.
+ *
+ * @param mgr pointer to umem manager
+ * @return an error code (UBASE_ERR_INVALID if the manager is not a umem pool
+ * manager)
+ */
+int umem_pool_mgr_enable_stats(struct umem_mgr *mgr);
+
+/** @This returns the usage statistics of a pool of a umem pool manager.
+ * The counters stay at 0 unless @ref umem_pool_mgr_enable_stats was called.
+ *
+ * @param mgr pointer to umem manager
+ * @param pool index of the pool, starting from the smallest buffers
+ * @param stats filled in with the statistics
+ * @return an error code (UBASE_ERR_INVALID if the manager is not a umem pool
+ * manager or the pool does not exist)
+ */
+int umem_pool_mgr_get_stats(struct umem_mgr *mgr, unsigned int pool,
+                            struct umem_pool_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,9 @@ extern "C" {
 #include <upipe/uprobe.h>
 #include <upipe/urequest.h>
 #include <upipe/udict_dump.h>
+#include <upipe/upipe_prof.h>
+#include <upipe/uref_trace.h>
+#include <upipe/utrace.h>
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -58,6 +61,8 @@ struct upump_mgr;
 /** @hidden */
 struct ubuf_mgr;
 /** @hidden */
+struct ustats;
+/** @hidden */
 struct upipe_mgr;
 /** @hidden */
 struct upump;
@@ -179,6 +184,8 @@ struct upipe {
     struct uprobe *uprobe;
     /** pointer to the manager for this pipe type */
     struct upipe_mgr *mgr;
+    /** pointer to the profiling counters, or NULL */
+    struct upipe_prof *prof;
 };
 
 UBASE_FROM_TO(upipe, uchain, uchain, uchain)
@@ -454,6 +461,7 @@ static inline void upipe_init(struct upipe *upipe, struct upipe_mgr *mgr,
     upipe->uprobe = uprobe;
     upipe->refcount = NULL;
     upipe->mgr = mgr;
+    upipe->prof = NULL;
     upipe_mgr_use(mgr);
 }
 
@@ -1045,6 +1053,33 @@ static inline int upipe_throw_preroll_end(struct upipe *upipe)
     return upipe_throw(upipe, UPROBE_PREROLL_END);
 }
 
+/** @This throws an event asking for a shared memory segment to export
+ * counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param ustats_p filled in with a pointer to the segment
+ * @return an error code
+ */
+static inline int upipe_throw_need_ustats(struct upipe *upipe,
+                                          struct ustats **ustats_p)
+{
+    return upipe_throw(upipe, UPROBE_NEED_USTATS, ustats_p);
+}
+
+/** @This throws an event carrying a snapshot of the profiling counters of
+ * the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_throw_prof_stats(struct upipe *upipe)
+{
+    if (upipe->prof == NULL)
+        return UBASE_ERR_INVALID;
+    struct upipe_prof prof = *upipe->prof;
+    return upipe_throw(upipe, UPROBE_PROF_STATS, &prof);
+}
+
 /** @This catches an event coming from an inner pipe, and rethrows is as if
  * it were sent by the outermost pipe.
  *
@@ -1062,6 +1097,26 @@ static inline int upipe_throw_proxy(struct upipe *upipe, struct upipe *inner,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sends an input buffer into a pipe, and updates its
+ * profiling counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_prof_input(struct upipe *upipe, struct uref *uref,
+                      struct upump **upump_p);
+
+/** @internal @This sends a control command to the pipe, and updates its
+ * profiling counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param command control command to send
+ * @param args optional read or write parameters
+ * @return an error code
+ */
+int upipe_prof_control_va(struct upipe *upipe, int command, va_list args);
+
 /** @This sends an input buffer into a pipe. Note that all inputs and control
  * commands must be executed from the same thread - no reentrancy or locking
  * is required from the pipe. Also note that uref is then owned by the callee
@@ -1081,7 +1136,14 @@ static inline void upipe_input(struct upipe *upipe, struct uref *uref,
         return;
     }
     upipe_use(upipe);
-    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    UTRACE3(upipe_input_entry, upipe, upipe->mgr->signature, uref);
+    if (unlikely(uref_trace_check(uref)))
+        uref_trace_stamp(uref, upipe->mgr->signature);
+    if (unlikely(upipe->prof != NULL))
+        upipe_prof_input(upipe, uref, upump_p);
+    else
+        upipe->mgr->upipe_input(upipe, uref, upump_p);
+    UTRACE2(upipe_input_exit, upipe, upipe->mgr->signature);
     upipe_release(upipe);
 }
 
@@ -1106,7 +1168,10 @@ static inline int upipe_control_nodbg_va(struct upipe *upipe,
 
     int err;
     upipe_use(upipe);
-    err = upipe->mgr->upipe_control(upipe, command, args);
+    if (unlikely(upipe->prof != NULL))
+        err = upipe_prof_control_va(upipe, command, args);
+    else
+        err = upipe->mgr->upipe_control(upipe, command, args);
     upipe_release(upipe);
     return err;
 }
@@ -121,6 +121,70 @@ static inline int upipe_dump_open(upipe_dump_pipe_label pipe_label,
     return err;
 }
 
+/** @This represents a function called for each pipe of a pipeline. */
+typedef int (upipe_dump_walk_cb)(void *, struct upipe *);
+
+/** @This calls a function for each pipe of a pipeline, following the same
+ * edges as @ref upipe_dump_va (sub pipes, inner pipes, outputs and super
+ * pipes), and visiting each pipe once.
+ *
+ * @param cb function to call for each pipe
+ * @param opaque opaque passed to the function
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code, the walk being interrupted by the first error
+ * returned by the function
+ */
+int upipe_dump_walk_va(upipe_dump_walk_cb cb, void *opaque,
+                       struct uchain *ulist, va_list args);
+
+/** @This calls a function for each pipe of a pipeline with a variable list
+ * of arguments.
+ *
+ * @param cb function to call for each pipe
+ * @param opaque opaque passed to the function
+ * @param ulist list of sources pipes in ulist format, followed by a list of
+ * source pipes terminated by NULL
+ * @return an error code
+ */
+static inline int upipe_dump_walk(upipe_dump_walk_cb cb, void *opaque,
+                                  struct uchain *ulist, ...)
+{
+    va_list args;
+    va_start(args, ulist);
+    int err = upipe_dump_walk_va(cb, opaque, ulist, args);
+    va_end(args);
+    return err;
+}
+
+/** @This dumps the profiling counters of the pipes of a pipeline, as
+ * tab-separated values with a header line. Pipes without counters are
+ * skipped.
+ *
+ * @param file file pointer to write to
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code
+ */
+int upipe_dump_prof_va(FILE *file, struct uchain *ulist, va_list args);
+
+/** @This dumps the profiling counters of the pipes of a pipeline with a
+ * variable list of arguments.
+ *
+ * @param file file pointer to write to
+ * @param ulist list of sources pipes in ulist format, followed by a list of
+ * source pipes terminated by NULL
+ * @return an error code
+ */
+static inline int upipe_dump_prof(FILE *file, struct uchain *ulist, ...)
+{
+    va_list args;
+    va_start(args, ulist);
+    int err = upipe_dump_prof_va(file, ulist, args);
+    va_end(args);
+    return err;
+}
+
 #ifdef __cplusplus
 }
 #endif
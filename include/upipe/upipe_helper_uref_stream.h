@@ -41,6 +41,7 @@ extern "C" {
 #include <upipe/uref_attr.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_clock.h>
+#include <upipe/uref_trace.h>
 #include <upipe/upipe.h>
 
 #include <assert.h>
@@ -145,9 +146,12 @@ static void STRUCTURE##_append_uref_stream(struct upipe *upipe,             \
  *                                                                          \
  * @param upipe description structure of the pipe                           \
  * @param consumed number of octets consumed from the uref stream           \
+ * @param extracted uref receiving the trace of the urefs starting in the   \
+ * consumed octets, or NULL                                                 \
  */                                                                         \
-static UBASE_UNUSED void                                                    \
-    STRUCTURE##_consume_uref_stream(struct upipe *upipe, size_t consumed)   \
+static void STRUCTURE##_rotate_uref_stream(struct upipe *upipe,             \
+                                           size_t consumed,                 \
+                                           struct uref *extracted)          \
 {                                                                           \
     struct STRUCTURE *STRUCTURE = STRUCTURE##_from_upipe(upipe);            \
     assert(STRUCTURE->NEXT_UREF != NULL);                                   \
@@ -164,6 +168,12 @@ static UBASE_UNUSED void                                                    \
         }                                                                   \
         uref_free(STRUCTURE->NEXT_UREF);                                    \
         STRUCTURE->NEXT_UREF = uref_from_uchain(uchain);                    \
+        if (unlikely(uref_trace_check(STRUCTURE->NEXT_UREF)) &&             \
+            extracted != NULL && consumed > STRUCTURE->NEXT_UREF_SIZE) {    \
+            /* the uref starts in the extracted octets, move its trace */   \
+            uref_trace_import(extracted, STRUCTURE->NEXT_UREF);             \
+            uref_trace_stop(STRUCTURE->NEXT_UREF);                          \
+        }                                                                   \
         consumed -= STRUCTURE->NEXT_UREF_SIZE;                              \
         uint64_t size = 0;                                                  \
         uref_attr_get_priv(STRUCTURE->NEXT_UREF, &size);                    \
@@ -175,6 +185,17 @@ static UBASE_UNUSED void                                                    \
     STRUCTURE->NEXT_UREF_SIZE -= consumed;                                  \
     uref_attach_ubuf(STRUCTURE->NEXT_UREF, ubuf);                           \
 }                                                                           \
+/** @internal @This consumes the given number of octets from the uref       \
+ * stream, and rotates the buffers accordingly.                             \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ * @param consumed number of octets consumed from the uref stream           \
+ */                                                                         \
+static UBASE_UNUSED void                                                    \
+    STRUCTURE##_consume_uref_stream(struct upipe *upipe, size_t consumed)   \
+{                                                                           \
+    STRUCTURE##_rotate_uref_stream(upipe, consumed, NULL);                  \
+}                                                                           \
 /** @internal @This extracts the given number of octets from the uref       \
  * stream, and rotates the buffers accordingly.                             \
  *                                                                          \
@@ -191,7 +212,7 @@ static struct uref *STRUCTURE##_extract_uref_stream(struct upipe *upipe,    \
     if (unlikely(uref == NULL))                                             \
         return NULL;                                                        \
     uref_block_truncate(uref, extracted);                                   \
-    STRUCTURE##_consume_uref_stream(upipe, extracted);                      \
+    STRUCTURE##_rotate_uref_stream(upipe, extracted, uref);                 \
     return uref;                                                            \
 }                                                                           \
 /** @internal @This cleans up the private members for this helper.          \
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short Upipe profiling counters
+ *
+ * Profiling counters are attached to a pipe by @ref uprobe_prof, and updated
+ * by @ref upipe_input and @ref upipe_control, and by the input helper. Since
+ * a pipe is only ever used from a single thread, the counters are updated
+ * without atomic operations or locks.
+ *
+ * The pipes also get a @ref uaccount structure, made current during their
+ * input and control functions, counting the allocations they make.
+ *
+ * Durations are expressed in ticks, which are CPU timestamp counter cycles on
+ * x86, and nanoseconds elsewhere. The time spent in the input and control
+ * functions of a pipe excludes the time spent in the pipes it calls
+ * synchronously.
+ */
+
+#ifndef _UPIPE_UPIPE_PROF_H_
+/** @hidden */
+#define _UPIPE_UPIPE_PROF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uaccount.h>
+
+#include <stdint.h>
+
+/** @hidden */
+struct upipe;
+
+/** @This stores the profiling counters of a pipe. */
+struct upipe_prof {
+    /** structure for double-linked lists - for use by the owner */
+    struct uchain uchain;
+    /** owner of the counters */
+    void *owner;
+    /** pipe the counters are attached to */
+    struct upipe *upipe;
+
+    /** number of urefs received */
+    uint64_t urefs;
+    /** number of bytes of block urefs received */
+    uint64_t bytes;
+    /** cumulative ticks spent in the input function */
+    uint64_t input_ticks;
+    /** maximum ticks spent in a single call to the input function */
+    uint64_t input_max;
+
+    /** number of control commands received */
+    uint64_t controls;
+    /** cumulative ticks spent in the control function */
+    uint64_t control_ticks;
+    /** maximum ticks spent in a single call to the control function */
+    uint64_t control_max;
+
+    /** number of urefs currently held by the input helper */
+    uint64_t held;
+    /** maximum number of urefs held by the input helper */
+    uint64_t held_max;
+    /** number of urefs currently in the output queue, if any */
+    uint64_t queue;
+    /** maximum number of urefs in the output queue */
+    uint64_t queue_max;
+
+    /** allocations made by the pipe, or NULL */
+    struct uaccount *account;
+};
+
+UBASE_FROM_TO(upipe_prof, uchain, uchain, uchain)
+
+/** @This returns the current value of the profiling tick counter.
+ *
+ * @return ticks
+ */
+uint64_t upipe_prof_ticks(void);
+
+/** @This updates the number of urefs held by the input helper.
+ *
+ * @param prof profiling counters, or NULL
+ * @param held number of urefs currently held
+ */
+static inline void upipe_prof_held(struct upipe_prof *prof, uint64_t held)
+{
+    if (likely(prof == NULL))
+        return;
+    prof->held = held;
+    if (held > prof->held_max)
+        prof->held_max = held;
+}
+
+/** @This updates the number of urefs in the output queue of a pipe.
+ *
+ * @param prof profiling counters, or NULL
+ * @param queue number of urefs currently queued
+ */
+static inline void upipe_prof_queue(struct upipe_prof *prof, uint64_t queue)
+{
+    if (likely(prof == NULL))
+        return;
+    prof->queue = queue;
+    if (queue > prof->queue_max)
+        prof->queue_max = queue;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -109,6 +109,12 @@ enum uprobe_event {
     UPROBE_CLOCK_UTC,
     /** a pipe signal the end of the preroll (void) */
     UPROBE_PREROLL_END,
+    /** a pipe carries a snapshot of its profiling counters
+     * (const struct upipe_prof *) */
+    UPROBE_PROF_STATS,
+    /** a pipe needs a shared memory segment to export its counters
+     * (struct ustats **) */
+    UPROBE_NEED_USTATS,
 
     /** non-standard events implemented by a module type can start from
      * there (first arg = signature) */
@@ -146,6 +152,8 @@ static inline const char *uprobe_event_str(int event)
     UBASE_CASE_TO_STR(UPROBE_CLOCK_TS);
     UBASE_CASE_TO_STR(UPROBE_CLOCK_UTC);
     UBASE_CASE_TO_STR(UPROBE_PREROLL_END);
+    UBASE_CASE_TO_STR(UPROBE_PROF_STATS);
+    UBASE_CASE_TO_STR(UPROBE_NEED_USTATS);
     UBASE_CASE_TO_STR(UPROBE_LOCAL);
     }
     return NULL;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short probe attaching profiling counters to pipes
+ *
+ * The probe attaches @ref upipe_prof counters and a @ref uaccount to the
+ * pipes throwing a ready event through it, and detaches them when the pipes
+ * die. The account itself is freed once the buffers it was charged for are
+ * released. Since the counters
+ * are listed without locking, a probe must only be used by the pipes of a
+ * single thread; use one probe per thread.
+ */
+
+#ifndef _UPIPE_UPROBE_PROF_H_
+/** @hidden */
+#define _UPIPE_UPROBE_PROF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_prof {
+    /** list of profiled pipes */
+    struct uchain profs;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_prof, uprobe)
+
+/** @This initializes an already allocated uprobe_prof structure.
+ *
+ * @param uprobe_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_init(struct uprobe_prof *uprobe_prof,
+                                struct uprobe *next);
+
+/** @This cleans a uprobe_prof structure.
+ *
+ * @param uprobe_prof structure to clean
+ */
+void uprobe_prof_clean(struct uprobe_prof *uprobe_prof);
+
+/** @This allocates a new uprobe_prof structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_alloc(struct uprobe *next);
+
+/** @This throws a @ref UPROBE_PROF_STATS event from each profiled pipe.
+ * It must be called from the thread of the pipes, and the event handlers
+ * must not release the pipes.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_snapshot(struct uprobe *uprobe);
+
+/** @This throws a @ref UPROBE_PROF_STATS event from the profiled pipes
+ * which currently allocate the most bytes, in decreasing order. It must be
+ * called from the thread of the pipes, and the event handlers must not
+ * release the pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param nb maximum number of pipes
+ * @return an error code
+ */
+int uprobe_prof_snapshot_top(struct uprobe *uprobe, unsigned int nb);
+
+/** @This resets the cumulative counters of the profiled pipes.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_reset(struct uprobe *uprobe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
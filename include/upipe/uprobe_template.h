@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe recording a negotiated pipeline as a template
+ *
+ * The probe is placed in the probe hierarchy of a pipeline. The first time
+ * the pipeline is brought up, it forwards the requests to the next probes
+ * and records their answers (uref and ubuf managers, flow formats and
+ * uclock). Requests carrying a flow format are answered for any pipe
+ * proposing the same flow format, other requests only for pipes of the
+ * manager which recorded them. The sink latency depends on the position of
+ * the pipe in the graph and is never recorded. Once the pipeline is
+ * negotiated, its graph and output flow definitions may be captured.
+ *
+ * The template is then used to instantiate the pipeline again: the chains
+ * of pipes are allocated from the captured managers, and the requests are
+ * answered immediately with the recorded managers, whose pools are still
+ * warm, instead of being negotiated again.
+ */
+
+#ifndef _UPIPE_UPROBE_TEMPLATE_H_
+/** @hidden */
+#define _UPIPE_UPROBE_TEMPLATE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ulist.h>
+
+#include <stdarg.h>
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_template {
+    /** list of recorded answers to requests */
+    struct uchain answers;
+    /** list of requests forwarded to the next probe */
+    struct uchain proxies;
+    /** list of captured pipes */
+    struct uchain nodes;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_template, uprobe)
+
+/** @This initializes an already allocated uprobe_template structure.
+ *
+ * @param uprobe_template pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_template_init(struct uprobe_template *uprobe_template,
+                                    struct uprobe *next);
+
+/** @This cleans a uprobe_template structure.
+ *
+ * @param uprobe_template structure to clean
+ */
+void uprobe_template_clean(struct uprobe_template *uprobe_template);
+
+/** @This allocates a new uprobe_template structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_template_alloc(struct uprobe *next);
+
+/** @This captures the graph of a negotiated pipeline, replacing the
+ * previous capture. The managers and output flow definitions of the pipes
+ * are kept in the template.
+ *
+ * @param uprobe pointer to probe
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code
+ */
+int uprobe_template_capture_va(struct uprobe *uprobe,
+                               struct uchain *ulist, va_list args);
+
+/** @This captures the graph of a negotiated pipeline with a variable list
+ * of arguments.
+ *
+ * @param uprobe pointer to probe
+ * @param ulist list of sources pipes in ulist format, followed by a list of
+ * source pipes terminated by NULL
+ * @return an error code
+ */
+static inline int uprobe_template_capture(struct uprobe *uprobe,
+                                          struct uchain *ulist, ...)
+{
+    va_list args;
+    va_start(args, ulist);
+    int err = uprobe_template_capture_va(uprobe, ulist, args);
+    va_end(args);
+    return err;
+}
+
+/** @This allocates the outputs of a pipe following the captured graph.
+ * The captured pipe is the first one allocated from the same manager, and
+ * the chain stops at the first pipe without output, or whose output is a
+ * sub pipe or an inner pipe. Sub pipes are not allocated: their manager
+ * belongs to a super pipe instance (the input of a mux, the output of a
+ * split), so the caller allocates them from the new super pipe and
+ * completes the graph itself. Inner pipes are allocated by their bin.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pipe allocated again, typically a source
+ * @param output_uprobe probe given to the allocated pipes
+ * @param last_p filled in with the last pipe of the chain, with a new
+ * reference (upipe itself if no pipe was allocated)
+ * @return an error code
+ */
+int uprobe_template_alloc_output(struct uprobe *uprobe, struct upipe *upipe,
+                                 struct uprobe *output_uprobe,
+                                 struct upipe **last_p);
+
+/** @This warms up the pools of the recorded picture managers, by allocating
+ * and releasing the given number of pictures of the size of the captured
+ * flow definitions.
+ *
+ * @param uprobe pointer to probe
+ * @param nb number of pictures per manager
+ * @return an error code
+ */
+int uprobe_template_prealloc(struct uprobe *uprobe, unsigned int nb);
+
+/** @This returns the number of recorded answers and captured pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param answers_p filled in with the number of recorded answers
+ * @param nodes_p filled in with the number of captured pipes
+ */
+void uprobe_template_get_stats(struct uprobe *uprobe,
+                               unsigned int *answers_p,
+                               unsigned int *nodes_p);
+
+/** @This releases the recorded answers and the captured graph.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_template_vacuum(struct uprobe *uprobe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -41,6 +41,10 @@ extern "C" {
 
 /** @hidden */
 struct umem_mgr;
+/** @hidden */
+struct umem_pool_stats;
+/** @hidden */
+struct uref;
 
 /** @This is a super-set of the uprobe structure with additional local
  * members. */
@@ -84,6 +88,36 @@ struct uprobe *
  */
 void uprobe_ubuf_mem_pool_vacuum(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool);
 
+/** @This warms up the pools for pictures of the given flow definition and
+ * size, so that the first pictures allocated by pipes (typically decoders
+ * after a channel change or a resolution change) do not cause a burst of
+ * mallocs and page faults. For the buffers to stay available, the umem
+ * manager must be a umem pool manager deep enough for this size of buffers.
+ *
+ * @param uprobe_ubuf_mem_pool pointer to probe
+ * @param flow_def picture flow definition, as requested by the pipes
+ * @param hsize horizontal size of the pictures in pixels
+ * @param vsize vertical size of the pictures in lines
+ * @param nb number of pictures to keep warm
+ * @return an error code
+ */
+int uprobe_ubuf_mem_pool_prealloc_pic(
+        struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool,
+        struct uref *flow_def, size_t hsize, size_t vsize, unsigned int nb);
+
+/** @This returns the occupancy statistics of the buffers of a given size
+ * class, if the probe allocates from a umem pool manager with statistics
+ * enabled (see @ref umem_pool_mgr_enable_stats).
+ *
+ * @param uprobe_ubuf_mem_pool pointer to probe
+ * @param pool index of the size class, starting from the smallest buffers
+ * @param stats filled in with the statistics
+ * @return an error code
+ */
+int uprobe_ubuf_mem_pool_get_stats(
+        struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool,
+        unsigned int pool, struct umem_pool_stats *stats);
+
 /** @This cleans a uprobe_ubuf_mem_pool structure.
  *
  * @param uprobe_ubuf_mem_pool structure to clean
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short probe providing a shared memory segment to export counters
+ *
+ * The probe creates a stats segment (see @ref ustats_create) and provides it
+ * to the pipes throwing @ref UPROBE_NEED_USTATS. It may also export the hit
+ * rate of umem pool managers, refreshed by @ref uprobe_ustats_update, which
+ * is typically called by the application from a timer.
+ */
+
+#ifndef _UPIPE_UPROBE_USTATS_H_
+/** @hidden */
+#define _UPIPE_UPROBE_USTATS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ustats.h>
+
+/** @hidden */
+struct umem_mgr;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_ustats {
+    /** stats segment */
+    struct ustats *ustats;
+    /** list of exported umem managers */
+    struct uchain umem_mgrs;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_ustats, uprobe)
+
+/** @This initializes an already allocated uprobe_ustats structure.
+ *
+ * @param uprobe_ustats pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param name name of the shared memory object, or NULL for "/upipe-<pid>"
+ * @param nb_records number of records, or 0 for the default
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ustats_init(struct uprobe_ustats *uprobe_ustats,
+                                  struct uprobe *next, const char *name,
+                                  unsigned int nb_records);
+
+/** @This cleans a uprobe_ustats structure, and removes the segment.
+ *
+ * @param uprobe_ustats structure to clean
+ */
+void uprobe_ustats_clean(struct uprobe_ustats *uprobe_ustats);
+
+/** @This allocates a new uprobe_ustats structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param name name of the shared memory object, or NULL for "/upipe-<pid>"
+ * @param nb_records number of records, or 0 for the default
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ustats_alloc(struct uprobe *next, const char *name,
+                                   unsigned int nb_records);
+
+/** @This returns the stats segment of the probe, to register application
+ * counters.
+ *
+ * @param uprobe pointer to probe
+ * @return pointer to the segment
+ */
+struct ustats *uprobe_ustats_get(struct uprobe *uprobe);
+
+/** @This exports the hit rate of the pools of a umem pool manager, as
+ * "<name>.<size>.hit_rate" ratio records. The statistics of the manager
+ * must have been enabled with @ref umem_pool_mgr_enable_stats.
+ *
+ * @param uprobe pointer to probe
+ * @param umem_mgr umem pool manager
+ * @param name prefix of the records
+ * @return an error code
+ */
+int uprobe_ustats_add_umem_mgr(struct uprobe *uprobe,
+                               struct umem_mgr *umem_mgr, const char *name);
+
+/** @This refreshes the records of the exported umem managers.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_ustats_update(struct uprobe *uprobe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -51,6 +51,8 @@ struct upump;
 struct upump_blocker;
 /** @hidden */
 struct umutex;
+/** @hidden */
+struct upump_trace;
 
 /** @This defines the standard types of pumps. */
 enum upump_type {
@@ -133,6 +135,8 @@ enum upump_mgr_command {
     UPUMP_MGR_RUN,
     /** release all buffers kept in pools (void) */
     UPUMP_MGR_VACUUM,
+    /** trace the dispatches of the event loop (struct upump_trace *) */
+    UPUMP_MGR_SET_TRACE,
 
     /** non-standard manager commands implemented by a upump handler can start
      * from there (first arg = signature) */
@@ -518,6 +522,20 @@ static inline int upump_mgr_vacuum(struct upump_mgr *mgr)
     return upump_mgr_control(mgr, UPUMP_MGR_VACUUM);
 }
 
+/** @This starts tracing the dispatches of an event loop, or stops it if
+ * trace is NULL. The trace structure belongs to the caller and must outlive
+ * the manager or be unset before being cleaned.
+ *
+ * @param mgr pointer to upump manager
+ * @param trace pointer to an initialized trace structure, or NULL
+ * @return an error code
+ */
+static inline int upump_mgr_set_trace(struct upump_mgr *mgr,
+                                      struct upump_trace *trace)
+{
+    return upump_mgr_control(mgr, UPUMP_MGR_SET_TRACE, trace);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,12 +38,15 @@ extern "C" {
 #include <upipe/ulist.h>
 #include <upipe/upool.h>
 #include <upipe/upump.h>
+#include <upipe/uaccount.h>
 
 #include <stdbool.h>
 #include <stdarg.h>
 
 /** @hidden */
 struct upump_blocker;
+/** @hidden */
+struct upump_trace;
 
 /** @This stores upump parameters invisible from modules but usually common.
  */
@@ -54,6 +57,8 @@ struct upump_common {
     bool status;
     /** list of blockers registered on this pump */
     struct uchain blockers;
+    /** account current when the pump was allocated, or NULL */
+    struct uaccount *account;
 
     /** public upump structure */
     struct upump upump;
@@ -140,6 +145,9 @@ struct upump_common_mgr {
     /** function to really stop a watcher */
     void (*upump_real_stop)(struct upump *, bool);
 
+    /** trace of the dispatches, or NULL */
+    struct upump_trace *trace;
+
     /** structure exported to modules */
     struct upump_mgr mgr;
 };
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short tracing of the dispatches of an event loop
+ *
+ * A upump_trace structure is given to a upump manager with
+ * @ref upump_mgr_set_trace. The manager then records the duration of the
+ * callbacks of its pumps, globally and per pump, the lateness of its timers
+ * and the time spent processing each iteration of the loop, and keeps a
+ * ring of the last dispatches slower than a threshold.
+ *
+ * The structure is written from the thread running the event loop, without
+ * locking, so it must only be read from that thread or once the loop has
+ * returned.
+ */
+
+#ifndef _UPIPE_UPUMP_TRACE_H_
+/** @hidden */
+#define _UPIPE_UPUMP_TRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/upump.h>
+
+#include <stdint.h>
+
+/** number of buckets of a histogram */
+#define UPUMP_TRACE_BUCKETS 24
+/** number of entries of the ring of slow dispatches */
+#define UPUMP_TRACE_SLOW 32
+/** size of the names of the pumps, including the final nul */
+#define UPUMP_TRACE_NAME_SIZE 32
+/** number of buckets of the hash table of pumps */
+#define UPUMP_TRACE_HASH 64
+/** default threshold for a dispatch to be slow (1 ms) */
+#define UPUMP_TRACE_DEFAULT_THRESHOLD (UCLOCK_FREQ / 1000)
+
+/** @This stores a histogram of durations. Bucket 0 counts the durations
+ * under 1 µs, and bucket n counts the durations in [2^(n-1), 2^n[ µs, the
+ * last one also counting all longer durations. */
+struct upump_trace_hist {
+    /** number of samples */
+    uint64_t count;
+    /** sum of the samples, in 27 MHz ticks */
+    uint64_t total;
+    /** longest sample, in 27 MHz ticks */
+    uint64_t max;
+    /** number of samples per bucket */
+    uint64_t buckets[UPUMP_TRACE_BUCKETS];
+};
+
+/** @This stores the statistics of a pump, identified by its callback and
+ * opaque, so that they survive pumps which are freed and allocated again. */
+struct upump_trace_pump {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** next statistics in the same hash bucket */
+    struct upump_trace_pump *next;
+    /** callback of the pump */
+    upump_cb cb;
+    /** opaque of the pump */
+    void *opaque;
+    /** name of the owner of the pump */
+    char name[UPUMP_TRACE_NAME_SIZE];
+    /** durations of the callbacks */
+    struct upump_trace_hist dispatch;
+};
+
+UBASE_FROM_TO(upump_trace_pump, uchain, uchain, uchain)
+
+/** @This stores a slow dispatch. */
+struct upump_trace_slow {
+    /** date of the dispatch, in 27 MHz ticks of the monotonic clock */
+    uint64_t date;
+    /** duration of the callback, in 27 MHz ticks */
+    uint64_t duration;
+    /** callback of the pump */
+    upump_cb cb;
+    /** opaque of the pump */
+    void *opaque;
+    /** name of the owner of the pump */
+    char name[UPUMP_TRACE_NAME_SIZE];
+};
+
+/** @This returns the name of the owner of a pump from its opaque.
+ *
+ * @param opaque opaque of the pump
+ * @param name filled in with the name
+ * @param size size of name
+ */
+typedef void (*upump_trace_name)(void *opaque, char *name, size_t size);
+
+/** @This stores the trace of an event loop. */
+struct upump_trace {
+    /** durations of all the callbacks */
+    struct upump_trace_hist dispatch;
+    /** lateness of the timers */
+    struct upump_trace_hist lateness;
+    /** number of timers dispatched before their deadline */
+    uint64_t early;
+    /** time spent processing each iteration of the loop */
+    struct upump_trace_hist iteration;
+
+    /** list of per-pump statistics */
+    struct uchain pumps;
+    /** hash table of per-pump statistics */
+    struct upump_trace_pump *hash[UPUMP_TRACE_HASH];
+    /** function returning the name of the owner of a pump, or NULL */
+    upump_trace_name name;
+
+    /** minimum duration of a slow dispatch, in 27 MHz ticks */
+    uint64_t threshold;
+    /** ring of the last slow dispatches */
+    struct upump_trace_slow slow[UPUMP_TRACE_SLOW];
+    /** total number of slow dispatches */
+    uint64_t nb_slow;
+};
+
+/** @This initializes a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ * @param name function returning the name of the owner of a pump, or NULL
+ */
+void upump_trace_init(struct upump_trace *trace, upump_trace_name name);
+
+/** @This releases the per-pump statistics of a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ */
+void upump_trace_clean(struct upump_trace *trace);
+
+/** @This resets the counters of a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ */
+void upump_trace_reset(struct upump_trace *trace);
+
+/** @This returns the date of the monotonic clock used by the traces.
+ *
+ * @return date in 27 MHz ticks
+ */
+uint64_t upump_trace_now(void);
+
+/** @This adds a sample to a histogram.
+ *
+ * @param hist pointer to histogram
+ * @param duration duration in 27 MHz ticks
+ */
+void upump_trace_hist_add(struct upump_trace_hist *hist, uint64_t duration);
+
+/** @This returns the per-pump statistics of a pump, allocating them the
+ * first time the pump is dispatched.
+ *
+ * @param trace pointer to trace structure
+ * @param upump description structure of the pump
+ * @return pointer to the per-pump statistics, or NULL in case of allocation
+ * error
+ */
+struct upump_trace_pump *upump_trace_get_pump(struct upump_trace *trace,
+                                              struct upump *upump);
+
+/** @This records a dispatch.
+ *
+ * @param trace pointer to trace structure
+ * @param pump per-pump statistics, or NULL
+ * @param cb callback of the pump
+ * @param opaque opaque of the pump
+ * @param begin date of the beginning of the callback
+ * @param end date of the end of the callback
+ */
+void upump_trace_dispatch(struct upump_trace *trace,
+                          struct upump_trace_pump *pump,
+                          upump_cb cb, void *opaque,
+                          uint64_t begin, uint64_t end);
+
+/** @This records the lateness of a timer.
+ *
+ * @param trace pointer to trace structure
+ * @param lateness difference between the dispatch and the deadline, in
+ * 27 MHz ticks (negative if the timer fired early)
+ */
+void upump_trace_timer(struct upump_trace *trace, int64_t lateness);
+
+/** @This records the time spent processing an iteration of the loop.
+ *
+ * @param trace pointer to trace structure
+ * @param duration duration in 27 MHz ticks
+ */
+static inline void upump_trace_iteration(struct upump_trace *trace,
+                                         uint64_t duration)
+{
+    upump_trace_hist_add(&trace->iteration, duration);
+}
+
+/** @This returns a slow dispatch from the ring, from the most recent.
+ *
+ * @param trace pointer to trace structure
+ * @param index index of the dispatch, 0 being the most recent
+ * @return pointer to the dispatch, or NULL if there is no such dispatch
+ */
+const struct upump_trace_slow *upump_trace_get_slow(struct upump_trace *trace,
+                                                    unsigned int index);
+
+/** @This is a name function for pumps whose opaque is the pipe owning
+ * them, which is the case of the pumps allocated by upipe modules. It
+ * returns the name given by the first prefix probe of the pipe.
+ *
+ * @param opaque pipe owning the pump
+ * @param name filled in with the name
+ * @param size size of name
+ */
+void upump_trace_upipe_name(void *opaque, char *name, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
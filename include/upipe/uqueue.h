@@ -40,6 +40,7 @@ extern "C" {
 #include <upipe/ufifo.h>
 #include <upipe/ueventfd.h>
 #include <upipe/upump.h>
+#include <upipe/utrace.h>
 
 #include <stdint.h>
 #include <assert.h>
@@ -140,8 +141,10 @@ static inline bool uqueue_push(struct uqueue *uqueue, void *element)
         ueventfd_read(&uqueue->event_push);
 
         /* double-check */
-        if (likely(!ufifo_push(&uqueue->fifo, element)))
+        if (likely(!ufifo_push(&uqueue->fifo, element))) {
+            UTRACE3(uqueue_push, uqueue, element, false);
             return false;
+        }
 
         /* signal that we're alright again */
         ueventfd_write(&uqueue->event_push);
@@ -149,6 +152,7 @@ static inline bool uqueue_push(struct uqueue *uqueue, void *element)
 
     if (unlikely(uatomic_fetch_add(&uqueue->counter, 1) == 0))
         ueventfd_write(&uqueue->event_pop);
+    UTRACE3(uqueue_push, uqueue, element, true);
     return true;
 }
 
@@ -166,8 +170,10 @@ static inline void *uqueue_pop_internal(struct uqueue *uqueue)
 
         /* double-check */
         element = ufifo_pop(&uqueue->fifo, void *);
-        if (likely(element == NULL))
+        if (likely(element == NULL)) {
+            UTRACE2(uqueue_pop, uqueue, NULL);
             return NULL;
+        }
 
         /* signal that we're alright again */
         ueventfd_write(&uqueue->event_pop);
@@ -175,6 +181,7 @@ static inline void *uqueue_pop_internal(struct uqueue *uqueue)
 
     if (unlikely(uatomic_fetch_sub(&uqueue->counter, 1) == uqueue->length))
         ueventfd_write(&uqueue->event_push);
+    UTRACE2(uqueue_pop, uqueue, element);
     return element;
 }
 
@@ -37,8 +37,10 @@ extern "C" {
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uaccount.h>
 #include <upipe/ubuf.h>
 #include <upipe/udict.h>
+#include <upipe/utrace.h>
 
 #include <assert.h>
 #include <inttypes.h>
@@ -86,6 +88,8 @@ static inline const char *uref_date_type_str(int dt)
 #define UREF_FLAG_BLOCK_END 0x10
 /** the block contains a clock reference */
 #define UREF_FLAG_CLOCK_REF 0x20
+/** the uref carries trace stamps, see @ref uref_trace_start */
+#define UREF_FLAG_TRACE 0x40
 
 /** position of the bitfield for the type of sys date */
 #define UREF_FLAG_DATE_SYS 0x0400000000000000
@@ -171,6 +175,7 @@ static inline void uref_free(struct uref *uref)
 {
     if (uref == NULL)
         return;
+    UTRACE1(uref_free, uref);
     ubuf_free(uref->ubuf);
     udict_free(uref->udict);
     uref->mgr->uref_free(uref);
@@ -203,9 +208,11 @@ static inline void uref_init(struct uref *uref)
 static inline struct uref *uref_alloc(struct uref_mgr *mgr)
 {
     struct uref *uref = mgr->uref_alloc(mgr);
+    UTRACE2(uref_alloc, mgr, uref);
     if (unlikely(uref == NULL))
         return NULL;
 
+    uaccount_uref();
     uref_init(uref);
     return uref;
 }
@@ -263,9 +270,11 @@ static inline struct uref *uref_dup_inner(struct uref *uref)
 {
     assert(uref != NULL);
     struct uref *new_uref = uref->mgr->uref_alloc(uref->mgr);
+    UTRACE2(uref_alloc, uref->mgr, new_uref);
     if (unlikely(new_uref == NULL))
         return NULL;
 
+    uaccount_uref();
     new_uref->ubuf = NULL;
     if (uref->udict != NULL) {
         new_uref->udict = udict_dup(uref->udict);
@@ -38,7 +38,8 @@ extern "C" {
 #include <upipe/udict.h>
 
 /** @This imports all attributes from a uref into another uref (see also
- * @ref udict_import).
+ * @ref udict_import). The trace stamps being attributes, the uref is also
+ * traced if uref_attr is.
  *
  * @param uref overwritten uref
  * @param uref_attr uref containing attributes to fetch
@@ -46,6 +47,7 @@ extern "C" {
  */
 static inline int uref_attr_import(struct uref *uref, struct uref *uref_attr)
 {
+    uref->flags |= uref_attr->flags & UREF_FLAG_TRACE;
     if (uref_attr->udict == NULL)
         return UBASE_ERR_NONE;
     if (uref->udict == NULL) {
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short trace stamps recording the path of sampled urefs through a graph
+ *
+ * Once @ref uref_trace_start has been called on a uref, @ref upipe_input
+ * appends a stamp with the signature of the manager of the pipe and the
+ * date to the uref, each time the uref enters a pipe. The stamps are kept
+ * in the "x.trace" attribute, so they are copied along with the uref by
+ * @ref uref_dup and @ref uref_attr_import, and the framers using
+ * @ref #UPIPE_HELPER_UREF_STREAM pass them to the frame containing the
+ * start of a traced uref. Pipes allocating new urefs for their output
+ * without importing the attributes of their input, such as muxes, stop the
+ * trace. The difference between two consecutive stamps is the residence
+ * time of the uref in a pipe, including the time spent in its queues.
+ *
+ * Urefs which are not traced only cost a test of their flags.
+ */
+
+#ifndef _UPIPE_UREF_TRACE_H_
+/** @hidden */
+#define _UPIPE_UREF_TRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** maximum number of stamps of a uref, subsequent pipes are not recorded */
+#define UREF_TRACE_STAMPS 32
+
+/** @This stores a trace stamp. */
+struct uref_trace_stamp {
+    /** signature of the manager of the pipe */
+    uint32_t signature;
+    /** reserved for future use */
+    uint32_t reserved;
+    /** date of the entry in the pipe, in 27 MHz ticks of the monotonic
+     * clock */
+    uint64_t date;
+};
+
+/** @This returns the date of the monotonic clock used by the stamps.
+ *
+ * @return date in 27 MHz ticks
+ */
+uint64_t uref_trace_now(void);
+
+/** @This starts tracing a uref, discarding previous stamps if any.
+ *
+ * @param uref pointer to the uref
+ * @return an error code
+ */
+int uref_trace_start(struct uref *uref);
+
+/** @This stops tracing a uref and deletes its stamps.
+ *
+ * @param uref pointer to the uref
+ */
+void uref_trace_stop(struct uref *uref);
+
+/** @This traces a uref with the stamps of a traced uref, unless it is
+ * already traced.
+ *
+ * @param uref pointer to the uref
+ * @param uref_from pointer to the traced uref
+ * @return an error code
+ */
+int uref_trace_import(struct uref *uref, struct uref *uref_from);
+
+/** @internal @This appends a stamp to a traced uref.
+ *
+ * @param uref pointer to the uref
+ * @param signature signature of the manager of the pipe
+ */
+void uref_trace_stamp(struct uref *uref, uint32_t signature);
+
+/** @This copies the stamps of a traced uref.
+ *
+ * @param uref pointer to the uref
+ * @param stamps filled in with the stamps
+ * @param nb_p filled in with the number of stamps
+ * @return an error code
+ */
+int uref_trace_get(struct uref *uref,
+                   struct uref_trace_stamp stamps[UREF_TRACE_STAMPS],
+                   size_t *nb_p);
+
+/** @This returns true if the uref is being traced.
+ *
+ * @param uref pointer to the uref
+ * @return true if the uref is traced
+ */
+static inline bool uref_trace_check(struct uref *uref)
+{
+    return !!(uref->flags & UREF_FLAG_TRACE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
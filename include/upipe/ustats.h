@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short shared memory segment exporting counters of a live process
+ *
+ * The segment is an array of fixed-size records, created by the monitored
+ * process and mapped read-only by monitoring tools (see upipe-stat). Each
+ * record has a single writer, and is protected by a sequence lock so that
+ * readers never block the writer: the sequence number is odd while the
+ * record is being written, and readers retry when it changed during their
+ * copy.
+ */
+
+#ifndef _UPIPE_USTATS_H_
+/** @hidden */
+#define _UPIPE_USTATS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+/** @hidden */
+struct upipe;
+
+/** magic number of a stats segment */
+#define USTATS_MAGIC UBASE_FOURCC('u','s','t','a')
+/** version of the layout of a stats segment */
+#define USTATS_VERSION 1
+/** maximum size of the name of a record, including the trailing zero */
+#define USTATS_NAME_SIZE 64
+/** default number of records of a segment */
+#define USTATS_DEFAULT_RECORDS 1024
+
+/** @This defines the types of records. */
+enum ustats_type {
+    /** free record */
+    USTATS_FREE = 0,
+    /** monotonic counter (value) */
+    USTATS_COUNTER,
+    /** instantaneous value (value) */
+    USTATS_GAUGE,
+    /** ratio between two counters (value / total) */
+    USTATS_RATIO,
+
+    /** record being registered */
+    USTATS_RESERVED = 0xff
+};
+
+/** @This returns a string describing the type of a record.
+ *
+ * @param type type of record
+ * @return a string, or NULL
+ */
+static inline const char *ustats_type_str(enum ustats_type type)
+{
+    switch (type) {
+        case USTATS_COUNTER: return "counter";
+        case USTATS_GAUGE: return "gauge";
+        case USTATS_RATIO: return "ratio";
+        default: break;
+    }
+    return NULL;
+}
+
+/** @This is a record of a stats segment. */
+struct ustats_record {
+    /** sequence number, odd while the record is being written */
+    uint32_t seq;
+    /** type of record (enum ustats_type) */
+    uint32_t type;
+    /** name of the record */
+    char name[USTATS_NAME_SIZE];
+    /** value of the counter or gauge, or numerator of the ratio */
+    uint64_t value;
+    /** denominator of the ratio */
+    uint64_t total;
+};
+
+/** @This is the header of a stats segment. */
+struct ustats_header {
+    /** magic number */
+    uint32_t magic;
+    /** version of the layout */
+    uint32_t version;
+    /** number of records */
+    uint32_t nb_records;
+    /** pid of the monitored process */
+    uint32_t pid;
+    /** records */
+    struct ustats_record records[];
+};
+
+/** @This is a consistent copy of a record. */
+struct ustats_sample {
+    /** type of record */
+    enum ustats_type type;
+    /** name of the record */
+    char name[USTATS_NAME_SIZE];
+    /** value of the counter or gauge, or numerator of the ratio */
+    uint64_t value;
+    /** denominator of the ratio */
+    uint64_t total;
+};
+
+/** @This describes a mapped stats segment. */
+struct ustats {
+    /** mapped segment */
+    struct ustats_header *header;
+    /** size of the mapping */
+    size_t size;
+    /** name of the segment if it was created by this process, or NULL */
+    char *name;
+};
+
+/** @internal @This starts writing a record.
+ *
+ * @param record record to write
+ */
+static inline void ustats_write_begin(struct ustats_record *record)
+{
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/** @internal @This finishes writing a record.
+ *
+ * @param record record to write
+ */
+static inline void ustats_write_end(struct ustats_record *record)
+{
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELEASE);
+}
+
+/** @This adds to a counter.
+ *
+ * @param record counter record, or NULL
+ * @param delta value to add
+ */
+static inline void ustats_counter_add(struct ustats_record *record,
+                                      uint64_t delta)
+{
+    if (record == NULL)
+        return;
+    ustats_write_begin(record);
+    __atomic_store_n(&record->value, record->value + delta, __ATOMIC_RELAXED);
+    ustats_write_end(record);
+}
+
+/** @This sets the value of a gauge.
+ *
+ * @param record gauge record, or NULL
+ * @param value new value
+ */
+static inline void ustats_gauge_set(struct ustats_record *record,
+                                    uint64_t value)
+{
+    if (record == NULL)
+        return;
+    ustats_write_begin(record);
+    __atomic_store_n(&record->value, value, __ATOMIC_RELAXED);
+    ustats_write_end(record);
+}
+
+/** @This adds to both terms of a ratio.
+ *
+ * @param record ratio record, or NULL
+ * @param value value to add to the numerator
+ * @param total value to add to the denominator
+ */
+static inline void ustats_ratio_add(struct ustats_record *record,
+                                    uint64_t value, uint64_t total)
+{
+    if (record == NULL)
+        return;
+    ustats_write_begin(record);
+    __atomic_store_n(&record->value, record->value + value, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->total, record->total + total, __ATOMIC_RELAXED);
+    ustats_write_end(record);
+}
+
+/** @This sets both terms of a ratio.
+ *
+ * @param record ratio record, or NULL
+ * @param value numerator
+ * @param total denominator
+ */
+static inline void ustats_ratio_set(struct ustats_record *record,
+                                    uint64_t value, uint64_t total)
+{
+    if (record == NULL)
+        return;
+    ustats_write_begin(record);
+    __atomic_store_n(&record->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->total, total, __ATOMIC_RELAXED);
+    ustats_write_end(record);
+}
+
+/** @This creates a stats segment.
+ *
+ * @param name name of the shared memory object, or NULL for
+ * "/upipe-<pid>"
+ * @param nb_records number of records, or 0 for the default
+ * @return pointer to the segment, or NULL in case of error
+ */
+struct ustats *ustats_create(const char *name, unsigned int nb_records);
+
+/** @This maps an existing stats segment read-only.
+ *
+ * @param name name of the shared memory object
+ * @return pointer to the segment, or NULL in case of error
+ */
+struct ustats *ustats_attach(const char *name);
+
+/** @This unmaps a stats segment, and removes it if it was created by
+ * this process.
+ *
+ * @param ustats pointer to the segment
+ */
+void ustats_close(struct ustats *ustats);
+
+/** @This returns the number of records of a segment.
+ *
+ * @param ustats pointer to the segment
+ * @return number of records
+ */
+static inline unsigned int ustats_nb_records(struct ustats *ustats)
+{
+    return ustats->header->nb_records;
+}
+
+/** @This registers a new record.
+ *
+ * @param ustats pointer to the segment, or NULL
+ * @param type type of record
+ * @param format printf-style format of the name, followed by optional
+ * arguments
+ * @return pointer to the record, or NULL if the segment is full
+ */
+struct ustats_record *ustats_register(struct ustats *ustats,
+                                      enum ustats_type type,
+                                      const char *format, ...)
+    UBASE_FMT_PRINTF(3, 4);
+
+/** @This releases a record.
+ *
+ * @param record pointer to the record, or NULL
+ */
+void ustats_unregister(struct ustats_record *record);
+
+/** @This reads a consistent copy of a record.
+ *
+ * @param ustats pointer to the segment
+ * @param index index of the record
+ * @param sample filled in with the copy
+ * @return an error code (UBASE_ERR_INVALID if the record is free,
+ * UBASE_ERR_BUSY if it is being written)
+ */
+int ustats_read(struct ustats *ustats, unsigned int index,
+                struct ustats_sample *sample);
+
+/** @This registers a new record for a pipe, in the segment provided by the
+ * probe hierarchy (see @ref uprobe_ustats). The name of the record is the
+ * name of the first prefix probe of the pipe, or its signature, followed by
+ * a dot and the name of the metric.
+ *
+ * @param upipe description structure of the pipe
+ * @param type type of record
+ * @param metric name of the metric
+ * @return pointer to the record, or NULL if no segment is available
+ */
+struct ustats_record *upipe_ustats_register(struct upipe *upipe,
+                                            enum ustats_type type,
+                                            const char *metric);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
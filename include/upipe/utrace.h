@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short static tracepoints in the hot paths
+ *
+ * When Upipe is configured with USDT support (the default if
+ * <sys/sdt.h> is available, see --disable-usdt), the following probes
+ * of provider "upipe" are compiled in. A probe site is a single nop
+ * instruction until a tracer such as bpftrace, perf or SystemTap attaches
+ * to it. Its arguments are however always computed, whether a tracer is
+ * attached or not, so that the tracer finds them in registers or in
+ * memory: the loads of upipe->mgr->signature for the upipe_input probes,
+ * for instance, are performed on every call.
+ *
+ * @table 2
+ * @item probe @item arguments
+ * @item uref_alloc @item uref manager, allocated or duplicated uref (NULL
+ * on failure)
+ * @item uref_free @item freed uref
+ * @item ubuf_alloc @item ubuf manager, signature, allocated ubuf (NULL on
+ * failure)
+ * @item ubuf_dup @item duplicated ubuf, new ubuf (NULL on failure)
+ * @item ubuf_free @item freed ubuf
+ * @item upipe_input_entry @item pipe, signature of its manager, uref
+ * @item upipe_input_exit @item pipe, signature of its manager
+ * @item upump_dispatch_entry @item pump, callback, opaque
+ * @item upump_dispatch_exit @item callback, opaque (the pump may have been
+ * freed)
+ * @item uqueue_push @item queue, element, true if the element was queued
+ * @item uqueue_pop @item queue, popped element (NULL if the queue was empty)
+ * @end table
+ *
+ * Otherwise the macros expand to nothing and do not evaluate their
+ * arguments. The probes compiled in a library or an application are listed
+ * in its .note.stapsdt section, for instance with
+ * "readelf -n libupipe.so | grep -A3 stapsdt". Example bpftrace scripts are
+ * available in examples/bpftrace.
+ */
+
+#ifndef _UPIPE_UTRACE_H_
+/** @hidden */
+#define _UPIPE_UTRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/config.h>
+
+#ifdef UPIPE_HAVE_USDT
+#include <sys/sdt.h>
+
+/** @This fires probe name of provider upipe with one argument. */
+#define UTRACE1(name, a)                                                    \
+    DTRACE_PROBE1(upipe, name, a)
+/** @This fires probe name of provider upipe with two arguments. */
+#define UTRACE2(name, a, b)                                                 \
+    DTRACE_PROBE2(upipe, name, a, b)
+/** @This fires probe name of provider upipe with three arguments. */
+#define UTRACE3(name, a, b, c)                                              \
+    DTRACE_PROBE3(upipe, name, a, b, c)
+
+#else
+
+/** @hidden */
+#define UTRACE1(name, a) do { } while (0)
+/** @hidden */
+#define UTRACE2(name, a, b) do { } while (0)
+/** @hidden */
+#define UTRACE3(name, a, b, c) do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -41,6 +41,10 @@
 
 /** structure to protect exclusive access to avcodec_open() */
 struct udeal upipe_av_deal;
+/** process-wide decoder thread budget (0 means unlimited) */
+uatomic_uint32_t upipe_av_thread_budget;
+/** number of decoder threads currently granted */
+uatomic_uint32_t upipe_av_thread_used;
 /** @internal true if only avcodec was initialized */
 static bool avcodec_only = false;
 /** @internal probe used by upipe_av_vlog, defined in upipe_av_init() */
@@ -113,6 +117,8 @@ bool upipe_av_init(bool init_avcodec_only, struct uprobe *uprobe)
         uprobe_release(uprobe);
         return false;
     }
+    uatomic_init(&upipe_av_thread_budget, 0);
+    uatomic_init(&upipe_av_thread_used, 0);
 
     if (unlikely(avcodec_only)) {
         avcodec_register_all();
@@ -136,6 +142,8 @@ void upipe_av_clean(void)
     if (likely(!avcodec_only))
         avformat_network_deinit();
     udeal_clean(&upipe_av_deal);
+    uatomic_clean(&upipe_av_thread_budget);
+    uatomic_clean(&upipe_av_thread_used);
     if (logprobe)
         uprobe_release(logprobe);
 }
@@ -32,6 +32,7 @@
 #define _UPIPE_AV_INTERNAL_H_
 
 #include <upipe/udeal.h>
+#include <upipe/uatomic.h>
 #include <upipe/upump.h>
 
 #include <stdbool.h>
@@ -55,6 +56,10 @@ enum CodecID;
 
 /** structure to protect exclusive access to avcodec_open() */
 extern struct udeal upipe_av_deal;
+/** process-wide decoder thread budget (0 means unlimited) */
+extern uatomic_uint32_t upipe_av_thread_budget;
+/** number of decoder threads currently granted */
+extern uatomic_uint32_t upipe_av_thread_used;
 
 /** @This allocates a watcher triggering when exclusive access to avcodec_open()
  * is granted.
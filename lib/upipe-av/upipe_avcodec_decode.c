@@ -53,6 +53,7 @@
 #include <upipe/upipe_helper_upump_mgr.h>
 #include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_input.h>
+#include <upipe/upipe_helper_uclock.h>
 #include <upipe-av/upipe_avcodec_decode.h>
 #include <upipe-framers/uref_h26x.h>
 
@@ -69,6 +70,7 @@
 #include <libavutil/avutil.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/opt.h>
+#include <libavutil/cpu.h>
 #include <upipe-av/upipe_av_pixfmt.h>
 #include <upipe-av/upipe_av_samplefmt.h>
 #include "upipe_av_internal.h"
@@ -77,6 +79,8 @@
 
 #define EXPECTED_FLOW_DEF "block."
 
+UREF_ATTR_UNSIGNED(avcdec, input_date, "x.avcdec_input", avcdec input date)
+
 /** @hidden */
 static int upipe_avcdec_check(struct upipe *upipe, struct uref *flow_format);
 /** @hidden */
@@ -119,6 +123,10 @@ struct upipe_avcdec {
 
     /** upump mgr */
     struct upump_mgr *upump_mgr;
+    /** uclock structure, used to measure decode latency */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
     /** pixel format used for the ubuf manager */
     enum AVPixelFormat pix_fmt;
     /** sample format used for the ubuf manager */
@@ -169,6 +177,17 @@ struct upipe_avcdec {
     /** true if the context will be closed */
     bool close;
 
+    /** requested threading model */
+    enum upipe_avcdec_thread_type thread_type;
+    /** requested number of threads (0 for automatic) */
+    unsigned int thread_count;
+    /** number of threads granted from the process-wide budget */
+    unsigned int thread_granted;
+    /** true if low latency mode is enabled */
+    bool low_latency;
+    /** measured decode latency */
+    struct upipe_avcdec_latency latency;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -184,6 +203,9 @@ UPIPE_HELPER_UBUF_MGR(upipe_avcdec, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_avcdec_check,
                       upipe_avcdec_register_output_request,
                       upipe_avcdec_unregister_output_request)
+UPIPE_HELPER_UCLOCK(upipe_avcdec, uclock, uclock_request, NULL,
+                    upipe_avcdec_register_output_request,
+                    upipe_avcdec_unregister_output_request)
 UPIPE_HELPER_UPUMP_MGR(upipe_avcdec, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_avcdec, upump_av_deal, upump_mgr)
 UPIPE_HELPER_INPUT(upipe_avcdec, urefs, nb_urefs, max_urefs, blockers, upipe_avcdec_decode)
@@ -308,11 +330,21 @@ static int upipe_avcdec_get_buffer_pic(struct AVCodecContext *context,
         urational_simplify(&fps);
         UBASE_FATAL(upipe, uref_pic_flow_set_fps(flow_def_attr, fps))
 
-        uint64_t latency = upipe_avcdec->input_latency +
-                           context->delay * UCLOCK_FREQ * fps.den / fps.num;
-        if (context->active_thread_type == FF_THREAD_FRAME &&
-            context->thread_count != -1)
-            latency += context->thread_count * UCLOCK_FREQ * fps.den / fps.num;
+        uint64_t latency = upipe_avcdec->input_latency;
+        if (upipe_avcdec->low_latency && upipe_avcdec->latency.count) {
+            /* round the measured latency up to the histogram bucket to
+             * avoid changing the flow definition on every frame */
+            uint64_t measured = UCLOCK_FREQ / 1000;
+            while (measured < upipe_avcdec->latency.max)
+                measured *= 2;
+            latency += measured;
+        } else {
+            latency += context->delay * UCLOCK_FREQ * fps.den / fps.num;
+            if (context->active_thread_type == FF_THREAD_FRAME &&
+                context->thread_count != -1)
+                latency += context->thread_count * UCLOCK_FREQ *
+                           fps.den / fps.num;
+        }
         UBASE_FATAL(upipe, uref_clock_set_latency(flow_def_attr, latency))
     }
     /* set aspect-ratio */
@@ -577,6 +609,73 @@ static void upipe_avcdec_abort_av_deal(struct upipe *upipe)
     }
 }
 
+/** @internal @This applies the threading model to the codec context, and
+ * takes the threads from the process-wide budget.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avcdec_apply_threading(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcdec->context;
+    enum upipe_avcdec_thread_type thread_type = upipe_avcdec->thread_type;
+    if (upipe_avcdec->low_latency) {
+        thread_type = UPIPE_AVCDEC_THREAD_SLICE;
+        context->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+
+    switch (thread_type) {
+        case UPIPE_AVCDEC_THREAD_FRAME:
+            context->thread_type = FF_THREAD_FRAME;
+            break;
+        case UPIPE_AVCDEC_THREAD_SLICE:
+            context->thread_type = FF_THREAD_SLICE;
+            break;
+        default:
+            break;
+    }
+
+    unsigned int thread_count = upipe_avcdec->thread_count;
+    uint32_t budget = uatomic_load(&upipe_av_thread_budget);
+    if (budget) {
+        /* decoders opened without the dealer may race on the budget */
+        uint32_t used = uatomic_load(&upipe_av_thread_used);
+        uint32_t granted;
+        do {
+            uint32_t available = used < budget ? budget - used : 0;
+            granted = thread_count ? thread_count : av_cpu_count();
+            if (granted > available)
+                granted = available;
+            /* a decoder always needs at least one thread */
+            if (!granted)
+                granted = 1;
+        } while (!uatomic_compare_exchange(&upipe_av_thread_used, &used,
+                                           used + granted));
+        upipe_avcdec->thread_granted = granted;
+        thread_count = granted;
+    }
+    if (thread_count) {
+        context->thread_count = thread_count;
+        upipe_dbg_va(upipe, "using %u thread(s)", thread_count);
+    }
+}
+
+/** @internal @This gives back the threads taken from the process-wide
+ * budget.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avcdec_release_threading(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (!upipe_avcdec->thread_granted)
+        return;
+    uint32_t used = uatomic_fetch_sub(&upipe_av_thread_used,
+                                      upipe_avcdec->thread_granted);
+    assert(used >= upipe_avcdec->thread_granted);
+    upipe_avcdec->thread_granted = 0;
+}
+
 /** @internal @This actually calls avcodec_open(). It may only be called by
  * one thread at a time.
  *
@@ -594,6 +693,7 @@ static bool upipe_avcdec_do_av_deal(struct upipe *upipe)
                         context->codec->long_name, context->codec->id);
 
         avcodec_close(context);
+        upipe_avcdec_release_threading(upipe);
         return false;
     }
 
@@ -621,9 +721,12 @@ static bool upipe_avcdec_do_av_deal(struct upipe *upipe)
             return false;
     }
 
+    upipe_avcdec_apply_threading(upipe);
+
     /* open new context */
     int err;
     if (unlikely((err = avcodec_open2(context, context->codec, NULL)) < 0)) {
+        upipe_avcdec_release_threading(upipe);
         upipe_av_strerror(err, buf);
         upipe_warn_va(upipe, "could not open codec (%s)", buf);
         upipe_throw_fatal(upipe, UBASE_ERR_EXTERNAL);
@@ -821,6 +924,42 @@ static void upipe_avcdec_set_time_attributes(struct upipe *upipe,
     }
 }
 
+/** @internal @This measures the decode latency of an output buffer, in
+ * low latency mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref output buffer
+ */
+static void upipe_avcdec_measure_latency(struct upipe *upipe,
+                                         struct uref *uref)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    uint64_t input_date;
+    if (!ubase_check(uref_avcdec_get_input_date(uref, &input_date)))
+        return;
+    uref_avcdec_delete_input_date(uref);
+    if (unlikely(upipe_avcdec->uclock == NULL))
+        return;
+
+    uint64_t now = uclock_now(upipe_avcdec->uclock);
+    uint64_t latency = now > input_date ? now - input_date : 0;
+    struct upipe_avcdec_latency *stats = &upipe_avcdec->latency;
+    if (!stats->count || latency < stats->min)
+        stats->min = latency;
+    if (latency > stats->max)
+        stats->max = latency;
+    stats->sum += latency;
+    stats->count++;
+
+    unsigned int bucket = 0;
+    uint64_t limit = UCLOCK_FREQ / 1000;
+    while (latency >= limit && bucket < UPIPE_AVCDEC_LATENCY_BUCKETS - 1) {
+        bucket++;
+        limit *= 2;
+    }
+    stats->buckets[bucket]++;
+}
+
 /** @internal @This outputs subtitles.
  *
  * @param upipe description structure of the pipe
@@ -1033,6 +1172,7 @@ static void upipe_avcdec_output_pic(struct upipe *upipe, struct upump **upump_p)
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return;
     }
+    upipe_avcdec_measure_latency(upipe, uref);
 
     if (!(context->codec->capabilities & AV_CODEC_CAP_DR1)) {
         /* Not direct rendering, copy data. */
@@ -1149,6 +1289,7 @@ static void upipe_avcdec_output_sound(struct upipe *upipe,
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return;
     }
+    upipe_avcdec_measure_latency(upipe, uref);
 
     if (!(context->codec->capabilities & AV_CODEC_CAP_DR1)) {
         /* Not direct rendering, copy data. */
@@ -1340,6 +1481,8 @@ static bool upipe_avcdec_decode(struct upipe *upipe, struct uref *uref,
     memset(avpkt.data + avpkt.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
     uref_pic_set_number(uref, upipe_avcdec->counter++);
+    if (upipe_avcdec->low_latency && upipe_avcdec->uclock != NULL)
+        uref_avcdec_set_input_date(uref, uclock_now(upipe_avcdec->uclock));
     uref_clock_get_rate(uref, &upipe_avcdec->drift_rate);
     uint64_t input_dts, input_dts_sys;
     if (ubase_check(uref_clock_get_dts_prog(uref, &input_dts)) &&
@@ -1536,6 +1679,71 @@ static int upipe_avcdec_set_option(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the threading model.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type threading model
+ * @param thread_count number of threads, or 0 for automatic
+ * @return an error code
+ */
+static int _upipe_avcdec_set_threading(struct upipe *upipe,
+        enum upipe_avcdec_thread_type thread_type, unsigned int thread_count)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->context != NULL && avcodec_is_open(upipe_avcdec->context))
+        return UBASE_ERR_BUSY;
+    if (thread_type != UPIPE_AVCDEC_THREAD_AUTO &&
+        thread_type != UPIPE_AVCDEC_THREAD_FRAME &&
+        thread_type != UPIPE_AVCDEC_THREAD_SLICE)
+        return UBASE_ERR_INVALID;
+    upipe_avcdec->thread_type = thread_type;
+    upipe_avcdec->thread_count = thread_count;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This gets the threading model.
+ *
+ * @param upipe description structure of the pipe
+ * @param thread_type_p filled in with the threading model
+ * @param thread_count_p filled in with the number of threads
+ * @return an error code
+ */
+static int _upipe_avcdec_get_threading(struct upipe *upipe,
+                                       int *thread_type_p,
+                                       unsigned int *thread_count_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcdec->context;
+    if (thread_type_p != NULL)
+        *thread_type_p = upipe_avcdec->low_latency ?
+            UPIPE_AVCDEC_THREAD_SLICE : upipe_avcdec->thread_type;
+    if (thread_count_p != NULL) {
+        if (context != NULL && avcodec_is_open(context) &&
+            context->thread_count > 0)
+            *thread_count_p = context->thread_count;
+        else
+            *thread_count_p = upipe_avcdec->thread_count;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This enables or disables low latency mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled true to enable low latency mode
+ * @return an error code
+ */
+static int _upipe_avcdec_set_low_latency(struct upipe *upipe, bool enabled)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec->context != NULL && avcodec_is_open(upipe_avcdec->context))
+        return UBASE_ERR_BUSY;
+    upipe_avcdec->low_latency = enabled;
+    if (enabled && upipe_avcdec->uclock == NULL)
+        upipe_avcdec_require_uclock(upipe);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -1565,6 +1773,9 @@ static int upipe_avcdec_control(struct upipe *upipe, int command, va_list args)
             upipe_avcdec_set_upump_av_deal(upipe, NULL);
             upipe_avcdec_abort_av_deal(upipe);
             return upipe_avcdec_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_avcdec_require_uclock(upipe);
+            return UBASE_ERR_NONE;
 
         case UPIPE_SET_FLOW_DEF: {
             struct uref *flow_def = va_arg(args, struct uref *);
@@ -1581,6 +1792,34 @@ static int upipe_avcdec_control(struct upipe *upipe, int command, va_list args)
             return upipe_avcdec_set_option(upipe, option, content);
         }
 
+        case UPIPE_AVCDEC_SET_THREADING: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int thread_type = va_arg(args, int);
+            unsigned int thread_count = va_arg(args, unsigned int);
+            return _upipe_avcdec_set_threading(upipe, thread_type,
+                                              thread_count);
+        }
+        case UPIPE_AVCDEC_GET_THREADING: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int *thread_type_p = va_arg(args, int *);
+            unsigned int *thread_count_p = va_arg(args, unsigned int *);
+            return _upipe_avcdec_get_threading(upipe, thread_type_p,
+                                              thread_count_p);
+        }
+        case UPIPE_AVCDEC_SET_LOW_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int enabled = va_arg(args, int);
+            return _upipe_avcdec_set_low_latency(upipe, !!enabled);
+        }
+        case UPIPE_AVCDEC_GET_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            struct upipe_avcdec_latency *latency =
+                va_arg(args, struct upipe_avcdec_latency *);
+            struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+            *latency = upipe_avcdec->latency;
+            return UBASE_ERR_NONE;
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -1610,6 +1849,7 @@ static void upipe_avcdec_free(struct upipe *upipe)
     upipe_avcdec_clean_flow_def(upipe);
     upipe_avcdec_clean_flow_def_check(upipe);
     upipe_avcdec_clean_ubuf_mgr(upipe);
+    upipe_avcdec_clean_uclock(upipe);
     upipe_avcdec_clean_upump_av_deal(upipe);
     upipe_avcdec_clean_upump_mgr(upipe);
     upipe_avcdec_clean_urefcount(upipe);
@@ -1639,6 +1879,7 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     }
     upipe_avcdec_init_urefcount(upipe);
     upipe_avcdec_init_ubuf_mgr(upipe);
+    upipe_avcdec_init_uclock(upipe);
     upipe_avcdec_init_upump_mgr(upipe);
     upipe_avcdec_init_upump_av_deal(upipe);
     upipe_avcdec_init_output(upipe);
@@ -1651,6 +1892,11 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     upipe_avcdec->frame = frame;
     upipe_avcdec->counter = 0;
     upipe_avcdec->close = false;
+    upipe_avcdec->thread_type = UPIPE_AVCDEC_THREAD_AUTO;
+    upipe_avcdec->thread_count = 0;
+    upipe_avcdec->thread_granted = 0;
+    upipe_avcdec->low_latency = false;
+    memset(&upipe_avcdec->latency, 0, sizeof(upipe_avcdec->latency));
     upipe_avcdec->pix_fmt = AV_PIX_FMT_NONE;
     upipe_avcdec->sample_fmt = AV_SAMPLE_FMT_NONE;
     upipe_avcdec->channels = 0;
@@ -1673,6 +1919,38 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This processes control commands on an avcdec manager.
+ *
+ * @param mgr pointer to manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_avcdec_mgr_control(struct upipe_mgr *mgr,
+                                    int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_AVCDEC_MGR_SET_THREAD_BUDGET: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            uatomic_store(&upipe_av_thread_budget,
+                          va_arg(args, unsigned int));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AVCDEC_MGR_GET_THREAD_BUDGET: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int *budget_p = va_arg(args, unsigned int *);
+            unsigned int *used_p = va_arg(args, unsigned int *);
+            if (budget_p != NULL)
+                *budget_p = uatomic_load(&upipe_av_thread_budget);
+            if (used_p != NULL)
+                *used_p = uatomic_load(&upipe_av_thread_used);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
 /** module manager static descriptor */
 static struct upipe_mgr upipe_avcdec_mgr = {
     .refcount = NULL,
@@ -1682,7 +1960,7 @@ static struct upipe_mgr upipe_avcdec_mgr = {
     .upipe_input = upipe_avcdec_input,
     .upipe_control = upipe_avcdec_control,
 
-    .upipe_mgr_control = NULL
+    .upipe_mgr_control = upipe_avcdec_mgr_control
 };
 
 /** @This returns the management structure for avcodec decoders.
@@ -29,6 +29,7 @@
 
 #include <upipe/ulist.h>
 #include <upipe/uprobe.h>
+#include <upipe/uclock.h>
 #include <upipe/udict.h>
 #include <upipe/uref.h>
 #include <upipe/uref_flow.h>
@@ -78,6 +79,17 @@ struct upipe_ebur128 {
     uint8_t planes;
     /** sample format */
     enum upipe_ebur128_fmt fmt;
+    /** sample rate */
+    uint64_t rate;
+
+    /** momentary loudness reporting interval */
+    uint64_t momentary_interval;
+    /** integrated loudness and range reporting interval */
+    uint64_t integrated_interval;
+    /** samples added since the last momentary loudness report */
+    uint64_t momentary_samples;
+    /** samples added since the last integrated loudness report */
+    uint64_t integrated_samples;
 
     /** public structure */
     struct upipe upipe;
@@ -108,6 +120,11 @@ static struct upipe *upipe_ebur128_alloc(struct upipe_mgr *mgr,
         return NULL;
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
     upipe_ebur128->st = NULL;
+    upipe_ebur128->rate = 0;
+    upipe_ebur128->momentary_interval = 0;
+    upipe_ebur128->integrated_interval = 0;
+    upipe_ebur128->momentary_samples = 0;
+    upipe_ebur128->integrated_samples = 0;
 
     upipe_ebur128_init_urefcount(upipe);
     upipe_ebur128_init_output(upipe);
@@ -115,6 +132,26 @@ static struct upipe *upipe_ebur128_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This checks if a reporting interval has elapsed, and resets
+ * the sample counter if it has.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval reporting interval in @ref #UCLOCK_FREQ units
+ * @param samples_p pointer to the number of samples since the last report
+ * @return true if a report is due
+ */
+static bool upipe_ebur128_check_interval(struct upipe *upipe,
+                                         uint64_t interval,
+                                         uint64_t *samples_p)
+{
+    struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
+    if (interval &&
+        *samples_p * UCLOCK_FREQ < interval * upipe_ebur128->rate)
+        return false;
+    *samples_p = 0;
+    return true;
+}
+
 /** @internal @This handles input.
  *
  * @param upipe description structure of the pipe
@@ -125,7 +162,6 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
-    double loud = 0, lra = 0, global = 0;
 
     if (unlikely(upipe_ebur128->output_flow == NULL)) {
         upipe_err_va(upipe, "invalid input");
@@ -204,15 +240,28 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
     else
         free(buf);
 
-    ebur128_loudness_momentary(upipe_ebur128->st, &loud);
-    ebur128_loudness_range(upipe_ebur128->st, &lra);
-    ebur128_loudness_global(upipe_ebur128->st, &global);
+    upipe_ebur128->momentary_samples += samples;
+    upipe_ebur128->integrated_samples += samples;
 
-    uref_ebur128_set_momentary(uref, loud);
-    uref_ebur128_set_lra(uref, lra);
-    uref_ebur128_set_global(uref, global);
+    if (upipe_ebur128_check_interval(upipe, upipe_ebur128->momentary_interval,
+                                     &upipe_ebur128->momentary_samples)) {
+        double loud = 0;
+        ebur128_loudness_momentary(upipe_ebur128->st, &loud);
+        uref_ebur128_set_momentary(uref, loud);
+        upipe_verbose_va(upipe, "loud %f", loud);
+    }
 
-    upipe_verbose_va(upipe, "loud %f lra %f global %f", loud, lra, global);
+    /* range and global loudness are computed from the histogram, which
+     * costs a walk over all its bins: only do it at the reporting pace */
+    if (upipe_ebur128_check_interval(upipe, upipe_ebur128->integrated_interval,
+                                     &upipe_ebur128->integrated_samples)) {
+        double lra = 0, global = 0;
+        ebur128_loudness_range(upipe_ebur128->st, &lra);
+        ebur128_loudness_global(upipe_ebur128->st, &global);
+        uref_ebur128_set_lra(uref, lra);
+        uref_ebur128_set_global(uref, global);
+        upipe_verbose_va(upipe, "lra %f global %f", lra, global);
+    }
 
     upipe_ebur128_output(upipe, uref, upump_p);
 }
@@ -259,6 +308,7 @@ static int upipe_ebur128_set_flow_def(struct upipe *upipe,
         return UBASE_ERR_ALLOC;
     }
     upipe_ebur128->fmt = fmt;
+    upipe_ebur128->rate = rate;
 
     if (unlikely(upipe_ebur128->st)) {
         //ebur128_destroy(&upipe_ebur128->st);
@@ -294,6 +344,24 @@ static int upipe_ebur128_provide_flow_format(struct upipe *upipe,
     return urequest_provide_flow_format(request, flow);
 }
 
+/** @internal @This sets a reporting interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p pointer to the interval to set
+ * @param samples_p pointer to the number of samples since the last report
+ * @param interval new interval in @ref #UCLOCK_FREQ units
+ * @return an error code
+ */
+static int upipe_ebur128_set_interval(struct upipe *upipe,
+                                      uint64_t *interval_p,
+                                      uint64_t *samples_p,
+                                      uint64_t interval)
+{
+    *interval_p = interval;
+    *samples_p = 0;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on the pipe.
  *
  * @param upipe description structure of the pipe
@@ -323,6 +391,41 @@ static int upipe_ebur128_control(struct upipe *upipe,
         case UPIPE_GET_OUTPUT:
         case UPIPE_SET_OUTPUT:
             return upipe_ebur128_control_output(upipe, command, args);
+
+        case UPIPE_EBUR128_SET_MOMENTARY_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            uint64_t interval = va_arg(args, uint64_t);
+            return upipe_ebur128_set_interval(upipe,
+                    &upipe_ebur128->momentary_interval,
+                    &upipe_ebur128->momentary_samples, interval);
+        }
+        case UPIPE_EBUR128_GET_MOMENTARY_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            *interval_p = upipe_ebur128->momentary_interval;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_EBUR128_SET_INTEGRATED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            uint64_t interval = va_arg(args, uint64_t);
+            return upipe_ebur128_set_interval(upipe,
+                    &upipe_ebur128->integrated_interval,
+                    &upipe_ebur128->integrated_samples, interval);
+        }
+        case UPIPE_EBUR128_GET_INTEGRATED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            *interval_p = upipe_ebur128->integrated_interval;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
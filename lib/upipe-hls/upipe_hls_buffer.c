@@ -208,6 +208,35 @@ static void upipe_hls_buffer_input(struct upipe *upipe,
     ueventfd_write(&upipe_hls_buffer->ueventfd);
 }
 
+/** @internal @This returns the duration of the buffered data.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration_p filled with the buffered duration in 27MHz ticks
+ * @return an error code
+ */
+static int _upipe_hls_buffer_get_duration(struct upipe *upipe,
+                                          uint64_t *duration_p)
+{
+    struct upipe_hls_buffer *upipe_hls_buffer =
+        upipe_hls_buffer_from_upipe(upipe);
+    uint64_t first = UINT64_MAX, last = 0;
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_buffer->buffer, uchain) {
+        uint64_t pts;
+        if (!ubase_check(uref_clock_get_pts_prog(uref_from_uchain(uchain),
+                                                 &pts)))
+            continue;
+        if (first == UINT64_MAX)
+            first = pts;
+        last = pts;
+    }
+
+    if (duration_p)
+        *duration_p = first != UINT64_MAX && last > first ? last - first : 0;
+    return UBASE_ERR_NONE;
+}
+
 static int _upipe_hls_buffer_control(struct upipe *upipe,
                                      int command,
                                      va_list args)
@@ -223,6 +252,12 @@ static int _upipe_hls_buffer_control(struct upipe *upipe,
         struct uref *flow_def = va_arg(args, struct uref *);
         return upipe_hls_buffer_set_flow_def(upipe, flow_def);
     }
+
+    case UPIPE_HLS_BUFFER_GET_DURATION: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_BUFFER_SIGNATURE);
+        uint64_t *duration_p = va_arg(args, uint64_t *);
+        return _upipe_hls_buffer_get_duration(upipe, duration_p);
+    }
     }
     return UBASE_ERR_UNHANDLED;
 }
@@ -23,6 +23,8 @@
 
 #include <upipe-hls/upipe_hls_master.h>
 #include <upipe-hls/upipe_hls_variant.h>
+#include <upipe-hls/upipe_hls_playlist.h>
+#include <upipe-hls/upipe_hls_buffer.h>
 
 #include <upipe-hls/uref_hls.h>
 
@@ -43,7 +45,17 @@
 
 #include <upipe/uprobe_prefix.h>
 
+#include <upipe/uclock.h>
+
 #define EXPECTED_FLOW_DEF       "block.m3u.master."
+/** number of samples used for the harmonic mean */
+#define ABR_HARMONIC_SAMPLES    5
+/** percentage of the estimated throughput a variant may use */
+#define ABR_SAFETY              85
+/** do not switch up below this buffered duration */
+#define ABR_BUFFER_LOW          (UCLOCK_FREQ * 4)
+/** do not switch down above this buffered duration */
+#define ABR_BUFFER_HIGH         (UCLOCK_FREQ * 8)
 
 /** @internal @This is the private context of a sub master pipe. */
 struct upipe_hls_master_sub {
@@ -65,8 +77,16 @@ struct upipe_hls_master_sub {
     struct upipe *output;
     /** flow definition */
     struct uref *flow_def;
+    /** variant id */
+    uint64_t id;
+    /** a switch was already requested */
+    bool switching;
 };
 
+/** @hidden */
+static int probe_variant(struct uprobe *uprobe, struct upipe *inner,
+                         int event, va_list args);
+
 UPIPE_HELPER_UPIPE(upipe_hls_master_sub, upipe, UPIPE_HLS_MASTER_SUB_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_hls_master_sub, urefcount,
                        upipe_hls_master_sub_no_ref);
@@ -74,7 +94,7 @@ UPIPE_HELPER_UREFCOUNT_REAL(upipe_hls_master_sub, urefcount_real,
                             upipe_hls_master_sub_free);
 UPIPE_HELPER_FLOW(upipe_hls_master_sub, NULL);
 UPIPE_HELPER_UPROBE(upipe_hls_master_sub, urefcount_real,
-                    last_inner_probe, NULL);
+                    last_inner_probe, probe_variant);
 UPIPE_HELPER_INNER(upipe_hls_master_sub, last_inner);
 UPIPE_HELPER_BIN_OUTPUT(upipe_hls_master_sub, last_inner, output, requests);
 
@@ -96,6 +116,14 @@ struct upipe_hls_master {
     struct uchain subs;
     /** variant id */
     uint64_t id;
+    /** adaptive variant selection is enabled */
+    bool abr;
+    /** buffer pipe to watch */
+    struct upipe *buffer;
+    /** last throughput samples in bps */
+    uint64_t samples[ABR_HARMONIC_SAMPLES];
+    /** adaptive selection state */
+    struct upipe_hls_master_abr_stats abr_stats;
 };
 
 UPIPE_HELPER_UPIPE(upipe_hls_master, upipe, UPIPE_HLS_MASTER_SIGNATURE)
@@ -104,6 +132,228 @@ UPIPE_HELPER_VOID(upipe_hls_master)
 UPIPE_HELPER_SUBPIPE(upipe_hls_master, upipe_hls_master_sub,
                      pipe, sub_mgr, subs, uchain);
 
+/** @internal @This adds a throughput sample.
+ *
+ * @param upipe description structure of the pipe
+ * @param bytes number of downloaded bytes
+ * @param duration download duration in 27MHz ticks
+ * @return an error code
+ */
+static int _upipe_hls_master_add_sample(struct upipe *upipe,
+                                        uint64_t bytes,
+                                        uint64_t duration)
+{
+    struct upipe_hls_master *upipe_hls_master =
+        upipe_hls_master_from_upipe(upipe);
+    struct upipe_hls_master_abr_stats *stats = &upipe_hls_master->abr_stats;
+
+    if (unlikely(!duration || !bytes))
+        return UBASE_ERR_INVALID;
+
+    uint64_t bps = bytes * 8 * UCLOCK_FREQ / duration;
+    if (!stats->samples)
+        stats->ewma = bps;
+    else
+        stats->ewma = stats->ewma - stats->ewma / 4 + bps / 4;
+    upipe_hls_master->samples[stats->samples % ABR_HARMONIC_SAMPLES] = bps;
+    stats->samples++;
+
+    unsigned count = stats->samples < ABR_HARMONIC_SAMPLES ?
+        stats->samples : ABR_HARMONIC_SAMPLES;
+    double sum = 0.;
+    for (unsigned i = 0; i < count; i++)
+        if (upipe_hls_master->samples[i])
+            sum += 1. / upipe_hls_master->samples[i];
+    stats->harmonic = sum > 0. ? count / sum : 0;
+    stats->estimate = stats->ewma < stats->harmonic ?
+        stats->ewma : stats->harmonic;
+
+    upipe_verbose_va(upipe, "sample %"PRIu64" bps, estimate %"PRIu64" bps "
+                     "(ewma %"PRIu64", harmonic %"PRIu64")",
+                     bps, stats->estimate, stats->ewma, stats->harmonic);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This finds a variant by its id.
+ *
+ * @param upipe description structure of the pipe
+ * @param id variant id
+ * @param bandwidth_p filled with the variant bandwidth
+ * @return the variant or NULL
+ */
+static struct uref *upipe_hls_master_find_variant(struct upipe *upipe,
+                                                  uint64_t id,
+                                                  uint64_t *bandwidth_p)
+{
+    struct upipe_hls_master *upipe_hls_master =
+        upipe_hls_master_from_upipe(upipe);
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_master->items, uchain) {
+        struct uref *uref = uref_from_uchain(uchain);
+        uint64_t item_id;
+        if (ubase_check(uref_flow_get_id(uref, &item_id)) && item_id == id) {
+            *bandwidth_p = 0;
+            uref_m3u_master_get_bandwidth(uref, bandwidth_p);
+            return uref;
+        }
+    }
+    return NULL;
+}
+
+/** @internal @This selects the variant to play according to the throughput
+ * estimate and the buffer occupancy.
+ *
+ * @param upipe description structure of the pipe
+ * @param current id of the playing variant or UINT64_MAX
+ * @param variant_p filled with the selected variant
+ * @return an error code
+ */
+static int _upipe_hls_master_select(struct upipe *upipe,
+                                    uint64_t current,
+                                    struct uref **variant_p)
+{
+    struct upipe_hls_master *upipe_hls_master =
+        upipe_hls_master_from_upipe(upipe);
+    struct upipe_hls_master_abr_stats *stats = &upipe_hls_master->abr_stats;
+
+    stats->buffer = UINT64_MAX;
+    if (upipe_hls_master->buffer != NULL &&
+        !ubase_check(upipe_hls_buffer_get_duration(upipe_hls_master->buffer,
+                                                   &stats->buffer)))
+        stats->buffer = UINT64_MAX;
+
+    uint64_t budget = stats->estimate / 100 * ABR_SAFETY;
+    uint64_t current_bw = 0;
+    struct uref *selected = upipe_hls_master_find_variant(upipe, current,
+                                                          &current_bw);
+    struct uref *lowest = NULL, *target = NULL;
+    uint64_t lowest_bw = UINT64_MAX, target_bw = 0;
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_master->items, uchain) {
+        struct uref *uref = uref_from_uchain(uchain);
+        uint64_t bandwidth = 0;
+        uref_m3u_master_get_bandwidth(uref, &bandwidth);
+        if (!bandwidth)
+            continue;
+
+        if (bandwidth < lowest_bw) {
+            lowest = uref;
+            lowest_bw = bandwidth;
+        }
+        if (bandwidth <= budget && bandwidth > target_bw) {
+            target = uref;
+            target_bw = bandwidth;
+        }
+    }
+    if (target == NULL) {
+        target = lowest;
+        target_bw = lowest_bw;
+    }
+
+    if (selected == NULL)
+        selected = target;
+    else if (target != NULL && stats->samples) {
+        /* hold the current variant while the buffer allows it */
+        if (stats->buffer == UINT64_MAX ||
+            (target_bw > current_bw && stats->buffer >= ABR_BUFFER_LOW) ||
+            (target_bw < current_bw && stats->buffer < ABR_BUFFER_HIGH))
+            selected = target;
+    }
+
+    uint64_t id = UINT64_MAX;
+    if (selected != NULL)
+        uref_flow_get_id(selected, &id);
+    uint64_t policy_id = id;
+    upipe_throw(upipe, UPROBE_HLS_MASTER_ABR_SELECT,
+                UPIPE_HLS_MASTER_SIGNATURE, stats, current, &policy_id);
+    if (policy_id != id) {
+        uint64_t bandwidth;
+        struct uref *uref =
+            upipe_hls_master_find_variant(upipe, policy_id, &bandwidth);
+        if (uref != NULL)
+            selected = uref;
+        else
+            upipe_warn_va(upipe, "no variant %"PRIu64, policy_id);
+    }
+
+    if (unlikely(selected == NULL))
+        return UBASE_ERR_INVALID;
+    *variant_p = selected;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This is called at the end of an item of a variant to switch
+ * to a better variant if needed.
+ *
+ * @param upipe description structure of the sub pipe
+ * @return an error code
+ */
+static int upipe_hls_master_sub_item_end(struct upipe *upipe)
+{
+    struct upipe_hls_master_sub *upipe_hls_master_sub =
+        upipe_hls_master_sub_from_upipe(upipe);
+    struct upipe_hls_master *upipe_hls_master =
+        upipe_hls_master_from_sub_mgr(upipe->mgr);
+    struct upipe *super = upipe_hls_master_to_upipe(upipe_hls_master);
+
+    if (!upipe_hls_master->abr || upipe_hls_master_sub->switching)
+        return UBASE_ERR_NONE;
+
+    struct uref *variant;
+    UBASE_RETURN(_upipe_hls_master_select(super, upipe_hls_master_sub->id,
+                                          &variant));
+    uint64_t id;
+    UBASE_RETURN(uref_flow_get_id(variant, &id));
+    if (id == upipe_hls_master_sub->id)
+        return UBASE_ERR_NONE;
+
+    upipe_notice_va(upipe, "switch to variant %"PRIu64" "
+                    "(estimate %"PRIu64" bps)",
+                    id, upipe_hls_master->abr_stats.estimate);
+    upipe_hls_master_sub->switching = true;
+    upipe_hls_master->abr_stats.switches++;
+    upipe_throw(upipe, UPROBE_HLS_MASTER_SWITCH,
+                UPIPE_HLS_MASTER_SIGNATURE, variant);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This catches the events of the inner variant pipe.
+ *
+ * @param uprobe structure used to raise events
+ * @param inner pointer to inner pipe
+ * @param event event thrown
+ * @param args optional arguments
+ * @return an error code
+ */
+static int probe_variant(struct uprobe *uprobe, struct upipe *inner,
+                         int event, va_list args)
+{
+    struct upipe_hls_master_sub *upipe_hls_master_sub =
+        upipe_hls_master_sub_from_last_inner_probe(uprobe);
+    struct upipe *upipe = upipe_hls_master_sub_to_upipe(upipe_hls_master_sub);
+
+    if (event >= UPROBE_LOCAL &&
+        ubase_get_signature(args) == UPIPE_HLS_PLAYLIST_SIGNATURE) {
+        switch (event) {
+        case UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_PLAYLIST_SIGNATURE);
+            uint64_t bytes = va_arg(args, uint64_t);
+            uint64_t duration = va_arg(args, uint64_t);
+            struct upipe_hls_master *upipe_hls_master =
+                upipe_hls_master_from_sub_mgr(upipe->mgr);
+            return _upipe_hls_master_add_sample(
+                upipe_hls_master_to_upipe(upipe_hls_master),
+                bytes, duration);
+        }
+        case UPROBE_HLS_PLAYLIST_ITEM_END:
+            return upipe_hls_master_sub_item_end(upipe);
+        }
+    }
+    return upipe_throw_proxy(upipe, inner, event, args);
+}
+
 /** @internal @This allocates a sub master pipe.
  *
  * @param mgr management structure for this pipe type
@@ -139,6 +389,8 @@ static struct upipe *upipe_hls_master_sub_alloc(struct upipe_mgr *mgr,
     struct upipe_hls_master_sub *upipe_hls_master_sub =
         upipe_hls_master_sub_from_upipe(upipe);
     upipe_hls_master_sub->flow_def = flow_def;
+    upipe_hls_master_sub->id = id;
+    upipe_hls_master_sub->switching = false;
 
     upipe_throw_ready(upipe);
 
@@ -247,6 +499,12 @@ static struct upipe *upipe_hls_master_alloc(struct upipe_mgr *mgr,
     ulist_init(&upipe_hls_master->items);
     ulist_init(&upipe_hls_master->renditions);
     upipe_hls_master->id = 0;
+    upipe_hls_master->abr = false;
+    upipe_hls_master->buffer = NULL;
+    memset(upipe_hls_master->samples, 0, sizeof (upipe_hls_master->samples));
+    memset(&upipe_hls_master->abr_stats, 0,
+           sizeof (upipe_hls_master->abr_stats));
+    upipe_hls_master->abr_stats.buffer = UINT64_MAX;
 
     upipe_throw_ready(upipe);
 
@@ -281,6 +539,7 @@ static void upipe_hls_master_free(struct upipe *upipe)
 
     upipe_throw_dead(upipe);
 
+    upipe_release(upipe_hls_master->buffer);
     uref_free(upipe_hls_master->flow_def);
     upipe_hls_master_flush(upipe);
     upipe_hls_master_clean_sub_pipes(upipe);
@@ -465,6 +724,45 @@ static int upipe_hls_master_control(struct upipe *upipe,
         struct uref **uref_p = va_arg(args, struct uref **);
         return upipe_hls_master_split_iterate(upipe, uref_p);
     }
+
+    case UPIPE_HLS_MASTER_SET_ABR: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+        struct upipe_hls_master *upipe_hls_master =
+            upipe_hls_master_from_upipe(upipe);
+        upipe_hls_master->abr = !!va_arg(args, int);
+        return UBASE_ERR_NONE;
+    }
+    case UPIPE_HLS_MASTER_SET_BUFFER: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+        struct upipe_hls_master *upipe_hls_master =
+            upipe_hls_master_from_upipe(upipe);
+        struct upipe *buffer = va_arg(args, struct upipe *);
+        upipe_release(upipe_hls_master->buffer);
+        upipe_hls_master->buffer = upipe_use(buffer);
+        return UBASE_ERR_NONE;
+    }
+    case UPIPE_HLS_MASTER_ADD_SAMPLE: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+        uint64_t bytes = va_arg(args, uint64_t);
+        uint64_t duration = va_arg(args, uint64_t);
+        return _upipe_hls_master_add_sample(upipe, bytes, duration);
+    }
+    case UPIPE_HLS_MASTER_SELECT: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+        uint64_t current = va_arg(args, uint64_t);
+        struct uref **variant_p = va_arg(args, struct uref **);
+        return _upipe_hls_master_select(upipe, current, variant_p);
+    }
+    case UPIPE_HLS_MASTER_GET_ABR_STATS: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+        struct upipe_hls_master *upipe_hls_master =
+            upipe_hls_master_from_upipe(upipe);
+        struct upipe_hls_master_abr_stats *stats =
+            va_arg(args, struct upipe_hls_master_abr_stats *);
+        if (stats)
+            *stats = upipe_hls_master->abr_stats;
+        return UBASE_ERR_NONE;
+    }
     }
     return UBASE_ERR_UNHANDLED;
 }
@@ -473,6 +771,8 @@ static int upipe_hls_master_control(struct upipe *upipe,
 static struct upipe_mgr upipe_hls_master_mgr = {
     .refcount = NULL,
     .signature = UPIPE_HLS_MASTER_SIGNATURE,
+    .upipe_command_str = upipe_hls_master_command_str,
+    .upipe_event_str = uprobe_hls_master_event_str,
     .upipe_alloc = upipe_hls_master_alloc,
     .upipe_input = upipe_hls_master_input,
     .upipe_control = upipe_hls_master_control,
@@ -40,6 +40,7 @@
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_upump_mgr.h>
 #include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
 #include <upipe/upipe.h>
 
 #include <upipe/uprobe_prefix.h>
@@ -56,6 +57,7 @@
 #include <upipe/uref_uri.h>
 
 #include <upipe/uclock.h>
+#include <upipe/upump_blocker.h>
 
 #include <stdlib.h>
 #include <limits.h>
@@ -85,6 +87,30 @@ static int upipe_hls_playlist_throw_item_end(struct upipe *upipe)
                        UPIPE_HLS_PLAYLIST_SIGNATURE);
 }
 
+/** @internal @This is the download of a playlist item. */
+struct upipe_hls_playlist_fetch {
+    /** attach to the prefetch list */
+    struct uchain uchain;
+    /** media sequence of the item */
+    uint64_t index;
+    /** source pipe */
+    struct upipe *src;
+    /** probe uref pipe following the source */
+    struct upipe *probe;
+    /** buffered urefs, while prefetching */
+    struct uchain urefs;
+    /** number of buffered bytes */
+    uint64_t size;
+    /** number of downloaded bytes */
+    uint64_t bytes;
+    /** date of the download start */
+    uint64_t start;
+    /** the download is finished */
+    bool ended;
+};
+
+UBASE_FROM_TO(upipe_hls_playlist_fetch, uchain, uchain, uchain)
+
 /** @internal @This is the private context of a m3u playlist pipe. */
 struct upipe_hls_playlist {
     /** for urefcount helper */
@@ -121,6 +147,8 @@ struct upipe_hls_playlist {
     struct uprobe probe_key_src;
     /** key probe */
     struct uprobe probe_key;
+    /** probe for the download probe uref pipes */
+    struct uprobe probe_fetch;
 
     /** upump manager */
     struct upump_mgr *upump_mgr;
@@ -144,6 +172,25 @@ struct upipe_hls_playlist {
     bool attach_uclock;
     /** is currently playing */
     bool playing;
+
+    /** download of the current item */
+    struct upipe_hls_playlist_fetch *fetch;
+    /** list of prefetched downloads */
+    struct uchain prefetch;
+    /** number of items to prefetch */
+    unsigned int prefetch_count;
+    /** maximum number of prefetched bytes */
+    uint64_t prefetch_max_size;
+    /** source pumps blocked while the prefetch budget is exceeded */
+    struct uchain blockers;
+    /** prefetched urefs are being output */
+    bool flushing;
+    /** clock used to measure the download time */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+    /** download statistics */
+    struct upipe_hls_playlist_stats stats;
 };
 
 static int probe_key_src(struct uprobe *uprobe, struct upipe *inner,
@@ -152,6 +199,8 @@ static int probe_key(struct uprobe *uprobe, struct upipe *inner,
                      int event, va_list args);
 static int probe_src(struct uprobe *uprobe, struct upipe *inner,
                      int event, va_list args);
+static int probe_fetch(struct uprobe *uprobe, struct upipe *inner,
+                       int event, va_list args);
 
 UPIPE_HELPER_UPIPE(upipe_hls_playlist, upipe, UPIPE_HLS_PLAYLIST_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_hls_playlist, urefcount, upipe_hls_playlist_no_ref);
@@ -165,10 +214,143 @@ UPIPE_HELPER_UPROBE(upipe_hls_playlist, urefcount_real,
                     probe_key_src, probe_key_src);
 UPIPE_HELPER_UPROBE(upipe_hls_playlist, urefcount_real, probe_key, probe_key);
 UPIPE_HELPER_UPROBE(upipe_hls_playlist, urefcount_real, probe_src, probe_src);
+UPIPE_HELPER_UPROBE(upipe_hls_playlist, urefcount_real,
+                    probe_fetch, probe_fetch);
 UPIPE_HELPER_UPROBE(upipe_hls_playlist, urefcount_real, probe_setflowdef, NULL);
 UPIPE_HELPER_BIN_OUTPUT(upipe_hls_playlist, setflowdef, output, requests);
 UPIPE_HELPER_UPUMP_MGR(upipe_hls_playlist, upump_mgr);
 UPIPE_HELPER_UPUMP(upipe_hls_playlist, upump, upump_mgr);
+UPIPE_HELPER_UCLOCK(upipe_hls_playlist, uclock, uclock_request, NULL,
+                    upipe_throw_provide_request, NULL);
+
+/** @internal @This finds the download an inner pipe belongs to.
+ *
+ * @param upipe description structure of the pipe
+ * @param inner source or probe uref pipe of the download
+ * @return a pointer to the download, or NULL
+ */
+static struct upipe_hls_playlist_fetch *
+    upipe_hls_playlist_find_fetch(struct upipe *upipe, struct upipe *inner)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    struct upipe_hls_playlist_fetch *fetch = upipe_hls_playlist->fetch;
+
+    if (fetch != NULL && (fetch->src == inner || fetch->probe == inner))
+        return fetch;
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_playlist->prefetch, uchain) {
+        fetch = upipe_hls_playlist_fetch_from_uchain(uchain);
+        if (fetch->src == inner || fetch->probe == inner)
+            return fetch;
+    }
+    return NULL;
+}
+
+/** @internal @This returns the number of bytes buffered by the prefetched
+ * downloads.
+ *
+ * @param upipe description structure of the pipe
+ * @return the number of buffered bytes
+ */
+static uint64_t upipe_hls_playlist_prefetch_size(struct upipe *upipe)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    uint64_t size = 0;
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_playlist->prefetch, uchain)
+        size += upipe_hls_playlist_fetch_from_uchain(uchain)->size;
+    return size;
+}
+
+/** @internal @This is called when a blocked source pump is released by its
+ * owner.
+ *
+ * @param blocker description structure of the blocker
+ */
+static void upipe_hls_playlist_blocker_cb(struct upump_blocker *blocker)
+{
+    ulist_delete(upump_blocker_to_uchain(blocker));
+    upump_blocker_free(blocker);
+}
+
+/** @internal @This stops reading a prefetched download while the prefetch
+ * budget is exceeded.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to the source pump of the download
+ */
+static void upipe_hls_playlist_block_fetch(struct upipe *upipe,
+                                           struct upump **upump_p)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+
+    if (upump_p == NULL || *upump_p == NULL ||
+        upipe_hls_playlist_prefetch_size(upipe) <
+            upipe_hls_playlist->prefetch_max_size ||
+        upump_blocker_find(&upipe_hls_playlist->blockers, *upump_p) != NULL)
+        return;
+
+    upipe_verbose(upipe, "prefetch budget reached, pausing download");
+    struct upump_blocker *blocker =
+        upump_blocker_alloc(*upump_p, upipe_hls_playlist_blocker_cb, upipe,
+                            &upipe_hls_playlist->urefcount_real);
+    if (unlikely(blocker == NULL))
+        return;
+    ulist_add(&upipe_hls_playlist->blockers, upump_blocker_to_uchain(blocker));
+    upipe_hls_playlist->stats.paused++;
+}
+
+/** @internal @This resumes all the paused downloads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_playlist_unblock_fetch(struct upipe *upipe)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach(&upipe_hls_playlist->blockers, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        upump_blocker_free(upump_blocker_from_uchain(uchain));
+    }
+}
+
+/** @internal @This marks a download as finished and updates the statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @param fetch finished download
+ */
+static void upipe_hls_playlist_fetch_end(struct upipe *upipe,
+                                         struct upipe_hls_playlist_fetch *fetch)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    struct upipe_hls_playlist_stats *stats = &upipe_hls_playlist->stats;
+
+    fetch->ended = true;
+    uint64_t duration = 0;
+    if (likely(upipe_hls_playlist->uclock != NULL))
+        duration = uclock_now(upipe_hls_playlist->uclock) - fetch->start;
+
+    stats->items++;
+    stats->bytes += fetch->bytes;
+    stats->duration += duration;
+    if (duration)
+        stats->throughput = fetch->bytes * 8 * UCLOCK_FREQ / duration;
+    upipe_verbose_va(upipe, "item sequence %"PRIu64" downloaded, "
+                     "%"PRIu64" bytes in %"PRIu64" ms",
+                     fetch->index, fetch->bytes,
+                     duration / (UCLOCK_FREQ / 1000));
+    if (duration)
+        upipe_throw(upipe, UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED,
+                    UPIPE_HLS_PLAYLIST_SIGNATURE, fetch->bytes, duration);
+}
 
 /** @internal @This catches the inner key source pipe event.
  *
@@ -257,11 +439,73 @@ static int probe_src(struct uprobe *uprobe, struct upipe *inner,
     struct upipe *upipe = upipe_hls_playlist_to_upipe(upipe_hls_playlist);
 
     switch (event) {
-    case UPROBE_SOURCE_END:
+    case UPROBE_SOURCE_END: {
+        struct upipe_hls_playlist_fetch *fetch =
+            upipe_hls_playlist_find_fetch(upipe, inner);
+        if (unlikely(fetch == NULL) || fetch->ended)
+            return UBASE_ERR_NONE;
+
+        upipe_hls_playlist_fetch_end(upipe, fetch);
+        if (fetch != upipe_hls_playlist->fetch)
+            return UBASE_ERR_NONE;
+
         upipe_notice(upipe, "stopped");
         upipe_hls_playlist->playing = false;
         return upipe_hls_playlist_throw_item_end(upipe);
     }
+    }
+    return upipe_throw_proxy(upipe, inner, event, args);
+}
+
+/** @internal @This catches the inner download probe uref pipe events.
+ *
+ * @param uprobe structure used to raise events
+ * @param inner the inner pipe
+ * @param event event thrown
+ * @param args optional arguments
+ * @return an error code
+ */
+static int probe_fetch(struct uprobe *uprobe, struct upipe *inner,
+                       int event, va_list args)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_probe_fetch(uprobe);
+    struct upipe *upipe = upipe_hls_playlist_to_upipe(upipe_hls_playlist);
+
+    switch (event) {
+    case UPROBE_PROBE_UREF: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_PROBE_UREF_SIGNATURE);
+        struct uref *uref = va_arg(args, struct uref *);
+        struct upump **upump_p = va_arg(args, struct upump **);
+        bool *drop = va_arg(args, bool *);
+
+        struct upipe_hls_playlist_fetch *fetch =
+            upipe_hls_playlist_find_fetch(upipe, inner);
+        if (unlikely(fetch == NULL)) {
+            *drop = true;
+            return UBASE_ERR_NONE;
+        }
+        if (upipe_hls_playlist->flushing)
+            return UBASE_ERR_NONE;
+
+        size_t size = 0;
+        uref_block_size(uref, &size);
+        fetch->bytes += size;
+        if (fetch == upipe_hls_playlist->fetch)
+            return UBASE_ERR_NONE;
+
+        /* keep the data until the item is played */
+        *drop = true;
+        struct uref *dup = uref_dup(uref);
+        UBASE_ALLOC_RETURN(dup);
+        ulist_add(&fetch->urefs, uref_to_uchain(dup));
+        fetch->size += size;
+        upipe_hls_playlist_block_fetch(upipe, upump_p);
+        return UBASE_ERR_NONE;
+    }
+    case UPROBE_NEW_FLOW_DEF:
+        return UBASE_ERR_NONE;
+    }
     return upipe_throw_proxy(upipe, inner, event, args);
 }
 
@@ -288,12 +532,14 @@ static struct upipe *upipe_hls_playlist_alloc(struct upipe_mgr *mgr,
     upipe_hls_playlist_init_probe_src(upipe);
     upipe_hls_playlist_init_probe_key_src(upipe);
     upipe_hls_playlist_init_probe_key(upipe);
+    upipe_hls_playlist_init_probe_fetch(upipe);
     upipe_hls_playlist_init_probe_setflowdef(upipe);
     upipe_hls_playlist_init_src(upipe);
     upipe_hls_playlist_init_upipe_key(upipe);
     upipe_hls_playlist_init_bin_output(upipe);
     upipe_hls_playlist_init_upump_mgr(upipe);
     upipe_hls_playlist_init_upump(upipe);
+    upipe_hls_playlist_init_uclock(upipe);
 
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
@@ -309,6 +555,14 @@ static struct upipe *upipe_hls_playlist_alloc(struct upipe_mgr *mgr,
     upipe_hls_playlist->key.method = NULL;
     upipe_hls_playlist->attach_uclock = false;
     upipe_hls_playlist->playing = false;
+    upipe_hls_playlist->fetch = NULL;
+    ulist_init(&upipe_hls_playlist->prefetch);
+    upipe_hls_playlist->prefetch_count = 0;
+    upipe_hls_playlist->prefetch_max_size = 0;
+    ulist_init(&upipe_hls_playlist->blockers);
+    upipe_hls_playlist->flushing = false;
+    memset(&upipe_hls_playlist->stats, 0,
+           sizeof (upipe_hls_playlist->stats));
 
     upipe_throw_ready(upipe);
 
@@ -365,6 +619,7 @@ static void upipe_hls_playlist_free(struct upipe *upipe)
     free(upipe_hls_playlist->key.method);
     uref_free(upipe_hls_playlist->flow_def);
     uref_free(upipe_hls_playlist->input_flow_def);
+    upipe_hls_playlist_clean_uclock(upipe);
     upipe_hls_playlist_clean_upump(upipe);
     upipe_hls_playlist_clean_upump_mgr(upipe);
     upipe_hls_playlist_clean_bin_output(upipe);
@@ -372,12 +627,49 @@ static void upipe_hls_playlist_free(struct upipe *upipe)
     upipe_hls_playlist_clean_probe_src(upipe);
     upipe_hls_playlist_clean_probe_key(upipe);
     upipe_hls_playlist_clean_probe_key_src(upipe);
+    upipe_hls_playlist_clean_probe_fetch(upipe);
     upipe_hls_playlist_clean_probe_setflowdef(upipe);
     upipe_hls_playlist_clean_urefcount(upipe);
     upipe_hls_playlist_clean_urefcount_real(upipe);
     upipe_hls_playlist_free_void(upipe);
 }
 
+/** @internal @This frees a download.
+ *
+ * @param fetch download to free
+ */
+static void upipe_hls_playlist_fetch_free(
+        struct upipe_hls_playlist_fetch *fetch)
+{
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&fetch->urefs)) != NULL)
+        uref_free(uref_from_uchain(uchain));
+    upipe_release(fetch->probe);
+    upipe_release(fetch->src);
+    free(fetch);
+}
+
+/** @internal @This frees the current and the prefetched downloads.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_playlist_clean_fetch(struct upipe *upipe)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    struct upipe_hls_playlist_fetch *fetch = upipe_hls_playlist->fetch;
+
+    upipe_hls_playlist_unblock_fetch(upipe);
+    upipe_hls_playlist->fetch = NULL;
+    if (fetch != NULL)
+        upipe_hls_playlist_fetch_free(fetch);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_hls_playlist->prefetch)) != NULL)
+        upipe_hls_playlist_fetch_free(
+            upipe_hls_playlist_fetch_from_uchain(uchain));
+}
+
 /** @internal @This is called when there is no external reference to the pipe.
  *
  * @param upipe description structure of the pipe
@@ -390,40 +682,28 @@ static void upipe_hls_playlist_no_ref(struct upipe *upipe)
     upipe_hls_playlist_clean_upipe_key(upipe);
     upipe_hls_playlist_clean_setflowdef(upipe);
     upipe_hls_playlist_clean_src(upipe);
+    upipe_hls_playlist_clean_fetch(upipe);
     upipe_mgr_release(upipe_hls_playlist->source_mgr);
     upipe_hls_playlist_release_urefcount_real(upipe);
 }
 
-/** @internal @This sets the inner source pipe of the playlist.
+/** @internal @This applies the playlist settings to an inner source pipe.
  *
  * @param upipe description structure of the pipe
- * @param src the inner source pipe to set
+ * @param src the inner source pipe to set up
  * @return an error code
  */
-static int upipe_hls_playlist_set_src(struct upipe *upipe,
-                                      struct upipe *src)
+static int upipe_hls_playlist_setup_src(struct upipe *upipe,
+                                        struct upipe *src)
 {
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
-    int ret;
 
-    if (src) {
-        if (upipe_hls_playlist->attach_uclock) {
-            ret = upipe_attach_uclock(src);
-            if (unlikely(!ubase_check(ret))) {
-                upipe_release(src);
-                return ret;
-            }
-        }
-        if (upipe_hls_playlist->output_size) {
-            ret = upipe_set_output_size(src, upipe_hls_playlist->output_size);
-            if (unlikely(!ubase_check(ret))) {
-                upipe_release(src);
-                return ret;
-            }
-        }
-    }
-    upipe_hls_playlist_store_src(upipe, src);
+    if (upipe_hls_playlist->attach_uclock)
+        UBASE_RETURN(upipe_attach_uclock(src));
+    if (upipe_hls_playlist->output_size)
+        UBASE_RETURN(upipe_set_output_size(src,
+                                           upipe_hls_playlist->output_size));
     return UBASE_ERR_NONE;
 }
 
@@ -565,89 +845,88 @@ static int upipe_hls_playlist_update_flow_def(struct upipe *upipe)
                                      upipe_hls_playlist->flow_def);
 }
 
-/** @internal @This plays an URI.
+/** @internal @This finds an item by its sequence number.
  *
  * @param upipe description structure of the pipe
- * @param item item to play
- * @param uuri the URI of the item to play
- * @return an error code
+ * @param index the sequence number
+ * @return a pointer to the item, or NULL
  */
-static int upipe_hls_playlist_play_uri(struct upipe *upipe,
-                                       struct uref *item,
-                                       struct uuri *uuri)
+static struct uref *upipe_hls_playlist_find_item(struct upipe *upipe,
+                                                 uint64_t index)
 {
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
     struct uref *input_flow_def = upipe_hls_playlist->input_flow_def;
 
-    size_t len;
-    UBASE_RETURN(uuri_len(uuri, &len));
-    char uri[len + 1];
-    UBASE_RETURN(uuri_to_buffer(uuri, uri, sizeof (uri)));
-
-    upipe_notice_va(upipe, "play next item sequence %"PRIu64" %s",
-                    upipe_hls_playlist->index, uri);
-
-    struct uref *flow_def = upipe_hls_playlist->flow_def;
-    if (ubase_check(uref_flow_match_def(flow_def, "block.aes."))) {
-        const uint8_t *iv;
-        size_t iv_size;
-        if (ubase_check(uref_aes_get_iv(input_flow_def, &iv, &iv_size))) {
-            UBASE_RETURN(uref_aes_set_iv(flow_def, iv, iv_size));
-        }
-        else {
-            uint8_t iv_buf[16];
+    uint64_t media_sequence = 0;
+    uref_m3u_playlist_flow_get_media_sequence(input_flow_def, &media_sequence);
+    if (index < media_sequence)
+        return NULL;
+    index -= media_sequence;
 
-            memset(&iv_buf, 0, sizeof(iv_buf));
-            for (unsigned i = 0; i < 8; i++)
-                iv_buf[15 - i] = upipe_hls_playlist->index >> (i * 8);
-            UBASE_RETURN(uref_aes_set_iv(flow_def, iv_buf, sizeof(iv_buf)));
-        }
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_playlist->items, uchain) {
+        if (index-- == 0)
+            return uref_from_uchain(uchain);
     }
-    UBASE_RETURN(upipe_hls_playlist_update_flow_def(upipe));
-
-    UBASE_RETURN(upipe_hls_playlist_check_source_mgr(upipe));
-    struct upipe *inner = upipe_void_alloc(
-        upipe_hls_playlist->source_mgr,
-        uprobe_pfx_alloc(
-            uprobe_use(&upipe_hls_playlist->probe_src),
-            UPROBE_LOG_VERBOSE, "src"));
-    UBASE_ALLOC_RETURN(inner);
-    UBASE_RETURN(upipe_hls_playlist_set_src(upipe, inner));
-    UBASE_RETURN(upipe_set_output(inner, upipe_hls_playlist->setflowdef));
+    return NULL;
+}
 
-    UBASE_RETURN(upipe_set_uri(inner, uri));
+/** @internal @This gets a media sequence by its sequence number.
+ *
+ * @param upipe description structure of the pipe
+ * @param index the sequence number
+ * @param item_p pointer filled with the media sequence
+ * @return an error code
+ */
+static int upipe_hls_playlist_get_item_at(struct upipe *upipe,
+                                          uint64_t index,
+                                          struct uref **item_p)
+{
+    struct uref *item = upipe_hls_playlist_find_item(upipe, index);
+    if (item == NULL) {
+        upipe_notice(upipe, "nothing to play");
+        return UBASE_ERR_INVALID;
+    }
+    *item_p = item;
+    return UBASE_ERR_NONE;
+}
 
-    uint64_t range_off = 0;
-    uref_m3u_playlist_get_byte_range_off(item, &range_off);
-    uint64_t range_len = (uint64_t)-1;
-    uref_m3u_playlist_get_byte_range_len(item, &range_len);
-    UBASE_RETURN(upipe_src_set_range(inner, range_off, range_len));
-    upipe_notice(upipe, "playing");
-    upipe_hls_playlist->playing = true;
+/** @internal @This allocates a string from an URI.
+ *
+ * @param uuri the URI to print
+ * @param uri_p filled with an allocated string
+ * @return an error code
+ */
+static int upipe_hls_playlist_uuri_dup(struct uuri *uuri, char **uri_p)
+{
+    size_t len;
+    UBASE_RETURN(uuri_len(uuri, &len));
+    char *uri = malloc(len + 1);
+    UBASE_ALLOC_RETURN(uri);
+    int ret = uuri_to_buffer(uuri, uri, len + 1);
+    if (unlikely(!ubase_check(ret))) {
+        free(uri);
+        return ret;
+    }
+    *uri_p = uri;
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This plays an item.
+/** @internal @This resolves the URI of an item.
  *
  * @param upipe description structure of the pipe
- * @param item item to play
+ * @param item playlist item
+ * @param uri_p filled with an allocated string to free by the caller
  * @return an error code
  */
-static int upipe_hls_playlist_play_item(struct upipe *upipe,
-                                        struct uref *item)
+static int upipe_hls_playlist_item_uri(struct upipe *upipe,
+                                       struct uref *item,
+                                       char **uri_p)
 {
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
     struct uref *input_flow_def = upipe_hls_playlist->input_flow_def;
-    int ret;
-
-    if (unlikely(input_flow_def == NULL) || unlikely(item == NULL))
-        return UBASE_ERR_INVALID;
-
-    upipe_verbose_va(upipe, "play item sequence %"PRIu64,
-                     upipe_hls_playlist->index);
-    uref_dump(item, upipe->uprobe);
 
     const char *m3u_uri;
     UBASE_RETURN(uref_m3u_get_uri(item, &m3u_uri));
@@ -655,7 +934,7 @@ static int upipe_hls_playlist_play_item(struct upipe *upipe,
     struct uuri uuri;
     if (ubase_check(uuri_from_str(&uuri, m3u_uri)))
         /* this is a valid URI, we can directly play it */
-        return upipe_hls_playlist_play_uri(upipe, item, &uuri);
+        return upipe_hls_playlist_uuri_dup(&uuri, uri_p);
 
     UBASE_RETURN(uref_uri_get(input_flow_def, &uuri));
     uuri.query = ustring_null();
@@ -663,7 +942,7 @@ static int upipe_hls_playlist_play_item(struct upipe *upipe,
     if (strlen(m3u_uri) && *m3u_uri == '/') {
         /* use the item absolute path with the input scheme */
         uuri.path = ustring_from_str(m3u_uri);
-        return upipe_hls_playlist_play_uri(upipe, item, &uuri);
+        return upipe_hls_playlist_uuri_dup(&uuri, uri_p);
     }
 
     /* use the item relative path with the input path as root path */
@@ -671,46 +950,306 @@ static int upipe_hls_playlist_play_item(struct upipe *upipe,
     ustring_cpy(uuri.path, tmp, sizeof (tmp));
     const char *root = dirname(tmp);
     char new_path[strlen(root) + 1 + strlen(m3u_uri) + 1];
-    ret = snprintf(new_path, sizeof (new_path), "%s/%s", root, m3u_uri);
+    int ret = snprintf(new_path, sizeof (new_path), "%s/%s", root, m3u_uri);
     if (ret < 0 || (unsigned)ret >= sizeof (new_path))
         return UBASE_ERR_NOSPC;
     uuri.path = ustring_from_str(new_path);
-    return upipe_hls_playlist_play_uri(upipe, item, &uuri);
+    return upipe_hls_playlist_uuri_dup(&uuri, uri_p);
 }
 
-/** @internal @This gets a media sequence by its sequence number.
+/** @internal @This starts the download of an item.
  *
  * @param upipe description structure of the pipe
- * @param index the sequence number
- * @param item_p pointer filled with the media sequence
- * @param key_p pointer filled with the key if any
+ * @param index sequence number of the item
+ * @param item item to download
+ * @param uri the URI of the item
+ * @param fetch_p filled with the allocated download
  * @return an error code
  */
-static int upipe_hls_playlist_get_item_at(struct upipe *upipe,
-                                          uint64_t index,
-                                          struct uref **item_p)
+static int upipe_hls_playlist_fetch_alloc(
+        struct upipe *upipe, uint64_t index, struct uref *item,
+        const char *uri, struct upipe_hls_playlist_fetch **fetch_p)
 {
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
-    struct uref *input_flow_def = upipe_hls_playlist->input_flow_def;
 
-    uint64_t media_sequence = 0;
-    uref_m3u_playlist_flow_get_media_sequence(input_flow_def, &media_sequence);
-    if (index < media_sequence)
-        return UBASE_ERR_INVALID;
-    index -= media_sequence;
+    UBASE_RETURN(upipe_hls_playlist_check_source_mgr(upipe));
+    struct upipe_hls_playlist_fetch *fetch = malloc(sizeof (*fetch));
+    UBASE_ALLOC_RETURN(fetch);
+    uchain_init(&fetch->uchain);
+    fetch->index = index;
+    fetch->probe = NULL;
+    ulist_init(&fetch->urefs);
+    fetch->size = 0;
+    fetch->bytes = 0;
+    fetch->start = upipe_hls_playlist->uclock != NULL ?
+        uclock_now(upipe_hls_playlist->uclock) : 0;
+    fetch->ended = false;
+
+    fetch->src = upipe_void_alloc(
+        upipe_hls_playlist->source_mgr,
+        uprobe_pfx_alloc(
+            uprobe_use(&upipe_hls_playlist->probe_src),
+            UPROBE_LOG_VERBOSE, "src"));
+    if (unlikely(fetch->src == NULL)) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return UBASE_ERR_ALLOC;
+    }
+
+    int ret = upipe_hls_playlist_setup_src(upipe, fetch->src);
+    if (unlikely(!ubase_check(ret))) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return ret;
+    }
+
+    struct upipe_mgr *upipe_probe_uref_mgr = upipe_probe_uref_mgr_alloc();
+    if (unlikely(upipe_probe_uref_mgr == NULL)) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return UBASE_ERR_ALLOC;
+    }
+    fetch->probe = upipe_void_alloc_output(
+        fetch->src, upipe_probe_uref_mgr,
+        uprobe_pfx_alloc(
+            uprobe_use(&upipe_hls_playlist->probe_fetch),
+            UPROBE_LOG_VERBOSE, "fetch"));
+    upipe_mgr_release(upipe_probe_uref_mgr);
+    if (unlikely(fetch->probe == NULL)) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return UBASE_ERR_ALLOC;
+    }
+
+    ret = upipe_set_uri(fetch->src, uri);
+    if (unlikely(!ubase_check(ret))) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return ret;
+    }
+
+    uint64_t range_off = 0;
+    uref_m3u_playlist_get_byte_range_off(item, &range_off);
+    uint64_t range_len = (uint64_t)-1;
+    uref_m3u_playlist_get_byte_range_len(item, &range_len);
+    ret = upipe_src_set_range(fetch->src, range_off, range_len);
+    if (unlikely(!ubase_check(ret))) {
+        upipe_hls_playlist_fetch_free(fetch);
+        return ret;
+    }
+
+    *fetch_p = fetch;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This checks whether an item uses the current key.
+ *
+ * @param upipe description structure of the pipe
+ * @param item playlist item
+ * @return true if the item can be decrypted with the current key
+ */
+static bool upipe_hls_playlist_same_key(struct upipe *upipe,
+                                        struct uref *item)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+
+    const char *method;
+    if (!ubase_check(uref_m3u_playlist_key_get_method(item, &method)))
+        return true;
+
+    const char *key_uri;
+    return ubase_check(uref_m3u_playlist_key_get_uri(item, &key_uri)) &&
+           upipe_hls_playlist->key.uri != NULL &&
+           upipe_hls_playlist->key.method != NULL &&
+           !strcmp(method, upipe_hls_playlist->key.method) &&
+           !strcmp(key_uri, upipe_hls_playlist->key.uri);
+}
+
+/** @internal @This drops the prefetched downloads that are not needed
+ * anymore, and starts the download of the next items within the budget.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_playlist_prefetch(struct upipe *upipe)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    uint64_t index = upipe_hls_playlist->index;
+    uint64_t last = index + upipe_hls_playlist->prefetch_count;
+    uint64_t size = 0;
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach(&upipe_hls_playlist->prefetch, uchain, uchain_tmp) {
+        struct upipe_hls_playlist_fetch *fetch =
+            upipe_hls_playlist_fetch_from_uchain(uchain);
+        if (fetch->index <= index || fetch->index > last) {
+            ulist_delete(uchain);
+            upipe_hls_playlist_fetch_free(fetch);
+        }
+        else
+            size += fetch->size;
+    }
+    if (size < upipe_hls_playlist->prefetch_max_size)
+        upipe_hls_playlist_unblock_fetch(upipe);
+
+    if (upipe_hls_playlist->input_flow_def == NULL)
+        return;
+
+    for (uint64_t i = index + 1;
+         i <= last && size < upipe_hls_playlist->prefetch_max_size; i++) {
+        bool found = false;
+        ulist_foreach(&upipe_hls_playlist->prefetch, uchain) {
+            if (upipe_hls_playlist_fetch_from_uchain(uchain)->index == i) {
+                found = true;
+                break;
+            }
+        }
+        if (found)
+            continue;
+
+        struct uref *item = upipe_hls_playlist_find_item(upipe, i);
+        if (item == NULL || !upipe_hls_playlist_same_key(upipe, item))
+            break;
+
+        char *uri;
+        if (!ubase_check(upipe_hls_playlist_item_uri(upipe, item, &uri)))
+            break;
+        upipe_verbose_va(upipe, "prefetch item sequence %"PRIu64" %s",
+                         i, uri);
+        struct upipe_hls_playlist_fetch *fetch;
+        int ret = upipe_hls_playlist_fetch_alloc(upipe, i, item, uri, &fetch);
+        free(uri);
+        if (unlikely(!ubase_check(ret))) {
+            upipe_warn_va(upipe, "fail to prefetch item sequence %"PRIu64, i);
+            break;
+        }
+        ulist_add(&upipe_hls_playlist->prefetch,
+                  upipe_hls_playlist_fetch_to_uchain(fetch));
+    }
+}
+
+/** @internal @This makes a download the current one and outputs the data
+ * already received.
+ *
+ * @param upipe description structure of the pipe
+ * @param fetch download to play
+ * @return an error code
+ */
+static int upipe_hls_playlist_play_fetch(struct upipe *upipe,
+                                         struct upipe_hls_playlist_fetch *fetch)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+
+    struct upipe_hls_playlist_fetch *previous = upipe_hls_playlist->fetch;
+    upipe_hls_playlist->fetch = fetch;
+    if (previous != NULL)
+        upipe_hls_playlist_fetch_free(previous);
+    upipe_hls_playlist_store_src(upipe, upipe_use(fetch->src));
+
+    /* the new current download must not stay paused */
+    upipe_hls_playlist_unblock_fetch(upipe);
+    UBASE_RETURN(upipe_set_output(fetch->probe,
+                                  upipe_hls_playlist->setflowdef));
+    upipe_notice(upipe, "playing");
+    upipe_hls_playlist->playing = true;
 
     struct uchain *uchain;
-    ulist_foreach(&upipe_hls_playlist->items, uchain) {
-        struct uref *uref = uref_from_uchain(uchain);
+    upipe_hls_playlist->flushing = true;
+    while ((uchain = ulist_pop(&fetch->urefs)) != NULL)
+        upipe_input(fetch->probe, uref_from_uchain(uchain), NULL);
+    upipe_hls_playlist->flushing = false;
+    fetch->size = 0;
 
-        if (index-- == 0) {
-            *item_p = uref;
-            return UBASE_ERR_NONE;
+    if (upipe_hls_playlist->prefetch_count)
+        upipe_hls_playlist_prefetch(upipe);
+
+    if (fetch->ended && upipe_hls_playlist->fetch == fetch &&
+        upipe_hls_playlist->playing) {
+        upipe_notice(upipe, "stopped");
+        upipe_hls_playlist->playing = false;
+        return upipe_hls_playlist_throw_item_end(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This plays an URI.
+ *
+ * @param upipe description structure of the pipe
+ * @param item item to play
+ * @param uri the URI of the item to play
+ * @return an error code
+ */
+static int upipe_hls_playlist_play_uri(struct upipe *upipe,
+                                       struct uref *item,
+                                       const char *uri)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    struct uref *input_flow_def = upipe_hls_playlist->input_flow_def;
+
+    upipe_notice_va(upipe, "play next item sequence %"PRIu64" %s",
+                    upipe_hls_playlist->index, uri);
+
+    struct uref *flow_def = upipe_hls_playlist->flow_def;
+    if (ubase_check(uref_flow_match_def(flow_def, "block.aes."))) {
+        const uint8_t *iv;
+        size_t iv_size;
+        if (ubase_check(uref_aes_get_iv(input_flow_def, &iv, &iv_size))) {
+            UBASE_RETURN(uref_aes_set_iv(flow_def, iv, iv_size));
+        }
+        else {
+            uint8_t iv_buf[16];
+
+            memset(&iv_buf, 0, sizeof(iv_buf));
+            for (unsigned i = 0; i < 8; i++)
+                iv_buf[15 - i] = upipe_hls_playlist->index >> (i * 8);
+            UBASE_RETURN(uref_aes_set_iv(flow_def, iv_buf, sizeof(iv_buf)));
         }
     }
-    upipe_notice(upipe, "nothing to play");
-    return UBASE_ERR_INVALID;
+    UBASE_RETURN(upipe_hls_playlist_update_flow_def(upipe));
+
+    struct uchain *uchain;
+    ulist_foreach(&upipe_hls_playlist->prefetch, uchain) {
+        struct upipe_hls_playlist_fetch *fetch =
+            upipe_hls_playlist_fetch_from_uchain(uchain);
+        if (fetch->index == upipe_hls_playlist->index) {
+            upipe_dbg_va(upipe, "use prefetched item, %"PRIu64" bytes ready",
+                         fetch->size);
+            ulist_delete(uchain);
+            upipe_hls_playlist->stats.prefetched++;
+            return upipe_hls_playlist_play_fetch(upipe, fetch);
+        }
+    }
+
+    struct upipe_hls_playlist_fetch *fetch;
+    UBASE_RETURN(upipe_hls_playlist_fetch_alloc(
+            upipe, upipe_hls_playlist->index, item, uri, &fetch));
+    return upipe_hls_playlist_play_fetch(upipe, fetch);
+}
+
+/** @internal @This plays an item.
+ *
+ * @param upipe description structure of the pipe
+ * @param item item to play
+ * @return an error code
+ */
+static int upipe_hls_playlist_play_item(struct upipe *upipe,
+                                        struct uref *item)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    struct uref *input_flow_def = upipe_hls_playlist->input_flow_def;
+
+    if (unlikely(input_flow_def == NULL) || unlikely(item == NULL))
+        return UBASE_ERR_INVALID;
+
+    upipe_verbose_va(upipe, "play item sequence %"PRIu64,
+                     upipe_hls_playlist->index);
+    uref_dump(item, upipe->uprobe);
+
+    char *uri;
+    UBASE_RETURN(upipe_hls_playlist_item_uri(upipe, item, &uri));
+    int ret = upipe_hls_playlist_play_uri(upipe, item, uri);
+    free(uri);
+    return ret;
 }
 
 /** @internal @This plays the next item in the playlist.
@@ -864,6 +1403,9 @@ static void upipe_hls_playlist_input(struct upipe *upipe,
     if (ubase_check(uref_block_get_end(uref))) {
         upipe_dbg(upipe, "playlist end");
         upipe_hls_playlist->reloading = false;
+        if (upipe_hls_playlist->fetch != NULL &&
+            upipe_hls_playlist->prefetch_count)
+            upipe_hls_playlist_prefetch(upipe);
         upipe_hls_playlist_throw_reloaded(upipe);
     }
 }
@@ -1039,6 +1581,43 @@ static int _upipe_hls_playlist_seek(struct upipe *upipe,
     return UBASE_ERR_INVALID;
 }
 
+/** @internal @This sets the prefetch parameters.
+ *
+ * @param upipe description structure of the pipe
+ * @param count number of items to prefetch
+ * @param max_size maximum number of prefetched bytes
+ * @return an error code
+ */
+static int _upipe_hls_playlist_set_prefetch(struct upipe *upipe,
+                                            unsigned int count,
+                                            uint64_t max_size)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    upipe_hls_playlist->prefetch_count = count;
+    upipe_hls_playlist->prefetch_max_size = max_size;
+    if (upipe_hls_playlist->fetch != NULL)
+        upipe_hls_playlist_prefetch(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This gets the download statistics.
+ *
+ * @param upipe description structure of the pipe
+ * @param stats filled with the statistics
+ * @return an error code
+ */
+static int _upipe_hls_playlist_get_stats(struct upipe *upipe,
+                                         struct upipe_hls_playlist_stats *stats)
+{
+    struct upipe_hls_playlist *upipe_hls_playlist =
+        upipe_hls_playlist_from_upipe(upipe);
+    if (unlikely(stats == NULL))
+        return UBASE_ERR_INVALID;
+    *stats = upipe_hls_playlist->stats;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This sets the inner pipe output size.
  *
  * @param upipe description structure of the pipe
@@ -1066,6 +1645,7 @@ static int upipe_hls_playlist_attach_uclock(struct upipe *upipe)
     struct upipe_hls_playlist *upipe_hls_playlist =
         upipe_hls_playlist_from_upipe(upipe);
     upipe_hls_playlist->attach_uclock = true;
+    upipe_hls_playlist_require_uclock(upipe);
     if (upipe_hls_playlist->src != NULL)
         return upipe_attach_uclock(upipe_hls_playlist->src);
     return UBASE_ERR_NONE;
@@ -1138,6 +1718,19 @@ static int upipe_hls_playlist_control_internal(struct upipe *upipe,
         return _upipe_hls_playlist_seek(upipe, at, offset_p);
     }
 
+    case UPIPE_HLS_PLAYLIST_SET_PREFETCH: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_PLAYLIST_SIGNATURE);
+        unsigned int count = va_arg(args, unsigned int);
+        uint64_t max_size = va_arg(args, uint64_t);
+        return _upipe_hls_playlist_set_prefetch(upipe, count, max_size);
+    }
+    case UPIPE_HLS_PLAYLIST_GET_STATS: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_PLAYLIST_SIGNATURE);
+        struct upipe_hls_playlist_stats *stats =
+            va_arg(args, struct upipe_hls_playlist_stats *);
+        return _upipe_hls_playlist_get_stats(upipe, stats);
+    }
+
     default:
         return upipe_hls_playlist_control_bin_output(upipe, command, args);
     }
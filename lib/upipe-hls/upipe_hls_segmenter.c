@@ -0,0 +1,1552 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module writing HLS and low-latency HLS segments and playlists
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe-hls/upipe_hls_segmenter.h>
+
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_upipe.h>
+
+#include <upipe/uclock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define EXPECTED_FLOW_DEF       "block."
+#define MPEGTS_FLOW_DEF         "block.mpegts."
+/** number of segments at the end of the playlist listing their parts */
+#define PARTS_SEGMENTS          3
+/** part hold back, in part target durations */
+#define PART_HOLD_BACK          3
+/** maximum number of octets queued for the writer thread before the pipe
+ * thread waits for it to catch up */
+#define QUEUE_SIZE              (32 * 1024 * 1024)
+
+/** @internal @This is the private context of a hls segmenter pipe. */
+struct upipe_hls_segmenter {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** sub pipe manager */
+    struct upipe_mgr sub_mgr;
+    /** list of sub pipes */
+    struct uchain subs;
+
+    /** writer thread */
+    pthread_t writer;
+    /** protects the writer queue */
+    pthread_mutex_t mutex;
+    /** signals queued jobs to the writer thread */
+    pthread_cond_t cond;
+    /** signals that the writer thread has completed all the jobs */
+    pthread_cond_t idle;
+    /** signals that the writer thread has completed a job */
+    pthread_cond_t done;
+    /** list of jobs queued for the writer thread */
+    struct uchain jobs;
+    /** number of octets in the queued jobs */
+    size_t queued;
+    /** the writer thread is running a job */
+    bool busy;
+    /** the writer thread exits once the queue is empty */
+    bool stop;
+    /** number of failed jobs not reported yet */
+    unsigned int errors;
+
+    /** output directory */
+    char *dir;
+    /** master playlist file name */
+    char *master;
+    /** segment target duration */
+    uint64_t duration;
+    /** part target duration, or 0 */
+    uint64_t part_duration;
+    /** number of segments in the media playlists */
+    unsigned int window;
+    /** number of allocated sub pipes */
+    unsigned int nb_subs;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static int upipe_hls_segmenter_write_master(struct upipe *upipe);
+
+UPIPE_HELPER_UPIPE(upipe_hls_segmenter, upipe, UPIPE_HLS_SEGMENTER_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_hls_segmenter, urefcount,
+                       upipe_hls_segmenter_free);
+UPIPE_HELPER_VOID(upipe_hls_segmenter);
+
+/** @internal @This describes a completed segment. */
+struct upipe_hls_segmenter_segment {
+    /** link in the segment list */
+    struct uchain uchain;
+    /** media sequence number */
+    uint64_t sequence;
+    /** duration in 27MHz ticks */
+    uint64_t duration;
+    /** a discontinuity precedes the segment */
+    bool discontinuity;
+    /** uri of the segment */
+    char *uri;
+    /** uri of the initialization section, or NULL */
+    char *map;
+    /** playlist lines describing the parts, or NULL */
+    char *parts;
+};
+
+UBASE_FROM_TO(upipe_hls_segmenter_segment, uchain, uchain, uchain);
+
+/** @internal @This is the private context of a hls segmenter sub pipe. */
+struct upipe_hls_segmenter_sub {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** link in the super pipe list */
+    struct uchain uchain;
+
+    /** input flow definition */
+    struct uref *flow_def;
+    /** the input is a transport stream */
+    bool mpegts;
+    /** segment file name extension */
+    const char *ext;
+    /** rendition name */
+    char *name;
+    /** uri of the current initialization section, or NULL */
+    char *map;
+    /** a new initialization section must be written */
+    bool map_pending;
+
+    /** uref manager used for the playlists */
+    struct uref_mgr *uref_mgr;
+    /** block manager used for the playlists */
+    struct ubuf_mgr *ubuf_mgr;
+
+    /** file of the current segment */
+    struct upipe_hls_segmenter_file *file;
+    /** uri of the current segment */
+    char *uri;
+    /** sequence number of the current segment */
+    uint64_t sequence;
+    /** date of the current segment start */
+    uint64_t start;
+    /** date of the last buffer */
+    uint64_t last;
+    /** interval between the last buffers */
+    uint64_t interval;
+    /** size of the current segment */
+    uint64_t size;
+    /** the next segment follows a discontinuity */
+    bool discontinuity;
+
+    /** date of the current part start */
+    uint64_t part_start;
+    /** offset of the current part in the segment */
+    uint64_t part_offset;
+    /** the current part starts with a random access point */
+    bool part_independent;
+    /** playlist lines describing the parts of the current segment */
+    char *parts;
+
+    /** list of completed segments */
+    struct uchain segments;
+    /** number of completed segments in the list */
+    unsigned int nb_segments;
+    /** number of discontinuities removed from the list */
+    uint64_t discontinuity_sequence;
+    /** longest segment duration */
+    uint64_t max_duration;
+    /** peak segment bit rate */
+    uint64_t peak;
+    /** total number of bytes written */
+    uint64_t total_size;
+    /** total duration written */
+    uint64_t total_duration;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_hls_segmenter_sub, upipe,
+                   UPIPE_HLS_SEGMENTER_SUB_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_hls_segmenter_sub, urefcount,
+                       upipe_hls_segmenter_sub_free);
+UPIPE_HELPER_VOID(upipe_hls_segmenter_sub);
+UPIPE_HELPER_SUBPIPE(upipe_hls_segmenter, upipe_hls_segmenter_sub, sub,
+                     sub_mgr, subs, uchain);
+
+/** @internal @This is a file written by the writer thread. */
+struct upipe_hls_segmenter_file {
+    /** final path */
+    char *path;
+    /** temporary path renamed once the file is written, or NULL */
+    char *tmp;
+    /** file descriptor, or -1 */
+    int fd;
+    /** a write error occurred */
+    bool error;
+};
+
+/** @internal @This is an operation queued for the writer thread. */
+struct upipe_hls_segmenter_job {
+    /** link in the queue */
+    struct uchain uchain;
+    /** file to write to, or NULL */
+    struct upipe_hls_segmenter_file *file;
+    /** buffer to append to the file, or NULL */
+    struct uref *uref;
+    /** size of the buffer */
+    size_t size;
+    /** the file is closed once the buffer is written */
+    bool close;
+    /** path of a file to delete, or NULL */
+    char *unlink;
+};
+
+UBASE_FROM_TO(upipe_hls_segmenter_job, uchain, uchain, uchain);
+
+/** @internal @This frees a file description.
+ *
+ * @param file file description
+ */
+static void upipe_hls_segmenter_file_free(struct upipe_hls_segmenter_file *file)
+{
+    free(file->path);
+    free(file->tmp);
+    free(file);
+}
+
+/** @internal @This allocates a file description.
+ *
+ * @param dir output directory
+ * @param name file name in the output directory
+ * @param tmp true to write the file to a temporary path first
+ * @return pointer to the file description or NULL in case of allocation error
+ */
+static struct upipe_hls_segmenter_file *
+    upipe_hls_segmenter_file_alloc(const char *dir, const char *name, bool tmp)
+{
+    struct upipe_hls_segmenter_file *file = malloc(sizeof (*file));
+    if (unlikely(file == NULL))
+        return NULL;
+    file->path = NULL;
+    file->tmp = NULL;
+    file->fd = -1;
+    file->error = false;
+    if (unlikely(asprintf(&file->path, "%s/%s", dir, name) < 0)) {
+        file->path = NULL;
+        upipe_hls_segmenter_file_free(file);
+        return NULL;
+    }
+    if (tmp && unlikely(asprintf(&file->tmp, "%s.tmp", file->path) < 0)) {
+        file->tmp = NULL;
+        upipe_hls_segmenter_file_free(file);
+        return NULL;
+    }
+    return file;
+}
+
+/** @internal @This writes a buffer to a file descriptor, with a single
+ * system call unless the write is interrupted. The buffer is consumed.
+ *
+ * @param fd file descriptor
+ * @param uref buffer to write
+ * @return false in case of error
+ */
+static bool upipe_hls_segmenter_write_uref(int fd, struct uref *uref)
+{
+    for ( ; ; ) {
+        int iovec_count = uref_block_iovec_count(uref, 0, -1);
+        if (unlikely(iovec_count == -1))
+            return false;
+        if (unlikely(iovec_count == 0))
+            return true;
+
+        struct iovec iovecs[iovec_count];
+        if (unlikely(!ubase_check(uref_block_iovec_read(uref, 0, -1,
+                                                        iovecs))))
+            return false;
+
+        ssize_t ret = writev(fd, iovecs, iovec_count);
+        uref_block_iovec_unmap(uref, 0, -1, iovecs);
+        if (unlikely(ret < 0)) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        size_t size;
+        if (unlikely(!ubase_check(uref_block_size(uref, &size))))
+            return false;
+        if (size == ret)
+            return true;
+        /* partial write */
+        if (unlikely(!ubase_check(uref_block_resize(uref, ret, -1))))
+            return false;
+    }
+}
+
+/** @internal @This runs a job in the writer thread and frees it.
+ *
+ * @param job job to run
+ * @return false in case of error
+ */
+static bool upipe_hls_segmenter_job_run(struct upipe_hls_segmenter_job *job)
+{
+    struct upipe_hls_segmenter_file *file = job->file;
+    bool ok = true;
+
+    if (job->unlink != NULL) {
+        ok = unlink(job->unlink) == 0 || errno == ENOENT;
+        free(job->unlink);
+    }
+
+    if (file != NULL && file->fd < 0 && !file->error) {
+        file->fd = open(file->tmp != NULL ? file->tmp : file->path,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (unlikely(file->fd < 0)) {
+            file->error = true;
+            ok = false;
+        }
+    }
+
+    if (job->uref != NULL) {
+        if (!file->error &&
+            unlikely(!upipe_hls_segmenter_write_uref(file->fd, job->uref))) {
+            file->error = true;
+            ok = false;
+        }
+        uref_free(job->uref);
+    }
+
+    if (job->close) {
+        if (file->fd >= 0)
+            close(file->fd);
+        if (file->tmp != NULL) {
+            if (file->error)
+                unlink(file->tmp);
+            else if (unlikely(rename(file->tmp, file->path) < 0))
+                ok = false;
+        }
+        upipe_hls_segmenter_file_free(file);
+    }
+
+    free(job);
+    return ok;
+}
+
+/** @internal @This is the writer thread. It runs the queued jobs in order,
+ * so that file system operations never block the pipe thread.
+ *
+ * @param opaque description structure of the pipe
+ * @return NULL
+ */
+static void *upipe_hls_segmenter_writer(void *opaque)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter = opaque;
+
+    pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+    for ( ; ; ) {
+        struct uchain *uchain = ulist_pop(&upipe_hls_segmenter->jobs);
+        if (uchain == NULL) {
+            upipe_hls_segmenter->busy = false;
+            pthread_cond_broadcast(&upipe_hls_segmenter->idle);
+            if (upipe_hls_segmenter->stop)
+                break;
+            pthread_cond_wait(&upipe_hls_segmenter->cond,
+                              &upipe_hls_segmenter->mutex);
+            continue;
+        }
+
+        upipe_hls_segmenter->busy = true;
+        pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+        struct upipe_hls_segmenter_job *job =
+            upipe_hls_segmenter_job_from_uchain(uchain);
+        size_t size = job->size;
+        bool ok = upipe_hls_segmenter_job_run(job);
+        pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+        if (unlikely(!ok))
+            upipe_hls_segmenter->errors++;
+        upipe_hls_segmenter->queued -= size;
+        pthread_cond_broadcast(&upipe_hls_segmenter->done);
+    }
+    pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+    return NULL;
+}
+
+/** @internal @This queues a job for the writer thread, and reports the jobs
+ * that failed since the previous call. If the queued buffers exceed
+ * @ref QUEUE_SIZE octets, the pipe thread waits for the writer thread to
+ * catch up, so that a slow disk slows down the pipe instead of growing the
+ * queue without limit.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param file file to write to, or NULL
+ * @param uref buffer to append to the file, or NULL
+ * @param close true to close the file once the buffer is written
+ * @param unlink_path path of a file to delete, or NULL
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_queue(struct upipe *upipe,
+                                         struct upipe_hls_segmenter_file *file,
+                                         struct uref *uref, bool close,
+                                         char *unlink_path)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+    struct upipe_hls_segmenter_job *job = malloc(sizeof (*job));
+    if (unlikely(job == NULL)) {
+        if (uref != NULL)
+            uref_free(uref);
+        free(unlink_path);
+        return UBASE_ERR_ALLOC;
+    }
+    uchain_init(&job->uchain);
+    job->file = file;
+    job->uref = uref;
+    job->size = 0;
+    if (uref != NULL)
+        uref_block_size(uref, &job->size);
+    job->close = close;
+    job->unlink = unlink_path;
+
+    pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+    bool full = upipe_hls_segmenter->queued &&
+        upipe_hls_segmenter->queued + job->size > QUEUE_SIZE;
+    if (unlikely(full)) {
+        size_t queued = upipe_hls_segmenter->queued;
+        pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+        upipe_warn_va(upipe, "writer queue full (%zu octets), waiting",
+                      queued);
+        pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+        while (upipe_hls_segmenter->queued &&
+               upipe_hls_segmenter->queued + job->size > QUEUE_SIZE)
+            pthread_cond_wait(&upipe_hls_segmenter->done,
+                              &upipe_hls_segmenter->mutex);
+    }
+    upipe_hls_segmenter->queued += job->size;
+    ulist_add(&upipe_hls_segmenter->jobs,
+              upipe_hls_segmenter_job_to_uchain(job));
+    pthread_cond_signal(&upipe_hls_segmenter->cond);
+    unsigned int errors = upipe_hls_segmenter->errors;
+    upipe_hls_segmenter->errors = 0;
+    pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+
+    if (unlikely(errors))
+        upipe_warn_va(upipe, "%u file operations failed", errors);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This writes a complete file in the writer thread. The file
+ * is written to a temporary path and renamed in place once complete.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param name file name in the output directory
+ * @param uref buffer to write
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_write_file(struct upipe *upipe,
+                                              const char *name,
+                                              struct uref *uref)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+    struct upipe_hls_segmenter_file *file =
+        upipe_hls_segmenter_file_alloc(upipe_hls_segmenter->dir, name, true);
+    if (unlikely(file == NULL)) {
+        uref_free(uref);
+        return UBASE_ERR_ALLOC;
+    }
+    return upipe_hls_segmenter_sub_queue(upipe, file, uref, true, NULL);
+}
+
+/** @internal @This appends a formatted line to a string.
+ *
+ * @param string_p pointer to the string to append to, may point to NULL
+ * @param format format of the line
+ * @return an error code
+ */
+static int upipe_hls_segmenter_append(char **string_p,
+                                      const char *format, ...)
+{
+    va_list args;
+    char *line, *string;
+    va_start(args, format);
+    int ret = vasprintf(&line, format, args);
+    va_end(args);
+    if (unlikely(ret < 0))
+        return UBASE_ERR_ALLOC;
+    if (*string_p == NULL) {
+        *string_p = line;
+        return UBASE_ERR_NONE;
+    }
+    ret = asprintf(&string, "%s%s", *string_p, line);
+    free(line);
+    if (unlikely(ret < 0))
+        return UBASE_ERR_ALLOC;
+    free(*string_p);
+    *string_p = string;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This converts a duration to seconds.
+ *
+ * @param duration duration in 27MHz ticks
+ * @return the duration in seconds
+ */
+static inline double upipe_hls_segmenter_seconds(uint64_t duration)
+{
+    return (double)duration / UCLOCK_FREQ;
+}
+
+/** @internal @This frees a completed segment description.
+ *
+ * @param segment segment description
+ */
+static void upipe_hls_segmenter_segment_free(
+        struct upipe_hls_segmenter_segment *segment)
+{
+    free(segment->uri);
+    free(segment->map);
+    free(segment->parts);
+    free(segment);
+}
+
+/** @internal @This allocates a hls segmenter sub pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_hls_segmenter_sub_alloc(struct upipe_mgr *mgr,
+                                                   struct uprobe *uprobe,
+                                                   uint32_t signature,
+                                                   va_list args)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(mgr);
+    struct upipe *upipe =
+        upipe_hls_segmenter_sub_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    upipe_hls_segmenter_sub_init_urefcount(upipe);
+    upipe_hls_segmenter_sub_init_sub(upipe);
+    sub->flow_def = NULL;
+    sub->mpegts = false;
+    sub->ext = ".ts";
+    sub->name = NULL;
+    sub->map = NULL;
+    sub->map_pending = false;
+    sub->uref_mgr = NULL;
+    sub->ubuf_mgr = NULL;
+    sub->file = NULL;
+    sub->uri = NULL;
+    sub->sequence = 0;
+    sub->start = UINT64_MAX;
+    sub->last = UINT64_MAX;
+    sub->interval = 0;
+    sub->size = 0;
+    sub->discontinuity = false;
+    sub->part_start = UINT64_MAX;
+    sub->part_offset = 0;
+    sub->part_independent = false;
+    sub->parts = NULL;
+    ulist_init(&sub->segments);
+    sub->nb_segments = 0;
+    sub->discontinuity_sequence = 0;
+    sub->max_duration = 0;
+    sub->peak = 0;
+    sub->total_size = 0;
+    sub->total_duration = 0;
+
+    upipe_throw_ready(upipe);
+
+    if (unlikely(asprintf(&sub->name, "stream%u",
+                          upipe_hls_segmenter->nb_subs++) < 0)) {
+        upipe_release(upipe);
+        return NULL;
+    }
+    return upipe;
+}
+
+/** @internal @This writes the media playlist.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param end true to terminate the playlist
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_write_playlist(struct upipe *upipe,
+                                                  bool end)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+    uint64_t part_duration = upipe_hls_segmenter->part_duration;
+    unsigned int window = upipe_hls_segmenter->window;
+
+    if (unlikely(sub->uref_mgr == NULL))
+        return UBASE_ERR_INVALID;
+
+    /* skip the segments out of the window */
+    unsigned int skip = 0;
+    if (window && sub->nb_segments > window)
+        skip = sub->nb_segments - window;
+    uint64_t sequence = sub->sequence;
+    uint64_t discontinuity_sequence = sub->discontinuity_sequence;
+    struct uchain *first = sub->segments.next;
+    for (unsigned int i = 0; i < skip; i++, first = first->next)
+        if (upipe_hls_segmenter_segment_from_uchain(first)->discontinuity)
+            discontinuity_sequence++;
+    if (first != &sub->segments)
+        sequence = upipe_hls_segmenter_segment_from_uchain(first)->sequence;
+
+    uint64_t target = (upipe_hls_segmenter->duration + UCLOCK_FREQ - 1) /
+                      UCLOCK_FREQ;
+    uint64_t max = (sub->max_duration + UCLOCK_FREQ / 2) / UCLOCK_FREQ;
+    if (max > target)
+        target = max;
+
+    char *playlist = NULL;
+    int err = upipe_hls_segmenter_append(&playlist,
+            "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-TARGETDURATION:%"PRIu64"\n",
+            target);
+    if (ubase_check(err) && part_duration)
+        err = upipe_hls_segmenter_append(&playlist,
+                "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,"
+                "PART-HOLD-BACK=%.3f\n#EXT-X-PART-INF:PART-TARGET=%.3f\n",
+                upipe_hls_segmenter_seconds(part_duration * PART_HOLD_BACK),
+                upipe_hls_segmenter_seconds(part_duration));
+    if (ubase_check(err))
+        err = upipe_hls_segmenter_append(&playlist,
+                "#EXT-X-MEDIA-SEQUENCE:%"PRIu64"\n", sequence);
+    if (ubase_check(err) && discontinuity_sequence)
+        err = upipe_hls_segmenter_append(&playlist,
+                "#EXT-X-DISCONTINUITY-SEQUENCE:%"PRIu64"\n",
+                discontinuity_sequence);
+    if (ubase_check(err) && !window)
+        err = upipe_hls_segmenter_append(&playlist,
+                "#EXT-X-PLAYLIST-TYPE:EVENT\n");
+
+    const char *map = NULL;
+    struct uchain *uchain;
+    for (uchain = first; ubase_check(err) && uchain != &sub->segments;
+         uchain = uchain->next) {
+        struct upipe_hls_segmenter_segment *segment =
+            upipe_hls_segmenter_segment_from_uchain(uchain);
+        if (segment->discontinuity && uchain != first)
+            err = upipe_hls_segmenter_append(&playlist,
+                                             "#EXT-X-DISCONTINUITY\n");
+        if (ubase_check(err) && segment->map != NULL &&
+            (map == NULL || strcmp(map, segment->map)))
+            err = upipe_hls_segmenter_append(&playlist,
+                    "#EXT-X-MAP:URI=\"%s\"\n", segment->map);
+        map = segment->map;
+        if (ubase_check(err) && segment->parts != NULL)
+            err = upipe_hls_segmenter_append(&playlist, "%s",
+                                             segment->parts);
+        if (ubase_check(err))
+            err = upipe_hls_segmenter_append(&playlist,
+                    "#EXTINF:%.3f,\n%s\n",
+                    upipe_hls_segmenter_seconds(segment->duration),
+                    segment->uri);
+    }
+
+    if (ubase_check(err) && sub->file != NULL && part_duration) {
+        /* segment in progress */
+        if (sub->discontinuity && first != &sub->segments)
+            err = upipe_hls_segmenter_append(&playlist,
+                                             "#EXT-X-DISCONTINUITY\n");
+        if (ubase_check(err) && sub->map != NULL &&
+            (map == NULL || strcmp(map, sub->map)))
+            err = upipe_hls_segmenter_append(&playlist,
+                    "#EXT-X-MAP:URI=\"%s\"\n", sub->map);
+        if (ubase_check(err) && sub->parts != NULL)
+            err = upipe_hls_segmenter_append(&playlist, "%s", sub->parts);
+        if (ubase_check(err) && !end)
+            err = upipe_hls_segmenter_append(&playlist,
+                    "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s\","
+                    "BYTERANGE-START=%"PRIu64"\n", sub->uri,
+                    sub->part_offset);
+    }
+    if (ubase_check(err) && end)
+        err = upipe_hls_segmenter_append(&playlist, "#EXT-X-ENDLIST\n");
+    if (unlikely(!ubase_check(err))) {
+        free(playlist);
+        return err;
+    }
+
+    int size = strlen(playlist);
+    struct uref *uref = uref_block_alloc(sub->uref_mgr, sub->ubuf_mgr, size);
+    uint8_t *buffer;
+    if (unlikely(uref == NULL ||
+                 !ubase_check(uref_block_write(uref, 0, &size, &buffer)))) {
+        if (uref != NULL)
+            uref_free(uref);
+        free(playlist);
+        return UBASE_ERR_ALLOC;
+    }
+    memcpy(buffer, playlist, size);
+    uref_block_unmap(uref, 0);
+    free(playlist);
+
+    char *name;
+    if (unlikely(asprintf(&name, "%s.m3u8", sub->name) < 0)) {
+        uref_free(uref);
+        return UBASE_ERR_ALLOC;
+    }
+    err = upipe_hls_segmenter_sub_write_file(upipe, name, uref);
+    free(name);
+    return err;
+}
+
+/** @internal @This writes the initialization section given by the flow
+ * definition headers.
+ *
+ * @param upipe description structure of the sub pipe
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_write_map(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    const uint8_t *headers;
+    size_t headers_size;
+    sub->map_pending = false;
+    free(sub->map);
+    sub->map = NULL;
+    UBASE_RETURN(uref_flow_get_headers(sub->flow_def, &headers,
+                                       &headers_size))
+
+    int size = headers_size;
+    struct uref *uref = uref_block_alloc(sub->uref_mgr, sub->ubuf_mgr, size);
+    uint8_t *buffer;
+    if (unlikely(uref == NULL ||
+                 !ubase_check(uref_block_write(uref, 0, &size, &buffer)))) {
+        if (uref != NULL)
+            uref_free(uref);
+        return UBASE_ERR_ALLOC;
+    }
+    memcpy(buffer, headers, size);
+    uref_block_unmap(uref, 0);
+
+    if (unlikely(asprintf(&sub->map, "%s_init%"PRIu64".mp4",
+                          sub->name, sub->sequence) < 0)) {
+        sub->map = NULL;
+        uref_free(uref);
+        return UBASE_ERR_ALLOC;
+    }
+    return upipe_hls_segmenter_sub_write_file(upipe, sub->map, uref);
+}
+
+/** @internal @This opens a new segment.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param date date of the segment start
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_open(struct upipe *upipe, uint64_t date)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+
+    if (unlikely(upipe_hls_segmenter->dir == NULL)) {
+        upipe_warn(upipe, "no output directory set");
+        return UBASE_ERR_INVALID;
+    }
+
+    if (sub->map_pending &&
+        unlikely(!ubase_check(upipe_hls_segmenter_sub_write_map(upipe))))
+        upipe_warn(upipe, "couldn't write initialization section");
+
+    free(sub->uri);
+    if (unlikely(asprintf(&sub->uri, "%s_%"PRIu64"%s", sub->name,
+                          sub->sequence, sub->ext) < 0)) {
+        sub->uri = NULL;
+        return UBASE_ERR_ALLOC;
+    }
+    /* the segment is written in place, so that its parts can be served
+     * while it is written */
+    sub->file = upipe_hls_segmenter_file_alloc(upipe_hls_segmenter->dir,
+                                               sub->uri, false);
+    UBASE_ALLOC_RETURN(sub->file)
+    sub->start = date;
+    sub->size = 0;
+    sub->part_start = date;
+    sub->part_offset = 0;
+    sub->part_independent = true;
+    if (upipe_hls_segmenter->part_duration)
+        upipe_hls_segmenter_sub_write_playlist(upipe, false);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This adds the current part to the parts of the segment.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param date date of the part end
+ */
+static void upipe_hls_segmenter_sub_close_part(struct upipe *upipe,
+                                               uint64_t date)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    if (sub->size == sub->part_offset)
+        return;
+
+    if (unlikely(!ubase_check(upipe_hls_segmenter_append(&sub->parts,
+                "#EXT-X-PART:DURATION=%.5f,URI=\"%s\","
+                "BYTERANGE=\"%"PRIu64"@%"PRIu64"\"%s\n",
+                upipe_hls_segmenter_seconds(date - sub->part_start),
+                sub->uri, sub->size - sub->part_offset, sub->part_offset,
+                sub->part_independent ? ",INDEPENDENT=YES" : ""))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    sub->part_start = date;
+    sub->part_offset = sub->size;
+    sub->part_independent = false;
+}
+
+/** @internal @This closes the current segment.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param date date of the segment end
+ * @param end true if this is the last segment
+ */
+static void upipe_hls_segmenter_sub_close(struct upipe *upipe, uint64_t date,
+                                          bool end)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+
+    if (upipe_hls_segmenter->part_duration)
+        upipe_hls_segmenter_sub_close_part(upipe, date);
+    if (unlikely(!ubase_check(upipe_hls_segmenter_sub_queue(upipe,
+                        sub->file, NULL, true, NULL))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    sub->file = NULL;
+
+    struct upipe_hls_segmenter_segment *segment = malloc(sizeof (*segment));
+    if (unlikely(segment == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uchain_init(&segment->uchain);
+    segment->sequence = sub->sequence++;
+    segment->duration = date - sub->start;
+    segment->discontinuity = sub->discontinuity;
+    segment->uri = sub->uri;
+    segment->map = sub->map != NULL ? strdup(sub->map) : NULL;
+    segment->parts = sub->parts;
+    sub->uri = NULL;
+    sub->parts = NULL;
+    sub->discontinuity = false;
+    ulist_add(&sub->segments, &segment->uchain);
+    sub->nb_segments++;
+
+    upipe_verbose_va(upipe, "segment %"PRIu64" %.3f s %"PRIu64" bytes",
+                     segment->sequence,
+                     upipe_hls_segmenter_seconds(segment->duration),
+                     sub->size);
+    upipe_throw(upipe, UPROBE_HLS_SEGMENTER_SUB_SEGMENT,
+                UPIPE_HLS_SEGMENTER_SUB_SIGNATURE, segment->sequence,
+                segment->duration, sub->size);
+
+    /* only the last segments list their parts */
+    unsigned int i = 0;
+    struct uchain *uchain;
+    ulist_foreach (&sub->segments, uchain) {
+        if (i++ + PARTS_SEGMENTS >= sub->nb_segments)
+            break;
+        segment = upipe_hls_segmenter_segment_from_uchain(uchain);
+        free(segment->parts);
+        segment->parts = NULL;
+    }
+
+    /* keep removed segments for another window before deleting them */
+    unsigned int window = upipe_hls_segmenter->window;
+    while (window && sub->nb_segments > 2 * window) {
+        segment = upipe_hls_segmenter_segment_from_uchain(
+                ulist_pop(&sub->segments));
+        sub->nb_segments--;
+        if (segment->discontinuity)
+            sub->discontinuity_sequence++;
+        char *path;
+        if (likely(asprintf(&path, "%s/%s", upipe_hls_segmenter->dir,
+                            segment->uri) >= 0))
+            upipe_hls_segmenter_sub_queue(upipe, NULL, NULL, false, path);
+        upipe_hls_segmenter_segment_free(segment);
+    }
+
+    bool update = false;
+    uint64_t duration = date - sub->start;
+    if (duration > sub->max_duration)
+        sub->max_duration = duration;
+    if (duration) {
+        uint64_t rate = sub->size * 8 * UCLOCK_FREQ / duration;
+        if (rate > sub->peak) {
+            sub->peak = rate;
+            update = true;
+        }
+    }
+    sub->total_size += sub->size;
+    sub->total_duration += duration;
+    sub->start = UINT64_MAX;
+
+    if (unlikely(!ubase_check(upipe_hls_segmenter_sub_write_playlist(upipe,
+                                                                    end))))
+        upipe_warn(upipe, "couldn't write media playlist");
+    if (update &&
+        !ubase_check(upipe_hls_segmenter_write_master(
+                upipe_hls_segmenter_to_upipe(upipe_hls_segmenter))))
+        upipe_warn(upipe, "couldn't write master playlist");
+}
+
+/** @internal @This looks for a random access point in a transport stream
+ * buffer.
+ *
+ * @param uref buffer to scan
+ * @return the offset of the first packet with the random access indicator,
+ * or -1
+ */
+static int upipe_hls_segmenter_sub_find_rap(struct uref *uref)
+{
+    size_t size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size))))
+        return -1;
+
+    for (int offset = 0; offset + TS_SIZE <= size; offset += TS_SIZE) {
+        uint8_t buffer[TS_HEADER_SIZE + 2];
+        const uint8_t *ts = uref_block_peek(uref, offset, sizeof (buffer),
+                                            buffer);
+        if (unlikely(ts == NULL))
+            return -1;
+        bool rap = ts_validate(ts) && ts_get_unitstart(ts) &&
+                   ts_has_adaptation(ts) && ts_get_adaptation(ts) &&
+                   tsaf_has_randomaccess(ts);
+        uref_block_peek_unmap(uref, offset, buffer, ts);
+        if (rap)
+            return offset;
+    }
+    return -1;
+}
+
+/** @internal @This handles a buffer that either starts with a random access
+ * point or does not contain any.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param uref uref structure
+ * @param date date of the buffer
+ * @param rap true if the buffer starts with a random access point
+ * @param cut false if a part must not start with this buffer
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hls_segmenter_sub_work(struct upipe *upipe,
+                                         struct uref *uref, uint64_t date,
+                                         bool rap, bool cut,
+                                         struct upump **upump_p)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_sub_mgr(upipe->mgr);
+    uint64_t duration = upipe_hls_segmenter->duration;
+    uint64_t part_duration = upipe_hls_segmenter->part_duration;
+    uint64_t last = sub->last;
+
+    bool discontinuity = last != UINT64_MAX &&
+        (date < last || date - last > duration);
+    if (discontinuity) {
+        upipe_warn(upipe, "discontinuity");
+        if (sub->file != NULL)
+            upipe_hls_segmenter_sub_close(upipe, last + sub->interval, false);
+        sub->discontinuity = sub->sequence != 0;
+        sub->interval = 0;
+    } else {
+        if (last != UINT64_MAX && date > last)
+            sub->interval = date - last;
+        if (sub->file != NULL && rap && date - sub->start >= duration)
+            upipe_hls_segmenter_sub_close(upipe, date, false);
+    }
+    sub->last = date;
+
+    if (sub->file == NULL) {
+        if (!rap) {
+            uref_free(uref);
+            return;
+        }
+        if (unlikely(!ubase_check(upipe_hls_segmenter_sub_open(upipe,
+                                                               date)))) {
+            upipe_warn(upipe, "couldn't open segment");
+            uref_free(uref);
+            return;
+        }
+    } else if (part_duration && cut &&
+               date - sub->part_start + sub->interval > part_duration) {
+        /* the next buffer would not fit in the part */
+        upipe_hls_segmenter_sub_close_part(upipe, date);
+        sub->part_independent = rap;
+        if (unlikely(!ubase_check(upipe_hls_segmenter_sub_write_playlist(
+                            upipe, false))))
+            upipe_warn(upipe, "couldn't write media playlist");
+    }
+
+    size_t size = 0;
+    uref_block_size(uref, &size);
+    sub->size += size;
+    if (unlikely(!ubase_check(upipe_hls_segmenter_sub_queue(upipe, sub->file,
+                                                            uref, false,
+                                                            NULL))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hls_segmenter_sub_input(struct upipe *upipe,
+                                          struct uref *uref,
+                                          struct upump **upump_p)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+
+    if (unlikely(uref->ubuf == NULL)) {
+        uref_free(uref);
+        return;
+    }
+    if (unlikely(sub->uref_mgr == NULL)) {
+        sub->uref_mgr = uref_mgr_use(uref->mgr);
+        sub->ubuf_mgr = ubuf_mgr_use(uref->ubuf->mgr);
+    }
+
+    uint64_t date;
+    if (!ubase_check(uref_clock_get_dts_prog(uref, &date)) &&
+        !ubase_check(uref_clock_get_cr_prog(uref, &date)) &&
+        !ubase_check(uref_clock_get_cr_sys(uref, &date))) {
+        if (unlikely(sub->last == UINT64_MAX)) {
+            upipe_warn(upipe, "received non-dated buffer");
+            uref_free(uref);
+            return;
+        }
+        date = sub->last;
+    }
+
+    if (!sub->mpegts) {
+        upipe_hls_segmenter_sub_work(upipe, uref, date,
+                ubase_check(uref_flow_get_random(uref)), true, upump_p);
+        return;
+    }
+
+    int offset = upipe_hls_segmenter_sub_find_rap(uref);
+    if (offset > 0) {
+        /* split the buffer, without copying, on the random access point */
+        struct uref *head = uref_dup(uref);
+        if (unlikely(head == NULL)) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_block_resize(head, 0, offset);
+        uref_block_resize(uref, offset, -1);
+        upipe_hls_segmenter_sub_work(upipe, head, date, false, false,
+                                     upump_p);
+    }
+    upipe_hls_segmenter_sub_work(upipe, uref, date, offset >= 0, true,
+                                 upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_set_flow_def(struct upipe *upipe,
+                                                struct uref *flow_def)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup)
+    if (sub->flow_def != NULL)
+        uref_free(sub->flow_def);
+    sub->flow_def = flow_def_dup;
+
+    sub->mpegts = ubase_check(uref_flow_match_def(flow_def, MPEGTS_FLOW_DEF));
+    sub->ext = sub->mpegts ? ".ts" : ".m4s";
+    const uint8_t *headers;
+    size_t headers_size;
+    sub->map_pending = ubase_check(uref_flow_get_headers(flow_def, &headers,
+                                                         &headers_size));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the rendition name.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param name rendition name
+ * @return an error code
+ */
+static int _upipe_hls_segmenter_sub_set_name(struct upipe *upipe,
+                                             const char *name)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+    if (unlikely(name == NULL || sub->file != NULL || sub->nb_segments))
+        return UBASE_ERR_INVALID;
+    char *dup = strdup(name);
+    UBASE_ALLOC_RETURN(dup)
+    free(sub->name);
+    sub->name = dup;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a hls segmenter sub pipe.
+ *
+ * @param upipe description structure of the sub pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_hls_segmenter_sub_control(struct upipe *upipe,
+                                           int command, va_list args)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+
+    UBASE_HANDLED_RETURN(
+        upipe_hls_segmenter_sub_control_super(upipe, command, args));
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_hls_segmenter_sub_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_HLS_SEGMENTER_SUB_SET_NAME: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SUB_SIGNATURE)
+            const char *name = va_arg(args, const char *);
+            return _upipe_hls_segmenter_sub_set_name(upipe, name);
+        }
+        case UPIPE_HLS_SEGMENTER_SUB_GET_NAME: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SUB_SIGNATURE)
+            const char **name_p = va_arg(args, const char **);
+            *name_p = sub->name;
+            return UBASE_ERR_NONE;
+        }
+    }
+    return UBASE_ERR_UNHANDLED;
+}
+
+/** @internal @This frees a hls segmenter sub pipe. The current segment is
+ * completed and the media playlist is terminated.
+ *
+ * @param upipe description structure of the sub pipe
+ */
+static void upipe_hls_segmenter_sub_free(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(upipe);
+
+    if (sub->file != NULL)
+        upipe_hls_segmenter_sub_close(upipe, sub->last + sub->interval, true);
+
+    upipe_throw_dead(upipe);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&sub->segments)) != NULL)
+        upipe_hls_segmenter_segment_free(
+                upipe_hls_segmenter_segment_from_uchain(uchain));
+    free(sub->parts);
+    free(sub->uri);
+    free(sub->map);
+    free(sub->name);
+    if (sub->flow_def != NULL)
+        uref_free(sub->flow_def);
+    ubuf_mgr_release(sub->ubuf_mgr);
+    uref_mgr_release(sub->uref_mgr);
+    upipe_hls_segmenter_sub_clean_sub(upipe);
+    upipe_hls_segmenter_sub_clean_urefcount(upipe);
+    upipe_hls_segmenter_sub_free_void(upipe);
+}
+
+/** @internal @This writes the master playlist, listing the renditions with
+ * a known bit rate.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_hls_segmenter_write_master(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+    if (upipe_hls_segmenter->master == NULL)
+        return UBASE_ERR_NONE;
+
+    char *playlist = NULL;
+    struct upipe *writer = NULL;
+    int err = upipe_hls_segmenter_append(&playlist,
+            "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-INDEPENDENT-SEGMENTS\n");
+    struct uchain *uchain;
+    ulist_foreach (&upipe_hls_segmenter->subs, uchain) {
+        struct upipe_hls_segmenter_sub *sub =
+            upipe_hls_segmenter_sub_from_uchain(uchain);
+        uint64_t octetrate = 0;
+        uint64_t bandwidth = sub->peak;
+        if (sub->flow_def != NULL &&
+            ubase_check(uref_block_flow_get_octetrate(sub->flow_def,
+                                                      &octetrate)))
+            bandwidth = octetrate * 8;
+        if (!bandwidth || sub->uref_mgr == NULL)
+            continue;
+        if (writer == NULL)
+            writer = upipe_hls_segmenter_sub_to_upipe(sub);
+
+        if (ubase_check(err))
+            err = upipe_hls_segmenter_append(&playlist,
+                    "#EXT-X-STREAM-INF:BANDWIDTH=%"PRIu64, bandwidth);
+        if (ubase_check(err) && sub->total_duration)
+            err = upipe_hls_segmenter_append(&playlist,
+                    ",AVERAGE-BANDWIDTH=%"PRIu64,
+                    sub->total_size * 8 * UCLOCK_FREQ / sub->total_duration);
+        if (ubase_check(err))
+            err = upipe_hls_segmenter_append(&playlist, "\n%s.m3u8\n",
+                                             sub->name);
+    }
+    if (unlikely(!ubase_check(err) || writer == NULL)) {
+        free(playlist);
+        return err;
+    }
+
+    struct upipe_hls_segmenter_sub *sub =
+        upipe_hls_segmenter_sub_from_upipe(writer);
+    int size = strlen(playlist);
+    struct uref *uref = uref_block_alloc(sub->uref_mgr, sub->ubuf_mgr, size);
+    uint8_t *buffer;
+    if (unlikely(uref == NULL ||
+                 !ubase_check(uref_block_write(uref, 0, &size, &buffer)))) {
+        if (uref != NULL)
+            uref_free(uref);
+        free(playlist);
+        return UBASE_ERR_ALLOC;
+    }
+    memcpy(buffer, playlist, size);
+    uref_block_unmap(uref, 0);
+    free(playlist);
+    return upipe_hls_segmenter_sub_write_file(writer,
+                                              upipe_hls_segmenter->master,
+                                              uref);
+}
+
+/** @internal @This initializes the sub pipe manager.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_segmenter_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_hls_segmenter->sub_mgr;
+    memset(sub_mgr, 0, sizeof (*sub_mgr));
+    sub_mgr->refcount = &upipe_hls_segmenter->urefcount;
+    sub_mgr->signature = UPIPE_HLS_SEGMENTER_SUB_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_hls_segmenter_sub_alloc;
+    sub_mgr->upipe_input = upipe_hls_segmenter_sub_input;
+    sub_mgr->upipe_control = upipe_hls_segmenter_sub_control;
+    sub_mgr->upipe_command_str = upipe_hls_segmenter_sub_command_str;
+    sub_mgr->upipe_event_str = uprobe_hls_segmenter_sub_event_str;
+}
+
+/** @internal @This allocates a hls segmenter pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_hls_segmenter_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct upipe *upipe =
+        upipe_hls_segmenter_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+    upipe_hls_segmenter_init_urefcount(upipe);
+    upipe_hls_segmenter_init_sub_mgr(upipe);
+    upipe_hls_segmenter_init_sub_subs(upipe);
+    ulist_init(&upipe_hls_segmenter->jobs);
+    upipe_hls_segmenter->queued = 0;
+    upipe_hls_segmenter->busy = false;
+    upipe_hls_segmenter->stop = false;
+    upipe_hls_segmenter->errors = 0;
+    upipe_hls_segmenter->dir = NULL;
+    upipe_hls_segmenter->master = NULL;
+    upipe_hls_segmenter->duration = UPIPE_HLS_SEGMENTER_DEF_DURATION;
+    upipe_hls_segmenter->part_duration = 0;
+    upipe_hls_segmenter->window = UPIPE_HLS_SEGMENTER_DEF_WINDOW;
+    upipe_hls_segmenter->nb_subs = 0;
+
+    pthread_mutex_init(&upipe_hls_segmenter->mutex, NULL);
+    pthread_cond_init(&upipe_hls_segmenter->cond, NULL);
+    pthread_cond_init(&upipe_hls_segmenter->idle, NULL);
+    pthread_cond_init(&upipe_hls_segmenter->done, NULL);
+    if (unlikely(pthread_create(&upipe_hls_segmenter->writer, NULL,
+                                upipe_hls_segmenter_writer,
+                                upipe_hls_segmenter) != 0)) {
+        pthread_cond_destroy(&upipe_hls_segmenter->done);
+        pthread_cond_destroy(&upipe_hls_segmenter->idle);
+        pthread_cond_destroy(&upipe_hls_segmenter->cond);
+        pthread_mutex_destroy(&upipe_hls_segmenter->mutex);
+        upipe_hls_segmenter_clean_sub_subs(upipe);
+        upipe_hls_segmenter_clean_urefcount(upipe);
+        upipe_hls_segmenter_free_void(upipe);
+        return NULL;
+    }
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This sets the output directory and the master playlist name.
+ *
+ * @param upipe description structure of the pipe
+ * @param dir output directory
+ * @param master master playlist file name or NULL
+ * @return an error code
+ */
+static int _upipe_hls_segmenter_set_path(struct upipe *upipe,
+                                         const char *dir, const char *master)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+    char *dir_dup = NULL, *master_dup = NULL;
+    if (dir != NULL && (dir_dup = strdup(dir)) == NULL)
+        return UBASE_ERR_ALLOC;
+    if (master != NULL && (master_dup = strdup(master)) == NULL) {
+        free(dir_dup);
+        return UBASE_ERR_ALLOC;
+    }
+    free(upipe_hls_segmenter->dir);
+    free(upipe_hls_segmenter->master);
+    upipe_hls_segmenter->dir = dir_dup;
+    upipe_hls_segmenter->master = master_dup;
+    if (dir != NULL)
+        upipe_notice_va(upipe, "writing to %s", dir);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the segment and part target durations.
+ *
+ * @param upipe description structure of the pipe
+ * @param duration segment target duration
+ * @param part_duration part target duration or 0
+ * @return an error code
+ */
+static int _upipe_hls_segmenter_set_duration(struct upipe *upipe,
+                                             uint64_t duration,
+                                             uint64_t part_duration)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+    if (unlikely(!duration || part_duration > duration))
+        return UBASE_ERR_INVALID;
+    upipe_hls_segmenter->duration = duration;
+    upipe_hls_segmenter->part_duration = part_duration;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This waits until the writer thread has completed the queued
+ * jobs.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void _upipe_hls_segmenter_sync(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+
+    pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+    while (!ulist_empty(&upipe_hls_segmenter->jobs) ||
+           upipe_hls_segmenter->busy)
+        pthread_cond_wait(&upipe_hls_segmenter->idle,
+                          &upipe_hls_segmenter->mutex);
+    pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+}
+
+/** @internal @This processes control commands on a hls segmenter pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_hls_segmenter_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+
+    UBASE_HANDLED_RETURN(
+        upipe_hls_segmenter_control_subs(upipe, command, args));
+    switch (command) {
+        case UPIPE_HLS_SEGMENTER_SET_PATH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            const char *dir = va_arg(args, const char *);
+            const char *master = va_arg(args, const char *);
+            return _upipe_hls_segmenter_set_path(upipe, dir, master);
+        }
+        case UPIPE_HLS_SEGMENTER_GET_PATH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            const char **dir_p = va_arg(args, const char **);
+            const char **master_p = va_arg(args, const char **);
+            if (dir_p != NULL)
+                *dir_p = upipe_hls_segmenter->dir;
+            if (master_p != NULL)
+                *master_p = upipe_hls_segmenter->master;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SEGMENTER_SET_DURATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            uint64_t duration = va_arg(args, uint64_t);
+            uint64_t part_duration = va_arg(args, uint64_t);
+            return _upipe_hls_segmenter_set_duration(upipe, duration,
+                                                     part_duration);
+        }
+        case UPIPE_HLS_SEGMENTER_GET_DURATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            uint64_t *duration_p = va_arg(args, uint64_t *);
+            uint64_t *part_duration_p = va_arg(args, uint64_t *);
+            if (duration_p != NULL)
+                *duration_p = upipe_hls_segmenter->duration;
+            if (part_duration_p != NULL)
+                *part_duration_p = upipe_hls_segmenter->part_duration;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SEGMENTER_SET_WINDOW: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            upipe_hls_segmenter->window = va_arg(args, unsigned int);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HLS_SEGMENTER_SYNC: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SIGNATURE)
+            _upipe_hls_segmenter_sync(upipe);
+            return UBASE_ERR_NONE;
+        }
+    }
+    return UBASE_ERR_UNHANDLED;
+}
+
+/** @internal @This frees a hls segmenter pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hls_segmenter_free(struct upipe *upipe)
+{
+    struct upipe_hls_segmenter *upipe_hls_segmenter =
+        upipe_hls_segmenter_from_upipe(upipe);
+
+    upipe_throw_dead(upipe);
+
+    /* the writer thread completes the queued jobs before exiting */
+    pthread_mutex_lock(&upipe_hls_segmenter->mutex);
+    upipe_hls_segmenter->stop = true;
+    pthread_cond_signal(&upipe_hls_segmenter->cond);
+    pthread_mutex_unlock(&upipe_hls_segmenter->mutex);
+    pthread_join(upipe_hls_segmenter->writer, NULL);
+    if (unlikely(upipe_hls_segmenter->errors))
+        upipe_warn_va(upipe, "%u file operations failed",
+                      upipe_hls_segmenter->errors);
+    pthread_cond_destroy(&upipe_hls_segmenter->done);
+    pthread_cond_destroy(&upipe_hls_segmenter->idle);
+    pthread_cond_destroy(&upipe_hls_segmenter->cond);
+    pthread_mutex_destroy(&upipe_hls_segmenter->mutex);
+
+    free(upipe_hls_segmenter->dir);
+    free(upipe_hls_segmenter->master);
+    upipe_hls_segmenter_clean_sub_subs(upipe);
+    upipe_hls_segmenter_clean_urefcount(upipe);
+    upipe_hls_segmenter_free_void(upipe);
+}
+
+/** @internal @This is the static hls segmenter pipe manager. */
+static struct upipe_mgr upipe_hls_segmenter_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_HLS_SEGMENTER_SIGNATURE,
+    .upipe_alloc = upipe_hls_segmenter_alloc,
+    .upipe_control = upipe_hls_segmenter_control,
+    .upipe_command_str = upipe_hls_segmenter_command_str,
+};
+
+/** @This returns the hls segmenter pipe manager.
+ *
+ * @return a pointer to the hls segmenter pipe manager
+ */
+struct upipe_mgr *upipe_hls_segmenter_mgr_alloc(void)
+{
+    return &upipe_hls_segmenter_mgr;
+}
@@ -27,6 +27,7 @@
 #include <upipe-hls/upipe_hls_video.h>
 #include <upipe-hls/upipe_hls_audio.h>
 #include <upipe-hls/upipe_hls_variant.h>
+#include <upipe-hls/upipe_hls_playlist.h>
 
 #include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_upump_mgr.h>
@@ -93,6 +94,10 @@ struct upipe_hls_variant_sub {
     struct upipe *output;
 };
 
+/** @hidden */
+static int probe_last_inner(struct uprobe *uprobe, struct upipe *inner,
+                            int event, va_list args);
+
 UPIPE_HELPER_UPIPE(upipe_hls_variant_sub, upipe,
                    UPIPE_HLS_VARIANT_SUB_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_hls_variant_sub, urefcount,
@@ -102,7 +107,7 @@ UPIPE_HELPER_UREFCOUNT_REAL(upipe_hls_variant_sub, urefcount_real,
 UPIPE_HELPER_FLOW(upipe_hls_variant_sub, NULL);
 UPIPE_HELPER_INNER(upipe_hls_variant_sub, last_inner);
 UPIPE_HELPER_UPROBE(upipe_hls_variant_sub, urefcount_real,
-                    probe_last_inner, NULL);
+                    probe_last_inner, probe_last_inner);
 UPIPE_HELPER_BIN_OUTPUT(upipe_hls_variant_sub, last_inner, output, requests);
 
 struct upipe_hls_variant {
@@ -138,6 +143,42 @@ UPIPE_HELPER_SUBPIPE(upipe_hls_variant, upipe_hls_variant_sub,
 UPIPE_HELPER_UPUMP_MGR(upipe_hls_variant, upump_mgr);
 UPIPE_HELPER_UPUMP(upipe_hls_variant, upump, upump_mgr);
 
+/** @internal @This catches the events of the rendition inner pipe. Item
+ * events of the playlists are also forwarded to the super pipe, so that a
+ * master pipe can follow the downloads of the variant.
+ *
+ * @param uprobe structure used to raise events
+ * @param inner pointer to inner pipe
+ * @param event event thrown
+ * @param args optional arguments
+ * @return an error code
+ */
+static int probe_last_inner(struct uprobe *uprobe, struct upipe *inner,
+                            int event, va_list args)
+{
+    struct upipe_hls_variant_sub *upipe_hls_variant_sub =
+        upipe_hls_variant_sub_from_probe_last_inner(uprobe);
+    struct upipe *upipe = upipe_hls_variant_sub_to_upipe(upipe_hls_variant_sub);
+
+    if (event >= UPROBE_LOCAL &&
+        ubase_get_signature(args) == UPIPE_HLS_PLAYLIST_SIGNATURE) {
+        switch (event) {
+        case UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED:
+        case UPROBE_HLS_PLAYLIST_ITEM_END: {
+            struct upipe_hls_variant *upipe_hls_variant =
+                upipe_hls_variant_from_sub_mgr(upipe->mgr);
+            va_list args_copy;
+            va_copy(args_copy, args);
+            upipe_throw_va(upipe_hls_variant_to_upipe(upipe_hls_variant),
+                           event, args_copy);
+            va_end(args_copy);
+            break;
+        }
+        }
+    }
+    return upipe_throw_proxy(upipe, inner, event, args);
+}
+
 /** @internal @This allocates a hls sub variant pipe.
  *
  * @param mgr management structure for this pipe type
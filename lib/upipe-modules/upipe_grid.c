@@ -23,6 +23,21 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/** @file
+ * @short Upipe grid pipe, connecting any input to any output
+ *
+ * Each input publishes its frames in a fixed-size ring sorted by PTS, and
+ * each output looks up the frame matching its PTS in the ring of its
+ * selected input with a binary search on the PTS. Frames are refcounted
+ * and shared without locks, so that inputs and outputs may run in different
+ * threads: readers register in one of two epochs while they look up and
+ * reference a frame, and an input only releases the frames it removed from
+ * its ring once the readers of the previous epoch are gone.
+ *
+ * Allocating and releasing inputs and outputs, and iterating them, is
+ * serialized by a spinlock in the grid.
+ */
+
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_urefcount_real.h>
@@ -32,6 +47,8 @@
 #include <upipe/upipe_helper_flow_def.h>
 #include <upipe/upipe_helper_uclock.h>
 
+#include <upipe/uatomic.h>
+#include <upipe/urefcount.h>
 #include <upipe/uclock.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_void_flow.h>
@@ -44,12 +61,17 @@
 
 #include <upipe-modules/upipe_grid.h>
 
+#include <stdlib.h>
+#include <sched.h>
+
 /** expected flow def for reference input */
 #define REF_EXPECTED_FLOW "void."
 /** default pts tolerance (late packets) */
 #define DEFAULT_TOLERANCE ((UCLOCK_FREQ / 25) - 1)
 /** maximum retention when there is no packet afterwards */
 #define MAX_RETENTION UCLOCK_FREQ
+/** number of frames in the ring of an input */
+#define RING_SIZE 64
 
 /** @internal @This is the private structure of a grid pipe. */
 struct upipe_grid {
@@ -67,6 +89,8 @@ struct upipe_grid {
     struct uchain inputs;
     /** output sub pipe list */
     struct uchain outputs;
+    /** lock of the sub pipe lists */
+    uatomic_uint32_t lock;
     /** uclock */
     struct uclock *uclock;
     /** uclock request */
@@ -75,6 +99,8 @@ struct upipe_grid {
     uint64_t tolerance;
     /** grid max rentention */
     uint64_t max_retention;
+    /** highest PTS requested by the outputs, accessed atomically */
+    uint64_t next_pts;
 };
 
 /** @hidden */
@@ -89,6 +115,54 @@ UPIPE_HELPER_VOID(upipe_grid);
 UPIPE_HELPER_UCLOCK(upipe_grid, uclock, uclock_request, NULL,
                     upipe_throw_provide_request, NULL);
 
+/** @internal @This is the flow definition of a grid input, shared by the
+ * frames received with it. */
+struct upipe_grid_flow {
+    /** refcount structure */
+    struct urefcount urefcount;
+    /** flow definition */
+    struct uref *flow_def;
+    /** latency of the flow */
+    uint64_t latency;
+};
+
+UBASE_FROM_TO(upipe_grid_flow, urefcount, urefcount, urefcount)
+
+/** @internal @This is a frame published by a grid input. */
+struct upipe_grid_frame {
+    /** refcount structure */
+    struct urefcount urefcount;
+    /** frame, not modified once published */
+    struct uref *uref;
+    /** flow definition of the frame */
+    struct upipe_grid_flow *flow;
+    /** system PTS of the frame */
+    uint64_t pts;
+};
+
+UBASE_FROM_TO(upipe_grid_frame, urefcount, urefcount, urefcount)
+
+/** @internal @This is the ring of frames of a grid input, shared with the
+ * outputs reading it. Only the input writes to it. */
+struct upipe_grid_ring {
+    /** refcount structure */
+    struct urefcount urefcount;
+    /** 1 once the input is released */
+    uatomic_uint32_t closed;
+    /** current epoch of the readers */
+    uatomic_uint32_t epoch;
+    /** number of readers per epoch parity */
+    uatomic_uint32_t readers[2];
+    /** index of the oldest frame */
+    uatomic_uint32_t tail;
+    /** index following the newest frame */
+    uatomic_uint32_t head;
+    /** frames, sorted by PTS */
+    uatomic_ptr_t frames[RING_SIZE];
+};
+
+UBASE_FROM_TO(upipe_grid_ring, urefcount, urefcount, urefcount)
+
 /** @internal @This is the private structure for grid input sub pipe. */
 struct upipe_grid_in {
     /** pipe public structure */
@@ -97,22 +171,16 @@ struct upipe_grid_in {
     struct urefcount urefcount;
     /** uchain for upipe_grid input list */
     struct uchain uchain;
-    /** list of input urefs */
-    struct uchain urefs;
+    /** ring of published frames */
+    struct upipe_grid_ring *ring;
+    /** current flow definition of the published frames */
+    struct upipe_grid_flow *flow;
     /** input flow def */
     struct uref *flow_def;
     /** flow def attr */
     struct uref *flow_attr;
-    /** proxy probe */
-    struct uprobe proxy;
     /** last received PTS */
     uint64_t last_pts;
-    /** last update PTS */
-    uint64_t last_update;
-    /** input latency */
-    uint64_t latency;
-    /** next update diff */
-    uint64_t next_update;
 };
 
 UPIPE_HELPER_UPIPE(upipe_grid_in, upipe, UPIPE_GRID_IN_SIGNATURE);
@@ -149,12 +217,14 @@ struct upipe_grid_out {
     enum upipe_helper_output_state output_state;
     /** output request list */
     struct uchain requests;
-    /** inputs */
-    struct uchain inputs;
     /** true if flow def is from current input */
     bool flow_def_input;
     /** selected input */
     struct upipe *input;
+    /** ring of the selected input */
+    struct upipe_grid_ring *ring;
+    /** flow definition of the last extracted frame */
+    struct upipe_grid_flow *flow;
     /** true if flow def is up to date */
     bool flow_def_uptodate;
     /** uchain for super pipe list */
@@ -165,11 +235,6 @@ struct upipe_grid_out {
     uint64_t last_input_pts;
 };
 
-static void upipe_grid_out_handle_input_changed(struct upipe *upipe,
-                                                 struct upipe *input);
-static void upipe_grid_out_handle_input_removed(struct upipe *upipe,
-                                                 struct upipe *input);
-
 UPIPE_HELPER_UPIPE(upipe_grid_out, upipe, UPIPE_GRID_OUT_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_grid_out, urefcount,
                        upipe_grid_out_free);
@@ -180,6 +245,239 @@ UPIPE_HELPER_SUBPIPE(upipe_grid, upipe_grid_out, output, out_mgr,
                      outputs, uchain);
 UPIPE_HELPER_FLOW_DEF(upipe_grid_out, input_flow_def, input_flow_attr);
 
+/** @internal @This locks the sub pipe lists of a grid pipe.
+ *
+ * @param upipe_grid private structure of the grid pipe
+ */
+static inline void upipe_grid_lock(struct upipe_grid *upipe_grid)
+{
+    uint32_t expected;
+    do {
+        expected = 0;
+    } while (!uatomic_compare_exchange(&upipe_grid->lock, &expected, 1));
+}
+
+/** @internal @This unlocks the sub pipe lists of a grid pipe.
+ *
+ * @param upipe_grid private structure of the grid pipe
+ */
+static inline void upipe_grid_unlock(struct upipe_grid *upipe_grid)
+{
+    uatomic_store(&upipe_grid->lock, 0);
+}
+
+/** @internal @This frees a flow definition.
+ *
+ * @param urefcount pointer to the refcount of the flow
+ */
+static void upipe_grid_flow_free(struct urefcount *urefcount)
+{
+    struct upipe_grid_flow *flow = upipe_grid_flow_from_urefcount(urefcount);
+    uref_free(flow->flow_def);
+    urefcount_clean(urefcount);
+    free(flow);
+}
+
+/** @internal @This allocates a flow definition.
+ *
+ * @param flow_def flow definition, belongs to the callee
+ * @return pointer to the flow, or NULL in case of allocation error
+ */
+static struct upipe_grid_flow *upipe_grid_flow_alloc(struct uref *flow_def)
+{
+    struct upipe_grid_flow *flow = malloc(sizeof(struct upipe_grid_flow));
+    if (unlikely(!flow)) {
+        uref_free(flow_def);
+        return NULL;
+    }
+    urefcount_init(upipe_grid_flow_to_urefcount(flow), upipe_grid_flow_free);
+    flow->flow_def = flow_def;
+    flow->latency = 0;
+    uref_clock_get_latency(flow_def, &flow->latency);
+    return flow;
+}
+
+/** @internal @This uses a flow definition.
+ *
+ * @param flow pointer to the flow, or NULL
+ * @return flow
+ */
+static inline struct upipe_grid_flow *
+    upipe_grid_flow_use(struct upipe_grid_flow *flow)
+{
+    if (flow)
+        urefcount_use(upipe_grid_flow_to_urefcount(flow));
+    return flow;
+}
+
+/** @internal @This releases a flow definition.
+ *
+ * @param flow pointer to the flow, or NULL
+ */
+static inline void upipe_grid_flow_release(struct upipe_grid_flow *flow)
+{
+    if (flow)
+        urefcount_release(upipe_grid_flow_to_urefcount(flow));
+}
+
+/** @internal @This frees a frame.
+ *
+ * @param urefcount pointer to the refcount of the frame
+ */
+static void upipe_grid_frame_free(struct urefcount *urefcount)
+{
+    struct upipe_grid_frame *frame =
+        upipe_grid_frame_from_urefcount(urefcount);
+    uref_free(frame->uref);
+    upipe_grid_flow_release(frame->flow);
+    urefcount_clean(urefcount);
+    free(frame);
+}
+
+/** @internal @This releases a frame.
+ *
+ * @param frame pointer to the frame
+ */
+static inline void upipe_grid_frame_release(struct upipe_grid_frame *frame)
+{
+    urefcount_release(upipe_grid_frame_to_urefcount(frame));
+}
+
+/** @internal @This returns the frame at an index of a ring.
+ *
+ * @param ring pointer to the ring
+ * @param index index of the frame
+ * @return pointer to the frame
+ */
+static inline struct upipe_grid_frame *
+    upipe_grid_ring_peek(struct upipe_grid_ring *ring, uint32_t index)
+{
+    return uatomic_ptr_load_ptr(&ring->frames[index % RING_SIZE],
+                                struct upipe_grid_frame *);
+}
+
+/** @internal @This frees a ring and the frames it still contains.
+ *
+ * @param urefcount pointer to the refcount of the ring
+ */
+static void upipe_grid_ring_free(struct urefcount *urefcount)
+{
+    struct upipe_grid_ring *ring = upipe_grid_ring_from_urefcount(urefcount);
+    uint32_t head = uatomic_load(&ring->head);
+    for (uint32_t i = uatomic_load(&ring->tail); i != head; i++)
+        upipe_grid_frame_release(upipe_grid_ring_peek(ring, i));
+
+    uatomic_clean(&ring->closed);
+    uatomic_clean(&ring->epoch);
+    uatomic_clean(&ring->readers[0]);
+    uatomic_clean(&ring->readers[1]);
+    uatomic_clean(&ring->tail);
+    uatomic_clean(&ring->head);
+    for (unsigned i = 0; i < RING_SIZE; i++)
+        uatomic_ptr_clean(&ring->frames[i]);
+    urefcount_clean(urefcount);
+    free(ring);
+}
+
+/** @internal @This allocates an empty ring.
+ *
+ * @return pointer to the ring, or NULL in case of allocation error
+ */
+static struct upipe_grid_ring *upipe_grid_ring_alloc(void)
+{
+    struct upipe_grid_ring *ring = malloc(sizeof(struct upipe_grid_ring));
+    if (unlikely(!ring))
+        return NULL;
+    urefcount_init(upipe_grid_ring_to_urefcount(ring), upipe_grid_ring_free);
+    uatomic_init(&ring->closed, 0);
+    uatomic_init(&ring->epoch, 0);
+    uatomic_init(&ring->readers[0], 0);
+    uatomic_init(&ring->readers[1], 0);
+    uatomic_init(&ring->tail, 0);
+    uatomic_init(&ring->head, 0);
+    for (unsigned i = 0; i < RING_SIZE; i++)
+        uatomic_ptr_init(&ring->frames[i], NULL);
+    return ring;
+}
+
+/** @internal @This waits until no reader may still access the frames
+ * removed from a ring. It is called by the input only.
+ *
+ * @param ring pointer to the ring
+ */
+static void upipe_grid_ring_sync(struct upipe_grid_ring *ring)
+{
+    uint32_t epoch = uatomic_load(&ring->epoch);
+    uatomic_store(&ring->epoch, epoch + 1);
+    while (uatomic_load(&ring->readers[epoch & 1]))
+        sched_yield();
+}
+
+/** @internal @This returns the time after which a frame is late.
+ *
+ * @param frame pointer to the frame
+ * @param tolerance late buffer tolerance
+ * @return the limit in system time
+ */
+static inline uint64_t upipe_grid_frame_limit(struct upipe_grid_frame *frame,
+                                              uint64_t tolerance)
+{
+    return frame->pts + frame->flow->latency + tolerance;
+}
+
+/** @internal @This looks up the frame to output at a given PTS, which is the
+ * first frame which is not late, or the last frame if it is retained.
+ *
+ * @param ring pointer to the ring
+ * @param pts PTS to output
+ * @param tolerance late buffer tolerance
+ * @param max_retention retention of the last frame
+ * @return a reference to the frame, or NULL
+ */
+static struct upipe_grid_frame *
+    upipe_grid_ring_find(struct upipe_grid_ring *ring, uint64_t pts,
+                         uint64_t tolerance, uint64_t max_retention)
+{
+    uint32_t epoch;
+    for ( ; ; ) {
+        epoch = uatomic_load(&ring->epoch);
+        uatomic_fetch_add(&ring->readers[epoch & 1], 1);
+        if (likely(uatomic_load(&ring->epoch) == epoch))
+            break;
+        uatomic_fetch_sub(&ring->readers[epoch & 1], 1);
+    }
+
+    uint32_t tail = uatomic_load(&ring->tail);
+    uint32_t head = uatomic_load(&ring->head);
+    uint32_t low = 0, high = head - tail;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (upipe_grid_ring_peek(ring, tail + middle)->pts < pts)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    /* the latency may change between frames, so it is only applied to the
+     * frames preceding the PTS */
+    while (low && upipe_grid_frame_limit(
+            upipe_grid_ring_peek(ring, tail + low - 1), tolerance) >= pts)
+        low--;
+
+    struct upipe_grid_frame *frame = NULL;
+    if (low < head - tail)
+        frame = upipe_grid_ring_peek(ring, tail + low);
+    else if (head != tail) {
+        frame = upipe_grid_ring_peek(ring, head - 1);
+        if (upipe_grid_frame_limit(frame, tolerance) + max_retention < pts)
+            frame = NULL;
+    }
+    if (frame)
+        urefcount_use(upipe_grid_frame_to_urefcount(frame));
+
+    uatomic_fetch_sub(&ring->readers[epoch & 1], 1);
+    return frame;
+}
+
 /** @internal @This frees a grid input sub pipe.
  *
  * @param upipe description structure of the pipe
@@ -188,16 +486,19 @@ static void upipe_grid_in_free(struct upipe *upipe)
 {
     struct upipe_grid_in *upipe_grid_in =
         upipe_grid_in_from_upipe(upipe);
+    struct upipe_grid *upipe_grid = upipe_grid_from_in_mgr(upipe->mgr);
 
     upipe_throw_dead(upipe);
 
-    struct uchain *uchain, *uchain_tmp;
-    ulist_delete_foreach(&upipe_grid_in->urefs, uchain, uchain_tmp) {
-        ulist_delete(uchain);
-        uref_free(uref_from_uchain(uchain));
-    }
-    upipe_grid_in_clean_flow_def(upipe);
+    /* the outputs no longer find the input, and drop the ring when they
+     * see it closed */
+    upipe_grid_lock(upipe_grid);
     upipe_grid_in_clean_sub(upipe);
+    upipe_grid_unlock(upipe_grid);
+    uatomic_store(&upipe_grid_in->ring->closed, 1);
+    urefcount_release(upipe_grid_ring_to_urefcount(upipe_grid_in->ring));
+    upipe_grid_flow_release(upipe_grid_in->flow);
+    upipe_grid_in_clean_flow_def(upipe);
     upipe_grid_in_clean_urefcount(upipe);
 
     upipe_grid_in_free_void(upipe);
@@ -215,64 +516,77 @@ static struct upipe *upipe_grid_in_alloc(struct upipe_mgr *mgr,
                                          struct uprobe *uprobe,
                                          uint32_t signature, va_list args)
 {
+    struct upipe_grid_ring *ring = upipe_grid_ring_alloc();
+    if (unlikely(!ring)) {
+        uprobe_release(uprobe);
+        return NULL;
+    }
+
     struct upipe *upipe =
         upipe_grid_in_alloc_void(mgr, uprobe, signature, args);
-    if (unlikely(!upipe))
+    if (unlikely(!upipe)) {
+        urefcount_release(upipe_grid_ring_to_urefcount(ring));
         return NULL;
+    }
 
+    struct upipe_grid *upipe_grid = upipe_grid_from_in_mgr(mgr);
     upipe_grid_in_init_urefcount(upipe);
+    upipe_grid_lock(upipe_grid);
     upipe_grid_in_init_sub(upipe);
+    upipe_grid_unlock(upipe_grid);
     upipe_grid_in_init_flow_def(upipe);
 
     struct upipe_grid_in *upipe_grid_in =
         upipe_grid_in_from_upipe(upipe);
-    ulist_init(&upipe_grid_in->urefs);
+    upipe_grid_in->ring = ring;
+    upipe_grid_in->flow = NULL;
     upipe_grid_in->last_pts = 0;
-    upipe_grid_in->last_update = 0;
-    upipe_grid_in->latency = 0;
-    upipe_grid_in->next_update = 0;
 
     upipe_throw_ready(upipe);
 
     return upipe;
 }
 
-/** @internal @This catches events from a grid input pipe.
+/** @internal @This removes the late frames from the ring of an input, and
+ * the oldest frame if the ring is full.
  *
- * @param uprobe structure used to raise events
- * @param upipe the grid input pipe description
- * @param event event raised
- * @param args optional arguments
- * @return an error code
+ * @param upipe description structure of the input pipe
  */
-static int upipe_grid_in_catch(struct uprobe *uprobe,
-                               struct upipe *upipe,
-                               int event, va_list args)
+static void upipe_grid_in_prune(struct upipe *upipe)
 {
-    if (unlikely(!upipe))
-        return uprobe_throw_next(uprobe, upipe, event, args);
-
+    struct upipe_grid_in *upipe_grid_in = upipe_grid_in_from_upipe(upipe);
     struct upipe_grid *upipe_grid = upipe_grid_from_in_mgr(upipe->mgr);
-    struct upipe *super = upipe_grid_to_upipe(upipe_grid);
+    struct upipe_grid_ring *ring = upipe_grid_in->ring;
 
-    switch (event) {
-        case UPROBE_NEW_FLOW_DEF: {
-            struct upipe *output = NULL;
-            while (ubase_check(upipe_grid_iterate_output(super, &output)) &&
-                   output)
-                upipe_grid_out_handle_input_changed(output, upipe);
+    uint64_t limit = __atomic_load_n(&upipe_grid->next_pts, __ATOMIC_RELAXED);
+    uint64_t now;
+    if (ubase_check(upipe_grid_uclock_now(upipe_grid_to_upipe(upipe_grid),
+                                          &now)) && now > limit)
+        limit = now;
+
+    struct upipe_grid_frame *retired[RING_SIZE];
+    unsigned int nb_retired = 0;
+    uint32_t tail = uatomic_load(&ring->tail);
+    uint32_t head = uatomic_load(&ring->head);
+    while (tail != head) {
+        struct upipe_grid_frame *frame = upipe_grid_ring_peek(ring, tail);
+        uint64_t retention = tail + 1 == head ? upipe_grid->max_retention : 0;
+        if (head - tail < RING_SIZE &&
+            upipe_grid_frame_limit(frame, upipe_grid->tolerance) +
+            retention >= limit)
             break;
-        }
 
-        case UPROBE_DEAD: {
-            struct upipe *output = NULL;
-            while (ubase_check(upipe_grid_iterate_output(super, &output)) &&
-                   output)
-                upipe_grid_out_handle_input_removed(output, upipe);
-            break;
-        }
+        upipe_verbose_va(upipe, "drop late frame %"PRIu64, frame->pts);
+        retired[nb_retired++] = frame;
+        tail++;
     }
-    return uprobe_throw_next(uprobe, upipe, event, args);
+
+    if (!nb_retired)
+        return;
+    uatomic_store(&ring->tail, tail);
+    upipe_grid_ring_sync(ring);
+    for (unsigned int i = 0; i < nb_retired; i++)
+        upipe_grid_frame_release(retired[i]);
 }
 
 /** @internal @This handles input buffer from input pipe.
@@ -287,15 +601,7 @@ static void upipe_grid_in_input(struct upipe *upipe,
 {
     struct upipe_grid_in *upipe_grid_in =
         upipe_grid_in_from_upipe(upipe);
-    struct upipe_grid *upipe_grid = upipe_grid_from_in_mgr(upipe->mgr);
-
-    /* handle flow format */
-    if (unlikely(ubase_check(uref_flow_get_def(uref, NULL)))) {
-        upipe_grid_in->latency = 0;
-        uref_clock_get_latency(uref, &upipe_grid_in->latency);
-        ulist_add(&upipe_grid_in->urefs, uref_to_uchain(uref));
-        return;
-    }
+    struct upipe_grid_ring *ring = upipe_grid_in->ring;
 
     if (unlikely(!uref->ubuf)) {
         upipe_warn(upipe, "received empty buffer");
@@ -316,85 +622,39 @@ static void upipe_grid_in_input(struct upipe *upipe,
         return;
     }
 
-    uint64_t rebase_pts = pts + upipe_grid_in->latency;
-    if (rebase_pts + upipe_grid->tolerance < upipe_grid_in->last_update) {
-        upipe_warn_va(upipe, "PTS is too far in the past %"PRIu64"ms",
-                     (upipe_grid_in->last_update - rebase_pts) /
-                     (UCLOCK_FREQ / 1000));
+    if (unlikely(!upipe_grid_in->flow)) {
+        upipe_warn(upipe, "no input flow def set");
         uref_free(uref);
         return;
     }
 
-    upipe_grid_in->last_pts = pts;
-    ulist_add(&upipe_grid_in->urefs, uref_to_uchain(uref));
-
-    uint64_t now;
-    if (unlikely(!ubase_check(
-            upipe_grid_uclock_now(upipe_grid_to_upipe(upipe_grid), &now)))) {
-        upipe_warn(upipe, "no clock set");
+    struct upipe_grid_frame *frame = malloc(sizeof(struct upipe_grid_frame));
+    if (unlikely(!frame)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         return;
     }
+    urefcount_init(upipe_grid_frame_to_urefcount(frame),
+                   upipe_grid_frame_free);
+    frame->uref = uref;
+    frame->flow = upipe_grid_flow_use(upipe_grid_in->flow);
+    frame->pts = pts;
+    upipe_grid_in->last_pts = pts;
 
-    struct uref *last_flow_def = NULL;
-    struct uchain *uchain;
-    uint64_t latency = 0;
-    if (upipe_grid_in->flow_def)
-        uref_clock_get_latency(upipe_grid_in->flow_def, &latency);
-    while ((uchain = ulist_pop(&upipe_grid_in->urefs))) {
-        struct uref *uref = uref_from_uchain(uchain);
-
-        if (unlikely(ubase_check(uref_flow_get_def(uref, NULL)))) {
-            uref_free(last_flow_def);
-            last_flow_def = uref;
-            latency = 0;
-            uref_clock_get_latency(uref, &latency);
-            continue;
-        }
-
-        ubase_assert(uref_clock_get_pts_sys(uref, &pts));
-        uint64_t pts_max = pts + latency + upipe_grid->tolerance;
-        if (pts_max >= now) {
-            ulist_unshift(&upipe_grid_in->urefs, uchain);
-            break;
-        }
+    /* make room for the frame */
+    if (uatomic_load(&ring->head) - uatomic_load(&ring->tail) == RING_SIZE)
+        upipe_grid_in_prune(upipe);
 
-        if (ulist_empty(&upipe_grid_in->urefs) &&
-            pts_max + upipe_grid->max_retention >= now) {
-            ulist_unshift(&upipe_grid_in->urefs, uchain);
-            break;
-        }
+    /* publish */
+    uint32_t head = uatomic_load(&ring->head);
+    uatomic_ptr_store(&ring->frames[head % RING_SIZE], frame);
+    uatomic_store(&ring->head, head + 1);
 
-        upipe_verbose_va(upipe, "drop late frame %"PRIu64"ms, "
-                         "latency %"PRIu64"ms "
-                         "retention %"PRIu64"ms",
-                         (now - pts) / (UCLOCK_FREQ / 1000),
-                         latency / (UCLOCK_FREQ / 1000),
-                         upipe_grid->max_retention / (UCLOCK_FREQ / 1000));
-        uref_free(uref);
-    }
-
-    if (last_flow_def)
-        ulist_unshift(&upipe_grid_in->urefs, uref_to_uchain(last_flow_def));
-}
-
-/** @internal @This sets the input flow def for real.
- * @This applies a flow def pushed by the set flow def control command.
- * @see upipe_grid_in_set_flow_def.
- *
- * @param upipe description structure of the pipe
- * @param flow_def flow format definition
- */
-static void upipe_grid_in_set_flow_def_real(struct upipe *upipe,
-                                            struct uref *flow_def)
-{
-    upipe_grid_in_store_flow_def_input(upipe, flow_def);
-    upipe_throw_new_flow_def(upipe, flow_def);
+    upipe_grid_in_prune(upipe);
 }
 
-/** @internal @This sets a new flow def to a grid input pipe.
- * @This pushes the new flow def into the pipe input to be handled later,
- * i.e. when the flow def will be poped by an output pipe.
- * @See upipe_grid_in_set_flow_def_real, upipe_grid_update_pts
+/** @internal @This sets a new flow def to a grid input pipe. The frames
+ * received afterwards are published with it.
  *
  * @param upipe input pipe description
  * @param flow_def flow format definition
@@ -403,12 +663,25 @@ static void upipe_grid_in_set_flow_def_real(struct upipe *upipe,
 static int upipe_grid_in_set_flow_def(struct upipe *upipe,
                                       struct uref *flow_def)
 {
+    struct upipe_grid_in *upipe_grid_in = upipe_grid_in_from_upipe(upipe);
+
     if (!ubase_check(uref_flow_match_def(flow_def, UREF_PIC_FLOW_DEF)) &&
         !ubase_check(uref_flow_match_def(flow_def, UREF_SOUND_FLOW_DEF)))
         return UBASE_ERR_INVALID;
     struct uref *flow_def_dup = uref_dup(flow_def);
     UBASE_ALLOC_RETURN(flow_def_dup);
-    upipe_grid_in_input(upipe, flow_def_dup, NULL);
+    struct upipe_grid_flow *flow = upipe_grid_flow_alloc(flow_def_dup);
+    UBASE_ALLOC_RETURN(flow);
+    flow_def_dup = uref_dup(flow_def);
+    if (unlikely(!flow_def_dup)) {
+        upipe_grid_flow_release(flow);
+        return UBASE_ERR_ALLOC;
+    }
+
+    upipe_grid_flow_release(upipe_grid_in->flow);
+    upipe_grid_in->flow = flow;
+    upipe_grid_in_store_flow_def_input(upipe, flow_def_dup);
+    upipe_throw_new_flow_def(upipe, flow_def_dup);
     return UBASE_ERR_NONE;
 }
 
@@ -428,80 +701,6 @@ static int upipe_grid_in_get_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This removes all past urefs from an input pipe.
- *
- * @param upipe description structure of the input pipe
- * @param next_pts new ptr reference
- */
-static void upipe_grid_in_update_pts(struct upipe *upipe, uint64_t next_pts)
-{
-    struct upipe_grid_in *upipe_grid_in = upipe_grid_in_from_upipe(upipe);
-    struct upipe_grid *upipe_grid = upipe_grid_from_in_mgr(upipe->mgr);
-    struct uref *flow_def = upipe_grid_in->flow_def;
-    uint64_t latency = 0;
-
-    upipe_verbose_va(upipe, "update PTS %"PRIu64, next_pts);
-
-    if (upipe_grid_in->last_update &&
-        upipe_grid_in->next_update &&
-        upipe_grid_in->last_update + upipe_grid_in->next_update >= next_pts)
-        return;
-
-    /* get current input latency */
-    if (flow_def)
-        uref_clock_get_latency(flow_def, &latency);
-
-    /* iterate through the input buffers */
-    struct uchain *uchain, *uchain_tmp;
-    ulist_delete_foreach(&upipe_grid_in->urefs, uchain, uchain_tmp) {
-        struct uref *uref = uref_from_uchain(uchain);
-
-        /* if this is a new flow def, apply it and continue */
-        if (unlikely(ubase_check(uref_flow_get_def(uref, NULL)))) {
-            ulist_delete(uchain);
-            upipe_grid_in_set_flow_def_real(upipe, uref);
-            /* update current input latency */
-            flow_def = upipe_grid_in->flow_def;
-            latency = 0;
-            uref_clock_get_latency(flow_def, &latency);
-            continue;
-        }
-
-        if (unlikely(!flow_def)) {
-            /* no input flow definition set, drop */
-            upipe_warn(upipe, "no input flow def set");
-            ulist_delete(uchain);
-            uref_free(uref);
-            continue;
-        }
-
-        /* if late buffer, free it and continue */
-        uint64_t pts;
-        /* checked in upipe_grid_in_input */
-        ubase_assert(uref_clock_get_pts_sys(uref, &pts));
-
-        uint64_t retention = ulist_is_last(&upipe_grid_in->urefs, uchain) ?
-            upipe_grid->max_retention : 0;
-
-        if (pts + latency + upipe_grid->tolerance + retention < next_pts) {
-            upipe_verbose_va(upipe, "drop uref pts %"PRIu64, pts);
-            ulist_delete(uchain);
-            uref_free(uref);
-            continue;
-        }
-
-        upipe_grid_in->next_update = 0;
-        if (pts + latency + upipe_grid->tolerance > next_pts)
-            upipe_grid_in->next_update =
-                pts + latency + upipe_grid->tolerance - next_pts;
-
-        /* remaining buffers are up to date,.. */
-        break;
-    }
-
-    upipe_grid_in->last_update = next_pts;
-}
-
 /** @internal @This handles grid input controls.
  *
  * @param upipe input pipe description
@@ -535,10 +734,18 @@ static int upipe_grid_in_control(struct upipe *upipe,
  */
 static void upipe_grid_out_free(struct upipe *upipe)
 {
+    struct upipe_grid_out *upipe_grid_out = upipe_grid_out_from_upipe(upipe);
+    struct upipe_grid *upipe_grid = upipe_grid_from_out_mgr(upipe->mgr);
+
     upipe_throw_dead(upipe);
 
+    if (upipe_grid_out->ring)
+        urefcount_release(upipe_grid_ring_to_urefcount(upipe_grid_out->ring));
+    upipe_grid_flow_release(upipe_grid_out->flow);
     upipe_grid_out_clean_flow_def(upipe);
+    upipe_grid_lock(upipe_grid);
     upipe_grid_out_clean_sub(upipe);
+    upipe_grid_unlock(upipe_grid);
     upipe_grid_out_clean_output(upipe);
     upipe_grid_out_clean_urefcount(upipe);
 
@@ -563,18 +770,22 @@ static struct upipe *upipe_grid_out_alloc(struct upipe_mgr *mgr,
     if (unlikely(!upipe))
         return NULL;
 
+    struct upipe_grid *upipe_grid = upipe_grid_from_out_mgr(mgr);
     upipe_grid_out_init_urefcount(upipe);
     upipe_grid_out_init_output(upipe);
+    upipe_grid_lock(upipe_grid);
     upipe_grid_out_init_sub(upipe);
+    upipe_grid_unlock(upipe_grid);
     upipe_grid_out_init_flow_def(upipe);
 
     struct upipe_grid_out *upipe_grid_out =
         upipe_grid_out_from_upipe(upipe);
 
-    ulist_init(&upipe_grid_out->inputs);
     upipe_grid_out->flow_def_uptodate = false;
     upipe_grid_out->flow_def_input = false;
     upipe_grid_out->input = NULL;
+    upipe_grid_out->ring = NULL;
+    upipe_grid_out->flow = NULL;
     upipe_grid_out->tolerance = DEFAULT_TOLERANCE;
     upipe_grid_out->last_input_pts = UINT64_MAX;
 
@@ -691,29 +902,17 @@ static int upipe_grid_out_throw_update_pts(struct upipe *upipe, uint64_t pts)
                        UPIPE_GRID_OUT_SIGNATURE, pts);
 }
 
-/** @internal @This extracts picture data from selected input pipe.
+/** @internal @This extracts picture data from a frame.
  *
  * @param upipe description structure of the output pipe
  * @param uref picture buffer filled with input picture data
+ * @param frame frame of the selected input
  * @return an error code
  */
-static int upipe_grid_out_extract_pic(struct upipe *upipe, struct uref *uref)
+static int upipe_grid_out_extract_pic(struct upipe *upipe, struct uref *uref,
+                                      struct upipe_grid_frame *frame)
 {
-    struct upipe_grid_out *upipe_grid_out = upipe_grid_out_from_upipe(upipe);
-    struct upipe_grid_in *upipe_grid_in =
-        upipe_grid_in_from_upipe(upipe_grid_out->input);
-
-    uint64_t pts = 0;
-    /* checked in upipe_grid_out_input */
-    ubase_assert(uref_clock_get_pts_sys(uref, &pts));
-
-    /* get first picture */
-    struct uchain *uchain = ulist_peek(&upipe_grid_in->urefs);
-    if (unlikely(!uchain)) {
-        upipe_warn(upipe, "no input buffer available");
-        return UBASE_ERR_INVALID;
-    }
-    struct uref *input_uref = uref_from_uchain(uchain);
+    struct uref *input_uref = frame->uref;
 
     /* duplicate picture buffer */
     struct ubuf *ubuf = ubuf_dup(input_uref->ubuf);
@@ -729,35 +928,24 @@ static int upipe_grid_out_extract_pic(struct upipe *upipe, struct uref *uref)
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This extracts sound data from selected input pipe to an uref.
+/** @internal @This extracts sound data from a frame to an uref.
  *
  * @param upipe description structure of the output pipe
  * @param uref sound buffer filled with input sound data
+ * @param frame frame of the selected input
  * @return an error code
  */
-static int upipe_grid_out_extract_sound(struct upipe *upipe, struct uref *uref)
+static int upipe_grid_out_extract_sound(struct upipe *upipe, struct uref *uref,
+                                        struct upipe_grid_frame *frame)
 {
     struct upipe_grid_out *upipe_grid_out = upipe_grid_out_from_upipe(upipe);
-    struct upipe_grid_in *upipe_grid_in =
-        upipe_grid_in_from_upipe(upipe_grid_out->input);
-    struct uref *input_flow_def = upipe_grid_in->flow_def;
+    struct uref *input_uref = frame->uref;
     uint64_t next_pts;
 
-    /* checked before */
-    assert(input_flow_def);
     /* checked before */
     ubase_assert(uref_clock_get_pts_sys(uref, &next_pts));
 
-    struct uchain *uchain = ulist_peek(&upipe_grid_in->urefs);
-    if (unlikely(!uchain)) {
-        upipe_warn(upipe, "no input buffer available");
-        return UBASE_ERR_INVALID;
-    }
-    struct uref *input_uref = uref_from_uchain(uchain);
-
-    uint64_t input_pts;
-    /* checked before */
-    ubase_assert(uref_clock_get_pts_sys(input_uref, &input_pts));
+    uint64_t input_pts = frame->pts;
     if (input_pts > next_pts + upipe_grid_out->tolerance) {
         upipe_dbg(upipe, "next input in the futur");
         return UBASE_ERR_INVALID;
@@ -788,28 +976,99 @@ static int upipe_grid_out_extract_sound(struct upipe *upipe, struct uref *uref)
 static int upipe_grid_out_extract_input(struct upipe *upipe, struct uref *uref)
 {
     struct upipe_grid_out *upipe_grid_out = upipe_grid_out_from_upipe(upipe);
+    struct upipe_grid *upipe_grid = upipe_grid_from_out_mgr(upipe->mgr);
 
-    if (!upipe_grid_out->input) {
+    if (!upipe_grid_out->ring) {
         upipe_verbose(upipe, "no input set");
         return UBASE_ERR_INVALID;
     }
 
-    struct upipe_grid_in *upipe_grid_in =
-        upipe_grid_in_from_upipe(upipe_grid_out->input);
-    struct uref *input_flow_def = upipe_grid_in->flow_def;
-    if (unlikely(!input_flow_def))
+    uint64_t pts = 0;
+    /* checked in upipe_grid_out_input */
+    ubase_assert(uref_clock_get_pts_sys(uref, &pts));
+
+    struct upipe_grid_frame *frame =
+        upipe_grid_ring_find(upipe_grid_out->ring, pts,
+                             upipe_grid->tolerance,
+                             upipe_grid->max_retention);
+    if (unlikely(!frame)) {
+        upipe_warn(upipe, "no input buffer available");
         return UBASE_ERR_INVALID;
+    }
+
+    if (frame->flow != upipe_grid_out->flow) {
+        upipe_grid_flow_release(upipe_grid_out->flow);
+        upipe_grid_out->flow = upipe_grid_flow_use(frame->flow);
+        upipe_grid_out->flow_def_uptodate = false;
+    }
 
+    int ret = UBASE_ERR_UNHANDLED;
+    struct uref *input_flow_def = frame->flow->flow_def;
     if (ubase_check(uref_flow_match_def(input_flow_def, UREF_PIC_FLOW_DEF)))
-        return upipe_grid_out_extract_pic(upipe, uref);
+        ret = upipe_grid_out_extract_pic(upipe, uref, frame);
     else if (ubase_check(uref_flow_match_def(input_flow_def,
                                              UREF_SOUND_FLOW_DEF)))
-        return upipe_grid_out_extract_sound(upipe, uref);
+        ret = upipe_grid_out_extract_sound(upipe, uref, frame);
+    else {
+        const char *def = "(none)";
+        uref_flow_get_def(input_flow_def, &def);
+        upipe_warn_va(upipe, "invalid input %s", def);
+    }
 
-    const char *def = "(none)";
-    uref_flow_get_def(input_flow_def, &def);
-    upipe_warn_va(upipe, "invalid input %s", def);
-    return UBASE_ERR_UNHANDLED;
+    upipe_grid_frame_release(frame);
+    return ret;
+}
+
+/** @internal @This set the grid output input pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param input description of the input pipe to set
+ * @return an error code
+ */
+static int upipe_grid_out_set_input_real(struct upipe *upipe,
+                                         struct upipe *input)
+{
+    struct upipe_grid_out *upipe_grid_out =
+        upipe_grid_out_from_upipe(upipe);
+    struct upipe_grid *upipe_grid = upipe_grid_from_out_mgr(upipe->mgr);
+
+    upipe_notice_va(upipe, "switch input %p -> %p",
+                    upipe_grid_out->input, input);
+    if (upipe_grid_out->ring)
+        urefcount_release(upipe_grid_ring_to_urefcount(upipe_grid_out->ring));
+    upipe_grid_out->ring = NULL;
+
+    /* the input may be released concurrently */
+    upipe_grid_lock(upipe_grid);
+    struct uchain *uchain;
+    ulist_foreach(&upipe_grid->inputs, uchain) {
+        struct upipe_grid_in *upipe_grid_in =
+            upipe_grid_in_from_uchain(uchain);
+        if (upipe_grid_in_to_upipe(upipe_grid_in) == input) {
+            upipe_grid_out->ring = upipe_grid_in->ring;
+            urefcount_use(upipe_grid_ring_to_urefcount(upipe_grid_out->ring));
+            break;
+        }
+    }
+    upipe_grid_unlock(upipe_grid);
+    upipe_grid_out->input = upipe_grid_out->ring ? input : NULL;
+    upipe_grid_out->flow_def_uptodate = false;
+    upipe_grid_out->last_input_pts = UINT64_MAX;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This checks that the selected input was not released.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_grid_out_check_input(struct upipe *upipe)
+{
+    struct upipe_grid_out *upipe_grid_out =
+        upipe_grid_out_from_upipe(upipe);
+
+    if (unlikely(upipe_grid_out->ring &&
+                 uatomic_load(&upipe_grid_out->ring->closed)))
+        upipe_grid_out_set_input_real(upipe, NULL);
 }
 
 /** @internal @This handles grid output pipe input buffers.
@@ -844,14 +1103,13 @@ static void upipe_grid_out_input(struct upipe *upipe,
     /* notify new received pts */
     upipe_grid_out_throw_update_pts(upipe, pts);
 
-    if (unlikely(!upipe_grid_out->input)) {
+    upipe_grid_out_check_input(upipe);
+    if (unlikely(!upipe_grid_out->ring)) {
         upipe_verbose(upipe, "no input set");
         goto output;
     }
 
     /* extract from current input */
-    struct upipe_grid_in *upipe_grid_in =
-        upipe_grid_in_from_upipe(upipe_grid_out->input);
     int ret = upipe_grid_out_extract_input(upipe, uref);
     if (unlikely(!ubase_check(ret)))
         goto output;
@@ -872,7 +1130,7 @@ output:
         if (sub_attached) {
             /* import input flow def */
             upipe_grid_out_import_format(
-                upipe, flow_def, upipe_grid_in->flow_def);
+                upipe, flow_def, upipe_grid_out->flow->flow_def);
         }
 
         /* store new flow def */
@@ -905,26 +1163,6 @@ static int upipe_grid_out_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-/** @internal @This set the grid output input pipe.
- *
- * @param upipe description structure of the pipe
- * @param input description of the input pipe to set
- * @return an error code
- */
-static int upipe_grid_out_set_input_real(struct upipe *upipe,
-                                         struct upipe *input)
-{
-    struct upipe_grid_out *upipe_grid_out =
-        upipe_grid_out_from_upipe(upipe);
-
-    upipe_notice_va(upipe, "switch input %p -> %p",
-                    upipe_grid_out->input, input);
-    upipe_grid_out->input = input;
-    upipe_grid_out->flow_def_uptodate = false;
-    upipe_grid_out->last_input_pts = UINT64_MAX;
-    return UBASE_ERR_NONE;
-}
-
 /** @internal @This gets the grid output input pipe.
  *
  * @param upipe description structure of the pipe
@@ -936,6 +1174,7 @@ static int upipe_grid_out_get_input_real(struct upipe *upipe,
 {
     struct upipe_grid_out *upipe_grid_out =
         upipe_grid_out_from_upipe(upipe);
+    upipe_grid_out_check_input(upipe);
     if (input_p)
         *input_p = upipe_grid_out->input;
     return UBASE_ERR_NONE;
@@ -952,37 +1191,10 @@ static int upipe_grid_out_iterate_input_real(struct upipe *upipe,
 {
     struct upipe_grid *upipe_grid = upipe_grid_from_out_mgr(upipe->mgr);
     struct upipe *super = upipe_grid_to_upipe(upipe_grid);
-    return upipe_grid_iterate_input(super, input_p);
-}
-
-/** @internal @This handles an input changed.
- *
- * @param upipe output pipe description
- * @param input input pipe description
- */
-static void upipe_grid_out_handle_input_changed(struct upipe *upipe,
-                                                struct upipe *input)
-{
-    struct upipe_grid_out *upipe_grid_out =
-        upipe_grid_out_from_upipe(upipe);
-
-    if (unlikely(upipe_grid_out->input == input))
-        upipe_grid_out->flow_def_uptodate = false;
-}
-
-/** @internal @This is called when an input pipe is removed.
- *
- * @param upipe output pipe description
- * @param input input pipe description
- */
-static void upipe_grid_out_handle_input_removed(struct upipe *upipe,
-                                                struct upipe *input)
-{
-    struct upipe_grid_out *upipe_grid_out =
-        upipe_grid_out_from_upipe(upipe);
-
-    if (unlikely(upipe_grid_out->input == input))
-        upipe_grid_out_set_input_real(upipe, NULL);
+    upipe_grid_lock(upipe_grid);
+    int ret = upipe_grid_iterate_input(super, input_p);
+    upipe_grid_unlock(upipe_grid);
+    return ret;
 }
 
 /** @internal @This handles control commands of the grid outputs.
@@ -1095,6 +1307,7 @@ static void upipe_grid_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     upipe_grid_clean_uclock(upipe);
+    uatomic_clean(&upipe_grid_from_upipe(upipe)->lock);
     upipe_grid_clean_sub_outputs(upipe);
     upipe_grid_clean_sub_inputs(upipe);
     upipe_grid_clean_urefcount(upipe);
@@ -1139,6 +1352,8 @@ static struct upipe *upipe_grid_alloc(struct upipe_mgr *mgr,
     struct upipe_grid *upipe_grid = upipe_grid_from_upipe(upipe);
     upipe_grid->tolerance = DEFAULT_TOLERANCE;
     upipe_grid->max_retention = MAX_RETENTION;
+    upipe_grid->next_pts = 0;
+    uatomic_init(&upipe_grid->lock, 0);
 
     upipe_throw_ready(upipe);
 
@@ -1184,8 +1399,14 @@ static int upipe_grid_set_max_retention_real(struct upipe *upipe,
 static int upipe_grid_control(struct upipe *upipe,
                               int command, va_list args)
 {
-    UBASE_HANDLED_RETURN(upipe_grid_control_inputs(upipe, command, args));
-    UBASE_HANDLED_RETURN(upipe_grid_control_outputs(upipe, command, args));
+    struct upipe_grid *upipe_grid = upipe_grid_from_upipe(upipe);
+    upipe_grid_lock(upipe_grid);
+    int ret = upipe_grid_control_inputs(upipe, command, args);
+    if (ret == UBASE_ERR_UNHANDLED)
+        ret = upipe_grid_control_outputs(upipe, command, args);
+    upipe_grid_unlock(upipe_grid);
+    if (ret != UBASE_ERR_UNHANDLED)
+        return ret;
 
     switch (command) {
         case UPIPE_ATTACH_UCLOCK:
@@ -1208,7 +1429,8 @@ static int upipe_grid_control(struct upipe *upipe,
     return UBASE_ERR_UNHANDLED;
 }
 
-/** @internal @This removes all past urefs from input pipes.
+/** @internal @This records the PTS requested by an output, so that the
+ * inputs remove the past frames from their rings.
  *
  * @param upipe description structure of the pipe
  * @param next_pts new pts reference
@@ -1216,10 +1438,12 @@ static int upipe_grid_control(struct upipe *upipe,
  */
 static int upipe_grid_update_pts(struct upipe *upipe, uint64_t next_pts)
 {
-    /* iterate through the input pipes */
-    struct upipe *in = NULL;
-    while (ubase_check(upipe_grid_iterate_input(upipe, &in)) && in)
-        upipe_grid_in_update_pts(in, next_pts);
+    struct upipe_grid *upipe_grid = upipe_grid_from_upipe(upipe);
+    uint64_t pts = __atomic_load_n(&upipe_grid->next_pts, __ATOMIC_RELAXED);
+    while (pts < next_pts &&
+           !__atomic_compare_exchange_n(&upipe_grid->next_pts, &pts, next_pts,
+                                        true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED));
     return UBASE_ERR_NONE;
 }
 
@@ -1233,8 +1457,7 @@ struct upipe *upipe_grid_alloc_input(struct upipe *upipe,
                                      struct uprobe *uprobe)
 {
     struct upipe_grid *upipe_grid = upipe_grid_from_upipe(upipe);
-    return upipe_void_alloc(&upipe_grid->in_mgr,
-                            uprobe_alloc(upipe_grid_in_catch, uprobe));
+    return upipe_void_alloc(&upipe_grid->in_mgr, uprobe);
 }
 
 /** @This allocates a new grid output.
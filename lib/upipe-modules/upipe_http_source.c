@@ -39,6 +39,7 @@
 #include <upipe/uref_uri.h>
 #include <upipe/upump.h>
 #include <upipe/ubuf.h>
+#include <upipe/ueventfd.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -64,19 +65,31 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <assert.h>
 
 #include "http-parser/http_parser.h"
 
-/** default size of buffers when unspecified */
-#define UBUF_DEFAULT_SIZE       4096
+/** default size of output buffers when unspecified, a multiple of the
+ * transport stream packet size */
+#define UBUF_DEFAULT_SIZE       (188 * 7 * 4)
+/** minimum size of the receive buffers */
+#define RECV_BUFFER_SIZE        (128 * 1024)
 
 #define MAX_URL_SIZE            2048
 #define HTTP_VERSION            "HTTP/1.1"
 #define USER_AGENT              "upipe_http_src"
 #define TIMEOUT                 (5 * 27000000) /* 5s */
+/** maximum number of resolved addresses kept for a peer */
+#define MAX_ADDRS               8
+/** default maximum number of cached name resolutions */
+#define DNS_CACHE_SIZE          64
+/** default lifetime of a cached name resolution */
+#define DNS_CACHE_TTL           (60 * UCLOCK_FREQ)
 
 struct http_range {
     uint64_t offset;
@@ -94,14 +107,442 @@ struct upipe_http_src_cookie {
 
 UBASE_FROM_TO(upipe_http_src_cookie, uchain, uchain, uchain)
 
+/** @internal @This describes a resolved address. */
+struct upipe_http_src_addr {
+    /** socket family */
+    int family;
+    /** socket type */
+    int socktype;
+    /** socket protocol */
+    int protocol;
+    /** address length */
+    socklen_t addrlen;
+    /** address */
+    struct sockaddr_storage addr;
+};
+
+/** @internal @This is a cached name resolution. */
+struct upipe_http_src_host {
+    /** attach to the manager list */
+    struct uchain uchain;
+    /** host and service */
+    char *peer;
+    /** date after which the resolution is done again */
+    uint64_t expires;
+    /** number of resolved addresses */
+    unsigned int nb_addrs;
+    /** resolved addresses */
+    struct upipe_http_src_addr addrs[MAX_ADDRS];
+};
+
+UBASE_FROM_TO(upipe_http_src_host, uchain, uchain, uchain)
+
+/** @internal @This is a name resolution running on its own thread, so that
+ * the event loop is not blocked. */
+struct upipe_http_src_lookup {
+    /** host name */
+    char *host;
+    /** service name or port */
+    char *service;
+    /** signals the end of the resolution to the pipe thread */
+    struct ueventfd ueventfd;
+    /** protects the fields below */
+    pthread_mutex_t mutex;
+    /** true once the resolution is over */
+    bool done;
+    /** true if the pipe no longer waits for the result */
+    bool abandoned;
+    /** return value of getaddrinfo */
+    int ret;
+    /** resolved addresses */
+    struct addrinfo *info;
+};
+
+/** @internal @This is an idle connection kept for reuse. */
+struct upipe_http_src_conn {
+    /** attach to the manager list */
+    struct uchain uchain;
+    /** host and service */
+    char *peer;
+    /** socket descriptor */
+    int fd;
+};
+
+UBASE_FROM_TO(upipe_http_src_conn, uchain, uchain, uchain)
+
+/** @internal @This is the private context of a http source manager. */
+struct upipe_http_src_mgr {
+    /** upipe manager */
+    struct upipe_mgr upipe_mgr;
+    /** urefcount structure */
+    struct urefcount urefcount;
+    /** cookie list */
+    struct uchain cookies;
+    /** proxy url */
+    char *proxy;
+    /** maximum number of idle connections */
+    unsigned int max_idle;
+    /** number of idle connections */
+    unsigned int nb_idle;
+    /** list of idle connections, oldest first */
+    struct uchain idle;
+    /** list of cached name resolutions, oldest first */
+    struct uchain hosts;
+    /** number of cached name resolutions */
+    unsigned int nb_hosts;
+    /** maximum number of cached name resolutions */
+    unsigned int max_hosts;
+    /** lifetime of a cached name resolution */
+    uint64_t hosts_ttl;
+};
+
+UBASE_FROM_TO(upipe_http_src_mgr, upipe_mgr, upipe_mgr, upipe_mgr)
+UBASE_FROM_TO(upipe_http_src_mgr, urefcount, urefcount, urefcount);
+
+/** @internal @This closes the oldest idle connections above a limit.
+ *
+ * @param upipe_http_src_mgr private structure of the manager
+ * @param max_idle maximum number of idle connections to keep
+ */
+static void upipe_http_src_mgr_trim_idle(
+        struct upipe_http_src_mgr *upipe_http_src_mgr,
+        unsigned int max_idle)
+{
+    struct uchain *uchain;
+    while (upipe_http_src_mgr->nb_idle > max_idle &&
+           (uchain = ulist_pop(&upipe_http_src_mgr->idle)) != NULL) {
+        struct upipe_http_src_conn *conn =
+            upipe_http_src_conn_from_uchain(uchain);
+        ubase_clean_fd(&conn->fd);
+        free(conn->peer);
+        free(conn);
+        upipe_http_src_mgr->nb_idle--;
+    }
+}
+
+/** @internal @This gives an idle connection to the manager for reuse.
+ *
+ * @param mgr pointer to upipe manager
+ * @param peer host and service of the connection
+ * @param fd socket descriptor of the connection
+ * @return false if the connection was not kept
+ */
+static bool upipe_http_src_mgr_put_conn(struct upipe_mgr *mgr,
+                                        const char *peer, int fd)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+
+    if (!upipe_http_src_mgr->max_idle)
+        return false;
+
+    struct upipe_http_src_conn *conn = malloc(sizeof (*conn));
+    if (unlikely(conn == NULL))
+        return false;
+    conn->peer = strdup(peer);
+    if (unlikely(conn->peer == NULL)) {
+        free(conn);
+        return false;
+    }
+    conn->fd = fd;
+    ulist_add(&upipe_http_src_mgr->idle, upipe_http_src_conn_to_uchain(conn));
+    upipe_http_src_mgr->nb_idle++;
+    upipe_http_src_mgr_trim_idle(upipe_http_src_mgr,
+                                 upipe_http_src_mgr->max_idle);
+    return true;
+}
+
+/** @internal @This takes an idle connection to a peer from the manager.
+ *
+ * @param mgr pointer to upipe manager
+ * @param peer host and service to connect to
+ * @return a connected socket descriptor, or -1
+ */
+static int upipe_http_src_mgr_get_conn(struct upipe_mgr *mgr,
+                                       const char *peer)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach_reverse(&upipe_http_src_mgr->idle,
+                                 uchain, uchain_tmp) {
+        struct upipe_http_src_conn *conn =
+            upipe_http_src_conn_from_uchain(uchain);
+        if (strcmp(conn->peer, peer))
+            continue;
+
+        ulist_delete(uchain);
+        upipe_http_src_mgr->nb_idle--;
+        int fd = conn->fd;
+        free(conn->peer);
+        free(conn);
+
+        /* the server may have closed the connection in the meantime */
+        char c;
+        if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK))
+            return fd;
+        ubase_clean_fd(&fd);
+    }
+    return -1;
+}
+
+/** @internal @This returns the date used for the expiry of the cached name
+ * resolutions.
+ *
+ * @return monotonic date in units of UCLOCK_FREQ
+ */
+static uint64_t upipe_http_src_mgr_now(void)
+{
+    struct timespec ts;
+    if (unlikely(clock_gettime(CLOCK_MONOTONIC, &ts) < 0))
+        return 0;
+    return (uint64_t)ts.tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @internal @This removes a cached name resolution.
+ *
+ * @param upipe_http_src_mgr private structure of the manager
+ * @param host cached name resolution
+ */
+static void upipe_http_src_mgr_delete_host(
+        struct upipe_http_src_mgr *upipe_http_src_mgr,
+        struct upipe_http_src_host *host)
+{
+    ulist_delete(upipe_http_src_host_to_uchain(host));
+    upipe_http_src_mgr->nb_hosts--;
+    free(host->peer);
+    free(host);
+}
+
+/** @internal @This removes the oldest cached name resolutions above a
+ * limit.
+ *
+ * @param upipe_http_src_mgr private structure of the manager
+ * @param max_hosts maximum number of cached name resolutions to keep
+ */
+static void upipe_http_src_mgr_trim_hosts(
+        struct upipe_http_src_mgr *upipe_http_src_mgr,
+        unsigned int max_hosts)
+{
+    struct uchain *uchain;
+    while (upipe_http_src_mgr->nb_hosts > max_hosts &&
+           (uchain = ulist_peek(&upipe_http_src_mgr->hosts)) != NULL)
+        upipe_http_src_mgr_delete_host(upipe_http_src_mgr,
+                upipe_http_src_host_from_uchain(uchain));
+}
+
+/** @internal @This finds a cached name resolution, and removes the expired
+ * ones.
+ *
+ * @param mgr pointer to upipe manager
+ * @param peer host and service to find
+ * @return a pointer to the cached resolution, or NULL
+ */
+static struct upipe_http_src_host *
+    upipe_http_src_mgr_find_host(struct upipe_mgr *mgr, const char *peer)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+    uint64_t now = upipe_http_src_mgr_now();
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach(&upipe_http_src_mgr->hosts, uchain, uchain_tmp) {
+        struct upipe_http_src_host *host =
+            upipe_http_src_host_from_uchain(uchain);
+        if (now >= host->expires)
+            upipe_http_src_mgr_delete_host(upipe_http_src_mgr, host);
+        else if (!strcmp(host->peer, peer))
+            return host;
+    }
+    return NULL;
+}
+
+/** @internal @This caches a name resolution.
+ *
+ * @param mgr pointer to upipe manager
+ * @param peer host and service
+ * @param addrs resolved addresses
+ * @param nb_addrs number of resolved addresses
+ */
+static void upipe_http_src_mgr_cache_host(struct upipe_mgr *mgr,
+        const char *peer, const struct upipe_http_src_addr *addrs,
+        unsigned int nb_addrs)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+    if (!upipe_http_src_mgr->max_hosts || !nb_addrs)
+        return;
+
+    struct upipe_http_src_host *host = malloc(sizeof (*host));
+    if (unlikely(host == NULL))
+        return;
+    host->peer = strdup(peer);
+    if (unlikely(host->peer == NULL)) {
+        free(host);
+        return;
+    }
+    host->expires = upipe_http_src_mgr_now() + upipe_http_src_mgr->hosts_ttl;
+    memcpy(host->addrs, addrs, nb_addrs * sizeof (*addrs));
+    host->nb_addrs = nb_addrs;
+    ulist_add(&upipe_http_src_mgr->hosts,
+              upipe_http_src_host_to_uchain(host));
+    upipe_http_src_mgr->nb_hosts++;
+    upipe_http_src_mgr_trim_hosts(upipe_http_src_mgr,
+                                  upipe_http_src_mgr->max_hosts);
+}
+
+/** @internal @This removes a cached name resolution, so that the next
+ * connection resolves the name again.
+ *
+ * @param mgr pointer to upipe manager
+ * @param peer host and service to forget
+ */
+static void upipe_http_src_mgr_forget_host(struct upipe_mgr *mgr,
+                                           const char *peer)
+{
+    struct upipe_http_src_host *host = upipe_http_src_mgr_find_host(mgr, peer);
+    if (host == NULL)
+        return;
+    upipe_http_src_mgr_delete_host(upipe_http_src_mgr_from_upipe_mgr(mgr),
+                                   host);
+}
+
+/** @internal @This frees a name resolution.
+ *
+ * @param lookup name resolution
+ */
+static void upipe_http_src_lookup_free(struct upipe_http_src_lookup *lookup)
+{
+    if (lookup->info != NULL)
+        freeaddrinfo(lookup->info);
+    ueventfd_clean(&lookup->ueventfd);
+    pthread_mutex_destroy(&lookup->mutex);
+    free(lookup->host);
+    free(lookup->service);
+    free(lookup);
+}
+
+/** @internal @This is the thread resolving a name.
+ *
+ * @param _lookup name resolution
+ * @return NULL
+ */
+static void *upipe_http_src_lookup_run(void *_lookup)
+{
+    struct upipe_http_src_lookup *lookup = _lookup;
+    struct addrinfo *info = NULL;
+    struct addrinfo hints;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = 0;
+    int ret = getaddrinfo(lookup->host, lookup->service, &hints, &info);
+
+    pthread_mutex_lock(&lookup->mutex);
+    lookup->done = true;
+    lookup->ret = ret;
+    lookup->info = ret ? NULL : info;
+    bool abandoned = lookup->abandoned;
+    if (!abandoned)
+        ueventfd_write(&lookup->ueventfd);
+    pthread_mutex_unlock(&lookup->mutex);
+
+    if (abandoned)
+        upipe_http_src_lookup_free(lookup);
+    return NULL;
+}
+
+/** @internal @This starts a name resolution on a new thread.
+ *
+ * @param host host name
+ * @param service service name or port
+ * @return a pointer to the name resolution, or NULL in case of error
+ */
+static struct upipe_http_src_lookup *
+    upipe_http_src_lookup_start(const char *host, const char *service)
+{
+    struct upipe_http_src_lookup *lookup = malloc(sizeof (*lookup));
+    if (unlikely(lookup == NULL))
+        return NULL;
+    lookup->host = strdup(host);
+    lookup->service = strdup(service);
+    lookup->done = false;
+    lookup->abandoned = false;
+    lookup->ret = 0;
+    lookup->info = NULL;
+    if (unlikely(lookup->host == NULL || lookup->service == NULL ||
+                 !ueventfd_init(&lookup->ueventfd, false))) {
+        free(lookup->host);
+        free(lookup->service);
+        free(lookup);
+        return NULL;
+    }
+    pthread_mutex_init(&lookup->mutex, NULL);
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, upipe_http_src_lookup_run,
+                             lookup);
+    pthread_attr_destroy(&attr);
+    if (unlikely(err)) {
+        upipe_http_src_lookup_free(lookup);
+        return NULL;
+    }
+    return lookup;
+}
+
+/** @internal @This gives up a name resolution. It is freed by its thread
+ * if it is still running.
+ *
+ * @param lookup name resolution
+ */
+static void upipe_http_src_lookup_abandon(struct upipe_http_src_lookup *lookup)
+{
+    pthread_mutex_lock(&lookup->mutex);
+    bool done = lookup->done;
+    lookup->abandoned = true;
+    pthread_mutex_unlock(&lookup->mutex);
+    if (done)
+        upipe_http_src_lookup_free(lookup);
+}
+
 /** @hidden */
 static int upipe_http_src_check(struct upipe *upipe, struct uref *flow_format);
+/** @hidden */
+static void upipe_http_src_retry(struct upipe *upipe);
+/** @hidden */
+static void upipe_http_src_worker_lookup(struct upump *upump);
 
 struct header {
     const char *value;
     size_t len;
 };
 
+/** @internal @This is a receive buffer. Slices of the decoded body are
+ * output without copy, so the buffer is mapped once when allocated and
+ * only written past the octets already received, which are never part of
+ * an output slice. */
+struct upipe_http_src_buffer {
+    /** buffer */
+    struct ubuf *ubuf;
+    /** mapped buffer */
+    uint8_t *data;
+    /** size of the buffer */
+    size_t size;
+    /** number of octets received */
+    size_t fill;
+    /** offset of the body not yet output */
+    size_t body_start;
+    /** offset of the end of the decoded body */
+    size_t body_end;
+};
+
 #define HEADER(Value, Len) \
     (struct header){ .value = Value, .len = Len }
 
@@ -140,17 +581,39 @@ struct upipe_http_src {
     struct upump_mgr *upump_mgr;
     /** read watcher */
     struct upump *upump;
-    /** read size */
+    /** output size */
     unsigned int output_size;
+    /** receive buffers, the first one being filled */
+    struct upipe_http_src_buffer buffers[2];
+    /** system date of the last read */
+    uint64_t systime;
     /** write watcher */
     struct upump *upump_write;
     /** timeout watcher */
     struct upump *upump_timeout;
+    /** name resolution watcher */
+    struct upump *upump_lookup;
 
     /** socket descriptor */
     int fd;
     /** a request is pending */
     bool request_pending;
+    /** host and service of the connection */
+    char *peer;
+    /** resolved addresses of the peer */
+    struct upipe_http_src_addr addrs[MAX_ADDRS];
+    /** number of resolved addresses */
+    unsigned int nb_addrs;
+    /** index of the address being connected */
+    unsigned int addr_idx;
+    /** pending name resolution, or NULL */
+    struct upipe_http_src_lookup *lookup;
+    /** a non-blocking connection is in progress */
+    bool connecting;
+    /** the connection was reused from the manager */
+    bool reused;
+    /** number of bytes received on the connection */
+    uint64_t received;
     /** http url */
     char *url;
 
@@ -200,6 +663,7 @@ UPIPE_HELPER_UPUMP(upipe_http_src, upump, upump_mgr)
 UPIPE_HELPER_OUTPUT_SIZE(upipe_http_src, output_size)
 UPIPE_HELPER_UPUMP(upipe_http_src, upump_write, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_http_src, upump_timeout, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_http_src, upump_lookup, upump_mgr)
 
 static int upipe_http_src_header_field(http_parser *parser,
                                        const char *at,
@@ -235,12 +699,22 @@ static struct upipe *upipe_http_src_alloc(struct upipe_mgr *mgr,
     upipe_http_src_init_upump(upipe);
     upipe_http_src_init_upump_write(upipe);
     upipe_http_src_init_upump_timeout(upipe);
+    upipe_http_src_init_upump_lookup(upipe);
     upipe_http_src_init_uclock(upipe);
     upipe_http_src_init_output_size(upipe, UBUF_DEFAULT_SIZE);
 
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
     upipe_http_src->fd = -1;
     upipe_http_src->request_pending = false;
+    upipe_http_src->peer = NULL;
+    upipe_http_src->nb_addrs = 0;
+    upipe_http_src->addr_idx = 0;
+    upipe_http_src->lookup = NULL;
+    upipe_http_src->connecting = false;
+    upipe_http_src->reused = false;
+    upipe_http_src->received = 0;
+    memset(upipe_http_src->buffers, 0, sizeof (upipe_http_src->buffers));
+    upipe_http_src->systime = 0;
     upipe_http_src->url = NULL;
     upipe_http_src->range = HTTP_RANGE(0, -1);
     upipe_http_src->position = 0;
@@ -274,6 +748,46 @@ static struct upipe *upipe_http_src_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This allocates a receive buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer receive buffer to allocate
+ * @return an error code
+ */
+static int upipe_http_src_buffer_alloc(struct upipe *upipe,
+                                       struct upipe_http_src_buffer *buffer)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    int size = upipe_http_src->output_size > RECV_BUFFER_SIZE ?
+               upipe_http_src->output_size : RECV_BUFFER_SIZE;
+
+    buffer->ubuf = ubuf_block_alloc(upipe_http_src->ubuf_mgr, size);
+    if (unlikely(buffer->ubuf == NULL))
+        return UBASE_ERR_ALLOC;
+    if (unlikely(!ubase_check(ubuf_block_write(buffer->ubuf, 0, &size,
+                                               &buffer->data)))) {
+        ubuf_free(buffer->ubuf);
+        buffer->ubuf = NULL;
+        return UBASE_ERR_ALLOC;
+    }
+    buffer->size = size;
+    buffer->fill = buffer->body_start = buffer->body_end = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This releases a receive buffer.
+ *
+ * @param buffer receive buffer to release
+ */
+static void upipe_http_src_buffer_release(struct upipe_http_src_buffer *buffer)
+{
+    if (buffer->ubuf != NULL) {
+        ubuf_block_unmap(buffer->ubuf, 0);
+        ubuf_free(buffer->ubuf);
+    }
+    memset(buffer, 0, sizeof (*buffer));
+}
+
 /** @This closes a connection.
  *
  * @param upipe description structure of the pipe
@@ -287,12 +801,23 @@ static void upipe_http_src_close(struct upipe *upipe)
         upipe_notice_va(upipe, "closing %s", upipe_http_src->url);
     ubase_clean_fd(&upipe_http_src->fd);
     ubase_clean_str(&upipe_http_src->url);
+    ubase_clean_str(&upipe_http_src->peer);
     upipe_http_src_set_upump(upipe, NULL);
     upipe_http_src->request_pending = false;
+    upipe_http_src->connecting = false;
     upipe_http_src_set_upump_write(upipe, NULL);
     upipe_http_src_set_upump_timeout(upipe, NULL);
+    upipe_http_src_set_upump_lookup(upipe, NULL);
+    if (upipe_http_src->lookup != NULL) {
+        upipe_http_src_lookup_abandon(upipe_http_src->lookup);
+        upipe_http_src->lookup = NULL;
+    }
     if (flow_def)
         uref_http_delete_content_type(flow_def);
+
+    /* drop the body of an interrupted message */
+    struct upipe_http_src_buffer *buffer = &upipe_http_src->buffers[0];
+    buffer->body_start = buffer->body_end;
 }
 
 /** @This frees a upipe.
@@ -307,12 +832,16 @@ static void upipe_http_src_free(struct upipe *upipe)
 
     upipe_throw_dead(upipe);
 
+    for (unsigned i = 0; i < UBASE_ARRAY_SIZE(upipe_http_src->buffers); i++)
+        upipe_http_src_buffer_release(&upipe_http_src->buffers[i]);
+
     free(upipe_http_src->proxy);
     free(upipe_http_src->url);
     free(upipe_http_src->location);
     upipe_http_src_clean_output_size(upipe);
     upipe_http_src_clean_uclock(upipe);
     upipe_http_src_clean_upump_timeout(upipe);
+    upipe_http_src_clean_upump_lookup(upipe);
     upipe_http_src_clean_upump_write(upipe);
     upipe_http_src_clean_upump(upipe);
     upipe_http_src_clean_upump_mgr(upipe);
@@ -404,46 +933,64 @@ static int upipe_http_src_status_cb(http_parser *parser)
     return 0;
 }
 
-static int upipe_http_src_output_data(struct upipe *upipe,
-                                      const char *at, size_t len)
+/** @internal @This outputs the decoded body as slices of the receive
+ * buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param flush true to also output a last slice smaller than the output size
+ */
+static void upipe_http_src_output_body(struct upipe *upipe, bool flush)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    struct uref *uref;
-    uint64_t systime = 0;
-    uint8_t *buf = NULL;
-    int size;
+    struct upipe_http_src_buffer *buffer = &upipe_http_src->buffers[0];
+
+    while (buffer->body_end > buffer->body_start) {
+        size_t size = buffer->body_end - buffer->body_start;
+        if (size > upipe_http_src->output_size)
+            size = upipe_http_src->output_size;
+        else if (size < upipe_http_src->output_size && !flush)
+            break;
+
+        struct uref *uref = uref_alloc(upipe_http_src->uref_mgr);
+        struct ubuf *ubuf = ubuf_block_splice(buffer->ubuf,
+                                              buffer->body_start, size);
+        if (unlikely(uref == NULL || ubuf == NULL)) {
+            if (uref != NULL)
+                uref_free(uref);
+            if (ubuf != NULL)
+                ubuf_free(ubuf);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(uref, ubuf);
+        if (upipe_http_src->systime)
+            uref_clock_set_cr_sys(uref, upipe_http_src->systime);
+        buffer->body_start += size;
+        upipe_http_src->position += size;
+        upipe_http_src_output(upipe, uref, &upipe_http_src->upump);
+    }
+}
 
-    if (unlikely(at == NULL))
-        len = 0;
+/** @internal @This outputs the end of the body.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_output_end(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
 
-    /* fetch systime */
-    if (likely(upipe_http_src->uclock)) {
-        systime = uclock_now(upipe_http_src->uclock);
-    }
+    upipe_http_src_output_body(upipe, true);
 
-    /* alloc, map, copy, unmap */
-    uref = uref_block_alloc(upipe_http_src->uref_mgr,
-                            upipe_http_src->ubuf_mgr, len);
+    struct uref *uref = uref_block_alloc(upipe_http_src->uref_mgr,
+                                         upipe_http_src->ubuf_mgr, 0);
     if (unlikely(!uref)) {
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return 0;
+        return;
     }
-    size = -1;
-    uref_block_write(uref, 0, &size, &buf);
-    assert(len == size);
-    if (likely(at != NULL))
-        memcpy(buf, at, len);
-    uref_block_unmap(uref, 0);
-
-    if (systime)
-        uref_clock_set_cr_sys(uref, systime);
-    if (len == 0)
-        uref_block_set_end(uref);
-    upipe_http_src->position += len;
+    if (upipe_http_src->systime)
+        uref_clock_set_cr_sys(uref, upipe_http_src->systime);
+    uref_block_set_end(uref);
     upipe_http_src_output(upipe, uref, &upipe_http_src->upump);
-
-    /* everything's fine, return 0 to http_parser */
-    return 0;
 }
 
 /** @internal @This is called by http_parser when message is completed.
@@ -462,12 +1009,19 @@ static int upipe_http_src_message_complete(http_parser *parser)
 
     upipe_dbg_va(upipe, "message complete %i", status_code);
 
+    if (http_should_keep_alive(parser) && upipe_http_src->peer != NULL &&
+        upipe_http_src_mgr_put_conn(upipe->mgr, upipe_http_src->peer,
+                                    upipe_http_src->fd)) {
+        upipe_dbg_va(upipe, "keeping connection to %s", upipe_http_src->peer);
+        upipe_http_src->fd = -1;
+    }
+
     switch (status_code) {
     /* success */
     case 200:
     /* partial content */
     case 206:
-        upipe_http_src_output_data(upipe, NULL, 0);
+        upipe_http_src_output_end(upipe);
         break;
     }
     upipe_http_src_close(upipe);
@@ -502,9 +1056,28 @@ static int upipe_http_src_body_cb(http_parser *parser, const char *at, size_t le
     /* success */
     case 200:
     /* partial content */
-    case 206:
-        upipe_http_src_output_data(upipe, at, len);
+    case 206: {
+        struct upipe_http_src_buffer *buffer = &upipe_http_src->buffers[0];
+        uint8_t *body = buffer->data + buffer->body_end;
+        assert((const uint8_t *)at >= body &&
+               (const uint8_t *)at + len <= buffer->data + buffer->fill);
+        if ((const uint8_t *)at != body) {
+            if (ubase_check(ubuf_control(buffer->ubuf, UBUF_SINGLE)))
+                /* no slice was output yet, decode in place by moving the
+                 * body octets over the chunk headers */
+                memmove(body, at, len);
+            else {
+                /* slices of the buffer are in use downstream, so do not
+                 * write to it and restart the body after the headers */
+                upipe_http_src_output_body(upipe, true);
+                buffer->body_start = buffer->body_end =
+                    (const uint8_t *)at - buffer->data;
+            }
+        }
+        buffer->body_end += len;
+        upipe_http_src_output_body(upipe, false);
         break;
+    }
     /* redirect */
     case 302:
         break;
@@ -516,22 +1089,15 @@ static int upipe_http_src_body_cb(http_parser *parser, const char *at, size_t le
 /** @internal @This parses and outputs data.
  *
  * @param upipe description structure of the pipe
- * @param uref uref structure
+ * @param buffer received data, in the first receive buffer
+ * @param size size of the received data
  */
 static void upipe_http_src_process(struct upipe *upipe,
-                                   struct uref *uref)
+                                   const uint8_t *buffer, size_t size)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
 
     /* parse response */
-    const uint8_t *buffer;
-    int size = -1;
-    if (unlikely(!ubase_check(uref_block_read(uref, 0, &size, &buffer))) ||
-        size < 0) {
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
-    }
     size_t parsed_len =
         http_parser_execute(&upipe_http_src->parser,
                             &upipe_http_src->parser_settings,
@@ -540,8 +1106,22 @@ static void upipe_http_src_process(struct upipe *upipe,
         upipe_warn(upipe, "http request execution failed");
         upipe_throw_source_end(upipe);
     }
-    uref_block_unmap(uref, 0);
-    uref_free(uref);
+}
+
+/** @internal @This outputs the remaining body of the first receive buffer
+ * and replaces it with the second one.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_rotate(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+
+    upipe_http_src_output_body(upipe, true);
+    upipe_http_src_buffer_release(&upipe_http_src->buffers[0]);
+    upipe_http_src->buffers[0] = upipe_http_src->buffers[1];
+    memset(&upipe_http_src->buffers[1], 0,
+           sizeof (upipe_http_src->buffers[1]));
 }
 
 /** @internal @This reads data from the source and outputs it.
@@ -554,40 +1134,55 @@ static void upipe_http_src_worker(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    struct upipe_http_src_buffer *buffers = upipe_http_src->buffers;
 
     if (likely(upipe_http_src->upump_timeout))
         upump_restart(upipe_http_src->upump_timeout);
 
-    struct uref *uref = uref_block_alloc(upipe_http_src->uref_mgr,
-                                         upipe_http_src->ubuf_mgr,
-                                         upipe_http_src->output_size);
-    if (unlikely(uref == NULL)) {
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
-    }
-
-    uint8_t *buffer;
-    int output_size = -1;
-    if (unlikely(!ubase_check(uref_block_write(
-                    uref, 0, &output_size, &buffer)))) {
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
-    }
-    assert(output_size == upipe_http_src->output_size);
+    if (buffers[0].ubuf != NULL && buffers[0].fill == buffers[0].size)
+        upipe_http_src_rotate(upipe);
+    for (unsigned i = 0; i < 2; i++)
+        if (buffers[i].ubuf == NULL &&
+            unlikely(!ubase_check(upipe_http_src_buffer_alloc(upipe,
+                                                              &buffers[i])))) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
 
-    ssize_t len = recv(upipe_http_src->fd, buffer,
-                       upipe_http_src->output_size, 0);
-    uref_block_unmap(uref, 0);
+    /* read into the end of the current buffer and the next one */
+    struct iovec iov[2] = {
+        {
+            .iov_base = buffers[0].data + buffers[0].fill,
+            .iov_len = buffers[0].size - buffers[0].fill,
+        },
+        {
+            .iov_base = buffers[1].data,
+            .iov_len = buffers[1].size,
+        },
+    };
+    ssize_t len = readv(upipe_http_src->fd, iov, 2);
 
     if (len > 0) {
-        if (unlikely(len != upipe_http_src->output_size))
-            uref_block_resize(uref, 0, len);
-        return upipe_http_src_process(upipe, uref);
+        upipe_http_src->received += len;
+        if (likely(upipe_http_src->uclock))
+            upipe_http_src->systime = uclock_now(upipe_http_src->uclock);
+
+        size_t size = len;
+        if (size > iov[0].iov_len)
+            size = iov[0].iov_len;
+        buffers[0].fill += size;
+
+        upipe_use(upipe);
+        upipe_http_src_process(upipe, iov[0].iov_base, size);
+        if (len > size) {
+            upipe_http_src_rotate(upipe);
+            buffers[0].fill = len - size;
+            upipe_http_src_process(upipe, buffers[0].data, len - size);
+        }
+        upipe_release(upipe);
+        return;
     }
 
-    uref_free(uref);
-
     if (unlikely(len == -1)) {
         switch (errno) {
             case EINTR:
@@ -607,7 +1202,13 @@ static void upipe_http_src_worker(struct upump *upump)
     else  {
         upipe_dbg(upipe, "connection closed");
     }
-    upipe_http_src_output_data(upipe, NULL, 0);
+    if (upipe_http_src->reused && !upipe_http_src->received) {
+        /* the server closed the kept connection before our request */
+        upipe_dbg(upipe, "reused connection is gone, reconnecting");
+        upipe_http_src_retry(upipe);
+        return;
+    }
+    upipe_http_src_output_end(upipe);
     upipe_http_src_set_upump(upipe, NULL);
     upipe_http_src_set_upump_write(upipe, NULL);
     upipe_http_src_set_upump_timeout(upipe, NULL);
@@ -688,6 +1289,12 @@ static int upipe_http_src_send_request(struct upipe *upipe)
         request_add(&req, &req_len, "Host: %s\r\n", host);
     }
 
+    /* Connection */
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(upipe->mgr);
+    if (upipe_http_src_mgr->max_idle)
+        request_add(&req, &req_len, "Connection: keep-alive\r\n");
+
     /* Range */
     upipe_http_src->position = 0;
     if (upipe_http_src->range.offset ||
@@ -759,6 +1366,12 @@ static int upipe_http_src_send_request(struct upipe *upipe)
                 /* try again later */
                 return UBASE_ERR_EXTERNAL;
 
+            case EPIPE:
+            case ECONNRESET:
+                if (upipe_http_src->reused)
+                    /* the server closed the kept connection */
+                    return UBASE_ERR_BUSY;
+                /* fallthrough */
             case EBADF:
             case EINVAL:
             default:
@@ -779,7 +1392,27 @@ static void upipe_http_src_worker_write(struct upump *upump)
     if (likely(upipe_http_src->upump_timeout))
         upump_restart(upipe_http_src->upump_timeout);
 
-    if (unlikely(!ubase_check(upipe_http_src_send_request(upipe)))) {
+    if (upipe_http_src->connecting) {
+        int error = 0;
+        socklen_t len = sizeof (error);
+        if (getsockopt(upipe_http_src->fd, SOL_SOCKET, SO_ERROR,
+                       &error, &len) < 0)
+            error = errno;
+        if (error) {
+            upipe_warn_va(upipe, "connection to %s failed (%s)",
+                          upipe_http_src->peer, strerror(error));
+            upipe_http_src_retry(upipe);
+            return;
+        }
+        upipe_http_src->connecting = false;
+    }
+
+    int err = upipe_http_src_send_request(upipe);
+    if (unlikely(err == UBASE_ERR_BUSY)) {
+        upipe_dbg(upipe, "reused connection is gone, reconnecting");
+        upipe_http_src_retry(upipe);
+    }
+    else if (unlikely(!ubase_check(err))) {
         upipe_err(upipe, "fail to send request");
     }
     else {
@@ -796,7 +1429,7 @@ static void upipe_http_src_worker_timeout(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     upipe_warn(upipe, "timeout");
-    upipe_http_src_output_data(upipe, NULL, 0);
+    upipe_http_src_output_end(upipe);
     upipe_http_src_close(upipe);
     upipe_throw_source_end(upipe);
 }
@@ -847,6 +1480,37 @@ static int upipe_http_src_check(struct upipe *upipe, struct uref *flow_format)
             != NULL)
         return UBASE_ERR_NONE;
 
+    if (upipe_http_src->lookup != NULL &&
+        upipe_http_src->upump_lookup == NULL) {
+        struct upump *upump =
+            ueventfd_upump_alloc(&upipe_http_src->lookup->ueventfd,
+                                 upipe_http_src->upump_mgr,
+                                 upipe_http_src_worker_lookup, upipe,
+                                 upipe->refcount);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_http_src_set_upump_lookup(upipe, upump);
+        upump_start(upump);
+    }
+
+    if ((upipe_http_src->fd != -1 || upipe_http_src->lookup != NULL) &&
+        upipe_http_src->upump_timeout == NULL) {
+        struct upump *upump;
+
+        upump = upump_alloc_timer(upipe_http_src->upump_mgr,
+                                  upipe_http_src_worker_timeout, upipe,
+                                  upipe->refcount,
+                                  upipe_http_src->timeout, 0);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return UBASE_ERR_UPUMP;
+        }
+        upipe_http_src_set_upump_timeout(upipe, upump);
+        upump_start(upump);
+    }
+
     if (upipe_http_src->fd != -1) {
         if (upipe_http_src->upump == NULL) {
             struct upump *upump;
@@ -874,20 +1538,6 @@ static int upipe_http_src_check(struct upipe *upipe, struct uref *flow_format)
             upipe_http_src_set_upump_write(upipe, upump);
             upump_start(upump);
         }
-        if (upipe_http_src->upump_timeout == NULL) {
-            struct upump *upump;
-
-            upump = upump_alloc_timer(upipe_http_src->upump_mgr,
-                                      upipe_http_src_worker_timeout, upipe,
-                                      upipe->refcount,
-                                      upipe_http_src->timeout, 0);
-            if (unlikely(upump == NULL)) {
-                upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
-                return UBASE_ERR_UPUMP;
-            }
-            upipe_http_src_set_upump_timeout(upipe, upump);
-            upump_start(upump);
-        }
     }
     return UBASE_ERR_NONE;
 }
@@ -906,35 +1556,169 @@ static int upipe_http_src_get_uri(struct upipe *upipe, const char **url_p)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This resolves the peer addresses, using the name resolutions
+ * cached by the manager. Otherwise the name is resolved on another thread,
+ * and the connection starts in @ref upipe_http_src_worker_lookup.
+ *
+ * @param upipe description structure of the pipe
+ * @param host host name
+ * @param service service name or port
+ * @return an error code
+ */
+static int upipe_http_src_resolve(struct upipe *upipe,
+                                  const char *host, const char *service)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+
+    struct upipe_http_src_host *cached =
+        upipe_http_src_mgr_find_host(upipe->mgr, upipe_http_src->peer);
+    if (cached == NULL) {
+        upipe_verbose_va(upipe, "getaddrinfo to %s", upipe_http_src->peer);
+        upipe_http_src->lookup = upipe_http_src_lookup_start(host, service);
+        if (unlikely(upipe_http_src->lookup == NULL)) {
+            upipe_err_va(upipe, "unable to resolve %s", upipe_http_src->peer);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_http_src->nb_addrs = 0;
+        upipe_http_src->addr_idx = 0;
+        return UBASE_ERR_NONE;
+    }
+
+    memcpy(upipe_http_src->addrs, cached->addrs,
+           cached->nb_addrs * sizeof (struct upipe_http_src_addr));
+    upipe_http_src->nb_addrs = cached->nb_addrs;
+    upipe_http_src->addr_idx = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This stores the result of a name resolution in the pipe and
+ * in the manager cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param lookup finished name resolution
+ * @return an error code
+ */
+static int upipe_http_src_resolved(struct upipe *upipe,
+                                   struct upipe_http_src_lookup *lookup)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    if (unlikely(lookup->ret)) {
+        upipe_err_va(upipe, "getaddrinfo: %s", gai_strerror(lookup->ret));
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    upipe_http_src->nb_addrs = 0;
+    upipe_http_src->addr_idx = 0;
+    for (struct addrinfo *res = lookup->info;
+         res && upipe_http_src->nb_addrs < MAX_ADDRS; res = res->ai_next) {
+        if (res->ai_addrlen > sizeof (struct sockaddr_storage))
+            continue;
+        struct upipe_http_src_addr *addr =
+            &upipe_http_src->addrs[upipe_http_src->nb_addrs++];
+        addr->family = res->ai_family;
+        addr->socktype = res->ai_socktype;
+        addr->protocol = res->ai_protocol;
+        addr->addrlen = res->ai_addrlen;
+        memcpy(&addr->addr, res->ai_addr, res->ai_addrlen);
+    }
+    upipe_http_src_mgr_cache_host(upipe->mgr, upipe_http_src->peer,
+                                  upipe_http_src->addrs,
+                                  upipe_http_src->nb_addrs);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This starts a non-blocking connection to the first working
+ * address, starting from the current address index. The connection is
+ * completed in the write watcher.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_http_src_connect(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+
+    for (; upipe_http_src->addr_idx < upipe_http_src->nb_addrs;
+         upipe_http_src->addr_idx++) {
+        struct upipe_http_src_addr *addr =
+            &upipe_http_src->addrs[upipe_http_src->addr_idx];
+        int fd = socket(addr->family, addr->socktype, addr->protocol);
+        if (unlikely(fd < 0))
+            continue;
+
+        int flags = fcntl(fd, F_GETFL);
+        if (likely(flags >= 0) &&
+            likely(fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0) &&
+            (connect(fd, (struct sockaddr *)&addr->addr,
+                     addr->addrlen) == 0 || errno == EINPROGRESS)) {
+            upipe_http_src->fd = fd;
+            upipe_http_src->connecting = true;
+            return UBASE_ERR_NONE;
+        }
+        ubase_clean_fd(&fd);
+    }
+
+    upipe_err(upipe, "could not connect to any resource");
+    upipe_http_src_mgr_forget_host(upipe->mgr, upipe_http_src->peer);
+    return UBASE_ERR_EXTERNAL;
+}
+
+/** @internal @This opens a connection to a peer, reusing an idle
+ * connection from the manager if possible.
+ *
+ * @param upipe description structure of the pipe
+ * @param host host name
+ * @param service service name or port
+ * @return an error code
+ */
+static int upipe_http_src_open_peer(struct upipe *upipe,
+                                    const char *host, const char *service)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+
+    char peer[strlen(host) + 1 + strlen(service) + 1];
+    snprintf(peer, sizeof (peer), "%s:%s", host, service);
+    ubase_clean_str(&upipe_http_src->peer);
+    upipe_http_src->peer = strdup(peer);
+    if (unlikely(upipe_http_src->peer == NULL))
+        return UBASE_ERR_ALLOC;
+
+    int fd = upipe_http_src_mgr_get_conn(upipe->mgr, peer);
+    if (fd >= 0) {
+        upipe_dbg_va(upipe, "reusing connection to %s", peer);
+        upipe_http_src->fd = fd;
+        upipe_http_src->reused = true;
+        return UBASE_ERR_NONE;
+    }
+
+    UBASE_RETURN(upipe_http_src_resolve(upipe, host, service));
+    if (upipe_http_src->lookup != NULL)
+        return UBASE_ERR_NONE;
+    return upipe_http_src_connect(upipe);
+}
+
 /** @internal @This asks to open the given http (real code here).
  *
  * @param upipe description structure of the pipe
- * @param url relative or absolute url of the http
  * @return an error code
  */
 static int upipe_http_src_open_url(struct upipe *upipe)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
     struct uref *flow_def = upipe_http_src->flow_def;
-    struct addrinfo *info = NULL, *res;
-    struct addrinfo hints;
-    int ret, fd = -1;
 
     if (unlikely(flow_def == NULL))
         return UBASE_ERR_INVALID;
 
     /* init parser */
     http_parser_init(&upipe_http_src->parser, HTTP_RESPONSE);
-
-    /* get socket information */
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = PF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = 0;
+    upipe_http_src->connecting = false;
+    upipe_http_src->reused = false;
+    upipe_http_src->received = 0;
 
     if (upipe_http_src->proxy) {
         struct uuri uuri;
-        ret = uuri_from_str(&uuri, upipe_http_src->proxy);
+        int ret = uuri_from_str(&uuri, upipe_http_src->proxy);
         if (!ubase_check(ret)) {
             upipe_err_va(upipe, "invalid http_proxy %s",
                          upipe_http_src->proxy);
@@ -944,48 +1728,82 @@ static int upipe_http_src_open_url(struct upipe *upipe)
         ustring_cpy(uuri.authority.host, host, sizeof (host));
         char service[uuri.authority.port.len + 1];
         ustring_cpy(uuri.authority.port, service, sizeof (service));
-
-        upipe_verbose_va(upipe, "getaddrinfo to %s%s%s",
-                         host, strlen(service) ? ":" : "",
-                         service);
-        ret = getaddrinfo(host, service, &hints, &info);
+        return upipe_http_src_open_peer(upipe, host, service);
     }
-    else {
-        const char *host;
-        UBASE_RETURN(uref_uri_get_host(flow_def, &host));
 
-        const char *service;
-        if (!ubase_check(uref_uri_get_port(flow_def, &service)))
-            UBASE_RETURN(uref_uri_get_scheme(flow_def, &service));
+    const char *host;
+    UBASE_RETURN(uref_uri_get_host(flow_def, &host));
 
-        upipe_verbose_va(upipe, "getaddrinfo to %s", host);
-        ret = getaddrinfo(host, service, &hints, &info);
-    }
+    const char *service;
+    if (!ubase_check(uref_uri_get_port(flow_def, &service)))
+        UBASE_RETURN(uref_uri_get_scheme(flow_def, &service));
+    return upipe_http_src_open_peer(upipe, host, service);
+}
 
-    if (unlikely(ret)) {
-        upipe_err_va(upipe, "getaddrinfo: %s", gai_strerror(ret));
-        return UBASE_ERR_EXTERNAL;
-    }
+/** @internal @This drops the current connection and opens a new one, either
+ * to the next resolved address if the connection failed, or to the peer
+ * again if a reused connection was closed by the server.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_src_retry(struct upipe *upipe)
+{
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    int ret;
 
-    /* connect to first working resource */
-    for (res = info; res; res = res->ai_next) {
-        fd = socket(res->ai_family, res->ai_socktype,
-                                          res->ai_protocol);
-        if (likely(fd >= 0)) {
-            if (connect(fd, res->ai_addr, res->ai_addrlen) == 0)
-                break;
-            ubase_clean_fd(&fd);
-        }
+    upipe_http_src_set_upump(upipe, NULL);
+    upipe_http_src_set_upump_write(upipe, NULL);
+    upipe_http_src_set_upump_timeout(upipe, NULL);
+    ubase_clean_fd(&upipe_http_src->fd);
+
+    if (upipe_http_src->reused)
+        ret = upipe_http_src_open_url(upipe);
+    else {
+        upipe_http_src->addr_idx++;
+        ret = upipe_http_src_connect(upipe);
     }
-    freeaddrinfo(info);
 
-    if (fd < 0) {
-        upipe_err(upipe, "could not connect to any resource");
-        return UBASE_ERR_EXTERNAL;
+    if (unlikely(!ubase_check(ret))) {
+        upipe_http_src_output_end(upipe);
+        upipe_http_src_close(upipe);
+        upipe_throw_source_end(upipe);
+        return;
     }
+    upipe_http_src->request_pending = true;
+    upipe_http_src_check(upipe, NULL);
+}
 
-    upipe_http_src->fd = fd;
-    return UBASE_ERR_NONE;
+/** @internal @This is triggered when the name resolution is over, and
+ * starts the connection.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_http_src_worker_lookup(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
+    struct upipe_http_src_lookup *lookup = upipe_http_src->lookup;
+
+    ueventfd_read(&lookup->ueventfd);
+    pthread_mutex_lock(&lookup->mutex);
+    bool done = lookup->done;
+    pthread_mutex_unlock(&lookup->mutex);
+    if (!done)
+        return;
+
+    upipe_http_src_set_upump_lookup(upipe, NULL);
+    upipe_http_src->lookup = NULL;
+    int ret = upipe_http_src_resolved(upipe, lookup);
+    upipe_http_src_lookup_free(lookup);
+    if (ubase_check(ret))
+        ret = upipe_http_src_connect(upipe);
+    if (unlikely(!ubase_check(ret))) {
+        upipe_http_src_output_end(upipe);
+        upipe_http_src_close(upipe);
+        upipe_throw_source_end(upipe);
+        return;
+    }
+    upipe_http_src_check(upipe, NULL);
 }
 
 /** @internal @This asks to open the given http.
@@ -1188,20 +2006,6 @@ static int upipe_http_src_control(struct upipe *upipe,
     return upipe_http_src_check(upipe, NULL);
 }
 
-struct upipe_http_src_mgr {
-    /** upipe manager */
-    struct upipe_mgr upipe_mgr;
-    /** urefcount structure */
-    struct urefcount urefcount;
-    /** cookie list */
-    struct uchain cookies;
-    /** proxy url */
-    char *proxy;
-};
-
-UBASE_FROM_TO(upipe_http_src_mgr, upipe_mgr, upipe_mgr, upipe_mgr)
-UBASE_FROM_TO(upipe_http_src_mgr, urefcount, urefcount, urefcount);
-
 static int _upipe_http_src_mgr_set_cookie(struct upipe_mgr *upipe_mgr,
                                           const char *cookie_string)
 {
@@ -1309,6 +2113,34 @@ static int _upipe_http_src_mgr_set_proxy(struct upipe_mgr *mgr,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the maximum number of idle connections kept.
+ *
+ * @param mgr pointer to upipe manager
+ * @param max_idle maximum number of idle connections
+ * @return an error code
+ */
+static int _upipe_http_src_mgr_set_keepalive(struct upipe_mgr *mgr,
+                                             unsigned int max_idle)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+    upipe_http_src_mgr->max_idle = max_idle;
+    upipe_http_src_mgr_trim_idle(upipe_http_src_mgr, max_idle);
+    return UBASE_ERR_NONE;
+}
+
+static int _upipe_http_src_mgr_set_dns_cache(struct upipe_mgr *mgr,
+                                             unsigned int max_hosts,
+                                             uint64_t ttl)
+{
+    struct upipe_http_src_mgr *upipe_http_src_mgr =
+        upipe_http_src_mgr_from_upipe_mgr(mgr);
+    upipe_http_src_mgr->max_hosts = max_hosts;
+    upipe_http_src_mgr->hosts_ttl = ttl;
+    upipe_http_src_mgr_trim_hosts(upipe_http_src_mgr, max_hosts);
+    return UBASE_ERR_NONE;
+}
+
 static int upipe_http_src_mgr_control(struct upipe_mgr *upipe_mgr,
                                       int command, va_list args)
 {
@@ -1337,6 +2169,18 @@ static int upipe_http_src_mgr_control(struct upipe_mgr *upipe_mgr,
         const char *proxy = va_arg(args, const char *);
         return _upipe_http_src_mgr_set_proxy(upipe_mgr, proxy);
     }
+
+    case UPIPE_HTTP_SRC_MGR_SET_KEEPALIVE: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_SRC_SIGNATURE)
+        unsigned int max_idle = va_arg(args, unsigned int);
+        return _upipe_http_src_mgr_set_keepalive(upipe_mgr, max_idle);
+    }
+    case UPIPE_HTTP_SRC_MGR_SET_DNS_CACHE: {
+        UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_SRC_SIGNATURE)
+        unsigned int max_hosts = va_arg(args, unsigned int);
+        uint64_t ttl = va_arg(args, uint64_t);
+        return _upipe_http_src_mgr_set_dns_cache(upipe_mgr, max_hosts, ttl);
+    }
     }
     return UBASE_ERR_UNHANDLED;
 }
@@ -1354,6 +2198,8 @@ static void upipe_http_src_mgr_free(struct urefcount *urefcount)
         free(cookie->value);
         free(cookie);
     }
+    upipe_http_src_mgr_trim_idle(upipe_http_src_mgr, 0);
+    upipe_http_src_mgr_trim_hosts(upipe_http_src_mgr, 0);
     free(upipe_http_src_mgr->proxy);
     urefcount_clean(urefcount);
     free(upipe_http_src_mgr);
@@ -1387,6 +2233,13 @@ struct upipe_mgr *upipe_http_src_mgr_alloc(void)
     upipe_mgr->refcount = urefcount;
     ulist_init(&upipe_http_src_mgr->cookies);
     upipe_http_src_mgr->proxy = NULL;
+    upipe_http_src_mgr->max_idle = 0;
+    upipe_http_src_mgr->nb_idle = 0;
+    ulist_init(&upipe_http_src_mgr->idle);
+    ulist_init(&upipe_http_src_mgr->hosts);
+    upipe_http_src_mgr->nb_hosts = 0;
+    upipe_http_src_mgr->max_hosts = DNS_CACHE_SIZE;
+    upipe_http_src_mgr->hosts_ttl = DNS_CACHE_TTL;
 
     return upipe_http_src_mgr_to_upipe_mgr(upipe_http_src_mgr);
 }
@@ -154,6 +154,17 @@ struct upipe_m3u_reader {
     struct uref *key;
     /** list of items */
     struct uchain items;
+    /** number of items of the current playlist */
+    uint64_t index;
+    /** items of the previous playlist, kept for reload */
+    struct uchain cache;
+    /** media sequence of the first cached item */
+    uint64_t cache_sequence;
+    /** cached item matching the current item, or NULL */
+    struct uref *cached;
+    /** lines of the current item, kept until it is checked against the
+     * cached item */
+    struct uchain lines;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -195,6 +206,11 @@ static struct upipe *upipe_m3u_reader_alloc(struct upipe_mgr *mgr,
     struct upipe_m3u_reader *upipe_m3u_reader =
         upipe_m3u_reader_from_upipe(upipe);
     ulist_init(&upipe_m3u_reader->items);
+    upipe_m3u_reader->index = 0;
+    ulist_init(&upipe_m3u_reader->cache);
+    upipe_m3u_reader->cache_sequence = 0;
+    upipe_m3u_reader->cached = NULL;
+    ulist_init(&upipe_m3u_reader->lines);
     upipe_m3u_reader->current_flow_def = NULL;
     upipe_m3u_reader->flow_def = NULL;
     upipe_m3u_reader->item = NULL;
@@ -205,6 +221,35 @@ static struct upipe *upipe_m3u_reader_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This cleans the cached items of the previous playlist.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_m3u_reader_flush_cache(struct upipe *upipe)
+{
+    struct upipe_m3u_reader *upipe_m3u_reader =
+        upipe_m3u_reader_from_upipe(upipe);
+
+    upipe_m3u_reader->cached = NULL;
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_m3u_reader->cache)) != NULL)
+        uref_free(uref_from_uchain(uchain));
+}
+
+/** @internal @This cleans the pending lines of the current item.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_m3u_reader_flush_lines(struct upipe *upipe)
+{
+    struct upipe_m3u_reader *upipe_m3u_reader =
+        upipe_m3u_reader_from_upipe(upipe);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_m3u_reader->lines)) != NULL)
+        uref_free(uref_from_uchain(uchain));
+}
+
 /** @internal @This cleans the m3u reader items.
  *
  * @param upipe description structure of the pipe
@@ -215,8 +260,12 @@ static void upipe_m3u_reader_flush(struct upipe *upipe)
         upipe_m3u_reader_from_upipe(upipe);
 
     uref_free(upipe_m3u_reader->current_flow_def);
+    upipe_m3u_reader->current_flow_def = NULL;
     uref_free(upipe_m3u_reader->item);
     upipe_m3u_reader->item = NULL;
+    upipe_m3u_reader->cached = NULL;
+    upipe_m3u_reader->index = 0;
+    upipe_m3u_reader_flush_lines(upipe);
 
     struct uchain *uchain;
     while ((uchain = ulist_pop(&upipe_m3u_reader->items)) != NULL)
@@ -238,6 +287,7 @@ static void upipe_m3u_reader_free(struct upipe *upipe)
 
     uref_free(upipe_m3u_reader->key);
     upipe_m3u_reader_flush(upipe);
+    upipe_m3u_reader_flush_cache(upipe);
     uref_free(upipe_m3u_reader->flow_def);
     upipe_m3u_reader_clean_uref_stream(upipe);
     upipe_m3u_reader_clean_output(upipe);
@@ -274,6 +324,45 @@ static int upipe_m3u_reader_get_item(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This looks up the item of the previous playlist with the same
+ * media sequence as the current item. Expired items are dropped from the
+ * cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def the current flow definition
+ * @return true if a cached item was found
+ */
+static bool upipe_m3u_reader_lookup(struct upipe *upipe,
+                                    struct uref *flow_def)
+{
+    struct upipe_m3u_reader *upipe_m3u_reader =
+        upipe_m3u_reader_from_upipe(upipe);
+
+    if (upipe_m3u_reader->cached != NULL)
+        return true;
+    if (upipe_m3u_reader->item != NULL ||
+        ulist_empty(&upipe_m3u_reader->cache) ||
+        ubase_check(uref_flow_match_def(flow_def, MASTER_FLOW_DEF)))
+        return false;
+
+    uint64_t media_sequence = 0;
+    uref_m3u_playlist_flow_get_media_sequence(flow_def, &media_sequence);
+    uint64_t sequence = media_sequence + upipe_m3u_reader->index;
+
+    struct uchain *uchain;
+    while (upipe_m3u_reader->cache_sequence < sequence &&
+           (uchain = ulist_pop(&upipe_m3u_reader->cache)) != NULL) {
+        uref_free(uref_from_uchain(uchain));
+        upipe_m3u_reader->cache_sequence++;
+    }
+
+    uchain = ulist_peek(&upipe_m3u_reader->cache);
+    if (uchain == NULL || upipe_m3u_reader->cache_sequence != sequence)
+        return false;
+    upipe_m3u_reader->cached = uref_from_uchain(uchain);
+    return true;
+}
+
 /** @internal @This checks a "#EXTM3U" tag.
  *
  * @param upipe description structure of the pipe
@@ -782,6 +871,10 @@ static int upipe_m3u_reader_key(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @hidden */
+static int upipe_m3u_reader_replay(struct upipe *upipe,
+                                   struct uref *flow_def);
+
 /** @internal @This checks an URI.
  *
  * @param upipe description structure of the pipe
@@ -798,12 +891,35 @@ static int upipe_m3u_reader_process_uri(struct upipe *upipe,
 
     upipe_verbose_va(upipe, "uri %s", uri);
     UBASE_RETURN(uref_flow_match_def(flow_def, M3U_FLOW_DEF));
+
+    if (upipe_m3u_reader_lookup(upipe, flow_def)) {
+        struct uref *cached = upipe_m3u_reader->cached;
+        const char *cached_uri;
+        upipe_m3u_reader->cached = NULL;
+        if (likely(ubase_check(uref_m3u_get_uri(cached, &cached_uri))) &&
+            likely(!strcmp(cached_uri, uri))) {
+            /* unchanged item, skip its tags */
+            ulist_delete(uref_to_uchain(cached));
+            upipe_m3u_reader->cache_sequence++;
+            upipe_m3u_reader_flush_lines(upipe);
+            upipe_m3u_reader->index++;
+            ulist_add(&upipe_m3u_reader->items, uref_to_uchain(cached));
+            return UBASE_ERR_NONE;
+        }
+
+        upipe_warn_va(upipe, "item %"PRIu64" changed (%s)",
+                      upipe_m3u_reader->cache_sequence, uri);
+        upipe_m3u_reader_flush_cache(upipe);
+        UBASE_RETURN(upipe_m3u_reader_replay(upipe, flow_def));
+    }
+
     struct uref *item;
     UBASE_RETURN(upipe_m3u_reader_get_item(upipe, flow_def, &item));
     UBASE_RETURN(uref_m3u_set_uri(item, uri));
     if (upipe_m3u_reader->key)
         UBASE_RETURN(uref_m3u_playlist_key_copy(item, upipe_m3u_reader->key));
     upipe_m3u_reader->item = NULL;
+    upipe_m3u_reader->index++;
     ulist_add(&upipe_m3u_reader->items, uref_to_uchain(item));
     return UBASE_ERR_NONE;
 }
@@ -812,12 +928,12 @@ static int upipe_m3u_reader_process_uri(struct upipe *upipe,
  *
  * @param upipe description structure of the pipe
  * @param flow_def the current flow definition
- * @param uref pointer to uref carrying the line to parse
+ * @param line the line to parse
  * @return an error code
  */
 static int upipe_m3u_reader_process_line(struct upipe *upipe,
                                          struct uref *flow_def,
-                                         struct uref *uref)
+                                         char *line)
 {
     static const struct {
         const char *pfx;
@@ -836,14 +952,6 @@ static int upipe_m3u_reader_process_line(struct upipe *upipe,
         { "#EXT-X-KEY:", upipe_m3u_reader_key },
     };
 
-    size_t block_size;
-    UBASE_RETURN(uref_block_size(uref, &block_size));
-
-    uint8_t buffer[block_size + 1];
-    memset(buffer, 0, sizeof (buffer));
-    UBASE_RETURN(uref_block_extract(uref, 0, block_size, buffer));
-
-    char *line = (char *)buffer;
     /* remove end of line */
     if (strlen(line) && line[strlen(line) - 1] == '\n') {
         line[strlen(line) - 1] = '\0';
@@ -869,11 +977,62 @@ static int upipe_m3u_reader_process_line(struct upipe *upipe,
     return upipe_m3u_reader_process_uri(upipe, flow_def, line);
 }
 
-/** @internal @This parses and outputs a m3u file.
+/** @internal @This checks if a line only describes the current item and
+ * may be skipped if the item is already known from the previous playlist.
  *
  * @param upipe description structure of the pipe
+ * @param flow_def the current flow definition
+ * @param line the line to check
+ * @return true if the line must be kept until the item uri is checked
+ */
+static bool upipe_m3u_reader_defer_line(struct upipe *upipe,
+                                        struct uref *flow_def,
+                                        const char *line)
+{
+    static const char *item_tags[] = { "#EXTINF:", "#EXT-X-BYTERANGE:" };
+
+    for (unsigned i = 0; i < UBASE_ARRAY_SIZE(item_tags); i++)
+        if (!strncmp(line, item_tags[i], strlen(item_tags[i])))
+            return upipe_m3u_reader_lookup(upipe, flow_def);
+    return false;
+}
+
+/** @internal @This parses the pending lines of the current item, when it
+ * does not match the cached item.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def the current flow definition
  * @return an error code
  */
+static int upipe_m3u_reader_replay(struct upipe *upipe,
+                                   struct uref *flow_def)
+{
+    struct upipe_m3u_reader *upipe_m3u_reader =
+        upipe_m3u_reader_from_upipe(upipe);
+
+    int ret = UBASE_ERR_NONE;
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_m3u_reader->lines)) != NULL) {
+        struct uref *uref = uref_from_uchain(uchain);
+        size_t block_size = 0;
+        uref_block_size(uref, &block_size);
+
+        char line[block_size + 1];
+        int err = uref_block_extract(uref, 0, block_size, (uint8_t *)line);
+        uref_free(uref);
+        line[block_size] = '\0';
+        if (ubase_check(err))
+            err = upipe_m3u_reader_process_line(upipe, flow_def, line);
+        if (!ubase_check(err))
+            ret = err;
+    }
+    return ret;
+}
+
+/** @internal @This parses the complete lines received so far.
+ *
+ * @param upipe description structure of the pipe
+ */
 static void upipe_m3u_reader_process(struct upipe *upipe)
 {
     struct upipe_m3u_reader *upipe_m3u_reader =
@@ -887,6 +1046,7 @@ static void upipe_m3u_reader_process(struct upipe *upipe)
             return;
         }
     }
+    struct uref *flow_def = upipe_m3u_reader->current_flow_def;
 
     /* parse m3u */
     int ret = UBASE_ERR_NONE;
@@ -896,11 +1056,25 @@ static void upipe_m3u_reader_process(struct upipe *upipe)
          ubase_check(ret) &&
          ubase_check(uref_block_scan(uref, &offset, '\n'));
          offset = 0, uref = upipe_m3u_reader->next_uref) {
-        struct uref *line =
-            upipe_m3u_reader_extract_uref_stream(upipe, offset + 1);
-        ret = upipe_m3u_reader_process_line(
-            upipe, upipe_m3u_reader->current_flow_def, line);
-        uref_free(line);
+        char line[offset + 2];
+        ret = uref_block_extract(uref, 0, offset + 1, (uint8_t *)line);
+        if (unlikely(!ubase_check(ret)))
+            break;
+        line[offset + 1] = '\0';
+
+        if (upipe_m3u_reader_defer_line(upipe, flow_def, line)) {
+            struct uref *deferred =
+                upipe_m3u_reader_extract_uref_stream(upipe, offset + 1);
+            if (unlikely(deferred == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                return;
+            }
+            ulist_add(&upipe_m3u_reader->lines, uref_to_uchain(deferred));
+            continue;
+        }
+
+        upipe_m3u_reader_consume_uref_stream(upipe, offset + 1);
+        ret = upipe_m3u_reader_process_line(upipe, flow_def, line);
     }
 
     if (!ubase_check(ret))
@@ -926,6 +1100,16 @@ static void upipe_m3u_reader_output_all(struct upipe *upipe,
         return;
     }
 
+    /* keep the items of live playlists, to reuse them on reload */
+    bool keep = ubase_check(uref_flow_match_def(flow_def,
+                                                PLAYLIST_FLOW_DEF)) &&
+                !ubase_check(uref_m3u_playlist_flow_get_endlist(flow_def));
+    uint64_t media_sequence = 0;
+    uref_m3u_playlist_flow_get_media_sequence(flow_def, &media_sequence);
+    upipe_m3u_reader_flush_cache(upipe);
+    upipe_m3u_reader_flush_lines(upipe);
+    upipe_m3u_reader->cache_sequence = media_sequence;
+
     /* force new flow def */
     upipe_m3u_reader_store_flow_def(upipe, NULL);
     /* set output flow def */
@@ -938,6 +1122,18 @@ static void upipe_m3u_reader_output_all(struct upipe *upipe,
     while ((uchain = ulist_pop(&upipe_m3u_reader->items)) != NULL) {
         struct uref *uref = uref_from_uchain(uchain);
 
+        if (keep) {
+            struct uref *dup = uref_dup(uref);
+            if (unlikely(dup == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                keep = false;
+            }
+            else {
+                ulist_add(&upipe_m3u_reader->cache, uref_to_uchain(uref));
+                uref = dup;
+            }
+        }
+
         if (first)
             uref_block_set_start(uref);
         first = false;
@@ -159,8 +159,11 @@ static bool upipe_qsink_output(struct upipe *upipe, struct uref *uref,
                                struct upump **upump_p)
 {
     struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
-    return uqueue_push(&upipe_queue(upipe_qsink->qsrc)->uqueue,
-                       uref_to_uchain(uref));
+    struct uqueue *uqueue = &upipe_queue(upipe_qsink->qsrc)->uqueue;
+    if (!uqueue_push(uqueue, uref_to_uchain(uref)))
+        return false;
+    upipe_prof_queue(upipe->prof, uqueue_length(uqueue));
+    return true;
 }
 
 /** @internal @This is called when the queue can be written again.
@@ -37,6 +37,7 @@
 #include <upipe/uref_clock.h>
 #include <upipe/upump.h>
 #include <upipe/ubuf.h>
+#include <upipe/ustats.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -95,6 +96,8 @@ struct upipe_udpsink {
 
     /** delay applied to systime attribute when uclock is provided */
     uint64_t latency;
+    /** exported number of late packets dropped */
+    struct ustats_record *late_drops_stats;
     /** file descriptor */
     int fd;
     /** socket uri */
@@ -159,6 +162,8 @@ static struct upipe *upipe_udpsink_alloc(struct upipe_mgr *mgr,
     upipe_udpsink->raw = false;
     upipe_udpsink->addrlen = 0;
     upipe_throw_ready(upipe);
+    upipe_udpsink->late_drops_stats =
+        upipe_ustats_register(upipe, USTATS_COUNTER, "late_drops");
     return upipe;
 }
 
@@ -237,6 +242,7 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
                       "dropping late packet %"PRIu64" ms, latency %"PRIu64" ms",
                       (now - systime) / (UCLOCK_FREQ / 1000),
                       upipe_udpsink->latency / (UCLOCK_FREQ / 1000));
+        ustats_counter_add(upipe_udpsink->late_drops_stats, 1);
         uref_free(uref);
         return true;
     } else if (now > systime + SYSTIME_PRINT)
@@ -577,6 +583,7 @@ static void upipe_udpsink_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     free(upipe_udpsink->uri);
+    ustats_unregister(upipe_udpsink->late_drops_stats);
     upipe_udpsink_clean_uclock(upipe);
     upipe_udpsink_clean_upump(upipe);
     upipe_udpsink_clean_upump_mgr(upipe);
@@ -63,6 +63,7 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 #include <sys/socket.h>
 
 /** default size of buffers when unspecified */
@@ -71,6 +72,9 @@
 #define UDP_DEFAULT_TTL 0
 #define UDP_DEFAULT_PORT 1234
 
+/** time the kernel busy-polls the device queue on empty reads, in us */
+#define UPIPE_UDPSRC_BUSY_POLL_USEC 50
+
 /** @hidden */
 static int upipe_udpsrc_check(struct upipe *upipe, struct uref *flow_format);
 
@@ -111,6 +115,17 @@ struct upipe_udpsrc {
     struct upump *upump;
     /** read size */
     unsigned int output_size;
+    /** buffer allocated for a read which returned no datagram, or NULL */
+    struct uref *uref;
+
+    /** busy-poll idle period in 27 MHz ticks, or 0 if disabled */
+    uint64_t busy_poll;
+    /** true if the read watcher is a busy-poll idler */
+    bool busy;
+    /** date of the first empty poll since the last datagram, or 0 */
+    uint64_t busy_idle;
+    /** polling statistics */
+    struct upipe_udpsrc_poll_stats stats;
 
     /** udp socket descriptor */
     int fd;
@@ -169,6 +184,11 @@ static struct upipe *upipe_udpsrc_alloc(struct upipe_mgr *mgr,
     upipe_udpsrc_init_upump(upipe);
     upipe_udpsrc_init_uclock(upipe);
     upipe_udpsrc_init_output_size(upipe, UBUF_DEFAULT_SIZE);
+    upipe_udpsrc->uref = NULL;
+    upipe_udpsrc->busy_poll = 0;
+    upipe_udpsrc->busy = false;
+    upipe_udpsrc->busy_idle = 0;
+    memset(&upipe_udpsrc->stats, 0, sizeof(upipe_udpsrc->stats));
     upipe_udpsrc->fd = -1;
     upipe_udpsrc->uri = NULL;
     upipe_udpsrc->addrlen = 0;
@@ -176,26 +196,49 @@ static struct upipe *upipe_udpsrc_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This reads data from the source and outputs it.
- * It is called either when the idler triggers (permanent storage mode) or
- * when data is available on the udp socket descriptor (live stream mode).
+/** @internal @This returns the date of the monotonic clock used for the
+ * busy-poll idle period.
  *
- * @param upump description structure of the read watcher
+ * @return date in 27 MHz ticks
  */
-static void upipe_udpsrc_worker(struct upump *upump)
+static uint64_t upipe_udpsrc_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @internal @This reads a datagram from the source and outputs it.
+ *
+ * @param upipe description structure of the pipe
+ * @param flags flags passed to recvfrom
+ * @return true if a datagram was received
+ */
+static bool upipe_udpsrc_read(struct upipe *upipe, int flags)
 {
-    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
     uint64_t systime = 0; /* to keep gcc quiet */
     if (unlikely(upipe_udpsrc->uclock != NULL))
         systime = uclock_now(upipe_udpsrc->uclock);
 
-    struct uref *uref = uref_block_alloc(upipe_udpsrc->uref_mgr,
-                                         upipe_udpsrc->ubuf_mgr,
-                                         upipe_udpsrc->output_size);
-    if (unlikely(uref == NULL)) {
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
+    /* reuse the buffer of the last empty read, if any */
+    struct uref *uref = upipe_udpsrc->uref;
+    upipe_udpsrc->uref = NULL;
+    size_t size;
+    if (uref != NULL &&
+        (!ubase_check(uref_block_size(uref, &size)) ||
+         size != upipe_udpsrc->output_size)) {
+        uref_free(uref);
+        uref = NULL;
+    }
+    if (uref == NULL) {
+        uref = uref_block_alloc(upipe_udpsrc->uref_mgr, upipe_udpsrc->ubuf_mgr,
+                                upipe_udpsrc->output_size);
+        if (unlikely(uref == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return false;
+        }
     }
 
     uint8_t *buffer;
@@ -204,7 +247,7 @@ static void upipe_udpsrc_worker(struct upump *upump)
                                                &buffer)))) {
         uref_free(uref);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return;
+        return false;
     }
     assert(output_size == upipe_udpsrc->output_size);
 
@@ -212,11 +255,10 @@ static void upipe_udpsrc_worker(struct upump *upump)
     socklen_t addrlen = sizeof(addr);
 
     ssize_t ret = recvfrom(upipe_udpsrc->fd, buffer, upipe_udpsrc->output_size,
-                        0, (struct sockaddr*)&addr, &addrlen);
+                        flags, (struct sockaddr*)&addr, &addrlen);
     uref_block_unmap(uref, 0);
 
     if (unlikely(ret == -1)) {
-        uref_free(uref);
         switch (errno) {
             case EINTR:
             case EAGAIN:
@@ -224,17 +266,19 @@ static void upipe_udpsrc_worker(struct upump *upump)
             case EWOULDBLOCK:
 #endif
                 /* not an issue, try again later */
-                return;
+                upipe_udpsrc->uref = uref;
+                return false;
             case EBADF:
             case EINVAL:
             case EIO:
             default:
                 break;
         }
+        uref_free(uref);
         upipe_err_va(upipe, "read error from %s (%m)", upipe_udpsrc->uri);
         upipe_udpsrc_set_upump(upipe, NULL);
         upipe_throw_source_end(upipe);
-        return;
+        return false;
     } else if (addrlen != upipe_udpsrc->addrlen ||
         memcmp(&addr, &upipe_udpsrc->addr, addrlen)) {
         upipe_throw(upipe, UPROBE_UDPSRC_NEW_PEER, UPIPE_UDPSRC_SIGNATURE,
@@ -243,6 +287,7 @@ static void upipe_udpsrc_worker(struct upump *upump)
         memcpy(&upipe_udpsrc->addr, &addr, addrlen);
     }
 
+    upipe_udpsrc->stats.packets++;
     if (unlikely(ret == 0)) {
         uref_free(uref);
         if (likely(upipe_udpsrc->uclock == NULL)) {
@@ -250,13 +295,128 @@ static void upipe_udpsrc_worker(struct upump *upump)
             upipe_udpsrc_set_upump(upipe, NULL);
             upipe_throw_source_end(upipe);
         }
-        return;
+        return true;
     }
     if (unlikely(upipe_udpsrc->uclock != NULL))
         uref_clock_set_cr_sys(uref, systime);
     if (unlikely(ret != upipe_udpsrc->output_size))
         uref_block_resize(uref, 0, ret);
     upipe_udpsrc_output(upipe, uref, &upipe_udpsrc->upump);
+    return true;
+}
+
+/** @hidden */
+static void upipe_udpsrc_busy_start(struct upipe *upipe);
+/** @hidden */
+static void upipe_udpsrc_busy_stop(struct upipe *upipe);
+
+/** @internal @This reads data from the source and outputs it.
+ * It is called when data is available on the udp socket descriptor.
+ *
+ * @param upump description structure of the read watcher
+ */
+static void upipe_udpsrc_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc->stats.wakeups++;
+    if (upipe_udpsrc_read(upipe, 0) && upipe_udpsrc->busy_poll &&
+        upipe_udpsrc->upump == upump)
+        upipe_udpsrc_busy_start(upipe);
+}
+
+/** @internal @This reads data from the source without blocking, and falls
+ * back to waiting for the readiness of the socket if no data was received
+ * during the idle period. It is called by an idler in busy-poll mode.
+ *
+ * @param upump description structure of the idler
+ */
+static void upipe_udpsrc_busy_worker(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    upipe_udpsrc->stats.polls++;
+    if (upipe_udpsrc_read(upipe, MSG_DONTWAIT)) {
+        upipe_udpsrc->busy_idle = 0;
+        return;
+    }
+    if (upipe_udpsrc->upump != upump)
+        return;
+
+    upipe_udpsrc->stats.empty_polls++;
+    uint64_t now = upipe_udpsrc_now();
+    if (!upipe_udpsrc->busy_idle)
+        upipe_udpsrc->busy_idle = now;
+    else if (now - upipe_udpsrc->busy_idle >= upipe_udpsrc->busy_poll)
+        upipe_udpsrc_busy_stop(upipe);
+}
+
+/** @internal @This allocates and starts the read watcher of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param busy true for a busy-poll idler, false to wait for the readiness
+ * of the socket
+ * @return an error code
+ */
+static int upipe_udpsrc_alloc_upump(struct upipe *upipe, bool busy)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    struct upump *upump;
+    if (busy)
+        upump = upump_alloc_idler(upipe_udpsrc->upump_mgr,
+                                  upipe_udpsrc_busy_worker, upipe,
+                                  upipe->refcount);
+    else
+        upump = upump_alloc_fd_read(upipe_udpsrc->upump_mgr,
+                                    upipe_udpsrc_worker, upipe, upipe->refcount,
+                                    upipe_udpsrc->fd);
+    if (unlikely(upump == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return UBASE_ERR_UPUMP;
+    }
+    upipe_udpsrc_set_upump(upipe, upump);
+    upipe_udpsrc->busy = busy;
+    upipe_udpsrc->busy_idle = 0;
+    upump_start(upump);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This lets the kernel poll the device queue on empty reads of
+ * the socket while busy-poll is enabled, and stops it otherwise.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_set_sock_busy_poll(struct upipe *upipe)
+{
+#ifdef SO_BUSY_POLL
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (upipe_udpsrc->fd == -1)
+        return;
+    int usec = upipe_udpsrc->busy_poll ? UPIPE_UDPSRC_BUSY_POLL_USEC : 0;
+    if (setsockopt(upipe_udpsrc->fd, SOL_SOCKET, SO_BUSY_POLL,
+                   &usec, sizeof(usec)) < 0)
+        upipe_verbose_va(upipe, "couldn't set SO_BUSY_POLL (%m)");
+#endif
+}
+
+/** @internal @This switches to busy-poll mode.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_busy_start(struct upipe *upipe)
+{
+    struct upipe_udpsrc *upipe_udpsrc = upipe_udpsrc_from_upipe(upipe);
+    if (ubase_check(upipe_udpsrc_alloc_upump(upipe, true)))
+        upipe_udpsrc->stats.busy++;
+}
+
+/** @internal @This falls back to waiting for the readiness of the socket.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsrc_busy_stop(struct upipe *upipe)
+{
+    upipe_udpsrc_alloc_upump(upipe, false);
 }
 
 /** @internal @This checks if the pump may be allocated.
@@ -297,18 +457,8 @@ static int upipe_udpsrc_check(struct upipe *upipe, struct uref *flow_format)
             != NULL)
         return UBASE_ERR_NONE;
 
-    if (upipe_udpsrc->fd != -1 && upipe_udpsrc->upump == NULL) {
-        struct upump *upump;
-        upump = upump_alloc_fd_read(upipe_udpsrc->upump_mgr,
-                                    upipe_udpsrc_worker, upipe, upipe->refcount,
-                                    upipe_udpsrc->fd);
-        if (unlikely(upump == NULL)) {
-            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
-            return UBASE_ERR_UPUMP;
-        }
-        upipe_udpsrc_set_upump(upipe, upump);
-        upump_start(upump);
-    }
+    if (upipe_udpsrc->fd != -1 && upipe_udpsrc->upump == NULL)
+        return upipe_udpsrc_alloc_upump(upipe, false);
     return UBASE_ERR_NONE;
 }
 
@@ -363,6 +513,8 @@ static int upipe_udpsrc_set_uri(struct upipe *upipe, const char *uri)
         return UBASE_ERR_ALLOC;
     }
     upipe_notice_va(upipe, "opening udp socket %s", upipe_udpsrc->uri);
+    if (upipe_udpsrc->busy_poll)
+        upipe_udpsrc_set_sock_busy_poll(upipe);
     return UBASE_ERR_NONE;
 }
 
@@ -414,6 +566,32 @@ static int _upipe_udpsrc_control(struct upipe *upipe,
             UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
             upipe_udpsrc_set_upump(upipe, NULL);
             upipe_udpsrc->fd = va_arg(args, int );
+            if (upipe_udpsrc->busy_poll)
+                upipe_udpsrc_set_sock_busy_poll(upipe);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_GET_BUSY_POLL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            uint64_t *idle_p = va_arg(args, uint64_t *);
+            *idle_p = upipe_udpsrc->busy_poll;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_SET_BUSY_POLL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            bool enabled = !!upipe_udpsrc->busy_poll;
+            upipe_udpsrc->busy_poll = va_arg(args, uint64_t);
+            if (enabled != !!upipe_udpsrc->busy_poll)
+                upipe_udpsrc_set_sock_busy_poll(upipe);
+            if (!upipe_udpsrc->busy_poll && upipe_udpsrc->busy &&
+                upipe_udpsrc->upump != NULL)
+                upipe_udpsrc_busy_stop(upipe);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSRC_GET_POLL_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSRC_SIGNATURE)
+            struct upipe_udpsrc_poll_stats *stats =
+                va_arg(args, struct upipe_udpsrc_poll_stats *);
+            *stats = upipe_udpsrc->stats;
             return UBASE_ERR_NONE;
         }
         default:
@@ -456,6 +634,7 @@ static void upipe_udpsrc_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     free(upipe_udpsrc->uri);
+    uref_free(upipe_udpsrc->uref);
     upipe_udpsrc_clean_output_size(upipe);
     upipe_udpsrc_clean_uclock(upipe);
     upipe_udpsrc_clean_upump(upipe);
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe sampling urefs for tracing and collecting their trace stamps
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upump_trace.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_trace.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_probe_uref.h>
+#include <upipe-modules/uprobe_uref_trace.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** @internal @This returns the statistics of a hop, allocating them the
+ * first time the hop is seen.
+ *
+ * @param uprobe_uref_trace pointer to probe
+ * @param index position of the hop
+ * @param signature signature of the manager of the pipe
+ * @param next_signature signature of the manager of the next pipe
+ * @return pointer to the statistics, or NULL in case of allocation error
+ */
+static struct uprobe_uref_trace_hop *
+    uprobe_uref_trace_get_hop(struct uprobe_uref_trace *uprobe_uref_trace,
+                              unsigned int index, uint32_t signature,
+                              uint32_t next_signature)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_uref_trace->hops, uchain) {
+        struct uprobe_uref_trace_hop *hop =
+            uprobe_uref_trace_hop_from_uchain(uchain);
+        if (hop->index > index)
+            break;
+        if (hop->index == index && hop->signature == signature &&
+            hop->next_signature == next_signature)
+            return hop;
+    }
+
+    struct uprobe_uref_trace_hop *hop =
+        calloc(1, sizeof(struct uprobe_uref_trace_hop));
+    if (unlikely(hop == NULL))
+        return NULL;
+    uchain_init(&hop->uchain);
+    hop->index = index;
+    hop->signature = signature;
+    hop->next_signature = next_signature;
+    /* keep the list sorted by position */
+    ulist_insert(uchain->prev, uchain, uprobe_uref_trace_hop_to_uchain(hop));
+    return hop;
+}
+
+/** @internal @This collects the stamps of a traced uref.
+ *
+ * @param uprobe_uref_trace pointer to probe
+ * @param uref traced uref
+ */
+static void uprobe_uref_trace_collect(
+        struct uprobe_uref_trace *uprobe_uref_trace, struct uref *uref)
+{
+    struct uref_trace_stamp stamps[UREF_TRACE_STAMPS];
+    size_t nb;
+    if (!ubase_check(uref_trace_get(uref, stamps, &nb)) || !nb)
+        return;
+
+    for (size_t i = 0; i + 1 < nb; i++) {
+        struct uprobe_uref_trace_hop *hop =
+            uprobe_uref_trace_get_hop(uprobe_uref_trace, i,
+                                      stamps[i].signature,
+                                      stamps[i + 1].signature);
+        if (likely(hop != NULL))
+            upump_trace_hist_add(&hop->hist,
+                    stamps[i + 1].date > stamps[i].date ?
+                    stamps[i + 1].date - stamps[i].date : 0);
+    }
+    uint64_t total = stamps[nb - 1].date - stamps[0].date;
+    upump_trace_hist_add(&uprobe_uref_trace->total, total);
+    if (uprobe_uref_trace->latency != UINT64_MAX &&
+        total > uprobe_uref_trace->latency)
+        uprobe_uref_trace->exceeded++;
+}
+
+/** @internal @This updates the latency declared by the flow definition of
+ * the collecting pipe.
+ *
+ * @param uprobe_uref_trace pointer to probe
+ * @param upipe collecting pipe
+ */
+static void uprobe_uref_trace_get_latency(
+        struct uprobe_uref_trace *uprobe_uref_trace, struct upipe *upipe)
+{
+    struct uref *flow_def = NULL;
+    uint64_t latency;
+    if (upipe != NULL &&
+        ubase_check(upipe_get_flow_def(upipe, &flow_def)) &&
+        flow_def != NULL &&
+        ubase_check(uref_clock_get_latency(flow_def, &latency)))
+        uprobe_uref_trace->latency = latency;
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_uref_trace_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                   int event, va_list args)
+{
+    struct uprobe_uref_trace *uprobe_uref_trace =
+        uprobe_uref_trace_from_uprobe(uprobe);
+
+    if (event != UPROBE_PROBE_UREF ||
+        ubase_get_signature(args) != UPIPE_PROBE_UREF_SIGNATURE)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    UBASE_SIGNATURE_CHECK(args_copy, UPIPE_PROBE_UREF_SIGNATURE);
+    struct uref *uref = va_arg(args_copy, struct uref *);
+    va_end(args_copy);
+
+    if (uref_trace_check(uref)) {
+        uprobe_uref_trace_get_latency(uprobe_uref_trace, upipe);
+        uprobe_uref_trace_collect(uprobe_uref_trace, uref);
+        uref_trace_stop(uref);
+    } else if (uprobe_uref_trace->sample &&
+               ++uprobe_uref_trace->counter >= uprobe_uref_trace->sample) {
+        uprobe_uref_trace->counter = 0;
+        uref_trace_start(uref);
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This resets the statistics of the probe.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_uref_trace_reset(struct uprobe *uprobe)
+{
+    struct uprobe_uref_trace *uprobe_uref_trace =
+        uprobe_uref_trace_from_uprobe(uprobe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_uref_trace->hops, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        free(uprobe_uref_trace_hop_from_uchain(uchain));
+    }
+    memset(&uprobe_uref_trace->total, 0, sizeof(uprobe_uref_trace->total));
+    uprobe_uref_trace->latency = UINT64_MAX;
+    uprobe_uref_trace->exceeded = 0;
+}
+
+/** @internal @This prints the statistics of a histogram.
+ *
+ * @param uprobe pointer to probe
+ * @param name name of the hop
+ * @param hist pointer to histogram
+ */
+static void uprobe_uref_trace_print_hist(struct uprobe *uprobe,
+                                         const char *name,
+                                         const struct upump_trace_hist *hist)
+{
+    if (!hist->count)
+        return;
+    uprobe_notice_va(uprobe, NULL,
+            "trace %s: %" PRIu64 " urefs, mean %" PRIu64 " us, max %"
+            PRIu64 " us", name, hist->count,
+            hist->total / hist->count / (UCLOCK_FREQ / 1000000),
+            hist->max / (UCLOCK_FREQ / 1000000));
+}
+
+/** @This prints the statistics of the probe, one line per hop, at the
+ * notice level, and a warning if urefs exceeded the declared latency.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_uref_trace_print(struct uprobe *uprobe)
+{
+    struct uprobe_uref_trace *uprobe_uref_trace =
+        uprobe_uref_trace_from_uprobe(uprobe);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_uref_trace->hops, uchain) {
+        struct uprobe_uref_trace_hop *hop =
+            uprobe_uref_trace_hop_from_uchain(uchain);
+        char name[32];
+        snprintf(name, sizeof(name), "#%u %4.4s -> %4.4s", hop->index,
+                 (const char *)&hop->signature,
+                 (const char *)&hop->next_signature);
+        uprobe_uref_trace_print_hist(uprobe, name, &hop->hist);
+    }
+    uprobe_uref_trace_print_hist(uprobe, "total", &uprobe_uref_trace->total);
+    if (uprobe_uref_trace->exceeded)
+        uprobe_warn_va(uprobe, NULL,
+                "trace: %" PRIu64 " urefs exceeded the declared latency of %"
+                PRIu64 " us", uprobe_uref_trace->exceeded,
+                uprobe_uref_trace->latency / (UCLOCK_FREQ / 1000000));
+}
+
+/** @This initializes an already allocated uprobe_uref_trace structure.
+ *
+ * @param uprobe_uref_trace pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param sample trace one untraced uref out of sample, or 0 to only collect
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_uref_trace_init(
+        struct uprobe_uref_trace *uprobe_uref_trace,
+        struct uprobe *next, unsigned int sample)
+{
+    assert(uprobe_uref_trace != NULL);
+    struct uprobe *uprobe = uprobe_uref_trace_to_uprobe(uprobe_uref_trace);
+    uprobe_uref_trace->sample = sample;
+    uprobe_uref_trace->counter = 0;
+    ulist_init(&uprobe_uref_trace->hops);
+    memset(&uprobe_uref_trace->total, 0, sizeof(uprobe_uref_trace->total));
+    uprobe_uref_trace->latency = UINT64_MAX;
+    uprobe_uref_trace->exceeded = 0;
+    uprobe_init(uprobe, uprobe_uref_trace_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_uref_trace structure.
+ *
+ * @param uprobe_uref_trace structure to clean
+ */
+void uprobe_uref_trace_clean(struct uprobe_uref_trace *uprobe_uref_trace)
+{
+    assert(uprobe_uref_trace != NULL);
+    struct uprobe *uprobe = uprobe_uref_trace_to_uprobe(uprobe_uref_trace);
+    uprobe_uref_trace_reset(uprobe);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, unsigned int sample
+#define ARGS next, sample
+UPROBE_HELPER_ALLOC(uprobe_uref_trace)
+#undef ARGS
+#undef ARGS_DECL
@@ -31,6 +31,7 @@
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf.h>
 #include <upipe/uclock.h>
+#include <upipe/ustats.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
@@ -70,6 +71,8 @@ struct upipe_ts_decaps {
 
     /** lost packets based on cc errors */
     uint64_t lost;
+    /** exported number of cc errors */
+    struct ustats_record *cc_errors_stats;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -104,6 +107,8 @@ static struct upipe *upipe_ts_decaps_alloc(struct upipe_mgr *mgr,
     upipe_ts_decaps->lost = 0;
     upipe_ts_decaps->last_uref = NULL;
     upipe_throw_ready(upipe);
+    upipe_ts_decaps->cc_errors_stats =
+        upipe_ustats_register(upipe, USTATS_COUNTER, "cc_errors");
     return upipe;
 }
 
@@ -203,6 +208,7 @@ static void upipe_ts_decaps_input(struct upipe *upipe, struct uref *uref,
         }
         upipe_warn_va(upipe, "potentially lost 16 packets");
         upipe_ts_decaps->lost += 16;
+        ustats_counter_add(upipe_ts_decaps->cc_errors_stats, 1);
         discontinuity = true;
     }
 
@@ -210,6 +216,7 @@ static void upipe_ts_decaps_input(struct upipe *upipe, struct uref *uref,
                  ts_check_discontinuity(cc, upipe_ts_decaps->last_cc))) {
         int lost = (0x10 + cc - upipe_ts_decaps->last_cc - 1) & 0xf;
         upipe_ts_decaps->lost += lost;
+        ustats_counter_add(upipe_ts_decaps->cc_errors_stats, 1);
         upipe_warn_va(upipe, "potentially lost %d packets", lost);
         discontinuity = true;
     }
@@ -301,6 +308,7 @@ static void upipe_ts_decaps_free(struct upipe *upipe)
 
     struct upipe_ts_decaps *upipe_ts_decaps = upipe_ts_decaps_from_upipe(upipe);
     uref_free(upipe_ts_decaps->last_uref);
+    ustats_unregister(upipe_ts_decaps->cc_errors_stats);
     upipe_ts_decaps_clean_output(upipe);
     upipe_ts_decaps_clean_urefcount(upipe);
     upipe_ts_decaps_free_void(upipe);
@@ -26,7 +26,8 @@
  * until ts_psi_split
  * @item output source pipe, which is returned to the application, and
  * represents an elementary stream; it sets up the ts_decaps, pes_decaps and
- * framer inner pipes
+ * framer inner pipes, or a fused ts_fastd pipe instead of ts_decaps and
+ * pes_decaps for PES streams
  * @item program split pipe, which is returned to the application, and
  * represents a program; it sets up the ts_split_output and ts_pmtd inner pipes
  * @item demux sink pipe which sets up the ts_split, ts_patd and optional input
@@ -70,6 +71,7 @@
 #include <upipe-modules/upipe_idem.h>
 #include <upipe-modules/upipe_setflowdef.h>
 #include <upipe-modules/upipe_probe_uref.h>
+#include <upipe-modules/upipe_worker_linear.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/uref_ts_event.h>
 #include <upipe-ts/upipe_ts_demux.h>
@@ -77,6 +79,7 @@
 #include <upipe-ts/upipe_ts_sync.h>
 #include <upipe-ts/upipe_ts_check.h>
 #include <upipe-ts/upipe_ts_decaps.h>
+#include <upipe-ts/upipe_ts_fast_decaps.h>
 #include <upipe-ts/upipe_ts_eit_decoder.h>
 #include <upipe-ts/upipe_ts_nit_decoder.h>
 #include <upipe-ts/upipe_ts_psi_merge.h>
@@ -124,6 +127,8 @@
 #define EITS_TABLEIDS 16
 /** teletext frame rate */
 #define TELX_FPS 25
+/** length of the queues to and from framer workers */
+#define WORKER_QUEUE_LENGTH 255
 
 /** @internal @This is the private context of a ts_demux manager. */
 struct upipe_ts_demux_mgr {
@@ -178,9 +183,19 @@ struct upipe_ts_demux_mgr {
     /* ES */
     /** pointer to ts_pesd manager */
     struct upipe_mgr *ts_pesd_mgr;
+    /** pointer to ts_fastd manager, or NULL to use ts_decaps and ts_pesd */
+    struct upipe_mgr *ts_fastd_mgr;
     /** pointer to autof manager */
     struct upipe_mgr *autof_mgr;
 
+    /* workers */
+    /** number of framer workers */
+    unsigned int nb_workers;
+    /** wlin managers of the framer workers */
+    struct upipe_mgr *work_mgrs[UPIPE_TS_DEMUX_MAX_WORKERS];
+    /** probe hierarchies used in the framer workers */
+    struct uprobe *work_probes[UPIPE_TS_DEMUX_MAX_WORKERS];
+
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
 };
@@ -216,6 +231,10 @@ struct upipe_ts_demux {
     struct uchain input_request_list;
     /** pointer to input inner pipe */
     struct upipe *input;
+    /** pointer to input inner pipe if it is a ts_sync, or NULL */
+    struct upipe *sync;
+    /** bitmap of the PIDs needed by ts_split, for the ts_sync PID filter */
+    uint64_t pids[MAX_PIDS / 64];
     /** true if we have thrown the sync_acquired event */
     bool acquired;
     /** flow definition of the input */
@@ -284,6 +303,8 @@ struct upipe_ts_demux {
     bool auto_conformance;
     /** current conformance */
     enum upipe_ts_conformance conformance;
+    /** framer worker given to the next allocated program */
+    unsigned int next_worker;
 
     /** probe to get new flow events from inner pipes created by psi_pid
      * objects */
@@ -357,6 +378,8 @@ struct upipe_ts_demux_program {
     struct uref *flow_def_input;
     /** program number */
     uint64_t program;
+    /** framer worker of the elementary streams of the program */
+    unsigned int worker;
     /** psi_pid structure for PMT */
     struct upipe_ts_demux_psi_pid *psi_pid_pmt;
     /** ts_psi_split_output inner pipe */
@@ -776,6 +799,24 @@ static int upipe_ts_demux_output_plumber(struct upipe *upipe,
             return UBASE_ERR_ALLOC;
         }
 
+        /* PES streams use the fused decaps if available */
+        struct upipe_mgr *decaps_mgr = ts_demux_mgr->ts_decaps_mgr;
+        if (!ubase_ncmp(def, "block.mpegts.mpegtspes.") &&
+            ts_demux_mgr->ts_fastd_mgr != NULL)
+            decaps_mgr = ts_demux_mgr->ts_fastd_mgr;
+
+        if (upipe_ts_demux_output->decaps->mgr != decaps_mgr) {
+            struct upipe *decaps = upipe_void_alloc(decaps_mgr,
+                    uprobe_pfx_alloc(uprobe_use(&upipe_ts_demux_output->probe),
+                        UPROBE_LOG_VERBOSE,
+                        decaps_mgr == ts_demux_mgr->ts_fastd_mgr ?
+                        "fastd" : "decaps"));
+            if (likely(decaps != NULL)) {
+                upipe_release(upipe_ts_demux_output->decaps);
+                upipe_ts_demux_output->decaps = decaps;
+            }
+        }
+
         upipe_set_output(inner, upipe_ts_demux_output->decaps);
         return UBASE_ERR_NONE;
     }
@@ -823,6 +864,37 @@ static int upipe_ts_demux_output_plumber(struct upipe *upipe,
         upipe_release(inner);
     }
 
+    if (ts_demux_mgr->autof_mgr != NULL && ts_demux_mgr->nb_workers) {
+        /* allocate autof inner in the worker thread of the program */
+        unsigned int worker = program->worker % ts_demux_mgr->nb_workers;
+        struct upipe *framer = upipe_void_alloc(ts_demux_mgr->autof_mgr,
+                uprobe_pfx_alloc(
+                    uprobe_use(ts_demux_mgr->work_probes[worker]),
+                    UPROBE_LOG_VERBOSE, "autof"));
+        if (unlikely(framer == NULL))
+            return UBASE_ERR_ALLOC;
+
+        struct upipe *output = upipe_wlin_alloc(
+                ts_demux_mgr->work_mgrs[worker],
+                uprobe_pfx_alloc(
+                    uprobe_use(&upipe_ts_demux_output->last_inner_probe),
+                    UPROBE_LOG_VERBOSE, "autof_w"),
+                framer,
+                uprobe_pfx_alloc(
+                    uprobe_use(ts_demux_mgr->work_probes[worker]),
+                    UPROBE_LOG_VERBOSE, "autof_wx"),
+                WORKER_QUEUE_LENGTH, WORKER_QUEUE_LENGTH);
+        if (unlikely(output == NULL))
+            return UBASE_ERR_ALLOC;
+        int err = upipe_set_output(inner, output);
+        if (unlikely(!ubase_check(err))) {
+            upipe_release(output);
+            return err;
+        }
+        upipe_ts_demux_output_store_bin_output(upipe, output);
+        return UBASE_ERR_NONE;
+    }
+
     if (ts_demux_mgr->autof_mgr != NULL) {
         /* allocate autof inner */
         struct upipe *output =
@@ -1400,6 +1472,11 @@ static int upipe_ts_demux_configure_eit(struct upipe *upipe,
     }
     uref_free(flow_def);
 
+    /* repeated EIT sections are dropped before reaching the decoder */
+    if (unlikely(!ubase_check(upipe_ts_psi_split_sub_set_cache(
+                        upipe_ts_demux_program->psi_split_output_eit, true))))
+        upipe_warn(upipe, "unable to enable the EIT section cache");
+
     /* allocate EIT decoder */
     upipe_ts_demux_program->eitd =
         upipe_void_alloc_output(upipe_ts_demux_program->psi_split_output_eit,
@@ -1487,6 +1564,11 @@ static int upipe_ts_demux_configure_eits(struct upipe *upipe,
     }
     uref_free(flow_def);
 
+    /* repeated EITs sections are dropped before reaching the decoder */
+    if (unlikely(!ubase_check(upipe_ts_psi_split_sub_set_cache(
+                    upipe_ts_demux_program->psi_split_output_eits[n], true))))
+        upipe_warn(upipe, "unable to enable the EITs section cache");
+
     /* allocate EIT decoder */
     upipe_ts_demux_program->eitsd[n] =
         upipe_void_alloc_output(upipe_ts_demux_program->psi_split_output_eits[n],
@@ -2003,6 +2085,8 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux_program_init_sub_outputs(upipe);
     upipe_ts_demux_program->flow_def_input = flow_def;
     upipe_ts_demux_program->program = 0;
+    upipe_ts_demux_program->worker =
+        upipe_ts_demux_from_program_mgr(mgr)->next_worker++;
     upipe_ts_demux_program->pmt_rap = 0;
     upipe_ts_demux_program->pcr_pid = 0;
     upipe_ts_demux_program->pcr_split_output = NULL;
@@ -2525,6 +2609,11 @@ static void upipe_ts_demux_update_nit(struct upipe *upipe)
     }
     uref_free(flow_def);
 
+    /* repeated NIT sections are dropped before reaching the decoder */
+    if (unlikely(!ubase_check(upipe_ts_psi_split_sub_set_cache(
+                        upipe_ts_demux->psi_split_output_nit, true))))
+        upipe_warn(upipe, "unable to enable the NIT section cache");
+
     /* allocate NIT decoder */
     struct upipe_ts_demux_mgr *ts_demux_mgr =
         upipe_ts_demux_mgr_from_upipe_mgr(upipe->mgr);
@@ -2599,6 +2688,11 @@ static void upipe_ts_demux_update_sdt(struct upipe *upipe)
     }
     uref_free(flow_def);
 
+    /* repeated SDT sections are dropped before reaching the decoder */
+    if (unlikely(!ubase_check(upipe_ts_psi_split_sub_set_cache(
+                        upipe_ts_demux->psi_split_output_sdt, true))))
+        upipe_warn(upipe, "unable to enable the SDT section cache");
+
     /* allocate SDT decoder */
     struct upipe_ts_demux_mgr *ts_demux_mgr =
         upipe_ts_demux_mgr_from_upipe_mgr(upipe->mgr);
@@ -3107,6 +3201,36 @@ static int upipe_ts_demux_input_probe(struct uprobe *uprobe,
     }
 }
 
+/** @internal @This keeps track of the PIDs needed by the split inner pipe,
+ * and forwards them to the PID filter of the ts_sync inner pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param event event triggered by the split inner pipe
+ * @param args arguments of the event
+ */
+static void upipe_ts_demux_split_pid(struct upipe *upipe, int event,
+                                     va_list args)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    unsigned int signature = va_arg(args_copy, unsigned int);
+    unsigned int pid = va_arg(args_copy, unsigned int);
+    va_end(args_copy);
+    if (signature != UPIPE_TS_SPLIT_SIGNATURE || pid >= MAX_PIDS)
+        return;
+
+    if (event == UPROBE_TS_SPLIT_ADD_PID) {
+        upipe_ts_demux->pids[pid / 64] |= UINT64_C(1) << (pid % 64);
+        if (upipe_ts_demux->sync != NULL)
+            upipe_ts_sync_add_pid(upipe_ts_demux->sync, pid);
+    } else {
+        upipe_ts_demux->pids[pid / 64] &= ~(UINT64_C(1) << (pid % 64));
+        if (upipe_ts_demux->sync != NULL)
+            upipe_ts_sync_del_pid(upipe_ts_demux->sync, pid);
+    }
+}
+
 /** @internal @This catches events coming from split inner pipe.
  *
  * @param uprobe pointer to the probe in upipe_ts_demux
@@ -3126,6 +3250,8 @@ static int upipe_ts_demux_split_probe(struct uprobe *uprobe,
     switch (event) {
         case UPROBE_TS_SPLIT_ADD_PID:
         case UPROBE_TS_SPLIT_DEL_PID:
+            upipe_ts_demux_split_pid(upipe, event, args);
+            return upipe_throw_proxy(upipe, inner, event, args);
         default:
             return upipe_throw_proxy(upipe, inner, event, args);
     }
@@ -3195,6 +3321,9 @@ static struct upipe *upipe_ts_demux_alloc(struct upipe_mgr *mgr,
     ulist_init(&upipe_ts_demux->psi_pids);
     upipe_ts_demux->conformance = UPIPE_TS_CONFORMANCE_DVB_NO_TABLES;
     upipe_ts_demux->auto_conformance = true;
+    upipe_ts_demux->next_worker = 0;
+    upipe_ts_demux->sync = NULL;
+    memset(upipe_ts_demux->pids, 0, sizeof(upipe_ts_demux->pids));
     upipe_ts_demux->nit_pid = 0;
     upipe_ts_demux->flow_def_input = NULL;
 
@@ -3361,6 +3490,7 @@ static int upipe_ts_demux_set_flow_def(struct upipe *upipe,
     struct upipe_ts_demux_mgr *ts_demux_mgr =
         upipe_ts_demux_mgr_from_upipe_mgr(upipe->mgr);
     struct upipe *input;
+    upipe_ts_demux->sync = NULL;
     if (ubase_ncmp(def, EXPECTED_FLOW_DEF_SYNC)) {
         if (!ubase_ncmp(def, EXPECTED_FLOW_DEF_CHECK))
             /* allocate ts_check inner pipe */
@@ -3378,6 +3508,15 @@ static int upipe_ts_demux_set_flow_def(struct upipe *upipe,
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
             return UBASE_ERR_ALLOC;
         }
+        if (input->mgr == ts_demux_mgr->ts_sync_mgr &&
+            ubase_check(upipe_ts_sync_set_pid_filter(input, true))) {
+            /* drop the packets of unwanted PIDs before uref allocation */
+            upipe_ts_demux->sync = input;
+            for (unsigned int pid = 0; pid < MAX_PIDS; pid++)
+                if (upipe_ts_demux->pids[pid / 64] &
+                    (UINT64_C(1) << (pid % 64)))
+                    upipe_ts_sync_add_pid(input, pid);
+        }
         upipe_ts_demux_store_bin_input(upipe, input);
         upipe_set_output(input, upipe_ts_demux->setrap);
 
@@ -3565,7 +3704,9 @@ static void upipe_ts_demux_free(struct urefcount *urefcount_real)
 static void upipe_ts_demux_no_input(struct upipe *upipe)
 {
     struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
-    /* release the packet blocked in ts_sync */
+    /* release the packet blocked in ts_sync, which no longer receives the
+     * DEL_PID events thrown below */
+    upipe_ts_demux->sync = NULL;
     upipe_ts_demux_store_bin_input(upipe, NULL);
 
     upipe_ts_demux_throw_sub_programs(upipe, UPROBE_SOURCE_END);
@@ -3656,6 +3797,20 @@ static void upipe_ts_demux_no_input(struct upipe *upipe)
     urefcount_release(upipe_ts_demux_to_urefcount_real(upipe_ts_demux));
 }
 
+/** @internal @This releases all framer workers of a ts_demux manager.
+ *
+ * @param ts_demux_mgr pointer to the private manager structure
+ */
+static void upipe_ts_demux_mgr_clear_workers_mgr(
+        struct upipe_ts_demux_mgr *ts_demux_mgr)
+{
+    for (unsigned int i = 0; i < ts_demux_mgr->nb_workers; i++) {
+        upipe_mgr_release(ts_demux_mgr->work_mgrs[i]);
+        uprobe_release(ts_demux_mgr->work_probes[i]);
+    }
+    ts_demux_mgr->nb_workers = 0;
+}
+
 /** @This frees a upipe manager.
  *
  * @param urefcount pointer to urefcount structure
@@ -3683,8 +3838,10 @@ static void upipe_ts_demux_mgr_free(struct urefcount *urefcount)
     upipe_mgr_release(ts_demux_mgr->ts_pmtd_mgr);
     upipe_mgr_release(ts_demux_mgr->ts_eitd_mgr);
     upipe_mgr_release(ts_demux_mgr->ts_pesd_mgr);
+    upipe_mgr_release(ts_demux_mgr->ts_fastd_mgr);
     upipe_mgr_release(ts_demux_mgr->ts_scte35d_mgr);
     upipe_mgr_release(ts_demux_mgr->autof_mgr);
+    upipe_ts_demux_mgr_clear_workers_mgr(ts_demux_mgr);
 
     urefcount_clean(urefcount);
     free(ts_demux_mgr);
@@ -3740,10 +3897,38 @@ static int upipe_ts_demux_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(ts_eitd, TS_EITD)
         GET_SET_MGR(ts_pesd, TS_PESD)
         GET_SET_MGR(ts_scte35d, TS_SCTE35D)
+        GET_SET_MGR(ts_fastd, TS_FASTD)
 
         GET_SET_MGR(autof, AUTOF)
 #undef GET_SET_MGR
 
+        case UPIPE_TS_DEMUX_MGR_ADD_WORKER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_mgr *m = va_arg(args, struct upipe_mgr *);
+            struct uprobe *uprobe = va_arg(args, struct uprobe *);
+            if (!urefcount_single(&ts_demux_mgr->urefcount)) {
+                uprobe_release(uprobe);
+                return UBASE_ERR_BUSY;
+            }
+            if (unlikely(m == NULL ||
+                         ts_demux_mgr->nb_workers >=
+                            UPIPE_TS_DEMUX_MAX_WORKERS)) {
+                uprobe_release(uprobe);
+                return UBASE_ERR_INVALID;
+            }
+            ts_demux_mgr->work_mgrs[ts_demux_mgr->nb_workers] =
+                upipe_mgr_use(m);
+            ts_demux_mgr->work_probes[ts_demux_mgr->nb_workers++] = uprobe;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_DEMUX_MGR_CLEAR_WORKERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            if (!urefcount_single(&ts_demux_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            upipe_ts_demux_mgr_clear_workers_mgr(ts_demux_mgr);
+            return UBASE_ERR_NONE;
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -3783,6 +3968,7 @@ struct upipe_mgr *upipe_ts_demux_mgr_alloc(void)
     ts_demux_mgr->ts_pmtd_mgr = upipe_ts_pmtd_mgr_alloc();
     ts_demux_mgr->ts_eitd_mgr = upipe_ts_eitd_mgr_alloc();
     ts_demux_mgr->ts_pesd_mgr = upipe_ts_pesd_mgr_alloc();
+    ts_demux_mgr->ts_fastd_mgr = upipe_ts_fastd_mgr_alloc();
     ts_demux_mgr->ts_scte35d_mgr = upipe_ts_scte35d_mgr_alloc();
 
     ts_demux_mgr->autof_mgr = NULL;
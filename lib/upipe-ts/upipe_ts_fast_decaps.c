@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2012-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module decapsulating (removing) TS and PES headers of TS
+ * packets in a single pass
+ *
+ * The TS header, adaptation field and PES header are parsed from a single
+ * mapping of the packet, and the payload is output with a single resize.
+ * PES headers spanning several TS packets are reassembled as in ts_pesd.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/ubuf.h>
+#include <upipe/uclock.h>
+#include <upipe/ustats.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_sync.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-ts/upipe_ts_fast_decaps.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+
+/** we only accept TS packets that contain PES headers when unit start is
+ * true */
+#define EXPECTED_FLOW_DEF "block.mpegts.mpegtspes."
+/** 2^33 (max resolution of PCR, PTS and DTS) */
+#define POW2_33 UINT64_C(8589934592)
+/** max DTS/PTS delay */
+#define MAX_DELAY (UCLOCK_FREQ * 60)
+/** max size of a PES header */
+#define MAX_PES_HEADER_SIZE (PES_HEADER_SIZE_NOPTS + UINT8_MAX)
+
+/** @internal @This is the private context of a ts_fastd pipe. */
+struct upipe_ts_fastd {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** last continuity counter for this PID, or -1 */
+    int8_t last_cc;
+    /** last TS payload */
+    struct uref *last_uref;
+    /** lost packets based on cc errors */
+    uint64_t lost;
+    /** cc errors statistics record */
+    struct ustats_record *cc_errors_stats;
+
+    /** next uref to be processed */
+    struct uref *next_uref;
+    /** size of next uref */
+    size_t next_uref_size;
+    /** size of next PES */
+    size_t next_pes_size;
+    /** true if we have thrown the sync_acquired event */
+    bool acquired;
+    /** true if subsequent (non-start) packets have to be dropped */
+    bool drop;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @internal @This is the result of the parsing of a PES header. */
+enum upipe_ts_fastd_pes_status {
+    /** more data is needed */
+    UPIPE_TS_FASTD_PES_SHORT,
+    /** the header is invalid */
+    UPIPE_TS_FASTD_PES_INVALID,
+    /** the PES is padding */
+    UPIPE_TS_FASTD_PES_PADDING,
+    /** the header is valid */
+    UPIPE_TS_FASTD_PES_VALID,
+};
+
+/** @internal @This describes a parsed PES header. */
+struct upipe_ts_fastd_pes {
+    /** error message if the header is invalid */
+    const char *error;
+    /** PES length field */
+    uint16_t length;
+    /** size of the PES header */
+    size_t header_size;
+    /** true if the header carries timestamps */
+    bool has_pts;
+    /** true if the timestamps have a correct syntax */
+    bool valid_ts;
+    /** PTS */
+    uint64_t pts;
+    /** DTS */
+    uint64_t dts;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_fastd, upipe, UPIPE_TS_FASTD_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_fastd, urefcount, upipe_ts_fastd_free)
+UPIPE_HELPER_VOID(upipe_ts_fastd)
+UPIPE_HELPER_SYNC(upipe_ts_fastd, acquired)
+UPIPE_HELPER_OUTPUT(upipe_ts_fastd, output, flow_def, output_state, request_list)
+
+/** @internal @This allocates a ts_fastd pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_fastd_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_fastd_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    upipe_ts_fastd_init_urefcount(upipe);
+    upipe_ts_fastd_init_sync(upipe);
+    upipe_ts_fastd_init_output(upipe);
+    upipe_ts_fastd->last_cc = -1;
+    upipe_ts_fastd->last_uref = NULL;
+    upipe_ts_fastd->lost = 0;
+    upipe_ts_fastd->drop = true;
+    upipe_ts_fastd->next_uref = NULL;
+    upipe_ts_fastd->next_uref_size = 0;
+    upipe_ts_fastd->next_pes_size = 0;
+    upipe_throw_ready(upipe);
+    upipe_ts_fastd->cc_errors_stats =
+        upipe_ustats_register(upipe, USTATS_COUNTER, "cc_errors");
+    return upipe;
+}
+
+/** @internal @This flushes the PES being reassembled.
+ *
+ * @param upipe description structure of the pipe
+ * @param lost true if the sync was lost
+ */
+static void upipe_ts_fastd_flush(struct upipe *upipe, bool lost)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    if (upipe_ts_fastd->next_uref != NULL) {
+        uref_free(upipe_ts_fastd->next_uref);
+        upipe_ts_fastd->next_uref = NULL;
+        upipe_ts_fastd->next_uref_size = 0;
+    }
+    if (lost)
+        upipe_ts_fastd_sync_lost(upipe);
+    upipe_ts_fastd->drop = true;
+}
+
+/** @internal @This outputs a PES chunk, and checks if it is the end of the
+ * PES.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_fastd_check_output(struct upipe *upipe,
+                                        struct upump **upump_p)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    upipe_ts_fastd_sync_acquired(upipe);
+    upipe_ts_fastd->drop = false;
+    if (upipe_ts_fastd->next_uref_size == upipe_ts_fastd->next_pes_size) {
+        uref_block_set_end(upipe_ts_fastd->next_uref);
+        upipe_ts_fastd->next_uref_size = upipe_ts_fastd->next_pes_size = 0;
+    }
+    upipe_ts_fastd_output(upipe, upipe_ts_fastd->next_uref, upump_p);
+    upipe_ts_fastd->next_uref = NULL;
+}
+
+/** @internal @This parses a PES header from a buffer.
+ *
+ * @param p pointer to the beginning of the PES
+ * @param size number of bytes available
+ * @param pes filled in with the parsed header
+ * @return the status of the parsing
+ */
+static enum upipe_ts_fastd_pes_status
+    upipe_ts_fastd_parse_pes(const uint8_t *p, size_t size,
+                             struct upipe_ts_fastd_pes *pes)
+{
+    if (size < PES_HEADER_SIZE)
+        return UPIPE_TS_FASTD_PES_SHORT;
+
+    if (unlikely(!pes_validate(p))) {
+        pes->error = "wrong PES header";
+        return UPIPE_TS_FASTD_PES_INVALID;
+    }
+
+    uint8_t streamid = pes_get_streamid(p);
+    if (unlikely(streamid == PES_STREAM_ID_PADDING))
+        return UPIPE_TS_FASTD_PES_PADDING;
+
+    pes->length = pes_get_length(p);
+    pes->has_pts = false;
+    if (streamid == PES_STREAM_ID_PSM ||
+        streamid == PES_STREAM_ID_PRIVATE_2 ||
+        streamid == PES_STREAM_ID_ECM ||
+        streamid == PES_STREAM_ID_EMM ||
+        streamid == PES_STREAM_ID_PSD ||
+        streamid == PES_STREAM_ID_DSMCC ||
+        streamid == PES_STREAM_ID_H222_1_E) {
+        pes->header_size = PES_HEADER_SIZE;
+        return UPIPE_TS_FASTD_PES_VALID;
+    }
+
+    if (unlikely(pes->length != 0 &&
+                 pes->length < PES_HEADER_OPTIONAL_SIZE)) {
+        pes->error = "wrong PES length";
+        return UPIPE_TS_FASTD_PES_INVALID;
+    }
+
+    if (size < PES_HEADER_SIZE_NOPTS)
+        return UPIPE_TS_FASTD_PES_SHORT;
+
+    if (unlikely(!pes_validate_header(p))) {
+        pes->error = "wrong PES optional header";
+        return UPIPE_TS_FASTD_PES_INVALID;
+    }
+
+    bool has_pts = pes_has_pts(p);
+    bool has_dts = pes_has_dts(p);
+    uint8_t headerlength = pes_get_headerlength(p);
+    if (unlikely((pes->length != 0 &&
+                  headerlength + PES_HEADER_OPTIONAL_SIZE > pes->length) ||
+                 (has_pts && headerlength < PES_HEADER_SIZE_PTS -
+                                            PES_HEADER_SIZE_NOPTS) ||
+                 (has_dts && headerlength < PES_HEADER_SIZE_PTSDTS -
+                                            PES_HEADER_SIZE_NOPTS))) {
+        pes->error = "wrong PES header length";
+        return UPIPE_TS_FASTD_PES_INVALID;
+    }
+
+    pes->header_size = PES_HEADER_SIZE_NOPTS + headerlength;
+    if (size < pes->header_size)
+        return UPIPE_TS_FASTD_PES_SHORT;
+
+    if (has_pts) {
+        pes->has_pts = true;
+        pes->valid_ts = pes_validate_pts(p);
+        pes->pts = pes_get_pts(p);
+        if (has_dts) {
+            pes->valid_ts = pes->valid_ts && pes_validate_dts(p);
+            pes->dts = pes_get_dts(p);
+        } else
+            pes->dts = pes->pts;
+    }
+    return UPIPE_TS_FASTD_PES_VALID;
+}
+
+/** @internal @This applies a parsed PES header to the PES being
+ * reassembled, and outputs it.
+ *
+ * @param upipe description structure of the pipe
+ * @param status status of the parsing
+ * @param pes parsed header
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_fastd_decaps(struct upipe *upipe,
+                                  enum upipe_ts_fastd_pes_status status,
+                                  const struct upipe_ts_fastd_pes *pes,
+                                  struct upump **upump_p)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    switch (status) {
+        case UPIPE_TS_FASTD_PES_SHORT:
+            return;
+        case UPIPE_TS_FASTD_PES_INVALID:
+            upipe_warn(upipe, pes->error);
+            upipe_ts_fastd_flush(upipe, true);
+            return;
+        case UPIPE_TS_FASTD_PES_PADDING:
+            upipe_ts_fastd_flush(upipe, false);
+            return;
+        case UPIPE_TS_FASTD_PES_VALID:
+            break;
+    }
+
+    if (pes->length)
+        upipe_ts_fastd->next_pes_size = pes->length + PES_HEADER_SIZE;
+    else
+        upipe_ts_fastd->next_pes_size = 0;
+
+    if (pes->has_pts) {
+        if (unlikely(!pes->valid_ts))
+            upipe_warn(upipe, "wrong PES timestamp syntax");
+
+        uint64_t dts_pts_delay = (POW2_33 + pes->pts - pes->dts) % POW2_33;
+        dts_pts_delay *= UCLOCK_FREQ / 90000;
+        if (dts_pts_delay > MAX_DELAY) {
+            upipe_warn_va(upipe, "invalid PTS field (%"PRIu64" < %"PRIu64")",
+                          pes->pts, pes->dts);
+            dts_pts_delay = 0;
+        }
+        uint64_t dts = pes->dts * (UCLOCK_FREQ / 90000);
+        uref_clock_set_dts_orig(upipe_ts_fastd->next_uref, dts);
+        uref_clock_set_dts_pts_delay(upipe_ts_fastd->next_uref, dts_pts_delay);
+        upipe_throw_clock_ts(upipe, upipe_ts_fastd->next_uref);
+    }
+
+    UBASE_FATAL(upipe, uref_block_resize(upipe_ts_fastd->next_uref,
+                                         pes->header_size, -1))
+    upipe_ts_fastd_check_output(upipe, upump_p);
+}
+
+/** @internal @This parses the PES header of a PES being reassembled across
+ * several TS packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_fastd_decaps_slow(struct upipe *upipe,
+                                       struct upump **upump_p)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    uint8_t buffer[MAX_PES_HEADER_SIZE];
+    size_t size = upipe_ts_fastd->next_uref_size;
+    if (size > MAX_PES_HEADER_SIZE)
+        size = MAX_PES_HEADER_SIZE;
+    if (unlikely(!ubase_check(uref_block_extract(upipe_ts_fastd->next_uref,
+                                                 0, size, buffer)))) {
+        upipe_ts_fastd_flush(upipe, false);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    struct upipe_ts_fastd_pes pes;
+    enum upipe_ts_fastd_pes_status status =
+        upipe_ts_fastd_parse_pes(buffer, size, &pes);
+    upipe_ts_fastd_decaps(upipe, status, &pes, upump_p);
+}
+
+/** @internal @This parses the TS header, adaptation field and PES header of
+ * a packet, and outputs its payload.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_fastd_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    size_t total_size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &total_size)) ||
+                 total_size < TS_HEADER_SIZE)) {
+        upipe_warn(upipe, "invalid TS packet received");
+        uref_free(uref);
+        return;
+    }
+
+    /* map the whole packet, or copy it if it is segmented */
+    uint8_t buffer[TS_SIZE];
+    const uint8_t *ts;
+    int size = -1;
+    bool mapped = ubase_check(uref_block_read(uref, 0, &size, &ts));
+    if (!mapped || size < total_size) {
+        if (mapped)
+            uref_block_unmap(uref, 0);
+        mapped = false;
+        size = total_size < TS_SIZE ? total_size : TS_SIZE;
+        if (unlikely(!ubase_check(uref_block_extract(uref, 0, size,
+                                                     buffer)))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        ts = buffer;
+    }
+
+    bool transporterror = ts_get_transporterror(ts);
+    bool unitstart = ts_get_unitstart(ts);
+    uint8_t cc = ts_get_cc(ts);
+    bool has_payload = ts_has_payload(ts);
+    size_t header_size = TS_HEADER_SIZE;
+    bool invalid = false;
+    bool discontinuity_flag = false;
+    bool random = false;
+    bool has_pcr = false;
+    uint64_t pcrval = 0;
+    if (unlikely(ts_has_adaptation(ts))) {
+        uint8_t af_length = size > TS_HEADER_SIZE ? ts_get_adaptation(ts) : 0;
+        header_size += af_length + 1;
+        if (unlikely(size <= TS_HEADER_SIZE ||
+                     (!has_payload && af_length != 183) || af_length > 183 ||
+                     header_size > total_size ||
+                     (af_length && size < TS_HEADER_SIZE_AF)))
+            invalid = true;
+        else if (af_length) {
+            discontinuity_flag = tsaf_has_discontinuity(ts);
+            random = tsaf_has_randomaccess(ts);
+            if (tsaf_has_pcr(ts)) {
+                if (unlikely(size < TS_HEADER_SIZE_PCR))
+                    invalid = true;
+                else {
+                    has_pcr = true;
+                    pcrval = (tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts));
+                    pcrval *= UCLOCK_FREQ / 27000000;
+                }
+            }
+        }
+    }
+
+    /* parse the PES header in the same pass, if it fits in the packet */
+    struct upipe_ts_fastd_pes pes;
+    enum upipe_ts_fastd_pes_status status = UPIPE_TS_FASTD_PES_SHORT;
+    if (unitstart && has_payload && !invalid)
+        status = upipe_ts_fastd_parse_pes(ts + header_size,
+                                          size - header_size, &pes);
+    if (mapped)
+        uref_block_unmap(uref, 0);
+
+    if (unlikely(invalid)) {
+        upipe_warn(upipe, "invalid adaptation field received");
+        uref_free(uref);
+        return;
+    }
+
+    UBASE_FATAL(upipe, uref_block_resize(uref, header_size, -1))
+    total_size -= header_size;
+
+    bool discontinuity = upipe_ts_fastd->last_cc == -1;
+    if (unlikely(!discontinuity && discontinuity_flag)) {
+        upipe_warn(upipe, "discontinuity flagged");
+        discontinuity = true;
+    }
+
+    if (unlikely(has_pcr)) {
+        uref_clock_set_ref(uref);
+        upipe_throw_clock_ref(upipe, uref, pcrval, discontinuity ? 1 : 0);
+    }
+
+    if (unlikely(ts_check_duplicate(cc, upipe_ts_fastd->last_cc))) {
+        if (!has_payload) {
+            /* padding or just PCR */
+            uref_free(uref);
+            return;
+        }
+        if (upipe_ts_fastd->last_uref != NULL &&
+            ubase_check(uref_block_compare(uref, 0,
+                                           upipe_ts_fastd->last_uref))) {
+            upipe_dbg(upipe, "removing duplicate packet");
+            uref_free(uref);
+            return;
+        }
+        upipe_warn_va(upipe, "potentially lost 16 packets");
+        upipe_ts_fastd->lost += 16;
+        ustats_counter_add(upipe_ts_fastd->cc_errors_stats, 1);
+        discontinuity = true;
+    }
+
+    if (unlikely(!discontinuity &&
+                 ts_check_discontinuity(cc, upipe_ts_fastd->last_cc))) {
+        int lost = (0x10 + cc - upipe_ts_fastd->last_cc - 1) & 0xf;
+        upipe_ts_fastd->lost += lost;
+        ustats_counter_add(upipe_ts_fastd->cc_errors_stats, 1);
+        upipe_warn_va(upipe, "potentially lost %d packets", lost);
+        discontinuity = true;
+    }
+    upipe_ts_fastd->last_cc = cc;
+
+    if (unlikely(!has_payload)) {
+        uref_free(uref);
+        return;
+    }
+
+    if (unlikely(discontinuity))
+        uref_flow_set_discontinuity(uref);
+    if (unlikely(random))
+        uref_flow_set_random(uref);
+    if (unlikely(unitstart))
+        uref_block_set_start(uref);
+    if (unlikely(transporterror))
+        uref_flow_set_error(uref);
+
+    uref_free(upipe_ts_fastd->last_uref);
+    upipe_ts_fastd->last_uref = uref_dup(uref);
+
+    if (unitstart) {
+        if (unlikely(upipe_ts_fastd->next_uref != NULL)) {
+            upipe_warn(upipe, "truncated PES header");
+            uref_free(upipe_ts_fastd->next_uref);
+        }
+        upipe_ts_fastd->next_uref = uref;
+        upipe_ts_fastd->next_uref_size = total_size;
+        if (likely(status != UPIPE_TS_FASTD_PES_SHORT))
+            upipe_ts_fastd_decaps(upipe, status, &pes, upump_p);
+        else
+            upipe_ts_fastd_decaps_slow(upipe, upump_p);
+
+    } else if (upipe_ts_fastd->next_uref != NULL) {
+        struct ubuf *ubuf = uref_detach_ubuf(uref);
+        uref_free(uref);
+        if (unlikely(!ubase_check(uref_block_append(upipe_ts_fastd->next_uref,
+                                                    ubuf)))) {
+            ubuf_free(ubuf);
+            upipe_ts_fastd_flush(upipe, false);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_ts_fastd->next_uref_size += total_size;
+        upipe_ts_fastd_decaps_slow(upipe, upump_p);
+
+    } else if (likely(!upipe_ts_fastd->drop)) {
+        upipe_ts_fastd->next_uref = uref;
+        upipe_ts_fastd->next_uref_size += total_size;
+        upipe_ts_fastd_check_output(upipe, upump_p);
+
+    } else
+        uref_free(uref);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_fastd_set_flow_def(struct upipe *upipe,
+                                       struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_def, &def))
+    if (ubase_ncmp(def, EXPECTED_FLOW_DEF))
+        return UBASE_ERR_INVALID;
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    if (unlikely(!ubase_check(uref_flow_set_def_va(flow_def_dup, "block.%s",
+                                       def + strlen(EXPECTED_FLOW_DEF)))))
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+    upipe_ts_fastd_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_fastd pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_fastd_control(struct upipe *upipe,
+                                  int command, va_list args)
+{
+    UBASE_HANDLED_RETURN(upipe_ts_fastd_control_output(upipe, command, args));
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_fastd_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_TS_DECAPS_GET_PACKETS_LOST: {
+            struct upipe_ts_fastd *upipe_ts_fastd =
+                upipe_ts_fastd_from_upipe(upipe);
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DECAPS_SIGNATURE)
+            uint64_t *lost = va_arg(args, uint64_t *);
+            *lost = upipe_ts_fastd->lost;
+            upipe_ts_fastd->lost = 0; /* reset counter */
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_fastd_free(struct upipe *upipe)
+{
+    struct upipe_ts_fastd *upipe_ts_fastd = upipe_ts_fastd_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    uref_free(upipe_ts_fastd->last_uref);
+    uref_free(upipe_ts_fastd->next_uref);
+    ustats_unregister(upipe_ts_fastd->cc_errors_stats);
+    upipe_ts_fastd_clean_output(upipe);
+    upipe_ts_fastd_clean_sync(upipe);
+    upipe_ts_fastd_clean_urefcount(upipe);
+    upipe_ts_fastd_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_fastd_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_FASTD_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_fastd_alloc,
+    .upipe_input = upipe_ts_fastd_input,
+    .upipe_control = upipe_ts_fastd_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_fastd pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_fastd_mgr_alloc(void)
+{
+    return &upipe_ts_fastd_mgr;
+}
@@ -50,6 +50,7 @@
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf.h>
 #include <upipe/uclock.h>
+#include <upipe/ustats.h>
 #include <upipe/urefcount_helper.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
@@ -283,6 +284,8 @@ struct upipe_ts_mux {
 
     /** one TS packet of padding */
     struct ubuf *padding;
+    /** exported ratio of padding packets */
+    struct ustats_record *padding_stats;
 
     /** input flow definition */
     struct uref *flow_def_input;
@@ -2539,6 +2542,8 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux->probe.refcount = upipe_ts_mux_to_urefcount_real(upipe_ts_mux);
 
     upipe_throw_ready(upipe);
+    upipe_ts_mux->padding_stats =
+        upipe_ustats_register(upipe, USTATS_RATIO, "padding");
 
     upipe_ts_mux_require_uref_mgr(upipe);
     upipe_ts_mux_update(upipe);
@@ -2787,6 +2792,23 @@ static void upipe_ts_mux_append(struct upipe *upipe, struct ubuf *ubuf,
         uref_block_append(mux->uref, ubuf);
     }
     mux->uref_size += TS_SIZE;
+    ustats_ratio_add(mux->padding_stats, 0, 1);
+}
+
+/** @internal @This appends a TS packet of padding to the current uref.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of allocation error
+ */
+static bool upipe_ts_mux_append_padding(struct upipe *upipe)
+{
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
+    struct ubuf *ubuf = ubuf_dup(mux->padding);
+    if (unlikely(ubuf == NULL))
+        return false;
+    upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
+    ustats_ratio_add(mux->padding_stats, 1, 0);
+    return true;
 }
 
 /** @internal @This completes a uref and outputs it.
@@ -2836,10 +2858,8 @@ static void _upipe_ts_mux_watcher(struct upipe *upipe)
              dts_sys + mux->latency < upipe_ts_mux_show_increment(upipe))) {
             while (mux->uref_size < mux->mtu) {
                 nb_packets++;
-                struct ubuf *ubuf = ubuf_dup(mux->padding);
-                if (ubuf == NULL)
+                if (!upipe_ts_mux_append_padding(upipe))
                     break;
-                upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
             }
         }
 
@@ -2969,10 +2989,8 @@ static void upipe_ts_mux_work_file(struct upipe *upipe, struct upump **upump_p)
         }
 
         while (mux->uref_size < mux->mtu) {
-            struct ubuf *ubuf = ubuf_dup(mux->padding);
-            if (ubuf == NULL)
+            if (!upipe_ts_mux_append_padding(upipe))
                 break;
-            upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
         }
 
         upipe_ts_mux_complete(upipe, upump_p);
@@ -4502,10 +4520,8 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
         size_t uref_size;
         while ((ubase_check(uref_block_size(mux->uref, &uref_size)) &&
                 uref_size < mux->mtu)) {
-            struct ubuf *ubuf = ubuf_dup(mux->padding);
-            if (ubuf == NULL)
+            if (!upipe_ts_mux_append_padding(upipe))
                 break;
-            upipe_ts_mux_append(upipe, ubuf, UINT64_MAX);
         }
 
         upipe_ts_mux_complete(upipe, NULL);
@@ -4513,6 +4529,7 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
 
     upipe_throw_dead(upipe);
 
+    ustats_unregister(mux->padding_stats);
     ubuf_free(mux->padding);
     uref_free(mux->flow_def_input);
     uprobe_clean(&mux->probe);
@@ -45,9 +45,24 @@
 #include <assert.h>
 
 #include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
 
 /** we only accept blocks containing exactly one PSI section */
 #define EXPECTED_FLOW_DEF "block.mpegtspsi."
+/** number of entries of the section fingerprint cache (power of 2) */
+#define CACHE_SIZE 256
+
+/** @internal @This is the fingerprint of a PSI section. */
+struct upipe_ts_psi_split_fp {
+    /** true if the entry is in use */
+    bool valid;
+    /** table id, table id extension and section number */
+    uint32_t key;
+    /** version number */
+    uint8_t version;
+    /** CRC_32 of the section */
+    uint32_t crc;
+};
 
 /** @internal @This is the private context of a ts_psi_split pipe. */
 struct upipe_ts_psi_split {
@@ -92,6 +107,13 @@ struct upipe_ts_psi_split_sub {
     /** list of output requests */
     struct uchain request_list;
 
+    /** section fingerprint cache, or NULL if disabled */
+    struct upipe_ts_psi_split_fp *cache;
+    /** number of sections dropped by the cache */
+    uint64_t cache_hits;
+    /** number of sections output while the cache is enabled */
+    uint64_t cache_misses;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -130,10 +152,73 @@ static struct upipe *upipe_ts_psi_split_sub_alloc(struct upipe_mgr *mgr,
     upipe_ts_psi_split_sub_init_sub(upipe);
     upipe_ts_psi_split_sub_store_flow_def(upipe, flow_def);
 
+    struct upipe_ts_psi_split_sub *sub =
+        upipe_ts_psi_split_sub_from_upipe(upipe);
+    sub->cache = NULL;
+    sub->cache_hits = sub->cache_misses = 0;
+
     upipe_throw_ready(upipe);
     return upipe;
 }
 
+/** @internal @This enables or disables the section fingerprint cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param enable true to enable the cache
+ * @return an error code
+ */
+static int _upipe_ts_psi_split_sub_set_cache(struct upipe *upipe, bool enable)
+{
+    struct upipe_ts_psi_split_sub *sub =
+        upipe_ts_psi_split_sub_from_upipe(upipe);
+    free(sub->cache);
+    sub->cache = NULL;
+    sub->cache_hits = sub->cache_misses = 0;
+    if (!enable)
+        return UBASE_ERR_NONE;
+
+    sub->cache = calloc(CACHE_SIZE, sizeof(struct upipe_ts_psi_split_fp));
+    UBASE_ALLOC_RETURN(sub->cache);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This checks whether a section is a repetition of the last
+ * section seen with the same fingerprint key, and updates the cache
+ * otherwise. Only sections with a valid CRC_32 are entered in the cache,
+ * so that a corrupted section does not mask its correct repetitions.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref containing the section
+ * @param fp fingerprint of the section
+ * @return true if the section may be dropped
+ */
+static bool upipe_ts_psi_split_sub_cache_hit(struct upipe *upipe,
+        struct uref *uref, const struct upipe_ts_psi_split_fp *fp)
+{
+    struct upipe_ts_psi_split_sub *sub =
+        upipe_ts_psi_split_sub_from_upipe(upipe);
+    uint32_t key = fp->key;
+    struct upipe_ts_psi_split_fp *entry =
+        &sub->cache[(key ^ (key >> 8) ^ (key >> 16) ^ (key >> 24)) &
+                    (CACHE_SIZE - 1)];
+    if (entry->valid && entry->key == key && entry->version == fp->version &&
+        entry->crc == fp->crc) {
+        sub->cache_hits++;
+        return true;
+    }
+
+    sub->cache_misses++;
+    uint8_t section[PSI_PRIVATE_MAX_SIZE + PSI_HEADER_SIZE];
+    size_t size;
+    if (ubase_check(uref_block_size(uref, &size)) &&
+        size <= sizeof(section) &&
+        ubase_check(uref_block_extract(uref, 0, size, section)) &&
+        psi_get_length(section) + PSI_HEADER_SIZE <= size &&
+        psi_check_crc(section))
+        *entry = *fp;
+    return false;
+}
+
 /** @internal @This processes control commands on an output subpipe of a
  * ts_psi_split pipe.
  *
@@ -153,6 +238,24 @@ static int upipe_ts_psi_split_sub_control(struct upipe *upipe,
         case UPIPE_SET_OUTPUT:
             return upipe_ts_psi_split_sub_control_output(upipe, command, args);
 
+        case UPIPE_TS_PSI_SPLIT_SUB_SET_CACHE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PSI_SPLIT_OUTPUT_SIGNATURE)
+            int enable = va_arg(args, int);
+            return _upipe_ts_psi_split_sub_set_cache(upipe, !!enable);
+        }
+        case UPIPE_TS_PSI_SPLIT_SUB_GET_CACHE_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_PSI_SPLIT_OUTPUT_SIGNATURE)
+            struct upipe_ts_psi_split_sub *sub =
+                upipe_ts_psi_split_sub_from_upipe(upipe);
+            uint64_t *hits_p = va_arg(args, uint64_t *);
+            uint64_t *misses_p = va_arg(args, uint64_t *);
+            if (hits_p != NULL)
+                *hits_p = sub->cache_hits;
+            if (misses_p != NULL)
+                *misses_p = sub->cache_misses;
+            return UBASE_ERR_NONE;
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -164,8 +267,12 @@ static int upipe_ts_psi_split_sub_control(struct upipe *upipe,
  */
 static void upipe_ts_psi_split_sub_free(struct upipe *upipe)
 {
+    struct upipe_ts_psi_split_sub *sub =
+        upipe_ts_psi_split_sub_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    free(sub->cache);
+
     upipe_ts_psi_split_sub_clean_output(upipe);
     upipe_ts_psi_split_sub_clean_sub(upipe);
     upipe_ts_psi_split_sub_clean_urefcount(upipe);
@@ -217,6 +324,48 @@ static struct upipe *upipe_ts_psi_split_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This computes the fingerprint of a PSI section from its
+ * header and CRC_32 bytes.
+ *
+ * @param uref uref containing the section
+ * @param fp filled in with the fingerprint
+ * @return false if the section cannot be fingerprinted (no syntax indicator,
+ * truncated section)
+ */
+static bool upipe_ts_psi_split_fingerprint(struct uref *uref,
+                                           struct upipe_ts_psi_split_fp *fp)
+{
+    uint8_t buffer[PSI_HEADER_SIZE_SYNTAX1];
+    const uint8_t *header = uref_block_peek(uref, 0, PSI_HEADER_SIZE_SYNTAX1,
+                                            buffer);
+    if (unlikely(header == NULL))
+        return false;
+    bool syntax = psi_get_syntax(header);
+    uint16_t length = psi_get_length(header);
+    fp->key = ((uint32_t)psi_get_tableid(header) << 24) |
+              ((uint32_t)psi_get_tableidext(header) << 8) |
+              psi_get_section(header);
+    fp->version = psi_get_version(header);
+    uref_block_peek_unmap(uref, 0, buffer, header);
+
+    size_t size;
+    if (!syntax || length < PSI_HEADER_SIZE_SYNTAX1 - PSI_HEADER_SIZE +
+                            PSI_CRC_SIZE ||
+        !ubase_check(uref_block_size(uref, &size)) ||
+        length + PSI_HEADER_SIZE > size)
+        return false;
+
+    uint8_t crc[PSI_CRC_SIZE];
+    if (unlikely(!ubase_check(uref_block_extract(uref,
+                        length + PSI_HEADER_SIZE - PSI_CRC_SIZE,
+                        PSI_CRC_SIZE, crc))))
+        return false;
+    fp->crc = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) |
+              ((uint32_t)crc[2] << 8) | crc[3];
+    fp->valid = true;
+    return true;
+}
+
 /** @internal @This demuxes a PSI section to the appropriate output(s).
  *
  * @param upipe description structure of the pipe
@@ -228,6 +377,11 @@ static void upipe_ts_psi_split_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_psi_split *upipe_ts_psi_split =
         upipe_ts_psi_split_from_upipe(upipe);
+    /* the fingerprint is only computed if an output has a cache */
+    struct upipe_ts_psi_split_fp fp;
+    bool fp_done = false;
+    fp.valid = false;
+
     struct uchain *uchain;
     ulist_foreach (&upipe_ts_psi_split->subs, uchain) {
         struct upipe_ts_psi_split_sub *output =
@@ -237,6 +391,17 @@ static void upipe_ts_psi_split_input(struct upipe *upipe, struct uref *uref,
         if (ubase_check(uref_ts_flow_get_psi_filter(output->flow_def, &filter,
                         &mask, &size)) &&
             ubase_check(uref_block_match(uref, filter, mask, size))) {
+            if (output->cache != NULL) {
+                if (!fp_done) {
+                    upipe_ts_psi_split_fingerprint(uref, &fp);
+                    fp_done = true;
+                }
+                if (fp.valid && upipe_ts_psi_split_sub_cache_hit(
+                            upipe_ts_psi_split_sub_to_upipe(output),
+                            uref, &fp))
+                    continue;
+            }
+
             if (likely(uchain->next == NULL)) {
                 upipe_ts_psi_split_sub_output(
                         upipe_ts_psi_split_sub_to_upipe(output), uref,
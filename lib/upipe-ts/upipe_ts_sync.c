@@ -65,6 +65,8 @@
 #define SUFFIX_OUTPUT_FLOW_DEF "block.mpegtssuffix."
 /** TS synchronization word */
 #define TS_SYNC 0x47
+/** maximum number of PIDs */
+#define MAX_PIDS 8192
 
 /** @internal @This is the private context of a ts_sync pipe. */
 struct upipe_ts_sync {
@@ -93,6 +95,13 @@ struct upipe_ts_sync {
     /** true if we have thrown the sync_acquired event */
     bool acquired;
 
+    /** true if packets of PIDs not in the bitmap are dropped */
+    bool pid_filter;
+    /** bitmap of the wanted PIDs */
+    uint64_t pids[MAX_PIDS / 64];
+    /** number of packets dropped by the PID filter */
+    uint64_t filtered;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -131,6 +140,9 @@ static struct upipe *upipe_ts_sync_alloc(struct upipe_mgr *mgr,
     upipe_ts_sync->ts_sync = DEFAULT_TS_SYNC;
     upipe_ts_sync->next_uref = NULL;
     ulist_init(&upipe_ts_sync->urefs);
+    upipe_ts_sync->pid_filter = false;
+    memset(upipe_ts_sync->pids, 0, sizeof(upipe_ts_sync->pids));
+    upipe_ts_sync->filtered = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -177,6 +189,41 @@ static bool upipe_ts_sync_check(struct upipe *upipe, size_t *offset_p)
     return true;
 }
 
+/** @internal @This outputs the TS packet at the start of the working buffer,
+ * or drops it without allocating a uref if its PID is filtered out.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_sync_output_packet(struct upipe *upipe,
+                                        struct upump **upump_p)
+{
+    struct upipe_ts_sync *upipe_ts_sync = upipe_ts_sync_from_upipe(upipe);
+    if (upipe_ts_sync->pid_filter) {
+        uint8_t header[TS_HEADER_SIZE];
+        if (likely(ubase_check(uref_block_extract(upipe_ts_sync->next_uref,
+                                                  0, TS_HEADER_SIZE,
+                                                  header)))) {
+            uint16_t pid = ts_get_pid(header);
+            if (!(upipe_ts_sync->pids[pid / 64] &
+                  (UINT64_C(1) << (pid % 64)))) {
+                upipe_ts_sync->filtered++;
+                upipe_ts_sync_consume_uref_stream(upipe,
+                                                  upipe_ts_sync->output_size);
+                return;
+            }
+        }
+    }
+
+    struct uref *output = upipe_ts_sync_extract_uref_stream(upipe,
+                                                upipe_ts_sync->output_size);
+    if (unlikely(output == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_ts_sync_output(upipe, output, upump_p);
+}
+
 /** @internal @This flushes all input buffers.
  *
  * @param upipe description structure of the pipe
@@ -191,15 +238,8 @@ static void upipe_ts_sync_flush(struct upipe *upipe, struct upump **upump_p)
                ubase_check(uref_block_size(upipe_ts_sync->next_uref, &size)) &&
                size >= upipe_ts_sync->output_size &&
                ubase_check(uref_block_scan(upipe_ts_sync->next_uref, &offset, TS_SYNC)) &&
-               !offset) {
-            struct uref *output = upipe_ts_sync_extract_uref_stream(upipe,
-                                                        upipe_ts_sync->output_size);
-            if (unlikely(output == NULL)) {
-                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-                continue;
-            }
-            upipe_ts_sync_output(upipe, output, upump_p);
-        }
+               !offset)
+            upipe_ts_sync_output_packet(upipe, upump_p);
     }
 
     upipe_ts_sync_clean_uref_stream(upipe);
@@ -235,13 +275,7 @@ static void upipe_ts_sync_input(struct upipe *upipe, struct uref *uref,
 
         /* upipe_ts_sync_check said there is at least one TS packet there. */
         upipe_ts_sync_sync_acquired(upipe);
-        struct uref *output = upipe_ts_sync_extract_uref_stream(upipe,
-                                                    upipe_ts_sync->output_size);
-        if (unlikely(output == NULL)) {
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            continue;
-        }
-        upipe_ts_sync_output(upipe, output, upump_p);
+        upipe_ts_sync_output_packet(upipe, upump_p);
     }
 }
 
@@ -302,6 +336,39 @@ static int _upipe_ts_sync_set_sync(struct upipe *upipe, int sync)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This enables or disables the PID filter.
+ *
+ * @param upipe description structure of the pipe
+ * @param enable true to drop the packets of PIDs that were not added
+ * @return an error code
+ */
+static int _upipe_ts_sync_set_pid_filter(struct upipe *upipe, bool enable)
+{
+    struct upipe_ts_sync *upipe_ts_sync = upipe_ts_sync_from_upipe(upipe);
+    upipe_ts_sync->pid_filter = enable;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This adds or removes a PID from the PID filter.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID
+ * @param wanted true to let the packets of the PID through
+ * @return an error code
+ */
+static int upipe_ts_sync_set_pid(struct upipe *upipe, unsigned int pid,
+                                 bool wanted)
+{
+    struct upipe_ts_sync *upipe_ts_sync = upipe_ts_sync_from_upipe(upipe);
+    if (unlikely(pid >= MAX_PIDS))
+        return UBASE_ERR_INVALID;
+    if (wanted)
+        upipe_ts_sync->pids[pid / 64] |= UINT64_C(1) << (pid % 64);
+    else
+        upipe_ts_sync->pids[pid / 64] &= ~(UINT64_C(1) << (pid % 64));
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts sync pipe.
  *
  * @param upipe description structure of the pipe
@@ -333,6 +400,30 @@ static int upipe_ts_sync_control(struct upipe *upipe,
             int sync = va_arg(args, int);
             return _upipe_ts_sync_set_sync(upipe, sync);
         }
+        case UPIPE_TS_SYNC_SET_PID_FILTER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SYNC_SIGNATURE)
+            int enable = va_arg(args, int);
+            return _upipe_ts_sync_set_pid_filter(upipe, !!enable);
+        }
+        case UPIPE_TS_SYNC_ADD_PID: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SYNC_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            return upipe_ts_sync_set_pid(upipe, pid, true);
+        }
+        case UPIPE_TS_SYNC_DEL_PID: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SYNC_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            return upipe_ts_sync_set_pid(upipe, pid, false);
+        }
+        case UPIPE_TS_SYNC_GET_FILTERED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_SYNC_SIGNATURE)
+            struct upipe_ts_sync *upipe_ts_sync =
+                upipe_ts_sync_from_upipe(upipe);
+            uint64_t *filtered_p = va_arg(args, uint64_t *);
+            assert(filtered_p != NULL);
+            *filtered_p = upipe_ts_sync->filtered;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -56,6 +56,7 @@
 #include <upipe-v210/upipe_v210dec.h>
 
 #include "v210dec.h"
+#include "v210threads.h"
 
 #define UPIPE_V210_MAX_PLANES 3
 #define UBUF_ALIGN 32
@@ -108,6 +109,11 @@ struct upipe_v210dec {
     /** output chroma map */
     const char *output_chroma_map[UPIPE_V210_MAX_PLANES+1];
 
+    /** number of threads unpacking the rows */
+    unsigned int threads;
+    /** pool of threads, or NULL */
+    struct v210threads *pool;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -170,6 +176,18 @@ static void v210dec_setup_asm(struct upipe *upipe, bool assembly)
     v210dec->v210_to_planar_8  = upipe_v210_to_planar_8_c;
     v210dec->v210_to_planar_10 = upipe_v210_to_planar_10_c;
 
+#ifdef HAVE_AVX512_INTRINSICS
+    /* masked loads and stores, no alignment requirement */
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl")) {
+        v210dec->v210_to_planar_8  = upipe_v210_to_planar_8_avx512;
+        v210dec->v210_to_planar_10 = upipe_v210_to_planar_10_avx512;
+        if (__builtin_cpu_supports("avx512vbmi"))
+            v210dec->v210_to_planar_8 = upipe_v210_to_planar_8_avx512vbmi;
+        return;
+    }
+#endif
+
     if (!assembly)
         return;
 
@@ -191,6 +209,115 @@ static void v210dec_setup_asm(struct upipe *upipe, bool assembly)
 #endif
 }
 
+/** @internal @This describes a picture being unpacked. */
+struct upipe_v210dec_frame {
+    /** pointer to the pipe */
+    struct upipe_v210dec *v210dec;
+    /** horizontal size */
+    uint64_t hsize;
+    /** input plane */
+    const uint8_t *input_plane;
+    /** input stride */
+    size_t input_stride;
+    /** output planes */
+    uint8_t *output_planes[3];
+    /** output strides */
+    size_t output_strides[3];
+};
+
+/** @internal @This unpacks a band of rows of a picture.
+ *
+ * @param opaque description of the picture
+ * @param start first row
+ * @param end row following the last row
+ */
+static void upipe_v210dec_unpack_rows(void *opaque, int start, int end)
+{
+    struct upipe_v210dec_frame *frame = opaque;
+    struct upipe_v210dec *v210dec = frame->v210dec;
+    uint64_t output_hsize = frame->hsize;
+
+    switch (v210dec->output_type) {
+        case V2D_OUTPUT_PLANAR_8: {
+            for (int h = start; h < end; h++) {
+                uint8_t *y = frame->output_planes[0] +
+                    h * frame->output_strides[0];
+                uint8_t *u = frame->output_planes[1] +
+                    h * frame->output_strides[1];
+                uint8_t *v = frame->output_planes[2] +
+                    h * frame->output_strides[2];
+                const uint32_t *src = (const uint32_t *)(frame->input_plane +
+                    h * frame->input_stride);
+
+                int w = (output_hsize / 6) * 6;
+                v210dec->v210_to_planar_8(src, y, u, v, w);
+
+                y += w;
+                u += w >> 1;
+                v += w >> 1;
+                src += (w * 2) / 3;
+
+                if (w < output_hsize - 1) {
+                    READ_PIXELS_8(u, y, v);
+                    uint32_t val = *src++;
+                    *y++ = (val >> 2) & 255;
+
+                    if (w < output_hsize - 3) {
+                        *u++ = (val >> 12) & 255;
+                        *y++ = (val >> 22) & 255;
+
+                        val = rl32(src);
+                        src++;
+                        *v++ = (val >>  2) & 255;
+                        *y++ = (val >> 12) & 255;
+                    }
+                }
+            }
+        } break;
+
+        case V2D_OUTPUT_PLANAR_10: {
+            for (int h = start; h < end; h++) {
+                uint16_t *y = (uint16_t*)(frame->output_planes[0] +
+                    h * frame->output_strides[0]);
+                uint16_t *u = (uint16_t*)(frame->output_planes[1] +
+                    h * frame->output_strides[1]);
+                uint16_t *v = (uint16_t*)(frame->output_planes[2] +
+                    h * frame->output_strides[2]);
+                const uint32_t *src = (const uint32_t *)(frame->input_plane +
+                    h * frame->input_stride);
+
+                int w = (output_hsize / 6) * 6;
+                v210dec->v210_to_planar_10(src, y, u, v, w);
+
+                y += w;
+                u += w >> 1;
+                v += w >> 1;
+                src += (w * 2) / 3;
+
+                if (w < output_hsize - 1) {
+                    READ_PIXELS_10(u, y, v);
+                    uint32_t val = rl32(src);
+                    src++;
+                    *y++ = val & 1023;
+
+                    if (w < output_hsize - 3) {
+                        *u++ = (val >> 10) & 1023;
+                        *y++ = (val >> 20) & 1023;
+
+                        val = rl32(src);
+                        src++;
+                        *v++ = val & 1023;
+                        *y++ = (val >> 10) & 1023;
+                    }
+                }
+            }
+        } break;
+
+        default:
+            assert(0);
+    }
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -264,85 +391,21 @@ static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
         }
     }
 
-    switch (v210dec->output_type) {
-        case V2D_OUTPUT_PLANAR_8: {
-            for (int h = 0; h < input_vsize; h++) {
-                uint8_t *y = output_planes[0];
-                uint8_t *u = output_planes[1];
-                uint8_t *v = output_planes[2];
-                const uint32_t *src = (uint32_t*)input_plane;
-
-                int w = (output_hsize / 6) * 6;
-                v210dec->v210_to_planar_8(src, y, u, v, w);
-
-                y += w;
-                u += w >> 1;
-                v += w >> 1;
-                src += (w * 2) / 3;
-
-                if (w < output_hsize - 1) {
-                    READ_PIXELS_8(u, y, v);
-                    uint32_t val = *src++;
-                    *y++ = (val >> 2) & 255;
-
-                    if (w < output_hsize - 3) {
-                        *u++ = (val >> 12) & 255;
-                        *y++ = (val >> 22) & 255;
-
-                        val = rl32(src);
-                        src++;
-                        *v++ = (val >>  2) & 255;
-                        *y++ = (val >> 12) & 255;
-                    }
-                }
-
-                for (int i = 0; i < 3; i++)
-                    output_planes[i] += output_strides[i];
-                input_plane += input_stride;
-            }
-        } break;
-
-        case V2D_OUTPUT_PLANAR_10: {
-            for (int h = 0; h < input_vsize; h++) {
-                uint16_t *y = (uint16_t*)output_planes[0];
-                uint16_t *u = (uint16_t*)output_planes[1];
-                uint16_t *v = (uint16_t*)output_planes[2];
-                const uint32_t *src = (uint32_t*)input_plane;
-
-                int w = (output_hsize / 6) * 6;
-                v210dec->v210_to_planar_10(src, y, u, v, w);
-
-                y += w;
-                u += w >> 1;
-                v += w >> 1;
-                src += (w * 2) / 3;
-
-                if (w < output_hsize - 1) {
-                    READ_PIXELS_10(u, y, v);
-                    uint32_t val = rl32(src);
-                    src++;
-                    *y++ = val & 1023;
-
-                    if (w < output_hsize - 3) {
-                        *u++ = (val >> 10) & 1023;
-                        *y++ = (val >> 20) & 1023;
-
-                        val = rl32(src);
-                        src++;
-                        *v++ = val & 1023;
-                        *y++ = (val >> 10) & 1023;
-                    }
-                }
-
-                for (int i = 0; i < 3; i++)
-                    output_planes[i] += output_strides[i];
-                input_plane += input_stride;
-            }
-        } break;
-
-        default:
-            assert(0);
+    struct upipe_v210dec_frame frame = {
+        .v210dec = v210dec,
+        .hsize = output_hsize,
+        .input_plane = input_plane,
+        .input_stride = input_stride,
+    };
+    for (int i = 0; i < 3; i++) {
+        frame.output_planes[i] = output_planes[i];
+        frame.output_strides[i] = output_strides[i];
     }
+    if (v210dec->pool != NULL)
+        v210threads_run(v210dec->pool, upipe_v210dec_unpack_rows, &frame,
+                        input_vsize);
+    else
+        upipe_v210dec_unpack_rows(&frame, 0, input_vsize);
 
     uref_pic_plane_unmap(uref, v210_chroma_str, 0, 0, -1, -1);
     for (int i = 0; i < 3; i++)
@@ -523,6 +586,36 @@ static int upipe_v210dec_provide_flow_format(struct upipe *upipe,
 }
 #endif
 
+/** @internal @This sets the number of threads unpacking the rows.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_v210dec_set_threads(struct upipe *upipe,
+                                      unsigned int threads)
+{
+    struct upipe_v210dec *v210dec = upipe_v210dec_from_upipe(upipe);
+    if (threads <= 1)
+        threads = 0;
+    if (threads == v210dec->threads)
+        return UBASE_ERR_NONE;
+
+    v210threads_free(v210dec->pool);
+    v210dec->pool = NULL;
+    v210dec->threads = 0;
+    if (threads) {
+        v210dec->pool = v210threads_alloc(threads);
+        if (unlikely(v210dec->pool == NULL)) {
+            upipe_err_va(upipe, "unable to start %u threads", threads);
+            return UBASE_ERR_ALLOC;
+        }
+        v210dec->threads = threads;
+    }
+    upipe_dbg_va(upipe, "unpacking with %u threads", threads ? threads : 1);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -561,6 +654,12 @@ static int upipe_v210dec_control(struct upipe *upipe, int command, va_list args)
             return upipe_v210dec_set_flow_def(upipe, flow);
         }
 
+        case UPIPE_V210DEC_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210DEC_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_v210dec_set_threads(upipe, threads);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -612,6 +711,9 @@ static struct upipe *upipe_v210dec_alloc(struct upipe_mgr *manager,
 
 #undef PRINT_OUTPUT_TYPE
 
+    v210dec->threads = 0;
+    v210dec->pool = NULL;
+
     upipe_v210dec_init_urefcount(upipe);
     upipe_v210dec_init_ubuf_mgr(upipe);
     upipe_v210dec_init_output(upipe);
@@ -628,6 +730,9 @@ static struct upipe *upipe_v210dec_alloc(struct upipe_mgr *manager,
  */
 static void upipe_v210dec_free(struct upipe *upipe)
 {
+    struct upipe_v210dec *v210dec = upipe_v210dec_from_upipe(upipe);
+    v210threads_free(v210dec->pool);
+
     upipe_throw_dead(upipe);
     upipe_v210dec_clean_input(upipe);
     upipe_v210dec_clean_output(upipe);
@@ -56,6 +56,7 @@
 #include <upipe-v210/upipe_v210enc.h>
 
 #include "v210enc.h"
+#include "v210threads.h"
 
 #define UPIPE_V210_MAX_PLANES 3
 
@@ -107,6 +108,11 @@ struct upipe_v210enc {
     /** 10-bit line packing function **/
     upipe_v210enc_pack_line_10 pack_line_10;
 
+    /** number of threads packing the rows */
+    unsigned int threads;
+    /** pool of threads, or NULL */
+    struct v210threads *pool;
+
     /** input chroma map */
     const char *input_chroma_map[UPIPE_V210_MAX_PLANES+1];
     /** output chroma map */
@@ -161,6 +167,121 @@ static inline void wl32(uint8_t *dst, uint32_t u)
         dst += 4;                       \
     } while (0)
 
+/** @internal @This describes a picture being packed. */
+struct upipe_v210enc_frame {
+    /** pointer to the pipe */
+    struct upipe_v210enc *upipe_v210enc;
+    /** horizontal size */
+    size_t hsize;
+    /** input planes */
+    const uint8_t *input_planes[UPIPE_V210_MAX_PLANES];
+    /** input strides */
+    int input_strides[UPIPE_V210_MAX_PLANES];
+    /** output plane */
+    uint8_t *output_plane;
+    /** output stride */
+    size_t output_stride;
+};
+
+/** @internal @This packs a band of rows of a picture.
+ *
+ * @param opaque description of the picture
+ * @param start first row
+ * @param end row following the last row
+ */
+static void upipe_v210enc_pack_rows(void *opaque, int start, int end)
+{
+    struct upipe_v210enc_frame *frame = opaque;
+    struct upipe_v210enc *upipe_v210enc = frame->upipe_v210enc;
+    size_t input_hsize = frame->hsize;
+    int line_padding = frame->output_stride - ((input_hsize * 8 + 11) / 12) * 4;
+    int h, w;
+    if (upipe_v210enc->input_bit_depth == 10) {
+        for (h = start; h < end; h++) {
+            const uint16_t *y = (const uint16_t *)(frame->input_planes[0] +
+                    h * frame->input_strides[0]);
+            const uint16_t *u = (const uint16_t *)(frame->input_planes[1] +
+                    h * frame->input_strides[1]);
+            const uint16_t *v = (const uint16_t *)(frame->input_planes[2] +
+                    h * frame->input_strides[2]);
+            uint8_t *dst = frame->output_plane + h * frame->output_stride;
+            uint32_t val = 0;
+            w = (input_hsize / 6) * 6;
+            upipe_v210enc->pack_line_10(y, u, v, dst, w);
+
+            y += w;
+            u += w >> 1;
+            v += w >> 1;
+            dst += (w / 6) * 16;
+            if (w < input_hsize - 1) {
+                WRITE_PIXELS(u, y, v);
+
+                val = CLIP(*y++);
+                if (w == input_hsize - 2) {
+                    wl32(dst, val);
+                    dst += 4;
+                }
+            }
+            if (w < input_hsize - 3) {
+                val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
+                wl32(dst, val);
+                dst += 4;
+
+                val = CLIP(*v++) | (CLIP(*y++) << 10);
+                wl32(dst, val);
+                dst += 4;
+            }
+
+            memset(dst, 0, line_padding);
+        }
+    }
+    else {
+        for (h = start; h < end; h++) {
+            const uint8_t *y = frame->input_planes[0] +
+                h * frame->input_strides[0];
+            const uint8_t *u = frame->input_planes[1] +
+                h * frame->input_strides[1];
+            const uint8_t *v = frame->input_planes[2] +
+                h * frame->input_strides[2];
+            uint8_t *dst = frame->output_plane + h * frame->output_stride;
+            uint32_t val = 0;
+            w = (input_hsize / 12) * 12;
+            upipe_v210enc->pack_line_8(y, u, v, dst, w);
+
+            y += w;
+            u += w >> 1;
+            v += w >> 1;
+            dst += (w / 12) * 32;
+
+            for (; w < input_hsize - 5; w += 6) {
+                WRITE_PIXELS8(u, y, v);
+                WRITE_PIXELS8(y, u, y);
+                WRITE_PIXELS8(v, y, u);
+                WRITE_PIXELS8(y, v, y);
+            }
+            if (w < input_hsize - 1) {
+                WRITE_PIXELS8(u, y, v);
+
+                val = CLIP8(*y++) << 2;
+                if (w == input_hsize - 2) {
+                    wl32(dst, val);
+                    dst += 4;
+                }
+            }
+            if (w < input_hsize - 3) {
+                val |= (CLIP8(*u++) << 12) | (CLIP8(*y++) << 22);
+                wl32(dst, val);
+                dst += 4;
+
+                val = (CLIP8(*v++) << 2) | (CLIP8(*y++) << 12);
+                wl32(dst, val);
+                dst += 4;
+            }
+            memset(dst, 0, line_padding);
+        }
+    }
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -256,94 +377,21 @@ static bool upipe_v210enc_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* Do v210 packing */
-    int line_padding = stride - ((input_hsize * 8 + 11) / 12) * 4;
-    uint8_t *dst = output_plane;
-    int h, w;
-    if (upipe_v210enc->input_bit_depth == 10) {
-        const uint16_t *y = (const uint16_t *)input_planes[0];
-        const uint16_t *u = (const uint16_t *)input_planes[1];
-        const uint16_t *v = (const uint16_t *)input_planes[2];
-        for (h = 0; h < input_vsize; h++) {
-            uint32_t val = 0;
-            w = (input_hsize / 6) * 6;
-            upipe_v210enc->pack_line_10(y, u, v, dst, w);
-
-            y += w;
-            u += w >> 1;
-            v += w >> 1;
-            dst += (w / 6) * 16;
-            if (w < input_hsize - 1) {
-                WRITE_PIXELS(u, y, v);
-
-                val = CLIP(*y++);
-                if (w == input_hsize - 2) {
-                    wl32(dst, val);
-                    dst += 4;
-                }
-            }
-            if (w < input_hsize - 3) {
-                val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
-                wl32(dst, val);
-                dst += 4;
-
-                val = CLIP(*v++) | (CLIP(*y++) << 10);
-                wl32(dst, val);
-                dst += 4;
-            }
-
-            memset(dst, 0, line_padding);
-            dst += line_padding;
-            y += input_strides[0] / 2 - input_hsize;
-            u += input_strides[1] / 2 - input_hsize / 2;
-            v += input_strides[2] / 2 - input_hsize / 2;
-        }
-    }
-    else {
-        const uint8_t *y = input_planes[0];
-        const uint8_t *u = input_planes[1];
-        const uint8_t *v = input_planes[2];
-        for (h = 0; h < input_vsize; h++) {
-            uint32_t val = 0;
-            w = (input_hsize / 12) * 12;
-            upipe_v210enc->pack_line_8(y, u, v, dst, w);
-
-            y += w;
-            u += w >> 1;
-            v += w >> 1;
-            dst += (w / 12) * 32;
-
-            for (; w < input_hsize - 5; w += 6) {
-                WRITE_PIXELS8(u, y, v);
-                WRITE_PIXELS8(y, u, y);
-                WRITE_PIXELS8(v, y, u);
-                WRITE_PIXELS8(y, v, y);
-            }
-            if (w < input_hsize - 1) {
-                WRITE_PIXELS8(u, y, v);
-
-                val = CLIP8(*y++) << 2;
-                if (w == input_hsize - 2) {
-                    wl32(dst, val);
-                    dst += 4;
-                }
-            }
-            if (w < input_hsize - 3) {
-                val |= (CLIP8(*u++) << 12) | (CLIP8(*y++) << 22);
-                wl32(dst, val);
-                dst += 4;
-
-                val = (CLIP8(*v++) << 2) | (CLIP8(*y++) << 12);
-                wl32(dst, val);
-                dst += 4;
-            }
-            memset(dst, 0, line_padding);
-            dst += line_padding;
-
-            y += input_strides[0] - input_hsize;
-            u += input_strides[1] - input_hsize / 2;
-            v += input_strides[2] - input_hsize / 2;
-        }
+    struct upipe_v210enc_frame frame = {
+        .upipe_v210enc = upipe_v210enc,
+        .hsize = input_hsize,
+        .output_plane = output_plane,
+        .output_stride = stride,
+    };
+    for (i = 0; i < UPIPE_V210_MAX_PLANES; i++) {
+        frame.input_planes[i] = input_planes[i];
+        frame.input_strides[i] = input_strides[i];
     }
+    if (upipe_v210enc->pool != NULL)
+        v210threads_run(upipe_v210enc->pool, upipe_v210enc_pack_rows, &frame,
+                        input_vsize);
+    else
+        upipe_v210enc_pack_rows(&frame, 0, input_vsize);
 
     /* unmap pictures */
     for (i = 0; i < UPIPE_V210_MAX_PLANES &&
@@ -520,6 +568,36 @@ static int upipe_v210enc_provide_flow_format(struct upipe *upipe,
     return urequest_provide_flow_format(request, flow_format);
 }
 
+/** @internal @This sets the number of threads packing the rows.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_v210enc_set_threads(struct upipe *upipe,
+                                      unsigned int threads)
+{
+    struct upipe_v210enc *upipe_v210enc = upipe_v210enc_from_upipe(upipe);
+    if (threads <= 1)
+        threads = 0;
+    if (threads == upipe_v210enc->threads)
+        return UBASE_ERR_NONE;
+
+    v210threads_free(upipe_v210enc->pool);
+    upipe_v210enc->pool = NULL;
+    upipe_v210enc->threads = 0;
+    if (threads) {
+        upipe_v210enc->pool = v210threads_alloc(threads);
+        if (unlikely(upipe_v210enc->pool == NULL)) {
+            upipe_err_va(upipe, "unable to start %u threads", threads);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_v210enc->threads = threads;
+    }
+    upipe_dbg_va(upipe, "packing with %u threads", threads ? threads : 1);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -556,6 +634,12 @@ static int upipe_v210enc_control(struct upipe *upipe, int command, va_list args)
             return upipe_v210enc_set_flow_def(upipe, flow);
         }
 
+        case UPIPE_V210ENC_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210ENC_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_v210enc_set_threads(upipe, threads);
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -598,6 +682,17 @@ static struct upipe *upipe_v210enc_alloc(struct upipe_mgr *mgr,
 #endif
 #endif
 
+#ifdef HAVE_AVX512_INTRINSICS
+    if (__builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vl")) {
+        upipe_v210enc->pack_line_8  = upipe_planar_to_v210_8_avx512;
+        upipe_v210enc->pack_line_10 = upipe_planar_to_v210_10_avx512;
+    }
+#endif
+
+    upipe_v210enc->threads = 0;
+    upipe_v210enc->pool = NULL;
+
     upipe_v210enc_init_urefcount(upipe);
     upipe_v210enc_init_ubuf_mgr(upipe);
     upipe_v210enc_init_output(upipe);
@@ -613,6 +708,9 @@ static struct upipe *upipe_v210enc_alloc(struct upipe_mgr *mgr,
  */
 static void upipe_v210enc_free(struct upipe *upipe)
 {
+    struct upipe_v210enc *upipe_v210enc = upipe_v210enc_from_upipe(upipe);
+    v210threads_free(upipe_v210enc->pool);
+
     upipe_throw_dead(upipe);
     upipe_v210enc_clean_input(upipe);
     upipe_v210enc_clean_output(upipe);
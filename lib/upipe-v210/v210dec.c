@@ -26,10 +26,16 @@
  * @short Upipe v210dec module
  */
 
+#include <config.h>
+
 #include <stdint.h>
 
 #include "v210dec.h"
 
+#ifdef HAVE_AVX512_INTRINSICS
+#include <immintrin.h>
+#endif
+
 // TODO: handle endianess
 
 static inline uint32_t rl32(const void *src)
@@ -79,3 +85,174 @@ void upipe_v210_to_planar_10_c(const void *src, uint16_t *y, uint16_t *u, uint16
         READ_PIXELS_10(y, v, y);
     }
 }
+
+#ifdef HAVE_AVX512_INTRINSICS
+#define UPIPE_V210_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+#define UPIPE_V210_AVX512VBMI \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx512vbmi")))
+
+/* position of the samples of 4 v210 blocks (24 pixels) after splitting
+ * the dwords in fields: indices 0-31 address fields 0 and 1 (interleaved),
+ * 32-63 field 2 */
+#define F0(d) (2 * (d))
+#define F1(d) (2 * (d) + 1)
+#define F2(d) (32 + 2 * (d))
+#define BLOCK_Y(b) F1(4*b), F0(4*b+1), F2(4*b+1), F1(4*b+2), F0(4*b+3), \
+                   F2(4*b+3)
+#define BLOCK_U(b) F0(4*b), F1(4*b+1), F2(4*b+2)
+#define BLOCK_V(b) F2(4*b), F0(4*b+2), F1(4*b+3)
+
+/** @internal @This unpacks up to 4 v210 blocks in 10-bit luma and chroma
+ * vectors. */
+UPIPE_V210_AVX512
+static inline void upipe_v210dec_unpack_avx512(__m512i src,
+                                               __m512i *y, __m512i *uv)
+{
+    static const uint16_t luma[32] = {
+        BLOCK_Y(0), BLOCK_Y(1), BLOCK_Y(2), BLOCK_Y(3)
+    };
+    static const uint16_t chroma[32] = {
+        BLOCK_U(0), BLOCK_U(1), BLOCK_U(2), BLOCK_U(3), 0, 0, 0, 0,
+        BLOCK_V(0), BLOCK_V(1), BLOCK_V(2), BLOCK_V(3), 0, 0, 0, 0
+    };
+    const __m512i mask = _mm512_set1_epi32(0x3ff);
+
+    /* fields 0 and 1 in the low and high words of each dword */
+    __m512i f01 = _mm512_or_si512(_mm512_and_si512(src, mask),
+            _mm512_slli_epi32(_mm512_and_si512(_mm512_srli_epi32(src, 10),
+                                               mask), 16));
+    __m512i f2 = _mm512_and_si512(_mm512_srli_epi32(src, 20), mask);
+
+    *y = _mm512_permutex2var_epi16(f01, _mm512_loadu_si512(luma), f2);
+    *uv = _mm512_permutex2var_epi16(f01, _mm512_loadu_si512(chroma), f2);
+}
+
+#undef F0
+#undef F1
+#undef F2
+#undef BLOCK_Y
+#undef BLOCK_U
+#undef BLOCK_V
+
+UPIPE_V210_AVX512
+void upipe_v210_to_planar_10_avx512(const void *src, uint16_t *y, uint16_t *u,
+                                    uint16_t *v, uintptr_t pixels)
+{
+    const uint32_t *s = src;
+
+    for (uintptr_t i = 0; i + 5 < pixels; i += 24) {
+        /* number of 6-pixel blocks in this iteration */
+        uintptr_t blocks = (pixels - i) / 6;
+        if (blocks > 4)
+            blocks = 4;
+        __mmask32 ymask = (1U << (6 * blocks)) - 1;
+        __mmask16 cmask = (1U << (3 * blocks)) - 1;
+        __mmask16 smask = (1U << (4 * blocks)) - 1;
+
+        __m512i yv, uv;
+        upipe_v210dec_unpack_avx512(_mm512_maskz_loadu_epi32(smask, s),
+                                    &yv, &uv);
+        _mm512_mask_storeu_epi16(y, ymask, yv);
+        _mm256_mask_storeu_epi16(u, cmask, _mm512_castsi512_si256(uv));
+        _mm256_mask_storeu_epi16(v, cmask, _mm512_extracti64x4_epi64(uv, 1));
+        s += 16;
+        y += 24;
+        u += 12;
+        v += 12;
+    }
+}
+
+UPIPE_V210_AVX512
+void upipe_v210_to_planar_8_avx512(const void *src, uint8_t *y, uint8_t *u,
+                                   uint8_t *v, uintptr_t pixels)
+{
+    const uint32_t *s = src;
+
+    for (uintptr_t i = 0; i + 5 < pixels; i += 24) {
+        /* number of 6-pixel blocks in this iteration */
+        uintptr_t blocks = (pixels - i) / 6;
+        if (blocks > 4)
+            blocks = 4;
+        __mmask32 ymask = (1U << (6 * blocks)) - 1;
+        __mmask16 cmask = (1U << (3 * blocks)) - 1;
+        __mmask16 smask = (1U << (4 * blocks)) - 1;
+
+        __m512i yv, uv;
+        upipe_v210dec_unpack_avx512(_mm512_maskz_loadu_epi32(smask, s),
+                                    &yv, &uv);
+        yv = _mm512_srli_epi16(yv, 2);
+        uv = _mm512_srli_epi16(uv, 2);
+        __m256i c = _mm512_cvtepi16_epi8(uv);
+        _mm256_mask_storeu_epi8(y, ymask, _mm512_cvtepi16_epi8(yv));
+        _mm_mask_storeu_epi8(u, cmask, _mm256_castsi256_si128(c));
+        _mm_mask_storeu_epi8(v, cmask, _mm256_extracti128_si256(c, 1));
+        s += 16;
+        y += 24;
+        u += 12;
+        v += 12;
+    }
+}
+
+/* with VBMI, the 8 most significant bits of each sample are extracted from
+ * the qwords directly, then shuffled to their planes: 8 blocks (48 pixels)
+ * in two vectors per iteration */
+#define Q(q, n) (8 * (q) + (n))
+#define BLOCK_Y(b) Q(2*b, 1), Q(2*b, 3), Q(2*b, 5), Q(2*b+1, 1), \
+                   Q(2*b+1, 3), Q(2*b+1, 5)
+#define BLOCK_U(b) Q(2*b, 0), Q(2*b, 4), Q(2*b+1, 2)
+#define BLOCK_V(b) Q(2*b, 2), Q(2*b+1, 0), Q(2*b+1, 4)
+
+UPIPE_V210_AVX512VBMI
+void upipe_v210_to_planar_8_avx512vbmi(const void *src, uint8_t *y,
+                                       uint8_t *u, uint8_t *v,
+                                       uintptr_t pixels)
+{
+    static const uint8_t luma[64] = {
+        BLOCK_Y(0), BLOCK_Y(1), BLOCK_Y(2), BLOCK_Y(3),
+        BLOCK_Y(4), BLOCK_Y(5), BLOCK_Y(6), BLOCK_Y(7)
+    };
+    static const uint8_t chroma[64] = {
+        BLOCK_U(0), BLOCK_U(1), BLOCK_U(2), BLOCK_U(3),
+        BLOCK_U(4), BLOCK_U(5), BLOCK_U(6), BLOCK_U(7), 0, 0, 0, 0, 0, 0, 0, 0,
+        BLOCK_V(0), BLOCK_V(1), BLOCK_V(2), BLOCK_V(3),
+        BLOCK_V(4), BLOCK_V(5), BLOCK_V(6), BLOCK_V(7)
+    };
+    /* bit offsets of the samples in a qword */
+    const __m512i shifts = _mm512_set1_epi64(0x0000362c22160c02ULL);
+    const __m512i luma_idx = _mm512_loadu_si512(luma);
+    const __m512i chroma_idx = _mm512_loadu_si512(chroma);
+    const uint32_t *s = src;
+
+    for (uintptr_t i = 0; i + 5 < pixels; i += 48) {
+        /* number of 6-pixel blocks in this iteration */
+        uintptr_t blocks = (pixels - i) / 6;
+        if (blocks > 8)
+            blocks = 8;
+        __mmask64 ymask = (1ULL << (6 * blocks)) - 1;
+        __mmask32 cmask = (1U << (3 * blocks)) - 1;
+        __mmask16 smask = (1U << (2 * blocks)) - 1;
+
+        __m512i lo = _mm512_multishift_epi64_epi8(shifts,
+                _mm512_maskz_loadu_epi64(smask, s));
+        __m512i hi = _mm512_multishift_epi64_epi8(shifts,
+                _mm512_maskz_loadu_epi64(smask >> 8, s + 16));
+        __m512i c = _mm512_permutex2var_epi8(lo, chroma_idx, hi);
+        _mm512_mask_storeu_epi8(y, ymask,
+                                _mm512_permutex2var_epi8(lo, luma_idx, hi));
+        _mm256_mask_storeu_epi8(u, cmask, _mm512_castsi512_si256(c));
+        _mm256_mask_storeu_epi8(v, cmask, _mm512_extracti64x4_epi64(c, 1));
+        s += 32;
+        y += 48;
+        u += 24;
+        v += 24;
+    }
+}
+
+#undef Q
+#undef BLOCK_Y
+#undef BLOCK_U
+#undef BLOCK_V
+
+#undef UPIPE_V210_AVX512
+#undef UPIPE_V210_AVX512VBMI
+#endif
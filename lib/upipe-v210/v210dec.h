@@ -15,4 +15,10 @@ void upipe_v210_to_planar_8_aligned_ssse3(const void *src, uint8_t *y, uint8_t *
 void upipe_v210_to_planar_8_aligned_avx  (const void *src, uint8_t *y, uint8_t *u, uint8_t *v, uintptr_t pixels);
 void upipe_v210_to_planar_8_aligned_avx2 (const void *src, uint8_t *y, uint8_t *u, uint8_t *v, uintptr_t pixels);
 
+/* AVX-512 (BW, VL and VBMI) intrinsics, no alignment constraint, any number
+ * of pixels multiple of 6 */
+void upipe_v210_to_planar_10_avx512(const void *src, uint16_t *y, uint16_t *u, uint16_t *v, uintptr_t pixels);
+void upipe_v210_to_planar_8_avx512(const void *src, uint8_t *y, uint8_t *u, uint8_t *v, uintptr_t pixels);
+void upipe_v210_to_planar_8_avx512vbmi(const void *src, uint8_t *y, uint8_t *u, uint8_t *v, uintptr_t pixels);
+
 #endif
@@ -26,10 +26,16 @@
  * @short Upipe v210enc module
  */
 
+#include <config.h>
+
 #include <stdint.h>
 #include <upipe-v210/upipe_v210enc.h>
 #include "v210enc.h"
 
+#ifdef HAVE_AVX512_INTRINSICS
+#include <immintrin.h>
+#endif
+
 #define CLIP(v) ubase_clip(v, 4, 1019)
 #define CLIP8(v) ubase_clip(v, 1, 254)
 
@@ -91,3 +97,116 @@ void upipe_planar_to_v210_10_c(const uint16_t *y, const uint16_t *u,
         WRITE_PIXELS(y, v, y);
     }
 }
+
+#ifdef HAVE_AVX512_INTRINSICS
+#define UPIPE_V210_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl")))
+
+/* field positions of the samples in 4 v210 blocks (24 pixels): indices 0-31
+ * address the luma vector, 32-63 the chroma vector with U in the low half
+ * and V in the high half */
+#define Y(n) (n)
+#define U(n) (32 + (n))
+#define V(n) (48 + (n))
+#define BLOCK_FIELD0(b) U(3*b), 0, Y(6*b+1), 0, V(3*b+1), 0, Y(6*b+4), 0
+#define BLOCK_FIELD1(b) Y(6*b), 0, U(3*b+1), 0, Y(6*b+3), 0, V(3*b+2), 0
+#define BLOCK_FIELD2(b) V(3*b), 0, Y(6*b+2), 0, U(3*b+2), 0, Y(6*b+5), 0
+
+/** @internal @This packs up to 24 clipped 10-bit pixels in v210 blocks. */
+UPIPE_V210_AVX512
+static inline __m512i upipe_v210enc_pack_avx512(__m512i y, __m512i uv)
+{
+    static const uint16_t field0[32] = { BLOCK_FIELD0(0), BLOCK_FIELD0(1),
+                                         BLOCK_FIELD0(2), BLOCK_FIELD0(3) };
+    static const uint16_t field1[32] = { BLOCK_FIELD1(0), BLOCK_FIELD1(1),
+                                         BLOCK_FIELD1(2), BLOCK_FIELD1(3) };
+    static const uint16_t field2[32] = { BLOCK_FIELD2(0), BLOCK_FIELD2(1),
+                                         BLOCK_FIELD2(2), BLOCK_FIELD2(3) };
+    /* only keep the low word of each dword */
+    const __mmask32 low = 0x55555555;
+
+    __m512i f0 = _mm512_maskz_permutex2var_epi16(low, y,
+            _mm512_loadu_si512(field0), uv);
+    __m512i f1 = _mm512_maskz_permutex2var_epi16(low, y,
+            _mm512_loadu_si512(field1), uv);
+    __m512i f2 = _mm512_maskz_permutex2var_epi16(low, y,
+            _mm512_loadu_si512(field2), uv);
+    return _mm512_or_si512(_mm512_or_si512(f0, _mm512_slli_epi32(f1, 10)),
+                           _mm512_slli_epi32(f2, 20));
+}
+
+#undef Y
+#undef U
+#undef V
+#undef BLOCK_FIELD0
+#undef BLOCK_FIELD1
+#undef BLOCK_FIELD2
+
+UPIPE_V210_AVX512
+void upipe_planar_to_v210_10_avx512(const uint16_t *y, const uint16_t *u,
+                                    const uint16_t *v, uint8_t *dst,
+                                    ptrdiff_t pixels)
+{
+    const __m512i min = _mm512_set1_epi16(4);
+    const __m512i max = _mm512_set1_epi16(1019);
+
+    for (ptrdiff_t i = 0; i < pixels - 5; i += 24) {
+        /* number of 6-pixel blocks in this iteration */
+        ptrdiff_t blocks = (pixels - i) / 6;
+        if (blocks > 4)
+            blocks = 4;
+        __mmask32 ymask = (1U << (6 * blocks)) - 1;
+        __mmask16 cmask = (1U << (3 * blocks)) - 1;
+        __mmask16 dmask = (1U << (4 * blocks)) - 1;
+
+        __m512i yv = _mm512_maskz_loadu_epi16(ymask, y);
+        __m512i uv = _mm512_inserti64x4(
+                _mm512_castsi256_si512(_mm256_maskz_loadu_epi16(cmask, u)),
+                _mm256_maskz_loadu_epi16(cmask, v), 1);
+        yv = _mm512_min_epu16(_mm512_max_epu16(yv, min), max);
+        uv = _mm512_min_epu16(_mm512_max_epu16(uv, min), max);
+
+        _mm512_mask_storeu_epi32(dst, dmask,
+                                 upipe_v210enc_pack_avx512(yv, uv));
+        y += 24;
+        u += 12;
+        v += 12;
+        dst += 64;
+    }
+}
+
+UPIPE_V210_AVX512
+void upipe_planar_to_v210_8_avx512(const uint8_t *y, const uint8_t *u,
+                                   const uint8_t *v, uint8_t *dst,
+                                   ptrdiff_t pixels)
+{
+    const __m512i min = _mm512_set1_epi16(1);
+    const __m512i max = _mm512_set1_epi16(254);
+
+    for (ptrdiff_t i = 0; i < pixels - 5; i += 24) {
+        /* number of 6-pixel blocks in this iteration */
+        ptrdiff_t blocks = (pixels - i) / 6;
+        if (blocks > 4)
+            blocks = 4;
+        __mmask32 ymask = (1U << (6 * blocks)) - 1;
+        __mmask16 cmask = (1U << (3 * blocks)) - 1;
+        __mmask16 dmask = (1U << (4 * blocks)) - 1;
+
+        __m512i yv = _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(ymask, y));
+        __m512i uv = _mm512_inserti64x4(
+                _mm512_castsi256_si512(_mm256_cvtepu8_epi16(
+                        _mm_maskz_loadu_epi8(cmask, u))),
+                _mm256_cvtepu8_epi16(_mm_maskz_loadu_epi8(cmask, v)), 1);
+        yv = _mm512_min_epu16(_mm512_max_epu16(yv, min), max);
+        uv = _mm512_min_epu16(_mm512_max_epu16(uv, min), max);
+
+        _mm512_mask_storeu_epi32(dst, dmask, upipe_v210enc_pack_avx512(
+                    _mm512_slli_epi16(yv, 2), _mm512_slli_epi16(uv, 2)));
+        y += 24;
+        u += 12;
+        v += 12;
+        dst += 64;
+    }
+}
+
+#undef UPIPE_V210_AVX512
+#endif
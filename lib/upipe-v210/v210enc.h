@@ -18,4 +18,10 @@ void upipe_planar_to_v210_8_avx(const uint8_t *y, const uint8_t *u,
 void upipe_planar_to_v210_8_avx2(const uint8_t *y, const uint8_t *u,
                                    const uint8_t *v, uint8_t *dst, ptrdiff_t pixels);
 
+/* AVX-512 (BW, VL) intrinsics, any number of pixels multiple of 6 */
+void upipe_planar_to_v210_10_avx512(const uint16_t *y, const uint16_t *u,
+                                    const uint16_t *v, uint8_t *dst, ptrdiff_t pixels);
+void upipe_planar_to_v210_8_avx512(const uint8_t *y, const uint8_t *u,
+                                   const uint8_t *v, uint8_t *dst, ptrdiff_t pixels);
+
 #endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short pool of threads converting v210 pictures by bands of rows
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "v210threads.h"
+
+/** @internal @This describes a worker thread. */
+struct v210thread {
+    /** pointer to the pool */
+    struct v210threads *pool;
+    /** band converted by the thread */
+    unsigned int index;
+    /** thread */
+    pthread_t thread;
+};
+
+/** @internal @This is the pool of threads. */
+struct v210threads {
+    /** protects the fields below */
+    pthread_mutex_t mutex;
+    /** signals a new picture or the exit of the threads */
+    pthread_cond_t start;
+    /** signals the end of the conversion */
+    pthread_cond_t done;
+    /** incremented for each picture */
+    uint64_t generation;
+    /** number of bands not yet converted */
+    unsigned int pending;
+    /** true if the threads must exit */
+    bool exit;
+
+    /** function converting a band */
+    v210threads_cb cb;
+    /** opaque passed to cb */
+    void *opaque;
+    /** number of rows of the picture */
+    int rows;
+
+    /** number of bands */
+    unsigned int nb_threads;
+    /** worker threads (nb_threads - 1) */
+    struct v210thread threads[];
+};
+
+/** @internal @This converts a band of rows.
+ *
+ * @param pool pointer to the pool
+ * @param index band to convert
+ */
+static void v210threads_band(struct v210threads *pool, unsigned int index)
+{
+    int start = (int64_t)pool->rows * index / pool->nb_threads;
+    int end = (int64_t)pool->rows * (index + 1) / pool->nb_threads;
+    if (start < end)
+        pool->cb(pool->opaque, start, end);
+}
+
+/** @internal @This is the main loop of a worker thread.
+ *
+ * @param _thread pointer to the thread description
+ * @return NULL
+ */
+static void *v210threads_main(void *_thread)
+{
+    struct v210thread *thread = _thread;
+    struct v210threads *pool = thread->pool;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    for ( ; ; ) {
+        while (!pool->exit && pool->generation == generation)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        if (pool->exit)
+            break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        v210threads_band(pool, thread->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (!--pool->pending)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/** @This allocates a pool of threads converting pictures by bands of rows.
+ * The calling thread converts the first band, so threads - 1 threads are
+ * actually created.
+ *
+ * @param threads number of bands
+ * @return pointer to the pool, or NULL in case of error
+ */
+struct v210threads *v210threads_alloc(unsigned int threads)
+{
+    if (!threads)
+        return NULL;
+
+    struct v210threads *pool = malloc(sizeof(struct v210threads) +
+                                      (threads - 1) * sizeof(struct v210thread));
+    if (pool == NULL)
+        return NULL;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->exit = false;
+    pool->cb = NULL;
+    pool->opaque = NULL;
+    pool->rows = 0;
+    pool->nb_threads = 1;
+
+    for (unsigned int i = 1; i < threads; i++) {
+        struct v210thread *thread = &pool->threads[i - 1];
+        thread->pool = pool;
+        thread->index = i;
+        if (pthread_create(&thread->thread, NULL, v210threads_main, thread)) {
+            v210threads_free(pool);
+            return NULL;
+        }
+        pool->nb_threads++;
+    }
+    return pool;
+}
+
+/** @This converts a picture by bands of rows, and returns once all bands
+ * are converted.
+ *
+ * @param pool pointer to the pool
+ * @param cb function converting a band
+ * @param opaque opaque passed to cb
+ * @param rows number of rows of the picture
+ */
+void v210threads_run(struct v210threads *pool, v210threads_cb cb,
+                     void *opaque, int rows)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->cb = cb;
+    pool->opaque = opaque;
+    pool->rows = rows;
+    pool->pending = pool->nb_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    v210threads_band(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/** @This stops the threads and frees the pool.
+ *
+ * @param pool pointer to the pool
+ */
+void v210threads_free(struct v210threads *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->exit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (unsigned int i = 1; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i - 1].thread, NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short pool of threads converting v210 pictures by bands of rows
+ */
+
+#ifndef _V210THREADS_H_
+/** @hidden */
+#define _V210THREADS_H_
+
+/** @This converts the rows [start, end[ of a picture. */
+typedef void (*v210threads_cb)(void *opaque, int start, int end);
+
+/** @hidden */
+struct v210threads;
+
+/** @This allocates a pool of threads converting pictures by bands of rows.
+ *
+ * @param threads number of bands, including the one converted by the
+ * calling thread
+ * @return pointer to the pool, or NULL in case of error
+ */
+struct v210threads *v210threads_alloc(unsigned int threads);
+
+/** @This converts a picture by bands of rows, and returns once all bands
+ * are converted.
+ *
+ * @param pool pointer to the pool
+ * @param cb function converting a band
+ * @param opaque opaque passed to cb
+ * @param rows number of rows of the picture
+ */
+void v210threads_run(struct v210threads *pool, v210threads_cb cb,
+                     void *opaque, int rows);
+
+/** @This stops the threads and frees the pool.
+ *
+ * @param pool pointer to the pool, or NULL
+ */
+void v210threads_free(struct v210threads *pool);
+
+#endif
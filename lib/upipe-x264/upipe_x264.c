@@ -34,6 +34,7 @@
 #include <upipe/uprobe.h>
 #include <upipe/udict.h>
 #include <upipe/uref.h>
+#include <upipe/uref_attr.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_dump.h>
@@ -68,6 +69,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <x264.h>
 #include <bitstream/mpeg/h264.h>
@@ -77,6 +79,80 @@
 #define OUT_FLOW "block.h264.pic."
 #define OUT_FLOW_MPEG2 "block.mpeg2video.pic."
 
+/** @internal planes of the input pictures */
+static const char *const upipe_x264_chromas[] = {"y8", "u8", "v8"};
+
+/** @hidden */
+UREF_ATTR_UNSIGNED(x264, chunk, "x.x264_chunk", x264 chunk index)
+
+/** @internal @This is a picture exchanged with an encoder thread in chunked
+ * mode. */
+struct upipe_x264_job {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** picture to encode, or encoded picture, with the uref as opaque */
+    x264_picture_t pic;
+    /** timebase numerator of the encoder */
+    uint32_t timebase_num;
+    /** timebase denominator of the encoder */
+    uint32_t timebase_den;
+    /** copy of the NAL units of the encoded picture */
+    x264_nal_t *nals;
+    /** number of NAL units */
+    int nals_num;
+};
+
+UBASE_FROM_TO(upipe_x264_job, uchain, uchain, uchain)
+
+/** @internal @This is a message logged by x264, possibly from one of its
+ * threads, waiting to be thrown from the pipe thread. */
+struct upipe_x264_log {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** log level */
+    enum uprobe_log_level level;
+    /** message */
+    char msg[];
+};
+
+UBASE_FROM_TO(upipe_x264_log, uchain, uchain, uchain)
+
+/** @internal @This is an encoder instance in chunked mode, running on its
+ * own thread. */
+struct upipe_x264_instance {
+    /** x264 encoder */
+    x264_t *encoder;
+    /** x264 "PTS" of this instance */
+    uint64_t x264_ts;
+    /** encoded urefs waiting to be restitched (pipe thread only) */
+    struct uchain urefs;
+
+    /** encoder thread */
+    pthread_t thread;
+    /** true if the thread was started */
+    bool started;
+    /** protects the fields below */
+    pthread_mutex_t mutex;
+    /** signals new pictures, a flush or the exit of the thread */
+    pthread_cond_t cond;
+    /** signals that a picture was encoded or the flush is over */
+    pthread_cond_t done;
+    /** pictures to encode */
+    struct uchain inputs;
+    /** number of pictures to encode */
+    uint64_t nb_inputs;
+    /** encoded pictures */
+    struct uchain outputs;
+    /** number of encoding errors */
+    unsigned int errors;
+    /** true while the thread is using the encoder */
+    bool busy;
+    /** true if the delayed pictures must be output */
+    bool flush;
+    /** true if the thread must exit */
+    bool exit;
+};
+
 /** @internal upipe_x264 private structure */
 struct upipe_x264 {
     /** refcount management structure */
@@ -94,10 +170,34 @@ struct upipe_x264 {
     uint64_t sc_latency;
     /** true if the existing slice types must be enforced */
     bool slice_type_enforce;
+    /** number of slice threads, or 0 */
+    unsigned int sliced_threads;
+
+    /** number of encoder instances in chunked mode, or 0 */
+    unsigned int chunk_instances;
+    /** number of GOPs per chunk */
+    unsigned int chunk_gops;
+    /** encoder instances in chunked mode */
+    struct upipe_x264_instance *instances;
+    /** number of pictures per chunk */
+    uint64_t chunk_frames;
+    /** index of the chunk being fed */
+    uint64_t chunk_in;
+    /** number of pictures fed in the current chunk */
+    uint64_t chunk_in_frames;
+    /** index of the chunk being output */
+    uint64_t chunk_out;
+    /** number of pictures output in the current chunk */
+    uint64_t chunk_out_frames;
 
     /** x264 "PTS" */
     uint64_t x264_ts;
 
+    /** protects the list of log messages */
+    pthread_mutex_t log_mutex;
+    /** log messages waiting to be thrown */
+    struct uchain logs;
+
     /** uclock */
     struct uclock *uclock;
     /** uclock request */
@@ -175,6 +275,21 @@ static int upipe_x264_check_flow_format(struct upipe *upipe,
 /** @hidden */
 static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
                               struct upump **upump_p);
+/** @hidden */
+static void upipe_x264_flush(struct upipe *upipe, x264_t *encoder);
+/** @hidden */
+static void upipe_x264_wait_instances(struct upipe *upipe);
+/** @hidden */
+static void upipe_x264_encoded(struct upipe *upipe,
+                               x264_nal_t *nals, int nals_num,
+                               x264_picture_t *pic, uint32_t timebase_num,
+                               uint32_t timebase_den, struct upump **upump_p);
+/** @hidden */
+static void upipe_x264_queue_chunk(struct upipe *upipe, struct uref *uref,
+                                   struct upump **upump_p);
+/** @hidden */
+static void upipe_x264_restitch(struct upipe *upipe, struct upump **upump_p,
+                                bool flush);
 
 UPIPE_HELPER_UPIPE(upipe_x264, upipe, UPIPE_X264_SIGNATURE);
 UPIPE_HELPER_UREFCOUNT(upipe_x264, urefcount, upipe_x264_free)
@@ -201,7 +316,9 @@ static const enum uprobe_log_level loglevel_map[] = {
     [X264_LOG_DEBUG] = UPROBE_LOG_VERBOSE
 };
 
-/** @internal @This sends x264 logs to uprobe_log
+/** @internal @This queues x264 logs, which may come from the encoder
+ * threads, until they are thrown by @ref upipe_x264_throw_logs.
+ *
  * @param upipe description structure of the pipe
  * @param loglevel x264 loglevel
  * @param format string format
@@ -212,21 +329,55 @@ static void upipe_x264_log(void *_upipe, int loglevel,
                            const char *format, va_list args)
 {
     struct upipe *upipe = _upipe;
-    char *string = NULL, *end = NULL;
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
     if (unlikely(loglevel < 0 || loglevel > X264_LOG_DEBUG)) {
         return;
     }
 
-    int ret = vasprintf(&string, format, args);
-    if (unlikely(ret < 0) || unlikely(!string)) {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int len = vsnprintf(NULL, 0, format, args_copy);
+    va_end(args_copy);
+    if (unlikely(len < 0)) {
         return;
     }
-    end = string + strlen(string) - 1;
-    if (isspace(*end)) {
-        *end = '\0';
+    struct upipe_x264_log *log = malloc(sizeof(struct upipe_x264_log) +
+                                        len + 1);
+    if (unlikely(log == NULL)) {
+        return;
+    }
+    vsnprintf(log->msg, len + 1, format, args);
+    if (len && isspace(log->msg[len - 1])) {
+        log->msg[len - 1] = '\0';
+    }
+    uchain_init(upipe_x264_log_to_uchain(log));
+    log->level = loglevel_map[loglevel];
+
+    pthread_mutex_lock(&upipe_x264->log_mutex);
+    ulist_add(&upipe_x264->logs, upipe_x264_log_to_uchain(log));
+    pthread_mutex_unlock(&upipe_x264->log_mutex);
+}
+
+/** @internal @This throws the queued x264 logs from the pipe thread.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_x264_throw_logs(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    struct uchain logs;
+    ulist_init(&logs);
+    pthread_mutex_lock(&upipe_x264->log_mutex);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&upipe_x264->logs)) != NULL)
+        ulist_add(&logs, uchain);
+    pthread_mutex_unlock(&upipe_x264->log_mutex);
+
+    while ((uchain = ulist_pop(&logs)) != NULL) {
+        struct upipe_x264_log *log = upipe_x264_log_from_uchain(uchain);
+        upipe_log(upipe, log->level, log->msg);
+        free(log);
     }
-    upipe_log(upipe, loglevel_map[loglevel], string);
-    free(string);
 }
 
 /** @internal @This checks whether mpeg2 encoding is enabled
@@ -254,6 +405,16 @@ static int _upipe_x264_reconfigure(struct upipe *upipe)
     if (unlikely(!upipe_x264->encoder)) {
         return UBASE_ERR_UNHANDLED;
     }
+    if (upipe_x264->instances != NULL) {
+        upipe_x264_wait_instances(upipe);
+        for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+            ret = x264_encoder_reconfig(upipe_x264->instances[i].encoder,
+                                        &upipe_x264->params);
+            if (ret < 0)
+                return UBASE_ERR_EXTERNAL;
+        }
+        return UBASE_ERR_NONE;
+    }
     ret = x264_encoder_reconfig(upipe_x264->encoder, &upipe_x264->params);
     return ( (ret < 0) ? UBASE_ERR_EXTERNAL : UBASE_ERR_NONE );
 }
@@ -370,6 +531,48 @@ static int _upipe_x264_set_slice_type_enforce(struct upipe *upipe, bool enforce)
     return UBASE_ERR_NONE;
 }
 
+/** @This switches x264 into sliced threads mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of slice threads, or 0 to disable
+ * @return an error code
+ */
+static int _upipe_x264_set_sliced_threads(struct upipe *upipe,
+                                          unsigned int threads)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    if (upipe_x264->encoder != NULL)
+        return UBASE_ERR_BUSY;
+    if (threads && upipe_x264->chunk_instances)
+        return UBASE_ERR_INVALID;
+    upipe_x264->sliced_threads = threads;
+    upipe_dbg_va(upipe, "%sactivating sliced threads (%u)",
+                 threads ? "" : "de", threads);
+    return UBASE_ERR_NONE;
+}
+
+/** @This switches x264 into chunked GOP-parallel mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param instances number of encoder instances, or 0 to disable
+ * @param gops number of GOPs per chunk
+ * @return an error code
+ */
+static int _upipe_x264_set_chunked(struct upipe *upipe,
+                                   unsigned int instances, unsigned int gops)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    if (upipe_x264->encoder != NULL)
+        return UBASE_ERR_BUSY;
+    if (instances && (!gops || upipe_x264->sliced_threads))
+        return UBASE_ERR_INVALID;
+    upipe_x264->chunk_instances = instances;
+    upipe_x264->chunk_gops = gops;
+    upipe_dbg_va(upipe, "%sactivating chunked mode (%u instances, %u GOPs)",
+                 instances ? "" : "de", instances, gops);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This allocates a filter pipe.
  *
  * @param mgr common management structure
@@ -394,7 +597,18 @@ static struct upipe *upipe_x264_alloc(struct upipe_mgr *mgr,
     upipe_x264->initial_latency = 0;
     upipe_x264->sc_latency = 0;
     upipe_x264->slice_type_enforce = false;
+    upipe_x264->sliced_threads = 0;
+    upipe_x264->chunk_instances = 0;
+    upipe_x264->chunk_gops = 0;
+    upipe_x264->instances = NULL;
+    upipe_x264->chunk_frames = 0;
+    upipe_x264->chunk_in = 0;
+    upipe_x264->chunk_in_frames = 0;
+    upipe_x264->chunk_out = 0;
+    upipe_x264->chunk_out_frames = 0;
     upipe_x264->x264_ts = 0;
+    pthread_mutex_init(&upipe_x264->log_mutex, NULL);
+    ulist_init(&upipe_x264->logs);
 
     upipe_x264_init_urefcount(upipe);
     upipe_x264_init_ubuf_mgr(upipe);
@@ -421,6 +635,415 @@ static struct upipe *upipe_x264_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This tunes the parameters for sliced threads mode: no
+ * lookahead, no B-frames, and a VBV of one frame at the target bitrate.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_x264_apply_sliced_threads(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    x264_param_t *params = &upipe_x264->params;
+
+    params->i_threads = upipe_x264->sliced_threads;
+    params->b_sliced_threads = 1;
+    params->i_sync_lookahead = 0;
+    params->rc.i_lookahead = 0;
+    params->rc.b_mb_tree = 0;
+    params->i_bframe = 0;
+
+    if (params->rc.i_bitrate > 0) {
+        if (params->rc.i_vbv_max_bitrate <= 0)
+            params->rc.i_vbv_max_bitrate = params->rc.i_bitrate;
+        if (params->rc.i_vbv_buffer_size <= 0 && params->i_fps_num) {
+            uint64_t size = (uint64_t)params->rc.i_vbv_max_bitrate *
+                params->i_fps_den / params->i_fps_num;
+            params->rc.i_vbv_buffer_size = size ? size : 1;
+        }
+    }
+}
+
+/** @internal @This copies the NAL units returned by x264, which are only
+ * valid until the next call to the encoder.
+ *
+ * @param job encoded picture
+ * @param nals NAL units
+ * @param nals_num number of NAL units
+ * @return false in case of allocation error
+ */
+static bool upipe_x264_job_copy_nals(struct upipe_x264_job *job,
+                                     x264_nal_t *nals, int nals_num)
+{
+    size_t size = 0;
+    for (int i = 0; i < nals_num; i++)
+        size += nals[i].i_payload;
+    job->nals = malloc(sizeof(x264_nal_t) * nals_num + size);
+    if (unlikely(job->nals == NULL))
+        return false;
+
+    uint8_t *payload = (uint8_t *)(job->nals + nals_num);
+    memcpy(payload, nals[0].p_payload, size);
+    for (int i = 0; i < nals_num; i++) {
+        job->nals[i] = nals[i];
+        job->nals[i].p_payload = payload;
+        payload += nals[i].i_payload;
+    }
+    job->nals_num = nals_num;
+    return true;
+}
+
+/** @internal @This queues the result of an encoder call, from the encoder
+ * thread. A picture that could not be encoded is queued without NAL units,
+ * so that its chunk still completes.
+ *
+ * @param instance encoder instance
+ * @param job structure to reuse for the encoded picture
+ * @param ret return value of the encoder
+ * @param nals NAL units
+ * @param nals_num number of NAL units
+ * @param pic encoded picture
+ * @param dropped uref of the input picture if the encoder failed, or NULL
+ */
+static void upipe_x264_instance_encoded(struct upipe_x264_instance *instance,
+                                        struct upipe_x264_job *job, int ret,
+                                        x264_nal_t *nals, int nals_num,
+                                        x264_picture_t *pic,
+                                        struct uref *dropped)
+{
+    bool error = ret < 0;
+    bool queue = false;
+    job->nals = NULL;
+    job->nals_num = 0;
+    if (ret > 0) {
+        x264_param_t params;
+        x264_encoder_parameters(instance->encoder, &params);
+        job->pic = *pic;
+        job->timebase_num = params.i_timebase_num;
+        job->timebase_den = params.i_timebase_den;
+        if (unlikely(!upipe_x264_job_copy_nals(job, nals, nals_num)))
+            error = true;
+        queue = true;
+    } else if (error && dropped != NULL) {
+        job->pic.opaque = dropped;
+        queue = true;
+    }
+
+    pthread_mutex_lock(&instance->mutex);
+    if (queue)
+        ulist_add(&instance->outputs, upipe_x264_job_to_uchain(job));
+    if (error)
+        instance->errors++;
+    pthread_mutex_unlock(&instance->mutex);
+    if (!queue)
+        free(job);
+}
+
+/** @internal @This is the main loop of an encoder thread in chunked mode.
+ *
+ * @param _instance encoder instance
+ * @return NULL
+ */
+static void *upipe_x264_instance_run(void *_instance)
+{
+    struct upipe_x264_instance *instance = _instance;
+
+    pthread_mutex_lock(&instance->mutex);
+    for ( ; ; ) {
+        struct uchain *uchain = ulist_pop(&instance->inputs);
+        if (uchain != NULL) {
+            instance->busy = true;
+            pthread_mutex_unlock(&instance->mutex);
+
+            struct upipe_x264_job *job = upipe_x264_job_from_uchain(uchain);
+            struct uref *uref = job->pic.opaque;
+            x264_picture_t pic;
+            x264_nal_t *nals;
+            int nals_num;
+            x264_picture_init(&pic);
+            int ret = x264_encoder_encode(instance->encoder, &nals, &nals_num,
+                                          &job->pic, &pic);
+
+            /* x264 keeps its own copy of the picture */
+            for (int i = 0; i < 3; i++)
+                uref_pic_plane_unmap(uref, upipe_x264_chromas[i],
+                                     0, 0, -1, -1);
+            ubuf_free(uref_detach_ubuf(uref));
+            upipe_x264_instance_encoded(instance, job, ret, nals, nals_num,
+                                        &pic, ret < 0 ? uref : NULL);
+
+            pthread_mutex_lock(&instance->mutex);
+            instance->nb_inputs--;
+            instance->busy = false;
+            pthread_cond_signal(&instance->done);
+
+        } else if (instance->flush) {
+            instance->busy = true;
+            pthread_mutex_unlock(&instance->mutex);
+
+            while (x264_encoder_delayed_frames(instance->encoder)) {
+                struct upipe_x264_job *job =
+                    malloc(sizeof(struct upipe_x264_job));
+                x264_picture_t pic;
+                x264_nal_t *nals;
+                int nals_num;
+                x264_picture_init(&pic);
+                int ret = x264_encoder_encode(instance->encoder, &nals,
+                                              &nals_num, NULL, &pic);
+                if (unlikely(job == NULL)) {
+                    if (ret > 0)
+                        uref_free(pic.opaque);
+                    ret = -1;
+                }
+                if (job != NULL)
+                    upipe_x264_instance_encoded(instance, job, ret,
+                                                nals, nals_num, &pic, NULL);
+                if (unlikely(ret < 0))
+                    break;
+            }
+
+            pthread_mutex_lock(&instance->mutex);
+            instance->flush = false;
+            instance->busy = false;
+            pthread_cond_signal(&instance->done);
+
+        } else if (instance->exit)
+            break;
+        else
+            pthread_cond_wait(&instance->cond, &instance->mutex);
+    }
+    pthread_mutex_unlock(&instance->mutex);
+    return NULL;
+}
+
+/** @internal @This waits until the encoder threads are idle, so that the
+ * encoders may be used from the pipe thread.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_x264_wait_instances(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        pthread_mutex_lock(&instance->mutex);
+        while (instance->nb_inputs || instance->flush || instance->busy)
+            pthread_cond_wait(&instance->done, &instance->mutex);
+        pthread_mutex_unlock(&instance->mutex);
+    }
+}
+
+/** @internal @This outputs or queues for restitching the pictures encoded
+ * by the encoder threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to upump structure
+ */
+static void upipe_x264_collect(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        struct uchain outputs;
+        ulist_init(&outputs);
+        pthread_mutex_lock(&instance->mutex);
+        struct uchain *uchain;
+        while ((uchain = ulist_pop(&instance->outputs)) != NULL)
+            ulist_add(&outputs, uchain);
+        unsigned int errors = instance->errors;
+        instance->errors = 0;
+        pthread_mutex_unlock(&instance->mutex);
+
+        if (unlikely(errors))
+            upipe_warn_va(upipe, "%u error(s) encoding frames", errors);
+        while ((uchain = ulist_pop(&outputs)) != NULL) {
+            struct upipe_x264_job *job = upipe_x264_job_from_uchain(uchain);
+            if (unlikely(job->nals == NULL))
+                upipe_x264_queue_chunk(upipe, job->pic.opaque, upump_p);
+            else
+                upipe_x264_encoded(upipe, job->nals, job->nals_num, &job->pic,
+                                   job->timebase_num, job->timebase_den,
+                                   upump_p);
+            free(job->nals);
+            free(job);
+        }
+    }
+    upipe_x264_throw_logs(upipe);
+}
+
+/** @internal @This gives the slot of a picture that could not be dispatched
+ * to an encoder thread back to the next picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param instance encoder instance
+ */
+static void upipe_x264_cancel_dispatch(struct upipe *upipe,
+                                       struct upipe_x264_instance *instance)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    upipe_x264->chunk_in_frames--;
+    instance->x264_ts--;
+}
+
+/** @internal @This queues a picture for an encoder thread. The pipe thread
+ * waits if a whole chunk of pictures is already queued.
+ *
+ * @param upipe description structure of the pipe
+ * @param instance encoder instance
+ * @param pic picture to encode, with the uref as opaque
+ * @return false in case of allocation error
+ */
+static bool upipe_x264_dispatch(struct upipe *upipe,
+                                struct upipe_x264_instance *instance,
+                                x264_picture_t *pic)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    struct upipe_x264_job *job = malloc(sizeof(struct upipe_x264_job));
+    if (unlikely(job == NULL))
+        return false;
+    uchain_init(upipe_x264_job_to_uchain(job));
+    job->pic = *pic;
+    job->nals = NULL;
+    job->nals_num = 0;
+
+    pthread_mutex_lock(&instance->mutex);
+    while (instance->nb_inputs >= upipe_x264->chunk_frames)
+        pthread_cond_wait(&instance->done, &instance->mutex);
+    ulist_add(&instance->inputs, upipe_x264_job_to_uchain(job));
+    instance->nb_inputs++;
+    pthread_cond_signal(&instance->cond);
+    pthread_mutex_unlock(&instance->mutex);
+    return true;
+}
+
+/** @internal @This outputs the delayed pictures of all encoder threads, and
+ * the chunks waiting to be restitched.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_x264_flush_instances(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        pthread_mutex_lock(&instance->mutex);
+        instance->flush = true;
+        pthread_cond_signal(&instance->cond);
+        pthread_mutex_unlock(&instance->mutex);
+    }
+    upipe_x264_wait_instances(upipe);
+    upipe_x264_collect(upipe, NULL);
+    upipe_x264_restitch(upipe, NULL, true);
+}
+
+/** @internal @This stops the encoder threads, closes the encoder instances
+ * in chunked mode, and frees the urefs which have not been restitched.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_x264_free_instances(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    if (upipe_x264->instances == NULL)
+        return;
+
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        if (instance->started) {
+            pthread_mutex_lock(&instance->mutex);
+            instance->exit = true;
+            pthread_cond_signal(&instance->cond);
+            pthread_mutex_unlock(&instance->mutex);
+            pthread_join(instance->thread, NULL);
+        }
+
+        struct uchain *uchain, *uchain_tmp;
+        ulist_delete_foreach(&instance->inputs, uchain, uchain_tmp) {
+            struct upipe_x264_job *job = upipe_x264_job_from_uchain(uchain);
+            ulist_delete(uchain);
+            uref_free(job->pic.opaque);
+            free(job);
+        }
+        ulist_delete_foreach(&instance->outputs, uchain, uchain_tmp) {
+            struct upipe_x264_job *job = upipe_x264_job_from_uchain(uchain);
+            ulist_delete(uchain);
+            uref_free(job->pic.opaque);
+            free(job->nals);
+            free(job);
+        }
+        ulist_delete_foreach(&instance->urefs, uchain, uchain_tmp) {
+            ulist_delete(uchain);
+            uref_free(uref_from_uchain(uchain));
+        }
+        if (instance->encoder != NULL)
+            x264_encoder_close(instance->encoder);
+        pthread_cond_destroy(&instance->done);
+        pthread_cond_destroy(&instance->cond);
+        pthread_mutex_destroy(&instance->mutex);
+    }
+    free(upipe_x264->instances);
+    upipe_x264->instances = NULL;
+    upipe_x264->encoder = NULL;
+}
+
+/** @internal @This opens the encoder instances in chunked mode, and starts
+ * a thread for each of them.
+ *
+ * @param upipe description structure of the pipe
+ * @return false in case of error
+ */
+static bool upipe_x264_open_instances(struct upipe *upipe)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    x264_param_t *params = &upipe_x264->params;
+
+    if (params->i_keyint_max <= 0 ||
+        params->i_keyint_max == X264_KEYINT_MAX_INFINITE) {
+        upipe_err(upipe, "chunked mode requires a finite keyint");
+        return false;
+    }
+    /* chunks must be independently decodable */
+    params->b_open_gop = 0;
+    upipe_x264->chunk_frames =
+        (uint64_t)params->i_keyint_max * upipe_x264->chunk_gops;
+
+    upipe_x264->instances = calloc(upipe_x264->chunk_instances,
+                                   sizeof(struct upipe_x264_instance));
+    if (unlikely(upipe_x264->instances == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        ulist_init(&instance->urefs);
+        ulist_init(&instance->inputs);
+        ulist_init(&instance->outputs);
+        pthread_mutex_init(&instance->mutex, NULL);
+        pthread_cond_init(&instance->cond, NULL);
+        pthread_cond_init(&instance->done, NULL);
+    }
+
+    for (unsigned int i = 0; i < upipe_x264->chunk_instances; i++) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[i];
+        instance->encoder = x264_encoder_open(params);
+        if (unlikely(instance->encoder == NULL)) {
+            upipe_err_va(upipe, "unable to open encoder instance %u", i);
+            upipe_x264_free_instances(upipe);
+            return false;
+        }
+        if (unlikely(pthread_create(&instance->thread, NULL,
+                                    upipe_x264_instance_run, instance))) {
+            upipe_err_va(upipe, "unable to start encoder thread %u", i);
+            upipe_x264_free_instances(upipe);
+            return false;
+        }
+        instance->started = true;
+    }
+    upipe_x264->encoder = upipe_x264->instances[0].encoder;
+    upipe_notice_va(upipe, "opened %u instances, %"PRIu64" pictures per chunk",
+                    upipe_x264->chunk_instances, upipe_x264->chunk_frames);
+    return true;
+}
+
 /** @internal @This opens x264 encoder.
  *
  * @param upipe description structure of the pipe
@@ -496,7 +1119,13 @@ static bool upipe_x264_open(struct upipe *upipe, int width, int height)
     if (unlikely(upipe_x264->encoder)) {
         if (!ubase_check(_upipe_x264_reconfigure(upipe)))
             return false;
+    } else if (upipe_x264->chunk_instances) {
+        if (unlikely(!upipe_x264_open_instances(upipe)))
+            return false;
     } else {
+        if (upipe_x264->sliced_threads)
+            upipe_x264_apply_sliced_threads(upipe);
+
         /* open encoder */
         upipe_x264->encoder = x264_encoder_open(params);
         if (unlikely(!upipe_x264->encoder))
@@ -653,10 +1282,13 @@ static bool upipe_x264_open(struct upipe *upipe, int width, int height)
 static void upipe_x264_close(struct upipe *upipe)
 {
     struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
-    if (upipe_x264->encoder) {
-        while(x264_encoder_delayed_frames(upipe_x264->encoder)) {
-            upipe_x264_handle(upipe, NULL, NULL);
-        }
+    if (upipe_x264->instances != NULL) {
+        upipe_x264_flush_instances(upipe);
+
+        upipe_notice(upipe, "closing encoder instances");
+        upipe_x264_free_instances(upipe);
+    } else if (upipe_x264->encoder) {
+        upipe_x264_flush(upipe, upipe_x264->encoder);
 
         upipe_notice(upipe, "closing encoder");
         x264_encoder_close(upipe_x264->encoder);
@@ -678,6 +1310,10 @@ static void upipe_x264_build_flow_def(struct upipe *upipe)
         return;
     }
 
+    /* the encoder threads must not use the first instance meanwhile */
+    if (upipe_x264->instances != NULL)
+        upipe_x264_wait_instances(upipe);
+
     /* find latency */
     uint64_t latency = upipe_x264->input_latency;
     int delayed = x264_encoder_maximum_delayed_frames(upipe_x264->encoder);
@@ -688,6 +1324,11 @@ static void upipe_x264_build_flow_def(struct upipe *upipe)
     /* add one frame for the time of encoding the current frame */
     latency += UCLOCK_FREQ * upipe_x264->params.i_fps_den /
                upipe_x264->params.i_fps_num;
+    /* in chunked mode, a chunk is output once all instances were fed */
+    if (upipe_x264->instances != NULL)
+        latency += upipe_x264->chunk_frames * upipe_x264->chunk_instances *
+                   UCLOCK_FREQ * upipe_x264->params.i_fps_den /
+                   upipe_x264->params.i_fps_num;
     upipe_x264->initial_latency = latency;
 
     latency += upipe_x264->sc_latency;
@@ -741,205 +1382,163 @@ static inline bool upipe_x264_need_update(struct upipe *upipe,
             params->vui.i_overscan != upipe_x264->overscan);
 }
 
-/** @internal @This processes pictures.
+/** @internal @This rebases the timestamps of an encoded picture and outputs
+ * it.
  *
  * @param upipe description structure of the pipe
  * @param uref uref structure
  * @param upump_p reference to upump structure
- * @return true if the packet was handled
  */
-static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
-                              struct upump **upump_p)
+static void upipe_x264_output_frame(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
 {
     struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
-    const char *def;
-    if (unlikely(uref != NULL && ubase_check(uref_flow_get_def(uref, &def)))) {
-        upipe_x264->input_latency = 0;
-        uref_clock_get_latency(uref, &upipe_x264->input_latency);
-        upipe_x264_store_flow_def(upipe, NULL);
-        uref_free(upipe_x264->flow_def_requested);
-        upipe_x264->flow_def_requested = NULL;
-
-        if (upipe_x264_mpeg2_enabled(upipe)) {
-            struct urational dar;
-            dar.num = 4;
-            dar.den = 3;
-            uref_pic_flow_infer_dar(uref, &dar);
-            if (dar.num == 4 && dar.den == 3)
-                upipe_x264->mpeg2_ar = 2;
-            else if (dar.num == 16 && dar.den == 9)
-                upipe_x264->mpeg2_ar = 3;
-            else if (dar.num == 221 && dar.den == 100)
-                upipe_x264->mpeg2_ar = 4;
-            else {
-                upipe_warn_va(upipe,
-                        "unrecognized aspect ratio %"PRId64"/%"PRIu64", using square",
-                        dar.num, dar.den);
-                upipe_x264->mpeg2_ar = 1;
-            }
-        } else {
-            upipe_x264->sar.num = upipe_x264->sar.den = 1;
-            uref_pic_flow_get_sar(uref, &upipe_x264->sar);
-            bool overscan;
-            if (!ubase_check(uref_pic_flow_get_overscan(uref, &overscan)))
-                upipe_x264->overscan = 0; /* undef */
-            else
-                upipe_x264->overscan = overscan ? 2 : 1;
-        }
-
-        if (ubase_check(uref_pic_flow_check_yuv420p(uref)))
-            upipe_x264->chroma_subsampling = X264_CSP_I420;
-        else if (ubase_check(uref_pic_flow_check_yuv422p(uref)))
-            upipe_x264->chroma_subsampling = X264_CSP_I422;
-        else if (ubase_check(uref_pic_flow_check_yuv444p(uref)))
-            upipe_x264->chroma_subsampling = X264_CSP_I444;
-        else
-            upipe_err(upipe, "invalid chroma subsampling");
 
-        uref = upipe_x264_store_flow_def_input(upipe, uref);
-        if (uref != NULL) {
-            uref_pic_flow_clear_format(uref);
-            upipe_x264_require_flow_format(upipe, uref);
-        }
-        return true;
-    }
+    /* rebase to dts as we're in encoded domain now */
+    uint64_t dts = UINT64_MAX;
+    if ((!ubase_check(uref_clock_get_dts_prog(uref, &dts)) ||
+         dts < upipe_x264->last_dts) &&
+        upipe_x264->last_dts != UINT64_MAX) {
+        upipe_warn_va(upipe, "DTS prog in the past, resetting (%"PRIu64" ms)",
+                      (upipe_x264->last_dts - dts) * 1000 / UCLOCK_FREQ);
+        dts = upipe_x264->last_dts + 1;
+        uref_clock_set_dts_prog(uref, dts);
+    } else
+        uref_clock_rebase_dts_prog(uref);
 
-    static const char *const chromas[] = {"y8", "u8", "v8"};
-    size_t width, height;
-    x264_picture_t pic;
-    x264_nal_t *nals;
-    int i, nals_num, size = 0, header_size = 0;
-    struct ubuf *ubuf_block;
-    uint8_t *buf = NULL;
-    x264_param_t curparams;
-    bool needopen = false;
-    int ret = 0;
+    uint64_t dts_sys = UINT64_MAX;
+    if (dts != UINT64_MAX &&
+        upipe_x264->input_pts != UINT64_MAX &&
+        upipe_x264->input_pts_sys != UINT64_MAX) {
+        dts_sys = (int64_t)upipe_x264->input_pts_sys +
+            ((int64_t)dts - (int64_t)upipe_x264->input_pts) *
+            (int64_t)upipe_x264->drift_rate.num /
+            (int64_t)upipe_x264->drift_rate.den;
+        uref_clock_set_dts_sys(uref, dts_sys);
+    } else if (!ubase_check(uref_clock_get_dts_sys(uref, &dts_sys)) ||
+        (upipe_x264->last_dts_sys != UINT64_MAX &&
+               dts_sys < upipe_x264->last_dts_sys)) {
+        upipe_warn_va(upipe,
+                      "DTS sys in the past, resetting (%"PRIu64" ms)",
+                      (upipe_x264->last_dts_sys - dts_sys) * 1000 /
+                      UCLOCK_FREQ);
+        dts_sys = upipe_x264->last_dts_sys + 1;
+        uref_clock_set_dts_sys(uref, dts_sys);
+    } else
+        uref_clock_rebase_dts_sys(uref);
 
-    /* init x264 picture */
-    x264_picture_init(&pic);
+    uref_clock_rebase_dts_orig(uref);
+    uref_clock_set_rate(uref, upipe_x264->drift_rate);
 
-    if (likely(uref)) {
-        pic.opaque = uref;
-
-        uref_pic_size(uref, &width, &height, NULL);
-
-        /* open encoder if not already opened or if update needed */
-        if (unlikely(!upipe_x264->encoder)) {
-            needopen = true;
-        } else if (unlikely(upipe_x264_need_update(upipe, width, height))) {
-            x264_param_t *params = &upipe_x264_from_upipe(upipe)->params;
-            upipe_notice_va(upipe, "Flow parameters changed, reconfiguring encoder (%d:%zu, %d:%zu, %d:%"PRId64", %d:%"PRIu64", %d:%d)",
-                params->i_width, width, params->i_height, height,
-                params->vui.i_sar_width, upipe_x264->sar.num,
-                params->vui.i_sar_height, upipe_x264->sar.den,
-                params->vui.i_overscan, upipe_x264->overscan);
-            needopen = true;
-        }
-        if (unlikely(needopen)) {
-            if (unlikely(!upipe_x264_open(upipe, width, height))) {
-                upipe_err(upipe, "Could not open encoder");
-                uref_free(uref);
-                return true;
-            }
-        }
-        if (upipe_x264->flow_def_requested == NULL)
-            return false;
+    upipe_x264->last_dts = dts;
+    upipe_x264->last_dts_sys = dts_sys;
 
-        x264_encoder_parameters(upipe_x264->encoder, &curparams);
+#ifdef HAVE_X264_OBE
+    /* speedcontrol */
+    if (dts_sys != UINT64_MAX && upipe_x264->uclock != NULL &&
+        upipe_x264->sc_latency && upipe_x264->instances == NULL) {
+        uint64_t systime = uclock_now(upipe_x264->uclock);
+        int64_t buffer_state = dts_sys + upipe_x264->initial_latency +
+                               upipe_x264->sc_latency - systime;
+        float buffer_fill = (float)buffer_state /
+                            (float)upipe_x264->sc_latency;
+        x264_speedcontrol_sync(upipe_x264->encoder, buffer_fill, 0, 1);
+    }
+#endif
 
-        pic.img.i_csp = upipe_x264->chroma_subsampling;
+    if (upipe_x264->flow_def == NULL)
+        upipe_x264_build_flow_def(upipe);
 
-        /* set pts in x264 timebase */
-        pic.i_pts = upipe_x264->x264_ts;
-        upipe_x264->x264_ts++;
-        uref_clock_get_rate(uref, &upipe_x264->drift_rate);
-        uref_clock_get_pts_prog(uref, &upipe_x264->input_pts);
-        uref_clock_get_pts_sys(uref, &upipe_x264->input_pts_sys);
-
-        pic.i_type = X264_TYPE_AUTO;
-        if (upipe_x264->slice_type_enforce) {
-            uint8_t type;
-            if (ubase_check(uref_h264_get_type(uref, &type))) {
-                switch (type) {
-                    case H264SLI_TYPE_P:
-                        pic.i_type = X264_TYPE_P;
-                        break;
-                    case H264SLI_TYPE_B:
-                        pic.i_type = X264_TYPE_B;
-                        break;
-                    case H264SLI_TYPE_I:
-                        pic.i_type = X264_TYPE_KEYFRAME;
-                        break;
-                    case H264SLI_TYPE_SP:
-                    case H264SLI_TYPE_SI:
-                    default:
-                        break;
-                }
-            } else if (ubase_check(uref_mpgv_get_type(uref, &type))) {
-                switch (type) {
-                    case MP2VPIC_TYPE_P:
-                        pic.i_type = X264_TYPE_P;
-                        break;
-                    case MP2VPIC_TYPE_B:
-                        pic.i_type = X264_TYPE_B;
-                        break;
-                    case MP2VPIC_TYPE_I:
-                        pic.i_type = X264_TYPE_KEYFRAME;
-                        break;
-                    case MP2VPIC_TYPE_D:
-                    default:
-                        break;
-                }
-            }
-        }
+    upipe_x264_output(upipe, uref, upump_p);
+}
 
-        /* map */
-        for (i = 0; i < 3; i++) {
-            size_t stride;
-            const uint8_t *plane;
-            if (unlikely(!ubase_check(uref_pic_plane_size(uref, chromas[i], &stride,
-                                              NULL, NULL, NULL)) ||
-                         !ubase_check(uref_pic_plane_read(uref, chromas[i], 0, 0, -1, -1,
-                                              &plane)))) {
-                upipe_err_va(upipe, "Could not read origin chroma %s",
-                             chromas[i]);
+/** @internal @This outputs the encoded pictures of the chunks in the input
+ * order, as long as they are complete.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to upump structure
+ * @param flush true if incomplete chunks must also be output
+ */
+static void upipe_x264_restitch(struct upipe *upipe, struct upump **upump_p,
+                                bool flush)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+
+    while (upipe_x264->chunk_out <= upipe_x264->chunk_in) {
+        struct upipe_x264_instance *instance = &upipe_x264->instances[
+            upipe_x264->chunk_out % upipe_x264->chunk_instances];
+        struct uchain *uchain;
+        while ((uchain = ulist_peek(&instance->urefs)) != NULL) {
+            struct uref *uref = uref_from_uchain(uchain);
+            uint64_t chunk = UINT64_MAX;
+            uref_x264_get_chunk(uref, &chunk);
+            if (chunk != upipe_x264->chunk_out)
+                break;
+
+            ulist_pop(&instance->urefs);
+            uref_x264_delete_chunk(uref);
+            upipe_x264->chunk_out_frames++;
+            if (unlikely(uref->ubuf == NULL)) {
+                /* dropped picture, only counted in its chunk */
                 uref_free(uref);
-                return true;
+                continue;
             }
-            pic.img.i_stride[i] = stride;
-            /* cast needed because of x264 API */
-            pic.img.plane[i] = (uint8_t *)plane;
-        }
-        pic.img.i_plane = i;
-
-        /* encode frame ! */
-        ret = x264_encoder_encode(upipe_x264->encoder,
-                                  &nals, &nals_num, &pic, &pic);
-
-        /* unmap */
-        for (i = 0; i < 3; i++) {
-            uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+            upipe_x264_output_frame(upipe, uref, upump_p);
         }
-        ubuf_free(uref_detach_ubuf(uref));
 
-    } else {
-        /* NULL uref, flushing delayed frame */
-        ret = x264_encoder_encode(upipe_x264->encoder,
-                                  &nals, &nals_num, NULL, &pic);
-        x264_encoder_parameters(upipe_x264->encoder, &curparams);
+        if (!flush && upipe_x264->chunk_out_frames < upipe_x264->chunk_frames)
+            break;
+        upipe_x264->chunk_out++;
+        upipe_x264->chunk_out_frames = 0;
     }
+}
 
-    if (unlikely(ret < 0)) {
-        upipe_warn(upipe, "Error encoding frame");
+/** @internal @This queues an encoded picture for restitching in chunked
+ * mode. A uref without ubuf stands for a dropped picture, so that its chunk
+ * still completes.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref encoded or dropped picture
+ * @param upump_p reference to upump structure
+ */
+static void upipe_x264_queue_chunk(struct upipe *upipe, struct uref *uref,
+                                   struct upump **upump_p)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    uint64_t chunk;
+    if (unlikely(!ubase_check(uref_x264_get_chunk(uref, &chunk)))) {
         uref_free(uref);
-        return true;
-    } else if (unlikely(ret == 0)) {
-        upipe_verbose(upipe, "No nal units returned");
-        return true;
+        return;
     }
+    struct upipe_x264_instance *instance =
+        &upipe_x264->instances[chunk % upipe_x264->chunk_instances];
+    ulist_add(&instance->urefs, uref_to_uchain(uref));
+    upipe_x264_restitch(upipe, upump_p, false);
+}
+
+/** @internal @This builds an encoded picture from the NAL units returned by
+ * x264, and outputs it, or queues it for restitching in chunked mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param nals NAL units
+ * @param nals_num number of NAL units
+ * @param pic output picture
+ * @param timebase_num timebase numerator of the encoder
+ * @param timebase_den timebase denominator of the encoder
+ * @param upump_p reference to upump structure
+ */
+static void upipe_x264_encoded(struct upipe *upipe,
+                               x264_nal_t *nals, int nals_num,
+                               x264_picture_t *pic, uint32_t timebase_num,
+                               uint32_t timebase_den, struct upump **upump_p)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    struct ubuf *ubuf_block;
+    uint8_t *buf = NULL;
+    int i, size = 0, header_size = 0;
 
     /* get uref back */
-    uref = pic.opaque;
+    struct uref *uref = pic->opaque;
     assert(uref);
 
     for (i = 0; i < nals_num; i++) {
@@ -953,8 +1552,12 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
     /* alloc ubuf, map, copy, unmap */
     ubuf_block = ubuf_block_alloc(upipe_x264->ubuf_mgr, size);
     if (unlikely(ubuf_block == NULL)) {
+        if (upipe_x264->instances != NULL)
+            upipe_x264_queue_chunk(upipe, uref, upump_p);
+        else
+            uref_free(uref);
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return true;
+        return;
     }
     ubuf_block_write(ubuf_block, 0, &size, &buf);
     memcpy(buf, nals[0].p_payload, size);
@@ -985,72 +1588,279 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* set dts */
-    uint64_t dts_pts_delay = (uint64_t)(pic.i_pts - pic.i_dts) * UCLOCK_FREQ
-                              * curparams.i_timebase_num
-                              / curparams.i_timebase_den;
+    uint64_t dts_pts_delay = (uint64_t)(pic->i_pts - pic->i_dts) * UCLOCK_FREQ
+                              * timebase_num / timebase_den;
     uref_clock_set_dts_pts_delay(uref, dts_pts_delay);
     uref_clock_delete_cr_dts_delay(uref);
 
-    /* rebase to dts as we're in encoded domain now */
-    uint64_t dts = UINT64_MAX;
-    if ((!ubase_check(uref_clock_get_dts_prog(uref, &dts)) ||
-         dts < upipe_x264->last_dts) &&
-        upipe_x264->last_dts != UINT64_MAX) {
-        upipe_warn_va(upipe, "DTS prog in the past, resetting (%"PRIu64" ms)",
-                      (upipe_x264->last_dts - dts) * 1000 / UCLOCK_FREQ);
-        dts = upipe_x264->last_dts + 1;
-        uref_clock_set_dts_prog(uref, dts);
-    } else
-        uref_clock_rebase_dts_prog(uref);
+    if (pic->b_keyframe) {
+        uref_flow_set_random(uref);
+    }
 
-    uint64_t dts_sys = UINT64_MAX;
-    if (dts != UINT64_MAX &&
-        upipe_x264->input_pts != UINT64_MAX &&
-        upipe_x264->input_pts_sys != UINT64_MAX) {
-        dts_sys = (int64_t)upipe_x264->input_pts_sys +
-            ((int64_t)dts - (int64_t)upipe_x264->input_pts) *
-            (int64_t)upipe_x264->drift_rate.num /
-            (int64_t)upipe_x264->drift_rate.den;
-        uref_clock_set_dts_sys(uref, dts_sys);
-    } else if (!ubase_check(uref_clock_get_dts_sys(uref, &dts_sys)) ||
-        (upipe_x264->last_dts_sys != UINT64_MAX &&
-               dts_sys < upipe_x264->last_dts_sys)) {
-        upipe_warn_va(upipe,
-                      "DTS sys in the past, resetting (%"PRIu64" ms)",
-                      (upipe_x264->last_dts_sys - dts_sys) * 1000 /
-                      UCLOCK_FREQ);
-        dts_sys = upipe_x264->last_dts_sys + 1;
-        uref_clock_set_dts_sys(uref, dts_sys);
-    } else
-        uref_clock_rebase_dts_sys(uref);
+    if (upipe_x264->instances != NULL) {
+        upipe_x264_queue_chunk(upipe, uref, upump_p);
+        return;
+    }
 
-    uref_clock_rebase_dts_orig(uref);
-    uref_clock_set_rate(uref, upipe_x264->drift_rate);
+    upipe_x264_output_frame(upipe, uref, upump_p);
+}
 
-    upipe_x264->last_dts = dts;
-    upipe_x264->last_dts_sys = dts_sys;
+/** @internal @This flushes the delayed frames of an encoder.
+ *
+ * @param upipe description structure of the pipe
+ * @param encoder x264 encoder
+ */
+static void upipe_x264_flush(struct upipe *upipe, x264_t *encoder)
+{
+    while (x264_encoder_delayed_frames(encoder)) {
+        x264_picture_t pic;
+        x264_nal_t *nals;
+        x264_param_t curparams;
+        int nals_num;
 
-#ifdef HAVE_X264_OBE
-    /* speedcontrol */
-    if (dts_sys != UINT64_MAX && upipe_x264->uclock != NULL &&
-        upipe_x264->sc_latency) {
-        uint64_t systime = uclock_now(upipe_x264->uclock);
-        int64_t buffer_state = dts_sys + upipe_x264->initial_latency +
-                               upipe_x264->sc_latency - systime;
-        float buffer_fill = (float)buffer_state /
-                            (float)upipe_x264->sc_latency;
-        x264_speedcontrol_sync(upipe_x264->encoder, buffer_fill, 0, 1);
+        x264_picture_init(&pic);
+        int ret = x264_encoder_encode(encoder, &nals, &nals_num, NULL, &pic);
+        x264_encoder_parameters(encoder, &curparams);
+        if (unlikely(ret < 0)) {
+            upipe_warn(upipe, "Error flushing encoder");
+            break;
+        }
+        if (ret > 0)
+            upipe_x264_encoded(upipe, nals, nals_num, &pic,
+                               curparams.i_timebase_num,
+                               curparams.i_timebase_den, NULL);
     }
-#endif
+}
 
-    if (pic.b_keyframe) {
-        uref_flow_set_random(uref);
+/** @internal @This processes pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ * @return true if the packet was handled
+ */
+static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
+                              struct upump **upump_p)
+{
+    struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_x264->input_latency = 0;
+        uref_clock_get_latency(uref, &upipe_x264->input_latency);
+        upipe_x264_store_flow_def(upipe, NULL);
+        uref_free(upipe_x264->flow_def_requested);
+        upipe_x264->flow_def_requested = NULL;
+
+        if (upipe_x264_mpeg2_enabled(upipe)) {
+            struct urational dar;
+            dar.num = 4;
+            dar.den = 3;
+            uref_pic_flow_infer_dar(uref, &dar);
+            if (dar.num == 4 && dar.den == 3)
+                upipe_x264->mpeg2_ar = 2;
+            else if (dar.num == 16 && dar.den == 9)
+                upipe_x264->mpeg2_ar = 3;
+            else if (dar.num == 221 && dar.den == 100)
+                upipe_x264->mpeg2_ar = 4;
+            else {
+                upipe_warn_va(upipe,
+                        "unrecognized aspect ratio %"PRId64"/%"PRIu64", using square",
+                        dar.num, dar.den);
+                upipe_x264->mpeg2_ar = 1;
+            }
+        } else {
+            upipe_x264->sar.num = upipe_x264->sar.den = 1;
+            uref_pic_flow_get_sar(uref, &upipe_x264->sar);
+            bool overscan;
+            if (!ubase_check(uref_pic_flow_get_overscan(uref, &overscan)))
+                upipe_x264->overscan = 0; /* undef */
+            else
+                upipe_x264->overscan = overscan ? 2 : 1;
+        }
+
+        if (ubase_check(uref_pic_flow_check_yuv420p(uref)))
+            upipe_x264->chroma_subsampling = X264_CSP_I420;
+        else if (ubase_check(uref_pic_flow_check_yuv422p(uref)))
+            upipe_x264->chroma_subsampling = X264_CSP_I422;
+        else if (ubase_check(uref_pic_flow_check_yuv444p(uref)))
+            upipe_x264->chroma_subsampling = X264_CSP_I444;
+        else
+            upipe_err(upipe, "invalid chroma subsampling");
+
+        uref = upipe_x264_store_flow_def_input(upipe, uref);
+        if (uref != NULL) {
+            uref_pic_flow_clear_format(uref);
+            upipe_x264_require_flow_format(upipe, uref);
+        }
+        return true;
     }
 
-    if (upipe_x264->flow_def == NULL)
-        upipe_x264_build_flow_def(upipe);
+    const char *const *chromas = upipe_x264_chromas;
+    size_t width, height;
+    x264_picture_t pic;
+    x264_nal_t *nals;
+    int i, nals_num;
+    x264_param_t curparams;
+    bool needopen = false;
+    int ret = 0;
 
-    upipe_x264_output(upipe, uref, upump_p);
+    /* init x264 picture */
+    x264_picture_init(&pic);
+    pic.opaque = uref;
+
+    uref_pic_size(uref, &width, &height, NULL);
+
+    /* open encoder if not already opened or if update needed */
+    if (unlikely(!upipe_x264->encoder)) {
+        needopen = true;
+    } else if (unlikely(upipe_x264_need_update(upipe, width, height))) {
+        x264_param_t *params = &upipe_x264_from_upipe(upipe)->params;
+        upipe_notice_va(upipe, "Flow parameters changed, reconfiguring encoder (%d:%zu, %d:%zu, %d:%"PRId64", %d:%"PRIu64", %d:%d)",
+            params->i_width, width, params->i_height, height,
+            params->vui.i_sar_width, upipe_x264->sar.num,
+            params->vui.i_sar_height, upipe_x264->sar.den,
+            params->vui.i_overscan, upipe_x264->overscan);
+        needopen = true;
+    }
+    if (unlikely(needopen)) {
+        if (unlikely(!upipe_x264_open(upipe, width, height))) {
+            upipe_err(upipe, "Could not open encoder");
+            uref_free(uref);
+            return true;
+        }
+    }
+    if (upipe_x264->flow_def_requested == NULL)
+        return false;
+
+    if (upipe_x264->instances == NULL)
+        x264_encoder_parameters(upipe_x264->encoder, &curparams);
+
+    pic.img.i_csp = upipe_x264->chroma_subsampling;
+
+    uref_clock_get_rate(uref, &upipe_x264->drift_rate);
+    uref_clock_get_pts_prog(uref, &upipe_x264->input_pts);
+    uref_clock_get_pts_sys(uref, &upipe_x264->input_pts_sys);
+
+    pic.i_type = X264_TYPE_AUTO;
+    if (upipe_x264->slice_type_enforce) {
+        uint8_t type;
+        if (ubase_check(uref_h264_get_type(uref, &type))) {
+            switch (type) {
+                case H264SLI_TYPE_P:
+                    pic.i_type = X264_TYPE_P;
+                    break;
+                case H264SLI_TYPE_B:
+                    pic.i_type = X264_TYPE_B;
+                    break;
+                case H264SLI_TYPE_I:
+                    pic.i_type = X264_TYPE_KEYFRAME;
+                    break;
+                case H264SLI_TYPE_SP:
+                case H264SLI_TYPE_SI:
+                default:
+                    break;
+            }
+        } else if (ubase_check(uref_mpgv_get_type(uref, &type))) {
+            switch (type) {
+                case MP2VPIC_TYPE_P:
+                    pic.i_type = X264_TYPE_P;
+                    break;
+                case MP2VPIC_TYPE_B:
+                    pic.i_type = X264_TYPE_B;
+                    break;
+                case MP2VPIC_TYPE_I:
+                    pic.i_type = X264_TYPE_KEYFRAME;
+                    break;
+                case MP2VPIC_TYPE_D:
+                default:
+                    break;
+            }
+        }
+    }
+
+    struct upipe_x264_instance *instance = NULL;
+    if (upipe_x264->instances != NULL) {
+        /* dispatch chunks to the instances in turn, each starting with an
+         * IDR picture */
+        if (upipe_x264->chunk_in_frames == upipe_x264->chunk_frames) {
+            upipe_x264->chunk_in++;
+            upipe_x264->chunk_in_frames = 0;
+        }
+        instance = &upipe_x264->instances[
+            upipe_x264->chunk_in % upipe_x264->chunk_instances];
+        if (unlikely(!ubase_check(uref_x264_set_chunk(uref,
+                                                      upipe_x264->chunk_in)))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return true;
+        }
+        if (!upipe_x264->chunk_in_frames)
+            pic.i_type = X264_TYPE_IDR;
+        upipe_x264->chunk_in_frames++;
+
+        pic.i_pts = instance->x264_ts++;
+    } else {
+        /* set pts in x264 timebase */
+        pic.i_pts = upipe_x264->x264_ts;
+        upipe_x264->x264_ts++;
+    }
+
+    /* map */
+    for (i = 0; i < 3; i++) {
+        size_t stride;
+        const uint8_t *plane;
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chromas[i], &stride,
+                                          NULL, NULL, NULL)) ||
+                     !ubase_check(uref_pic_plane_read(uref, chromas[i], 0, 0, -1, -1,
+                                          &plane)))) {
+            upipe_err_va(upipe, "Could not read origin chroma %s",
+                         chromas[i]);
+            if (instance != NULL)
+                upipe_x264_cancel_dispatch(upipe, instance);
+            uref_free(uref);
+            return true;
+        }
+        pic.img.i_stride[i] = stride;
+        /* cast needed because of x264 API */
+        pic.img.plane[i] = (uint8_t *)plane;
+    }
+    pic.img.i_plane = i;
+
+    if (instance != NULL) {
+        /* the encoder thread unmaps the picture once it is encoded */
+        if (unlikely(!upipe_x264_dispatch(upipe, instance, &pic))) {
+            for (i = 0; i < 3; i++)
+                uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+            upipe_x264_cancel_dispatch(upipe, instance);
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return true;
+        }
+        upipe_x264_collect(upipe, upump_p);
+        return true;
+    }
+
+    /* encode frame ! */
+    ret = x264_encoder_encode(upipe_x264->encoder, &nals, &nals_num,
+                              &pic, &pic);
+
+    /* unmap */
+    for (i = 0; i < 3; i++) {
+        uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+    }
+    ubuf_free(uref_detach_ubuf(uref));
+
+    if (unlikely(ret < 0)) {
+        upipe_warn(upipe, "Error encoding frame");
+        uref_free(uref);
+        return true;
+    } else if (unlikely(ret == 0)) {
+        upipe_verbose(upipe, "No nal units returned");
+        return true;
+    }
+
+    upipe_x264_encoded(upipe, nals, nals_num, &pic, curparams.i_timebase_num,
+                       curparams.i_timebase_den, upump_p);
     return true;
 }
 
@@ -1073,6 +1883,7 @@ static void upipe_x264_input(struct upipe *upipe, struct uref *uref,
          * have been sent. */
         upipe_use(upipe);
     }
+    upipe_x264_throw_logs(upipe);
 }
 
 /** @internal @This receives the result of a flow format request.
@@ -1248,7 +2059,8 @@ static int _upipe_x264_provide_flow_format(struct upipe *upipe,
  * @param args arguments of the command
  * @return an error code
  */
-static int upipe_x264_control(struct upipe *upipe, int command, va_list args)
+static int _upipe_x264_control(struct upipe *upipe, int command,
+                               va_list args)
 {
     switch (command) {
         case UPIPE_ATTACH_UCLOCK:
@@ -1317,11 +2129,37 @@ static int upipe_x264_control(struct upipe *upipe, int command, va_list args)
             bool enforce = !(va_arg(args, int) == 0);
             return _upipe_x264_set_slice_type_enforce(upipe, enforce);
         }
+        case UPIPE_X264_SET_SLICED_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_X264_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_x264_set_sliced_threads(upipe, threads);
+        }
+        case UPIPE_X264_SET_CHUNKED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_X264_SIGNATURE)
+            unsigned int instances = va_arg(args, unsigned int);
+            unsigned int gops = va_arg(args, unsigned int);
+            return _upipe_x264_set_chunked(upipe, instances, gops);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
 }
 
+/** @internal @This processes control commands, and throws the messages
+ * logged by x264 meanwhile.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_x264_control(struct upipe *upipe, int command, va_list args)
+{
+    int err = _upipe_x264_control(upipe, command, args);
+    upipe_x264_throw_logs(upipe);
+    return err;
+}
+
 /** @This frees a upipe.
  *
  * @param upipe description structure of the pipe
@@ -1330,6 +2168,8 @@ static void upipe_x264_free(struct upipe *upipe)
 {
     struct upipe_x264 *upipe_x264 = upipe_x264_from_upipe(upipe);
     upipe_x264_close(upipe);
+    upipe_x264_throw_logs(upipe);
+    pthread_mutex_destroy(&upipe_x264->log_mutex);
 
     upipe_throw_dead(upipe);
     upipe_x264_clean_uclock(upipe);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short accounting of the allocations of a pipe
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uaccount.h>
+
+#include <stdlib.h>
+
+/** account current on the thread */
+UACCOUNT_TLS struct uaccount *uaccount_current = NULL;
+
+/** @internal @This frees a uaccount structure.
+ *
+ * @param urefcount pointer to urefcount structure
+ */
+static void uaccount_free(struct urefcount *urefcount)
+{
+    struct uaccount *account = uaccount_from_urefcount(urefcount);
+    urefcount_clean(urefcount);
+    free(account);
+}
+
+/** @This allocates a uaccount structure.
+ *
+ * @return pointer to uaccount, or NULL in case of allocation error
+ */
+struct uaccount *uaccount_alloc(void)
+{
+    struct uaccount *account = calloc(1, sizeof(struct uaccount));
+    if (unlikely(account == NULL))
+        return NULL;
+    urefcount_init(&account->urefcount, uaccount_free);
+    return account;
+}
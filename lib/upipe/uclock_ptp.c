@@ -25,43 +25,126 @@
 
 /** @file
  * @short Upipe NIC PTP implementation of uclock
+ *
+ * Reading a PHC is a system call, so the clock keeps, for each NIC, a linear
+ * mapping from CLOCK_MONOTONIC_RAW to the PHC time, refreshed from a
+ * cross-timestamp every @ref UCLOCK_PTP_REFRESH. The state of the links is
+ * followed with netlink events instead of being queried on each call.
  */
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
 #include <upipe/uclock.h>
 #include <upipe/uclock_ptp.h>
 
 #include <stdbool.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <net/if.h>
 #ifdef __linux__
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
+#include <linux/ptp_clock.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #endif
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
 
+#ifdef CLOCK_MONOTONIC_RAW
+/** clock the PHCs are mapped from */
+#define UCLOCK_PTP_SYS_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define UCLOCK_PTP_SYS_CLOCK CLOCK_MONOTONIC
+#endif
+
+/** maximum deviation of the rate of a PHC, in parts per billion */
+#define UCLOCK_PTP_MAX_PPB 1000000
+/** minimum interval between the cross-timestamps giving the rate, in ns */
+#define UCLOCK_PTP_MIN_INTERVAL (UCLOCK_PTP_REFRESH / 2)
+/** number of samples of the cross-timestamps without hardware support */
+#define UCLOCK_PTP_SAMPLES 5
+/** period of the polling of the netlink socket, in ms */
+#define UCLOCK_PTP_LINK_PERIOD 10
+
+#define CLOCKFD 3
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | CLOCKFD)
+
+/** methods to cross-timestamp a PHC and the system clock */
+enum uclock_ptp_method {
+    /** PTP_SYS_OFFSET_PRECISE, with hardware support */
+    UCLOCK_PTP_PRECISE,
+    /** PTP_SYS_OFFSET_EXTENDED, timestamped by the driver */
+    UCLOCK_PTP_EXTENDED,
+    /** clock_gettime on the PHC between two readings of the system clock */
+    UCLOCK_PTP_READ
+};
+
+/** @This stores the mapping from the system clock to a PHC. */
+struct uclock_ptp_map {
+    /** system time of the reference, in ns */
+    uint64_t sys;
+    /** PHC time of the reference, in ns */
+    uint64_t phc;
+    /** PHC ns per system ns */
+    double rate;
+    /** true if the mapping was initialized */
+    bool valid;
+};
+
+/** @This stores the state of a NIC. */
+struct uclock_ptp_nic {
+    /** clock device fd */
+    int fd;
+    /** interface index */
+    int ifindex;
+    /** method of cross-timestamping */
+    enum uclock_ptp_method method;
+    /** 1 if the interface is up */
+    uatomic_uint32_t up;
+
+    /** sequence number of the mapping, odd while it is written */
+    uint32_t seq;
+    /** mapping, protected by seq */
+    struct uclock_ptp_map map;
+    /** system time of the last cross-timestamp */
+    uint64_t last_sys;
+    /** PHC time of the last cross-timestamp */
+    uint64_t last_phc;
+};
+
 /** super-set of the uclock structure with additional local members */
 struct uclock_ptp {
     /** refcount management structure */
     struct urefcount urefcount;
 
-    /** clock device fd */
-    int fd[2];
+    /** NICs */
+    struct uclock_ptp_nic nic[2];
+    /** number of NICs */
+    unsigned int nb_nics;
 
+    /** 1 while a thread refreshes a mapping or polls the links */
+    uatomic_uint32_t lock;
+    /** date of the next poll of the links, in ms */
+    uatomic_uint32_t link_check;
 #ifdef __linux__
-    /** interface device fd */
-    int if_fd[2];
-
-    /** interface struct */
-    struct ifreq ifr[2];
+    /** socket for interface ioctls */
+    int if_fd;
+    /** netlink socket receiving the link events */
+    int nl_fd;
 #endif
 
+    /** callback replacing the reading of the PHCs, or NULL */
+    uclock_ptp_phc_read phc_read;
+    /** opaque for phc_read */
+    void *opaque;
+
     /** structure exported to modules */
     struct uclock uclock;
 };
@@ -69,20 +152,291 @@ struct uclock_ptp {
 UBASE_FROM_TO(uclock_ptp, uclock, uclock, uclock)
 UBASE_FROM_TO(uclock_ptp, urefcount, urefcount, urefcount)
 
-/** @internal */
-static bool uclock_ptp_intf_up(struct uclock *uclock, int i)
+/** @internal @This returns the time of the system clock.
+ *
+ * @param sys_p filled in with the time in ns
+ * @return false in case of error
+ */
+static inline bool uclock_ptp_sys(uint64_t *sys_p)
 {
-    struct uclock_ptp *ptp = uclock_ptp_from_uclock(uclock);
+    struct timespec ts;
+    if (unlikely(clock_gettime(UCLOCK_PTP_SYS_CLOCK, &ts) == -1))
+        return false;
+    *sys_p = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+    return true;
+}
+
+/** @internal @This tries to take the lock of the clock.
+ *
+ * @param ptp pointer to the clock
+ * @return true if the lock was taken
+ */
+static inline bool uclock_ptp_trylock(struct uclock_ptp *ptp)
+{
+    uint32_t expected = 0;
+    return uatomic_compare_exchange(&ptp->lock, &expected, 1);
+}
+
+/** @internal @This releases the lock of the clock.
+ *
+ * @param ptp pointer to the clock
+ */
+static inline void uclock_ptp_unlock(struct uclock_ptp *ptp)
+{
+    uatomic_store(&ptp->lock, 0);
+}
 
 #ifdef __linux__
-    if (ioctl(ptp->if_fd[i], SIOCGIFFLAGS, &ptp->ifr[i]) >= 0)
-        return ptp->ifr[i].ifr_flags & IFF_UP;
-#else
-    (void)ptp;
-    (void)i;
+/** @internal @This converts a ptp_clock_time to ns. */
+static inline uint64_t uclock_ptp_time(const struct ptp_clock_time *t)
+{
+    return t->sec * UINT64_C(1000000000) + t->nsec;
+}
+
+/** @internal @This cross-timestamps a PHC with PTP_SYS_OFFSET_EXTENDED,
+ * whose system timestamps are in CLOCK_REALTIME.
+ *
+ * @param nic NIC
+ * @param sys_p filled in with the system time in ns
+ * @param phc_p filled in with the PHC time in ns
+ * @return false in case of error
+ */
+static bool uclock_ptp_extended(struct uclock_ptp_nic *nic,
+                                uint64_t *sys_p, uint64_t *phc_p)
+{
+    struct ptp_sys_offset_extended ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.n_samples = UCLOCK_PTP_SAMPLES;
+    if (ioctl(nic->fd, PTP_SYS_OFFSET_EXTENDED, &ext) < 0)
+        return false;
+
+    uint64_t best = UINT64_MAX, real = 0;
+    for (int i = 0; i < UCLOCK_PTP_SAMPLES; i++) {
+        uint64_t before = uclock_ptp_time(&ext.ts[i][0]);
+        uint64_t after = uclock_ptp_time(&ext.ts[i][2]);
+        if (after - before < best) {
+            best = after - before;
+            real = before + best / 2;
+            *phc_p = uclock_ptp_time(&ext.ts[i][1]);
+        }
+    }
+
+    /* offset between CLOCK_REALTIME and the system clock */
+    struct timespec ts;
+    uint64_t before, after;
+    if (!uclock_ptp_sys(&before) ||
+        clock_gettime(CLOCK_REALTIME, &ts) == -1 ||
+        !uclock_ptp_sys(&after))
+        return false;
+    uint64_t now = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+    *sys_p = real - now + before + (after - before) / 2;
+    return true;
+}
+#endif
+
+/** @internal @This cross-timestamps a PHC by reading it between two
+ * readings of the system clock.
+ *
+ * @param nic NIC
+ * @param sys_p filled in with the system time in ns
+ * @param phc_p filled in with the PHC time in ns
+ * @return false in case of error
+ */
+static bool uclock_ptp_read(struct uclock_ptp_nic *nic,
+                            uint64_t *sys_p, uint64_t *phc_p)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < UCLOCK_PTP_SAMPLES; i++) {
+        struct timespec ts;
+        uint64_t before, after;
+        if (!uclock_ptp_sys(&before) ||
+            clock_gettime(FD_TO_CLOCKID(nic->fd), &ts) == -1 ||
+            !uclock_ptp_sys(&after))
+            return false;
+        if (after - before < best) {
+            best = after - before;
+            *sys_p = before + best / 2;
+            *phc_p = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+        }
+    }
+    return true;
+}
+
+/** @internal @This cross-timestamps a PHC and the system clock, with the
+ * most precise method supported by the NIC.
+ *
+ * @param ptp pointer to the clock
+ * @param i index of the NIC
+ * @param sys_p filled in with the system time in ns
+ * @param phc_p filled in with the PHC time in ns
+ * @return false in case of error
+ */
+static bool uclock_ptp_cross_timestamp(struct uclock_ptp *ptp, int i,
+                                       uint64_t *sys_p, uint64_t *phc_p)
+{
+    struct uclock_ptp_nic *nic = &ptp->nic[i];
+
+    if (ptp->phc_read != NULL)
+        return ptp->phc_read(ptp->opaque, i, sys_p, phc_p);
+    if (nic->fd < 0)
+        return false;
+
+#ifdef __linux__
+    if (nic->method == UCLOCK_PTP_PRECISE) {
+        struct ptp_sys_offset_precise precise;
+        memset(&precise, 0, sizeof(precise));
+        if (ioctl(nic->fd, PTP_SYS_OFFSET_PRECISE, &precise) >= 0) {
+            *sys_p = uclock_ptp_time(&precise.sys_monoraw);
+            *phc_p = uclock_ptp_time(&precise.device);
+            return true;
+        }
+        nic->method = UCLOCK_PTP_EXTENDED;
+    }
+
+    if (nic->method == UCLOCK_PTP_EXTENDED) {
+        if (uclock_ptp_extended(nic, sys_p, phc_p))
+            return true;
+        nic->method = UCLOCK_PTP_READ;
+    }
+#endif
+
+    return uclock_ptp_read(nic, sys_p, phc_p);
+}
+
+/** @internal @This reads the mapping of a NIC.
+ *
+ * @param nic NIC
+ * @param map filled in with the mapping
+ */
+static inline void uclock_ptp_map_get(struct uclock_ptp_nic *nic,
+                                      struct uclock_ptp_map *map)
+{
+    uint32_t seq;
+    do {
+        while ((seq = __atomic_load_n(&nic->seq, __ATOMIC_ACQUIRE)) & 1);
+        *map = nic->map;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&nic->seq, __ATOMIC_RELAXED) != seq);
+}
+
+/** @internal @This refreshes the mapping of a NIC. It must be called with
+ * the lock held.
+ *
+ * @param ptp pointer to the clock
+ * @param i index of the NIC
+ * @return false in case of error
+ */
+static bool uclock_ptp_refresh(struct uclock_ptp *ptp, int i)
+{
+    struct uclock_ptp_nic *nic = &ptp->nic[i];
+    uint64_t sys, phc;
+    if (unlikely(!uclock_ptp_cross_timestamp(ptp, i, &sys, &phc)))
+        return false;
+
+    double rate = nic->map.valid ? nic->map.rate : 1.;
+    if (nic->map.valid && sys - nic->last_sys >= UCLOCK_PTP_MIN_INTERVAL) {
+        rate = (double)(int64_t)(phc - nic->last_phc) /
+               (double)(sys - nic->last_sys);
+        if (rate > 1. + UCLOCK_PTP_MAX_PPB / 1e9 ||
+            rate < 1. - UCLOCK_PTP_MAX_PPB / 1e9)
+            /* the PHC was stepped */
+            rate = 1.;
+    }
+    nic->last_sys = sys;
+    nic->last_phc = phc;
+
+    __atomic_store_n(&nic->seq, nic->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    nic->map.sys = sys;
+    nic->map.phc = phc;
+    nic->map.rate = rate;
+    nic->map.valid = true;
+    __atomic_store_n(&nic->seq, nic->seq + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#ifdef __linux__
+/** @internal @This reads the state of the links with ioctls.
+ *
+ * @param ptp pointer to the clock
+ */
+static void uclock_ptp_link_sync(struct uclock_ptp *ptp)
+{
+    for (int i = 0; i < ptp->nb_nics; i++) {
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        ifr.ifr_ifindex = ptp->nic[i].ifindex;
+        if (ioctl(ptp->if_fd, SIOCGIFNAME, &ifr) < 0 ||
+            ioctl(ptp->if_fd, SIOCGIFFLAGS, &ifr) < 0)
+            uatomic_store(&ptp->nic[i].up, 0);
+        else
+            uatomic_store(&ptp->nic[i].up, !!(ifr.ifr_flags & IFF_UP));
+    }
+}
+
+/** @internal @This processes the pending link events. It must be called
+ * with the lock held.
+ *
+ * @param ptp pointer to the clock
+ */
+static void uclock_ptp_link_poll(struct uclock_ptp *ptp)
+{
+    char buffer[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+    for ( ; ; ) {
+        ssize_t len = recv(ptp->nl_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == ENOBUFS)
+                /* events were lost */
+                uclock_ptp_link_sync(ptp);
+            else if (errno != EINTR)
+                return;
+            continue;
+        }
+
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer;
+             NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type != RTM_NEWLINK &&
+                nlh->nlmsg_type != RTM_DELLINK)
+                continue;
+            struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+            for (int i = 0; i < ptp->nb_nics; i++)
+                if (ptp->nic[i].ifindex == ifi->ifi_index)
+                    uatomic_store(&ptp->nic[i].up,
+                                  nlh->nlmsg_type == RTM_NEWLINK &&
+                                  (ifi->ifi_flags & IFF_UP));
+        }
+    }
+}
 #endif
 
-    return false;
+/** @internal @This processes the link events if they were not processed for
+ * @ref UCLOCK_PTP_LINK_PERIOD.
+ *
+ * @param ptp pointer to the clock
+ * @param sys system time in ns
+ */
+static inline void uclock_ptp_link_check(struct uclock_ptp *ptp, uint64_t sys)
+{
+#ifdef __linux__
+    if (ptp->nl_fd < 0)
+        return;
+
+    uint32_t now = sys / 1000000;
+    if ((int32_t)(now - uatomic_load(&ptp->link_check)) < 0 ||
+        !uclock_ptp_trylock(ptp))
+        return;
+    uatomic_store(&ptp->link_check, now + UCLOCK_PTP_LINK_PERIOD);
+    uclock_ptp_link_poll(ptp);
+    uclock_ptp_unlock(ptp);
+#endif
+}
+
+/** @internal @This converts ns to 27 MHz ticks. */
+static inline uint64_t uclock_ptp_ticks(uint64_t ns)
+{
+    return ns / UINT64_C(1000000000) * UCLOCK_FREQ +
+           ns % UINT64_C(1000000000) * UCLOCK_FREQ / UINT64_C(1000000000);
 }
 
 /** @This returns the current time in the given clock.
@@ -94,18 +448,34 @@ static uint64_t uclock_ptp_now(struct uclock *uclock)
 {
     struct uclock_ptp *ptp = uclock_ptp_from_uclock(uclock);
 
-#define CLOCKFD 3
-#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | CLOCKFD)
-
-    int idx = uclock_ptp_intf_up(uclock, 0) ? 0 : 1;
-
-    struct timespec ts;
-    if (unlikely(clock_gettime(FD_TO_CLOCKID(ptp->fd[idx]), &ts) == -1))
+    uint64_t sys;
+    if (unlikely(!uclock_ptp_sys(&sys)))
         return UINT64_MAX;
+    uclock_ptp_link_check(ptp, sys);
+
+    int idx = ptp->nb_nics > 1 && !uatomic_load(&ptp->nic[0].up) ? 1 : 0;
+    struct uclock_ptp_nic *nic = &ptp->nic[idx];
+
+    struct uclock_ptp_map map;
+    uclock_ptp_map_get(nic, &map);
+    if (unlikely(!map.valid || sys - map.sys >= UCLOCK_PTP_REFRESH)) {
+        if (uclock_ptp_trylock(ptp)) {
+            bool ret = uclock_ptp_refresh(ptp, idx);
+            uclock_ptp_unlock(ptp);
+            if (unlikely(!ret && !map.valid))
+                return UINT64_MAX;
+            uclock_ptp_map_get(nic, &map);
+        } else if (!map.valid) {
+            /* another thread is refreshing, read the PHC directly */
+            uint64_t phc;
+            if (unlikely(!uclock_ptp_cross_timestamp(ptp, idx, &sys, &phc)))
+                return UINT64_MAX;
+            return uclock_ptp_ticks(phc);
+        }
+    }
 
-    uint64_t now = ts.tv_sec * UCLOCK_FREQ +
-                   ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
-    return now;
+    int64_t delta = sys - map.sys;
+    return uclock_ptp_ticks(map.phc + (int64_t)(delta * map.rate));
 }
 
 /** @This frees a uclock.
@@ -117,11 +487,15 @@ static void uclock_ptp_free(struct urefcount *urefcount)
     struct uclock_ptp *ptp = uclock_ptp_from_urefcount(urefcount);
     urefcount_clean(urefcount);
     for (int i = 0; i < 2; i++) {
-        ubase_clean_fd(&ptp->fd[i]);
+        ubase_clean_fd(&ptp->nic[i].fd);
+        uatomic_clean(&ptp->nic[i].up);
+    }
 #ifdef __linux__
-        ubase_clean_fd(&ptp->if_fd[i]);
+    ubase_clean_fd(&ptp->if_fd);
+    ubase_clean_fd(&ptp->nl_fd);
 #endif
-    }
+    uatomic_clean(&ptp->lock);
+    uatomic_clean(&ptp->link_check);
     free(ptp);
 }
 
@@ -131,13 +505,25 @@ static int uclock_ptp_nic_clock_idx(struct uclock_ptp *ptp,
 {
 #ifdef __linux__
     struct ethtool_ts_info info;
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, interface, IFNAMSIZ - 1);
+    if (ioctl(ptp->if_fd, SIOCGIFINDEX, &ifr) < 0) {
+        uprobe_err_va(uprobe, NULL, "Couldn't get index of %s: %m",
+            interface);
+        return -1;
+    }
+    ptp->nic[i].ifindex = ifr.ifr_ifindex;
+
+    if (ioctl(ptp->if_fd, SIOCGIFFLAGS, &ifr) >= 0)
+        uatomic_store(&ptp->nic[i].up, !!(ifr.ifr_flags & IFF_UP));
 
     memset(&info, 0, sizeof(info));
     info.cmd = ETHTOOL_GET_TS_INFO;
-    strncpy(ptp->ifr[i].ifr_name, interface, IFNAMSIZ - 1);
-    ptp->ifr[i].ifr_data = (char *) &info;
+    ifr.ifr_data = (char *) &info;
 
-    if (ioctl(ptp->if_fd[i], SIOCETHTOOL, &ptp->ifr[i]) < 0) {
+    if (ioctl(ptp->if_fd, SIOCETHTOOL, &ifr) < 0) {
         uprobe_err_va(uprobe, NULL, "Couldn't get ethtool ts information for %s: %m",
             interface);
         info.phc_index = -1;
@@ -164,8 +550,8 @@ static int uclock_ptp_open_nic(struct uclock_ptp *ptp, struct uprobe *uprobe,
     char clkdev[32];
     snprintf(clkdev, sizeof(clkdev), "/dev/ptp%u", idx);
 
-    ptp->fd[i] = open(clkdev, O_RDWR);
-    if (ptp->fd[i] < 0) {
+    ptp->nic[i].fd = open(clkdev, O_RDWR);
+    if (ptp->nic[i].fd < 0) {
         uprobe_err_va(uprobe, NULL, "Could not open PTP device %s: %m", clkdev);
         return UBASE_ERR_EXTERNAL;
     }
@@ -173,13 +559,11 @@ static int uclock_ptp_open_nic(struct uclock_ptp *ptp, struct uprobe *uprobe,
     return UBASE_ERR_NONE;
 }
 
-/** @This allocates a new uclock structure.
+/** @internal @This allocates and initializes a uclock_ptp structure.
  *
- * @param uprobe probe catching log events for error reporting
- * @param interface NIC names
- * @return pointer to uclock, or NULL in case of error
+ * @return pointer to uclock_ptp, or NULL in case of error
  */
-struct uclock *uclock_ptp_alloc(struct uprobe *uprobe, const char *interface[2])
+static struct uclock_ptp *uclock_ptp_alloc_inner(void)
 {
     struct uclock_ptp *ptp = malloc(sizeof(struct uclock_ptp));
     if (unlikely(ptp == NULL))
@@ -194,29 +578,111 @@ struct uclock *uclock_ptp_alloc(struct uprobe *uprobe, const char *interface[2])
     ptp->uclock.uclock_from_real = NULL;
 
     for (int i = 0; i < 2; i++) {
-        ptp->fd[i] = -1;
+        struct uclock_ptp_nic *nic = &ptp->nic[i];
+        nic->fd = -1;
+        nic->ifindex = 0;
+        nic->method = UCLOCK_PTP_PRECISE;
+        uatomic_init(&nic->up, 0);
+        nic->seq = 0;
+        nic->map.valid = false;
+        nic->last_sys = nic->last_phc = 0;
+    }
+    ptp->nb_nics = 0;
+    uatomic_init(&ptp->lock, 0);
+    uatomic_init(&ptp->link_check, 0);
 #ifdef __linux__
-        ptp->if_fd[i] = -1;
+    ptp->if_fd = -1;
+    ptp->nl_fd = -1;
 #endif
-    }
+    ptp->phc_read = NULL;
+    ptp->opaque = NULL;
+    return ptp;
+}
+
+/** @This allocates a new uclock structure.
+ *
+ * @param uprobe probe catching log events for error reporting
+ * @param interface NIC names
+ * @return pointer to uclock, or NULL in case of error
+ */
+struct uclock *uclock_ptp_alloc(struct uprobe *uprobe, const char *interface[2])
+{
+    struct uclock_ptp *ptp = uclock_ptp_alloc_inner();
+    if (unlikely(ptp == NULL))
+        return NULL;
 
-    for (int i = 0; i < 2 && interface[i]; i++) {
 #ifdef __linux__
-        ptp->if_fd[i] = socket(AF_INET, SOCK_DGRAM, 0);
-        if (ptp->if_fd[i] < 0) {
-            uprobe_err_va(uprobe, NULL, "%s: can't open socket (%m)",
-                    interface[i]);
-            goto err;
-        }
-        memset(&ptp->ifr[i], 0, sizeof(ptp->ifr[i]));
+    ptp->if_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (ptp->if_fd < 0) {
+        uprobe_err_va(uprobe, NULL, "can't open socket (%m)");
+        goto err;
+    }
+
+    ptp->nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        NETLINK_ROUTE);
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = RTMGRP_LINK;
+    if (ptp->nl_fd < 0 ||
+        bind(ptp->nl_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        uprobe_err_va(uprobe, NULL, "can't open netlink socket (%m)");
+        goto err;
+    }
 #endif
+
+    for (int i = 0; i < 2 && interface[i]; i++) {
         if (!ubase_check(uclock_ptp_open_nic(ptp, uprobe, i, interface[i])))
             goto err;
+        ptp->nb_nics++;
     }
 
     return uclock_ptp_to_uclock(ptp);
 
 err:
-    uclock_ptp_free(urefcount);
+    uclock_ptp_free(uclock_ptp_to_urefcount(ptp));
     return NULL;
 }
+
+/** @This allocates a new uclock structure reading the PHCs with a callback
+ * instead of the devices, for instance to test it with fake PHCs. The links
+ * are up, and their state is changed with @ref uclock_ptp_set_link.
+ *
+ * @param uprobe probe catching log events for error reporting
+ * @param nb_nics number of NICs (1 or 2)
+ * @param phc_read callback cross-timestamping the PHCs
+ * @param opaque opaque passed to phc_read
+ * @return pointer to uclock, or NULL in case of error
+ */
+struct uclock *uclock_ptp_alloc_phc(struct uprobe *uprobe,
+                                    unsigned int nb_nics,
+                                    uclock_ptp_phc_read phc_read,
+                                    void *opaque)
+{
+    if (unlikely(!nb_nics || nb_nics > 2 || phc_read == NULL))
+        return NULL;
+
+    struct uclock_ptp *ptp = uclock_ptp_alloc_inner();
+    if (unlikely(ptp == NULL))
+        return NULL;
+
+    ptp->nb_nics = nb_nics;
+    for (int i = 0; i < nb_nics; i++)
+        uatomic_store(&ptp->nic[i].up, 1);
+    ptp->phc_read = phc_read;
+    ptp->opaque = opaque;
+    return uclock_ptp_to_uclock(ptp);
+}
+
+/** @This forces the state of a link, until the next netlink event about it.
+ *
+ * @param uclock pointer to a uclock allocated by uclock_ptp
+ * @param nic index of the NIC
+ * @param up true if the link is up
+ */
+void uclock_ptp_set_link(struct uclock *uclock, unsigned int nic, bool up)
+{
+    struct uclock_ptp *ptp = uclock_ptp_from_uclock(uclock);
+    if (nic < ptp->nb_nics)
+        uatomic_store(&ptp->nic[nic].up, up ? 1 : 0);
+}
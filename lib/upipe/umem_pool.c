@@ -25,6 +25,7 @@
 
 #include <upipe/ubase.h>
 #include <upipe/urefcount.h>
+#include <upipe/uatomic.h>
 #include <upipe/ulifo.h>
 #include <upipe/umem.h>
 #include <upipe/umem_pool.h>
@@ -33,6 +34,18 @@
 #include <stdbool.h>
 #include <assert.h>
 
+/** @This defines the usage counters of a pool. */
+struct umem_pool_counters {
+    /** maximum number of buffers kept in the pool */
+    unsigned int depth;
+    /** number of buffers currently kept in the pool */
+    uatomic_uint32_t kept;
+    /** number of allocations served from the pool */
+    uatomic_uint32_t hits;
+    /** number of allocations that had to call malloc() */
+    uatomic_uint32_t misses;
+};
+
 /** @This defines the private data structures of the umem pool manager. */
 struct umem_pool_mgr {
     /** refcount management structure */
@@ -45,6 +58,10 @@ struct umem_pool_mgr {
     size_t pool0_size;
     /** number of pools of buffers */
     size_t nb_pools;
+    /** true if the usage counters are maintained */
+    bool stats;
+    /** usage counters, one per pool */
+    struct umem_pool_counters *counters;
     /** buffer pools */
     struct ulifo pools[];
 };
@@ -91,8 +108,17 @@ static bool umem_pool_alloc(struct umem_mgr *mgr, struct umem *umem,
     unsigned int pool = umem_pool_find(mgr, size, &real_size);
     uint8_t *buffer = NULL;
 
-    if (likely(pool < pool_mgr->nb_pools))
+    if (likely(pool < pool_mgr->nb_pools)) {
+        struct umem_pool_counters *counters = &pool_mgr->counters[pool];
         buffer = ulifo_pop(&pool_mgr->pools[pool], uint8_t *);
+        if (unlikely(pool_mgr->stats)) {
+            if (buffer != NULL) {
+                uatomic_fetch_sub(&counters->kept, 1);
+                uatomic_fetch_add(&counters->hits, 1);
+            } else
+                uatomic_fetch_add(&counters->misses, 1);
+        }
+    }
     if (unlikely(buffer == NULL))
         buffer = malloc(real_size);
     if (unlikely(buffer == NULL))
@@ -117,9 +143,23 @@ static void umem_pool_free(struct umem *umem)
     struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(umem->mgr);
     unsigned int pool = umem_pool_find(umem->mgr, umem->real_size, NULL);
 
-    if (unlikely(pool >= pool_mgr->nb_pools ||
-                 !ulifo_push(&pool_mgr->pools[pool], umem->buffer)))
+    if (unlikely(pool >= pool_mgr->nb_pools)) {
+        free(umem->buffer);
+        umem->buffer = NULL;
+        umem->mgr = NULL;
+        return;
+    }
+
+    /* count the buffer before it may be popped by another thread, so that
+     * the counter never underflows */
+    struct umem_pool_counters *counters = &pool_mgr->counters[pool];
+    if (unlikely(pool_mgr->stats))
+        uatomic_fetch_add(&counters->kept, 1);
+    if (unlikely(!ulifo_push(&pool_mgr->pools[pool], umem->buffer))) {
+        if (unlikely(pool_mgr->stats))
+            uatomic_fetch_sub(&counters->kept, 1);
         free(umem->buffer);
+    }
     umem->buffer = NULL;
     umem->mgr = NULL;
 }
@@ -160,8 +200,11 @@ static void umem_pool_mgr_vacuum(struct umem_mgr *mgr)
 
     for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
         uint8_t *buffer;
-        while ((buffer = ulifo_pop(&pool_mgr->pools[i], uint8_t *)) != NULL)
+        while ((buffer = ulifo_pop(&pool_mgr->pools[i], uint8_t *)) != NULL) {
+            if (pool_mgr->stats)
+                uatomic_fetch_sub(&pool_mgr->counters[i].kept, 1);
             free(buffer);
+        }
     }
 }
 
@@ -174,8 +217,12 @@ static void umem_pool_mgr_free(struct urefcount *urefcount)
     struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_urefcount(urefcount);
     umem_pool_mgr_vacuum(umem_pool_mgr_to_umem_mgr(pool_mgr));
 
-    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++)
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
         ulifo_clean(&pool_mgr->pools[i]);
+        uatomic_clean(&pool_mgr->counters[i].kept);
+        uatomic_clean(&pool_mgr->counters[i].hits);
+        uatomic_clean(&pool_mgr->counters[i].misses);
+    }
 
     urefcount_clean(urefcount);
     free(pool_mgr);
@@ -195,7 +242,8 @@ static void umem_pool_mgr_free(struct urefcount *urefcount)
 struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
 {
     size_t alloc_size = sizeof(struct umem_pool_mgr) +
-                        sizeof(struct ulifo) * nb_pools;
+                        sizeof(struct ulifo) * nb_pools +
+                        sizeof(struct umem_pool_counters) * nb_pools;
     unsigned int pools_depths[nb_pools];
     va_list args;
     va_start(args, nb_pools);
@@ -212,13 +260,20 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
 
     pool_mgr->pool0_size = pool0_size;
     pool_mgr->nb_pools = nb_pools;
+    pool_mgr->stats = false;
 
-    void *extra = (void *)pool_mgr + sizeof(struct umem_pool_mgr) +
-                  sizeof(struct ulifo) * nb_pools;
+    pool_mgr->counters = (void *)pool_mgr + sizeof(struct umem_pool_mgr) +
+                         sizeof(struct ulifo) * nb_pools;
+    void *extra = (void *)pool_mgr->counters +
+                  sizeof(struct umem_pool_counters) * nb_pools;
 
     for (unsigned int i = 0; i < nb_pools; i++) {
         ulifo_init(&pool_mgr->pools[i], pools_depths[i], extra);
         extra += ulifo_sizeof(pools_depths[i]);
+        pool_mgr->counters[i].depth = pools_depths[i];
+        uatomic_init(&pool_mgr->counters[i].kept, 0);
+        uatomic_init(&pool_mgr->counters[i].hits, 0);
+        uatomic_init(&pool_mgr->counters[i].misses, 0);
     }
 
     urefcount_init(umem_pool_mgr_to_urefcount(pool_mgr), umem_pool_mgr_free);
@@ -260,3 +315,47 @@ struct umem_mgr *umem_pool_mgr_alloc_simple(uint16_t base_pools_depth)
                                base_pools_depth / 8, /* 2 Mi */
                                base_pools_depth / 8); /* 4 Mi */
 }
+
+/** @This enables the usage counters of a umem pool manager. They are
+ * shared between threads and updated on each allocation, so they are
+ * disabled by default. It must be called before the manager is used.
+ *
+ * @param mgr pointer to umem manager
+ * @return an error code (UBASE_ERR_INVALID if the manager is not a umem pool
+ * manager)
+ */
+int umem_pool_mgr_enable_stats(struct umem_mgr *mgr)
+{
+    if (unlikely(mgr == NULL || mgr->umem_alloc != umem_pool_alloc))
+        return UBASE_ERR_INVALID;
+    struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(mgr);
+    pool_mgr->stats = true;
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the usage statistics of a pool of a umem pool manager.
+ * The counters stay at 0 unless @ref umem_pool_mgr_enable_stats was called.
+ *
+ * @param mgr pointer to umem manager
+ * @param pool index of the pool, starting from the smallest buffers
+ * @param stats filled in with the statistics
+ * @return an error code (UBASE_ERR_INVALID if the manager is not a umem pool
+ * manager or the pool does not exist)
+ */
+int umem_pool_mgr_get_stats(struct umem_mgr *mgr, unsigned int pool,
+                            struct umem_pool_stats *stats)
+{
+    if (unlikely(mgr == NULL || mgr->umem_alloc != umem_pool_alloc))
+        return UBASE_ERR_INVALID;
+    struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(mgr);
+    if (unlikely(pool >= pool_mgr->nb_pools))
+        return UBASE_ERR_INVALID;
+
+    struct umem_pool_counters *counters = &pool_mgr->counters[pool];
+    stats->size = pool_mgr->pool0_size << pool;
+    stats->depth = counters->depth;
+    stats->kept = uatomic_load(&counters->kept);
+    stats->hits = uatomic_load(&counters->hits);
+    stats->misses = uatomic_load(&counters->misses);
+    return UBASE_ERR_NONE;
+}
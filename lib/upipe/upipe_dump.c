@@ -35,6 +35,7 @@
 #include <upipe/uprobe_prefix.h>
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -44,21 +45,39 @@ struct upipe_dump_ctx {
     uint64_t input_uid;
     /** unique ID for pipe output */
     uint64_t output_uid;
-    /** context chain - for finding already dumped pipes */
+    /** label of the pipe, while it is being dumped */
+    char *label;
+    /** context chain - for finding already visited pipes */
     struct uchain uchain;
     /** owning pipe */
     struct upipe *upipe;
-    /** original opaque */
-    void *original_opaque;
 };
 
 UBASE_FROM_TO(upipe_dump_ctx, uchain, uchain, uchain)
 
-/** @hidden */
-static void upipe_dump_pipe(upipe_dump_pipe_label pipe_label,
-                            upipe_dump_flow_def_label flow_def_label,
-                            FILE *file, struct upipe *upipe, uint64_t *uid_p,
-                            struct uchain *list, struct upipe *last_output);
+/** @This is a walk through a pipeline. The functions are called in the
+ * order of the traversal, and may be NULL. */
+struct upipe_dump_walker {
+    /** list of visited pipes */
+    struct uchain list;
+
+    /** called when a pipe is visited for the first time */
+    int (*enter)(struct upipe_dump_walker *, struct upipe_dump_ctx *);
+    /** called after a sub pipe is visited */
+    void (*sub)(struct upipe_dump_walker *, struct upipe_dump_ctx *,
+                struct upipe_dump_ctx *);
+    /** called before the inner pipes of a bin are visited */
+    void (*begin_inner)(struct upipe_dump_walker *, struct upipe_dump_ctx *);
+    /** called after the inner pipes are visited, with the first and last
+     * inner pipes (NULL if the pipe is not a bin) */
+    void (*end_inner)(struct upipe_dump_walker *, struct upipe_dump_ctx *,
+                      struct upipe_dump_ctx *, struct upipe_dump_ctx *);
+    /** called after the output is visited */
+    void (*output)(struct upipe_dump_walker *, struct upipe_dump_ctx *,
+                   struct upipe_dump_ctx *);
+    /** called after the pipe and its output are visited */
+    void (*leave)(struct upipe_dump_walker *, struct upipe_dump_ctx *);
+};
 
 /** @This converts a pipe to a label (default function).
  *
@@ -110,67 +129,59 @@ char *upipe_dump_flow_def_label_default(struct uref *flow_def)
     return string;
 }
 
-/** @internal @This finds in the list of a pipe has already been printed.
+/** @internal @This finds a pipe in the list of already visited pipes.
  *
- * @param upipe first pipe of the pipeline
- * @param list list of already printed pipes
- * @return true if the pipe has been found
+ * @param upipe pipe to find
+ * @param list list of already visited pipes
+ * @return pointer to the context of the pipe, or NULL
  */
-static bool upipe_dump_find(struct upipe *upipe, struct uchain *list)
+static struct upipe_dump_ctx *upipe_dump_find(struct upipe *upipe,
+                                              struct uchain *list)
 {
     struct uchain *uchain;
     ulist_foreach (list, uchain) {
-        if (upipe_dump_ctx_from_uchain(uchain)->upipe == upipe)
-            return true;
+        struct upipe_dump_ctx *ctx = upipe_dump_ctx_from_uchain(uchain);
+        if (ctx->upipe == upipe)
+            return ctx;
     }
-    return false;
+    return NULL;
 }
 
-/** @internal @This dumps a pipe in dot format.
+/** @internal @This visits a pipe and the pipes connected to it.
  *
- * @param pipe_label function to print pipe labels
- * @param flow_def_label function to print flow_def labels
- * @param file file pointer to write to
- * @param upipe upipe to dump
- * @param uid_p pointer to unique ID
- * @param list list of already printed pipes
+ * @param walker description of the walk
+ * @param upipe upipe to visit
  * @param last_output last output pipe of the pipeline
+ * @return an error code
  */
-static void upipe_dump_pipe(upipe_dump_pipe_label pipe_label,
-                            upipe_dump_flow_def_label flow_def_label,
-                            FILE *file, struct upipe *upipe, uint64_t *uid_p,
-                            struct uchain *list, struct upipe *last_output)
+static int upipe_dump_walk_pipe(struct upipe_dump_walker *walker,
+                                struct upipe *upipe,
+                                struct upipe *last_output)
 {
-    if (upipe_dump_find(upipe, list))
-        return;
+    struct uchain *list = &walker->list;
+    if (upipe_dump_find(upipe, list) != NULL)
+        return UBASE_ERR_NONE;
 
-    char *label = pipe_label(upipe);
-
-    /* Prepare context. */
     struct upipe_dump_ctx *ctx = malloc(sizeof(struct upipe_dump_ctx));
-    assert(ctx != NULL);
-    ctx->input_uid = (*uid_p)++;
+    if (unlikely(ctx == NULL))
+        return UBASE_ERR_ALLOC;
+    ctx->input_uid = ctx->output_uid = 0;
+    ctx->label = NULL;
     ctx->upipe = upipe;
-    ctx->original_opaque = upipe->opaque;
-    upipe_set_opaque(upipe, ctx);
     ulist_add(list, upipe_dump_ctx_to_uchain(ctx));
-    fprintf(file, "#begin pipe%"PRIu64"\n", ctx->input_uid);
+    if (walker->enter != NULL)
+        UBASE_RETURN(walker->enter(walker, ctx));
 
     /* Iterate over subpipes. */
     struct upipe *sub = NULL;
     while (ubase_check(upipe_iterate_sub(upipe, &sub)) && sub != NULL) {
-        upipe_dump_pipe(pipe_label, flow_def_label, file, sub,
-                        uid_p, list, last_output);
-
-        struct upipe_dump_ctx *sub_ctx =
-            upipe_get_opaque(sub, struct upipe_dump_ctx *);
-        fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64" [style=\"dashed\"];\n",
-                ctx->input_uid, sub_ctx->input_uid);
-        fprintf(file, "{rank=same; pipe%"PRIu64" pipe%"PRIu64"};\n",
-                ctx->input_uid, sub_ctx->input_uid);
+        UBASE_RETURN(upipe_dump_walk_pipe(walker, sub, last_output));
+        if (walker->sub != NULL)
+            walker->sub(walker, ctx, upipe_dump_find(sub, list));
     }
 
     /* Dig into inner pipes. */
+    int err = UBASE_ERR_NONE;
     upipe_bin_freeze(upipe);
     struct upipe *first_inner = NULL;
     struct upipe *last_inner = NULL;
@@ -179,137 +190,319 @@ static void upipe_dump_pipe(upipe_dump_pipe_label pipe_label,
     if (first_inner != NULL || last_inner != NULL) {
         first_inner = first_inner ?: last_inner;
         last_inner = last_inner ?: first_inner;
-        ctx->output_uid = (*uid_p)++;
-
-        fprintf(file, "subgraph cluster_%"PRIu64" {\n", ctx->input_uid);
-        fprintf(file, "color=\"#0e0e0e\";\n");
-        fprintf(file, "fillcolor=\"#e0e0e0\";\n");
-        fprintf(file, "style=\"dashed,filled\";\n");
-        fprintf(file, "label=\"%s\";\n", label);
-
-        fprintf(file, "pipe%"PRIu64" [label=\"input\", style=\"dashed,filled\"];\n",
-                ctx->input_uid);
-        fprintf(file, "pipe%"PRIu64" [label=\"output\", style=\"dashed,filled\"];\n",
-                ctx->output_uid);
-
-        upipe_dump_pipe(pipe_label, flow_def_label, file, first_inner,
-                        uid_p, list, last_inner);
-        upipe_dump_pipe(pipe_label, flow_def_label, file, last_inner,
-                        uid_p, list, last_inner);
-
-        struct upipe_dump_ctx *first_ctx =
-                upipe_get_opaque(first_inner, struct upipe_dump_ctx *);
-        struct upipe_dump_ctx *last_ctx =
-                upipe_get_opaque(last_inner, struct upipe_dump_ctx *);
-        fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64";\n",
-                ctx->input_uid, first_ctx->input_uid);
-        fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64";\n",
-                last_ctx->output_uid, ctx->output_uid);
-        fprintf(file, "}\n");
-
-    } else {
-        ctx->output_uid = ctx->input_uid;
-        fprintf(file, "pipe%"PRIu64" [label=\"%s\"];\n", ctx->input_uid, label);
+        if (walker->begin_inner != NULL)
+            walker->begin_inner(walker, ctx);
+        err = upipe_dump_walk_pipe(walker, first_inner, last_inner);
+        if (ubase_check(err))
+            err = upipe_dump_walk_pipe(walker, last_inner, last_inner);
     }
+    if (ubase_check(err) && walker->end_inner != NULL)
+        walker->end_inner(walker, ctx,
+            first_inner != NULL ? upipe_dump_find(first_inner, list) : NULL,
+            last_inner != NULL ? upipe_dump_find(last_inner, list) : NULL);
     upipe_bin_thaw(upipe);
-    free(label);
-
-    if (upipe == last_output)
-        goto upipe_dump_pipe_end;
+    UBASE_RETURN(err);
 
     /* Edge with output. */
     struct upipe *output = NULL;
-    upipe_get_output(upipe, &output);
-    if (output == NULL)
-        goto upipe_dump_pipe_end;
-
-    upipe_dump_pipe(pipe_label, flow_def_label, file, output,
-                    uid_p, list, last_output);
-
-    struct uref *flow_def = NULL;
-    upipe_get_flow_def(upipe, &flow_def);
-    label = flow_def_label(flow_def);
-
-    struct upipe_dump_ctx *output_ctx =
-            upipe_get_opaque(output, struct upipe_dump_ctx *);
-    fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64" [label=\"%s\"];\n",
-            ctx->output_uid, output_ctx->input_uid, label);
-    free(label);
+    if (upipe != last_output)
+        upipe_get_output(upipe, &output);
+    if (output != NULL) {
+        UBASE_RETURN(upipe_dump_walk_pipe(walker, output, last_output));
+        if (walker->output != NULL)
+            walker->output(walker, ctx, upipe_dump_find(output, list));
+    }
 
-upipe_dump_pipe_end:
-    fprintf(file, "#end pipe%"PRIu64"\n", ctx->input_uid);
+    if (walker->leave != NULL)
+        walker->leave(walker, ctx);
+    return UBASE_ERR_NONE;
 }
 
-/** @This dumps a pipeline in dot format.
+/** @internal @This walks through a pipeline, from the given sources and
+ * then from the super-pipes of the visited pipes, visiting each pipe once.
  *
- * @param pipe_label function to print pipe labels
- * @param flow_def_label function to print flow_def labels
- * @param file file pointer to write to
+ * @param walker description of the walk
  * @param ulist list of sources pipes in ulist format
  * @param args list of sources pipes terminated with NULL
+ * @return an error code, the walk being interrupted by the first error
  */
-void upipe_dump_va(upipe_dump_pipe_label pipe_label,
-                   upipe_dump_flow_def_label flow_def_label,
-                   FILE *file, struct uchain *ulist, va_list args)
+static int upipe_dump_walker_run(struct upipe_dump_walker *walker,
+                                 struct uchain *ulist, va_list args)
 {
-    pipe_label = pipe_label ?: upipe_dump_upipe_label_default;
-    flow_def_label = flow_def_label ?: upipe_dump_flow_def_label_default;
-
-    uint64_t uid = 0;
-    struct uchain list;
+    int err = UBASE_ERR_NONE;
     struct uchain *uchain, *uchain_tmp;
-    ulist_init(&list);
-
-    fprintf(file, "digraph \"upipe dump\" {\n");
-    fprintf(file, "graph [bgcolor=\"#00000000\", fontname=\"Arial\", fontsize=10, fontcolor=\"#0e0e0e\"];\n");
-    fprintf(file, "edge [penwidth=1, color=\"#0e0e0e\", fontname=\"Arial\", fontsize=7, fontcolor=\"#0e0e0e\"];\n");
-    fprintf(file, "node [shape=\"box\", style=\"filled\", color=\"#0e0e0e\", fillcolor=\"#f6f6f6\", fontname=\"Arial\", fontsize=10, fontcolor=\"#0e0e0e\"];\n");
-    fprintf(file, "newrank=true;\n"); /* for rank=same */
+    ulist_init(&walker->list);
 
     if (ulist != NULL) {
         ulist_foreach (ulist, uchain) {
             struct upipe *source = upipe_from_uchain(uchain);
-            upipe_dump_pipe(pipe_label, flow_def_label, file, source,
-                            &uid, &list, false);
+            if (ubase_check(err))
+                err = upipe_dump_walk_pipe(walker, source, NULL);
         }
     }
 
     struct upipe *source;
     while ((source = va_arg(args, struct upipe *)) != NULL)
-        upipe_dump_pipe(pipe_label, flow_def_label, file, source,
-                        &uid, &list, false);
+        if (ubase_check(err))
+            err = upipe_dump_walk_pipe(walker, source, NULL);
 
     /* Walk through the super-pipes that we may have forgotten. */
-    fprintf(file, "#super-pipes\n");
-    uint64_t last_uid;
-    do {
-        last_uid = uid;
-        ulist_foreach (&list, uchain) {
+    bool found = true;
+    while (ubase_check(err) && found) {
+        found = false;
+        ulist_foreach (&walker->list, uchain) {
             struct upipe *upipe = upipe_dump_ctx_from_uchain(uchain)->upipe;
             struct upipe *super = NULL;
             while (ubase_check(upipe_sub_get_super(upipe, &upipe)) &&
                    upipe != NULL)
                 super = upipe;
-            if (super != NULL)
-                upipe_dump_pipe(pipe_label, flow_def_label, file, super,
-                                &uid, &list, false);
+            if (super != NULL &&
+                upipe_dump_find(super, &walker->list) == NULL) {
+                err = upipe_dump_walk_pipe(walker, super, NULL);
+                found = true;
+                break;
+            }
         }
-    } while (last_uid != uid);
-
-    fprintf(file, "}\n");
+    }
 
     /* Clean up. */
-    ulist_delete_foreach (&list, uchain, uchain_tmp) {
+    ulist_delete_foreach (&walker->list, uchain, uchain_tmp) {
         struct upipe_dump_ctx *ctx = upipe_dump_ctx_from_uchain(uchain);
-        ctx->upipe->opaque = ctx->original_opaque;
-        uid--;
-        if (ctx->output_uid != ctx->input_uid)
-            uid--;
+        ulist_delete(uchain);
+        free(ctx->label);
         free(ctx);
     }
-    assert(!uid);
+    return err;
+}
+
+/** @This is a dump of a pipeline in dot format. */
+struct upipe_dump_dot {
+    /** function to print pipe labels */
+    upipe_dump_pipe_label *pipe_label;
+    /** function to print flow_def labels */
+    upipe_dump_flow_def_label *flow_def_label;
+    /** file pointer to write to */
+    FILE *file;
+    /** next unique ID */
+    uint64_t uid;
+
+    /** walk through the pipeline */
+    struct upipe_dump_walker walker;
+};
+
+/** @internal @This returns the dot dump from the walker.
+ *
+ * @param walker description of the walk
+ * @return pointer to the dot dump
+ */
+static inline struct upipe_dump_dot *
+    upipe_dump_dot_from_walker(struct upipe_dump_walker *walker)
+{
+    return container_of(walker, struct upipe_dump_dot, walker);
 }
 
+/** @internal @This starts the dump of a pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ * @return an error code
+ */
+static int upipe_dump_dot_enter(struct upipe_dump_walker *walker,
+                                struct upipe_dump_ctx *ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    ctx->input_uid = ctx->output_uid = dot->uid++;
+    ctx->label = dot->pipe_label(ctx->upipe);
+    fprintf(dot->file, "#begin pipe%"PRIu64"\n", ctx->input_uid);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This dumps the edge with a sub pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ * @param sub_ctx context of the sub pipe
+ */
+static void upipe_dump_dot_sub(struct upipe_dump_walker *walker,
+                               struct upipe_dump_ctx *ctx,
+                               struct upipe_dump_ctx *sub_ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    fprintf(dot->file, "pipe%"PRIu64"->pipe%"PRIu64" [style=\"dashed\"];\n",
+            ctx->input_uid, sub_ctx->input_uid);
+    fprintf(dot->file, "{rank=same; pipe%"PRIu64" pipe%"PRIu64"};\n",
+            ctx->input_uid, sub_ctx->input_uid);
+}
+
+/** @internal @This opens the cluster of a bin pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ */
+static void upipe_dump_dot_begin_inner(struct upipe_dump_walker *walker,
+                                       struct upipe_dump_ctx *ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    FILE *file = dot->file;
+    ctx->output_uid = dot->uid++;
+
+    fprintf(file, "subgraph cluster_%"PRIu64" {\n", ctx->input_uid);
+    fprintf(file, "color=\"#0e0e0e\";\n");
+    fprintf(file, "fillcolor=\"#e0e0e0\";\n");
+    fprintf(file, "style=\"dashed,filled\";\n");
+    fprintf(file, "label=\"%s\";\n", ctx->label);
+
+    fprintf(file, "pipe%"PRIu64" [label=\"input\", style=\"dashed,filled\"];\n",
+            ctx->input_uid);
+    fprintf(file, "pipe%"PRIu64" [label=\"output\", style=\"dashed,filled\"];\n",
+            ctx->output_uid);
+}
+
+/** @internal @This closes the cluster of a bin pipe, or dumps the node of
+ * another pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ * @param first_ctx context of the first inner pipe, or NULL
+ * @param last_ctx context of the last inner pipe, or NULL
+ */
+static void upipe_dump_dot_end_inner(struct upipe_dump_walker *walker,
+                                     struct upipe_dump_ctx *ctx,
+                                     struct upipe_dump_ctx *first_ctx,
+                                     struct upipe_dump_ctx *last_ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    FILE *file = dot->file;
+    if (first_ctx != NULL) {
+        fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64";\n",
+                ctx->input_uid, first_ctx->input_uid);
+        fprintf(file, "pipe%"PRIu64"->pipe%"PRIu64";\n",
+                last_ctx->output_uid, ctx->output_uid);
+        fprintf(file, "}\n");
+    } else
+        fprintf(file, "pipe%"PRIu64" [label=\"%s\"];\n", ctx->input_uid,
+                ctx->label);
+    free(ctx->label);
+    ctx->label = NULL;
+}
+
+/** @internal @This dumps the edge with the output.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ * @param output_ctx context of the output
+ */
+static void upipe_dump_dot_output(struct upipe_dump_walker *walker,
+                                  struct upipe_dump_ctx *ctx,
+                                  struct upipe_dump_ctx *output_ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    struct uref *flow_def = NULL;
+    upipe_get_flow_def(ctx->upipe, &flow_def);
+    char *label = dot->flow_def_label(flow_def);
+    fprintf(dot->file, "pipe%"PRIu64"->pipe%"PRIu64" [label=\"%s\"];\n",
+            ctx->output_uid, output_ctx->input_uid, label);
+    free(label);
+}
+
+/** @internal @This ends the dump of a pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ */
+static void upipe_dump_dot_leave(struct upipe_dump_walker *walker,
+                                 struct upipe_dump_ctx *ctx)
+{
+    struct upipe_dump_dot *dot = upipe_dump_dot_from_walker(walker);
+    fprintf(dot->file, "#end pipe%"PRIu64"\n", ctx->input_uid);
+}
+
+/** @This dumps a pipeline in dot format.
+ *
+ * @param pipe_label function to print pipe labels
+ * @param flow_def_label function to print flow_def labels
+ * @param file file pointer to write to
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ */
+void upipe_dump_va(upipe_dump_pipe_label pipe_label,
+                   upipe_dump_flow_def_label flow_def_label,
+                   FILE *file, struct uchain *ulist, va_list args)
+{
+    struct upipe_dump_dot dot = {
+        .pipe_label = pipe_label ?: upipe_dump_upipe_label_default,
+        .flow_def_label = flow_def_label ?: upipe_dump_flow_def_label_default,
+        .file = file,
+        .uid = 0,
+        .walker = {
+            .enter = upipe_dump_dot_enter,
+            .sub = upipe_dump_dot_sub,
+            .begin_inner = upipe_dump_dot_begin_inner,
+            .end_inner = upipe_dump_dot_end_inner,
+            .output = upipe_dump_dot_output,
+            .leave = upipe_dump_dot_leave,
+        },
+    };
+
+    fprintf(file, "digraph \"upipe dump\" {\n");
+    fprintf(file, "graph [bgcolor=\"#00000000\", fontname=\"Arial\", fontsize=10, fontcolor=\"#0e0e0e\"];\n");
+    fprintf(file, "edge [penwidth=1, color=\"#0e0e0e\", fontname=\"Arial\", fontsize=7, fontcolor=\"#0e0e0e\"];\n");
+    fprintf(file, "node [shape=\"box\", style=\"filled\", color=\"#0e0e0e\", fillcolor=\"#f6f6f6\", fontname=\"Arial\", fontsize=10, fontcolor=\"#0e0e0e\"];\n");
+    fprintf(file, "newrank=true;\n"); /* for rank=same */
+
+    upipe_dump_walker_run(&dot.walker, ulist, args);
+
+    fprintf(file, "}\n");
+}
+
+/** @This calls a function for each pipe of a pipeline. */
+struct upipe_dump_walk {
+    /** function to call for each pipe */
+    upipe_dump_walk_cb *cb;
+    /** opaque passed to the function */
+    void *opaque;
+
+    /** walk through the pipeline */
+    struct upipe_dump_walker walker;
+};
+
+/** @internal @This calls the function for a visited pipe.
+ *
+ * @param walker description of the walk
+ * @param ctx context of the pipe
+ * @return an error code
+ */
+static int upipe_dump_walk_enter(struct upipe_dump_walker *walker,
+                                 struct upipe_dump_ctx *ctx)
+{
+    struct upipe_dump_walk *walk =
+        container_of(walker, struct upipe_dump_walk, walker);
+    return walk->cb(walk->opaque, ctx->upipe);
+}
+
+/** @This calls a function for each pipe of a pipeline, following the same
+ * edges as @ref upipe_dump_va (sub pipes, inner pipes, outputs and super
+ * pipes), and visiting each pipe once.
+ *
+ * @param cb function to call for each pipe
+ * @param opaque opaque passed to the function
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code, the walk being interrupted by the first error
+ * returned by the function
+ */
+int upipe_dump_walk_va(upipe_dump_walk_cb cb, void *opaque,
+                       struct uchain *ulist, va_list args)
+{
+    struct upipe_dump_walk walk = {
+        .cb = cb,
+        .opaque = opaque,
+        .walker = {
+            .enter = upipe_dump_walk_enter,
+        },
+    };
+    return upipe_dump_walker_run(&walk.walker, ulist, args);
+}
 
 /** @This opens a file and dumps a pipeline in dot format.
  *
@@ -332,3 +525,57 @@ int upipe_dump_open_va(upipe_dump_pipe_label pipe_label,
     fclose(file);
     return UBASE_ERR_NONE;
 }
+
+/** @internal @This prints the profiling counters of a pipe.
+ *
+ * @param opaque file pointer to write to
+ * @param upipe upipe structure
+ * @return an error code
+ */
+static int upipe_dump_prof_pipe(void *opaque, struct upipe *upipe)
+{
+    FILE *file = opaque;
+    struct upipe_prof *prof = upipe->prof;
+    if (prof == NULL)
+        return UBASE_ERR_NONE;
+
+    struct uprobe *uprobe = upipe->uprobe;
+    const char *prefix = NULL;
+    while (uprobe != NULL && prefix == NULL) {
+        prefix = uprobe_pfx_get_name(uprobe);
+        uprobe = uprobe->next;
+    }
+
+    uint64_t live = 0, allocated = 0;
+    if (prof->account != NULL) {
+        live = uaccount_load(&prof->account->live);
+        allocated = uaccount_load(&prof->account->bytes);
+    }
+
+    fprintf(file, "%p\t%s\t%4.4s\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64
+            "\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64
+            "\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\n",
+            upipe, prefix ?: "-", (const char *)&upipe->mgr->signature,
+            prof->urefs, prof->bytes, prof->input_ticks, prof->input_max,
+            prof->controls, prof->control_ticks, prof->control_max,
+            prof->held, prof->held_max, prof->queue, prof->queue_max,
+            live, allocated);
+    return UBASE_ERR_NONE;
+}
+
+/** @This dumps the profiling counters of the pipes of a pipeline, as
+ * tab-separated values with a header line. Pipes without counters are
+ * skipped.
+ *
+ * @param file file pointer to write to
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code
+ */
+int upipe_dump_prof_va(FILE *file, struct uchain *ulist, va_list args)
+{
+    fprintf(file, "pipe\tname\tsignature\turefs\tbytes\tinput_ticks"
+            "\tinput_max\tcontrols\tcontrol_ticks\tcontrol_max"
+            "\theld\theld_max\tqueue\tqueue_max\tlive\tallocated\n");
+    return upipe_dump_walk_va(upipe_dump_prof_pipe, file, ulist, args);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short Upipe profiling counters
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_prof.h>
+#include <upipe/uaccount.h>
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+
+#include <time.h>
+
+/** ticks spent in the pipes called by the current pipe, per thread */
+static __thread uint64_t upipe_prof_nested = 0;
+
+/** @This returns the current value of the profiling tick counter.
+ *
+ * @return ticks
+ */
+uint64_t upipe_prof_ticks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+#endif
+}
+
+/** @internal @This starts measuring a call.
+ *
+ * @param saved_p filled in with the nested ticks of the calling pipe
+ * @return start ticks
+ */
+static inline uint64_t upipe_prof_enter(uint64_t *saved_p)
+{
+    *saved_p = upipe_prof_nested;
+    upipe_prof_nested = 0;
+    return upipe_prof_ticks();
+}
+
+/** @internal @This stops measuring a call.
+ *
+ * @param start start ticks
+ * @param saved nested ticks of the calling pipe
+ * @return ticks spent in the pipe itself
+ */
+static inline uint64_t upipe_prof_leave(uint64_t start, uint64_t saved)
+{
+    uint64_t elapsed = upipe_prof_ticks() - start;
+    uint64_t self = elapsed > upipe_prof_nested ?
+                    elapsed - upipe_prof_nested : 0;
+    upipe_prof_nested = saved + elapsed;
+    return self;
+}
+
+/** @internal @This sends an input buffer into a pipe, and updates its
+ * profiling counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure to send
+ * @param upump_p reference to the pump that generated the buffer
+ */
+void upipe_prof_input(struct upipe *upipe, struct uref *uref,
+                      struct upump **upump_p)
+{
+    struct upipe_prof *prof = upipe->prof;
+    size_t size;
+    prof->urefs++;
+    if (uref->ubuf != NULL && ubase_check(ubuf_block_size(uref->ubuf, &size)))
+        prof->bytes += size;
+
+    struct uaccount *prev = uaccount_enter(prof->account);
+    uint64_t saved;
+    uint64_t start = upipe_prof_enter(&saved);
+    upipe->mgr->upipe_input(upipe, uref, upump_p);
+    uint64_t self = upipe_prof_leave(start, saved);
+    uaccount_leave(prev);
+
+    prof->input_ticks += self;
+    if (self > prof->input_max)
+        prof->input_max = self;
+}
+
+/** @internal @This sends a control command to the pipe, and updates its
+ * profiling counters.
+ *
+ * @param upipe description structure of the pipe
+ * @param command control command to send
+ * @param args optional read or write parameters
+ * @return an error code
+ */
+int upipe_prof_control_va(struct upipe *upipe, int command, va_list args)
+{
+    struct upipe_prof *prof = upipe->prof;
+    prof->controls++;
+
+    struct uaccount *prev = uaccount_enter(prof->account);
+    uint64_t saved;
+    uint64_t start = upipe_prof_enter(&saved);
+    int err = upipe->mgr->upipe_control(upipe, command, args);
+    uint64_t self = upipe_prof_leave(start, saved);
+    uaccount_leave(prev);
+
+    prof->control_ticks += self;
+    if (self > prof->control_max)
+        prof->control_max = self;
+    return err;
+}
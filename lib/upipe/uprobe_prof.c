@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short probe attaching profiling counters to pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prof.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_prof.h>
+#include <upipe/uaccount.h>
+
+#include <stdlib.h>
+#include <assert.h>
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_prof_throw(struct uprobe *uprobe, struct upipe *upipe,
+                             int event, va_list args)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+
+    switch (event) {
+        case UPROBE_READY:
+            if (upipe != NULL && upipe->prof == NULL) {
+                struct upipe_prof *prof = calloc(1, sizeof(struct upipe_prof));
+                if (likely(prof != NULL)) {
+                    prof->owner = uprobe_prof;
+                    prof->upipe = upipe;
+                    prof->account = uaccount_alloc();
+                    ulist_add(&uprobe_prof->profs,
+                              upipe_prof_to_uchain(prof));
+                    upipe->prof = prof;
+                }
+            }
+            break;
+
+        case UPROBE_DEAD:
+            if (upipe != NULL && upipe->prof != NULL &&
+                upipe->prof->owner == uprobe_prof) {
+                struct upipe_prof *prof = upipe->prof;
+                upipe->prof = NULL;
+                ulist_delete(upipe_prof_to_uchain(prof));
+                uaccount_release(prof->account);
+                free(prof);
+            }
+            break;
+
+        default:
+            break;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This throws a @ref UPROBE_PROF_STATS event from each profiled pipe.
+ * It must be called from the thread of the pipes, and the event handlers
+ * must not release the pipes.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_snapshot(struct uprobe *uprobe)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_prof->profs, uchain) {
+        struct upipe_prof *prof = upipe_prof_from_uchain(uchain);
+        upipe_throw_prof_stats(prof->upipe);
+    }
+}
+
+/** @internal @This returns the bytes currently allocated by a pipe.
+ *
+ * @param prof profiling counters of the pipe
+ * @return number of bytes
+ */
+static inline uint64_t uprobe_prof_live(struct upipe_prof *prof)
+{
+    return prof->account != NULL ? uaccount_load(&prof->account->live) : 0;
+}
+
+/** @This throws a @ref UPROBE_PROF_STATS event from the profiled pipes
+ * which currently allocate the most bytes, in decreasing order. It must be
+ * called from the thread of the pipes, and the event handlers must not
+ * release the pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param nb maximum number of pipes
+ * @return an error code
+ */
+int uprobe_prof_snapshot_top(struct uprobe *uprobe, unsigned int nb)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    if (!nb)
+        return UBASE_ERR_NONE;
+    struct upipe_prof **top = malloc(nb * sizeof(struct upipe_prof *));
+    if (unlikely(top == NULL))
+        return UBASE_ERR_ALLOC;
+
+    /* insertion into the sorted array of the top pipes */
+    unsigned int nb_top = 0;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_prof->profs, uchain) {
+        struct upipe_prof *prof = upipe_prof_from_uchain(uchain);
+        uint64_t live = uprobe_prof_live(prof);
+        unsigned int i = nb_top < nb ? nb_top++ : nb;
+        while (i > 0 && uprobe_prof_live(top[i - 1]) < live) {
+            if (i < nb)
+                top[i] = top[i - 1];
+            i--;
+        }
+        if (i < nb)
+            top[i] = prof;
+    }
+
+    for (unsigned int i = 0; i < nb_top; i++)
+        upipe_throw_prof_stats(top[i]->upipe);
+    free(top);
+    return UBASE_ERR_NONE;
+}
+
+/** @This resets the cumulative counters of the profiled pipes.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_reset(struct uprobe *uprobe)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_prof->profs, uchain) {
+        struct upipe_prof *prof = upipe_prof_from_uchain(uchain);
+        prof->urefs = prof->bytes = 0;
+        prof->input_ticks = prof->input_max = 0;
+        prof->controls = 0;
+        prof->control_ticks = prof->control_max = 0;
+        prof->held_max = prof->held;
+        prof->queue_max = prof->queue;
+        if (prof->account != NULL)
+            uaccount_reset(prof->account);
+    }
+}
+
+/** @This initializes an already allocated uprobe_prof structure.
+ *
+ * @param uprobe_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_init(struct uprobe_prof *uprobe_prof,
+                                struct uprobe *next)
+{
+    assert(uprobe_prof != NULL);
+    struct uprobe *uprobe = uprobe_prof_to_uprobe(uprobe_prof);
+    ulist_init(&uprobe_prof->profs);
+    uprobe_init(uprobe, uprobe_prof_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_prof structure.
+ *
+ * @param uprobe_prof structure to clean
+ */
+void uprobe_prof_clean(struct uprobe_prof *uprobe_prof)
+{
+    assert(uprobe_prof != NULL);
+    struct uprobe *uprobe = uprobe_prof_to_uprobe(uprobe_prof);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_prof->profs, uchain, uchain_tmp) {
+        struct upipe_prof *prof = upipe_prof_from_uchain(uchain);
+        ulist_delete(uchain);
+        prof->upipe->prof = NULL;
+        uaccount_release(prof->account);
+        free(prof);
+    }
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next
+#define ARGS next
+UPROBE_HELPER_ALLOC(uprobe_prof)
+#undef ARGS
+#undef ARGS_DECL
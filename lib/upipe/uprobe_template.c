@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe recording a negotiated pipeline as a template
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_template.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/udict.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/urequest.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_dump.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <assert.h>
+
+/** @This is a recorded answer to a request. */
+struct uprobe_template_answer {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** type of request */
+    int type;
+    /** uref carried by the request, or NULL */
+    struct uref *request;
+    /** manager of the requesting pipe, for requests without uref */
+    struct upipe_mgr *mgr;
+
+    /** provided uref manager */
+    struct uref_mgr *uref_mgr;
+    /** provided ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** provided flow format */
+    struct uref *flow_format;
+    /** provided uclock */
+    struct uclock *uclock;
+};
+
+UBASE_FROM_TO(uprobe_template_answer, uchain, uchain, uchain)
+
+/** @This is a request forwarded to the next probe, to record its answer. */
+struct uprobe_template_proxy {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the probe */
+    struct uprobe_template *uprobe_template;
+    /** manager of the requesting pipe, for requests without uref */
+    struct upipe_mgr *mgr;
+    /** original request, only valid while it is thrown to the next probe */
+    struct urequest *original;
+    /** request forwarded to the next probe */
+    struct urequest urequest;
+};
+
+UBASE_FROM_TO(uprobe_template_proxy, uchain, uchain, uchain)
+UBASE_FROM_TO(uprobe_template_proxy, urequest, urequest, urequest)
+
+/** @This is a captured pipe. */
+struct uprobe_template_node {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** manager of the pipe */
+    struct upipe_mgr *mgr;
+    /** output flow definition, or NULL */
+    struct uref *flow_def;
+    /** captured output, or NULL */
+    struct uprobe_template_node *output;
+    /** true if the pipe is a sub pipe or an inner pipe */
+    bool dependent;
+
+    /** pipe, only valid during the capture */
+    struct upipe *upipe;
+    /** output pipe, only valid during the capture */
+    struct upipe *output_upipe;
+};
+
+UBASE_FROM_TO(uprobe_template_node, uchain, uchain, uchain)
+
+/** @internal @This checks if two requests carry the same uref.
+ *
+ * @param uref1 first uref, or NULL
+ * @param uref2 second uref, or NULL
+ * @return true if the urefs are identical
+ */
+static bool uprobe_template_match_uref(struct uref *uref1,
+                                       struct uref *uref2)
+{
+    if (uref1 == NULL || uref2 == NULL)
+        return uref1 == uref2;
+    return !udict_cmp(uref1->udict, uref2->udict) &&
+           !udict_cmp(uref2->udict, uref1->udict);
+}
+
+/** @internal @This returns the manager a request is recorded for. Requests
+ * carrying a uref are matched on the uref, whatever the requesting pipe;
+ * the other requests are only matched for pipes of the same manager.
+ *
+ * @param upipe requesting pipe, or NULL
+ * @param urequest request
+ * @return pointer to the manager, or NULL
+ */
+static struct upipe_mgr *uprobe_template_key(struct upipe *upipe,
+                                             struct urequest *urequest)
+{
+    if (urequest->uref != NULL || upipe == NULL)
+        return NULL;
+    return upipe->mgr;
+}
+
+/** @internal @This finds the recorded answer to a request.
+ *
+ * @param uprobe_template pointer to probe
+ * @param upipe requesting pipe, or NULL
+ * @param urequest request to answer
+ * @return pointer to the answer, or NULL
+ */
+static struct uprobe_template_answer *
+    uprobe_template_find(struct uprobe_template *uprobe_template,
+                         struct upipe *upipe, struct urequest *urequest)
+{
+    struct upipe_mgr *mgr = uprobe_template_key(upipe, urequest);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->answers, uchain) {
+        struct uprobe_template_answer *answer =
+            uprobe_template_answer_from_uchain(uchain);
+        if (answer->type == urequest->type && answer->mgr == mgr &&
+            uprobe_template_match_uref(answer->request, urequest->uref))
+            return answer;
+    }
+    return NULL;
+}
+
+/** @internal @This answers a request with a recorded answer.
+ *
+ * @param answer recorded answer
+ * @param urequest request to answer
+ * @return an error code
+ */
+static int uprobe_template_provide(struct uprobe_template_answer *answer,
+                                   struct urequest *urequest)
+{
+    struct uref *uref = NULL;
+    if (answer->flow_format != NULL) {
+        uref = uref_dup(answer->flow_format);
+        if (unlikely(uref == NULL))
+            return UBASE_ERR_ALLOC;
+    }
+
+    switch (answer->type) {
+        case UREQUEST_UREF_MGR:
+            return urequest_provide_uref_mgr(urequest,
+                                             uref_mgr_use(answer->uref_mgr));
+        case UREQUEST_FLOW_FORMAT:
+            return urequest_provide_flow_format(urequest, uref);
+        case UREQUEST_UBUF_MGR:
+            return urequest_provide_ubuf_mgr(urequest,
+                                             ubuf_mgr_use(answer->ubuf_mgr),
+                                             uref);
+        case UREQUEST_UCLOCK:
+            return urequest_provide_uclock(urequest,
+                                           uclock_use(answer->uclock));
+        default:
+            break;
+    }
+    uref_free(uref);
+    return UBASE_ERR_INVALID;
+}
+
+/** @internal @This frees a recorded answer.
+ *
+ * @param answer recorded answer
+ */
+static void uprobe_template_answer_free(struct uprobe_template_answer *answer)
+{
+    uref_free(answer->request);
+    upipe_mgr_release(answer->mgr);
+    uref_mgr_release(answer->uref_mgr);
+    ubuf_mgr_release(answer->ubuf_mgr);
+    uref_free(answer->flow_format);
+    uclock_release(answer->uclock);
+    free(answer);
+}
+
+/** @internal @This frees a forwarded request.
+ *
+ * @param proxy forwarded request
+ */
+static void uprobe_template_proxy_free(struct uprobe_template_proxy *proxy)
+{
+    ulist_delete(uprobe_template_proxy_to_uchain(proxy));
+    urequest_clean(&proxy->urequest);
+    upipe_mgr_release(proxy->mgr);
+    free(proxy);
+}
+
+/** @internal @This checks if a forwarded request is still waiting for an
+ * answer.
+ *
+ * @param uprobe_template pointer to probe
+ * @param proxy forwarded request
+ * @return true if the request was not answered yet
+ */
+static bool uprobe_template_pending(struct uprobe_template *uprobe_template,
+                                    struct uprobe_template_proxy *proxy)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->proxies, uchain)
+        if (uchain == uprobe_template_proxy_to_uchain(proxy))
+            return true;
+    return false;
+}
+
+/** @internal @This releases the structures provided to a request which is
+ * not forwarded.
+ *
+ * @param type type of request
+ * @param args answer
+ */
+static void uprobe_template_release_va(int type, va_list args)
+{
+    switch (type) {
+        case UREQUEST_UREF_MGR:
+            uref_mgr_release(va_arg(args, struct uref_mgr *));
+            break;
+        case UREQUEST_FLOW_FORMAT:
+            uref_free(va_arg(args, struct uref *));
+            break;
+        case UREQUEST_UBUF_MGR:
+            ubuf_mgr_release(va_arg(args, struct ubuf_mgr *));
+            uref_free(va_arg(args, struct uref *));
+            break;
+        case UREQUEST_UCLOCK:
+            uclock_release(va_arg(args, struct uclock *));
+            break;
+        default:
+            break;
+    }
+}
+
+/** @internal @This records the answer of the next probe and forwards it to
+ * the original request.
+ *
+ * @param urequest forwarded request
+ * @param args answer
+ * @return an error code
+ */
+static int uprobe_template_proxy_provide(struct urequest *urequest,
+                                         va_list args)
+{
+    struct uprobe_template_proxy *proxy =
+        uprobe_template_proxy_from_urequest(urequest);
+    struct uprobe_template *uprobe_template = proxy->uprobe_template;
+    struct urequest *original = proxy->original;
+
+    struct uprobe_template_answer *answer =
+        malloc(sizeof(struct uprobe_template_answer));
+    if (likely(answer != NULL)) {
+        answer->type = urequest->type;
+        answer->request = NULL;
+        answer->mgr = upipe_mgr_use(proxy->mgr);
+        answer->uref_mgr = NULL;
+        answer->ubuf_mgr = NULL;
+        answer->flow_format = NULL;
+        answer->uclock = NULL;
+
+        va_list args_copy;
+        va_copy(args_copy, args);
+        switch (urequest->type) {
+            case UREQUEST_UREF_MGR:
+                answer->uref_mgr =
+                    uref_mgr_use(va_arg(args_copy, struct uref_mgr *));
+                break;
+            case UREQUEST_FLOW_FORMAT:
+                answer->flow_format = va_arg(args_copy, struct uref *);
+                break;
+            case UREQUEST_UBUF_MGR:
+                answer->ubuf_mgr =
+                    ubuf_mgr_use(va_arg(args_copy, struct ubuf_mgr *));
+                answer->flow_format = va_arg(args_copy, struct uref *);
+                break;
+            case UREQUEST_UCLOCK:
+                answer->uclock = uclock_use(va_arg(args_copy, struct uclock *));
+                break;
+        }
+        va_end(args_copy);
+
+        if (answer->flow_format != NULL)
+            answer->flow_format = uref_dup(answer->flow_format);
+        if (urequest->uref != NULL)
+            answer->request = uref_dup(urequest->uref);
+        ulist_add(&uprobe_template->answers,
+                  uprobe_template_answer_to_uchain(answer));
+    }
+
+    uprobe_template_proxy_free(proxy);
+    if (original == NULL) {
+        /* the original request was thrown again to the next probe */
+        uprobe_template_release_va(urequest->type, args);
+        return UBASE_ERR_NONE;
+    }
+    return urequest_provide_va(original, args);
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_template_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                 int event, va_list args)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+
+    if (event != UPROBE_PROVIDE_REQUEST)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    struct urequest *urequest = va_arg(args_copy, struct urequest *);
+    va_end(args_copy);
+
+    /* the sink latency depends on the position of the pipe in the graph,
+     * so it is not recorded */
+    if (urequest->type >= UREQUEST_LOCAL ||
+        urequest->type == UREQUEST_SINK_LATENCY)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    struct uprobe_template_answer *answer =
+        uprobe_template_find(uprobe_template, upipe, urequest);
+    if (answer != NULL)
+        return uprobe_template_provide(answer, urequest);
+
+    /* forward a copy of the request to record the answer */
+    struct uprobe_template_proxy *proxy =
+        malloc(sizeof(struct uprobe_template_proxy));
+    if (unlikely(proxy == NULL))
+        return uprobe_throw_next(uprobe, upipe, event, args);
+    struct uref *uref = NULL;
+    if (urequest->uref != NULL &&
+        unlikely((uref = uref_dup(urequest->uref)) == NULL)) {
+        free(proxy);
+        return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+    proxy->uprobe_template = uprobe_template;
+    proxy->mgr = upipe_mgr_use(uprobe_template_key(upipe, urequest));
+    proxy->original = urequest;
+    urequest_init(&proxy->urequest, urequest->type, uref,
+                  uprobe_template_proxy_provide, NULL);
+    ulist_add(&uprobe_template->proxies,
+              uprobe_template_proxy_to_uchain(proxy));
+
+    int err = uprobe_throw(uprobe->next, upipe, event, &proxy->urequest);
+    /* the proxy is freed when it is answered */
+    if (!uprobe_template_pending(uprobe_template, proxy))
+        return err;
+    if (!ubase_check(err)) {
+        uprobe_template_proxy_free(proxy);
+        return err;
+    }
+
+    /* the next probe answers later, possibly after the original request
+     * is freed, so the proxy only records the answer and the original
+     * request is thrown again */
+    proxy->original = NULL;
+    return uprobe_throw(uprobe->next, upipe, event, urequest);
+}
+
+/** @internal @This frees a captured pipe.
+ *
+ * @param node captured pipe
+ */
+static void uprobe_template_node_free(struct uprobe_template_node *node)
+{
+    upipe_mgr_release(node->mgr);
+    uref_free(node->flow_def);
+    free(node);
+}
+
+/** @internal @This captures a pipe.
+ *
+ * @param opaque pointer to probe
+ * @param upipe pipe to capture
+ * @return an error code
+ */
+static int uprobe_template_capture_pipe(void *opaque, struct upipe *upipe)
+{
+    struct uprobe_template *uprobe_template = opaque;
+    struct uprobe_template_node *node =
+        malloc(sizeof(struct uprobe_template_node));
+    if (unlikely(node == NULL))
+        return UBASE_ERR_ALLOC;
+
+    node->mgr = upipe_mgr_use(upipe->mgr);
+    node->flow_def = NULL;
+    node->output = NULL;
+    node->upipe = upipe;
+    node->output_upipe = NULL;
+
+    struct upipe *super = NULL;
+    node->dependent = ubase_check(upipe_sub_get_super(upipe, &super)) &&
+                      super != NULL;
+
+    struct uref *flow_def = NULL;
+    if (ubase_check(upipe_get_flow_def(upipe, &flow_def)) &&
+        flow_def != NULL)
+        node->flow_def = uref_dup(flow_def);
+    upipe_get_output(upipe, &node->output_upipe);
+
+    ulist_add(&uprobe_template->nodes, uprobe_template_node_to_uchain(node));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This finds a captured pipe.
+ *
+ * @param uprobe_template pointer to probe
+ * @param upipe pipe to find
+ * @return pointer to the captured pipe, or NULL
+ */
+static struct uprobe_template_node *
+    uprobe_template_find_node(struct uprobe_template *uprobe_template,
+                              struct upipe *upipe)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->nodes, uchain) {
+        struct uprobe_template_node *node =
+            uprobe_template_node_from_uchain(uchain);
+        if (node->upipe == upipe)
+            return node;
+    }
+    return NULL;
+}
+
+/** @internal @This releases the captured graph.
+ *
+ * @param uprobe_template pointer to probe
+ */
+static void uprobe_template_flush_nodes(struct uprobe_template *uprobe_template)
+{
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&uprobe_template->nodes)) != NULL)
+        uprobe_template_node_free(uprobe_template_node_from_uchain(uchain));
+}
+
+/** @This captures the graph of a negotiated pipeline, replacing the
+ * previous capture. The managers and output flow definitions of the pipes
+ * are kept in the template.
+ *
+ * @param uprobe pointer to probe
+ * @param ulist list of sources pipes in ulist format
+ * @param args list of sources pipes terminated with NULL
+ * @return an error code
+ */
+int uprobe_template_capture_va(struct uprobe *uprobe,
+                               struct uchain *ulist, va_list args)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+
+    uprobe_template_flush_nodes(uprobe_template);
+    int err = upipe_dump_walk_va(uprobe_template_capture_pipe,
+                                 uprobe_template, ulist, args);
+    if (unlikely(!ubase_check(err))) {
+        uprobe_template_flush_nodes(uprobe_template);
+        return err;
+    }
+
+    /* resolve the edges, and mark the inner pipes of bins */
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->nodes, uchain) {
+        struct uprobe_template_node *node =
+            uprobe_template_node_from_uchain(uchain);
+        struct upipe *inner = NULL;
+        upipe_bin_freeze(node->upipe);
+        upipe_bin_get_first_inner(node->upipe, &inner);
+        upipe_bin_thaw(node->upipe);
+        while (inner != NULL) {
+            struct uprobe_template_node *inner_node =
+                uprobe_template_find_node(uprobe_template, inner);
+            if (inner_node == NULL || inner_node->dependent)
+                break;
+            inner_node->dependent = true;
+            inner = inner_node->output_upipe;
+        }
+        if (node->output_upipe != NULL)
+            node->output = uprobe_template_find_node(uprobe_template,
+                                                     node->output_upipe);
+    }
+
+    /* forget the pipes */
+    ulist_foreach (&uprobe_template->nodes, uchain) {
+        struct uprobe_template_node *node =
+            uprobe_template_node_from_uchain(uchain);
+        node->upipe = NULL;
+        node->output_upipe = NULL;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This allocates the outputs of a pipe following the captured graph.
+ * The captured pipe is the first one allocated from the same manager, and
+ * the chain stops at the first pipe without output, or whose output is a
+ * sub pipe or an inner pipe. Sub pipes are left to the caller, as their
+ * manager belongs to the new super pipe, and inner pipes to their bin.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pipe allocated again, typically a source
+ * @param output_uprobe probe given to the allocated pipes
+ * @param last_p filled in with the last pipe of the chain, with a new
+ * reference (upipe itself if no pipe was allocated)
+ * @return an error code
+ */
+int uprobe_template_alloc_output(struct uprobe *uprobe, struct upipe *upipe,
+                                 struct uprobe *output_uprobe,
+                                 struct upipe **last_p)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+
+    struct uprobe_template_node *node = NULL;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->nodes, uchain) {
+        struct uprobe_template_node *it =
+            uprobe_template_node_from_uchain(uchain);
+        if (it->mgr == upipe->mgr && !it->dependent) {
+            node = it;
+            break;
+        }
+    }
+    if (unlikely(node == NULL))
+        return UBASE_ERR_INVALID;
+
+    upipe_use(upipe);
+    while (node->output != NULL && !node->output->dependent) {
+        node = node->output;
+        struct upipe *output = upipe_void_alloc_output(upipe, node->mgr,
+                uprobe_use(output_uprobe));
+        upipe_release(upipe);
+        if (unlikely(output == NULL)) {
+            uprobe_release(output_uprobe);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe = output;
+    }
+    uprobe_release(output_uprobe);
+
+    if (last_p != NULL)
+        *last_p = upipe;
+    else
+        upipe_release(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @This warms up the pools of the recorded picture managers, by allocating
+ * and releasing the given number of pictures of the size of the captured
+ * flow definitions.
+ *
+ * @param uprobe pointer to probe
+ * @param nb number of pictures per manager
+ * @return an error code
+ */
+int uprobe_template_prealloc(struct uprobe *uprobe, unsigned int nb)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+    if (!nb)
+        return UBASE_ERR_NONE;
+
+    struct ubuf *ubufs[nb];
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_template->answers, uchain) {
+        struct uprobe_template_answer *answer =
+            uprobe_template_answer_from_uchain(uchain);
+        uint64_t hsize, vsize;
+        if (answer->type != UREQUEST_UBUF_MGR ||
+            !ubase_check(uref_flow_match_def(answer->flow_format, "pic.")) ||
+            !ubase_check(uref_pic_flow_get_hsize(answer->flow_format,
+                                                 &hsize)) ||
+            !ubase_check(uref_pic_flow_get_vsize(answer->flow_format,
+                                                 &vsize)))
+            continue;
+
+        int err = UBASE_ERR_NONE;
+        unsigned int i;
+        for (i = 0; i < nb; i++) {
+            ubufs[i] = ubuf_pic_alloc(answer->ubuf_mgr, hsize, vsize);
+            if (unlikely(ubufs[i] == NULL)) {
+                err = UBASE_ERR_ALLOC;
+                break;
+            }
+            /* write all planes to fault the pages in */
+            ubuf_pic_clear(ubufs[i], 0, 0, -1, -1, 0);
+        }
+        while (i > 0)
+            ubuf_free(ubufs[--i]);
+        UBASE_RETURN(err);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the number of recorded answers and captured pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param answers_p filled in with the number of recorded answers
+ * @param nodes_p filled in with the number of captured pipes
+ */
+void uprobe_template_get_stats(struct uprobe *uprobe,
+                               unsigned int *answers_p,
+                               unsigned int *nodes_p)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+    if (answers_p != NULL)
+        *answers_p = ulist_depth(&uprobe_template->answers);
+    if (nodes_p != NULL)
+        *nodes_p = ulist_depth(&uprobe_template->nodes);
+}
+
+/** @This releases the recorded answers and the captured graph.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_template_vacuum(struct uprobe *uprobe)
+{
+    struct uprobe_template *uprobe_template =
+        uprobe_template_from_uprobe(uprobe);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&uprobe_template->answers)) != NULL)
+        uprobe_template_answer_free(
+                uprobe_template_answer_from_uchain(uchain));
+    uprobe_template_flush_nodes(uprobe_template);
+}
+
+/** @This initializes an already allocated uprobe_template structure.
+ *
+ * @param uprobe_template pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_template_init(struct uprobe_template *uprobe_template,
+                                    struct uprobe *next)
+{
+    assert(uprobe_template != NULL);
+    struct uprobe *uprobe = uprobe_template_to_uprobe(uprobe_template);
+    ulist_init(&uprobe_template->answers);
+    ulist_init(&uprobe_template->proxies);
+    ulist_init(&uprobe_template->nodes);
+    uprobe_init(uprobe, uprobe_template_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_template structure.
+ *
+ * @param uprobe_template structure to clean
+ */
+void uprobe_template_clean(struct uprobe_template *uprobe_template)
+{
+    assert(uprobe_template != NULL);
+    struct uprobe *uprobe = uprobe_template_to_uprobe(uprobe_template);
+    uprobe_template_vacuum(uprobe);
+
+    /* requests still waiting for an answer are no longer recorded */
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_template->proxies, uchain, uchain_tmp)
+        uprobe_template_proxy_free(
+                uprobe_template_proxy_from_uchain(uchain));
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next
+#define ARGS next
+UPROBE_HELPER_ALLOC(uprobe_template)
+#undef ARGS
+#undef ARGS_DECL
@@ -31,6 +31,9 @@
 #include <upipe/umem.h>
 #include <upipe/ubuf.h>
 #include <upipe/ubuf_mem.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/umem_pool.h>
+#include <upipe/uref_flow.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_ubuf_mem_pool.h>
 #include <upipe/uprobe_helper_alloc.h>
@@ -49,6 +52,52 @@ struct uprobe_ubuf_mem_pool_element {
     uatomic_ptr_t next;
 };
 
+/** @internal @This returns a pooled ubuf manager compatible with the given
+ * flow definition, allocating it and adding it to the pool if needed.
+ *
+ * @param uprobe_ubuf_mem_pool pointer to probe
+ * @param flow_def flow definition
+ * @return pointer to ubuf manager (with a new reference), or NULL
+ */
+static struct ubuf_mgr *
+    uprobe_ubuf_mem_pool_get_mgr(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool,
+                                 struct uref *flow_def)
+{
+    uatomic_ptr_t *elem_p = &uprobe_ubuf_mem_pool->first;
+    struct uprobe_ubuf_mem_pool_element *elem;
+
+    for ( ; ; ) {
+        while ((elem = uatomic_ptr_load_ptr(elem_p,
+                            struct uprobe_ubuf_mem_pool_element *)) != NULL) {
+            if (ubase_check(ubuf_mgr_check(elem->ubuf_mgr, flow_def)))
+                return ubuf_mgr_use(elem->ubuf_mgr);
+            elem_p = &elem->next;
+        }
+
+        struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+                uprobe_ubuf_mem_pool->ubuf_pool_depth,
+                uprobe_ubuf_mem_pool->shared_pool_depth,
+                uprobe_ubuf_mem_pool->umem_mgr, flow_def);
+        if (unlikely(ubuf_mgr == NULL))
+            return NULL;
+
+        struct uprobe_ubuf_mem_pool_element *new_elem =
+            malloc(sizeof(struct uprobe_ubuf_mem_pool_element));
+        if (unlikely(new_elem == NULL))
+            return ubuf_mgr;
+
+        new_elem->ubuf_mgr = ubuf_mgr;
+        uatomic_ptr_init(&new_elem->next, NULL);
+        if (likely(uatomic_ptr_compare_exchange_ptr(elem_p, &elem, new_elem)))
+            return ubuf_mgr_use(ubuf_mgr);
+
+        /* retry */
+        ubuf_mgr_release(new_elem->ubuf_mgr);
+        uatomic_ptr_clean(&new_elem->next);
+        free(new_elem);
+    }
+}
+
 /** @internal @This catches events thrown by pipes.
  *
  * @param uprobe pointer to probe
@@ -87,43 +136,13 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
     if (urequest->type == UREQUEST_FLOW_FORMAT)
         return urequest_provide_flow_format(urequest, uref);
 
-    uatomic_ptr_t *elem_p = &uprobe_ubuf_mem_pool->first;
-    struct uprobe_ubuf_mem_pool_element *elem;
-
-    for ( ; ; ) {
-        while ((elem = uatomic_ptr_load_ptr(elem_p,
-                            struct uprobe_ubuf_mem_pool_element *)) != NULL) {
-            if (ubase_check(ubuf_mgr_check(elem->ubuf_mgr, uref)))
-                return urequest_provide_ubuf_mgr(urequest,
-                            ubuf_mgr_use(elem->ubuf_mgr), uref);
-            elem_p = &elem->next;
-        }
-
-        struct ubuf_mgr *ubuf_mgr = ubuf_mem_mgr_alloc_from_flow_def(
-                uprobe_ubuf_mem_pool->ubuf_pool_depth,
-                uprobe_ubuf_mem_pool->shared_pool_depth,
-                uprobe_ubuf_mem_pool->umem_mgr, uref);
-        if (unlikely(ubuf_mgr == NULL)) {
-            uref_free(uref);
-            return uprobe_throw_next(uprobe, upipe, event, args);
-        }
-
-        struct uprobe_ubuf_mem_pool_element *new_elem =
-            malloc(sizeof(struct uprobe_ubuf_mem_pool_element));
-        if (unlikely(new_elem == NULL))
-            return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
-
-        new_elem->ubuf_mgr = ubuf_mgr;
-        uatomic_ptr_init(&new_elem->next, NULL);
-        if (likely(uatomic_ptr_compare_exchange_ptr(elem_p, &elem, new_elem)))
-            return urequest_provide_ubuf_mgr(urequest, ubuf_mgr_use(ubuf_mgr),
-                                             uref);
-
-        /* retry */
-        ubuf_mgr_release(new_elem->ubuf_mgr);
-        uatomic_ptr_clean(&new_elem->next);
-        free(new_elem);
+    struct ubuf_mgr *ubuf_mgr =
+        uprobe_ubuf_mem_pool_get_mgr(uprobe_ubuf_mem_pool, uref);
+    if (unlikely(ubuf_mgr == NULL)) {
+        uref_free(uref);
+        return uprobe_throw_next(uprobe, upipe, event, args);
     }
+    return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
 }
 
 /** @This initializes an already allocated uprobe_ubuf_mem_pool structure.
@@ -176,6 +195,80 @@ void uprobe_ubuf_mem_pool_vacuum(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_po
     }
 }
 
+/** @This warms up the pools for pictures of the given flow definition and
+ * size, so that the first pictures allocated by pipes (typically decoders
+ * after a channel change or a resolution change) do not cause a burst of
+ * mallocs and page faults. The given number of pictures is allocated from
+ * the pooled ubuf manager, written to fault all their pages in, and released
+ * to the pools. For the buffers to stay available, the umem manager must be
+ * a umem pool manager deep enough for this size of buffers.
+ *
+ * The flow definition must be the one the pipes will request, including the
+ * alignment they need (see @ref uref_pic_flow_set_align).
+ *
+ * @param uprobe_ubuf_mem_pool pointer to probe
+ * @param flow_def picture flow definition
+ * @param hsize horizontal size of the pictures in pixels
+ * @param vsize vertical size of the pictures in lines
+ * @param nb number of pictures to keep warm
+ * @return an error code
+ */
+int uprobe_ubuf_mem_pool_prealloc_pic(
+        struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool,
+        struct uref *flow_def, size_t hsize, size_t vsize, unsigned int nb)
+{
+    const char *def;
+    if (unlikely(uprobe_ubuf_mem_pool->umem_mgr == NULL ||
+                 !ubase_check(uref_flow_get_def(flow_def, &def)) ||
+                 ubase_ncmp(def, "pic.")))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf_mgr *ubuf_mgr =
+        uprobe_ubuf_mem_pool_get_mgr(uprobe_ubuf_mem_pool, flow_def);
+    if (unlikely(ubuf_mgr == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct ubuf **ubufs = malloc(sizeof(struct ubuf *) * nb);
+    if (unlikely(ubufs == NULL)) {
+        ubuf_mgr_release(ubuf_mgr);
+        return UBASE_ERR_ALLOC;
+    }
+
+    int err = UBASE_ERR_NONE;
+    unsigned int i;
+    for (i = 0; i < nb; i++) {
+        ubufs[i] = ubuf_pic_alloc(ubuf_mgr, hsize, vsize);
+        if (unlikely(ubufs[i] == NULL)) {
+            err = UBASE_ERR_ALLOC;
+            break;
+        }
+        /* write all planes to fault the pages in */
+        ubuf_pic_clear(ubufs[i], 0, 0, -1, -1, 0);
+    }
+
+    while (i > 0)
+        ubuf_free(ubufs[--i]);
+    free(ubufs);
+    ubuf_mgr_release(ubuf_mgr);
+    return err;
+}
+
+/** @This returns the occupancy statistics of the buffers of a given size
+ * class, if the probe allocates from a umem pool manager.
+ *
+ * @param uprobe_ubuf_mem_pool pointer to probe
+ * @param pool index of the size class, starting from the smallest buffers
+ * @param stats filled in with the statistics
+ * @return an error code
+ */
+int uprobe_ubuf_mem_pool_get_stats(
+        struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool,
+        unsigned int pool, struct umem_pool_stats *stats)
+{
+    return umem_pool_mgr_get_stats(uprobe_ubuf_mem_pool->umem_mgr, pool,
+                                   stats);
+}
+
 /** @This cleans a uprobe_ubuf_mem_pool structure.
  *
  * @param uprobe_ubuf_mem_pool structure to clean
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short probe providing a shared memory segment to export counters
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_ustats.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/ustats.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+
+#include <stdlib.h>
+#include <assert.h>
+
+/** @This is an exported umem pool manager. */
+struct uprobe_ustats_umem {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** umem pool manager */
+    struct umem_mgr *umem_mgr;
+    /** number of pools */
+    unsigned int nb_pools;
+    /** hit rate records, one per pool */
+    struct ustats_record *records[];
+};
+
+UBASE_FROM_TO(uprobe_ustats_umem, uchain, uchain, uchain)
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_ustats_throw(struct uprobe *uprobe, struct upipe *upipe,
+                               int event, va_list args)
+{
+    struct uprobe_ustats *uprobe_ustats = uprobe_ustats_from_uprobe(uprobe);
+
+    if (event != UPROBE_NEED_USTATS)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    struct ustats **ustats_p = va_arg(args, struct ustats **);
+    *ustats_p = uprobe_ustats->ustats;
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the stats segment of the probe, to register application
+ * counters.
+ *
+ * @param uprobe pointer to probe
+ * @return pointer to the segment
+ */
+struct ustats *uprobe_ustats_get(struct uprobe *uprobe)
+{
+    struct uprobe_ustats *uprobe_ustats = uprobe_ustats_from_uprobe(uprobe);
+    return uprobe_ustats->ustats;
+}
+
+/** @This exports the hit rate of the pools of a umem pool manager, as
+ * "<name>.<size>.hit_rate" ratio records. The statistics of the manager
+ * must have been enabled with @ref umem_pool_mgr_enable_stats.
+ *
+ * @param uprobe pointer to probe
+ * @param umem_mgr umem pool manager
+ * @param name prefix of the records
+ * @return an error code
+ */
+int uprobe_ustats_add_umem_mgr(struct uprobe *uprobe,
+                               struct umem_mgr *umem_mgr, const char *name)
+{
+    struct uprobe_ustats *uprobe_ustats = uprobe_ustats_from_uprobe(uprobe);
+
+    unsigned int nb_pools = 0;
+    struct umem_pool_stats stats;
+    while (ubase_check(umem_pool_mgr_get_stats(umem_mgr, nb_pools, &stats)))
+        nb_pools++;
+    if (!nb_pools)
+        return UBASE_ERR_INVALID;
+
+    struct uprobe_ustats_umem *umem =
+        malloc(sizeof(struct uprobe_ustats_umem) +
+               nb_pools * sizeof(struct ustats_record *));
+    UBASE_ALLOC_RETURN(umem);
+    umem->umem_mgr = umem_mgr_use(umem_mgr);
+    umem->nb_pools = nb_pools;
+    for (unsigned int i = 0; i < nb_pools; i++) {
+        umem_pool_mgr_get_stats(umem_mgr, i, &stats);
+        umem->records[i] = ustats_register(uprobe_ustats->ustats,
+                                           USTATS_RATIO, "%s.%zu.hit_rate",
+                                           name, stats.size);
+    }
+    ulist_add(&uprobe_ustats->umem_mgrs, uprobe_ustats_umem_to_uchain(umem));
+    return UBASE_ERR_NONE;
+}
+
+/** @This refreshes the records of the exported umem managers.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_ustats_update(struct uprobe *uprobe)
+{
+    struct uprobe_ustats *uprobe_ustats = uprobe_ustats_from_uprobe(uprobe);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_ustats->umem_mgrs, uchain) {
+        struct uprobe_ustats_umem *umem =
+            uprobe_ustats_umem_from_uchain(uchain);
+        for (unsigned int i = 0; i < umem->nb_pools; i++) {
+            struct umem_pool_stats stats;
+            if (ubase_check(umem_pool_mgr_get_stats(umem->umem_mgr, i,
+                                                    &stats)))
+                ustats_ratio_set(umem->records[i], stats.hits,
+                                 (uint64_t)stats.hits + stats.misses);
+        }
+    }
+}
+
+/** @This initializes an already allocated uprobe_ustats structure.
+ *
+ * @param uprobe_ustats pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param name name of the shared memory object, or NULL for "/upipe-<pid>"
+ * @param nb_records number of records, or 0 for the default
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ustats_init(struct uprobe_ustats *uprobe_ustats,
+                                  struct uprobe *next, const char *name,
+                                  unsigned int nb_records)
+{
+    assert(uprobe_ustats != NULL);
+    struct uprobe *uprobe = uprobe_ustats_to_uprobe(uprobe_ustats);
+    uprobe_ustats->ustats = ustats_create(name, nb_records);
+    if (unlikely(uprobe_ustats->ustats == NULL)) {
+        uprobe_err(next, NULL, "unable to create stats segment");
+        uprobe_release(next);
+        return NULL;
+    }
+    ulist_init(&uprobe_ustats->umem_mgrs);
+    uprobe_init(uprobe, uprobe_ustats_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_ustats structure, and removes the segment.
+ *
+ * @param uprobe_ustats structure to clean
+ */
+void uprobe_ustats_clean(struct uprobe_ustats *uprobe_ustats)
+{
+    assert(uprobe_ustats != NULL);
+    struct uprobe *uprobe = uprobe_ustats_to_uprobe(uprobe_ustats);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&uprobe_ustats->umem_mgrs)) != NULL) {
+        struct uprobe_ustats_umem *umem =
+            uprobe_ustats_umem_from_uchain(uchain);
+        umem_mgr_release(umem->umem_mgr);
+        free(umem);
+    }
+    ustats_close(uprobe_ustats->ustats);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, const char *name, \
+                  unsigned int nb_records
+#define ARGS next, name, nb_records
+UPROBE_HELPER_ALLOC(uprobe_ustats)
+#undef ARGS
+#undef ARGS_DECL
@@ -32,6 +32,9 @@
 #include <upipe/upool.h>
 #include <upipe/upump_common.h>
 #include <upipe/upump_blocker.h>
+#include <upipe/upump_trace.h>
+#include <upipe/utrace.h>
+#include <upipe/uaccount.h>
 
 #include <stdlib.h>
 
@@ -132,6 +135,7 @@ void upump_common_init(struct upump *upump)
     common->started = false;
     common->status = true;
     ulist_init(&common->blockers);
+    common->account = uaccount_use(uaccount_get_current());
 }
 
 /** @This dispatches a pump.
@@ -140,8 +144,28 @@ void upump_common_init(struct upump *upump)
  */
 void upump_common_dispatch(struct upump *upump)
 {
+    struct upump_common_mgr *common_mgr =
+        upump_common_mgr_from_upump_mgr(upump->mgr);
+    struct upump_trace *trace = common_mgr->trace;
     struct urefcount *refcount = urefcount_use(upump->refcount);
-    upump->cb(upump);
+    /* the pump may be freed by its callback */
+    upump_cb cb = upump->cb;
+    void *opaque = upump->opaque;
+    struct uaccount *account =
+        uaccount_use(upump_common_from_upump(upump)->account);
+    struct uaccount *prev = uaccount_enter(account);
+    UTRACE3(upump_dispatch_entry, upump, cb, opaque);
+    if (unlikely(trace != NULL)) {
+        struct upump_trace_pump *pump = upump_trace_get_pump(trace, upump);
+        uint64_t begin = upump_trace_now();
+        cb(upump);
+        upump_trace_dispatch(trace, pump, cb, opaque,
+                             begin, upump_trace_now());
+    } else
+        cb(upump);
+    UTRACE2(upump_dispatch_exit, cb, opaque);
+    uaccount_leave(prev);
+    uaccount_release(account);
     urefcount_release(refcount);
 }
 
@@ -237,6 +261,8 @@ void upump_common_clean(struct upump *upump)
             upump_blocker_common_to_upump_blocker(blocker_common);
         blocker->cb(blocker);
     }
+    uaccount_release(common->account);
+    common->account = NULL;
     urefcount_release(refcount);
 }
 
@@ -309,6 +335,7 @@ void upump_common_mgr_init(struct upump_mgr *mgr,
     common_mgr->upump_real_start = upump_real_start;
     common_mgr->upump_real_stop = upump_real_stop;
     common_mgr->upump_real_restart = upump_real_restart;
+    common_mgr->trace = NULL;
 
     upool_init(&common_mgr->upump_pool, mgr->refcount, upump_pool_depth,
                pool_extra, upump_alloc_inner, upump_free_inner);
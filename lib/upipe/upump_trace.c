@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short tracing of the dispatches of an event loop
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/upipe.h>
+#include <upipe/upump_trace.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** @This initializes a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ * @param name function returning the name of the owner of a pump, or NULL
+ */
+void upump_trace_init(struct upump_trace *trace, upump_trace_name name)
+{
+    memset(trace, 0, sizeof(struct upump_trace));
+    ulist_init(&trace->pumps);
+    trace->name = name;
+    trace->threshold = UPUMP_TRACE_DEFAULT_THRESHOLD;
+}
+
+/** @This releases the per-pump statistics of a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ */
+void upump_trace_clean(struct upump_trace *trace)
+{
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&trace->pumps, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        free(upump_trace_pump_from_uchain(uchain));
+    }
+    memset(trace->hash, 0, sizeof(trace->hash));
+}
+
+/** @This resets the counters of a upump_trace structure.
+ *
+ * @param trace pointer to trace structure
+ */
+void upump_trace_reset(struct upump_trace *trace)
+{
+    memset(&trace->dispatch, 0, sizeof(trace->dispatch));
+    memset(&trace->lateness, 0, sizeof(trace->lateness));
+    trace->early = 0;
+    memset(&trace->iteration, 0, sizeof(trace->iteration));
+    trace->nb_slow = 0;
+
+    struct uchain *uchain;
+    ulist_foreach (&trace->pumps, uchain) {
+        struct upump_trace_pump *pump = upump_trace_pump_from_uchain(uchain);
+        memset(&pump->dispatch, 0, sizeof(pump->dispatch));
+    }
+}
+
+/** @This returns the date of the monotonic clock used by the traces.
+ *
+ * @return date in 27 MHz ticks
+ */
+uint64_t upump_trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @This adds a sample to a histogram.
+ *
+ * @param hist pointer to histogram
+ * @param duration duration in 27 MHz ticks
+ */
+void upump_trace_hist_add(struct upump_trace_hist *hist, uint64_t duration)
+{
+    uint64_t us = duration / (UCLOCK_FREQ / 1000000);
+    unsigned int bucket = us ? 64 - __builtin_clzll(us) : 0;
+    if (bucket >= UPUMP_TRACE_BUCKETS)
+        bucket = UPUMP_TRACE_BUCKETS - 1;
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total += duration;
+    if (duration > hist->max)
+        hist->max = duration;
+}
+
+/** @internal @This returns the hash bucket of a pump.
+ *
+ * @param cb callback of the pump
+ * @param opaque opaque of the pump
+ * @return index of the bucket
+ */
+static inline unsigned int upump_trace_hash(upump_cb cb, void *opaque)
+{
+    uint64_t key = (uintptr_t)cb ^ ((uintptr_t)opaque >> 4);
+    key *= UINT64_C(0x9e3779b97f4a7c15);
+    return key >> 58;
+}
+
+/** @internal @This fills in the name of the owner of a pump.
+ *
+ * @param trace pointer to trace structure
+ * @param opaque opaque of the pump
+ * @param name filled in with the name
+ */
+static void upump_trace_get_name(struct upump_trace *trace, void *opaque,
+                                 char *name)
+{
+    name[0] = '\0';
+    if (trace->name != NULL && opaque != NULL)
+        trace->name(opaque, name, UPUMP_TRACE_NAME_SIZE);
+}
+
+/** @This returns the per-pump statistics of a pump, allocating them the
+ * first time the pump is dispatched.
+ *
+ * @param trace pointer to trace structure
+ * @param upump description structure of the pump
+ * @return pointer to the per-pump statistics, or NULL in case of allocation
+ * error
+ */
+struct upump_trace_pump *upump_trace_get_pump(struct upump_trace *trace,
+                                              struct upump *upump)
+{
+    unsigned int hash = upump_trace_hash(upump->cb, upump->opaque);
+    struct upump_trace_pump *pump;
+    for (pump = trace->hash[hash]; pump != NULL; pump = pump->next)
+        if (pump->cb == upump->cb && pump->opaque == upump->opaque)
+            return pump;
+
+    pump = calloc(1, sizeof(struct upump_trace_pump));
+    if (unlikely(pump == NULL))
+        return NULL;
+    uchain_init(&pump->uchain);
+    pump->cb = upump->cb;
+    pump->opaque = upump->opaque;
+    upump_trace_get_name(trace, upump->opaque, pump->name);
+    pump->next = trace->hash[hash];
+    trace->hash[hash] = pump;
+    ulist_add(&trace->pumps, upump_trace_pump_to_uchain(pump));
+    return pump;
+}
+
+/** @This records a dispatch.
+ *
+ * @param trace pointer to trace structure
+ * @param pump per-pump statistics, or NULL
+ * @param cb callback of the pump
+ * @param opaque opaque of the pump
+ * @param begin date of the beginning of the callback
+ * @param end date of the end of the callback
+ */
+void upump_trace_dispatch(struct upump_trace *trace,
+                          struct upump_trace_pump *pump,
+                          upump_cb cb, void *opaque,
+                          uint64_t begin, uint64_t end)
+{
+    uint64_t duration = end > begin ? end - begin : 0;
+    upump_trace_hist_add(&trace->dispatch, duration);
+    if (pump != NULL)
+        upump_trace_hist_add(&pump->dispatch, duration);
+
+    if (duration < trace->threshold)
+        return;
+
+    struct upump_trace_slow *slow =
+        &trace->slow[trace->nb_slow++ % UPUMP_TRACE_SLOW];
+    slow->date = begin;
+    slow->duration = duration;
+    slow->cb = cb;
+    slow->opaque = opaque;
+    /* the owner may have been released by the callback */
+    if (pump != NULL)
+        memcpy(slow->name, pump->name, UPUMP_TRACE_NAME_SIZE);
+    else
+        slow->name[0] = '\0';
+}
+
+/** @This records the lateness of a timer.
+ *
+ * @param trace pointer to trace structure
+ * @param lateness difference between the dispatch and the deadline, in
+ * 27 MHz ticks (negative if the timer fired early)
+ */
+void upump_trace_timer(struct upump_trace *trace, int64_t lateness)
+{
+    if (lateness < 0) {
+        trace->early++;
+        lateness = 0;
+    }
+    upump_trace_hist_add(&trace->lateness, lateness);
+}
+
+/** @This returns a slow dispatch from the ring, from the most recent.
+ *
+ * @param trace pointer to trace structure
+ * @param index index of the dispatch, 0 being the most recent
+ * @return pointer to the dispatch, or NULL if there is no such dispatch
+ */
+const struct upump_trace_slow *upump_trace_get_slow(struct upump_trace *trace,
+                                                    unsigned int index)
+{
+    if (index >= UPUMP_TRACE_SLOW || index >= trace->nb_slow)
+        return NULL;
+    return &trace->slow[(trace->nb_slow - 1 - index) % UPUMP_TRACE_SLOW];
+}
+
+/** @This is a name function for pumps whose opaque is the pipe owning
+ * them, which is the case of the pumps allocated by upipe modules. It
+ * returns the name given by the first prefix probe of the pipe.
+ *
+ * @param opaque pipe owning the pump
+ * @param name filled in with the name
+ * @param size size of name
+ */
+void upump_trace_upipe_name(void *opaque, char *name, size_t size)
+{
+    struct upipe *upipe = opaque;
+    struct uprobe *uprobe = upipe->uprobe;
+    const char *prefix = NULL;
+
+    while (uprobe != NULL && prefix == NULL) {
+        prefix = uprobe_pfx_get_name(uprobe);
+        uprobe = uprobe->next;
+    }
+
+    snprintf(name, size, "%s (%4.4s)", prefix ?: "",
+             (const char *)&upipe->mgr->signature);
+}
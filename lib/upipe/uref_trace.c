@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short trace stamps recording the path of sampled urefs through a graph
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_trace.h>
+
+#include <string.h>
+#include <time.h>
+
+UREF_ATTR_OPAQUE(trace, stamps, "x.trace", trace stamps)
+
+/** @This returns the date of the monotonic clock used by the stamps.
+ *
+ * @return date in 27 MHz ticks
+ */
+uint64_t uref_trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UCLOCK_FREQ +
+           (uint64_t)ts.tv_nsec * UCLOCK_FREQ / UINT64_C(1000000000);
+}
+
+/** @This starts tracing a uref, discarding previous stamps if any.
+ *
+ * @param uref pointer to the uref
+ * @return an error code
+ */
+int uref_trace_start(struct uref *uref)
+{
+    uref_trace_delete_stamps(uref);
+    uref->flags |= UREF_FLAG_TRACE;
+    return UBASE_ERR_NONE;
+}
+
+/** @This stops tracing a uref and deletes its stamps.
+ *
+ * @param uref pointer to the uref
+ */
+void uref_trace_stop(struct uref *uref)
+{
+    uref->flags &= ~UREF_FLAG_TRACE;
+    uref_trace_delete_stamps(uref);
+}
+
+/** @This copies the stamps of a traced uref.
+ *
+ * @param uref pointer to the uref
+ * @param stamps filled in with the stamps
+ * @param nb_p filled in with the number of stamps
+ * @return an error code
+ */
+int uref_trace_get(struct uref *uref,
+                   struct uref_trace_stamp stamps[UREF_TRACE_STAMPS],
+                   size_t *nb_p)
+{
+    const uint8_t *v;
+    size_t size;
+    if (!uref_trace_check(uref))
+        return UBASE_ERR_INVALID;
+    if (!ubase_check(uref_trace_get_stamps(uref, &v, &size))) {
+        *nb_p = 0;
+        return UBASE_ERR_NONE;
+    }
+    if (unlikely(size % sizeof(struct uref_trace_stamp) ||
+                 size > UREF_TRACE_STAMPS * sizeof(struct uref_trace_stamp)))
+        return UBASE_ERR_INVALID;
+    /* the attribute may not be aligned */
+    memcpy(stamps, v, size);
+    *nb_p = size / sizeof(struct uref_trace_stamp);
+    return UBASE_ERR_NONE;
+}
+
+/** @This traces a uref with the stamps of a traced uref, unless it is
+ * already traced.
+ *
+ * @param uref pointer to the uref
+ * @param uref_from pointer to the traced uref
+ * @return an error code
+ */
+int uref_trace_import(struct uref *uref, struct uref *uref_from)
+{
+    const uint8_t *v;
+    size_t size;
+    if (!uref_trace_check(uref_from) || uref_trace_check(uref))
+        return UBASE_ERR_NONE;
+    uref->flags |= UREF_FLAG_TRACE;
+    if (!ubase_check(uref_trace_get_stamps(uref_from, &v, &size)))
+        return UBASE_ERR_NONE;
+    return uref_trace_set_stamps(uref, v, size);
+}
+
+/** @internal @This appends a stamp to a traced uref.
+ *
+ * @param uref pointer to the uref
+ * @param signature signature of the manager of the pipe
+ */
+void uref_trace_stamp(struct uref *uref, uint32_t signature)
+{
+    struct uref_trace_stamp stamps[UREF_TRACE_STAMPS];
+    size_t nb;
+    if (unlikely(!ubase_check(uref_trace_get(uref, stamps, &nb)) ||
+                 nb >= UREF_TRACE_STAMPS))
+        return;
+    stamps[nb].signature = signature;
+    stamps[nb].reserved = 0;
+    stamps[nb].date = uref_trace_now();
+    nb++;
+    uref_trace_set_stamps(uref, (const uint8_t *)stamps,
+                          nb * sizeof(struct uref_trace_stamp));
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/** @file
+ * @short shared memory segment exporting counters of a live process
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/ustats.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @This creates a stats segment.
+ *
+ * @param name name of the shared memory object, or NULL for
+ * "/upipe-<pid>"
+ * @param nb_records number of records, or 0 for the default
+ * @return pointer to the segment, or NULL in case of error
+ */
+struct ustats *ustats_create(const char *name, unsigned int nb_records)
+{
+    if (!nb_records)
+        nb_records = USTATS_DEFAULT_RECORDS;
+
+    struct ustats *ustats = malloc(sizeof(struct ustats));
+    if (unlikely(ustats == NULL))
+        return NULL;
+    if (name != NULL)
+        ustats->name = strdup(name);
+    else if (asprintf(&ustats->name, "/upipe-%u",
+                      (unsigned int)getpid()) == -1)
+        ustats->name = NULL;
+    if (unlikely(ustats->name == NULL)) {
+        free(ustats);
+        return NULL;
+    }
+
+    ustats->size = sizeof(struct ustats_header) +
+                   nb_records * sizeof(struct ustats_record);
+    int fd = shm_open(ustats->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (unlikely(fd == -1))
+        goto ustats_create_err;
+    if (unlikely(ftruncate(fd, ustats->size) == -1)) {
+        close(fd);
+        shm_unlink(ustats->name);
+        goto ustats_create_err;
+    }
+    ustats->header = mmap(NULL, ustats->size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+    close(fd);
+    if (unlikely(ustats->header == MAP_FAILED)) {
+        shm_unlink(ustats->name);
+        goto ustats_create_err;
+    }
+
+    /* the segment is zeroed by ftruncate() */
+    ustats->header->version = USTATS_VERSION;
+    ustats->header->nb_records = nb_records;
+    ustats->header->pid = getpid();
+    __atomic_store_n(&ustats->header->magic, USTATS_MAGIC, __ATOMIC_RELEASE);
+    return ustats;
+
+ustats_create_err:
+    free(ustats->name);
+    free(ustats);
+    return NULL;
+}
+
+/** @This maps an existing stats segment read-only.
+ *
+ * @param name name of the shared memory object
+ * @return pointer to the segment, or NULL in case of error
+ */
+struct ustats *ustats_attach(const char *name)
+{
+    struct ustats *ustats = malloc(sizeof(struct ustats));
+    if (unlikely(ustats == NULL))
+        return NULL;
+    ustats->name = NULL;
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (unlikely(fd == -1)) {
+        free(ustats);
+        return NULL;
+    }
+    struct stat st;
+    if (unlikely(fstat(fd, &st) == -1 ||
+                 st.st_size < sizeof(struct ustats_header))) {
+        close(fd);
+        free(ustats);
+        return NULL;
+    }
+    ustats->size = st.st_size;
+    ustats->header = mmap(NULL, ustats->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (unlikely(ustats->header == MAP_FAILED)) {
+        free(ustats);
+        return NULL;
+    }
+
+    struct ustats_header *header = ustats->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != USTATS_MAGIC ||
+        header->version != USTATS_VERSION ||
+        sizeof(struct ustats_header) +
+            header->nb_records * sizeof(struct ustats_record) > ustats->size) {
+        munmap(ustats->header, ustats->size);
+        free(ustats);
+        return NULL;
+    }
+    return ustats;
+}
+
+/** @This unmaps a stats segment, and removes it if it was created by
+ * this process.
+ *
+ * @param ustats pointer to the segment
+ */
+void ustats_close(struct ustats *ustats)
+{
+    if (ustats == NULL)
+        return;
+    munmap(ustats->header, ustats->size);
+    if (ustats->name != NULL) {
+        shm_unlink(ustats->name);
+        free(ustats->name);
+    }
+    free(ustats);
+}
+
+/** @This registers a new record.
+ *
+ * @param ustats pointer to the segment, or NULL
+ * @param type type of record
+ * @param format printf-style format of the name, followed by optional
+ * arguments
+ * @return pointer to the record, or NULL if the segment is full
+ */
+struct ustats_record *ustats_register(struct ustats *ustats,
+                                      enum ustats_type type,
+                                      const char *format, ...)
+{
+    if (ustats == NULL || ustats->name == NULL)
+        return NULL;
+
+    struct ustats_header *header = ustats->header;
+    for (unsigned int i = 0; i < header->nb_records; i++) {
+        struct ustats_record *record = &header->records[i];
+        uint32_t expected = USTATS_FREE;
+        if (!__atomic_compare_exchange_n(&record->type, &expected,
+                                         USTATS_RESERVED, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            continue;
+
+        ustats_write_begin(record);
+        va_list args;
+        va_start(args, format);
+        vsnprintf(record->name, USTATS_NAME_SIZE, format, args);
+        va_end(args);
+        record->value = 0;
+        record->total = 0;
+        __atomic_store_n(&record->type, type, __ATOMIC_RELAXED);
+        ustats_write_end(record);
+        return record;
+    }
+    return NULL;
+}
+
+/** @This releases a record.
+ *
+ * @param record pointer to the record, or NULL
+ */
+void ustats_unregister(struct ustats_record *record)
+{
+    if (record == NULL)
+        return;
+    ustats_write_begin(record);
+    __atomic_store_n(&record->type, USTATS_FREE, __ATOMIC_RELAXED);
+    ustats_write_end(record);
+}
+
+/** @This reads a consistent copy of a record.
+ *
+ * @param ustats pointer to the segment
+ * @param index index of the record
+ * @param sample filled in with the copy
+ * @return an error code (UBASE_ERR_INVALID if the record is free,
+ * UBASE_ERR_BUSY if it is being written)
+ */
+int ustats_read(struct ustats *ustats, unsigned int index,
+                struct ustats_sample *sample)
+{
+    if (unlikely(index >= ustats->header->nb_records))
+        return UBASE_ERR_INVALID;
+    struct ustats_record *record = &ustats->header->records[index];
+
+    for (unsigned int retry = 0; retry < 64; retry++) {
+        uint32_t seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        uint32_t type = __atomic_load_n(&record->type, __ATOMIC_RELAXED);
+        if (type == USTATS_FREE || type == USTATS_RESERVED)
+            return UBASE_ERR_INVALID;
+        for (unsigned int i = 0; i < USTATS_NAME_SIZE; i++)
+            sample->name[i] = __atomic_load_n(&record->name[i],
+                                              __ATOMIC_RELAXED);
+        sample->value = __atomic_load_n(&record->value, __ATOMIC_RELAXED);
+        sample->total = __atomic_load_n(&record->total, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&record->seq, __ATOMIC_RELAXED) == seq) {
+            sample->type = type;
+            sample->name[USTATS_NAME_SIZE - 1] = '\0';
+            return UBASE_ERR_NONE;
+        }
+    }
+    return UBASE_ERR_BUSY;
+}
+
+/** @This registers a new record for a pipe, in the segment provided by the
+ * probe hierarchy (see @ref uprobe_ustats). The name of the record is the
+ * name of the first prefix probe of the pipe, or its signature, followed by
+ * a dot and the name of the metric.
+ *
+ * @param upipe description structure of the pipe
+ * @param type type of record
+ * @param metric name of the metric
+ * @return pointer to the record, or NULL if no segment is available
+ */
+struct ustats_record *upipe_ustats_register(struct upipe *upipe,
+                                            enum ustats_type type,
+                                            const char *metric)
+{
+    struct ustats *ustats = NULL;
+    if (!ubase_check(upipe_throw_need_ustats(upipe, &ustats)) ||
+        ustats == NULL)
+        return NULL;
+
+    struct uprobe *uprobe = upipe->uprobe;
+    const char *prefix = NULL;
+    while (uprobe != NULL && prefix == NULL) {
+        prefix = uprobe_pfx_get_name(uprobe);
+        uprobe = uprobe->next;
+    }
+    if (prefix != NULL)
+        return ustats_register(ustats, type, "%s.%s", prefix, metric);
+    return ustats_register(ustats, type, "%4.4s.%s",
+                           (const char *)&upipe->mgr->signature, metric);
+}
@@ -438,6 +438,13 @@ static int upump_ecore_mgr_control(struct upump_mgr *mgr,
         case UPUMP_MGR_VACUUM:
             upump_common_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UPUMP_MGR_SET_TRACE: {
+            /* only the durations of the callbacks are traced */
+            struct upump_common_mgr *common_mgr =
+                upump_common_mgr_from_upump_mgr(mgr);
+            common_mgr->trace = va_arg(args, struct upump_trace *);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -33,6 +33,7 @@
 #include <upipe/umutex.h>
 #include <upipe/upump.h>
 #include <upipe/upump_common.h>
+#include <upipe/upump_trace.h>
 #include <upump-ev/upump_ev.h>
 
 #include <stdlib.h>
@@ -50,6 +51,13 @@ struct upump_ev_mgr {
     /** true if the loop has to be destroyed at the end */
     bool destroy;
 
+    /** watcher called before the loop sleeps, when tracing */
+    struct ev_prepare ev_prepare;
+    /** watcher called when the loop wakes up, when tracing */
+    struct ev_check ev_check;
+    /** date of the beginning of the current iteration, or 0 */
+    uint64_t iteration_begin;
+
     /** common structure */
     struct upump_common_mgr common_mgr;
 
@@ -65,6 +73,8 @@ UBASE_FROM_TO(upump_ev_mgr, urefcount, urefcount, urefcount)
 struct upump_ev {
     /** type of event to watch */
     int event;
+    /** date of the next expiration of the timer, in ev time */
+    ev_tstamp deadline;
 
     /** ev private structure */
     union {
@@ -106,6 +116,15 @@ static void upump_ev_dispatch_timer(struct ev_loop *ev_loop,
     struct upump_ev *upump_ev = container_of(ev_timer, struct upump_ev,
                                              ev_timer);
     struct upump *upump = upump_ev_to_upump(upump_ev);
+    struct upump_ev_mgr *ev_mgr = upump_ev_mgr_from_upump_mgr(upump->mgr);
+    struct upump_trace *trace = ev_mgr->common_mgr.trace;
+    if (unlikely(trace != NULL)) {
+        upump_trace_timer(trace,
+                (ev_time() - upump_ev->deadline) * UCLOCK_FREQ);
+        if (ev_is_active(ev_timer))
+            upump_ev->deadline = ev_now(ev_loop) +
+                                 ev_timer_remaining(ev_loop, ev_timer);
+    }
     upump_common_dispatch(upump);
 }
 
@@ -211,6 +230,8 @@ static void upump_ev_real_start(struct upump *upump, bool status)
             break;
         case UPUMP_TYPE_TIMER:
             ev_timer_start(ev_mgr->ev_loop, &upump_ev->ev_timer);
+            upump_ev->deadline = ev_now(ev_mgr->ev_loop) +
+                ev_timer_remaining(ev_mgr->ev_loop, &upump_ev->ev_timer);
             break;
         case UPUMP_TYPE_FD_READ:
         case UPUMP_TYPE_FD_WRITE:
@@ -271,6 +292,8 @@ static void upump_ev_real_restart(struct upump *upump, bool status)
         case UPUMP_TYPE_TIMER: {
             bool active = ev_is_active(&upump_ev->ev_timer);
             ev_timer_again(ev_mgr->ev_loop, &upump_ev->ev_timer);
+            upump_ev->deadline = ev_now(ev_mgr->ev_loop) +
+                ev_timer_remaining(ev_mgr->ev_loop, &upump_ev->ev_timer);
             if (!active && !status)
                 ev_unref(ev_mgr->ev_loop);
             break;
@@ -389,6 +412,68 @@ static void upump_ev_mgr_unlock(struct ev_loop *loop)
     umutex_unlock(mutex);
 }
 
+/** @internal @This is called when the event loop wakes up, to record the
+ * beginning of an iteration.
+ *
+ * @param ev_loop current event loop (unused parameter)
+ * @param ev_check ev watcher
+ * @param revents events triggered (unused parameter)
+ */
+static void upump_ev_mgr_check(struct ev_loop *ev_loop,
+                               struct ev_check *ev_check, int revents)
+{
+    struct upump_ev_mgr *ev_mgr = container_of(ev_check, struct upump_ev_mgr,
+                                               ev_check);
+    ev_mgr->iteration_begin = upump_trace_now();
+}
+
+/** @internal @This is called before the event loop sleeps, to record the
+ * time spent processing the iteration.
+ *
+ * @param ev_loop current event loop (unused parameter)
+ * @param ev_prepare ev watcher
+ * @param revents events triggered (unused parameter)
+ */
+static void upump_ev_mgr_prepare(struct ev_loop *ev_loop,
+                                 struct ev_prepare *ev_prepare, int revents)
+{
+    struct upump_ev_mgr *ev_mgr = container_of(ev_prepare,
+                                               struct upump_ev_mgr,
+                                               ev_prepare);
+    if (ev_mgr->iteration_begin && ev_mgr->common_mgr.trace != NULL)
+        upump_trace_iteration(ev_mgr->common_mgr.trace,
+                              upump_trace_now() - ev_mgr->iteration_begin);
+    ev_mgr->iteration_begin = 0;
+}
+
+/** @internal @This starts or stops tracing the dispatches of the event loop.
+ * The watchers measuring the iterations don't keep the loop running.
+ *
+ * @param mgr pointer to a upump_mgr structure
+ * @param trace pointer to trace structure, or NULL to stop tracing
+ * @return an error code
+ */
+static int upump_ev_mgr_set_trace(struct upump_mgr *mgr,
+                                  struct upump_trace *trace)
+{
+    struct upump_ev_mgr *ev_mgr = upump_ev_mgr_from_upump_mgr(mgr);
+
+    if (trace != NULL && ev_mgr->common_mgr.trace == NULL) {
+        ev_mgr->iteration_begin = 0;
+        ev_prepare_start(ev_mgr->ev_loop, &ev_mgr->ev_prepare);
+        ev_unref(ev_mgr->ev_loop);
+        ev_check_start(ev_mgr->ev_loop, &ev_mgr->ev_check);
+        ev_unref(ev_mgr->ev_loop);
+    } else if (trace == NULL && ev_mgr->common_mgr.trace != NULL) {
+        ev_ref(ev_mgr->ev_loop);
+        ev_prepare_stop(ev_mgr->ev_loop, &ev_mgr->ev_prepare);
+        ev_ref(ev_mgr->ev_loop);
+        ev_check_stop(ev_mgr->ev_loop, &ev_mgr->ev_check);
+    }
+    ev_mgr->common_mgr.trace = trace;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This runs an event loop.
  *
  * @param mgr pointer to a upump_mgr structure
@@ -440,6 +525,10 @@ static int upump_ev_mgr_control(struct upump_mgr *mgr,
         case UPUMP_MGR_VACUUM:
             upump_common_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UPUMP_MGR_SET_TRACE: {
+            struct upump_trace *trace = va_arg(args, struct upump_trace *);
+            return upump_ev_mgr_set_trace(mgr, trace);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -452,6 +541,7 @@ static int upump_ev_mgr_control(struct upump_mgr *mgr,
 static void upump_ev_mgr_free(struct urefcount *urefcount)
 {
     struct upump_ev_mgr *ev_mgr = upump_ev_mgr_from_urefcount(urefcount);
+    upump_ev_mgr_set_trace(upump_ev_mgr_to_upump_mgr(ev_mgr), NULL);
     upump_common_mgr_clean(upump_ev_mgr_to_upump_mgr(ev_mgr));
     if (ev_mgr->destroy)
         ev_loop_destroy(ev_mgr->ev_loop);
@@ -492,6 +582,10 @@ struct upump_mgr *upump_ev_mgr_alloc(struct ev_loop *ev_loop,
 
     ev_mgr->ev_loop = ev_loop;
     ev_mgr->destroy = false;
+    ev_mgr->iteration_begin = 0;
+    ev_prepare_init(&ev_mgr->ev_prepare, upump_ev_mgr_prepare);
+    ev_check_init(&ev_mgr->ev_check, upump_ev_mgr_check);
+    ev_set_priority(&ev_mgr->ev_check, EV_MAXPRI);
     return mgr;
 }
 
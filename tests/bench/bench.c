@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks
+ *
+ * The results are printed on stdout as a JSON document:
+ * @code
+ * {"version": 1, "scale": 1, "results": [
+ *   {"name": "uref.alloc_free", "ops": 1000000, "bytes": 0, "ns": 25000000,
+ *    "ns_per_op": 25.00, "ops_per_sec": 40000000, "bytes_per_sec": 0},
+ *   ...
+ * ]}
+ * @endcode
+ * The names of the benchmarks and the keys are stable, so that the results
+ * can be compared across builds.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+
+/** shared managers */
+struct bench_env bench_env;
+
+/** scale of the number of iterations */
+static uint64_t scale = 1;
+/** benchmarks to run, or NULL for all */
+static const char *filter = NULL;
+/** number of reported results */
+static unsigned int nb_results = 0;
+
+/** list of benchmarks */
+static const struct {
+    /** name of the group of benchmarks */
+    const char *name;
+    /** function running the benchmarks */
+    void (*run)(void);
+} benches[] = {
+    { "uref", bench_uref },
+    { "ubuf", bench_ubuf },
+#ifdef HAVE_BENCH_THREAD
+    { "thread", bench_thread },
+#endif
+#ifdef HAVE_BENCH_TS
+    { "ts", bench_ts },
+#endif
+#ifdef HAVE_BENCH_UDP
+    { "udp", bench_udp },
+#endif
+};
+
+/** @This returns the date of the monotonic clock.
+ *
+ * @return date in nanoseconds
+ */
+uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @This returns the number of iterations of a benchmark, scaled by the
+ * command line.
+ *
+ * @param base number of iterations at scale 1
+ * @return number of iterations
+ */
+uint64_t bench_iterations(uint64_t base)
+{
+    return base * scale;
+}
+
+/** @This reports the result of a benchmark.
+ *
+ * @param name stable name of the benchmark
+ * @param ops number of operations
+ * @param bytes number of bytes processed, or 0
+ * @param ns duration in nanoseconds
+ */
+void bench_report(const char *name, uint64_t ops, uint64_t bytes, uint64_t ns)
+{
+    if (!ns)
+        ns = 1;
+    printf("%s\n    {\"name\": \"%s\", \"ops\": %"PRIu64", "
+           "\"bytes\": %"PRIu64", \"ns\": %"PRIu64", \"ns_per_op\": %.2f, "
+           "\"ops_per_sec\": %.0f, \"bytes_per_sec\": %.0f}",
+           nb_results ? "," : "", name, ops, bytes, ns,
+           ops ? (double)ns / ops : 0.,
+           (double)ops * 1000000000. / ns,
+           (double)bytes * 1000000000. / ns);
+    fflush(stdout);
+    nb_results++;
+}
+
+/** @internal @This is the private context of a sink pipe. */
+struct bench_sink {
+    /** number of urefs received */
+    uint64_t urefs;
+    /** number of bytes received */
+    uint64_t bytes;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(bench_sink, upipe, 0);
+
+/** @internal @This allocates a sink pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *bench_sink_alloc_inner(struct upipe_mgr *mgr,
+                                            struct uprobe *uprobe,
+                                            uint32_t signature, va_list args)
+{
+    struct bench_sink *sink = malloc(sizeof(struct bench_sink));
+    assert(sink != NULL);
+    sink->urefs = sink->bytes = 0;
+    upipe_init(&sink->upipe, mgr, uprobe);
+    return &sink->upipe;
+}
+
+/** @internal @This counts an incoming uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void bench_sink_input(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct bench_sink *sink = bench_sink_from_upipe(upipe);
+    size_t size;
+    sink->urefs++;
+    if (uref->ubuf != NULL && ubase_check(uref_block_size(uref, &size)))
+        sink->bytes += size;
+    uref_free(uref);
+}
+
+/** @internal @This processes control commands.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int bench_sink_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This is the management structure of sink pipes. */
+static struct upipe_mgr bench_sink_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('b','n','c','h'),
+    .upipe_alloc = bench_sink_alloc_inner,
+    .upipe_input = bench_sink_input,
+    .upipe_control = bench_sink_control
+};
+
+/** @This allocates a sink pipe counting the urefs and bytes it receives.
+ * The pipe is not refcounted and must be freed with @ref bench_sink_free.
+ *
+ * @return pointer to pipe
+ */
+struct upipe *bench_sink_alloc(void)
+{
+    return upipe_void_alloc(&bench_sink_mgr, uprobe_use(bench_env.uprobe));
+}
+
+/** @This frees a sink pipe.
+ *
+ * @param upipe sink pipe
+ */
+void bench_sink_free(struct upipe *upipe)
+{
+    struct bench_sink *sink = bench_sink_from_upipe(upipe);
+    upipe_clean(upipe);
+    free(sink);
+}
+
+/** @This returns the counters of a sink pipe.
+ *
+ * @param upipe sink pipe
+ * @param urefs_p filled in with the number of urefs received
+ * @param bytes_p filled in with the number of bytes received
+ */
+void bench_sink_get(struct upipe *upipe, uint64_t *urefs_p,
+                    uint64_t *bytes_p)
+{
+    struct bench_sink *sink = bench_sink_from_upipe(upipe);
+    *urefs_p = sink->urefs;
+    *bytes_p = sink->bytes;
+}
+
+/** @internal @This catches the events which are not logs. */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    return UBASE_ERR_NONE;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-s <scale>] [-f <benchmark>] [-t <ts file>]\n",
+            argv0);
+    fprintf(stderr, "Benchmarks:");
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(benches); i++)
+        fprintf(stderr, " %s", benches[i].name);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    bench_env.ts_file = "upipe_ts_test.ts";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:f:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                scale = strtoull(optarg, NULL, 10);
+                if (!scale)
+                    usage(argv[0]);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 't':
+                bench_env.ts_file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc)
+        usage(argv[0]);
+
+    bench_env.umem_mgr = umem_pool_mgr_alloc_simple(BENCH_POOL_DEPTH);
+    assert(bench_env.umem_mgr != NULL);
+    bench_env.udict_mgr = udict_inline_mgr_alloc(BENCH_POOL_DEPTH,
+                                                 bench_env.umem_mgr, -1, -1);
+    assert(bench_env.udict_mgr != NULL);
+    bench_env.uref_mgr = uref_std_mgr_alloc(BENCH_POOL_DEPTH,
+                                            bench_env.udict_mgr, 0);
+    assert(bench_env.uref_mgr != NULL);
+    bench_env.ubuf_mgr = ubuf_block_mem_mgr_alloc(BENCH_POOL_DEPTH,
+                                                  BENCH_POOL_DEPTH,
+                                                  bench_env.umem_mgr,
+                                                  0, 0, -1, 0);
+    assert(bench_env.ubuf_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(uprobe_use(&uprobe), stderr,
+                                               UPROBE_LOG_ERROR);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, bench_env.uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, bench_env.umem_mgr,
+                                   BENCH_POOL_DEPTH, BENCH_POOL_DEPTH);
+    assert(logger != NULL);
+    bench_env.uprobe = logger;
+
+    printf("{\"version\": 1, \"scale\": %"PRIu64", \"results\": [", scale);
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(benches); i++)
+        if (filter == NULL || !strcmp(filter, benches[i].name))
+            benches[i].run();
+    printf("\n]}\n");
+
+    uprobe_release(bench_env.uprobe);
+    uprobe_clean(&uprobe);
+    ubuf_mgr_release(bench_env.ubuf_mgr);
+    uref_mgr_release(bench_env.uref_mgr);
+    udict_mgr_release(bench_env.udict_mgr);
+    umem_mgr_release(bench_env.umem_mgr);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - common definitions
+ */
+
+#ifndef _TESTS_BENCH_BENCH_H_
+#define _TESTS_BENCH_BENCH_H_
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** @hidden */
+struct umem_mgr;
+/** @hidden */
+struct udict_mgr;
+/** @hidden */
+struct uref_mgr;
+/** @hidden */
+struct ubuf_mgr;
+/** @hidden */
+struct uprobe;
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct upipe_mgr;
+
+/** depth of the pools of the managers */
+#define BENCH_POOL_DEPTH 64
+
+/** @This stores the managers shared by the benchmarks. */
+struct bench_env {
+    /** memory allocator */
+    struct umem_mgr *umem_mgr;
+    /** dictionary manager */
+    struct udict_mgr *udict_mgr;
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** block buffer manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** probe answering the requests of the pipes, and only logging errors */
+    struct uprobe *uprobe;
+    /** path of the transport stream sample */
+    const char *ts_file;
+};
+
+/** shared managers */
+extern struct bench_env bench_env;
+
+/** @This returns the date of the monotonic clock.
+ *
+ * @return date in nanoseconds
+ */
+uint64_t bench_now(void);
+
+/** @This returns the number of iterations of a benchmark, scaled by the
+ * command line.
+ *
+ * @param base number of iterations at scale 1
+ * @return number of iterations
+ */
+uint64_t bench_iterations(uint64_t base);
+
+/** @This reports the result of a benchmark.
+ *
+ * @param name stable name of the benchmark
+ * @param ops number of operations
+ * @param bytes number of bytes processed, or 0
+ * @param ns duration in nanoseconds
+ */
+void bench_report(const char *name, uint64_t ops, uint64_t bytes, uint64_t ns);
+
+/** @This allocates a sink pipe counting the urefs and bytes it receives.
+ * The pipe is not refcounted and must be freed with @ref bench_sink_free.
+ *
+ * @return pointer to pipe
+ */
+struct upipe *bench_sink_alloc(void);
+
+/** @This frees a sink pipe.
+ *
+ * @param upipe sink pipe
+ */
+void bench_sink_free(struct upipe *upipe);
+
+/** @This returns the counters of a sink pipe.
+ *
+ * @param upipe sink pipe
+ * @param urefs_p filled in with the number of urefs received
+ * @param bytes_p filled in with the number of bytes received
+ */
+void bench_sink_get(struct upipe *upipe, uint64_t *urefs_p,
+                    uint64_t *bytes_p);
+
+/** @This runs the uref and udict benchmarks. */
+void bench_uref(void);
+/** @This runs the block ubuf benchmarks. */
+void bench_ubuf(void);
+#ifdef HAVE_BENCH_THREAD
+/** @This runs the uqueue and upool benchmarks. */
+void bench_thread(void);
+#endif
+#ifdef HAVE_BENCH_TS
+/** @This runs the TS demux and mux benchmarks. */
+void bench_ts(void);
+#endif
+#ifdef HAVE_BENCH_UDP
+/** @This runs the UDP loopback benchmark. */
+void bench_udp(void);
+#endif
+
+#endif
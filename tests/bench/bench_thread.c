@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - uqueue and upool across threads
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uqueue.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+/** length of the queues */
+#define QUEUE_LENGTH 16
+/** number of round trips at scale 1 */
+#define PING_PONG 200000
+/** number of allocations per thread at scale 1 */
+#define ALLOCS 1000000
+/** maximum number of contending threads */
+#define MAX_THREADS 4
+
+/** queue from the main thread to the echo thread */
+static struct uqueue ping;
+/** queue from the echo thread to the main thread */
+static struct uqueue pong;
+
+/** @internal @This sends back the elements it receives, until it receives
+ * the address of ping. */
+static void *bench_echo(void *unused)
+{
+    for ( ; ; ) {
+        void *element;
+        while ((element = uqueue_pop(&ping, void *)) == NULL)
+            sched_yield();
+        while (!uqueue_push(&pong, element))
+            sched_yield();
+        if (element == &ping)
+            return NULL;
+    }
+}
+
+/** @This measures round trips of an element between two threads, through
+ * two uqueues. */
+static void bench_uqueue_ping_pong(void)
+{
+    void *ping_extra = malloc(uqueue_sizeof(QUEUE_LENGTH));
+    void *pong_extra = malloc(uqueue_sizeof(QUEUE_LENGTH));
+    assert(ping_extra != NULL && pong_extra != NULL);
+    assert(uqueue_init(&ping, QUEUE_LENGTH, ping_extra));
+    assert(uqueue_init(&pong, QUEUE_LENGTH, pong_extra));
+
+    pthread_t thread;
+    assert(!pthread_create(&thread, NULL, bench_echo, NULL));
+
+    uint64_t nb = bench_iterations(PING_PONG);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        while (!uqueue_push(&ping, &pong))
+            sched_yield();
+        while (uqueue_pop(&pong, void *) == NULL)
+            sched_yield();
+    }
+    uint64_t end = bench_now();
+
+    while (!uqueue_push(&ping, &ping))
+        sched_yield();
+    while (uqueue_pop(&pong, void *) == NULL)
+        sched_yield();
+    assert(!pthread_join(thread, NULL));
+    bench_report("uqueue.ping_pong", nb, 0, end - begin);
+
+    uqueue_clean(&ping);
+    uqueue_clean(&pong);
+    free(ping_extra);
+    free(pong_extra);
+}
+
+/** uref manager shared by the contending threads */
+static struct uref_mgr *contended_mgr;
+
+/** @internal @This allocates and frees urefs from the shared manager. */
+static void *bench_contend(void *unused)
+{
+    uint64_t nb = bench_iterations(ALLOCS);
+    for (uint64_t i = 0; i < nb; i++) {
+        struct uref *uref = uref_alloc(contended_mgr);
+        assert(uref != NULL);
+        uref_free(uref);
+    }
+    return NULL;
+}
+
+/** @This measures the allocations of urefs from a pool shared by several
+ * threads.
+ *
+ * @param nb_threads number of contending threads
+ */
+static void bench_upool_contention(unsigned int nb_threads)
+{
+    contended_mgr = uref_std_mgr_alloc(BENCH_POOL_DEPTH,
+                                       bench_env.udict_mgr, 0);
+    assert(contended_mgr != NULL);
+
+    pthread_t threads[nb_threads];
+    uint64_t begin = bench_now();
+    for (unsigned int i = 0; i < nb_threads; i++)
+        assert(!pthread_create(&threads[i], NULL, bench_contend, NULL));
+    for (unsigned int i = 0; i < nb_threads; i++)
+        assert(!pthread_join(threads[i], NULL));
+    uint64_t end = bench_now();
+
+    char name[64];
+    snprintf(name, sizeof(name), "upool.contention.%u", nb_threads);
+    bench_report(name, bench_iterations(ALLOCS) * nb_threads, 0,
+                 end - begin);
+    uref_mgr_release(contended_mgr);
+}
+
+/** @This runs the uqueue and upool benchmarks. */
+void bench_thread(void)
+{
+    bench_uqueue_ping_pong();
+    for (unsigned int i = 1; i <= MAX_THREADS; i *= 2)
+        bench_upool_contention(i);
+}
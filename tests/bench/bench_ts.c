@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - TS demux and mux
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_sound_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/** size of a TS packet */
+#define PACKET_SIZE 188
+/** number of packets per uref, as in a UDP datagram */
+#define PACKETS_PER_UREF 7
+/** number of loops over the sample at scale 1 */
+#define DEMUX_LOOPS 200
+/** maximum number of sub pipes allocated on the demux */
+#define MAX_SUBS 64
+/** numbers of inputs of the mux */
+static const unsigned int mux_inputs[] = { 1, 8, 32 };
+/** number of frames per mux input at scale 1 */
+#define MUX_FRAMES 2000
+/** octet rate of a mux input (MPEG-1 layer 2 at 192 kbits/s) */
+#define MUX_OCTETRATE 24000
+/** number of samples of an audio frame */
+#define MUX_SAMPLES 1152
+/** sample rate of the mux inputs */
+#define MUX_RATE 48000
+/** size of an audio frame */
+#define MUX_FRAME_SIZE (MUX_OCTETRATE * MUX_SAMPLES / MUX_RATE)
+
+/** sub pipes allocated on the demux */
+static struct upipe *subs[MAX_SUBS];
+/** number of sub pipes allocated on the demux */
+static unsigned int nb_subs;
+/** sink of the demux outputs */
+static struct upipe *demux_sink;
+/** probe catching the events of the demux programs */
+static struct uprobe uprobe_program;
+
+/** @internal @This allocates a sub pipe for each new flow of a split pipe.
+ *
+ * @param upipe split pipe
+ * @param uprobe probe given to the sub pipes
+ */
+static void bench_ts_split_update(struct upipe *upipe, struct uprobe *uprobe)
+{
+    struct uref *flow_def = NULL;
+    while (ubase_check(upipe_split_iterate(upipe, &flow_def)) &&
+           flow_def != NULL) {
+        uint64_t flow_id;
+        if (!ubase_check(uref_flow_get_id(flow_def, &flow_id)))
+            continue;
+
+        struct upipe *sub = NULL;
+        bool found = false;
+        while (ubase_check(upipe_iterate_sub(upipe, &sub)) && sub != NULL) {
+            struct uref *flow_def2;
+            uint64_t id2;
+            if (ubase_check(upipe_get_flow_def(sub, &flow_def2)) &&
+                ubase_check(uref_flow_get_id(flow_def2, &id2)) &&
+                flow_id == id2) {
+                found = true;
+                break;
+            }
+        }
+        if (found || nb_subs >= MAX_SUBS)
+            continue;
+
+        sub = upipe_flow_alloc_sub(upipe, uprobe_use(uprobe), flow_def);
+        if (sub == NULL)
+            continue;
+        if (uprobe != &uprobe_program)
+            upipe_set_output(sub, demux_sink);
+        subs[nb_subs++] = sub;
+    }
+}
+
+/** @internal @This catches the events of the demux and its programs. */
+static int bench_ts_catch(struct uprobe *uprobe, struct upipe *upipe,
+                          int event, va_list args)
+{
+    if (event == UPROBE_SPLIT_UPDATE) {
+        bench_ts_split_update(upipe, uprobe == &uprobe_program ?
+                              bench_env.uprobe : &uprobe_program);
+        return UBASE_ERR_NONE;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** @This measures ts_sync and ts_demux on the sample looped in memory. */
+static void bench_ts_demux(void)
+{
+    FILE *file = fopen(bench_env.ts_file, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to open %s\n", bench_env.ts_file);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned int nb_urefs = size / (PACKET_SIZE * PACKETS_PER_UREF);
+    assert(nb_urefs);
+
+    struct uref *urefs[nb_urefs];
+    for (unsigned int i = 0; i < nb_urefs; i++) {
+        urefs[i] = uref_block_alloc(bench_env.uref_mgr, bench_env.ubuf_mgr,
+                                    PACKET_SIZE * PACKETS_PER_UREF);
+        assert(urefs[i] != NULL);
+        uint8_t *buffer;
+        int buffer_size = -1;
+        ubase_assert(uref_block_write(urefs[i], 0, &buffer_size, &buffer));
+        assert(fread(buffer, buffer_size, 1, file) == 1);
+        ubase_assert(uref_block_unmap(urefs[i], 0));
+    }
+    fclose(file);
+
+    struct uprobe uprobe_demux;
+    uprobe_init(&uprobe_demux, bench_ts_catch, uprobe_use(bench_env.uprobe));
+    uprobe_init(&uprobe_program, bench_ts_catch,
+                uprobe_use(bench_env.uprobe));
+    demux_sink = bench_sink_alloc();
+    nb_subs = 0;
+
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    assert(upipe_ts_demux_mgr != NULL);
+    struct upipe *demux = upipe_void_alloc(upipe_ts_demux_mgr,
+                                           uprobe_use(&uprobe_demux));
+    assert(demux != NULL);
+    upipe_mgr_release(upipe_ts_demux_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench_env.uref_mgr,
+                                                      "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(demux, flow_def));
+    uref_free(flow_def);
+
+    uint64_t nb = bench_iterations(DEMUX_LOOPS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++)
+        for (unsigned int j = 0; j < nb_urefs; j++)
+            upipe_input(demux, uref_dup(urefs[j]), NULL);
+    uint64_t end = bench_now();
+
+    uint64_t out_urefs, out_bytes;
+    bench_sink_get(demux_sink, &out_urefs, &out_bytes);
+    assert(out_urefs);
+    bench_report("ts_demux.sample", nb * nb_urefs * PACKETS_PER_UREF,
+                 nb * nb_urefs * PACKETS_PER_UREF * PACKET_SIZE,
+                 end - begin);
+
+    /* outputs before programs */
+    while (nb_subs)
+        upipe_release(subs[--nb_subs]);
+    upipe_release(demux);
+    bench_sink_free(demux_sink);
+    uprobe_clean(&uprobe_program);
+    uprobe_clean(&uprobe_demux);
+    for (unsigned int i = 0; i < nb_urefs; i++)
+        uref_free(urefs[i]);
+}
+
+/** @This measures ts_mux with audio inputs in file mode.
+ *
+ * @param nb_inputs number of inputs
+ */
+static void bench_ts_mux_inputs(unsigned int nb_inputs)
+{
+    struct upipe *sink = bench_sink_alloc();
+    struct upipe_mgr *upipe_ts_mux_mgr = upipe_ts_mux_mgr_alloc();
+    assert(upipe_ts_mux_mgr != NULL);
+    struct upipe *mux = upipe_void_alloc(upipe_ts_mux_mgr,
+                                         uprobe_use(bench_env.uprobe));
+    assert(mux != NULL);
+    upipe_mgr_release(upipe_ts_mux_mgr);
+    ubase_assert(upipe_set_output(mux, sink));
+
+    struct uref *flow_def = uref_alloc_control(bench_env.uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(uref_flow_set_def(flow_def, "void."));
+    ubase_assert(upipe_set_flow_def(mux, flow_def));
+    struct upipe *program = upipe_void_alloc_sub(mux,
+                                                 uprobe_use(bench_env.uprobe));
+    assert(program != NULL);
+    ubase_assert(upipe_set_flow_def(program, flow_def));
+    uref_free(flow_def);
+
+    flow_def = uref_block_flow_alloc_def(bench_env.uref_mgr, "mp2.sound.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(flow_def, MUX_OCTETRATE));
+    ubase_assert(uref_sound_flow_set_rate(flow_def, MUX_RATE));
+    ubase_assert(uref_sound_flow_set_samples(flow_def, MUX_SAMPLES));
+    struct upipe *inputs[nb_inputs];
+    for (unsigned int i = 0; i < nb_inputs; i++) {
+        inputs[i] = upipe_void_alloc_sub(program,
+                                         uprobe_use(bench_env.uprobe));
+        assert(inputs[i] != NULL);
+        ubase_assert(upipe_set_flow_def(inputs[i], flow_def));
+    }
+    uref_free(flow_def);
+
+    struct uref *frame = uref_block_alloc(bench_env.uref_mgr,
+                                          bench_env.ubuf_mgr,
+                                          MUX_FRAME_SIZE);
+    assert(frame != NULL);
+    uint64_t duration = (uint64_t)MUX_SAMPLES * UCLOCK_FREQ / MUX_RATE;
+    uref_clock_set_duration(frame, duration);
+    uref_clock_set_dts_pts_delay(frame, 0);
+    uref_clock_set_cr_dts_delay(frame, 0);
+
+    uint64_t nb = bench_iterations(MUX_FRAMES);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        /* start after the initial mux delay */
+        uint64_t date = UCLOCK_FREQ + i * duration;
+        for (unsigned int j = 0; j < nb_inputs; j++) {
+            struct uref *uref = uref_dup(frame);
+            assert(uref != NULL);
+            uref_clock_set_dts_prog(uref, date);
+            uref_clock_set_dts_sys(uref, date);
+            upipe_input(inputs[j], uref, NULL);
+        }
+    }
+    uint64_t end = bench_now();
+
+    uint64_t out_urefs, out_bytes;
+    bench_sink_get(sink, &out_urefs, &out_bytes);
+    char name[64];
+    snprintf(name, sizeof(name), "ts_mux.inputs.%u", nb_inputs);
+    bench_report(name, nb * nb_inputs, out_bytes, end - begin);
+
+    uref_free(frame);
+    for (unsigned int i = 0; i < nb_inputs; i++)
+        upipe_release(inputs[i]);
+    upipe_release(program);
+    upipe_release(mux);
+    bench_sink_free(sink);
+}
+
+/** @This runs the TS demux and mux benchmarks. */
+void bench_ts(void)
+{
+    bench_ts_demux();
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(mux_inputs); i++)
+        bench_ts_mux_inputs(mux_inputs[i]);
+}
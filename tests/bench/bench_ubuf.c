@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - block ubuf
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+
+#include "bench.h"
+
+#include <string.h>
+#include <assert.h>
+
+/** size of a TS packet */
+#define PACKET_SIZE 188
+/** number of packets per chain */
+#define CHAIN_LENGTH 64
+/** number of chains at scale 1 */
+#define ITERATIONS 10000
+
+/** @This allocates a block of TS packets with a sync byte each.
+ *
+ * @param nb number of packets
+ * @return pointer to ubuf
+ */
+static struct ubuf *bench_ubuf_packets(unsigned int nb)
+{
+    struct ubuf *ubuf = ubuf_block_alloc(bench_env.ubuf_mgr,
+                                         nb * PACKET_SIZE);
+    assert(ubuf != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(ubuf_block_write(ubuf, 0, &size, &buffer));
+    memset(buffer, 0xff, size);
+    for (unsigned int i = 0; i < nb; i++)
+        buffer[i * PACKET_SIZE] = 0x47;
+    ubase_assert(ubuf_block_unmap(ubuf, 0));
+    return ubuf;
+}
+
+/** @This builds chains of packets by appending them. */
+static void bench_ubuf_append(void)
+{
+    struct ubuf *packet = bench_ubuf_packets(1);
+    uint64_t nb = bench_iterations(ITERATIONS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        struct ubuf *chain = ubuf_dup(packet);
+        assert(chain != NULL);
+        for (unsigned int j = 1; j < CHAIN_LENGTH; j++) {
+            struct ubuf *append = ubuf_dup(packet);
+            assert(append != NULL);
+            ubase_assert(ubuf_block_append(chain, append));
+        }
+        ubuf_free(chain);
+    }
+    bench_report("ubuf_block.append", nb * CHAIN_LENGTH,
+                 nb * CHAIN_LENGTH * PACKET_SIZE, bench_now() - begin);
+    ubuf_free(packet);
+}
+
+/** @This splices packets out of a chain of segments which are not aligned
+ * on packets. */
+static void bench_ubuf_splice(void)
+{
+    /* segments of 7 packets and a half */
+    struct ubuf *chain = bench_ubuf_packets(CHAIN_LENGTH);
+    for (unsigned int i = 1; i < CHAIN_LENGTH / 7; i++) {
+        struct ubuf *segment = ubuf_block_alloc(bench_env.ubuf_mgr,
+                                                7 * PACKET_SIZE +
+                                                PACKET_SIZE / 2);
+        assert(segment != NULL);
+        ubase_assert(ubuf_block_append(chain, segment));
+    }
+    size_t total;
+    ubase_assert(ubuf_block_size(chain, &total));
+    unsigned int nb_packets = total / PACKET_SIZE;
+
+    uint64_t nb = bench_iterations(ITERATIONS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        for (unsigned int j = 0; j < nb_packets; j++) {
+            struct ubuf *packet = ubuf_block_splice(chain, j * PACKET_SIZE,
+                                                    PACKET_SIZE);
+            assert(packet != NULL);
+            ubuf_free(packet);
+        }
+    }
+    bench_report("ubuf_block.splice", nb * nb_packets,
+                 nb * nb_packets * PACKET_SIZE, bench_now() - begin);
+    ubuf_free(chain);
+}
+
+/** @This scans a chain of segments for sync bytes. */
+static void bench_ubuf_scan(void)
+{
+    struct ubuf *chain = bench_ubuf_packets(CHAIN_LENGTH);
+    for (unsigned int i = 1; i < 8; i++) {
+        struct ubuf *segment = bench_ubuf_packets(CHAIN_LENGTH);
+        ubase_assert(ubuf_block_append(chain, segment));
+    }
+    size_t total;
+    ubase_assert(ubuf_block_size(chain, &total));
+
+    uint64_t nb = bench_iterations(ITERATIONS / 10);
+    uint64_t found = 0;
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        size_t offset = 0;
+        while (ubase_check(ubuf_block_scan(chain, &offset, 0x47))) {
+            found++;
+            offset++;
+        }
+    }
+    bench_report("ubuf_block.scan", nb, nb * total, bench_now() - begin);
+    assert(found == nb * total / PACKET_SIZE);
+    ubuf_free(chain);
+}
+
+/** @This runs the block ubuf benchmarks. */
+void bench_ubuf(void)
+{
+    bench_ubuf_append();
+    bench_ubuf_splice();
+    bench_ubuf_scan();
+}
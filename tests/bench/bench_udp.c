@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - udpsrc to udpsink over loopback
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-modules/upipe_udp_source.h>
+#include <upipe-modules/upipe_udp_sink.h>
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** size of a datagram */
+#define DATAGRAM_SIZE 1316
+/** number of datagrams at scale 1 */
+#define DATAGRAMS 100000
+/** number of datagrams sent per idler callback */
+#define BURST 16
+/** interval between two checks of the reception */
+#define CHECK_INTERVAL (UCLOCK_FREQ / 100)
+/** number of tries to find a free port */
+#define PORT_TRIES 10
+
+/** udp source */
+static struct upipe *udpsrc;
+/** udp sink */
+static struct upipe *udpsink;
+/** sink counting the received datagrams */
+static struct upipe *sink;
+/** datagram sent */
+static struct uref *datagram;
+/** number of datagrams to send */
+static uint64_t nb_datagrams;
+/** number of datagrams sent */
+static uint64_t nb_sent;
+/** number of datagrams received at the last check */
+static uint64_t nb_received;
+/** date of the last datagram received */
+static uint64_t last_received;
+
+/** @internal @This sends a burst of datagrams. */
+static void bench_udp_send(struct upump *upump)
+{
+    for (unsigned int i = 0; i < BURST && nb_sent < nb_datagrams; i++) {
+        upipe_input(udpsink, uref_dup(datagram), NULL);
+        nb_sent++;
+    }
+    if (nb_sent >= nb_datagrams)
+        upump_stop(upump);
+}
+
+/** @internal @This stops the source once all datagrams were sent and no
+ * datagram was received since the last check. */
+static void bench_udp_check(struct upump *upump)
+{
+    uint64_t urefs, bytes;
+    bench_sink_get(sink, &urefs, &bytes);
+    if (urefs != nb_received) {
+        nb_received = urefs;
+        last_received = bench_now();
+    } else if (nb_sent >= nb_datagrams) {
+        upipe_set_uri(udpsrc, NULL);
+        upump_stop(upump);
+    }
+}
+
+/** @This measures datagrams sent by udpsink and received by udpsrc over the
+ * loopback interface. */
+void bench_udp(void)
+{
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_loop(0, 0);
+    assert(upump_mgr != NULL);
+    struct uprobe *uprobe =
+        uprobe_upump_mgr_alloc(uprobe_use(bench_env.uprobe), upump_mgr);
+    assert(uprobe != NULL);
+
+    sink = bench_sink_alloc();
+    struct upipe_mgr *upipe_udpsrc_mgr = upipe_udpsrc_mgr_alloc();
+    assert(upipe_udpsrc_mgr != NULL);
+    udpsrc = upipe_void_alloc(upipe_udpsrc_mgr, uprobe_use(uprobe));
+    assert(udpsrc != NULL);
+    upipe_mgr_release(upipe_udpsrc_mgr);
+    ubase_assert(upipe_set_output(udpsrc, sink));
+    ubase_assert(upipe_set_output_size(udpsrc, DATAGRAM_SIZE));
+
+    char uri[64];
+    unsigned int i;
+    for (i = 0; i < PORT_TRIES; i++) {
+        snprintf(uri, sizeof(uri), "@127.0.0.1:%d", 1024 + rand() % 40000);
+        if (ubase_check(upipe_set_uri(udpsrc, uri)))
+            break;
+    }
+    assert(i < PORT_TRIES);
+
+    struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
+    assert(upipe_udpsink_mgr != NULL);
+    udpsink = upipe_void_alloc(upipe_udpsink_mgr, uprobe_use(uprobe));
+    assert(udpsink != NULL);
+    upipe_mgr_release(upipe_udpsink_mgr);
+    struct uref *flow_def = uref_block_flow_alloc_def(bench_env.uref_mgr,
+                                                      "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(udpsink, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_set_uri(udpsink, uri + 1));
+
+    datagram = uref_block_alloc(bench_env.uref_mgr, bench_env.ubuf_mgr,
+                                DATAGRAM_SIZE);
+    assert(datagram != NULL);
+    nb_datagrams = bench_iterations(DATAGRAMS);
+    nb_sent = nb_received = 0;
+
+    struct upump *send = upump_alloc_idler(upump_mgr, bench_udp_send,
+                                           NULL, NULL);
+    assert(send != NULL);
+    struct upump *check = upump_alloc_timer(upump_mgr, bench_udp_check,
+                                            NULL, NULL, CHECK_INTERVAL,
+                                            CHECK_INTERVAL);
+    assert(check != NULL);
+    upump_start(send);
+    upump_start(check);
+
+    uint64_t begin = last_received = bench_now();
+    upump_mgr_run(upump_mgr, NULL);
+
+    bench_report("udp.loopback", nb_received, nb_received * DATAGRAM_SIZE,
+                 last_received - begin);
+    if (nb_received < nb_sent)
+        fprintf(stderr, "udp.loopback: %"PRIu64" datagrams lost\n",
+                nb_sent - nb_received);
+
+    upump_free(send);
+    upump_free(check);
+    uref_free(datagram);
+    upipe_release(udpsink);
+    upipe_release(udpsrc);
+    bench_sink_free(sink);
+    uprobe_release(uprobe);
+    upump_mgr_release(upump_mgr);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short throughput benchmarks - uref and udict
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_block.h>
+
+#include "bench.h"
+
+#include <assert.h>
+
+/** number of iterations at scale 1 */
+#define ITERATIONS 1000000
+
+/** @This allocates and frees urefs, hitting the pools. */
+static void bench_uref_alloc_free(void)
+{
+    uint64_t nb = bench_iterations(ITERATIONS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        struct uref *uref = uref_alloc(bench_env.uref_mgr);
+        assert(uref != NULL);
+        uref_free(uref);
+    }
+    bench_report("uref.alloc_free", nb, 0, bench_now() - begin);
+}
+
+/** @This duplicates and frees a uref carrying a block and attributes. */
+static void bench_uref_dup_free(void)
+{
+    struct uref *uref = uref_block_alloc(bench_env.uref_mgr,
+                                         bench_env.ubuf_mgr, 1316);
+    assert(uref != NULL);
+    uref_clock_set_pts_prog(uref, 0);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    ubase_assert(uref_flow_set_def(uref, "block.mpegts."));
+
+    uint64_t nb = bench_iterations(ITERATIONS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        struct uref *dup = uref_dup(uref);
+        assert(dup != NULL);
+        uref_free(dup);
+    }
+    bench_report("uref.dup_free", nb, 0, bench_now() - begin);
+    uref_free(uref);
+}
+
+/** @This sets and gets attributes of a dictionary. */
+static void bench_udict_set_get(void)
+{
+    struct uref *uref = uref_alloc(bench_env.uref_mgr);
+    assert(uref != NULL);
+
+    uint64_t nb = bench_iterations(ITERATIONS);
+    uint64_t begin = bench_now();
+    for (uint64_t i = 0; i < nb; i++) {
+        uint64_t value;
+        const char *def;
+        uref_clock_set_pts_prog(uref, i);
+        uref_clock_set_dts_pts_delay(uref, i);
+        uref_clock_set_duration(uref, i);
+        ubase_assert(uref_flow_set_def(uref, "block.mpegts."));
+        ubase_assert(uref_clock_get_pts_prog(uref, &value));
+        assert(value == i);
+        ubase_assert(uref_clock_get_duration(uref, &value));
+        ubase_assert(uref_flow_get_def(uref, &def));
+    }
+    /* four setters and three getters per iteration */
+    bench_report("udict.set_get", nb * 7, 0, bench_now() - begin);
+    uref_free(uref);
+}
+
+/** @This runs the uref and udict benchmarks. */
+void bench_uref(void)
+{
+    bench_uref_alloc_free();
+    bench_uref_dup_free();
+    bench_udict_set_get();
+}
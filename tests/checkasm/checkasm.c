@@ -126,6 +126,9 @@ static const struct {
 #ifdef AV_CPU_FLAG_AVX512
     { "AVX-512",  "avx512",   AV_CPU_FLAG_AVX512 },
 #endif
+#ifdef AV_CPU_FLAG_AVX512ICL
+    { "AVX-512 ICL", "avx512icl", AV_CPU_FLAG_AVX512ICL },
+#endif
 #endif
     { NULL, NULL, 0 }
 };
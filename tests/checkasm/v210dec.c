@@ -94,6 +94,16 @@ void checkasm_check_v210dec(void)
         s.planar_10 = upipe_v210_to_planar_10_aligned_avx2;
         s.planar_8  = upipe_v210_to_planar_8_aligned_avx2;
     }
+#endif
+#if defined(HAVE_AVX512_INTRINSICS) && defined(AV_CPU_FLAG_AVX512)
+    if (cpu_flags & AV_CPU_FLAG_AVX512) {
+        s.planar_10 = upipe_v210_to_planar_10_avx512;
+        s.planar_8  = upipe_v210_to_planar_8_avx512;
+    }
+#ifdef AV_CPU_FLAG_AVX512ICL
+    if (cpu_flags & AV_CPU_FLAG_AVX512ICL)
+        s.planar_8  = upipe_v210_to_planar_8_avx512vbmi;
+#endif
 #endif
 
     if (check_func(s.planar_8, "v210_to_planar8")) {
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short local HTTP/1.1 server for the http source tests
+ * Each connection is served by its own thread, so that a client may keep
+ * several connections open and stop reading some of them.
+ */
+
+#undef NDEBUG
+
+#include "http_server_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CONNECTIONS 64
+#define REQUEST_SIZE 4096
+#define SEND_SIZE 4096
+
+/** served files */
+static const struct http_server_test_file *server_files;
+/** number of served files */
+static unsigned int server_nb_files;
+/** maximum number of requests per connection */
+static unsigned int server_max_requests;
+/** listening socket */
+static int server_fd = -1;
+/** accepting thread */
+static pthread_t server_thread;
+/** connection threads */
+static pthread_t conn_threads[MAX_CONNECTIONS];
+/** protects the counters */
+static pthread_mutex_t server_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** number of accepted connections */
+static unsigned int nb_connections = 0;
+/** number of received requests */
+static unsigned int nb_requests = 0;
+
+uint8_t http_server_test_byte(const char *path, size_t offset)
+{
+    uint8_t seed = 0;
+    for (const char *c = path; *c; c++)
+        seed += *c;
+    return seed + offset * 31 + (offset >> 8);
+}
+
+/** @This sends a buffer entirely. */
+static bool send_all(int fd, const void *buffer, size_t size)
+{
+    const uint8_t *p = buffer;
+    while (size) {
+        ssize_t ret = send(fd, p, size, MSG_NOSIGNAL);
+        if (ret <= 0)
+            return false;
+        p += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+/** @This sends a part of a body. */
+static bool send_body(int fd, const struct http_server_test_file *file,
+                      size_t offset, size_t size)
+{
+    if (file->body != NULL)
+        return send_all(fd, file->body + offset, size);
+
+    uint8_t buffer[SEND_SIZE];
+    while (size) {
+        size_t len = size < SEND_SIZE ? size : SEND_SIZE;
+        for (size_t i = 0; i < len; i++)
+            buffer[i] = http_server_test_byte(file->path, offset + i);
+        if (!send_all(fd, buffer, len))
+            return false;
+        offset += len;
+        size -= len;
+    }
+    return true;
+}
+
+/** @This answers a request. */
+static bool serve_file(int fd, const char *path)
+{
+    const struct http_server_test_file *file = NULL;
+    for (unsigned int i = 0; i < server_nb_files; i++)
+        if (!strcmp(server_files[i].path, path))
+            file = &server_files[i];
+
+    char header[256];
+    if (file == NULL) {
+        snprintf(header, sizeof (header), "HTTP/1.1 404 Not Found\r\n"
+                 "Content-Length: 0\r\n\r\n");
+        return send_all(fd, header, strlen(header));
+    }
+
+    if (!file->chunk_size) {
+        snprintf(header, sizeof (header), "HTTP/1.1 200 OK\r\n"
+                 "Content-Length: %zu\r\n\r\n", file->size);
+        return send_all(fd, header, strlen(header)) &&
+               send_body(fd, file, 0, file->size);
+    }
+
+    snprintf(header, sizeof (header), "HTTP/1.1 200 OK\r\n"
+             "Transfer-Encoding: chunked\r\n\r\n");
+    if (!send_all(fd, header, strlen(header)))
+        return false;
+    for (size_t offset = 0; offset < file->size; offset += file->chunk_size) {
+        size_t size = file->size - offset;
+        if (size > file->chunk_size)
+            size = file->chunk_size;
+        snprintf(header, sizeof (header), "%zx\r\n", size);
+        if (!send_all(fd, header, strlen(header)) ||
+            !send_body(fd, file, offset, size) ||
+            !send_all(fd, "\r\n", 2))
+            return false;
+    }
+    return send_all(fd, "0\r\n\r\n", 5);
+}
+
+/** @This serves the requests of a connection. */
+static void *serve_connection(void *_fd)
+{
+    int fd = (intptr_t)_fd;
+    char request[REQUEST_SIZE + 1];
+    size_t size = 0;
+    unsigned int served = 0;
+
+    for ( ; ; ) {
+        request[size] = '\0';
+        char *end = strstr(request, "\r\n\r\n");
+        if (end == NULL) {
+            if (size == REQUEST_SIZE)
+                break;
+            ssize_t ret = recv(fd, request + size, REQUEST_SIZE - size, 0);
+            if (ret <= 0)
+                break;
+            size += ret;
+            continue;
+        }
+        end += 4;
+
+        pthread_mutex_lock(&server_mutex);
+        nb_requests++;
+        pthread_mutex_unlock(&server_mutex);
+        if (server_max_requests && served == server_max_requests)
+            /* close the kept connection without answering */
+            break;
+
+        char path[256];
+        if (sscanf(request, "GET %255s ", path) != 1 ||
+            !serve_file(fd, path))
+            break;
+        served++;
+
+        size -= end - request;
+        memmove(request, end, size);
+    }
+    close(fd);
+    return NULL;
+}
+
+/** @This accepts the connections. */
+static void *serve(void *unused)
+{
+    for ( ; ; ) {
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0)
+            break;
+
+        pthread_mutex_lock(&server_mutex);
+        assert(nb_connections < MAX_CONNECTIONS);
+        unsigned int conn = nb_connections++;
+        pthread_mutex_unlock(&server_mutex);
+        assert(!pthread_create(&conn_threads[conn], NULL, serve_connection,
+                               (void *)(intptr_t)fd));
+    }
+    return NULL;
+}
+
+int http_server_test_start(const struct http_server_test_file *files,
+                           unsigned int nb_files, unsigned int max_requests)
+{
+    server_files = files;
+    server_nb_files = nb_files;
+    server_max_requests = max_requests;
+    nb_connections = nb_requests = 0;
+
+    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(server_fd >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    assert(!bind(server_fd, (struct sockaddr *)&addr, sizeof (addr)));
+    assert(!listen(server_fd, MAX_CONNECTIONS));
+    socklen_t len = sizeof (addr);
+    assert(!getsockname(server_fd, (struct sockaddr *)&addr, &len));
+
+    assert(!pthread_create(&server_thread, NULL, serve, NULL));
+    return ntohs(addr.sin_port);
+}
+
+void http_server_test_stop(void)
+{
+    shutdown(server_fd, SHUT_RDWR);
+    assert(!pthread_join(server_thread, NULL));
+    close(server_fd);
+    server_fd = -1;
+    for (unsigned int i = 0; i < nb_connections; i++)
+        assert(!pthread_join(conn_threads[i], NULL));
+}
+
+unsigned int http_server_test_connections(void)
+{
+    pthread_mutex_lock(&server_mutex);
+    unsigned int connections = nb_connections;
+    pthread_mutex_unlock(&server_mutex);
+    return connections;
+}
+
+unsigned int http_server_test_requests(void)
+{
+    pthread_mutex_lock(&server_mutex);
+    unsigned int requests = nb_requests;
+    pthread_mutex_unlock(&server_mutex);
+    return requests;
+}
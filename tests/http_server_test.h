@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short local HTTP/1.1 server for the http source tests
+ */
+
+#ifndef _TESTS_HTTP_SERVER_TEST_H_
+#define _TESTS_HTTP_SERVER_TEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @This describes a file served by the test server. */
+struct http_server_test_file {
+    /** path of the file */
+    const char *path;
+    /** size of the body */
+    size_t size;
+    /** size of the chunks, or 0 to send a Content-Length */
+    size_t chunk_size;
+    /** body of the file, or NULL to serve @ref http_server_test_byte */
+    const char *body;
+};
+
+/** @This returns the octet of a served body at the given offset. */
+uint8_t http_server_test_byte(const char *path, size_t offset);
+
+/** @This starts the server on the loopback interface. A connection is
+ * closed without answer once it has served max_requests requests (0 for
+ * no limit), like a server closing a kept connection.
+ *
+ * @return the listening port
+ */
+int http_server_test_start(const struct http_server_test_file *files,
+                           unsigned int nb_files, unsigned int max_requests);
+
+/** @This stops the server, once the clients have closed their
+ * connections. */
+void http_server_test_stop(void);
+
+/** @This returns the number of accepted connections. */
+unsigned int http_server_test_connections(void);
+
+/** @This returns the number of received requests. */
+unsigned int http_server_test_requests(void);
+
+#endif
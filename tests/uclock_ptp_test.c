@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uclock_ptp with fake PHCs
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uclock_ptp.h>
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+
+/** duration of the test of each NIC, in ns */
+#define DURATION UINT64_C(200000000)
+/** tolerated error, in 27 MHz ticks (100 us) */
+#define TOLERANCE (UCLOCK_FREQ / 10000)
+
+/** offsets of the fake PHCs, in ns */
+static const uint64_t offsets[2] = {
+    UINT64_C(1000000000000), UINT64_C(2000000000000)
+};
+/** number of reads of the fake PHCs */
+static unsigned int reads[2];
+
+/** returns CLOCK_MONOTONIC_RAW in ns */
+static uint64_t sys_now(void)
+{
+    struct timespec ts;
+    assert(clock_gettime(CLOCK_MONOTONIC_RAW, &ts) == 0);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** returns the time of a fake PHC running 100 ppm fast */
+static uint64_t phc_at(int nic, uint64_t sys)
+{
+    return offsets[nic] + sys + sys / 10000;
+}
+
+/** cross-timestamps a fake PHC */
+static bool phc_read(void *opaque, int nic, uint64_t *sys_p, uint64_t *phc_p)
+{
+    assert(opaque == reads);
+    assert(nic == 0 || nic == 1);
+    reads[nic]++;
+    *sys_p = sys_now();
+    *phc_p = phc_at(nic, *sys_p);
+    return true;
+}
+
+/** checks that the clock follows a fake PHC */
+static void check_nic(struct uclock *uclock, int nic)
+{
+    uint64_t begin = sys_now();
+    uint64_t sys;
+    do {
+        uint64_t before = phc_at(nic, sys_now());
+        uint64_t now = uclock_now(uclock);
+        sys = sys_now();
+        uint64_t after = phc_at(nic, sys);
+        before = before / 1000 * 27;
+        after = after / 1000 * 27;
+        assert(now != UINT64_MAX);
+        assert(now + TOLERANCE >= before);
+        assert(now <= after + TOLERANCE);
+    } while (sys - begin < DURATION);
+}
+
+int main(int argc, char **argv)
+{
+    assert(uclock_ptp_alloc_phc(NULL, 0, phc_read, reads) == NULL);
+    assert(uclock_ptp_alloc_phc(NULL, 3, phc_read, reads) == NULL);
+
+    struct uclock *uclock = uclock_ptp_alloc_phc(NULL, 2, phc_read, reads);
+    assert(uclock != NULL);
+
+    check_nic(uclock, 0);
+    printf("reads after %"PRIu64" ms: %u %u\n", DURATION / 1000000,
+           reads[0], reads[1]);
+    assert(reads[0] >= 1 && reads[0] <= 2);
+    assert(reads[1] == 0);
+
+    /* failover */
+    uclock_ptp_set_link(uclock, 0, false);
+    check_nic(uclock, 1);
+    assert(reads[1] >= 1 && reads[1] <= 2);
+
+    uclock_ptp_set_link(uclock, 0, true);
+    check_nic(uclock, 0);
+    assert(reads[0] <= 2);
+
+    uclock_release(uclock);
+    return 0;
+}
@@ -41,6 +41,7 @@ int main(int argc, char **argv)
 {
     struct umem_mgr *mgr = umem_pool_mgr_alloc_simple(32);
     assert(mgr != NULL);
+    ubase_assert(umem_pool_mgr_enable_stats(mgr));
 
     struct umem umem;
     assert(umem_alloc(mgr, &umem, 42));
@@ -87,6 +88,16 @@ int main(int argc, char **argv)
     umem_free(&umem);
     printf("Passed 6\n");
 
+    struct umem_pool_stats stats;
+    ubase_assert(umem_pool_mgr_get_stats(mgr, 8, &stats));
+    assert(stats.size == 8192);
+    assert(stats.depth == 16);
+    assert(stats.kept == 1);
+    assert(stats.hits == 1);
+    assert(stats.misses == 1);
+    ubase_nassert(umem_pool_mgr_get_stats(mgr, 18, &stats));
+    printf("Passed 7\n");
+
     umem_mgr_release(mgr);
     return 0;
 }
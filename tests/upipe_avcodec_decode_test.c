@@ -417,6 +417,8 @@ int main (int argc, char **argv)
     // build avcodec pipe
     struct upipe_mgr *upipe_avcdec_mgr = upipe_avcdec_mgr_alloc();
     assert(upipe_avcdec_mgr);
+    ubase_assert(upipe_avcdec_mgr_set_thread_budget(upipe_avcdec_mgr,
+                                                    thread_num + 2));
     struct upipe *avcdec = upipe_void_alloc(upipe_avcdec_mgr,
             uprobe_upump_mgr_alloc(
                 uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
@@ -424,6 +426,14 @@ int main (int argc, char **argv)
     assert(avcdec);
     ubase_assert(upipe_set_flow_def(avcdec, flowdef));
     uref_free(flowdef);
+    ubase_assert(upipe_avcdec_set_threading(avcdec, UPIPE_AVCDEC_THREAD_SLICE,
+                                            2));
+    enum upipe_avcdec_thread_type thread_type;
+    unsigned int thread_count;
+    ubase_assert(upipe_avcdec_get_threading(avcdec, &thread_type,
+                                            &thread_count));
+    assert(thread_type == UPIPE_AVCDEC_THREAD_SLICE);
+    assert(thread_count == 2);
     /* mainthread avcdec runs alone (no thread) so it doesn't need any upump_mgr
      * Please do not add one, to check the nopump (direct call) case */
     mainthread.avcdec = avcdec;
@@ -521,6 +531,13 @@ int main (int argc, char **argv)
     // Now read with avformat
     upump_mgr_run(upump_mgr, NULL);
 
+    /* all decoders are closed, the thread budget must be entirely back */
+    unsigned int budget, used;
+    ubase_assert(upipe_avcdec_mgr_get_thread_budget(upipe_avcdec_mgr,
+                                                    &budget, &used));
+    assert(budget == thread_num + 2);
+    assert(used == 0);
+
     // Close avformat
     avformat_close_input(&mainthread.avfctx);
 
@@ -32,7 +32,10 @@
 #include <upipe/uprobe_prefix.h>
 #include <upipe/uprobe_upump_mgr.h>
 #include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/uclock.h>
 #include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
 #include <upipe/umem.h>
 #include <upipe/umem_alloc.h>
 #include <upipe/udict.h>
@@ -99,6 +102,13 @@ struct ubuf_mgr *pic_mgr;
 struct uprobe *logger;
 struct uprobe uprobe_avcenc_s;
 
+/** date returned by the test uclock */
+static uint64_t test_date = 0;
+/** increment of the date after each read, that is the measured latency */
+static uint64_t test_step = 0;
+/** number of frames received by the phony sink */
+static unsigned int test_frames = 0;
+
 struct thread {
     pthread_t id;
     unsigned int num;
@@ -164,6 +174,87 @@ static int catch_avcenc(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** helper uclock returning a date advancing by test_step on each read */
+static uint64_t test_uclock_now(struct uclock *uclock)
+{
+    uint64_t now = test_date;
+    test_date += test_step;
+    return now;
+}
+
+/** helper uclock to control the measured decode latency */
+static struct uclock test_uclock = {
+    .refcount = NULL,
+    .uclock_now = test_uclock_now,
+    .uclock_to_real = NULL,
+    .uclock_from_real = NULL
+};
+
+/** helper phony pipe */
+struct avcdec_test {
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(avcdec_test, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr,
+                                struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct avcdec_test *avcdec_test = malloc(sizeof(struct avcdec_test));
+    assert(avcdec_test != NULL);
+    upipe_init(&avcdec_test->upipe, mgr, uprobe);
+    upipe_throw_ready(&avcdec_test->upipe);
+    return &avcdec_test->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    assert(uref->ubuf != NULL);
+    test_frames++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    struct avcdec_test *avcdec_test = avcdec_test_from_upipe(upipe);
+    upipe_clean(upipe);
+    free(avcdec_test);
+}
+
+/** helper phony pipe counting the decoded frames */
+static struct upipe_mgr avcdec_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
 /* fill picture with some stuff */
 static void fill_pic(struct ubuf *ubuf)
 {
@@ -395,6 +486,79 @@ int main(int argc, char **argv)
     upipe_release(avcenc);
     printf("Everything good so far, cleaning\n");
 
+    /* low latency decoding, with one frame per bucket boundary: intra-only
+     * mjpeg frames are decoded as soon as they are input, so the measured
+     * latency is exactly the step of the test uclock */
+    static const uint64_t latencies[] = {
+        0,                          /* bucket 0: below 1 ms */
+        UCLOCK_FREQ / 2000,         /* bucket 0 */
+        UCLOCK_FREQ / 1000,         /* bucket 1: [1 ms, 2 ms[ */
+        3 * UCLOCK_FREQ / 1000,     /* bucket 2: [2 ms, 4 ms[ */
+        3 * UCLOCK_FREQ / 1000,     /* bucket 2 */
+        100 * UCLOCK_FREQ / 1000,   /* bucket 7: [64 ms, 128 ms[ */
+        10 * UCLOCK_FREQ,           /* last bucket: 1024 ms and above */
+    };
+    static const unsigned int buckets[UPIPE_AVCDEC_LATENCY_BUCKETS] = {
+        [0] = 2, [1] = 1, [2] = 2, [7] = 1,
+        [UPIPE_AVCDEC_LATENCY_BUCKETS - 1] = 1
+    };
+    unsigned int nb_latencies = sizeof(latencies) / sizeof(latencies[0]);
+
+    flow = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow, 2, 2, 1, "v8"));
+    ubase_assert(uref_pic_flow_set_hsize(flow, WIDTH));
+    ubase_assert(uref_pic_flow_set_vsize(flow, HEIGHT));
+    ubase_assert(uref_pic_flow_set_fps(flow, fps));
+    struct uref *output_flow = uref_dup(flow);
+    assert(output_flow != NULL);
+    ubase_assert(uref_flow_set_def(output_flow, "block.mjpeg.pic."));
+    avcenc = upipe_flow_alloc(upipe_avcenc_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), loglevel, "avcenc mjpeg"),
+        output_flow);
+    assert(avcenc != NULL);
+    uref_free(output_flow);
+    ubase_assert(upipe_set_flow_def(avcenc, flow));
+    uref_free(flow);
+
+    struct upipe *avcdec = upipe_void_alloc_output(avcenc, upipe_avcdec_mgr,
+        uprobe_uclock_alloc(
+            uprobe_pfx_alloc(uprobe_use(logger), loglevel, "avcdec mjpeg"),
+            &test_uclock));
+    assert(avcdec != NULL);
+    ubase_assert(upipe_avcdec_set_low_latency(avcdec, true));
+    struct upipe *sink = upipe_void_alloc_output(avcdec, &avcdec_test_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), loglevel, "sink"));
+    assert(sink != NULL);
+
+    for (i = 0; i < nb_latencies; i++) {
+        test_step = latencies[i];
+        pic = uref_pic_alloc(uref_mgr, pic_mgr, WIDTH, HEIGHT);
+        assert(pic != NULL);
+        fill_pic(pic->ubuf);
+        upipe_input(avcenc, pic, NULL);
+        assert(test_frames == i + 1);
+    }
+
+    struct upipe_avcdec_latency latency;
+    ubase_assert(upipe_avcdec_get_latency(avcdec, &latency));
+    assert(latency.count == nb_latencies);
+    assert(latency.min == 0);
+    assert(latency.max == 10 * UCLOCK_FREQ);
+    uint64_t sum = 0;
+    for (i = 0; i < nb_latencies; i++)
+        sum += latencies[i];
+    assert(latency.sum == sum);
+    for (i = 0; i < UPIPE_AVCDEC_LATENCY_BUCKETS; i++)
+        assert(latency.buckets[i] == buckets[i]);
+
+    upipe_release(avcenc);
+    upipe_release(avcdec);
+    test_free(sink);
+    printf("Everything good so far, cleaning\n");
+
     /* clean managers and probes */
     upipe_mgr_release(upipe_avcdec_mgr);
     upipe_mgr_release(upipe_avcenc_mgr);
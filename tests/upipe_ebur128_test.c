@@ -41,8 +41,8 @@
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf_sound_mem.h>
+#include <upipe/upipe_helper_upipe.h>
 #include <upipe-ebur128/upipe_ebur128.h>
-#include <upipe-modules/upipe_null.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -63,6 +63,16 @@
 #define STEP                (2. * M_PI * FREQ / RATE)
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 #define ALIGN               0
+/* buffers per momentary report: 100 ms at RATE is 4800 samples */
+#define MOMENTARY_BUFFERS   ((RATE / 10 + SAMPLES - 1) / SAMPLES)
+/* buffers per integrated report: 1 s at RATE is 48000 samples */
+#define INTEGRATED_BUFFERS  ((RATE + SAMPLES - 1) / SAMPLES)
+
+static unsigned int momentary_buffers = MOMENTARY_BUFFERS;
+static unsigned int integrated_buffers = INTEGRATED_BUFFERS;
+static unsigned int nb_input = 0;
+static unsigned int nb_momentary = 0;
+static unsigned int nb_integrated = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -80,6 +90,74 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    nb_input++;
+
+    double value;
+    if (ubase_check(uref_ebur128_get_momentary(uref, &value))) {
+        assert(nb_input % momentary_buffers == 0);
+        nb_momentary++;
+    }
+    bool lra = ubase_check(uref_ebur128_get_lra(uref, &value));
+    bool global = ubase_check(uref_ebur128_get_global(uref, &value));
+    assert(lra == global);
+    if (lra) {
+        assert(nb_input % integrated_buffers == 0);
+        nb_integrated++;
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
@@ -124,12 +202,19 @@ int main(int argc, char **argv)
     ubase_assert(uref_sound_flow_set_rate(flow, RATE));
     ubase_assert(upipe_set_flow_def(r128, flow));
 
-    struct upipe *null = upipe_void_alloc_output(r128,
-        upipe_null_mgr_alloc(),
-        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "null"));
-    assert(null);
-    upipe_release(null);
-    upipe_null_dump_dict(null, true);
+    uint64_t interval;
+    ubase_assert(upipe_ebur128_set_momentary_interval(r128,
+                                                      UCLOCK_FREQ / 10));
+    ubase_assert(upipe_ebur128_get_momentary_interval(r128, &interval));
+    assert(interval == UCLOCK_FREQ / 10);
+    ubase_assert(upipe_ebur128_set_integrated_interval(r128, UCLOCK_FREQ));
+    ubase_assert(upipe_ebur128_get_integrated_interval(r128, &interval));
+    assert(interval == UCLOCK_FREQ);
+
+    struct upipe *test = upipe_void_alloc(&test_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "test"));
+    assert(test);
+    ubase_assert(upipe_set_output(r128, test));
 
     uref_free(flow);
 
@@ -165,8 +250,35 @@ int main(int argc, char **argv)
         upipe_input(r128, uref, NULL);
     }
 
+    /* check the reporting cadence */
+    assert(nb_input == ITERATIONS);
+    assert(nb_momentary == ITERATIONS / MOMENTARY_BUFFERS);
+    assert(nb_integrated == ITERATIONS / INTEGRATED_BUFFERS);
+
+    /* an interval of 0 reports on every buffer */
+    ubase_assert(upipe_ebur128_set_momentary_interval(r128, 0));
+    ubase_assert(upipe_ebur128_set_integrated_interval(r128, 0));
+    momentary_buffers = integrated_buffers = 1;
+    nb_input = nb_momentary = nb_integrated = 0;
+    for (i = 0; i < MOMENTARY_BUFFERS; i++) {
+        struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
+        assert(uref);
+        const char *channel;
+        int16_t *sample = NULL;
+        uref_sound_foreach_plane(uref, channel) {
+            uref_sound_plane_write_int16_t(uref, channel, 0, -1, &sample);
+            memset(sample, 0, 2 * CHANNELS * SAMPLES);
+            uref_sound_plane_unmap(uref, channel, 0, -1);
+        }
+        upipe_input(r128, uref, NULL);
+    }
+    assert(nb_input == MOMENTARY_BUFFERS);
+    assert(nb_momentary == MOMENTARY_BUFFERS);
+    assert(nb_integrated == MOMENTARY_BUFFERS);
+
     /* release pipe */
     upipe_release(r128);
+    test_free(test);
 
     /* release managers */
     upipe_mgr_release(upipe_ebur128_mgr); // no-op
@@ -32,6 +32,7 @@
 #include <upipe/ubuf_pic_mem.h>
 #include <upipe/ubuf_sound_mem.h>
 
+#include <upipe/uatomic.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
 #include <upipe/uprobe_prefix.h>
@@ -52,6 +53,8 @@
 #include <upipe-modules/upipe_grid.h>
 
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_DEBUG
 #define UDICT_POOL_DEPTH    5
@@ -67,6 +70,8 @@
 #define N_UREF              5
 #define N_INPUT             2
 #define N_OUTPUT            2
+#define N_THREAD_UREF       2000
+#define THREAD_DURATION     (UCLOCK_FREQ / 25)
 
 UREF_ATTR_SMALL_UNSIGNED(test, input_id, "input_id", input id);
 
@@ -173,6 +178,158 @@ static struct upipe_mgr sink_mgr = {
     .upipe_control = sink_control,
 };
 
+struct count_sink {
+    struct upipe upipe;
+    struct urefcount urefcount;
+    uint64_t count;
+    uint64_t pics;
+};
+
+UPIPE_HELPER_UPIPE(count_sink, upipe, 0);
+UPIPE_HELPER_UREFCOUNT(count_sink, urefcount, count_sink_free);
+UPIPE_HELPER_VOID(count_sink);
+
+static void count_sink_free(struct upipe *upipe)
+{
+    struct count_sink *count_sink = count_sink_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    assert(count_sink->count == N_THREAD_UREF);
+    assert(count_sink->pics);
+    count_sink_clean_urefcount(upipe);
+    count_sink_free_void(upipe);
+}
+
+static struct upipe *count_sink_alloc(struct upipe_mgr *mgr,
+                                      struct uprobe *uprobe,
+                                      uint32_t signature, va_list args)
+{
+    struct upipe *upipe = count_sink_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(!upipe))
+        return NULL;
+
+    count_sink_init_urefcount(upipe);
+
+    struct count_sink *count_sink = count_sink_from_upipe(upipe);
+    count_sink->count = 0;
+    count_sink->pics = 0;
+
+    upipe_throw_ready(upipe);
+
+    return upipe;
+}
+
+static void count_sink_input(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump)
+{
+    struct count_sink *count_sink = count_sink_from_upipe(upipe);
+    count_sink->count++;
+    if (uref->ubuf)
+        count_sink->pics++;
+    uref_free(uref);
+}
+
+static int count_sink_control(struct upipe *upipe,
+                              int command, va_list args)
+{
+    if (command == UPIPE_SET_FLOW_DEF)
+        return UBASE_ERR_NONE;
+    return UBASE_ERR_UNHANDLED;
+}
+
+static struct upipe_mgr count_sink_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = count_sink_alloc,
+    .upipe_input = count_sink_input,
+    .upipe_control = count_sink_control,
+};
+
+struct thread_input {
+    struct upipe *input;
+    struct uref_mgr *uref_mgr;
+    struct ubuf_mgr *ubuf_mgr;
+    uatomic_uint32_t sent;
+};
+
+static void *thread_input(void *opaque)
+{
+    struct thread_input *thread_input = opaque;
+    for (unsigned i = 0; i < N_THREAD_UREF; i++) {
+        struct uref *uref = uref_pic_alloc(thread_input->uref_mgr,
+                                           thread_input->ubuf_mgr,
+                                           WIDTH, HEIGHT);
+        assert(uref);
+        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * THREAD_DURATION);
+        upipe_input(thread_input->input, uref, NULL);
+        uatomic_store(&thread_input->sent, i + 1);
+    }
+    return NULL;
+}
+
+/* feeds an input from another thread while an output reads it */
+static void test_threads(struct upipe *upipe_grid, struct uprobe *logger,
+                         struct uref_mgr *uref_mgr,
+                         struct ubuf_mgr *ubuf_mgr)
+{
+    struct upipe *input =
+        upipe_grid_alloc_input(upipe_grid,
+                               uprobe_pfx_alloc(uprobe_use(logger),
+                                                UPROBE_LOG_ERROR,
+                                                "in thread"));
+    assert(input);
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 0);
+    assert(flow_def);
+    ubase_assert(upipe_set_flow_def(input, flow_def));
+    uref_free(flow_def);
+
+    struct upipe *output =
+        upipe_grid_alloc_output(upipe_grid,
+                                uprobe_pfx_alloc(uprobe_use(logger),
+                                                 UPROBE_LOG_ERROR,
+                                                 "out thread"));
+    assert(output);
+    flow_def = uref_void_flow_alloc_def(uref_mgr);
+    assert(flow_def);
+    ubase_assert(upipe_set_flow_def(output, flow_def));
+    uref_free(flow_def);
+    struct upipe *sink =
+        upipe_void_alloc_output(output, &count_sink_mgr,
+                                uprobe_pfx_alloc(uprobe_use(logger),
+                                                 UPROBE_LOG_ERROR,
+                                                 "sink thread"));
+    assert(sink);
+    upipe_release(sink);
+    ubase_assert(upipe_grid_out_set_input(output, input));
+
+    struct thread_input args = {
+        .input = input, .uref_mgr = uref_mgr, .ubuf_mgr = ubuf_mgr
+    };
+    uatomic_init(&args.sent, 0);
+    pthread_t thread;
+    assert(!pthread_create(&thread, NULL, thread_input, &args));
+
+    for (unsigned i = 0; i < N_THREAD_UREF; i++) {
+        /* do not run ahead of the input */
+        while (uatomic_load(&args.sent) <= i)
+            sched_yield();
+        struct uref *uref = uref_alloc_control(uref_mgr);
+        assert(uref);
+        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * THREAD_DURATION);
+        upipe_input(output, uref, NULL);
+    }
+
+    assert(!pthread_join(thread, NULL));
+    uatomic_clean(&args.sent);
+    upipe_release(input);
+
+    /* the output drops the released input */
+    struct upipe *current;
+    ubase_assert(upipe_grid_out_get_input(output, &current));
+    assert(current == NULL);
+    upipe_release(output);
+}
+
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
 {
@@ -325,6 +482,9 @@ int main(int argc, char *argv[])
         upipe_release(outputs[i]);
     for (unsigned i = 0; i < N_INPUT * 2; i++)
         upipe_release(inputs[i]);
+
+    test_threads(upipe_grid, logger, uref_mgr, ubuf_pic_mgr);
+
     assert(upipe_single(upipe_grid));
     upipe_release(upipe_grid);
     upipe_mgr_release(upipe_grid_mgr);
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit test for hls master adaptive variant switches
+ * The lowest variant of a master playlist is played from a local server.
+ * The download of its first segment is timed by the playlist, reported
+ * through the variant, and makes the master switch to the highest variant.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_uri.h>
+#include <upipe/uref_m3u.h>
+#include <upipe/uref_m3u_master.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_http_source.h>
+#include <upipe-hls/upipe_hls_master.h>
+#include <upipe-hls/upipe_hls_playlist.h>
+
+#include "http_server_test.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define SEGMENT_SIZE (188 * 1000)
+
+#define MEDIA_PLAYLIST(name)                                                \
+    "#EXTM3U\n"                                                             \
+    "#EXT-X-VERSION:3\n"                                                    \
+    "#EXT-X-PLAYLIST-TYPE:VOD\n"                                            \
+    "#EXT-X-TARGETDURATION:2\n"                                             \
+    "#EXT-X-MEDIA-SEQUENCE:0\n"                                             \
+    "#EXTINF:2.0,\n"                                                        \
+    name "0.ts\n"                                                           \
+    "#EXTINF:2.0,\n"                                                        \
+    name "1.ts\n"                                                           \
+    "#EXT-X-ENDLIST\n"
+
+static const char low_m3u8[] = MEDIA_PLAYLIST("low");
+static const char high_m3u8[] = MEDIA_PLAYLIST("high");
+
+/** files of the master playlist */
+static const struct http_server_test_file files[] = {
+    { "/hls/low.m3u8", sizeof (low_m3u8) - 1, 0, low_m3u8 },
+    { "/hls/high.m3u8", sizeof (high_m3u8) - 1, 0, high_m3u8 },
+    { "/hls/low0.ts", SEGMENT_SIZE, 0, NULL },
+    { "/hls/low1.ts", SEGMENT_SIZE, 0, NULL },
+    { "/hls/high0.ts", SEGMENT_SIZE, 0, NULL },
+    { "/hls/high1.ts", SEGMENT_SIZE, 0, NULL },
+};
+#define NB_FILES (sizeof (files) / sizeof (files[0]))
+
+/** bandwidths of the variants, lowest first */
+static const uint64_t bandwidths[] = { 500000, 1000000 };
+#define NB_VARIANTS (sizeof (bandwidths) / sizeof (bandwidths[0]))
+
+/** source manager given to the pipes */
+static struct upipe_mgr *source_mgr = NULL;
+/** logger */
+static struct uprobe *logger = NULL;
+/** master sub pipe playing a variant */
+static struct upipe *variant = NULL;
+/** rendition of the variant */
+static struct upipe *rendition = NULL;
+/** number of timed downloads */
+static unsigned int nb_downloaded = 0;
+/** number of played items */
+static unsigned int nb_items = 0;
+/** number of switches */
+static unsigned int nb_switches = 0;
+/** flow id of the variant to switch to */
+static uint64_t switch_id = UINT64_MAX;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    if (event >= UPROBE_LOCAL) {
+        switch (ubase_get_signature(args)) {
+            case UPIPE_HLS_MASTER_SIGNATURE:
+                if (event == UPROBE_HLS_MASTER_SWITCH) {
+                    UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+                    struct uref *uref = va_arg(args, struct uref *);
+                    assert(upipe == variant);
+                    /* the throughput was measured before the item end */
+                    assert(nb_downloaded >= 1);
+                    assert(nb_items == 0);
+                    ubase_assert(uref_flow_get_id(uref, &switch_id));
+                    nb_switches++;
+                }
+                return UBASE_ERR_NONE;
+
+            case UPIPE_HLS_PLAYLIST_SIGNATURE:
+                switch (event) {
+                    case UPROBE_HLS_PLAYLIST_RELOADED:
+                        ubase_assert(upipe_hls_playlist_play(upipe));
+                        break;
+                    case UPROBE_HLS_PLAYLIST_ITEM_DOWNLOADED:
+                        nb_downloaded++;
+                        break;
+                    case UPROBE_HLS_PLAYLIST_ITEM_END:
+                        /* the switch is thrown before the item end reaches
+                         * the application, which stops playing */
+                        assert(nb_switches == 1);
+                        nb_items++;
+                        break;
+                }
+                return UBASE_ERR_NONE;
+        }
+        return UBASE_ERR_NONE;
+    }
+
+    switch (event) {
+        case UPROBE_NEED_SOURCE_MGR: {
+            struct upipe_mgr **mgr_p = va_arg(args, struct upipe_mgr **);
+            *mgr_p = upipe_mgr_use(source_mgr);
+            return UBASE_ERR_NONE;
+        }
+        case UPROBE_SPLIT_UPDATE: {
+            if (upipe != variant || rendition != NULL)
+                return UBASE_ERR_NONE;
+
+            /* the variant has a single rendition */
+            struct uref *flow_def = NULL;
+            ubase_assert(upipe_split_iterate(upipe, &flow_def));
+            assert(flow_def != NULL);
+            ubase_assert(uref_flow_match_def(flow_def, "void."));
+            rendition = upipe_flow_alloc_sub(upipe,
+                    uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                     "rendition"),
+                    flow_def);
+            assert(rendition != NULL);
+            ubase_assert(upipe_attach_uclock(rendition));
+            return UBASE_ERR_NONE;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+int main(int argc, char *argv[])
+{
+    signal(SIGPIPE, SIG_IGN);
+    int port = http_server_test_start(files, NB_FILES, 0);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
+            UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock);
+    assert(logger != NULL);
+
+    source_mgr = upipe_http_src_mgr_alloc();
+    assert(source_mgr != NULL);
+
+    struct upipe_mgr *upipe_hls_master_mgr = upipe_hls_master_mgr_alloc();
+    assert(upipe_hls_master_mgr != NULL);
+    struct upipe *upipe_hls_master = upipe_void_alloc(upipe_hls_master_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "master"));
+    assert(upipe_hls_master != NULL);
+    upipe_mgr_release(upipe_hls_master_mgr);
+    ubase_assert(upipe_hls_master_set_abr(upipe_hls_master, true));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "m3u.master.");
+    assert(flow_def != NULL);
+    char uri[64];
+    snprintf(uri, sizeof (uri), "http://127.0.0.1:%d/hls/index.m3u8", port);
+    ubase_assert(uref_uri_set_from_str(flow_def, uri));
+    ubase_assert(upipe_set_flow_def(upipe_hls_master, flow_def));
+    uref_free(flow_def);
+
+    static const char *names[] = { "low.m3u8", "high.m3u8" };
+    for (unsigned int i = 0; i < NB_VARIANTS; i++) {
+        struct uref *item = uref_alloc_control(uref_mgr);
+        assert(item != NULL);
+        ubase_assert(uref_m3u_set_uri(item, names[i]));
+        ubase_assert(uref_m3u_master_set_bandwidth(item, bandwidths[i]));
+        if (i == 0)
+            uref_block_set_start(item);
+        if (i == NB_VARIANTS - 1)
+            uref_block_set_end(item);
+        upipe_input(upipe_hls_master, item, NULL);
+    }
+
+    /* without sample, the lowest variant is selected */
+    struct uref *selected;
+    ubase_assert(upipe_hls_master_select(upipe_hls_master, UINT64_MAX,
+                                         &selected));
+    uint64_t id;
+    ubase_assert(uref_flow_get_id(selected, &id));
+    assert(id == 0);
+    variant = upipe_flow_alloc_sub(upipe_hls_master,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "variant"),
+            selected);
+    assert(variant != NULL);
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    assert(rendition != NULL);
+    assert(nb_downloaded >= 1);
+    assert(nb_items == 1);
+    assert(nb_switches == 1);
+    assert(switch_id == NB_VARIANTS - 1);
+    struct upipe_hls_master_abr_stats stats;
+    ubase_assert(upipe_hls_master_get_abr_stats(upipe_hls_master, &stats));
+    assert(stats.samples == nb_downloaded);
+    assert(stats.switches == 1);
+
+    upipe_release(rendition);
+    upipe_release(variant);
+    upipe_release(upipe_hls_master);
+    upipe_mgr_release(source_mgr);
+    http_server_test_stop();
+
+    upump_mgr_release(upump_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uclock_release(uclock);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
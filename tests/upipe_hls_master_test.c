@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for hls master adaptive variant selection
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_uri.h>
+#include <upipe/uref_m3u.h>
+#include <upipe/uref_m3u_master.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-hls/upipe_hls_master.h>
+#include <upipe-hls/upipe_hls_buffer.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static unsigned int nb_updates = 0;
+static unsigned int nb_selects = 0;
+static uint64_t policy_id = UINT64_MAX;
+static uint64_t buffered = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+            break;
+        case UPROBE_SPLIT_UPDATE:
+            nb_updates++;
+            break;
+        case UPROBE_HLS_MASTER_ABR_SELECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_MASTER_SIGNATURE);
+            const struct upipe_hls_master_abr_stats *stats =
+                va_arg(args, const struct upipe_hls_master_abr_stats *);
+            va_arg(args, uint64_t);
+            uint64_t *id_p = va_arg(args, uint64_t *);
+            assert(stats != NULL);
+            nb_selects++;
+            if (policy_id != UINT64_MAX)
+                *id_p = policy_id;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony buffer pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony buffer pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_HLS_BUFFER_GET_DURATION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_BUFFER_SIGNATURE);
+            uint64_t *duration_p = va_arg(args, uint64_t *);
+            *duration_p = buffered;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony buffer pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony buffer pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = NULL,
+    .upipe_control = test_control
+};
+
+static uint64_t select_id(struct upipe *upipe, uint64_t current)
+{
+    struct uref *variant;
+    uint64_t id;
+    ubase_assert(upipe_hls_master_select(upipe, current, &variant));
+    ubase_assert(uref_flow_get_id(variant, &id));
+    return id;
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_hls_master_mgr = upipe_hls_master_mgr_alloc();
+    assert(upipe_hls_master_mgr != NULL);
+    struct upipe *upipe_hls_master = upipe_void_alloc(upipe_hls_master_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "hls master"));
+    assert(upipe_hls_master != NULL);
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "m3u.master.");
+    assert(uref != NULL);
+    ubase_assert(uref_uri_set_from_str(uref, "http://127.0.0.1/index.m3u8"));
+    ubase_assert(upipe_set_flow_def(upipe_hls_master, uref));
+    uref_free(uref);
+
+    static const uint64_t bandwidths[] = { 500000, 1000000, 2000000 };
+    for (unsigned i = 0; i < 3; i++) {
+        uref = uref_alloc_control(uref_mgr);
+        assert(uref != NULL);
+        ubase_assert(uref_m3u_set_uri(uref, "variant.m3u8"));
+        ubase_assert(uref_m3u_master_set_bandwidth(uref, bandwidths[i]));
+        if (i == 0)
+            uref_block_set_start(uref);
+        if (i == 2)
+            uref_block_set_end(uref);
+        upipe_input(upipe_hls_master, uref, NULL);
+    }
+    assert(nb_updates == 1);
+
+    /* no sample, start with the lowest variant */
+    assert(select_id(upipe_hls_master, UINT64_MAX) == 0);
+    assert(nb_selects == 1);
+
+    ubase_nassert(upipe_hls_master_add_sample(upipe_hls_master, 1000, 0));
+
+    /* 8 Mbps */
+    ubase_assert(upipe_hls_master_add_sample(upipe_hls_master,
+                                             1000000, UCLOCK_FREQ));
+    struct upipe_hls_master_abr_stats stats;
+    ubase_assert(upipe_hls_master_get_abr_stats(upipe_hls_master, &stats));
+    assert(stats.samples == 1);
+    assert(stats.estimate == 8000000);
+    assert(select_id(upipe_hls_master, 0) == 2);
+
+    /* not enough buffer to switch up */
+    struct upipe *upipe_buffer = upipe_void_alloc(&test_mgr,
+                                                  uprobe_use(uprobe_stdio));
+    assert(upipe_buffer != NULL);
+    ubase_assert(upipe_hls_master_set_buffer(upipe_hls_master, upipe_buffer));
+    buffered = UCLOCK_FREQ;
+    assert(select_id(upipe_hls_master, 0) == 0);
+    buffered = UCLOCK_FREQ * 5;
+    assert(select_id(upipe_hls_master, 0) == 2);
+
+    /* 800 kbps, the harmonic mean drops below 1.5 Mbps */
+    ubase_assert(upipe_hls_master_add_sample(upipe_hls_master,
+                                             100000, UCLOCK_FREQ));
+    ubase_assert(upipe_hls_master_get_abr_stats(upipe_hls_master, &stats));
+    assert(stats.samples == 2);
+    assert(stats.harmonic < stats.ewma);
+    assert(stats.estimate == stats.harmonic);
+    assert(select_id(upipe_hls_master, 2) == 1);
+
+    /* enough buffer to stay */
+    buffered = UCLOCK_FREQ * 9;
+    assert(select_id(upipe_hls_master, 2) == 2);
+
+    /* custom policy */
+    policy_id = 0;
+    assert(select_id(upipe_hls_master, 2) == 0);
+    policy_id = UINT64_MAX;
+
+    ubase_assert(upipe_hls_master_set_buffer(upipe_hls_master, NULL));
+    ubase_assert(upipe_hls_master_get_abr_stats(upipe_hls_master, &stats));
+    assert(stats.buffer == UCLOCK_FREQ * 9);
+    assert(stats.switches == 0);
+
+    upipe_release(upipe_hls_master);
+    upipe_mgr_release(upipe_hls_master_mgr); // nop
+
+    test_free(upipe_buffer);
+
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
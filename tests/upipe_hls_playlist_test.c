@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit test for hls playlist prefetching
+ * The items of a VOD playlist are fetched from a local server with a
+ * prefetch budget smaller than an item.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_m3u.h>
+#include <upipe/uref_m3u_playlist_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_http_source.h>
+#include <upipe-hls/upipe_hls_playlist.h>
+
+#include "http_server_test.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define MAX_IDLE 4
+#define PREFETCH_COUNT 2
+#define PREFETCH_SIZE 16384
+
+/** items of the playlist */
+static const struct http_server_test_file files[] = {
+    { "/seg0.ts", 200000, 0 },
+    { "/seg1.ts", 150000, 0 },
+    { "/seg2.ts", 100000, 0 },
+};
+#define NB_FILES (sizeof (files) / sizeof (files[0]))
+
+/** source manager given to the playlist */
+static struct upipe_mgr *source_mgr = NULL;
+/** index of the item being played */
+static unsigned int item_idx = 0;
+/** number of octets received for the item being played */
+static size_t offset = 0;
+/** number of played items */
+static unsigned int nb_items = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    if (event >= UPROBE_LOCAL) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        uint32_t signature = va_arg(args_copy, uint32_t);
+        va_end(args_copy);
+        if (signature != UPIPE_HLS_PLAYLIST_SIGNATURE)
+            return UBASE_ERR_NONE;
+    }
+
+    switch (event) {
+        case UPROBE_NEED_SOURCE_MGR: {
+            struct upipe_mgr **mgr_p = va_arg(args, struct upipe_mgr **);
+            *mgr_p = upipe_mgr_use(source_mgr);
+            return UBASE_ERR_NONE;
+        }
+        case UPROBE_HLS_PLAYLIST_RELOADED:
+            ubase_assert(upipe_hls_playlist_play(upipe));
+            return UBASE_ERR_NONE;
+        case UPROBE_HLS_PLAYLIST_ITEM_END:
+            assert(offset == files[item_idx].size);
+            nb_items++;
+            offset = 0;
+            if (++item_idx < NB_FILES) {
+                ubase_assert(upipe_hls_playlist_next(upipe));
+                ubase_assert(upipe_hls_playlist_play(upipe));
+            }
+            return UBASE_ERR_NONE;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe checking the played items */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    size_t read = 0;
+    while (read < size) {
+        int read_size = -1;
+        const uint8_t *buffer;
+        ubase_assert(uref_block_read(uref, read, &read_size, &buffer));
+        for (int i = 0; i < read_size; i++)
+            assert(buffer[i] == http_server_test_byte(files[item_idx].path,
+                                                      offset + read + i));
+        ubase_assert(uref_block_unmap(uref, read));
+        read += read_size;
+    }
+    offset += size;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+int main(int argc, char *argv[])
+{
+    signal(SIGPIPE, SIG_IGN);
+    int port = http_server_test_start(files, NB_FILES, 0);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
+            UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    source_mgr = upipe_http_src_mgr_alloc();
+    assert(source_mgr != NULL);
+    ubase_assert(upipe_http_src_mgr_set_keepalive(source_mgr, MAX_IDLE));
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink"));
+    assert(upipe_sink != NULL);
+
+    struct upipe_mgr *upipe_hls_playlist_mgr = upipe_hls_playlist_mgr_alloc();
+    assert(upipe_hls_playlist_mgr != NULL);
+    struct upipe *upipe_hls_playlist = upipe_void_alloc(
+        upipe_hls_playlist_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "playlist"));
+    assert(upipe_hls_playlist != NULL);
+    upipe_mgr_release(upipe_hls_playlist_mgr);
+    ubase_assert(upipe_set_output(upipe_hls_playlist, upipe_sink));
+    ubase_assert(upipe_hls_playlist_set_prefetch(upipe_hls_playlist,
+                                                 PREFETCH_COUNT,
+                                                 PREFETCH_SIZE));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr,
+                                                      "m3u.playlist.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_m3u_playlist_flow_set_type(flow_def, "VOD"));
+    ubase_assert(uref_m3u_playlist_flow_set_endlist(flow_def));
+    ubase_assert(uref_m3u_playlist_flow_set_media_sequence(flow_def, 0));
+    ubase_assert(upipe_set_flow_def(upipe_hls_playlist, flow_def));
+    uref_free(flow_def);
+
+    for (unsigned int i = 0; i < NB_FILES; i++) {
+        struct uref *item = uref_alloc(uref_mgr);
+        assert(item != NULL);
+        char uri[64];
+        snprintf(uri, sizeof (uri), "http://127.0.0.1:%d%s", port,
+                 files[i].path);
+        ubase_assert(uref_m3u_set_uri(item, uri));
+        if (i == NB_FILES - 1)
+            uref_block_set_end(item);
+        upipe_input(upipe_hls_playlist, item, NULL);
+    }
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    assert(nb_items == NB_FILES);
+    struct upipe_hls_playlist_stats stats;
+    ubase_assert(upipe_hls_playlist_get_stats(upipe_hls_playlist, &stats));
+    assert(stats.items == NB_FILES);
+    assert(stats.prefetched == NB_FILES - 1);
+    /* the prefetched items are larger than the budget */
+    assert(stats.paused > 0);
+
+    upipe_release(upipe_hls_playlist);
+    test_free(upipe_sink);
+    /* closes the idle connections */
+    upipe_mgr_release(source_mgr);
+    http_server_test_stop();
+    assert(http_server_test_requests() == NB_FILES);
+
+    upump_mgr_release(upump_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
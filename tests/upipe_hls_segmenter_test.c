@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for hls segmenter pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-hls/upipe_hls_segmenter.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+/** interval between two buffers */
+#define INTERVAL (UCLOCK_FREQ / 10)
+/** number of buffers per random access point */
+#define RAP_INTERVAL 10
+/** number of buffers */
+#define NB_BUFFERS 35
+
+static const char *dir;
+static unsigned int nb_segments = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEED_UPUMP_MGR:
+            break;
+        case UPROBE_HLS_SEGMENTER_SUB_SEGMENT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HLS_SEGMENTER_SUB_SIGNATURE);
+            uint64_t sequence = va_arg(args, uint64_t);
+            uint64_t duration = va_arg(args, uint64_t);
+            uint64_t size = va_arg(args, uint64_t);
+            /* both renditions cut their segments on the same buffers */
+            assert(sequence == nb_segments / 2);
+            if (sequence < 3)
+                assert(duration == INTERVAL * RAP_INTERVAL);
+            else
+                assert(duration == INTERVAL * (NB_BUFFERS % RAP_INTERVAL));
+            /* the last transport stream segment misses the packet before
+             * the next random access point */
+            uint64_t nb = duration / INTERVAL;
+            assert(size == TS_SIZE * nb || size == TS_SIZE * 2 * nb ||
+                   (sequence == 3 && size == TS_SIZE * (2 * nb - 1)));
+            nb_segments++;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** checks that a file exists and contains a string */
+static bool check_file(const char *name, const char *string)
+{
+    char path[strlen(dir) + strlen(name) + 2];
+    sprintf(path, "%s/%s", dir, name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+    char buffer[8192];
+    size_t size = fread(buffer, 1, sizeof (buffer) - 1, file);
+    fclose(file);
+    buffer[size] = '\0';
+    return string == NULL || strstr(buffer, string) != NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    assert(argc >= 2);
+    dir = argv[1];
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0,
+                                                         -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_hls_segmenter_mgr =
+        upipe_hls_segmenter_mgr_alloc();
+    assert(upipe_hls_segmenter_mgr != NULL);
+    struct upipe *segmenter = upipe_void_alloc(upipe_hls_segmenter_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "segmenter"));
+    assert(segmenter != NULL);
+    ubase_assert(upipe_hls_segmenter_set_path(segmenter, dir,
+                                              "master.m3u8"));
+    ubase_nassert(upipe_hls_segmenter_set_duration(segmenter, UCLOCK_FREQ,
+                                                   UCLOCK_FREQ * 2));
+    ubase_assert(upipe_hls_segmenter_set_duration(segmenter, UCLOCK_FREQ,
+                                                  UCLOCK_FREQ / 4));
+    ubase_assert(upipe_hls_segmenter_set_window(segmenter, 1));
+
+    /* transport stream rendition */
+    struct upipe *ts = upipe_void_alloc_sub(segmenter,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts"));
+    assert(ts != NULL);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(ts, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_hls_segmenter_sub_set_name(ts, "ts"));
+
+    /* fragmented mp4 rendition with an initialization section */
+    struct upipe *cmaf = upipe_void_alloc_sub(segmenter,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "cmaf"));
+    assert(cmaf != NULL);
+    flow_def = uref_block_flow_alloc_def(uref_mgr, "mp4.");
+    assert(flow_def != NULL);
+    static const uint8_t init[] = { 0, 0, 0, 8, 'f', 't', 'y', 'p' };
+    ubase_assert(uref_flow_set_headers(flow_def, init, sizeof (init)));
+    ubase_assert(upipe_set_flow_def(cmaf, flow_def));
+    uref_free(flow_def);
+    const char *name;
+    ubase_assert(upipe_hls_segmenter_sub_get_name(cmaf, &name));
+    assert(!strcmp(name, "stream1"));
+
+    for (unsigned int i = 0; i < NB_BUFFERS; i++) {
+        bool rap = !(i % RAP_INTERVAL);
+
+        /* the random access point is the second packet */
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                             TS_SIZE * 2);
+        assert(uref != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        ts_pad(buffer);
+        ts_pad(buffer + TS_SIZE);
+        if (rap) {
+            ts_set_pid(buffer + TS_SIZE, 68);
+            ts_set_unitstart(buffer + TS_SIZE);
+            ts_set_adaptation(buffer + TS_SIZE, 1);
+            tsaf_set_randomaccess(buffer + TS_SIZE);
+        }
+        uref_block_unmap(uref, 0);
+        uref_clock_set_cr_sys(uref, UCLOCK_FREQ + i * INTERVAL);
+        upipe_input(ts, uref, NULL);
+
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+        assert(uref != NULL);
+        if (rap)
+            uref_flow_set_random(uref);
+        uref_clock_set_dts_prog(uref, i * INTERVAL);
+        upipe_input(cmaf, uref, NULL);
+
+        if (i == RAP_INTERVAL + 3) {
+            /* the files are written by the writer thread */
+            ubase_assert(upipe_hls_segmenter_sync(segmenter));
+            assert(check_file("ts.m3u8", "#EXT-X-PART-INF:PART-TARGET=0.250"));
+            assert(check_file("ts.m3u8", "#EXT-X-PRELOAD-HINT:TYPE=PART,"
+                              "URI=\"ts_1.ts\",BYTERANGE-START=564"));
+            assert(check_file("ts.m3u8", "#EXT-X-PART:DURATION=0.20000,"
+                              "URI=\"ts_1.ts\",BYTERANGE=\"564@0\","
+                              "INDEPENDENT=YES"));
+            assert(check_file("master.m3u8", "ts.m3u8"));
+            assert(!check_file("ts.m3u8.tmp", NULL));
+        }
+    }
+    assert(nb_segments == 6);
+    ubase_assert(upipe_hls_segmenter_sync(segmenter));
+
+    /* only the last segment is listed, the previous one is kept */
+    assert(!check_file("ts_0.ts", NULL));
+    assert(check_file("ts_1.ts", NULL));
+    assert(check_file("ts.m3u8", "#EXT-X-MEDIA-SEQUENCE:2"));
+    assert(!check_file("ts.m3u8", "ts_1.ts\n"));
+    assert(check_file("stream1_init0.mp4", NULL));
+    assert(check_file("stream1.m3u8", "#EXT-X-MAP:URI=\"stream1_init0.mp4\""));
+
+    upipe_release(ts);
+    upipe_release(cmaf);
+    assert(nb_segments == 8);
+    ubase_assert(upipe_hls_segmenter_sync(segmenter));
+    assert(check_file("ts.m3u8", "#EXT-X-ENDLIST"));
+    assert(check_file("ts.m3u8", "ts_3.ts"));
+    assert(!check_file("ts_1.ts", NULL));
+    assert(check_file("stream1.m3u8", "#EXT-X-ENDLIST"));
+    assert(check_file("master.m3u8", "#EXT-X-STREAM-INF:BANDWIDTH=30080,"
+                      "AVERAGE-BANDWIDTH=30080\nts.m3u8\n"));
+    assert(check_file("master.m3u8", "stream1.m3u8"));
+
+    upipe_release(segmenter);
+    upipe_mgr_release(upipe_hls_segmenter_mgr); // nop
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+set -e
+
+srcdir="$1"
+
+TMP="`mktemp -d tmp.XXXXXXXXXX`"
+cleanup() { rm -rf "$TMP"; }
+trap cleanup EXIT
+
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_hls_segmenter_test "$TMP"
@@ -25,18 +25,20 @@
 
 /** @file
  * @short unit test for http source
+ * Without arguments, the files of a local server are fetched on a kept
+ * connection which the server closes after a few requests.
  */
 
 #undef NDEBUG
 
+#include <upipe/ulist.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
+#include <upipe/uclock.h>
 #include <upipe/uprobe_prefix.h>
 #include <upipe/uprobe_uref_mgr.h>
 #include <upipe/uprobe_upump_mgr.h>
 #include <upipe/uprobe_ubuf_mem.h>
-#include <upipe/uclock.h>
-#include <upipe/uclock_std.h>
 #include <upipe/umem.h>
 #include <upipe/umem_alloc.h>
 #include <upipe/udict.h>
@@ -45,16 +47,19 @@
 #include <upipe/ubuf_block.h>
 #include <upipe/ubuf_block_mem.h>
 #include <upipe/uref.h>
+#include <upipe/uref_block.h>
 #include <upipe/uref_std.h>
 #include <upipe/upump.h>
 #include <upump-ev/upump_ev.h>
 #include <upipe/upipe.h>
 #include <upipe-modules/upipe_http_source.h>
-#include <upipe-modules/upipe_null.h>
+
+#include "http_server_test.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <signal.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
@@ -66,6 +71,60 @@
 #define UPUMP_BLOCKER_POOL 1
 #define READ_SIZE 4096
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define MAX_IDLE 2
+#define MAX_REQUESTS 2
+
+/** files served by the local server */
+static const struct http_server_test_file files[] = {
+    { "/a", 10000, 0 },
+    { "/b", 50000, 0 },
+    { "/c", 3000, 0 },
+    { "/d", 20000, 0 },
+    /* chunked bodies crossing several receive buffers */
+    { "/e", 400000, 1000 },
+    { "/f", 300000, 70000 },
+};
+#define NB_FILES (sizeof (files) / sizeof (files[0]))
+
+/** urls to fetch in sequence */
+static char **urls;
+/** number of urls to fetch */
+static int nb_urls;
+/** index of the url being fetched */
+static int url_idx = 0;
+/** true if the received bodies are checked against the local server */
+static bool check = false;
+/** buffers received for the url being fetched, kept until its end so that
+ * the receive buffers are shared while the next octets are decoded */
+static struct uchain received;
+
+/** checks and frees the buffers received for the url being fetched */
+static void check_received(void)
+{
+    size_t offset = 0;
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&received)) != NULL) {
+        struct uref *uref = uref_from_uchain(uchain);
+        size_t size;
+        ubase_assert(uref_block_size(uref, &size));
+        size_t read = 0;
+        while (check && read < size) {
+            int read_size = -1;
+            const uint8_t *buffer;
+            ubase_assert(uref_block_read(uref, read, &read_size, &buffer));
+            for (int i = 0; i < read_size; i++)
+                assert(buffer[i] ==
+                       http_server_test_byte(files[url_idx].path,
+                                             offset + read + i));
+            ubase_assert(uref_block_unmap(uref, read));
+            read += read_size;
+        }
+        offset += size;
+        uref_free(uref);
+    }
+    if (check)
+        assert(offset == files[url_idx].size);
+}
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -77,21 +136,84 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
         case UPROBE_SOURCE_END:
+            check_received();
+            /* fetch the next url, reusing the connection if possible */
+            if (++url_idx < nb_urls)
+                ubase_assert(upipe_set_uri(upipe, urls[url_idx]));
             break;
     }
     return UBASE_ERR_NONE;
 }
 
-int main(int argc, char *argv[])
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
 {
-    const char *url;
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe keeping the received bodies */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    ulist_add(&received, uref_to_uchain(uref));
+}
 
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+int main(int argc, char *argv[])
+{
+    char local_urls[NB_FILES][64];
+    char *local_urls_p[NB_FILES];
+    ulist_init(&received);
     if (argc < 2) {
-        fprintf(stdout, "Usage: %s <url>\n", argv[0]);
-        exit(EXIT_FAILURE);
+        /* fetch the files of a local server which closes the kept
+         * connection after MAX_REQUESTS requests */
+        int port = http_server_test_start(files, NB_FILES, MAX_REQUESTS);
+        for (unsigned int i = 0; i < NB_FILES; i++) {
+            snprintf(local_urls[i], sizeof (local_urls[i]),
+                     "http://127.0.0.1:%d%s", port, files[i].path);
+            local_urls_p[i] = local_urls[i];
+        }
+        urls = local_urls_p;
+        nb_urls = NB_FILES;
+        check = true;
+        signal(SIGPIPE, SIG_IGN);
+    } else {
+        urls = argv + 1;
+        nb_urls = argc - 1;
     }
-    url = argv[1];
 
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     assert(umem_mgr != NULL);
@@ -104,8 +226,6 @@ int main(int argc, char *argv[])
     struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
             UPUMP_BLOCKER_POOL);
     assert(upump_mgr != NULL);
-    struct uclock *uclock = uclock_std_alloc(0);
-    assert(uclock != NULL);
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
     struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
@@ -119,33 +239,46 @@ int main(int argc, char *argv[])
                                    UBUF_POOL_DEPTH);
     assert(logger != NULL);
 
-    struct upipe_mgr *upipe_null_mgr = upipe_null_mgr_alloc();
-    struct upipe *upipe_null = upipe_void_alloc(upipe_null_mgr,
-            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
-                             "null"));
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink"));
+    assert(upipe_sink != NULL);
 
     struct upipe_mgr *upipe_http_src_mgr = upipe_http_src_mgr_alloc();
     assert(upipe_http_src_mgr != NULL);
+    ubase_assert(upipe_http_src_mgr_set_keepalive(upipe_http_src_mgr,
+                                                  MAX_IDLE));
+    ubase_assert(upipe_http_src_mgr_set_dns_cache(upipe_http_src_mgr, 1,
+                                                  UCLOCK_FREQ));
     struct upipe *upipe_http_src = upipe_void_alloc(upipe_http_src_mgr,
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
                              "http"));
     assert(upipe_http_src != NULL);
-    assert(upipe_set_output_size(upipe_http_src, READ_SIZE));
-    assert(upipe_set_uri(upipe_http_src, url));
-    assert(upipe_set_output(upipe_http_src, upipe_null));
-    upipe_release(upipe_null);
+    ubase_assert(upipe_set_output_size(upipe_http_src, READ_SIZE));
+    ubase_assert(upipe_set_uri(upipe_http_src, urls[0]));
+    ubase_assert(upipe_set_output(upipe_http_src, upipe_sink));
 
     upump_mgr_run(upump_mgr, NULL);
+    assert(url_idx == nb_urls);
 
     upipe_release(upipe_http_src);
-    upipe_mgr_release(upipe_http_src_mgr); // nop
-    upipe_mgr_release(upipe_null_mgr); // nop
+    /* closes the idle connections */
+    upipe_mgr_release(upipe_http_src_mgr);
+    test_free(upipe_sink);
+
+    if (check) {
+        http_server_test_stop();
+        /* the request following MAX_REQUESTS requests is refused on the
+         * kept connection, and sent again on a new one */
+        assert(http_server_test_connections() ==
+               (NB_FILES + MAX_REQUESTS - 1) / MAX_REQUESTS);
+        assert(http_server_test_requests() ==
+               NB_FILES + (NB_FILES - 1) / MAX_REQUESTS);
+    }
 
     upump_mgr_release(upump_mgr);
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
-    uclock_release(uclock);
     uprobe_release(logger);
     uprobe_clean(&uprobe);
 
@@ -13,3 +13,8 @@ for file in "$srcdir"/upipe_m3u_reader_test_files/*.m3u; do
     "$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_m3u_reader_test $file > "$TMP"/logs
     diff -u "$file".logs "$TMP"/logs
 done
+
+# reload of a live playlist
+dir="$srcdir"/upipe_m3u_reader_test_files/reload
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_m3u_reader_test "$dir"/1.m3u "$dir"/2.m3u > "$TMP"/logs
+diff -u "$dir"/2.m3u.logs "$TMP"/logs
@@ -79,6 +79,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEED_USTATS:
         case UPROBE_NEW_FLOW_DEF:
             break;
         case UPROBE_CLOCK_REF: {
@@ -46,7 +46,13 @@
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_std.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
 #include <upipe/upipe.h>
+#include <upipe-pthread/uprobe_pthread_upump_mgr.h>
+#include <upipe-modules/upipe_transfer.h>
+#include <upipe-modules/upipe_worker_linear.h>
 #include <upipe-ts/upipe_ts_demux.h>
 #include <upipe-ts/upipe_ts_pat_decoder.h>
 #include <upipe-ts/upipe_ts_pmt_decoder.h>
@@ -57,8 +63,10 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/ts.h>
@@ -70,14 +78,45 @@
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define XFER_QUEUE 255
+#define XFER_POOL 1
+#define ES_PACKETS 8
+#define ES_CAPTURE_SIZE (ES_PACKETS * TS_SIZE)
+#define ES_TIMER (UCLOCK_FREQ / 100)
+#define ES_MAX_TICKS 1000
 
 static struct upipe *upipe_ts_demux;
 static struct upipe *upipe_ts_demux_output_pmt = NULL;
 static struct upipe *upipe_ts_demux_output_video = NULL;
 static struct uprobe *logger;
+static struct uprobe *uprobe_upump;
 static uint64_t wanted_flow_id;
 static int expect_new_flow_def = 0;
 
+/** elementary stream received by the sink */
+struct es_capture {
+    /** number of urefs */
+    unsigned int nb;
+    /** PTS of the urefs */
+    uint64_t pts[ES_PACKETS];
+    /** total size */
+    size_t size;
+    /** concatenated payload */
+    uint8_t data[ES_CAPTURE_SIZE];
+};
+
+/** outputs of the single-thread and worker runs */
+static struct es_capture es_captures[2];
+static struct es_capture *es_capture = NULL;
+/** sink of the video output, or NULL */
+static struct upipe *es_sink = NULL;
+/** number of urefs expected in the sink before tearing down */
+static unsigned int es_expected;
+/** number of timer ticks waiting for the sink */
+static unsigned int es_ticks;
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -88,6 +127,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEED_USTATS:
         case UPROBE_SYNC_ACQUIRED:
         case UPROBE_SYNC_LOST:
         case UPROBE_CLOCK_REF:
@@ -96,6 +136,8 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_TS_SPLIT_DEL_PID:
         case UPROBE_NEW_FLOW_DEF:
         case UPROBE_SOURCE_END:
+        case UPROBE_NEED_UPUMP_MGR:
+        case UPROBE_STALLED:
             break;
         case UPROBE_SPLIT_UPDATE: {
             struct uref *flow_def = NULL;
@@ -131,11 +173,16 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
                                              "ts demux video"),
                             flow_def);
                     assert(upipe_ts_demux_output_video != NULL);
+                    if (es_sink != NULL)
+                        ubase_assert(upipe_set_output(
+                                upipe_ts_demux_output_video, es_sink));
                 }
             }
             break;
         }
         case UPROBE_NEED_OUTPUT:
+            if (es_sink != NULL)
+                break;
             assert(expect_new_flow_def);
             expect_new_flow_def--;
             break;
@@ -143,6 +190,305 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** helper phony pipe */
+static struct upipe *es_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                              uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void es_input(struct upipe *upipe, struct uref *uref,
+                     struct upump **upump_p)
+{
+    if (es_capture == NULL) {
+        /* frames flushed while tearing down are not compared */
+        uref_free(uref);
+        return;
+    }
+    assert(es_capture->nb < ES_PACKETS);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(es_capture->size + size <= ES_CAPTURE_SIZE);
+    ubase_assert(uref_block_extract(uref, 0, size,
+                                    es_capture->data + es_capture->size));
+    es_capture->size += size;
+    uint64_t pts = UINT64_MAX;
+    uref_clock_get_pts_orig(uref, &pts);
+    es_capture->pts[es_capture->nb++] = pts;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int es_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            const char *def;
+            ubase_assert(uref_flow_get_def(flow_def, &def));
+            assert(!ubase_ncmp(def, "block.mpeg2video."));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void es_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr es_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = es_alloc,
+    .upipe_input = es_input,
+    .upipe_control = es_control
+};
+
+/** thread running the framer worker */
+static void *es_worker(void *_upipe_xfer_mgr)
+{
+    struct upipe_mgr *upipe_xfer_mgr = (struct upipe_mgr *)_upipe_xfer_mgr;
+
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_loop(UPUMP_POOL,
+                                                          UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    uprobe_pthread_upump_mgr_set(uprobe_upump, upump_mgr);
+
+    ubase_assert(upipe_xfer_mgr_attach(upipe_xfer_mgr, upump_mgr));
+    upipe_mgr_release(upipe_xfer_mgr);
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    upump_mgr_release(upump_mgr);
+    return NULL;
+}
+
+/** @This inputs a PAT announcing program 12 on PID 42. */
+static void es_input_pat(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 0);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pat_init(payload);
+    pat_set_length(payload, PAT_PROGRAM_SIZE);
+    pat_set_tsid(payload, 42);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    uint8_t *pat_program = pat_get_program(payload, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 12);
+    patn_set_pid(pat_program, 42);
+    psi_set_crc(payload);
+    payload += PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE;
+    *payload = 0xff;
+    uref_block_unmap(uref, 0);
+    wanted_flow_id = 12;
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+/** @This inputs a PMT announcing an MPEG-2 video ES on PID 43. */
+static void es_input_pmt(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 42);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    uint8_t *payload = ts_payload(buffer);
+    *payload++ = 0; /* pointer_field */
+    pmt_init(payload);
+    pmt_set_length(payload, PMT_ES_SIZE);
+    pmt_set_program(payload, 12);
+    psi_set_version(payload, 0);
+    psi_set_current(payload);
+    psi_set_section(payload, 0);
+    psi_set_lastsection(payload, 0);
+    pmt_set_pcrpid(payload, 43);
+    pmt_set_desclength(payload, 0);
+    uint8_t *pmt_es = pmt_get_es(payload, 0);
+    pmtn_init(pmt_es);
+    pmtn_set_pid(pmt_es, 43);
+    pmtn_set_streamtype(pmt_es, 2);
+    pmtn_set_desclength(pmt_es, 0);
+    psi_set_crc(payload);
+    payload += PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE;
+    *payload = 0xff;
+    uref_block_unmap(uref, 0);
+    wanted_flow_id = 43;
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+/** @This inputs an MPEG-2 I picture in a single TS packet on PID 43.
+ *
+ * @param i index of the picture
+ */
+static void es_input_picture(struct uref_mgr *uref_mgr,
+                             struct ubuf_mgr *ubuf_mgr, unsigned int i)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_pid(buffer, 43);
+    ts_set_cc(buffer, i & 0xf);
+    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE -
+            PES_HEADER_SIZE_PTSDTS - MP2VSEQ_HEADER_SIZE -
+            MP2VSEQX_HEADER_SIZE - MP2VPIC_HEADER_SIZE -
+            MP2VPICX_HEADER_SIZE - 4 - MP2VEND_HEADER_SIZE - 1);
+    ts_set_payload(buffer);
+    if (!i)
+        tsaf_set_discontinuity(buffer);
+    tsaf_set_randomaccess(buffer);
+    tsaf_set_pcr(buffer, (27000000 + i * 40 * 27000) / 300);
+    tsaf_set_pcrext(buffer, (27000000 + i * 40 * 27000) % 300);
+    uint8_t *payload = ts_payload(buffer);
+    pes_init(payload);
+    pes_set_streamid(payload, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_headerlength(payload, 0);
+    pes_set_length(payload, MP2VSEQ_HEADER_SIZE + MP2VSEQX_HEADER_SIZE +
+            MP2VPIC_HEADER_SIZE + MP2VPICX_HEADER_SIZE + 4 +
+            MP2VEND_HEADER_SIZE + PES_HEADER_SIZE_PTSDTS - PES_HEADER_SIZE);
+    pes_set_dataalignment(payload);
+    pes_set_pts(payload, (27000000 + i * 40 * 27000) / 300 * 3);
+    pes_set_dts(payload, (27000000 + i * 40 * 27000) / 300 * 2);
+    payload = pes_payload(payload);
+    mp2vseq_init(payload);
+    mp2vseq_set_horizontal(payload, 720);
+    mp2vseq_set_vertical(payload, 576);
+    mp2vseq_set_aspect(payload, MP2VSEQ_ASPECT_16_9);
+    mp2vseq_set_framerate(payload, MP2VSEQ_FRAMERATE_25);
+    mp2vseq_set_bitrate(payload, 2000000/400);
+    mp2vseq_set_vbvbuffer(payload, 1835008/16/1024);
+    payload += MP2VSEQ_HEADER_SIZE;
+
+    mp2vseqx_init(payload);
+    mp2vseqx_set_profilelevel(payload,
+                              MP2VSEQX_PROFILE_MAIN | MP2VSEQX_LEVEL_MAIN);
+    mp2vseqx_set_chroma(payload, MP2VSEQX_CHROMA_420);
+    mp2vseqx_set_horizontal(payload, 0);
+    mp2vseqx_set_vertical(payload, 0);
+    mp2vseqx_set_bitrate(payload, 0);
+    mp2vseqx_set_vbvbuffer(payload, 0);
+    payload += MP2VSEQX_HEADER_SIZE;
+
+    mp2vpic_init(payload);
+    mp2vpic_set_temporalreference(payload, 0);
+    mp2vpic_set_codingtype(payload, MP2VPIC_TYPE_I);
+    mp2vpic_set_vbvdelay(payload, UINT16_MAX);
+    payload += MP2VPIC_HEADER_SIZE;
+
+    mp2vpicx_init(payload);
+    mp2vpicx_set_fcode00(payload, 0);
+    mp2vpicx_set_fcode01(payload, 0);
+    mp2vpicx_set_fcode10(payload, 0);
+    mp2vpicx_set_fcode11(payload, 0);
+    mp2vpicx_set_intradc(payload, 0);
+    mp2vpicx_set_structure(payload, MP2VPICX_FRAME_PICTURE);
+    mp2vpicx_set_tff(payload);
+    payload += MP2VPICX_HEADER_SIZE;
+
+    mp2vstart_init(payload, 1);
+    payload += 4;
+
+    mp2vend_init(payload);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_demux, uref, NULL);
+}
+
+/** @This allocates a demux with an ES sink and inputs a program. */
+static void es_start(struct upipe_mgr *upipe_ts_demux_mgr,
+                     struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                     struct es_capture *capture)
+{
+    memset(capture, 0, sizeof(*capture));
+    es_capture = capture;
+    es_sink = upipe_void_alloc(&es_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "es sink"));
+    assert(es_sink != NULL);
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts demux"));
+    assert(upipe_ts_demux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
+    uref_free(uref);
+
+    es_input_pat(uref_mgr, ubuf_mgr);
+    assert(upipe_ts_demux_output_pmt != NULL);
+    es_input_pmt(uref_mgr, ubuf_mgr);
+    assert(upipe_ts_demux_output_video != NULL);
+    for (unsigned int i = 0; i < ES_PACKETS; i++)
+        es_input_picture(uref_mgr, ubuf_mgr, i);
+}
+
+/** @This releases the demux allocated by @ref es_start. The sink is freed
+ * separately, once the outputs of the workers are torn down. */
+static void es_stop(void)
+{
+    upipe_release(upipe_ts_demux_output_video);
+    upipe_ts_demux_output_video = NULL;
+    upipe_release(upipe_ts_demux_output_pmt);
+    upipe_ts_demux_output_pmt = NULL;
+    upipe_release(upipe_ts_demux);
+    upipe_ts_demux = NULL;
+}
+
+/** @This waits for the outputs of the framer worker. */
+static void es_timer(struct upump *upump)
+{
+    struct upipe_mgr *upipe_ts_demux_mgr = upump_get_opaque(upump,
+                                                            struct upipe_mgr *);
+    assert(++es_ticks < ES_MAX_TICKS);
+    if (es_capture->nb < es_expected)
+        return;
+
+    es_capture = NULL;
+    es_stop();
+    ubase_assert(upipe_ts_demux_mgr_clear_workers(upipe_ts_demux_mgr));
+    upump_stop(upump);
+    upump_free(upump);
+}
+
 int main(int argc, char *argv[])
 {
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -161,6 +507,9 @@ int main(int argc, char *argv[])
     uprobe_init(&uprobe, catch, NULL);
     logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
     assert(logger != NULL);
+    logger = uprobe_pthread_upump_mgr_alloc(logger);
+    assert(logger != NULL);
+    uprobe_upump = logger;
     logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
     assert(logger != NULL);
     logger = uprobe_ubuf_mem_alloc(logger, umem_mgr,
@@ -393,9 +742,60 @@ int main(int argc, char *argv[])
     assert(!expect_new_flow_def);
 
     upipe_release(upipe_ts_demux_output_video);
+    upipe_ts_demux_output_video = NULL;
     upipe_release(upipe_ts_demux_output_pmt);
+    upipe_ts_demux_output_pmt = NULL;
     upipe_release(upipe_ts_demux);
 
+    /* reference elementary stream, framed in the thread of the demux */
+    es_start(upipe_ts_demux_mgr, uref_mgr, ubuf_mgr, &es_captures[0]);
+    es_capture = NULL;
+    es_stop();
+    es_free(es_sink);
+    es_sink = NULL;
+    assert(es_captures[0].nb);
+
+    /* same elementary stream, framed in a worker thread */
+    struct upump_mgr *upump_mgr =
+        upump_ev_mgr_alloc_default(UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    uprobe_pthread_upump_mgr_set(uprobe_upump, upump_mgr);
+
+    struct upipe_mgr *upipe_xfer_mgr =
+        upipe_xfer_mgr_alloc(XFER_QUEUE, XFER_POOL, NULL);
+    assert(upipe_xfer_mgr != NULL);
+    upipe_mgr_use(upipe_xfer_mgr);
+    pthread_t worker_id;
+    assert(pthread_create(&worker_id, NULL, es_worker, upipe_xfer_mgr) == 0);
+
+    struct upipe_mgr *upipe_wlin_mgr = upipe_wlin_mgr_alloc(upipe_xfer_mgr);
+    assert(upipe_wlin_mgr != NULL);
+    upipe_mgr_release(upipe_xfer_mgr);
+    ubase_assert(upipe_ts_demux_mgr_add_worker(upipe_ts_demux_mgr,
+                                               upipe_wlin_mgr,
+                                               uprobe_use(logger)));
+    upipe_mgr_release(upipe_wlin_mgr);
+
+    es_start(upipe_ts_demux_mgr, uref_mgr, ubuf_mgr, &es_captures[1]);
+    es_expected = es_captures[0].nb;
+    struct upump *upump = upump_alloc_timer(upump_mgr, es_timer,
+                                            upipe_ts_demux_mgr, NULL,
+                                            ES_TIMER, ES_TIMER);
+    assert(upump != NULL);
+    upump_start(upump);
+    upump_mgr_run(upump_mgr, NULL);
+    assert(!pthread_join(worker_id, NULL));
+    upump_mgr_release(upump_mgr);
+    es_free(es_sink);
+    es_sink = NULL;
+
+    assert(es_captures[1].nb == es_captures[0].nb);
+    assert(es_captures[1].size == es_captures[0].size);
+    assert(!memcmp(es_captures[1].pts, es_captures[0].pts,
+                   sizeof(es_captures[0].pts)));
+    assert(!memcmp(es_captures[1].data, es_captures[0].data,
+                   es_captures[0].size));
+
     upipe_mgr_release(upipe_ts_demux_mgr);
     upipe_mgr_release(upipe_autof_mgr);
 
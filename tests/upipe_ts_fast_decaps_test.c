@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2012-2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS fast decaps module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_fast_decaps.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+static unsigned int nb_packets = 0;
+static uint64_t pcr = 0;
+static uint64_t pts = 0;
+static uint64_t dts = 0;
+static size_t payload_size = 0;
+static int start = UBASE_ERR_NONE;
+static int end = UBASE_ERR_INVALID;
+static int discontinuity = UBASE_ERR_NONE;
+static bool expect_acquired = true;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_SYNC_ACQUIRED:
+            assert(expect_acquired);
+            expect_acquired = false;
+            break;
+        case UPROBE_CLOCK_REF: {
+            struct uref *uref = va_arg(args, struct uref *);
+            uint64_t decaps_pcr = va_arg(args, uint64_t);
+            assert(uref != NULL);
+            assert(decaps_pcr == pcr);
+            ubase_assert(uref_clock_get_ref(uref));
+            pcr = 0;
+            break;
+        }
+        case UPROBE_CLOCK_TS: {
+            struct uref *uref = va_arg(args, struct uref *);
+            uint64_t decaps_pts = UINT64_MAX, decaps_dts = UINT64_MAX;
+            assert(uref != NULL);
+            uref_clock_get_pts_orig(uref, &decaps_pts);
+            uref_clock_get_dts_orig(uref, &decaps_dts);
+            assert(decaps_pts == pts * 300);
+            assert(decaps_dts == dts * 300);
+            pts = dts = 0;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == payload_size);
+    assert(start == uref_block_get_start(uref));
+    assert(end == uref_block_get_end(uref));
+    assert(discontinuity == uref_flow_get_discontinuity(uref));
+    uref_free(uref);
+    nb_packets--;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            ubase_assert(uref_flow_match_def(flow_def, "block.mpeg2video."));
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.mpegtspes.mpeg2video.");
+    assert(uref != NULL);
+
+    struct upipe_mgr *upipe_ts_fastd_mgr = upipe_ts_fastd_mgr_alloc();
+    assert(upipe_ts_fastd_mgr != NULL);
+    struct upipe *upipe_ts_fastd = upipe_void_alloc(upipe_ts_fastd_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts fastd"));
+    assert(upipe_ts_fastd != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_fastd, uref));
+    ubase_assert(upipe_set_output(upipe_ts_fastd, upipe_sink));
+    uref_free(uref);
+
+    /* PCR, PES header with PTS and DTS, and payload in one packet */
+    uint8_t *buffer;
+    int size;
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_cc(buffer, 0);
+    ts_set_payload(buffer);
+    ts_set_adaptation(buffer, 7);
+    pcr = 0x112121212;
+    tsaf_set_pcr(buffer, pcr / 300);
+    tsaf_set_pcrext(buffer, pcr % 300);
+    uint8_t *pes = ts_payload(buffer);
+    pes_init(pes);
+    pes_set_streamid(pes, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_length(pes, TS_SIZE - 12 + TS_SIZE - TS_HEADER_SIZE -
+                        PES_HEADER_SIZE);
+    pes_set_headerlength(pes, PES_HEADER_SIZE_PTSDTS - PES_HEADER_SIZE_NOPTS);
+    pts = 0x112121212;
+    dts = 0x112121212 - 1080000;
+    pes_set_pts(pes, pts);
+    pes_set_dts(pes, dts);
+    uref_block_unmap(uref, 0);
+    payload_size = TS_SIZE - 12 - PES_HEADER_SIZE_PTSDTS;
+    discontinuity = UBASE_ERR_NONE;
+    nb_packets++;
+    upipe_input(upipe_ts_fastd, uref, NULL);
+    assert(!nb_packets);
+    assert(!pcr);
+    assert(!pts);
+    assert(!expect_acquired);
+
+    /* end of the PES */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    ts_init(buffer);
+    ts_set_cc(buffer, 1);
+    ts_set_payload(buffer);
+    uref_block_unmap(uref, 0);
+    payload_size = TS_SIZE - TS_HEADER_SIZE;
+    start = UBASE_ERR_INVALID;
+    end = UBASE_ERR_NONE;
+    discontinuity = UBASE_ERR_INVALID;
+    nb_packets++;
+    upipe_input(upipe_ts_fastd, uref, NULL);
+    assert(!nb_packets);
+
+    /* PES header split across two packets, after a lost packet */
+    uint8_t header[PES_HEADER_SIZE_PTS];
+    pes_init(header);
+    pes_set_streamid(header, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_length(header, 0);
+    pes_set_headerlength(header, PES_HEADER_SIZE_PTS - PES_HEADER_SIZE_NOPTS);
+    pes_set_pts(header, 0x112121212);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    ts_init(buffer);
+    ts_set_unitstart(buffer);
+    ts_set_cc(buffer, 3);
+    ts_set_payload(buffer);
+    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE - 1 - 4);
+    memcpy(ts_payload(buffer), header, 4);
+    uref_block_unmap(uref, 0);
+    /* no output yet */
+    upipe_input(upipe_ts_fastd, uref, NULL);
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    ts_init(buffer);
+    ts_set_cc(buffer, 4);
+    ts_set_payload(buffer);
+    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE - 1 - 30);
+    memcpy(ts_payload(buffer), header + 4, PES_HEADER_SIZE_PTS - 4);
+    uref_block_unmap(uref, 0);
+    pts = dts = 0x112121212;
+    payload_size = 4 + 30 - PES_HEADER_SIZE_PTS;
+    start = UBASE_ERR_NONE;
+    end = UBASE_ERR_INVALID;
+    discontinuity = UBASE_ERR_NONE;
+    nb_packets++;
+    upipe_input(upipe_ts_fastd, uref, NULL);
+    assert(!nb_packets);
+    assert(!pts);
+
+    uint64_t lost;
+    ubase_assert(upipe_ts_decaps_get_packets_lost(upipe_ts_fastd, &lost));
+    assert(lost == 1);
+
+    /* segmented packet */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 100);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    ts_init(buffer);
+    ts_set_cc(buffer, 5);
+    ts_set_payload(buffer);
+    uref_block_unmap(uref, 0);
+    struct ubuf *ubuf = ubuf_block_alloc(ubuf_mgr, TS_SIZE - 100);
+    assert(ubuf != NULL);
+    ubase_assert(uref_block_append(uref, ubuf));
+    payload_size = TS_SIZE - TS_HEADER_SIZE;
+    start = UBASE_ERR_INVALID;
+    discontinuity = UBASE_ERR_INVALID;
+    nb_packets++;
+    upipe_input(upipe_ts_fastd, uref, NULL);
+    assert(!nb_packets);
+
+    upipe_release(upipe_ts_fastd);
+    upipe_mgr_release(upipe_ts_fastd_mgr); // nop
+
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
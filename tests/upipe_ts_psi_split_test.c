@@ -51,6 +51,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <assert.h>
@@ -90,6 +91,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
 struct test {
     uint16_t table_id;
     unsigned int nb_packets;
+    unsigned int expected;
     struct upipe upipe;
 };
 
@@ -102,6 +104,7 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
     upipe_init(&test->upipe, mgr, uprobe);
     test->table_id = 0;
     test->nb_packets = 0;
+    test->expected = 1;
     return &test->upipe;
 }
 
@@ -147,7 +150,7 @@ static int test_control(struct upipe *upipe, int command, va_list args)
 static void test_free(struct upipe *upipe)
 {
     struct test *test = container_of(upipe, struct test, upipe);
-    assert(test->nb_packets == 1);
+    assert(test->nb_packets == test->expected);
     upipe_clean(upipe);
     free(test);
 }
@@ -231,6 +234,26 @@ int main(int argc, char *argv[])
                                  "ts psi split output 69"), uref);
     assert(upipe_ts_psi_split_output69 != NULL);
     ubase_assert(upipe_set_output(upipe_ts_psi_split_output69, upipe_sink69));
+
+    psi_set_tableid(filter, 70);
+    psi_set_tableidext(mask, 0);
+    psi_set_tableidext(filter, 0);
+    ubase_assert(uref_ts_flow_set_psi_filter(uref, filter, mask,
+                                       PSI_HEADER_SIZE_SYNTAX1));
+    struct upipe *upipe_sink70 = upipe_void_alloc(&test_mgr,
+                                                  uprobe_use(uprobe_stdio));
+    assert(upipe_sink70 != NULL);
+    test_set_table(upipe_sink70, 70);
+    container_of(upipe_sink70, struct test, upipe)->expected = 2;
+
+    struct upipe *upipe_ts_psi_split_output70 =
+        upipe_flow_alloc_sub(upipe_ts_psi_split,
+                uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                                 "ts psi split output 70"), uref);
+    assert(upipe_ts_psi_split_output70 != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_psi_split_output70, upipe_sink70));
+    ubase_assert(upipe_ts_psi_split_sub_set_cache(upipe_ts_psi_split_output70,
+                                                  true));
     uref_free(uref);
 
     uint8_t *buffer;
@@ -268,6 +291,32 @@ int main(int argc, char *argv[])
     uref_block_unmap(uref, 0);
     upipe_input(upipe_ts_psi_split, uref, NULL);
 
+    /* identical sections are only output once when the cache is enabled */
+    for (int i = 0; i < 3; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, PSI_MAX_SIZE);
+        assert(uref != NULL);
+        size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        assert(size == PSI_MAX_SIZE);
+        memset(buffer, 0, PSI_MAX_SIZE);
+        psi_init(buffer, 1);
+        psi_set_tableid(buffer, 70);
+        psi_set_tableidext(buffer, 12);
+        psi_set_version(buffer, i == 2 ? 1 : 0);
+        psi_set_current(buffer);
+        psi_set_length(buffer, PSI_MAX_SIZE - PSI_HEADER_SIZE);
+        psi_set_crc(buffer);
+        uref_block_unmap(uref, 0);
+        upipe_input(upipe_ts_psi_split, uref, NULL);
+    }
+
+    uint64_t hits, misses;
+    ubase_assert(upipe_ts_psi_split_sub_get_cache_stats(
+                upipe_ts_psi_split_output70, &hits, &misses));
+    assert(hits == 1);
+    assert(misses == 2);
+
+    upipe_release(upipe_ts_psi_split_output70);
     upipe_release(upipe_ts_psi_split_output68);
     upipe_release(upipe_ts_psi_split_output69);
     upipe_release(upipe_ts_psi_split);
@@ -275,6 +324,7 @@ int main(int argc, char *argv[])
 
     test_free(upipe_sink68);
     test_free(upipe_sink69);
+    test_free(upipe_sink70);
 
     uref_mgr_release(uref_mgr);
     ubuf_mgr_release(ubuf_mgr);
@@ -233,6 +233,59 @@ int main(int argc, char *argv[])
     nb_packets++;
     upipe_release(upipe_ts_sync);
     assert(!nb_packets);
+
+    /* PID filter */
+    uref = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(uref != NULL);
+    upipe_ts_sync = upipe_void_alloc(upipe_ts_sync_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts sync filter"));
+    assert(upipe_ts_sync != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_sync, uref));
+    ubase_assert(upipe_set_output(upipe_ts_sync, upipe_sink));
+    uref_free(uref);
+    ubase_assert(upipe_ts_sync_set_pid_filter(upipe_ts_sync, true));
+    ubase_assert(upipe_ts_sync_add_pid(upipe_ts_sync, 68));
+    ubase_assert(upipe_ts_sync_add_pid(upipe_ts_sync, 69));
+    ubase_assert(upipe_ts_sync_del_pid(upipe_ts_sync, 69));
+    ubase_nassert(upipe_ts_sync_add_pid(upipe_ts_sync, 8192));
+
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 4 * TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == 4 * TS_SIZE);
+    for (int i = 0; i < 4; i++) {
+        ts_init(buffer + i * TS_SIZE);
+        ts_set_pid(buffer + i * TS_SIZE, i % 2 ? 69 : 68);
+    }
+    uref_block_unmap(uref, 0);
+    nb_packets += 2;
+    upipe_input(upipe_ts_sync, uref, NULL);
+    assert(!nb_packets);
+
+    uint64_t filtered;
+    ubase_assert(upipe_ts_sync_get_filtered(upipe_ts_sync, &filtered));
+    assert(filtered == 1);
+
+    /* a discontinuity flushes the last packet, which is filtered as well */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    ts_init(buffer);
+    ts_set_pid(buffer, 69);
+    uref_block_unmap(uref, 0);
+    uref_flow_set_discontinuity(uref);
+    upipe_input(upipe_ts_sync, uref, NULL);
+    assert(!nb_packets);
+    ubase_assert(upipe_ts_sync_get_filtered(upipe_ts_sync, &filtered));
+    assert(filtered == 2);
+
+    /* the packet of the discontinuity is filtered on release */
+    upipe_release(upipe_ts_sync);
+    assert(!nb_packets);
     upipe_mgr_release(upipe_ts_sync_mgr); // nop
 
     test_free(upipe_sink);
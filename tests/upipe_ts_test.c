@@ -106,6 +106,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEED_USTATS:
         case UPROBE_SYNC_ACQUIRED:
         case UPROBE_SYNC_LOST:
         case UPROBE_CLOCK_REF:
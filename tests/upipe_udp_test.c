@@ -113,6 +113,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
             break;
         case UPROBE_READY:
         case UPROBE_DEAD:
+        case UPROBE_NEED_USTATS:
         case UPROBE_NEW_FLOW_DEF:
         case UPROBE_SOURCE_END:
         case UPROBE_UDPSRC_NEW_PEER:
@@ -364,6 +365,26 @@ int main(int argc, char *argv[])
     assert(ret);
     ubase_assert(upipe_set_uri(upipe_udpsink, udp_uri+1));
 
+    /* switch to busy-poll after the first datagram */
+    uint64_t busy_poll;
+    ubase_assert(upipe_udpsrc_set_busy_poll(upipe_udpsrc, UCLOCK_FREQ));
+    ubase_assert(upipe_udpsrc_get_busy_poll(upipe_udpsrc, &busy_poll));
+    assert(busy_poll == UCLOCK_FREQ);
+
+#ifdef SO_BUSY_POLL
+    /* the socket option is set once busy-poll is enabled (this requires
+     * CAP_NET_ADMIN), and reset when it is disabled */
+    int udp_fd, usec;
+    socklen_t usec_len = sizeof(usec);
+    ubase_assert(upipe_udpsrc_get_fd(upipe_udpsrc, &udp_fd));
+    assert(!getsockopt(udp_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, &usec_len));
+    printf("SO_BUSY_POLL %d\n", usec);
+    ubase_assert(upipe_udpsrc_set_busy_poll(upipe_udpsrc, 0));
+    assert(!getsockopt(udp_fd, SOL_SOCKET, SO_BUSY_POLL, &usec, &usec_len));
+    assert(usec == 0);
+    ubase_assert(upipe_udpsrc_set_busy_poll(upipe_udpsrc, UCLOCK_FREQ));
+#endif
+
     /* redefine write pump */
     write_pump = upump_alloc_idler(upump_mgr, genpackets2, NULL, NULL);
     assert(write_pump);
@@ -372,6 +393,16 @@ int main(int argc, char *argv[])
     /* fire again */
     upump_mgr_run(upump_mgr, NULL);
 
+    struct upipe_udpsrc_poll_stats stats;
+    ubase_assert(upipe_udpsrc_get_poll_stats(upipe_udpsrc, &stats));
+    printf("wakeups %"PRIu64" polls %"PRIu64" empty %"PRIu64
+           " packets %"PRIu64" busy %"PRIu64"\n", stats.wakeups, stats.polls,
+           stats.empty_polls, stats.packets, stats.busy);
+    assert(stats.busy >= 1);
+    assert(stats.wakeups >= 1);
+    assert(stats.polls >= stats.empty_polls);
+    assert(stats.packets >= 210);
+
     /* release */
     upump_free(write_pump);
     upipe_release(upipe_udpsrc);
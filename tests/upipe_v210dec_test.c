@@ -61,7 +61,7 @@
 #define UBUF_ALIGN 32
 
 #define TEST_WIDTH 1920
-#define TEST_HEIGHT 1
+#define TEST_HEIGHT 16
 
 const char *v210_chroma = "u10y10v10y10u10y10v10y10u10y10v10y10";
 
@@ -316,6 +316,13 @@ int main(int argc, char **argv)
     assert(pic);
     upipe_input(v210dec, pic, 0);
 
+    /* send it again, converted by several threads */
+    test_sucessful = false;
+    ubase_assert(upipe_v210dec_set_threads(v210dec, 4));
+    pic = uref_dup(input_uref);
+    assert(pic);
+    upipe_input(v210dec, pic, 0);
+
     uref_free(in_flow_def);
     uref_free(out_flow_8);
     uref_free(out_flow_10);
@@ -58,7 +58,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
 
 #define TEST_WIDTH 1920
-#define TEST_HEIGHT 1
+#define TEST_HEIGHT 16
 
 #define VALUE_Y 64
 #define VALUE_U 128
@@ -298,6 +298,13 @@ int main(int argc, char **argv)
     assert(pic);
     upipe_input(v210enc, pic, 0);
 
+    /* send it again, converted by several threads */
+    test_sucessful = false;
+    ubase_assert(upipe_v210enc_set_threads(v210enc, 4));
+    pic = uref_dup(input_uref);
+    assert(pic);
+    upipe_input(v210enc, pic, 0);
+
     uref_free(in_flow_def);
     /* release v210enc pipe */
     uref_free(input_uref);
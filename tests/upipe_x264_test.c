@@ -59,6 +59,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH    0
@@ -72,11 +73,13 @@
 #define WIDTH               96
 #define HEIGHT              64
 #define LIMIT               60
+#define KEYINT              "10"
 
 
 /** phony pipe to test upipe_x264 */
 struct x264_test {
     int counter;
+    uint64_t last_dts;
     struct upipe upipe;
 };
 
@@ -91,6 +94,7 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
     assert(x264_test != NULL);
     upipe_init(&x264_test->upipe, mgr, uprobe);
     x264_test->counter = 0;
+    x264_test->last_dts = 0;
     upipe_throw_ready(&x264_test->upipe);
     return &x264_test->upipe;
 }
@@ -112,6 +116,9 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     }
     upipe_dbg_va(upipe, "received pic %d, pts: %"PRIu64" , dts: %"PRIu64,
                  x264_test->counter, pts, dts);
+    /* pictures must be output in decoding order in all modes */
+    assert(dts >= x264_test->last_dts);
+    x264_test->last_dts = dts;
     x264_test->counter++;
 
     uref_free(uref);
@@ -179,6 +186,36 @@ static void fill_pic(struct uref *uref, int counter)
     }
 }
 
+/* synthetic zoneplate, as upipe_zoneplate_source, for throughput tests */
+static void fill_zoneplate(struct uref *uref, int counter)
+{
+    size_t hsize, vsize;
+    uint8_t macropixel;
+    assert(ubase_check(uref_pic_size(uref, &hsize, &vsize, &macropixel)));
+
+    const char *chroma;
+    uref_pic_foreach_plane(uref, chroma) {
+        size_t stride;
+        uint8_t hsub, vsub, macropixel_size;
+        assert(ubase_check(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                   &macropixel_size)));
+        int hoctets = hsize * macropixel_size / hsub / macropixel;
+        int voctets = vsize / vsub;
+        uint8_t *buffer;
+        assert(ubase_check(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buffer)));
+
+        for (int y = 0; y < voctets; y++) {
+            int dy = y - voctets / 2;
+            for (int x = 0; x < hoctets; x++) {
+                int dx = x - hoctets / 2;
+                buffer[x] = ((dx * dx + dy * dy) * (counter + 1) / 64) & 0xff;
+            }
+            buffer += stride;
+        }
+        assert(ubase_check(uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1)));
+    }
+}
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -195,42 +232,24 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-int main(int argc, char **argv)
-{
-    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
-
-    struct uref *pic;
-    int counter;
-    uint64_t pts;
-
-    /* upipe env */
-    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
-    assert(umem_mgr != NULL);
-    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH, umem_mgr, -1, -1);
-    assert(udict_mgr != NULL);
-    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
-    assert(uref_mgr != NULL);
-    /* planar YUV (I420) */
-    struct ubuf_mgr *pic_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, 1,
-                                      UBUF_PREPEND, UBUF_APPEND,
-                                      UBUF_PREPEND, UBUF_APPEND,
-                                      UBUF_ALIGN, UBUF_ALIGN_OFFSET);
-    assert(pic_mgr != NULL);
-    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "y8", 1, 1, 1));
-    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "u8", 2, 2, 1));
-    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "v8", 2, 2, 1));
-
-    struct uprobe uprobe;
-    uprobe_init(&uprobe, catch, NULL);
-    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
-                                               UPROBE_LOG_LEVEL);
-    assert(logger != NULL);
-    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
-                                   UBUF_POOL_DEPTH);
-    assert(logger != NULL);
+/** encoding modes */
+enum mode {
+    MODE_DEFAULT,
+    MODE_SLICED,
+    MODE_CHUNKED
+};
 
-    /* x264 manager */
-    struct upipe_mgr *upipe_x264_mgr = upipe_x264_mgr_alloc();
+/** encodes pictures in the given mode, and returns the throughput */
+static double encode(enum mode mode, struct uref_mgr *uref_mgr,
+                     struct ubuf_mgr *pic_mgr, struct uprobe *logger,
+                     struct upipe_mgr *upipe_x264_mgr,
+                     int width, int height, int limit, bool zoneplate)
+{
+    static const char *const names[] = {
+        [MODE_DEFAULT] = "default",
+        [MODE_SLICED] = "sliced",
+        [MODE_CHUNKED] = "chunked"
+    };
 
     /* send flow definition */
     struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
@@ -238,8 +257,8 @@ int main(int argc, char **argv)
     ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
     ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
     ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
-    ubase_assert(uref_pic_flow_set_hsize(flow_def, WIDTH));
-    ubase_assert(uref_pic_flow_set_vsize(flow_def, HEIGHT));
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, width));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, height));
     struct urational fps = { .num = 25, .den = 1 };
     ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
 
@@ -263,23 +282,108 @@ int main(int argc, char **argv)
     ubase_assert(upipe_x264_set_default_preset(x264, "faster", NULL));
     ubase_assert(upipe_x264_set_profile(x264, "high"));
     ubase_assert(upipe_x264_set_default(x264));
+    ubase_assert(upipe_set_option(x264, "keyint", KEYINT));
+
+    switch (mode) {
+        case MODE_DEFAULT:
+            break;
+        case MODE_SLICED:
+            ubase_assert(upipe_set_option(x264, "bitrate", "1000"));
+            ubase_assert(upipe_x264_set_sliced_threads(x264, 4));
+            ubase_nassert(upipe_x264_set_chunked(x264, 2, 1));
+            break;
+        case MODE_CHUNKED:
+            ubase_nassert(upipe_x264_set_chunked(x264, 3, 0));
+            ubase_assert(upipe_x264_set_chunked(x264, 3, 1));
+            ubase_nassert(upipe_x264_set_sliced_threads(x264, 4));
+            break;
+    }
 
     /* encoding test */
-    for (counter = 0; counter < LIMIT; counter ++) {
-        printf("Sending pic %d\n", counter);
-        pic = uref_pic_alloc(uref_mgr, pic_mgr, WIDTH, HEIGHT);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int counter = 0; counter < limit; counter ++) {
+        struct uref *pic = uref_pic_alloc(uref_mgr, pic_mgr, width, height);
         assert(pic);
-        fill_pic(pic, counter);
-        pts = counter + 42;
+        if (zoneplate)
+            fill_zoneplate(pic, counter);
+        else
+            fill_pic(pic, counter);
+        uint64_t pts = counter + 42;
         uref_clock_set_pts_orig(pic, pts);
         uref_clock_set_pts_prog(pic, pts * UCLOCK_FREQ + UINT32_MAX);
         upipe_input(x264, pic, NULL);
     }
+    /* modes may not be changed once the encoder is opened */
+    ubase_nassert(upipe_x264_set_sliced_threads(x264, 0));
 
     /* release pipes */
     upipe_release(x264);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(x264_test_from_upipe(x264_test)->counter == limit);
     test_free(x264_test);
 
+    double duration = (end.tv_sec - begin.tv_sec) +
+                      (end.tv_nsec - begin.tv_nsec) / 1000000000.;
+    double throughput = duration > 0 ? limit / duration : 0;
+    printf("%s: %d pictures %dx%d, %.1f fps\n", names[mode], limit,
+           width, height, throughput);
+    return throughput;
+}
+
+/* usage: upipe_x264_test [<width> <height> <pictures>] runs the throughput
+ * benchmark on a zoneplate of the given size */
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
+
+    int width = WIDTH, height = HEIGHT, limit = LIMIT;
+    bool zoneplate = false;
+    if (argc >= 4) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+        limit = atoi(argv[3]);
+        zoneplate = true;
+        assert(width > 0 && height > 0 && limit > 0);
+    }
+
+    /* upipe env */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH, umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    /* planar YUV (I420) */
+    struct ubuf_mgr *pic_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, 1,
+                                      UBUF_PREPEND, UBUF_APPEND,
+                                      UBUF_PREPEND, UBUF_APPEND,
+                                      UBUF_ALIGN, UBUF_ALIGN_OFFSET);
+    assert(pic_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, "v8", 2, 2, 1));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               zoneplate ? UPROBE_LOG_NOTICE :
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    /* x264 manager */
+    struct upipe_mgr *upipe_x264_mgr = upipe_x264_mgr_alloc();
+
+    encode(MODE_DEFAULT, uref_mgr, pic_mgr, logger, upipe_x264_mgr,
+           width, height, limit, zoneplate);
+    encode(MODE_SLICED, uref_mgr, pic_mgr, logger, upipe_x264_mgr,
+           width, height, limit, zoneplate);
+    encode(MODE_CHUNKED, uref_mgr, pic_mgr, logger, upipe_x264_mgr,
+           width, height, limit, zoneplate);
+
     /* clean everything */
     upipe_mgr_release(upipe_x264_mgr); // noop
     ubuf_mgr_release(pic_mgr);
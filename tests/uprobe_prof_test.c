@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_prof implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prof.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_prof.h>
+#include <upipe/uaccount.h>
+#include <upipe/upipe_dump.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define NB_UREFS 10
+#define UREF_SIZE 188
+/** ticks burnt by the sink for each uref */
+#define SINK_TICKS 1000000
+
+static unsigned int nb_stats = 0;
+static uint64_t top_live = 0;
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_LOG:
+            break;
+        case UPROBE_PROF_STATS: {
+            const struct upipe_prof *prof =
+                va_arg(args, const struct upipe_prof *);
+            assert(prof->urefs == NB_UREFS);
+            assert(prof->bytes == NB_UREFS * UREF_SIZE);
+            if (prof->account != NULL)
+                top_live = uaccount_load(&prof->account->live);
+            nb_stats++;
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+struct test_pipe {
+    struct urefcount urefcount;
+    struct upipe *output;
+    struct uchain urefs;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+static void test_free(struct urefcount *urefcount)
+{
+    struct test_pipe *test_pipe =
+        container_of(urefcount, struct test_pipe, urefcount);
+    upipe_throw_dead(&test_pipe->upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&test_pipe->urefs, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        uref_free(uref_from_uchain(uchain));
+    }
+    upipe_release(test_pipe->output);
+    upipe_clean(&test_pipe->upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    urefcount_init(&test_pipe->urefcount, test_free);
+    test_pipe->upipe.refcount = &test_pipe->urefcount;
+    test_pipe->output = NULL;
+    ulist_init(&test_pipe->urefs);
+    upipe_throw_ready(&test_pipe->upipe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    if (test_pipe->output != NULL)
+        upipe_input(test_pipe->output, uref, upump_p);
+    else {
+        /* burn measurable time in the sink */
+        uint64_t start = upipe_prof_ticks();
+        while (upipe_prof_ticks() - start < SINK_TICKS);
+
+        /* keep a copy, charged to the sink */
+        uref_free(uref);
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, UREF_SIZE);
+        assert(uref != NULL);
+        ulist_add(&test_pipe->urefs, uref_to_uchain(uref));
+    }
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    switch (command) {
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            *p = test_pipe->output;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            upipe_release(test_pipe->output);
+            test_pipe->output = upipe_use(output);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('t','e','s','t'),
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_prof = uprobe_prof_alloc(uprobe_use(&uprobe));
+    assert(uprobe_prof != NULL);
+
+    struct upipe *source = upipe_void_alloc(&test_mgr, uprobe_use(uprobe_prof));
+    assert(source != NULL);
+    assert(source->prof != NULL);
+    struct upipe *sink = upipe_void_alloc_output(source, &test_mgr,
+                                                 uprobe_use(uprobe_prof));
+    assert(sink != NULL);
+    assert(sink->prof != NULL);
+    assert(source->prof->controls == 1);
+
+    for (unsigned int i = 0; i < NB_UREFS; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, UREF_SIZE);
+        assert(uref != NULL);
+        upipe_input(source, uref, NULL);
+    }
+    assert(source->prof->urefs == NB_UREFS);
+    assert(sink->prof->urefs == NB_UREFS);
+    assert(sink->prof->bytes == NB_UREFS * UREF_SIZE);
+    assert(source->prof->input_max <= source->prof->input_ticks);
+    /* the time spent in the sink is not charged to the source */
+    assert(sink->prof->input_ticks >= NB_UREFS * SINK_TICKS);
+    assert(sink->prof->input_max >= SINK_TICKS);
+    assert(source->prof->input_ticks * 10 < sink->prof->input_ticks);
+
+    struct uaccount *account = sink->prof->account;
+    assert(account != NULL);
+    assert(uaccount_load(&account->urefs) == NB_UREFS);
+    assert(uaccount_load(&account->ubufs) == NB_UREFS);
+    assert(uaccount_load(&account->umems) == NB_UREFS);
+    assert(uaccount_load(&account->live) >= NB_UREFS * UREF_SIZE);
+    assert(uaccount_load(&account->bytes) == uaccount_load(&account->live));
+    assert(uaccount_load(&source->prof->account->live) == 0);
+    assert(uaccount_load(&source->prof->account->urefs) == 0);
+    /* allocations outside of the pipes are not charged */
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, UREF_SIZE);
+    assert(uref != NULL);
+    assert(uaccount_load(&account->urefs) == NB_UREFS);
+    uref_free(uref);
+
+    uprobe_prof_snapshot(uprobe_prof);
+    assert(nb_stats == 2);
+    ubase_assert(uprobe_prof_snapshot_top(uprobe_prof, 1));
+    assert(nb_stats == 3);
+    assert(top_live >= NB_UREFS * UREF_SIZE);
+
+    ubase_assert(upipe_dump_prof(stdout, NULL, source, NULL));
+
+    uprobe_prof_reset(uprobe_prof);
+    assert(source->prof->urefs == 0);
+    assert(source->prof->input_ticks == 0);
+    assert(uaccount_load(&account->urefs) == 0);
+    assert(uaccount_load(&account->live) >= NB_UREFS * UREF_SIZE);
+
+    /* the account survives the pipe as long as its buffers */
+    struct uchain *uchain = ulist_pop(&container_of(sink, struct test_pipe,
+                                                    upipe)->urefs);
+    assert(uchain != NULL);
+    uref = uref_from_uchain(uchain);
+    uaccount_use(account);
+
+    upipe_release(sink);
+    upipe_release(source);
+    assert(uaccount_load(&account->live) >= UREF_SIZE);
+    uref_free(uref);
+    assert(uaccount_load(&account->live) == 0);
+    uaccount_release(account);
+
+    uprobe_release(uprobe_prof);
+    uprobe_clean(&uprobe);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
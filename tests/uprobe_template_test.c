@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_template implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_template.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/upipe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/urequest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 5
+
+static struct uref *flow_def;
+static unsigned int nb_requests = 0;
+static unsigned int nb_answers = 0;
+static unsigned int nb_uref_mgr_requests = 0;
+static unsigned int nb_uref_mgr_answers = 0;
+static unsigned int nb_latency_requests = 0;
+static struct ubuf_mgr *previous_ubuf_mgr = NULL;
+
+/** definition of our uprobe, counting the requests reaching it */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    if (event == UPROBE_PROVIDE_REQUEST) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        struct urequest *urequest = va_arg(args_copy, struct urequest *);
+        va_end(args_copy);
+        switch (urequest->type) {
+            case UREQUEST_UREF_MGR:
+                nb_uref_mgr_requests++;
+                break;
+            case UREQUEST_SINK_LATENCY:
+                nb_latency_requests++;
+                return urequest_provide_sink_latency(urequest, 42);
+            default:
+                nb_requests++;
+                break;
+        }
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** helper phony pipe */
+struct test_pipe {
+    struct urefcount urefcount;
+    struct upipe *output;
+    struct urequest request;
+    struct urequest uref_mgr_request;
+    struct urequest latency_request;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+static int test_provide_uref_mgr(struct urequest *urequest, va_list args)
+{
+    struct uref_mgr *m = va_arg(args, struct uref_mgr *);
+    assert(m != NULL);
+    uref_mgr_release(m);
+    nb_uref_mgr_answers++;
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static int test_provide_latency(struct urequest *urequest, va_list args)
+{
+    uint64_t latency = va_arg(args, uint64_t);
+    assert(latency == 42);
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static int test_provide_ubuf_mgr(struct urequest *urequest, va_list args)
+{
+    struct ubuf_mgr *m = va_arg(args, struct ubuf_mgr *);
+    struct uref *flow_format = va_arg(args, struct uref *);
+    assert(m != NULL);
+    assert(flow_format != NULL);
+    if (previous_ubuf_mgr != NULL)
+        assert(m == previous_ubuf_mgr);
+    previous_ubuf_mgr = m;
+
+    struct ubuf *ubuf = ubuf_pic_alloc(m, 32, 32);
+    assert(ubuf != NULL);
+    ubuf_free(ubuf);
+    ubuf_mgr_release(m);
+    uref_free(flow_format);
+    nb_answers++;
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    struct upipe *upipe = &test_pipe->upipe;
+    upipe_init(upipe, mgr, uprobe);
+    test_pipe->output = NULL;
+    urequest_init_ubuf_mgr(&test_pipe->request, uref_dup(flow_def),
+                           test_provide_ubuf_mgr, NULL);
+    ubase_assert(upipe_throw_provide_request(upipe, &test_pipe->request));
+    urequest_init_uref_mgr(&test_pipe->uref_mgr_request,
+                           test_provide_uref_mgr, NULL);
+    ubase_assert(upipe_throw_provide_request(upipe,
+                                             &test_pipe->uref_mgr_request));
+    urequest_init_sink_latency(&test_pipe->latency_request,
+                               test_provide_latency, NULL);
+    ubase_assert(upipe_throw_provide_request(upipe,
+                                             &test_pipe->latency_request));
+    return upipe;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    switch (command) {
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            *p = test_pipe->output;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            upipe_release(test_pipe->output);
+            test_pipe->output = upipe_use(output);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            *p = flow_def;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct urefcount *urefcount)
+{
+    struct test_pipe *test_pipe =
+        container_of(urefcount, struct test_pipe, urefcount);
+    struct upipe *upipe = &test_pipe->upipe;
+    upipe_release(test_pipe->output);
+    urequest_clean(&test_pipe->request);
+    urequest_clean(&test_pipe->uref_mgr_request);
+    urequest_clean(&test_pipe->latency_request);
+    upipe_clean(upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc_refcount(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = test_alloc(mgr, uprobe, signature, args);
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    urefcount_init(&test_pipe->urefcount, test_free);
+    upipe->refcount = &test_pipe->urefcount;
+    return upipe;
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc_refcount,
+    .upipe_input = NULL,
+    .upipe_control = test_control
+};
+
+/** helper phony pipe */
+static struct upipe_mgr test_sink_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc_refcount,
+    .upipe_input = NULL,
+    .upipe_control = test_control
+};
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch,
+                uprobe_ubuf_mem_alloc(uprobe_uref_mgr_alloc(NULL, uref_mgr),
+                                      umem_mgr, UBUF_POOL_DEPTH,
+                                      UBUF_POOL_DEPTH));
+    assert(uprobe.next != NULL);
+    struct uprobe *uprobe_template = uprobe_template_alloc(uprobe_use(&uprobe));
+    assert(uprobe_template != NULL);
+
+    flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, 32));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, 32));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+
+    /* first negotiation, forwarded to the next probe */
+    struct upipe *source = upipe_void_alloc(&test_mgr,
+                                            uprobe_use(uprobe_template));
+    assert(source != NULL);
+    struct upipe *sink = upipe_void_alloc_output(source, &test_sink_mgr,
+                                                 uprobe_use(uprobe_template));
+    assert(sink != NULL);
+    assert(nb_requests == 1);
+    assert(nb_answers == 2);
+    /* requests without uref are recorded per manager */
+    assert(nb_uref_mgr_requests == 2);
+    assert(nb_uref_mgr_answers == 2);
+    assert(nb_latency_requests == 2);
+
+    unsigned int answers, nodes;
+    uprobe_template_get_stats(uprobe_template, &answers, &nodes);
+    assert(answers == 3);
+    assert(nodes == 0);
+
+    ubase_assert(uprobe_template_capture(uprobe_template, NULL,
+                                         source, NULL));
+    uprobe_template_get_stats(uprobe_template, &answers, &nodes);
+    assert(answers == 3);
+    assert(nodes == 2);
+    upipe_release(sink);
+    upipe_release(source);
+
+    ubase_assert(uprobe_template_prealloc(uprobe_template, 0));
+    ubase_assert(uprobe_template_prealloc(uprobe_template, 3));
+
+    /* second instantiation, answered from the template */
+    source = upipe_void_alloc(&test_mgr, uprobe_use(uprobe_template));
+    assert(source != NULL);
+    ubase_assert(uprobe_template_alloc_output(uprobe_template, source,
+                                              uprobe_use(uprobe_template),
+                                              &sink));
+    assert(sink != NULL);
+    assert(sink != source);
+    assert(sink->mgr == &test_sink_mgr);
+    struct upipe *output = NULL;
+    ubase_assert(upipe_get_output(source, &output));
+    assert(output == sink);
+    assert(nb_requests == 1);
+    assert(nb_answers == 4);
+    assert(nb_uref_mgr_requests == 2);
+    assert(nb_uref_mgr_answers == 4);
+    /* the sink latency is never replayed */
+    assert(nb_latency_requests == 4);
+    upipe_release(sink);
+    upipe_release(source);
+
+    uprobe_template_vacuum(uprobe_template);
+    uprobe_template_get_stats(uprobe_template, &answers, &nodes);
+    assert(answers == 0);
+    assert(nodes == 0);
+
+    uprobe_release(uprobe_template);
+    uref_free(flow_def);
+    uprobe_clean(&uprobe);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -34,6 +34,7 @@
 #include <upipe/upipe.h>
 #include <upipe/umem.h>
 #include <upipe/umem_alloc.h>
+#include <upipe/umem_pool.h>
 #include <upipe/udict.h>
 #include <upipe/udict_inline.h>
 #include <upipe/uref.h>
@@ -262,6 +263,49 @@ int main(int argc, char **argv)
     previous_ubuf_mgr = NULL;
 
     uprobe_release(uprobe);
+
+    /* pre-allocation of pictures in a umem pool */
+    struct umem_mgr *umem_pool_mgr = umem_pool_mgr_alloc_simple(32);
+    assert(umem_pool_mgr != NULL);
+    ubase_assert(umem_pool_mgr_enable_stats(umem_pool_mgr));
+    struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool =
+        uprobe_ubuf_mem_pool_from_uprobe(uprobe_ubuf_mem_pool_alloc(NULL,
+                    umem_pool_mgr, UBUF_POOL_DEPTH, UBUF_POOL_DEPTH));
+    assert(uprobe_ubuf_mem_pool != NULL);
+    flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_set_align(flow_def, 16));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+    ubase_assert(uprobe_ubuf_mem_pool_prealloc_pic(uprobe_ubuf_mem_pool,
+                                                   flow_def, 32, 32, 4));
+
+    unsigned int kept = 0, hits = 0, pool;
+    struct umem_pool_stats stats;
+    for (pool = 0; ubase_check(uprobe_ubuf_mem_pool_get_stats(
+                    uprobe_ubuf_mem_pool, pool, &stats)); pool++) {
+        kept += stats.kept;
+        hits += stats.hits;
+    }
+    assert(kept == 4);
+    assert(hits == 0);
+
+    /* warm buffers are reused */
+    ubase_assert(uprobe_ubuf_mem_pool_prealloc_pic(uprobe_ubuf_mem_pool,
+                                                   flow_def, 32, 32, 4));
+    kept = hits = 0;
+    for (pool = 0; ubase_check(uprobe_ubuf_mem_pool_get_stats(
+                    uprobe_ubuf_mem_pool, pool, &stats)); pool++) {
+        kept += stats.kept;
+        hits += stats.hits;
+    }
+    assert(kept == 4);
+    assert(hits == 4);
+    uref_free(flow_def);
+
+    uprobe_release(uprobe_ubuf_mem_pool_to_uprobe(uprobe_ubuf_mem_pool));
+    umem_mgr_release(umem_pool_mgr);
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for uprobe_uref_trace implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/upipe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_trace.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_uref_stream.h>
+#include <upipe/upump_trace.h>
+#include <upipe-modules/upipe_probe_uref.h>
+#include <upipe-modules/uprobe_uref_trace.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define NB_UREFS 10
+#define SAMPLE 2
+#define DELAY 1000
+#define BLOCK_SIZE 100
+
+static unsigned int nb_urefs = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_LOG:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_PROBE_UREF:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+struct test_pipe {
+    struct urefcount urefcount;
+    struct upipe *output;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+static void test_free(struct urefcount *urefcount)
+{
+    struct test_pipe *test_pipe =
+        container_of(urefcount, struct test_pipe, urefcount);
+    upipe_throw_dead(&test_pipe->upipe);
+    upipe_release(test_pipe->output);
+    upipe_clean(&test_pipe->upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    urefcount_init(&test_pipe->urefcount, test_free);
+    test_pipe->upipe.refcount = &test_pipe->urefcount;
+    test_pipe->output = NULL;
+    upipe_throw_ready(&test_pipe->upipe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe, holding the urefs for some time */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    if (test_pipe->output != NULL) {
+        usleep(DELAY);
+        upipe_input(test_pipe->output, uref, upump_p);
+    } else {
+        assert(!uref_trace_check(uref));
+        nb_urefs++;
+        uref_free(uref);
+    }
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            *p = test_pipe->output;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            upipe_release(test_pipe->output);
+            test_pipe->output = upipe_use(output);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('t','e','s','t'),
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper phony framer */
+struct test_stream {
+    struct uref *next_uref;
+    size_t next_uref_size;
+    struct uchain urefs;
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(test_stream, upipe, UBASE_FOURCC('t','e','s','t'))
+UPIPE_HELPER_UREF_STREAM(test_stream, next_uref, next_uref_size, urefs, NULL)
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+
+    /* stamps */
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    struct uref_trace_stamp stamps[UREF_TRACE_STAMPS];
+    size_t nb;
+    assert(!uref_trace_check(uref));
+    ubase_nassert(uref_trace_get(uref, stamps, &nb));
+    ubase_assert(uref_trace_start(uref));
+    ubase_assert(uref_trace_get(uref, stamps, &nb));
+    assert(nb == 0);
+    for (unsigned int i = 0; i < UREF_TRACE_STAMPS + 1; i++)
+        uref_trace_stamp(uref, i);
+    struct uref *dup = uref_dup(uref);
+    assert(dup != NULL);
+    uref_free(uref);
+    assert(uref_trace_check(dup));
+    ubase_assert(uref_trace_get(dup, stamps, &nb));
+    assert(nb == UREF_TRACE_STAMPS);
+    for (unsigned int i = 0; i < UREF_TRACE_STAMPS; i++) {
+        assert(stamps[i].signature == i);
+        assert(!i || stamps[i].date >= stamps[i - 1].date);
+    }
+    uref_trace_stop(dup);
+    assert(!uref_trace_check(dup));
+    ubase_assert(uref_trace_start(dup));
+    uref_trace_stamp(dup, 0);
+
+    /* importing the attributes keeps the trace */
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_attr_import(uref, dup));
+    assert(uref_trace_check(uref));
+    ubase_assert(uref_trace_get(uref, stamps, &nb));
+    assert(nb == 1);
+    uref_free(uref);
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_trace_import(uref, dup));
+    assert(uref_trace_check(uref));
+    ubase_assert(uref_trace_get(uref, stamps, &nb));
+    assert(nb == 1);
+    uref_free(uref);
+
+    /* framers pass the trace to the frame containing the start of a uref */
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(0, 0, umem_mgr,
+                                                         0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct test_stream test_stream;
+    struct upipe *stream = test_stream_to_upipe(&test_stream);
+    upipe_init(stream, &test_mgr, NULL);
+    test_stream_init_uref_stream(stream);
+    for (unsigned int i = 0; i < 3; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, BLOCK_SIZE);
+        assert(uref != NULL);
+        if (i == 1)
+            ubase_assert(uref_trace_import(uref, dup));
+        test_stream_append_uref_stream(stream, uref);
+    }
+    uref = test_stream_extract_uref_stream(stream, BLOCK_SIZE * 3 / 2);
+    assert(uref != NULL);
+    assert(uref_trace_check(uref));
+    uref_free(uref);
+    uref = test_stream_extract_uref_stream(stream, BLOCK_SIZE * 3 / 2);
+    assert(uref != NULL);
+    assert(!uref_trace_check(uref));
+    uref_free(uref);
+    test_stream_clean_uref_stream(stream);
+    upipe_clean(stream);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_free(dup);
+
+    /* sampler -> test -> collector -> sink */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *sampler = uprobe_uref_trace_alloc(uprobe_use(&uprobe),
+                                                     SAMPLE);
+    assert(sampler != NULL);
+    struct uprobe *collector = uprobe_uref_trace_alloc(uprobe_use(&uprobe), 0);
+    assert(collector != NULL);
+
+    struct upipe_mgr *upipe_probe_uref_mgr = upipe_probe_uref_mgr_alloc();
+    assert(upipe_probe_uref_mgr != NULL);
+    struct uref *flow_def = uref_alloc_control(uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(uref_flow_set_def(flow_def, "void."));
+    struct upipe *source = upipe_void_alloc(upipe_probe_uref_mgr,
+                                            uprobe_use(sampler));
+    assert(source != NULL);
+    struct upipe *middle = upipe_void_alloc_output(source, &test_mgr,
+                                                   uprobe_use(&uprobe));
+    assert(middle != NULL);
+    struct upipe *probe = upipe_void_alloc(upipe_probe_uref_mgr,
+                                           uprobe_use(collector));
+    assert(probe != NULL);
+    ubase_assert(upipe_set_output(middle, probe));
+    struct upipe *sink = upipe_void_alloc_output(probe, &test_mgr,
+                                                 uprobe_use(&uprobe));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_flow_def(source, flow_def));
+    /* declare less latency than the middle pipe adds */
+    uref_clock_set_latency(flow_def, DELAY * (UCLOCK_FREQ / 1000000) / 2);
+    ubase_assert(upipe_set_flow_def(probe, flow_def));
+    uref_free(flow_def);
+
+    for (unsigned int i = 0; i < NB_UREFS; i++) {
+        uref = uref_alloc(uref_mgr);
+        assert(uref != NULL);
+        upipe_input(source, uref, NULL);
+    }
+    assert(nb_urefs == NB_UREFS);
+
+    struct uprobe_uref_trace *uprobe_uref_trace =
+        uprobe_uref_trace_from_uprobe(collector);
+    assert(uprobe_uref_trace->total.count == NB_UREFS / SAMPLE);
+    assert(uprobe_uref_trace->total.total >=
+           NB_UREFS / SAMPLE * DELAY * (UCLOCK_FREQ / 1000000));
+    assert(!ulist_empty(&uprobe_uref_trace->hops));
+    struct uprobe_uref_trace_hop *hop =
+        uprobe_uref_trace_hop_from_uchain(ulist_peek(&uprobe_uref_trace->hops));
+    assert(hop->index == 0);
+    assert(hop->signature == test_mgr.signature);
+    assert(hop->next_signature == UPIPE_PROBE_UREF_SIGNATURE);
+    assert(hop->hist.count == NB_UREFS / SAMPLE);
+    assert(uprobe_uref_trace->latency ==
+           DELAY * (UCLOCK_FREQ / 1000000) / 2);
+    assert(uprobe_uref_trace->exceeded == NB_UREFS / SAMPLE);
+    uprobe_uref_trace_print(collector);
+
+    uprobe_uref_trace_reset(collector);
+    assert(ulist_empty(&uprobe_uref_trace->hops));
+    assert(uprobe_uref_trace->total.count == 0);
+    assert(uprobe_uref_trace->exceeded == 0);
+
+    upipe_release(sink);
+    upipe_release(probe);
+    upipe_release(middle);
+    upipe_release(source);
+    upipe_mgr_release(upipe_probe_uref_mgr);
+
+    uprobe_release(collector);
+    uprobe_release(sampler);
+    uprobe_clean(&uprobe);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
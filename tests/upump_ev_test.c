@@ -29,8 +29,11 @@
 
 #undef NDEBUG
 
+#include <upipe/upump_trace.h>
 #include <upump-ev/upump_ev.h>
 
+#include <assert.h>
+
 #include "upump_common_test.h"
 
 #define UPUMP_POOL 1
@@ -39,5 +42,26 @@
 int main(int argc, char **argv)
 {
     run(upump_ev_mgr_alloc_default(UPUMP_POOL, UPUMP_BLOCKER_POOL));
+
+    /* same run with dispatch tracing */
+    struct upump_trace trace;
+    upump_trace_init(&trace, NULL);
+    /* keep all dispatches in the ring */
+    trace.threshold = 0;
+
+    struct upump_mgr *mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
+                                                       UPUMP_BLOCKER_POOL);
+    assert(mgr != NULL);
+    ubase_assert(upump_mgr_set_trace(mgr, &trace));
+    run(mgr);
+
+    assert(trace.dispatch.count);
+    assert(trace.lateness.count);
+    assert(trace.iteration.count);
+    assert(!ulist_empty(&trace.pumps));
+    const struct upump_trace_slow *slow = upump_trace_get_slow(&trace, 0);
+    assert(slow != NULL);
+    assert(slow->cb != NULL);
+    upump_trace_clean(&trace);
     return 0;
 }
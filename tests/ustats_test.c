@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2016 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for ustats and uprobe_ustats
+ */
+
+#undef NDEBUG
+
+#include <upipe/ustats.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_ustats.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/upipe.h>
+#include <upipe/umem.h>
+#include <upipe/umem_pool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define NB_RECORDS 4
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_LOG:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = UBASE_FOURCC('t','e','s','t'),
+    .upipe_alloc = test_alloc,
+    .upipe_input = NULL,
+    .upipe_control = NULL
+};
+
+int main(int argc, char **argv)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/upipe-ustats-test-%u",
+             (unsigned int)getpid());
+
+    /* segment */
+    struct ustats *ustats = ustats_create(name, NB_RECORDS);
+    assert(ustats != NULL);
+    struct ustats *reader = ustats_attach(name);
+    assert(reader != NULL);
+    assert(ustats_nb_records(reader) == NB_RECORDS);
+    assert(ustats_register(reader, USTATS_COUNTER, "read-only") == NULL);
+
+    struct ustats_record *counter =
+        ustats_register(ustats, USTATS_COUNTER, "foo.%s", "errors");
+    assert(counter != NULL);
+    struct ustats_record *ratio =
+        ustats_register(ustats, USTATS_RATIO, "foo.padding");
+    assert(ratio != NULL);
+    ustats_counter_add(counter, 3);
+    ustats_counter_add(counter, 2);
+    ustats_ratio_add(ratio, 1, 4);
+    ustats_counter_add(NULL, 1);
+
+    struct ustats_sample sample;
+    ubase_assert(ustats_read(reader, 0, &sample));
+    assert(sample.type == USTATS_COUNTER);
+    assert(!strcmp(sample.name, "foo.errors"));
+    assert(sample.value == 5);
+    ubase_assert(ustats_read(reader, 1, &sample));
+    assert(sample.type == USTATS_RATIO);
+    assert(sample.value == 1);
+    assert(sample.total == 4);
+    ubase_nassert(ustats_read(reader, 2, &sample));
+    ubase_nassert(ustats_read(reader, NB_RECORDS, &sample));
+
+    /* records are reused */
+    ustats_unregister(counter);
+    ubase_nassert(ustats_read(reader, 0, &sample));
+    struct ustats_record *gauge = ustats_register(ustats, USTATS_GAUGE, "bar");
+    assert(gauge == counter);
+    ustats_gauge_set(gauge, 42);
+    ubase_assert(ustats_read(reader, 0, &sample));
+    assert(sample.type == USTATS_GAUGE);
+    assert(sample.value == 42);
+
+    assert(ustats_register(ustats, USTATS_GAUGE, "1") != NULL);
+    assert(ustats_register(ustats, USTATS_GAUGE, "2") != NULL);
+    assert(ustats_register(ustats, USTATS_GAUGE, "3") == NULL);
+
+    ustats_close(reader);
+    ustats_close(ustats);
+    assert(ustats_attach(name) == NULL);
+
+    /* probe */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_ustats = uprobe_ustats_alloc(uprobe_use(&uprobe),
+                                                       name, 0);
+    assert(uprobe_ustats != NULL);
+    reader = ustats_attach(name);
+    assert(reader != NULL);
+
+    struct upipe *upipe = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_ustats), UPROBE_LOG_ERROR,
+                             "pipe"));
+    assert(upipe != NULL);
+    struct ustats_record *record =
+        upipe_ustats_register(upipe, USTATS_COUNTER, "drops");
+    assert(record != NULL);
+    ubase_assert(ustats_read(reader, 0, &sample));
+    assert(!strcmp(sample.name, "pipe.drops"));
+    ustats_unregister(record);
+    test_free(upipe);
+
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc(32, 2, 1, 1);
+    assert(umem_mgr != NULL);
+    ubase_assert(umem_pool_mgr_enable_stats(umem_mgr));
+    ubase_assert(uprobe_ustats_add_umem_mgr(uprobe_ustats, umem_mgr, "umem"));
+    struct umem umem;
+    assert(umem_alloc(umem_mgr, &umem, 32));
+    umem_free(&umem);
+    assert(umem_alloc(umem_mgr, &umem, 32));
+    umem_free(&umem);
+    uprobe_ustats_update(uprobe_ustats);
+    ubase_assert(ustats_read(reader, 0, &sample));
+    assert(!strcmp(sample.name, "umem.32.hit_rate"));
+    assert(sample.type == USTATS_RATIO);
+    assert(sample.value == 1);
+    assert(sample.total == 2);
+    umem_mgr_release(umem_mgr);
+
+    ustats_close(reader);
+    uprobe_release(uprobe_ustats);
+    uprobe_clean(&uprobe);
+    return 0;
+}